@@ -0,0 +1,134 @@
+#!/bin/bash
+# Quality-vs-speed sweep: renders each input through every pipeline
+# configuration (variant x demosaic x denoise on/off x CA correction on/off,
+# plus the original camera_pipe app in camera_pipe/) and measures each
+# render's time, pipeline heap peak, and PSNR, SSIM and mean CIEDE2000
+# against a high-quality process_f32 render of the same input. Then
+# quality_report (src/quality_report.cpp) averages over the inputs, marks
+# the Pareto front of time against delta E and plots it.
+#
+#   ./benchmark_quality.sh bayer_raw.png
+#   DEMOSAICS="fast ahd" VARIANTS="f32 u16" ./benchmark_quality.sh shots/*.dng
+#
+# Writes $OUT_DIR/results.csv (a row per config and input),
+# $OUT_DIR/summary.csv (a row per config, with a pareto column) and
+# $OUT_DIR/pareto.svg. Variants: f32, u16, f16 (needs BUILD_F16_PIPELINE),
+# f32-fastmath (process_f32 rebuilt with FAST_COLOR_MATH in
+# $BUILD_DIR-fastmath) and ref (camera_pipe/; 16-bit Bayer PNG inputs only,
+# and no heap figure). The reference's color processing differs from
+# process's, so its delta E includes that as well as its demosaic.
+#
+# Note: This script is compatible with Bash 3.x (default on macOS) and newer versions.
+set -e # Exit immediately if a command exits with a non-zero status.
+
+BUILD_DIR="build"
+OUT_DIR=${OUT_DIR:-quality_report}
+ITERATIONS=${ITERATIONS:-5}
+VARIANTS=${VARIANTS:-"f32 u16 f16 f32-fastmath ref"}
+DEMOSAICS=${DEMOSAICS:-"fast ahd lmmse ri adaptive"}
+REFERENCE_ARGS=${REFERENCE_ARGS:-"--demosaic ahd --ca-strength 1 --denoise-strength 50"}
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <raw file>..." >&2
+    exit 1
+fi
+
+if [ ! -d "$BUILD_DIR" ] || [ ! -f "$BUILD_DIR/CMakeCache.txt" ]; then
+    echo "Error: Build directory '$BUILD_DIR' not found or not configured." >&2
+    echo "Please run 'cmake -S . -B $BUILD_DIR -DHalide_DIR=...' at least once before running this script." >&2
+    exit 1
+fi
+
+BUILD_JOBS=$( (which nproc > /dev/null && nproc) || sysctl -n hw.ncpu )
+HALIDE_DIR=$(sed -n 's/^Halide_DIR:[A-Z]*=//p' "$BUILD_DIR/CMakeCache.txt")
+
+cmake -B "$BUILD_DIR" -DBUILD_QUALITY_REPORT=ON > /dev/null
+TARGETS="process_f32 quality_report"
+case " $VARIANTS " in *" u16 "*) TARGETS="$TARGETS process_u16" ;; esac
+case " $VARIANTS " in
+    *" f16 "*)
+        if grep -q "^BUILD_F16_PIPELINE:BOOL=ON" "$BUILD_DIR/CMakeCache.txt"; then
+            TARGETS="$TARGETS process_f16"
+        else
+            echo "Note: skipping f16; configure with -DBUILD_F16_PIPELINE=ON to include it." >&2
+            VARIANTS=$(echo " $VARIANTS " | sed 's/ f16 / /')
+        fi
+        ;;
+esac
+cmake --build "$BUILD_DIR" --target $TARGETS -- -j$BUILD_JOBS > /dev/null
+
+case " $VARIANTS " in
+    *" f32-fastmath "*)
+        cmake -S . -B "$BUILD_DIR-fastmath" -DHalide_DIR="$HALIDE_DIR" -DFAST_COLOR_MATH=ON > /dev/null
+        cmake --build "$BUILD_DIR-fastmath" --target process_f32 -- -j$BUILD_JOBS > /dev/null
+        ;;
+esac
+case " $VARIANTS " in
+    *" ref "*)
+        cmake -S camera_pipe -B camera_pipe/build -DHalide_DIR="$HALIDE_DIR" > /dev/null
+        cmake --build camera_pipe/build --target process -- -j$BUILD_JOBS > /dev/null
+        ;;
+esac
+
+mkdir -p "$OUT_DIR"
+RESULTS="$OUT_DIR/results.csv"
+echo "config,image,time_ms,peak_mb,psnr_db,ssim,delta_e" > "$RESULTS"
+RENDER="$OUT_DIR/render.png"
+
+# Adds a row to results.csv for $RENDER: config, input, time, peak MB.
+record() {
+    QUALITY=$("$BUILD_DIR/quality_report" compare "$REFERENCE" "$RENDER")
+    echo "$1,$(basename "$2"),$3,$4,$QUALITY" >> "$RESULTS"
+    printf "%-28s %-24s %10.2f ms  %s\n" "$1" "$(basename "$2")" "$3" "$QUALITY"
+}
+
+for INPUT in "$@"; do
+    RAW_PNG=""
+    case "$INPUT" in *.png|*.PNG) RAW_PNG="--raw-png" ;; esac
+    REFERENCE="$OUT_DIR/reference_$(basename "${INPUT%.*}").png"
+    "$BUILD_DIR/process_f32" --input "$INPUT" $RAW_PNG --output "$REFERENCE" --iterations 1 $REFERENCE_ARGS > /dev/null
+
+    for VARIANT in $VARIANTS; do
+        if [ "$VARIANT" = "ref" ]; then
+            if [ -z "$RAW_PNG" ]; then
+                echo "Note: camera_pipe reads 16-bit Bayer PNGs only; no reference run for $INPUT" >&2
+                continue
+            fi
+            US=$(camera_pipe/build/process "$INPUT" 3700 2.0 50 1.0 "$ITERATIONS" "$RENDER" 2>&1 |
+                 sed -n 's/^Halide (manual):[[:space:]]*\([0-9.e+]*\)us$/\1/p')
+            record "camera_pipe" "$INPUT" "$(awk -v us="$US" 'BEGIN { print us / 1000 }')" ""
+            continue
+        fi
+        case "$VARIANT" in
+            f32-fastmath) PROCESS="$BUILD_DIR-fastmath/process_f32" ;;
+            *) PROCESS="$BUILD_DIR/process_$VARIANT" ;;
+        esac
+        for DEMOSAIC in $DEMOSAICS; do
+            for DENOISE in 0 50; do
+                for CA in 0 1; do
+                    ARGS="--input $INPUT $RAW_PNG --demosaic $DEMOSAIC --denoise-strength $DENOISE --ca-strength $CA"
+                    MS=$("$PROCESS" $ARGS --output "$RENDER" --iterations "$ITERATIONS" |
+                         sed -n 's/^Halide pipeline execution time: \([0-9.]*\) ms$/\1/p')
+                    if [ -z "$MS" ]; then
+                        echo "Error: no timing from $PROCESS $ARGS" >&2
+                        exit 1
+                    fi
+                    # The heap is counted in a run of its own, so the count doesn't slow the timed ones.
+                    PEAK=$("$PROCESS" $ARGS --output "$RENDER" --iterations 1 --mem-report |
+                           sed -n 's/^Pipeline heap over .* peak \([0-9.]*\) MB.*$/\1/p')
+                    DN=off; [ "$DENOISE" != 0 ] && DN=on
+                    CAC=off; [ "$CA" != 0 ] && CAC=on
+                    record "$VARIANT/$DEMOSAIC/denoise-$DN/ca-$CAC" "$INPUT" "$MS" "$PEAK"
+                done
+            done
+        done
+    done
+done
+rm -f "$RENDER"
+
+"$BUILD_DIR/quality_report" pareto "$RESULTS" "$OUT_DIR/pareto.svg" > "$OUT_DIR/summary.csv"
+echo
+echo "Pareto front (mean over inputs):"
+awk -F, 'NR > 1 && $8 == 1 { printf "  %-28s %10.2f ms  dE %6.3f  PSNR %6.2f dB  SSIM %.4f\n", $1, $3, $7, $5, $6 }' \
+    "$OUT_DIR/summary.csv" | sort -k2 -n
+echo "Wrote $RESULTS, $OUT_DIR/summary.csv and $OUT_DIR/pareto.svg"
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Strong-scaling sweep of the full pipeline: builds and runs
+# scaling_benchmark (src/scaling_benchmark.cpp), which times camera_pipe_f32
+# and camera_pipe_u16 over frame sizes, thread counts, demosaics and stage
+# settings and writes a CSV. Extra arguments are passed through, e.g.
+#
+#   ./benchmark_scaling.sh --sizes 2,8,24,50,100 --csv epyc.csv
+#   ./benchmark_scaling.sh --threads 1,4 --demosaic 0,1,2,3 --stages none,ca,ll,denoise,geometry
+#
+# Note: This script is compatible with Bash 3.x (default on macOS) and newer versions.
+set -e # Exit immediately if a command exits with a non-zero status.
+
+BUILD_DIR="build"
+
+if [ ! -d "$BUILD_DIR" ] || [ ! -f "$BUILD_DIR/CMakeCache.txt" ]; then
+    echo "Error: Build directory '$BUILD_DIR' not found or not configured." >&2
+    echo "Please run 'cmake -S . -B $BUILD_DIR -DHalide_DIR=...' at least once before running this script." >&2
+    exit 1
+fi
+
+cmake -B "$BUILD_DIR" -DBUILD_SCALING_BENCHMARK=ON > /dev/null
+BUILD_JOBS=$( (which nproc > /dev/null && nproc) || sysctl -n hw.ncpu )
+cmake --build "$BUILD_DIR" --target scaling_benchmark -- -j$BUILD_JOBS > /dev/null
+
+"$BUILD_DIR/scaling_benchmark" "$@"
@@ -1,18 +1,27 @@
 #include <SDL.h>
+#include <cfloat>
 #include <iostream>
 #include <vector>
 
 // Use GLES 3
 #define GL_GLEXT_PROTOTYPES 1
 #include <SDL_opengles2.h>
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2 // GLES 3; not in the GLES 2 headers.
+#endif
 
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_opengl3.h"
 #include "IconsFontAwesome6.h"
 
-#include <opencv2/opencv.hpp>
-#include <opencv2/videoio.hpp>
+#include <linux/videodev2.h>
+
+#include "v4l2_capture.h"
+
+#ifdef HALIDE_PREVIEW
+#include "preview_pipeline.h"
+#endif
 
 // --- GLSL Shaders for the camera view ---
 const char* vertexShaderSource = R"(
@@ -27,15 +36,25 @@ const char* vertexShaderSource = R"(
     }
 )";
 
+// The preview pipeline's alpha holds aid flags (bit 0 focus peaking, bit 1
+// zebra), read unfiltered and masked by the enabled aids.
 const char* fragmentShaderSource = R"(
     #version 300 es
     precision mediump float;
     out vec4 FragColor;
     in vec2 TexCoord;
     uniform sampler2D ourTexture;
+    uniform int aidMask;
     void main()
     {
-        FragColor = texture(ourTexture, TexCoord);
+        vec3 color = texture(ourTexture, TexCoord).rgb;
+        ivec2 texel = ivec2(TexCoord * vec2(textureSize(ourTexture, 0)));
+        int flags = int(texelFetch(ourTexture, texel, 0).a * 255.0 + 0.5) & aidMask;
+        if ((flags & 2) != 0 && mod(gl_FragCoord.x + gl_FragCoord.y, 16.0) < 8.0)
+            color = vec3(0.0);
+        if ((flags & 1) != 0)
+            color = vec3(1.0, 0.1, 0.1);
+        FragColor = vec4(color, 1.0);
     }
 )";
 
@@ -76,16 +95,48 @@ GLuint CreateShaderProgram(const char* vsSource, const char* fsSource) {
 
 // --- Application State ---
 struct CameraState {
-    cv::VideoCapture cap;
-    cv::Mat frame;
+    V4L2Capture capture;
+    CapturedFrame frame; // Held until the next one arrives.
     int width = 1280;
     int height = 720;
+    // Raw Bayer frames for the openraw live view, when the sensor offers an
+    // unpacked mode; otherwise the ISP's RGB.
+    bool raw = false;
+    int cfa_pattern = 1;
+    int bit_depth = 10;
+};
+
+#ifdef HALIDE_PREVIEW
+// V4L2's unpacked Bayer formats (16-bit samples), with the pipeline's CFA
+// codes (GRBG 0, RGGB 1, GBRG 2, BGGR 3). Higher bit depths first.
+struct RawMode { uint32_t fourcc; int cfa_pattern; int bit_depth; };
+const RawMode kRawModes[] = {
+    {V4L2_PIX_FMT_SRGGB12, 1, 12}, {V4L2_PIX_FMT_SGRBG12, 0, 12},
+    {V4L2_PIX_FMT_SGBRG12, 2, 12}, {V4L2_PIX_FMT_SBGGR12, 3, 12},
+    {V4L2_PIX_FMT_SRGGB10, 1, 10}, {V4L2_PIX_FMT_SGRBG10, 0, 10},
+    {V4L2_PIX_FMT_SGBRG10, 2, 10}, {V4L2_PIX_FMT_SBGGR10, 3, 10},
 };
 
+// Switches the capture to the first raw mode the driver accepts, at the
+// sensor's own size: the live view bins the raw itself.
+bool OpenRawMode(CameraState& camera) {
+    std::vector<uint32_t> fourccs;
+    for (const RawMode& mode : kRawModes) fourccs.push_back(mode.fourcc);
+    if (!camera.capture.set_format(fourccs, 0, 0)) return false;
+    for (const RawMode& mode : kRawModes) {
+        if (mode.fourcc != camera.capture.format().fourcc) continue;
+        camera.cfa_pattern = mode.cfa_pattern;
+        camera.bit_depth = mode.bit_depth;
+    }
+    return true;
+}
+#endif
+
 struct RendererState {
     GLuint shaderProgram;
     GLuint textureID;
     GLuint vao;
+    GLint aidMaskLocation;
 };
 
 // --- Declarative UI Structures ---
@@ -93,18 +144,43 @@ struct RendererState {
 struct MenuItem;
 using MenuPage = std::vector<MenuItem>;
 
-// We can add more types like Toggle, Enum, Slider later
+// We can add more types like Enum later
 enum class MenuItemType {
     Submenu,    // Navigates to another page of items
-    StaticText  // A simple non-interactive text label
+    StaticText, // A simple non-interactive text label
+    Slider,     // Edits a float in place
+    Toggle      // Edits a bool in place
 };
 
 struct MenuItem {
     std::string label;
     MenuItemType type;
     MenuPage submenu_page; // Only used by Submenu type
+    // Only used by Slider type. `rebuilds_look` marks values baked into the
+    // preview's LUTs, which are rebuilt when they change.
+    float* value = nullptr;
+    float min = 0.0f, max = 1.0f;
+    const char* format = "%.2f";
+    bool rebuilds_look = false;
+    bool* flag = nullptr; // Only used by Toggle type.
 };
 
+MenuItem Slider(const char* label, float* value, float min, float max, const char* format, bool rebuilds_look = false) {
+    MenuItem item{label, MenuItemType::Slider};
+    item.value = value;
+    item.min = min;
+    item.max = max;
+    item.format = format;
+    item.rebuilds_look = rebuilds_look;
+    return item;
+}
+
+MenuItem Toggle(const char* label, bool* flag) {
+    MenuItem item{label, MenuItemType::Toggle};
+    item.flag = flag;
+    return item;
+}
+
 struct SettingsTab {
     std::string name;
     MenuPage root_page;
@@ -124,6 +200,21 @@ struct AppState {
     // Placeholder for actual calibration values
     float k1 = 0.0f, k2 = 0.0f, p1 = 0.0f, p2 = 0.0f;
     float fx = 1280.0f, fy = 720.0f, cx = 640.0f, cy = 360.0f;
+
+#ifdef HALIDE_PREVIEW
+    // The part of the look the live view renders (see the Look tab).
+    ProcessConfig look;
+    bool look_changed = false;
+
+    // Exposure and focus aids (see the Assist tab), and the last preview's
+    // luma histogram.
+    bool show_peaking = false;
+    bool show_zebras = false;
+    bool show_histogram = true;
+    // The temporal denoise's history weight; 0 is off.
+    float temporal_strength = 0.0f;
+    std::vector<float> luma_histogram = std::vector<float>(256, 0.0f);
+#endif
 };
 
 
@@ -131,6 +222,35 @@ struct AppState {
 
 void InitializeSettings(AppState& state) {
     state.settings_tabs = {
+#ifdef HALIDE_PREVIEW
+        {
+            "Look", // Tab Name
+            { // Root Page
+                Slider("Exposure", &state.look.exposure, -4.0f, 4.0f, "%.2f"),
+                Slider("Color Temp", &state.look.color_temp, 1500.0f, 15000.0f, "%.0f K"),
+                Slider("Tint", &state.look.tint, -1.0f, 1.0f, "%.2f"),
+                Slider("Contrast", &state.look.contrast, 0.0f, 100.0f, "%.0f", true),
+                Slider("Temporal NR", &state.temporal_strength, 0.0f, 0.9f, "%.2f"),
+                {
+                    "Grading",
+                    MenuItemType::Submenu,
+                    { // Sub-page for "Grading"
+                        Slider("Shadows", &state.look.shadows_luma, -100.0f, 100.0f, "%.0f", true),
+                        Slider("Midtones", &state.look.midtones_luma, -100.0f, 100.0f, "%.0f", true),
+                        Slider("Highlights", &state.look.highlights_luma, -100.0f, 100.0f, "%.0f", true),
+                    }
+                },
+            }
+        },
+        {
+            "Assist", // Tab Name
+            { // Root Page
+                Toggle("Focus Peaking", &state.show_peaking),
+                Toggle("Zebras", &state.show_zebras),
+                Toggle("Histogram", &state.show_histogram),
+            }
+        },
+#endif
         {
             "Calibration", // Tab Name
             { // Root Page
@@ -179,6 +299,22 @@ void RenderMenuPage(AppState& state, MenuPage& page) {
             case MenuItemType::StaticText:
                 ImGui::TextWrapped("%s", item.label.c_str());
                 break;
+
+            case MenuItemType::Slider:
+                ImGui::PushID(&item);
+                if (ImGui::SliderFloat(item.label.c_str(), item.value, item.min, item.max, item.format) && item.rebuilds_look) {
+#ifdef HALIDE_PREVIEW
+                    state.look_changed = true;
+#endif
+                }
+                ImGui::PopID();
+                break;
+
+            case MenuItemType::Toggle:
+                ImGui::PushID(&item);
+                ImGui::Checkbox(item.label.c_str(), item.flag);
+                ImGui::PopID();
+                break;
         }
     }
 }
@@ -220,6 +356,18 @@ void RenderUI(SDL_Window* window, AppState& state) {
     }
     ImGui::End();
 
+#ifdef HALIDE_PREVIEW
+    if (state.show_histogram) {
+        const ImVec2 histogram_size(256.0f, 80.0f);
+        ImGui::SetNextWindowPos(ImVec2(display_size.x - histogram_size.x - 10, top_bar_height + 10));
+        ImGui::SetNextWindowBgAlpha(0.4f);
+        ImGui::Begin("Histogram", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove |
+                                           ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::PlotHistogram("##luma", state.luma_histogram.data(), (int)state.luma_histogram.size(),
+                             0, nullptr, 0.0f, FLT_MAX, histogram_size);
+        ImGui::End();
+    }
+#endif
 
     // --- Declarative Settings Window ---
     if (state.show_settings_window) {
@@ -281,13 +429,26 @@ int main(int, char**) {
 
     // --- Initialize Camera ---
     CameraState camera;
-    camera.cap.open(0, cv::CAP_V4L2); // Use V4L2 backend
-    if (!camera.cap.isOpened()) {
+    if (!camera.capture.open("/dev/video0")) {
         std::cerr << "Error: Could not open webcam." << std::endl;
         return -1;
     }
-    camera.cap.set(cv::CAP_PROP_FRAME_WIDTH, camera.width);
-    camera.cap.set(cv::CAP_PROP_FRAME_HEIGHT, camera.height);
+#ifdef HALIDE_PREVIEW
+    camera.raw = OpenRawMode(camera);
+    if (!camera.raw) {
+        std::cerr << "Warning: No unpacked raw mode; showing the ISP's frames." << std::endl;
+    }
+#endif
+    // Without the raw pipeline, the ISP's RGB goes straight to the texture.
+    if (!camera.raw && !camera.capture.set_format({V4L2_PIX_FMT_RGB24}, camera.width, camera.height)) {
+        std::cerr << "Error: The camera offers neither a raw nor an RGB24 format." << std::endl;
+        return -1;
+    }
+    if (!camera.capture.start()) {
+        return -1;
+    }
+    camera.width = camera.capture.format().width;
+    camera.height = camera.capture.format().height;
 
     // --- Setup Dear ImGui context ---
     IMGUI_CHECKVERSION();
@@ -317,6 +478,7 @@ int main(int, char**) {
     // --- Setup Renderer for Camera View ---
     RendererState renderer;
     renderer.shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+    renderer.aidMaskLocation = glGetUniformLocation(renderer.shaderProgram, "aidMask");
     
     // Create a texture for the camera frame
     glGenTextures(1, &renderer.textureID);
@@ -356,6 +518,10 @@ int main(int, char**) {
     // Application state
     AppState state;
     InitializeSettings(state); // Set up our declarative menu structure
+#ifdef HALIDE_PREVIEW
+    PreviewPipeline preview;
+    int texture_width = 0, texture_height = 0; // Allocated on the first rendered frame.
+#endif
     ImVec4 clear_color = ImVec4(0.0f, 0.0f, 0.0f, 1.00f); // Background if camera fails
 
     // --- Main loop ---
@@ -374,12 +540,57 @@ int main(int, char**) {
         }
 
         // --- Get Camera Frame and Update Texture ---
-        camera.cap >> camera.frame;
-        if (!camera.frame.empty()) {
-            cv::cvtColor(camera.frame, camera.frame, cv::COLOR_BGR2RGB);
+        // Frames are read in the capture buffers; the previous one goes back
+        // to the driver once a newer one is in hand.
+        CapturedFrame next;
+        const bool have_frame = camera.capture.dequeue_latest(next, 0);
+        if (have_frame) {
+            camera.capture.requeue(camera.frame);
+            camera.frame = next;
+        }
+#ifdef HALIDE_PREVIEW
+        if (camera.raw && have_frame) {
+            if (state.look_changed) {
+                preview.set_look(state.look);
+                state.look_changed = false;
+            }
+            preview.set_temporal_strength(state.temporal_strength);
+            RawFrameView raw;
+            raw.data = reinterpret_cast<const uint16_t*>(camera.frame.data);
+            raw.width = camera.width;
+            raw.height = camera.height;
+            raw.stride = camera.capture.format().bytes_per_line / 2;
+            raw.cfa_pattern = camera.cfa_pattern;
+            raw.bit_depth = camera.bit_depth;
+            // V4L2 doesn't report it; the Pi sensors' pedestal is 1/16 of range.
+            raw.black_level = 1 << (camera.bit_depth - 4);
+            if (preview.render(raw, state.look, (int)io.DisplaySize.x)) {
+                const auto& out = preview.output();
+                glBindTexture(GL_TEXTURE_2D, renderer.textureID);
+                if (out.width() != texture_width || out.height() != texture_height) {
+                    texture_width = out.width();
+                    texture_height = out.height();
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width, texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+                } else {
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture_width, texture_height, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+                }
+                // Luma, the histogram's channel 3.
+                const auto& histogram = preview.histogram();
+                for (int i = 0; i < (int)state.luma_histogram.size(); i++) {
+                    state.luma_histogram[i] = (float)histogram(i, 3);
+                }
+            }
+        } else
+#endif
+        if (have_frame) {
             glBindTexture(GL_TEXTURE_2D, renderer.textureID);
+            // Rows are packed unless the driver pads them; GLES 3 takes the
+            // padded length as the row length.
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, camera.capture.format().bytes_per_line / 3);
             // Use glTexSubImage2D for better performance
             glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, camera.width, camera.height, GL_RGB, GL_UNSIGNED_BYTE, camera.frame.data);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         }
 
         // --- Rendering ---
@@ -389,6 +600,12 @@ int main(int, char**) {
 
         // 1. Render Camera View (background)
         glUseProgram(renderer.shaderProgram);
+        // The ISP's frames have no aid flags (their alpha reads as 255).
+        int aid_mask = 0;
+#ifdef HALIDE_PREVIEW
+        if (camera.raw) aid_mask = (state.show_peaking ? 1 : 0) | (state.show_zebras ? 2 : 0);
+#endif
+        glUniform1i(renderer.aidMaskLocation, aid_mask);
         glBindVertexArray(renderer.vao);
         glBindTexture(GL_TEXTURE_2D, renderer.textureID);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
@@ -402,7 +619,7 @@ int main(int, char**) {
     }
 
     // --- Cleanup ---
-    camera.cap.release();
+    camera.capture.close();
     glDeleteVertexArrays(1, &renderer.vao);
     // VBO and EBO are cleaned up with VAO
     glDeleteTextures(1, &renderer.textureID);
@@ -0,0 +1,90 @@
+// Built only with the openraw tree's preview pipeline (make OPENRAW_BUILD=...).
+#ifdef HALIDE_PREVIEW
+
+#include "preview_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <cmath>
+
+#include "camera_pipe_preview_lib.h"
+#include "temporal_denoise_lib.h"
+#include "color_tools.h"
+#include "tone_curve_utils.h"
+#include "white_balance.h"
+
+using Halide::Runtime::Buffer;
+
+void PreviewPipeline::set_look(const ProcessConfig& cfg) {
+    tone_curve_lut_ = ToneCurveUtils::generate_pipeline_lut(cfg);
+    rgb_color_lut_ = HostColor::generate_rgb_color_lut(HostColor::generate_color_lut(cfg));
+    have_look_ = true;
+}
+
+void PreviewPipeline::set_temporal_strength(float strength) {
+    temporal_strength_ = strength;
+    if (strength <= 0.0f) {
+        history_ = Buffer<uint16_t, 2>();
+        denoised_ = Buffer<uint16_t, 2>();
+    }
+}
+
+bool PreviewPipeline::render(const RawFrameView& frame, const ProcessConfig& cfg, int display_width) {
+    if (!have_look_) set_look(cfg);
+
+    // An even bin, so each output pixel covers whole CFA quads.
+    const int fit = std::max(2, (frame.width / std::max(1, display_width) + 1) & ~1);
+    downscale_ = fit + extra_downscale_;
+    const int out_width = frame.width / downscale_;
+    const int out_height = frame.height / downscale_;
+    if (output_.width() != out_width || output_.height() != out_height) {
+        output_ = Buffer<uint8_t, 3>::make_interleaved(out_width, out_height, 4);
+    }
+
+    halide_dimension_t dims[2] = {{0, frame.width, 1}, {0, frame.height, frame.stride}};
+    Buffer<uint16_t, 2> input(const_cast<uint16_t*>(frame.data), 2, dims);
+
+    auto start = std::chrono::steady_clock::now();
+    if (temporal_strength_ > 0.0f) {
+        if (history_.width() != frame.width || history_.height() != frame.height) {
+            // A new sequence starts from the frame itself.
+            history_ = Buffer<uint16_t, 2>(frame.width, frame.height);
+            denoised_ = Buffer<uint16_t, 2>(frame.width, frame.height);
+            history_.copy_from(input);
+        }
+        const float sigma = kTemporalNoise * float((1 << frame.bit_depth) - 1);
+        if (temporal_denoise(input, history_, sigma, temporal_strength_, denoised_) != 0) return false;
+        std::swap(history_, denoised_);
+        input = history_;
+    }
+
+    // The sensor's own colour is taken as sRGB: V4L2 reports no calibration.
+    Buffer<float, 2> color_matrix(4, 3);
+    color_matrix.fill(0.0f);
+    for (int i = 0; i < 3; i++) color_matrix(i, i) = 1.0f;
+    Buffer<int, 2> black_level_cfa(2, 2);
+    black_level_cfa.fill(frame.black_level);
+
+    const PipelineUtils::RGBGains wb = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    const int white_level = (1 << frame.bit_depth) - 1;
+
+    const int result = camera_pipe_preview(input, frame.cfa_pattern, cfg.green_balance, float(downscale_),
+                                           wb.r, wb.g, wb.b, color_matrix, std::pow(2.0f, cfg.exposure),
+                                           frame.black_level, white_level, black_level_cfa,
+                                           tone_curve_lut_, rgb_color_lut_, kPeakingThreshold, kZebraLevel,
+                                           output_, histogram_);
+    last_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    average_ms_ = average_ms_ == 0.0 ? last_ms_ : 0.9 * average_ms_ + 0.1 * last_ms_;
+    if (average_ms_ > kPipelineBudgetMs && extra_downscale_ < 8) {
+        extra_downscale_ += 2;
+        average_ms_ = 0.0;
+    } else if (average_ms_ < 0.4 * kPipelineBudgetMs && extra_downscale_ > 0) {
+        extra_downscale_ -= 2;
+        average_ms_ = 0.0;
+    }
+    return result == 0;
+}
+
+#endif // HALIDE_PREVIEW
@@ -0,0 +1,79 @@
+#ifndef PREVIEW_PIPELINE_H
+#define PREVIEW_PIPELINE_H
+
+#include <cstdint>
+
+#include "HalideBuffer.h"
+#include "process_options.h"
+
+// A raw Bayer frame as the camera delivers it: 16-bit samples at the
+// sensor's bit depth, `stride` samples apart.
+struct RawFrameView {
+    const uint16_t* data = nullptr;
+    int width = 0, height = 0, stride = 0;
+    int cfa_pattern = 0; // RawImageData::cfa_pattern's codes.
+    int bit_depth = 10;
+    int black_level = 0; // Sensor units.
+};
+
+// Renders raw frames for the live view with camera_pipe_preview (built by
+// the openraw tree, src/pipeline_generator.cpp): the processing of
+// camera_pipe_u16 with the look of a ProcessConfig, binned down to about
+// the display's width.
+//
+// The bin starts at the display size and grows by 2 while the pipeline
+// runs over kPipelineBudgetMs on average, leaving the rest of the 33 ms
+// frame for capture, upload and the UI; it shrinks back when there is
+// time to spare.
+//
+// The output's alpha holds the focus and exposure aids as flags (bit 0
+// focus peaking, bit 1 zebra), for the frontend's shader to composite.
+//
+// With a temporal strength set, each raw frame first goes through
+// temporal_denoise against the previous denoised frame, which is kept
+// here at the sensor's resolution.
+class PreviewPipeline {
+public:
+    static constexpr double kPipelineBudgetMs = 24.0;
+    // Peaking marks Laplacians of the binned green over this fraction of
+    // the local level; zebras mark any channel at or over this 8-bit level.
+    static constexpr float kPeakingThreshold = 0.25f;
+    static constexpr int kZebraLevel = 250;
+    // The raw's noise for the temporal denoise's motion gate, as a fraction
+    // of the white level. V4L2 reports none; this suits the Pi sensors at
+    // low gain.
+    static constexpr float kTemporalNoise = 1.0f / 256.0f;
+
+    // Rebuilds the tone curve and look LUTs from `cfg`. Exposure and white
+    // balance are read per frame and don't need this.
+    void set_look(const ProcessConfig& cfg);
+    // Renders `frame`, with exposure and white balance from `cfg`, to
+    // output(). Returns false if the pipeline failed.
+    bool render(const RawFrameView& frame, const ProcessConfig& cfg, int display_width);
+    // The history's weight in the temporal denoise; 0 (the default) turns
+    // it off and drops the history.
+    void set_temporal_strength(float strength);
+
+    // Interleaved RGBA, resized to each frame's output.
+    const Halide::Runtime::Buffer<uint8_t, 3>& output() const { return output_; }
+    // 256 bins x (R, G, B, luma) counts of the last output.
+    const Halide::Runtime::Buffer<uint32_t, 2>& histogram() const { return histogram_; }
+    double last_ms() const { return last_ms_; }
+    int downscale() const { return downscale_; }
+
+private:
+    bool have_look_ = false;
+    Halide::Runtime::Buffer<uint16_t, 2> tone_curve_lut_;
+    Halide::Runtime::Buffer<float, 4> rgb_color_lut_;
+    Halide::Runtime::Buffer<uint8_t, 3> output_;
+    Halide::Runtime::Buffer<uint32_t, 2> histogram_{256, 4};
+    // The last denoised frame, and the buffer the next one is written to.
+    float temporal_strength_ = 0.0f;
+    Halide::Runtime::Buffer<uint16_t, 2> history_, denoised_;
+    int extra_downscale_ = 0;
+    int downscale_ = 2;
+    double average_ms_ = 0.0;
+    double last_ms_ = 0.0;
+};
+
+#endif // PREVIEW_PIPELINE_H
@@ -0,0 +1,151 @@
+#include "v4l2_capture.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// ioctl, retried when a signal interrupts it.
+int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+} // namespace
+
+bool V4L2Capture::open(const std::string& device) {
+    close();
+    // Non-blocking, so dequeue_latest() can drain the ready buffers.
+    fd_ = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd_ < 0) {
+        std::cerr << "Error: Could not open " << device << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    v4l2_capability cap = {};
+    if (xioctl(fd_, VIDIOC_QUERYCAP, &cap) < 0 ||
+        !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        std::cerr << "Error: " << device << " is not a streaming capture device." << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool V4L2Capture::set_format(const std::vector<uint32_t>& fourccs, int width, int height) {
+    v4l2_format current = {};
+    current.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd_, VIDIOC_G_FMT, &current) < 0) return false;
+
+    for (uint32_t fourcc : fourccs) {
+        v4l2_format fmt = current;
+        fmt.fmt.pix.pixelformat = fourcc;
+        if (width > 0 && height > 0) {
+            fmt.fmt.pix.width = width;
+            fmt.fmt.pix.height = height;
+        }
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        fmt.fmt.pix.bytesperline = 0;
+        // Drivers substitute a format they support rather than fail.
+        if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != fourcc) continue;
+        format_.fourcc = fourcc;
+        format_.width = fmt.fmt.pix.width;
+        format_.height = fmt.fmt.pix.height;
+        format_.bytes_per_line = fmt.fmt.pix.bytesperline;
+        return true;
+    }
+    return false;
+}
+
+bool V4L2Capture::start() {
+    v4l2_requestbuffers req = {};
+    req.count = kBufferCount;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        std::cerr << "Error: VIDIOC_REQBUFS failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    buffers_.resize(req.count);
+    for (unsigned i = 0; i < req.count; ++i) {
+        v4l2_buffer buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) return false;
+        void* start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+        if (start == MAP_FAILED) {
+            std::cerr << "Error: mmap of capture buffer " << i << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        buffers_[i].start = start;
+        buffers_[i].length = buf.length;
+        if (!queue(i)) return false;
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+        std::cerr << "Error: VIDIOC_STREAMON failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    streaming_ = true;
+    return true;
+}
+
+bool V4L2Capture::queue(int index) {
+    v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    return xioctl(fd_, VIDIOC_QBUF, &buf) == 0;
+}
+
+bool V4L2Capture::dequeue_latest(CapturedFrame& frame, int timeout_ms) {
+    pollfd pfd = {fd_, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+
+    bool have = false;
+    for (;;) {
+        v4l2_buffer buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) break; // EAGAIN: drained.
+        if (have) requeue(frame);
+        frame.data = static_cast<const uint8_t*>(buffers_[buf.index].start);
+        frame.bytes = buf.bytesused;
+        frame.index = buf.index;
+        frame.sequence = buf.sequence;
+        have = true;
+    }
+    return have;
+}
+
+void V4L2Capture::requeue(const CapturedFrame& frame) {
+    if (frame.index >= 0) queue(frame.index);
+}
+
+void V4L2Capture::close() {
+    if (fd_ < 0) return;
+    if (streaming_) {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd_, VIDIOC_STREAMOFF, &type);
+        streaming_ = false;
+    }
+    for (Mapping& m : buffers_) {
+        if (m.start) munmap(m.start, m.length);
+    }
+    buffers_.clear();
+    ::close(fd_);
+    fd_ = -1;
+}
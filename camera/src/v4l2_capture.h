@@ -0,0 +1,70 @@
+#ifndef V4L2_CAPTURE_H
+#define V4L2_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The format the driver settled on.
+struct CaptureFormat {
+    uint32_t fourcc = 0;
+    int width = 0, height = 0;
+    int bytes_per_line = 0;
+};
+
+// A filled capture buffer, mapped in place. Valid until it is requeued.
+struct CapturedFrame {
+    const uint8_t* data = nullptr;
+    size_t bytes = 0;
+    int index = -1;
+    uint32_t sequence = 0;
+};
+
+// Streams a V4L2 device through kBufferCount mmap'd buffers. Frames are
+// read where the driver wrote them, with no decode or copy on the way to
+// the preview pipeline or the texture upload.
+//
+// The live view always wants the newest frame: dequeue_latest() hands any
+// older filled buffers straight back to the driver, so a slow frame drops
+// stale ones instead of queuing them up as latency.
+class V4L2Capture {
+public:
+    static constexpr int kBufferCount = 4;
+
+    V4L2Capture() = default;
+    V4L2Capture(const V4L2Capture&) = delete;
+    V4L2Capture& operator=(const V4L2Capture&) = delete;
+    ~V4L2Capture() { close(); }
+
+    bool open(const std::string& device);
+    // Sets the first of `fourccs` the driver accepts, asking for width x
+    // height (0 keeps the driver's current size). Before start().
+    bool set_format(const std::vector<uint32_t>& fourccs, int width, int height);
+    // Maps the buffers, queues them all and starts streaming.
+    bool start();
+    // Waits up to timeout_ms for a frame and returns the newest one ready.
+    // False on timeout or error.
+    bool dequeue_latest(CapturedFrame& frame, int timeout_ms);
+    // Returns a frame's buffer to the driver.
+    void requeue(const CapturedFrame& frame);
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    const CaptureFormat& format() const { return format_; }
+
+private:
+    struct Mapping {
+        void* start = nullptr;
+        size_t length = 0;
+    };
+
+    bool queue(int index);
+
+    int fd_ = -1;
+    bool streaming_ = false;
+    CaptureFormat format_;
+    std::vector<Mapping> buffers_;
+};
+
+#endif // V4L2_CAPTURE_H
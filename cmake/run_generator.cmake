@@ -0,0 +1,39 @@
+# This script is called by add_halide_pipeline in the main CMakeLists.txt to
+# run a Halide generator: the command follows "--". The generator's output is
+# passed through, and with -DFAIL_ON_UNPROVEN=ON a "Failed to prove" warning
+# (a specialization or bound the schedule relies on that Halide couldn't
+# show to hold) fails the build.
+
+set(GENERATOR_COMMAND "")
+set(AFTER_SEPARATOR OFF)
+math(EXPR LAST_ARG "${CMAKE_ARGC} - 1")
+foreach(I RANGE 0 ${LAST_ARG})
+    if(AFTER_SEPARATOR)
+        list(APPEND GENERATOR_COMMAND "${CMAKE_ARGV${I}}")
+    elseif(CMAKE_ARGV${I} STREQUAL "--")
+        set(AFTER_SEPARATOR ON)
+    endif()
+endforeach()
+if(NOT GENERATOR_COMMAND)
+    message(FATAL_ERROR "Usage: cmake [-DFAIL_ON_UNPROVEN=ON] -P run_generator.cmake -- <generator> [args...]")
+endif()
+
+execute_process(
+    COMMAND ${GENERATOR_COMMAND}
+    RESULT_VARIABLE GENERATOR_RESULT
+    OUTPUT_VARIABLE GENERATOR_OUTPUT
+    ERROR_VARIABLE GENERATOR_ERRORS
+)
+if(GENERATOR_OUTPUT)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E echo_append "${GENERATOR_OUTPUT}")
+endif()
+if(GENERATOR_ERRORS)
+    message("${GENERATOR_ERRORS}")
+endif()
+if(NOT GENERATOR_RESULT EQUAL 0)
+    message(FATAL_ERROR "Generator failed: ${GENERATOR_RESULT}")
+endif()
+if(FAIL_ON_UNPROVEN AND GENERATOR_ERRORS MATCHES "Failed to prove")
+    message(FATAL_ERROR "The generator failed to prove a schedule condition (see above). "
+                        "Fix the schedule, or configure with -DFAIL_ON_UNPROVEN_SCHEDULES=OFF to build anyway.")
+endif()
@@ -0,0 +1,281 @@
+#include "camera_metadata_cache.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace { // Anonymous namespace for local helpers
+
+constexpr char kIndexMagic[8] = {'O', 'R', 'C', 'A', 'M', 'I', 'D', 'X'};
+constexpr uint32_t kIndexVersion = 1;
+
+// One <Camera> element of cameras.xml, listed once per name it answers to.
+struct IndexEntry {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    std::string make;
+    std::string model;
+};
+
+struct XmlStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+bool stat_file(const std::string& path, XmlStamp& stamp) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+bool make_dirs(const std::string& path) {
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            std::string prefix = path.substr(0, i);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        }
+    }
+    return true;
+}
+
+std::string decode_entities(const std::string& s) {
+    static const struct { const char* entity; char c; } kEntities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        bool replaced = false;
+        if (s[i] == '&') {
+            for (const auto& e : kEntities) {
+                size_t n = strlen(e.entity);
+                if (s.compare(i, n, e.entity) == 0) {
+                    out += e.c;
+                    i += n - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) out += s[i];
+    }
+    return out;
+}
+
+std::string attribute(const std::string& tag, const char* name) {
+    std::string key = std::string(" ") + name + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string::npos) return "";
+    pos += key.size();
+    size_t end = tag.find('"', pos);
+    if (end == std::string::npos) return "";
+    return decode_entities(tag.substr(pos, end - pos));
+}
+
+// cameras.xml is a flat list of <Camera> elements under <Cameras>, so a
+// plain scan is enough to find each element's extent and the names it is
+// looked up by (its make/model and any <Alias> models).
+std::vector<IndexEntry> scan_cameras(const std::string& xml) {
+    std::vector<IndexEntry> entries;
+    size_t pos = 0;
+    while ((pos = xml.find("<Camera", pos)) != std::string::npos) {
+        char next = pos + 7 < xml.size() ? xml[pos + 7] : '\0';
+        if (next != ' ' && next != '\t' && next != '\n' && next != '\r' && next != '>') {
+            pos += 7; // <Cameras>, <CameraId>, ...
+            continue;
+        }
+        size_t tag_end = xml.find('>', pos);
+        if (tag_end == std::string::npos) break;
+        std::string tag = xml.substr(pos, tag_end - pos);
+        size_t end;
+        if (xml[tag_end - 1] == '/') {
+            end = tag_end + 1;
+        } else {
+            end = xml.find("</Camera>", tag_end);
+            if (end == std::string::npos) break;
+            end += strlen("</Camera>");
+        }
+
+        IndexEntry entry;
+        entry.offset = static_cast<uint32_t>(pos);
+        entry.length = static_cast<uint32_t>(end - pos);
+        entry.make = attribute(tag, "make");
+        entry.model = attribute(tag, "model");
+        entries.push_back(entry);
+
+        std::string body = xml.substr(tag_end, end - tag_end);
+        size_t a = 0;
+        while ((a = body.find("<Alias", a)) != std::string::npos) {
+            if (body.compare(a, 8, "<Aliases") == 0) {
+                a += 8;
+                continue;
+            }
+            size_t text_start = body.find('>', a);
+            size_t text_end = body.find("</Alias>", a);
+            if (text_start == std::string::npos || text_end == std::string::npos || text_end < text_start) break;
+            IndexEntry alias = entry;
+            alias.model = decode_entities(body.substr(text_start + 1, text_end - text_start - 1));
+            entries.push_back(alias);
+            a = text_end;
+        }
+        pos = end;
+    }
+    return entries;
+}
+
+template <typename T>
+void write_pod(std::ostream& os, const T& v) {
+    os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool read_pod(std::istream& is, T& v) {
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(&v), sizeof(T)));
+}
+
+void write_string(std::ostream& os, const std::string& s) {
+    write_pod(os, static_cast<uint32_t>(s.size()));
+    os.write(s.data(), s.size());
+}
+
+bool read_string(std::istream& is, std::string& s) {
+    uint32_t n;
+    if (!read_pod(is, n) || n > (1u << 20)) return false;
+    s.resize(n);
+    return n == 0 || static_cast<bool>(is.read(&s[0], n));
+}
+
+bool write_index(const std::string& path, const std::string& xml_path, const XmlStamp& stamp,
+                 const std::vector<IndexEntry>& entries) {
+    // Write to a temporary name and rename, so concurrent runs never read a
+    // half-written index.
+    std::string tmp = path + ".tmp" + std::to_string(static_cast<long>(getpid()));
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        if (!os) return false;
+        os.write(kIndexMagic, sizeof(kIndexMagic));
+        write_pod(os, kIndexVersion);
+        write_pod(os, stamp.size);
+        write_pod(os, stamp.mtime);
+        write_string(os, xml_path);
+        write_pod(os, static_cast<uint32_t>(entries.size()));
+        for (const auto& e : entries) {
+            write_pod(os, e.offset);
+            write_pod(os, e.length);
+            write_string(os, e.make);
+            write_string(os, e.model);
+        }
+        if (!os) return false;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Reads only the entries for make/model. Returns false if the index is
+// missing, unreadable, or stale for this XML file.
+bool read_index(const std::string& path, const std::string& xml_path, const XmlStamp& stamp,
+                const std::string& make, const std::string& model, std::vector<IndexEntry>& matches) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) return false;
+    char magic[sizeof(kIndexMagic)];
+    uint32_t version;
+    XmlStamp stored;
+    std::string stored_path;
+    if (!is.read(magic, sizeof(magic)) || memcmp(magic, kIndexMagic, sizeof(magic)) != 0) return false;
+    if (!read_pod(is, version) || version != kIndexVersion) return false;
+    if (!read_pod(is, stored.size) || !read_pod(is, stored.mtime)) return false;
+    if (!read_string(is, stored_path)) return false;
+    if (stored.size != stamp.size || stored.mtime != stamp.mtime || stored_path != xml_path) return false;
+
+    uint32_t count;
+    if (!read_pod(is, count)) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        IndexEntry e;
+        if (!read_pod(is, e.offset) || !read_pod(is, e.length)) return false;
+        if (!read_string(is, e.make) || !read_string(is, e.model)) return false;
+        if (e.make == make && e.model == model) matches.push_back(e);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string openraw_cache_dir(bool create) {
+    std::string dir;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg && *xdg) dir = std::string(xdg) + "/openraw";
+    else if (home && *home) dir = std::string(home) + "/.cache/openraw";
+    if (create && !dir.empty() && !make_dirs(dir)) return "";
+    return dir;
+}
+
+std::unique_ptr<rawspeed::CameraMetaData> load_camera_metadata_subset(const std::string& xml_path,
+                                                                     const std::string& make,
+                                                                     const std::string& model) {
+    XmlStamp stamp;
+    std::string dir = openraw_cache_dir();
+    if (dir.empty() || !stat_file(xml_path, stamp)) return nullptr;
+    const std::string index_path = dir + "/cameras.idx";
+
+    std::vector<IndexEntry> matches;
+    if (!read_index(index_path, xml_path, stamp, make, model, matches)) {
+        std::ifstream in(xml_path, std::ios::binary);
+        if (!in) return nullptr;
+        std::string xml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<IndexEntry> entries = scan_cameras(xml);
+        if (entries.empty()) return nullptr;
+        if (openraw_cache_dir(true).empty() || !write_index(index_path, xml_path, stamp, entries)) {
+            fprintf(stderr, "Warning: could not write camera index to %s\n", index_path.c_str());
+        }
+        matches.clear();
+        for (const auto& e : entries) {
+            if (e.make == make && e.model == model) matches.push_back(e);
+        }
+    }
+    // The index lists every name RawSpeed would look this camera up by, so
+    // no match means the full XML would not have one either.
+    if (matches.empty()) return std::make_unique<rawspeed::CameraMetaData>();
+
+    // Slice the matching <Camera> elements out of the XML and let RawSpeed
+    // parse just those. Aliases point at the same element, so skip repeats.
+    std::ifstream in(xml_path, std::ios::binary);
+    if (!in) return nullptr;
+    std::ostringstream subset;
+    subset << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Cameras>\n";
+    std::vector<uint32_t> seen;
+    for (const auto& e : matches) {
+        bool dup = false;
+        for (uint32_t off : seen) dup |= (off == e.offset);
+        if (dup) continue;
+        seen.push_back(e.offset);
+        std::string element(e.length, '\0');
+        in.seekg(e.offset);
+        if (!in.read(&element[0], e.length)) return nullptr;
+        subset << element << "\n";
+    }
+    subset << "</Cameras>\n";
+
+    // CameraMetaData only loads from a path.
+    std::string subset_path = dir + "/cameras-subset-" + std::to_string(static_cast<long>(getpid())) + ".xml";
+    {
+        std::ofstream os(subset_path, std::ios::binary);
+        if (!(os << subset.str())) return nullptr;
+    }
+    std::unique_ptr<rawspeed::CameraMetaData> meta;
+    try {
+        meta = std::make_unique<rawspeed::CameraMetaData>(subset_path.c_str());
+    } catch (const rawspeed::RawspeedException&) {
+        meta.reset();
+    }
+    remove(subset_path.c_str());
+    return meta;
+}
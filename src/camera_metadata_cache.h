@@ -0,0 +1,25 @@
+#ifndef CAMERA_METADATA_CACHE_H
+#define CAMERA_METADATA_CACHE_H
+
+#include <memory>
+#include <string>
+#include "librawspeed/RawSpeed-API.h"
+
+// Directory for openraw's on-disk caches: $XDG_CACHE_HOME/openraw, else
+// ~/.cache/openraw. Created if `create` is set. Empty if none is usable.
+std::string openraw_cache_dir(bool create = false);
+
+// Loading rawspeed::CameraMetaData means parsing the whole (multi-megabyte)
+// cameras.xml. This keeps a small binary index of that file, keyed by
+// make/model (aliases included) and invalidated by the XML's size and mtime,
+// and uses it to build a CameraMetaData holding only the matching cameras.
+//
+// The index lives under $XDG_CACHE_HOME/openraw (or ~/.cache/openraw) and is
+// rebuilt on the first call after cameras.xml changes. Returns an empty
+// CameraMetaData if the XML has no such camera, and nullptr if the index
+// can't be used, in which case the caller should load the full XML.
+std::unique_ptr<rawspeed::CameraMetaData> load_camera_metadata_subset(const std::string& xml_path,
+                                                                     const std::string& make,
+                                                                     const std::string& model);
+
+#endif // CAMERA_METADATA_CACHE_H
@@ -0,0 +1,168 @@
+#ifndef CAMERA_PIPE_BENCHMARK_H
+#define CAMERA_PIPE_BENCHMARK_H
+
+// Fixed inputs and a single entry point for timing the whole camera_pipe,
+// shared by scaling_benchmark and perf_test: a synthetic mosaic, the stage
+// settings they sweep, and the AOT call with the host-side LUTs built once
+// per configuration.
+
+#include "HalideBuffer.h"
+#include "color_tools.h"
+#include "process_options.h"
+#include "tone_curve_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace CameraPipeBenchmark {
+
+using Halide::Runtime::Buffer;
+
+// The stage switches. "none" leaves every optional stage at its neutral
+// setting; "all" turns them all on.
+const char* const kStageSets[] = {"none", "ca", "ll", "denoise", "geometry", "all"};
+
+// A deterministic 14-bit GRBG mosaic of gradients, fine texture and hard
+// edges, the same scene as stage_benchmark's.
+inline Buffer<uint16_t, 2> synthetic_bayer(int width, int height, int black, int white) {
+    Buffer<uint16_t, 2> bayer(width, height);
+    uint32_t seed = 0x9e3779b9u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            float noise = ((seed >> 8) & 0xffff) / 65535.0f - 0.5f;
+            float u = (float)x / width, v = (float)y / height;
+            float r = 0.2f + 0.6f * u, g = 0.25f + 0.5f * v, b = 0.6f - 0.4f * u * v;
+            float texture = 0.08f * sinf(x * 0.37f) * cosf(y * 0.23f);
+            float edge = ((x / 96 + y / 96) % 2) ? 0.15f : 0.0f;
+            bool row_g = (y % 2) == 0;
+            bool col_g = (x % 2) == 0;
+            float base = (row_g == col_g) ? g : (row_g ? r : b);
+            float value = std::min(1.0f, std::max(0.0f, base + texture + edge + 0.01f * noise));
+            bayer(x, y) = static_cast<uint16_t>(black + value * (white - black));
+        }
+    }
+    return bayer;
+}
+
+// The pipeline parameters for one stage set. Stages that are off keep
+// process's defaults, which leave them neutral.
+inline ProcessConfig config_for(const std::string& stages) {
+    ProcessConfig cfg;
+    const bool all = stages == "all";
+    if (all || stages == "ca") {
+        cfg.ca_strength = 1.0f;
+        cfg.ca_red_cyan = 0.5f;
+        cfg.ca_blue_yellow = -0.5f;
+    }
+    if (all || stages == "ll") {
+        cfg.ll_detail = 30.0f;
+        cfg.ll_clarity = 20.0f;
+        cfg.ll_shadows = 20.0f;
+        cfg.ll_highlights = -20.0f;
+    }
+    if (all || stages == "denoise") {
+        cfg.denoise_strength = 50.0f;
+    }
+    if (all || stages == "geometry") {
+        cfg.geo_rotate = 1.5f;
+        cfg.geo_keystone_v = 5.0f;
+    }
+    return cfg;
+}
+
+// The per-frame inputs: a mosaic of some size, identity color and lens data.
+struct Inputs {
+    Buffer<uint16_t, 2> bayer;
+    Buffer<float, 2> color_matrix;
+    Buffer<int, 2> black_level_cfa;
+    Buffer<float, 1> distortion_lut;
+    Buffer<float, 1> vignetting_lut;
+    Buffer<float, 2> tca_lut;
+    int black = 512, white = 16383;
+
+    Inputs() {
+        color_matrix = Buffer<float, 2>(4, 3);
+        color_matrix.fill(0.0f);
+        for (int i = 0; i < 3; ++i) color_matrix(i, i) = 1.0f;
+        black_level_cfa = Buffer<int, 2>(2, 2);
+        black_level_cfa.fill(black);
+        // Identity in the layout of LensCorrection's LUTs.
+        distortion_lut = Buffer<float, 1>(2048);
+        distortion_lut.fill(1.0f);
+        // No lens vignetting correction (VignetteBuilder's one-point LUT).
+        vignetting_lut = Buffer<float, 1>(1);
+        vignetting_lut.fill(1.0f);
+        tca_lut = Buffer<float, 2>(1, 2);
+        tca_lut.fill(1.0f);
+    }
+
+    // Makes the mosaic a 3:2 frame of about `megapixels`, with even sides.
+    void set_size(double megapixels) {
+        const int height = static_cast<int>(std::sqrt(megapixels * 1e6 / 1.5)) & ~1;
+        const int width = static_cast<int>(height * 1.5) & ~1;
+        bayer = synthetic_bayer(width, height, black, white);
+    }
+};
+
+// One configuration of the pipeline: the parameters and the LUTs made from
+// them on the host, built once and reused for every run.
+struct Run {
+    ProcessConfig cfg;
+    int demosaic_id = 3;
+    Buffer<uint16_t, 2> tone_curve_lut;
+    Buffer<float, 4> color_grading_lut;
+    Buffer<float, 4> rgb_color_lut;
+    // No masked adjustments: one empty mask cell and no tiles.
+    Buffer<float, 3> adjust_masks;
+    Buffer<float, 1> adjust_exposure;
+    Buffer<int32_t, 2> adjust_tiles;
+
+    Run(const ProcessConfig& config, int demosaic)
+        : cfg(config), demosaic_id(demosaic),
+          tone_curve_lut(ToneCurveUtils::generate_pipeline_lut(config)),
+          color_grading_lut(HostColor::generate_color_lut(config)),
+          rgb_color_lut(HostColor::generate_rgb_color_lut(color_grading_lut)),
+          adjust_masks(1, 1, 1), adjust_exposure(1), adjust_tiles(1, 1) {
+        adjust_masks.fill(0.0f);
+        adjust_exposure.fill(0.0f);
+        adjust_tiles.fill(-1);
+    }
+
+    // Runs `pipe` - camera_pipe_f32, camera_pipe_u16 or a build of either
+    // with other target features, which share the signature - once.
+    template <typename Pipe>
+    void operator()(Pipe pipe, const std::string& name, Inputs& in, Buffer<uint8_t, 3>& output) {
+        const float denoise = std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f));
+        const float exposure = powf(2.0f, cfg.exposure);
+        int result = pipe(in.bayer, /* cfa_pattern */ 0, cfg.green_balance, 1.0f, demosaic_id,
+                          1.8f, 1.0f, 1.5f, in.color_matrix,
+                          exposure, cfg.ca_strength,
+                          denoise, cfg.denoise_eps, /* denoise_algorithm_id */ 0,
+                          in.black, in.white, in.black_level_cfa, tone_curve_lut,
+                          cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                          cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
+                          cfg.ll_debug_level,
+                          color_grading_lut, rgb_color_lut,
+                          cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
+                          in.vignetting_lut,
+                          cfg.dehaze_strength,
+                          in.distortion_lut, in.tca_lut,
+                          cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                          cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                          cfg.geo_keystone_v, cfg.geo_keystone_h,
+                          cfg.geo_offset_x, cfg.geo_offset_y,
+                          0, output.height() - 1, /* warp_src_row_reach */ output.height(),
+                          0, output.width() - 1, /* orientation */ 1,
+                          adjust_masks, adjust_exposure, adjust_tiles,
+                          output);
+        if (result != 0) throw std::runtime_error(name + " failed with code " + std::to_string(result));
+    }
+};
+
+} // namespace CameraPipeBenchmark
+
+#endif // CAMERA_PIPE_BENCHMARK_H
@@ -4,10 +4,18 @@
 #include <memory>
 #include <map>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
 
 #ifdef USE_LIBCAMERA
 #include <libcamera/libcamera.h>
 #include <png.h>
+#include <sys/mman.h>
+
+#include "csi2_packing.h"
+#include "raw_container.h"
 
 using namespace libcamera;
 
@@ -17,10 +25,27 @@ struct Config {
     int width = 0, height = 0;
     unsigned int bit_depth = 0;
     int exposure_us = 0; // 0 means auto
+    // Accept the sensor's CSI-2 packed RAW10/RAW12 modes, which move 20-40%
+    // fewer bytes per frame than the 16-bit unpacked ones.
+    bool packed = false;
+    // Frames to capture while the camera streams, and their rate (0 leaves
+    // the sensor mode's own).
+    int burst = 1;
+    float fps = 0.0f;
 };
 
+// The packing of a libcamera Bayer format, or None for unpacked.
+RawPacking packing_of(const PixelFormat& format) {
+    if (!format.isPacked()) return RawPacking::None;
+    if (format.bitdepth() == 10) return RawPacking::Csi2Raw10;
+    if (format.bitdepth() == 12) return RawPacking::Csi2Raw12;
+    return RawPacking::None;
+}
+
 // --- PNG Writing Helper ---
-bool save_raw_as_png(const std::string& filename, uint32_t width, uint32_t height, uint32_t stride, const uint8_t* data) {
+// PNG holds 16-bit samples, so packed rows are expanded on the way out.
+bool save_raw_as_png(const std::string& filename, uint32_t width, uint32_t height, uint32_t stride, const uint8_t* data,
+                     RawPacking packing = RawPacking::None) {
     FILE *fp = fopen(filename.c_str(), "wb");
     if (!fp) {
         std::cerr << "Error: Could not open " << filename << " for writing." << std::endl;
@@ -59,32 +84,182 @@ bool save_raw_as_png(const std::string& filename, uint32_t width, uint32_t heigh
 
     png_write_info(png_ptr, info_ptr);
 
-    // libpng expects an array of row pointers.
-    std::vector<png_bytep> row_pointers(height);
-    for (uint32_t y = 0; y < height; ++y) {
-        // The data is already in the correct 16-bit unpacked format (2 bytes per pixel)
-        row_pointers[y] = (png_bytep)(data + y * stride);
+    if (packing == RawPacking::None) {
+        // libpng expects an array of row pointers.
+        std::vector<png_bytep> row_pointers(height);
+        for (uint32_t y = 0; y < height; ++y) {
+            // The data is already in the correct 16-bit unpacked format (2 bytes per pixel)
+            row_pointers[y] = (png_bytep)(data + y * stride);
+        }
+        png_write_image(png_ptr, row_pointers.data());
+    } else {
+        std::vector<uint16_t> row(width);
+        for (uint32_t y = 0; y < height; ++y) {
+            csi2_unpack_row(packing, data + y * stride, row.data(), width);
+            png_write_row(png_ptr, reinterpret_cast<png_bytep>(row.data()));
+        }
     }
-
-    png_write_image(png_ptr, row_pointers.data());
     png_write_end(png_ptr, nullptr);
 
     png_destroy_write_struct(&png_ptr, &info_ptr);
     fclose(fp);
 
-    std::cout << "Successfully saved RAW image to " << filename << std::endl;
     return true;
 }
 
+// --- Raw Container Writing ---
+// The pipeline's CFA code for a Bayer format (GRBG 0, RGGB 1, GBRG 2,
+// BGGR 3), and which of libcamera's R, Gr, Gb, B black levels each 2x2
+// site, [y & 1][x & 1], takes.
+int cfa_pattern_of(const PixelFormat& format, int sites[2][2]) {
+    static const int kSites[4][2][2] = {{{1, 0}, {3, 2}}, {{0, 1}, {2, 3}}, {{2, 3}, {0, 1}}, {{3, 2}, {1, 0}}};
+    const std::string name = format.toString();
+    int pattern = 1;
+    if (name.rfind("SGRBG", 0) == 0) pattern = 0;
+    else if (name.rfind("SGBRG", 0) == 0) pattern = 2;
+    else if (name.rfind("SBGGR", 0) == 0) pattern = 3;
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) sites[y][x] = kSites[pattern][y][x];
+    }
+    return pattern;
+}
+
+// Writes the frame as it sits in the capture buffer, packed or not, with
+// the metadata the pipeline needs (see raw_container.h).
+bool save_raw_container(const std::string& filename, const StreamConfiguration& stream_config,
+                        const ControlList& metadata, uint32_t sequence, const uint8_t* data) {
+    RawContainer::Header header;
+    header.width = stream_config.size.width;
+    header.height = stream_config.size.height;
+    header.stride = stream_config.stride;
+    header.bit_depth = stream_config.pixelFormat.bitdepth();
+    header.packing = static_cast<uint32_t>(packing_of(stream_config.pixelFormat));
+    header.white_level = (1u << header.bit_depth) - 1;
+
+    int sites[2][2];
+    header.cfa_pattern = cfa_pattern_of(stream_config.pixelFormat, sites);
+    // libcamera reports black levels in 16-bit units.
+    if (auto black = metadata.get(controls::SensorBlackLevels)) {
+        for (int y = 0; y < 2; ++y) {
+            for (int x = 0; x < 2; ++x) header.black_levels[y][x] = (*black)[sites[y][x]] >> (16 - header.bit_depth);
+        }
+    } else {
+        std::cerr << "Warning: no sensor black levels in the frame metadata; recording 0." << std::endl;
+    }
+    if (auto ccm = metadata.get(controls::ColourCorrectionMatrix)) {
+        header.has_matrix = 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) header.color_matrix[i][j] = (*ccm)[i * 3 + j];
+        }
+    }
+    if (auto timestamp = metadata.get(controls::SensorTimestamp)) {
+        header.timestamp_ns = static_cast<uint64_t>(*timestamp);
+    }
+    if (auto exposure = metadata.get(controls::ExposureTime)) {
+        header.exposure_us = static_cast<uint32_t>(*exposure);
+    }
+    if (auto gain = metadata.get(controls::AnalogueGain)) {
+        header.analogue_gain = *gain;
+    }
+    header.sequence = sequence;
+
+    RawContainer::Writer writer;
+    if (!writer.open(filename, header) || !writer.write_rows(data, header.height, header.stride) || !writer.close()) {
+        std::cerr << "Error: Could not write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// --- Streaming ---
+// Every capture buffer, mapped once through its dmabuf so completed frames
+// are read where the camera wrote them.
+class DmabufMappings {
+public:
+    explicit DmabufMappings(const std::vector<std::unique_ptr<FrameBuffer>>& buffers) {
+        for (const auto& buffer : buffers) {
+            const FrameBuffer::Plane& plane = buffer->planes()[0];
+            const size_t length = plane.offset + plane.length;
+            void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, plane.fd.get(), 0);
+            if (p == MAP_FAILED) {
+                std::cerr << "Error: Could not map a capture buffer." << std::endl;
+                continue;
+            }
+            maps_.push_back({p, length});
+            data_[buffer.get()] = static_cast<const uint8_t*>(p) + plane.offset;
+        }
+    }
+    ~DmabufMappings() {
+        for (const auto& m : maps_) munmap(m.first, m.second);
+    }
+    DmabufMappings(const DmabufMappings&) = delete;
+    DmabufMappings& operator=(const DmabufMappings&) = delete;
+
+    bool complete(size_t buffers) const { return data_.size() == buffers; }
+    const uint8_t* data(const FrameBuffer* buffer) const { return data_.at(buffer); }
+
+private:
+    std::vector<std::pair<void*, size_t>> maps_;
+    std::map<const FrameBuffer*, const uint8_t*> data_;
+};
+
+// Completed requests, from libcamera's callback thread to the writer. One
+// producer and one consumer, so two atomic indices are all it takes; it
+// holds every request, so a push never finds it full.
+class RequestRing {
+public:
+    explicit RequestRing(size_t capacity) : slots_(capacity + 1) {}
+
+    void push(Request* request) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        slots_[tail] = request;
+        tail_.store((tail + 1) % slots_.size(), std::memory_order_release);
+    }
+    Request* pop() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+        Request* request = slots_[head];
+        head_.store((head + 1) % slots_.size(), std::memory_order_release);
+        return request;
+    }
+
+private:
+    std::vector<Request*> slots_;
+    std::atomic<size_t> head_{0}, tail_{0};
+};
+
+RequestRing* completed_requests = nullptr;
+
+void on_request_completed(Request* request) {
+    if (request->status() == Request::RequestCancelled) return;
+    completed_requests->push(request);
+}
+
+// The path of frame `index` of a burst: name_0000.ext for bursts, or the
+// path as given for a single frame.
+std::string frame_path(const std::string& path, int index, int burst) {
+    if (burst <= 1) return path;
+    const size_t dot = path.find_last_of('.');
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%04d", index);
+    return dot == std::string::npos ? path + suffix : path.substr(0, dot) + suffix + path.substr(dot);
+}
+
 // --- Main Capture Logic ---
 void print_usage() {
-    std::cout << "Usage: ./capture [options] <output.png>\n\n"
+    std::cout << "Usage: ./capture [options] <output.png|output.oraw>\n\n"
+              << "A .oraw output keeps the frame as captured, packed or not, with its CFA,\n"
+              << "levels and colour matrix, for process to map directly.\n\n"
               << "Options:\n"
               << "  --width <w>      Request specific width\n"
               << "  --height <h>     Request specific height\n"
               << "  --bit-depth <d>  Request specific bit depth (e.g., 10, 12)\n"
               << "  --exposure <us>  Set manual exposure time in microseconds (e.g., 33333 for 1/30s).\n"
               << "                   Default is auto-exposure.\n"
+              << "  --packed         Also accept CSI-2 packed RAW10/RAW12 modes (less sensor bandwidth)\n"
+              << "  --burst <n>      Capture n frames while the camera streams, as <name>_0000.<ext>, ...\n"
+              << "                   (default: 1)\n"
+              << "  --fps <f>        Frame rate of the stream (default: the sensor mode's)\n"
               << "  --help           Display this help message\n"
               << std::endl;
 }
@@ -95,6 +270,7 @@ int main(int argc, char **argv) {
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--help") { print_usage(); return 0; }
+        if (arg == "--packed") { cfg.packed = true; continue; }
         if (arg.rfind("--", 0) == 0) {
             if (i + 1 < argc) args[arg.substr(2)] = argv[++i];
         } else {
@@ -113,6 +289,8 @@ int main(int argc, char **argv) {
         if (args.count("height")) cfg.height = std::stoi(args["height"]);
         if (args.count("bit-depth")) cfg.bit_depth = std::stoul(args["bit-depth"]);
         if (args.count("exposure")) cfg.exposure_us = std::stoi(args["exposure"]);
+        if (args.count("burst")) cfg.burst = std::stoi(args["burst"]);
+        if (args.count("fps")) cfg.fps = std::stof(args["fps"]);
     } catch (const std::exception& e) {
         std::cerr << "Error parsing arguments: " << e.what() << std::endl; return 1;
     }
@@ -128,15 +306,17 @@ int main(int argc, char **argv) {
     unsigned int max_bit_depth = 0;
     for (const auto &format : camera->sensor()->properties().get(properties::PixelFormats)) {
         if (!format.isBayer()) continue;
-        if (format.isPacked()) continue;
+        if (format.isPacked() && (!cfg.packed || packing_of(format) == RawPacking::None)) continue;
 
+        // With --packed, a packed mode wins over an unpacked one of the same depth.
+        bool preferred_packing = best_format.isValid() && format.bitdepth() == best_format.bitdepth() &&
+                                 format.isPacked() && !best_format.isPacked();
         if (cfg.bit_depth > 0) {
-            if (format.bitdepth() == cfg.bit_depth) {
+            if (format.bitdepth() == cfg.bit_depth && (!best_format.isValid() || preferred_packing)) {
                 best_format = format;
-                break;
             }
         } else {
-            if (format.bitdepth() > max_bit_depth) {
+            if (format.bitdepth() > max_bit_depth || preferred_packing) {
                 max_bit_depth = format.bitdepth();
                 best_format = format;
             }
@@ -144,7 +324,7 @@ int main(int argc, char **argv) {
     }
 
     if (!best_format.isValid()) {
-        std::cerr << "Could not find a suitable unpacked RAW format." << std::endl;
+        std::cerr << "Could not find a suitable " << (cfg.packed ? "" : "unpacked ") << "RAW format." << std::endl;
         return 1;
     }
 
@@ -170,13 +350,29 @@ int main(int argc, char **argv) {
     config->validate();
     camera->configure(config->get());
 
+    Stream* stream = streamConfig.stream();
     FrameBufferAllocator allocator(camera);
-    allocator.allocate(streamConfig.stream());
-    const auto &buffers = allocator.buffers(streamConfig.stream());
-    Request *request = camera->createRequest();
-    request->addBuffer(streamConfig.stream(), buffers[0].get());
+    if (allocator.allocate(stream) < 0) {
+        std::cerr << "Could not allocate capture buffers." << std::endl;
+        return 1;
+    }
+    const auto &buffers = allocator.buffers(stream);
+    DmabufMappings mappings(buffers);
+    if (!mappings.complete(buffers.size())) return 1;
+
+    // One request per buffer, all in flight: the camera streams, and a
+    // frame's request goes back to it as soon as the frame is written.
+    std::vector<std::unique_ptr<Request>> requests;
+    for (const auto& buffer : buffers) {
+        std::unique_ptr<Request> request = camera->createRequest();
+        request->addBuffer(stream, buffer.get());
+        requests.push_back(std::move(request));
+    }
+    RequestRing ring(requests.size());
+    completed_requests = &ring;
+    camera->requestCompleted.connect(on_request_completed);
 
-    ControlList &controls = request->controls();
+    ControlList controls(controls::controls);
     if (cfg.exposure_us > 0) {
         controls.set(controls::AeEnable, false);
         controls.set(controls::AwbEnable, false);
@@ -186,29 +382,60 @@ int main(int argc, char **argv) {
         controls.set(controls::AeEnable, true);
         controls.set(controls::AwbEnable, true);
     }
+    if (cfg.fps > 0.0f) {
+        const int64_t frame_us = static_cast<int64_t>(1e6f / cfg.fps);
+        controls.set(controls::FrameDurationLimits, Span<const int64_t, 2>({frame_us, frame_us}));
+    }
 
-    camera->start();
-    camera->queueRequest(request);
-
-    bool captured = false;
-    while(!captured) {
-        CompletedRequest *completed_request = camera->dequeueRequest();
-        if (completed_request) {
-            FrameBuffer *buffer = completed_request->buffers().at(streamConfig.stream());
-            const MappedBuffer &mapped_buffer = completed_request->map(streamConfig.stream());
-
-            save_raw_as_png(cfg.output_path, streamConfig.size.width, streamConfig.size.height,
-                            streamConfig.stride, static_cast<const uint8_t*>(mapped_buffer.planes()[0].data));
-
-            completed_request->reuse();
-            captured = true;
+    camera->start(&controls);
+    for (auto& request : requests) camera->queueRequest(request.get());
+
+    const std::string ext = ".oraw";
+    const bool container = cfg.output_path.size() > ext.size() &&
+                           cfg.output_path.compare(cfg.output_path.size() - ext.size(), ext.size(), ext) == 0;
+    const int frames = std::max(1, cfg.burst);
+    int written = 0, dropped = 0;
+    uint32_t last_sequence = 0;
+    std::cout << "frame,sequence,timestamp_ns,exposure_us,analogue_gain" << std::endl;
+    while (written < frames) {
+        Request* request = ring.pop();
+        if (!request) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
         }
+        FrameBuffer* buffer = request->buffers().at(stream);
+        const uint32_t sequence = buffer->metadata().sequence;
+        if (written > 0 && sequence > last_sequence + 1) dropped += sequence - last_sequence - 1;
+        last_sequence = sequence;
+
+        const ControlList& metadata = request->metadata();
+        const std::string path = frame_path(cfg.output_path, written, frames);
+        const uint8_t* frame = mappings.data(buffer);
+        bool saved = container
+            ? save_raw_container(path, streamConfig, metadata, sequence, frame)
+            : save_raw_as_png(path, streamConfig.size.width, streamConfig.size.height,
+                              streamConfig.stride, frame, packing_of(streamConfig.pixelFormat));
+        if (!saved) break;
+        std::cout << written << "," << sequence << ","
+                  << metadata.get(controls::SensorTimestamp).value_or(0) << ","
+                  << metadata.get(controls::ExposureTime).value_or(0) << ","
+                  << metadata.get(controls::AnalogueGain).value_or(0.0f) << std::endl;
+        ++written;
+
+        request->reuse(Request::ReuseBuffers);
+        camera->queueRequest(request);
+    }
+    std::cerr << "Saved " << written << " RAW frame(s) to " << frame_path(cfg.output_path, 0, frames)
+              << (frames > 1 ? " ..." : "") << std::endl;
+    if (dropped > 0) {
+        std::cerr << "Warning: the sensor dropped " << dropped << " frame(s) while frames were written." << std::endl;
     }
 
     camera->stop();
+    camera->requestCompleted.disconnect(on_request_completed);
     camera->release();
     cm->stop();
-    return 0;
+    return written == frames ? 0 : 1;
 }
 #else
 #include <iostream>
@@ -0,0 +1,492 @@
+#include "color_profile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace ColorProfile {
+
+namespace { // Anonymous namespace for local helpers
+
+// Linear sRGB (D65) <-> linear ProPhoto RGB (D50, Bradford-adapted), the
+// space DCP maps are defined over.
+constexpr float kSrgbToProPhoto[3][3] = {{0.5293458f, 0.3300728f, 0.1405812f},
+                                         {0.0983744f, 0.8734611f, 0.0281647f},
+                                         {0.0168832f, 0.1176725f, 0.8654443f}};
+constexpr float kProPhotoToSrgb[3][3] = {{2.0340763f, -0.7273343f, -0.3067417f},
+                                         {-0.2288135f, 1.2317302f, -0.0029169f},
+                                         {-0.0085698f, -0.1532866f, 1.1618565f}};
+// Bradford adaptation of XYZ from D50 (the ICC connection space) to D65.
+constexpr float kBradfordD50ToD65[3][3] = {{0.9555767f, -0.0230393f, 0.0631637f},
+                                           {-0.0282895f, 1.0099416f, 0.0210077f},
+                                           {0.0122982f, -0.0204830f, 1.3299099f}};
+
+void multiply(const float m[3][3], const float in[3], float out[3]) {
+    for (int i = 0; i < 3; ++i) out[i] = m[i][0] * in[0] + m[i][1] * in[1] + m[i][2] * in[2];
+}
+
+bool invert(const float in[3][3], float out[3][3]) {
+    const double det = double(in[0][0]) * (double(in[1][1]) * in[2][2] - double(in[2][1]) * in[1][2]) -
+                       double(in[0][1]) * (double(in[1][0]) * in[2][2] - double(in[1][2]) * in[2][0]) +
+                       double(in[0][2]) * (double(in[1][0]) * in[2][1] - double(in[1][1]) * in[2][0]);
+    if (std::abs(det) < 1e-12) return false;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            // The cofactor of (j, i), for the transpose.
+            const int r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+            out[i][j] = static_cast<float>((double(in[r0][c0]) * in[r1][c1] - double(in[r0][c1]) * in[r1][c0]) / det);
+        }
+    }
+    return true;
+}
+
+float srgb_encode(float x) { return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f; }
+float srgb_decode(float x) { return x <= 0.04045f ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f); }
+
+std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// FNV-1a.
+uint64_t hash_bytes(const std::vector<uint8_t>& bytes) {
+    uint64_t h = 1469598103934665603ull;
+    for (uint8_t b : bytes) h = (h ^ b) * 1099511628211ull;
+    return h;
+}
+
+// The parse of `path` by `parse`, shared by every caller that loads the
+// same contents. A file whose size and modification time are unchanged
+// isn't read again.
+template <typename T>
+std::shared_ptr<const T> load_cached(const std::string& path, T (*parse)(const std::vector<uint8_t>&, const std::string&)) {
+    struct Stamp {
+        std::filesystem::file_time_type time;
+        uintmax_t size = 0;
+        uint64_t hash = 0;
+    };
+    static std::mutex mutex;
+    static std::map<std::string, Stamp> stamps;
+    static std::map<uint64_t, std::shared_ptr<const T>> parsed;
+
+    std::error_code ec;
+    const auto time = std::filesystem::last_write_time(path, ec);
+    const uintmax_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+    if (ec) throw std::runtime_error("Cannot open " + path);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto stamp = stamps.find(path);
+        if (stamp != stamps.end() && stamp->second.time == time && stamp->second.size == size) {
+            return parsed.at(stamp->second.hash);
+        }
+    }
+    const std::vector<uint8_t> bytes = read_file(path);
+    const uint64_t hash = hash_bytes(bytes);
+    std::shared_ptr<const T> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = parsed.find(hash);
+        if (it != parsed.end()) result = it->second;
+    }
+    if (!result) result = std::make_shared<const T>(parse(bytes, path));
+    std::lock_guard<std::mutex> lock(mutex);
+    parsed.emplace(hash, result);
+    stamps[path] = Stamp{time, size, hash};
+    return result;
+}
+
+// --- DCP (a TIFF-structured file, magic "IIRC") ---
+
+// The IFD entries of a TIFF-structured file, each as doubles.
+class TiffTags {
+public:
+    TiffTags(const std::vector<uint8_t>& bytes, const std::string& path) : b_(bytes), path_(path) {
+        if (b_.size() < 8 || b_[0] != b_[1] || (b_[0] != 'I' && b_[0] != 'M')) fail();
+        big_ = b_[0] == 'M';
+        const uint32_t ifd = u32(4);
+        const uint16_t count = u16(ifd);
+        for (uint32_t i = 0; i < count; ++i) {
+            const size_t e = ifd + 2 + size_t(12) * i;
+            const uint16_t tag = u16(e), type = u16(e + 2);
+            const uint32_t n = u32(e + 4);
+            const size_t size = type == 3 ? 2 : type == 4 || type == 9 || type == 11 ? 4 : type == 5 || type == 10 || type == 12 ? 8 : 0;
+            if (size == 0) continue; // Strings and bytes: nothing we read.
+            if (n > b_.size()) fail();
+            const size_t at = size * n <= 4 ? e + 8 : u32(e + 8);
+            std::vector<double>& values = tags_[tag];
+            values.resize(n);
+            for (uint32_t k = 0; k < n; ++k) {
+                const size_t o = at + size * k;
+                switch (type) {
+                case 3: values[k] = u16(o); break;
+                case 4: values[k] = u32(o); break;
+                case 9: values[k] = int32_t(u32(o)); break;
+                case 5: values[k] = u32(o + 4) ? double(u32(o)) / u32(o + 4) : 0.0; break;
+                case 10: values[k] = u32(o + 4) ? double(int32_t(u32(o))) / int32_t(u32(o + 4)) : 0.0; break;
+                case 11: { uint32_t v = u32(o); float f; std::memcpy(&f, &v, 4); values[k] = f; break; }
+                case 12: {
+                    uint64_t v = big_ ? (uint64_t(u32(o)) << 32) | u32(o + 4) : (uint64_t(u32(o + 4)) << 32) | u32(o);
+                    double d;
+                    std::memcpy(&d, &v, 8);
+                    values[k] = d;
+                    break;
+                }
+                }
+            }
+        }
+    }
+
+    const std::vector<double>* find(uint16_t tag) const {
+        auto it = tags_.find(tag);
+        return it == tags_.end() ? nullptr : &it->second;
+    }
+
+private:
+    [[noreturn]] void fail() const { throw std::runtime_error("not a valid DCP profile: " + path_); }
+    uint16_t u16(size_t o) const {
+        if (o + 2 > b_.size()) fail();
+        return big_ ? uint16_t(b_[o] << 8 | b_[o + 1]) : uint16_t(b_[o + 1] << 8 | b_[o]);
+    }
+    uint32_t u32(size_t o) const {
+        if (o + 4 > b_.size()) fail();
+        return big_ ? uint32_t(u16(o)) << 16 | u16(o + 2) : uint32_t(u16(o + 2)) << 16 | u16(o);
+    }
+
+    const std::vector<uint8_t>& b_;
+    const std::string& path_;
+    bool big_ = false;
+    std::map<uint16_t, std::vector<double>> tags_;
+};
+
+// The colour temperature of an EXIF LightSource, as DNG readers take it.
+float illuminant_temperature(int light_source) {
+    switch (light_source) {
+    case 2: case 14: return 4150.0f;  // Fluorescent, cool white
+    case 3: case 17: return 2856.0f;  // Tungsten, standard light A
+    case 12: return 6430.0f;          // Daylight fluorescent
+    case 13: return 5000.0f;          // Day white fluorescent
+    case 15: return 3450.0f;          // White fluorescent
+    case 16: return 2940.0f;          // Warm white fluorescent
+    case 18: return 4874.0f;          // Standard light B
+    case 19: return 6774.0f;          // Standard light C
+    case 20: return 5503.0f;          // D55
+    case 10: case 21: return 6504.0f; // Cloudy, D65
+    case 11: case 22: return 7504.0f; // Shade, D75
+    case 23: return 5003.0f;          // D50
+    case 24: return 3200.0f;          // ISO studio tungsten
+    default: return 5500.0f;          // Daylight, flash, fine weather, unknown
+    }
+}
+
+HsvMap hsv_map(const TiffTags& tags, uint16_t dims_tag, uint16_t data_tag, uint16_t encoding_tag, const std::string& path) {
+    HsvMap map;
+    const std::vector<double>* dims = tags.find(dims_tag);
+    const std::vector<double>* data = tags.find(data_tag);
+    if (!dims || !data) return map;
+    if (dims->size() < 2) throw std::runtime_error("bad map dimensions in " + path);
+    map.hue_divisions = int((*dims)[0]);
+    map.sat_divisions = int((*dims)[1]);
+    map.val_divisions = dims->size() > 2 ? std::max(1, int((*dims)[2])) : 1;
+    const size_t count = size_t(map.hue_divisions) * map.sat_divisions * map.val_divisions * 3;
+    if (map.hue_divisions < 1 || map.sat_divisions < 2 || data->size() != count) {
+        throw std::runtime_error("bad map in " + path);
+    }
+    map.data.assign(data->begin(), data->end());
+    const std::vector<double>* encoding = tags.find(encoding_tag);
+    map.srgb_value = encoding && !encoding->empty() && (*encoding)[0] == 1.0;
+    return map;
+}
+
+InputProfile parse_dcp(const std::vector<uint8_t>& bytes, const std::string& path) {
+    const TiffTags tags(bytes, path);
+    InputProfile profile;
+    const uint16_t matrix_tags[2] = {50721, 50722}, illuminant_tags[2] = {50778, 50779};
+    for (int i = 0; i < 2; ++i) {
+        const std::vector<double>* m = tags.find(matrix_tags[i]);
+        if (!m) continue;
+        if (m->size() != 9) throw std::runtime_error("only 3-colour DCP profiles are supported: " + path);
+        const int n = profile.matrix_count++;
+        for (int k = 0; k < 9; ++k) profile.xyz_to_cam[n][k / 3][k % 3] = float((*m)[k]);
+        const std::vector<double>* light = tags.find(illuminant_tags[i]);
+        profile.temperature[n] = illuminant_temperature(light && !light->empty() ? int((*light)[0]) : 0);
+    }
+    profile.hue_sat_map[0] = hsv_map(tags, 50937, 50938, 51107, path);
+    profile.hue_sat_map[1] = hsv_map(tags, 50937, 50939, 51107, path);
+    profile.look_table = hsv_map(tags, 50981, 50982, 51108, path);
+    if (profile.matrix_count == 0 && !profile.has_look()) {
+        throw std::runtime_error("DCP profile has no colour matrix or maps: " + path);
+    }
+    // Lower temperature first; the maps follow their illuminants.
+    if (profile.matrix_count == 2 && profile.temperature[0] > profile.temperature[1]) {
+        std::swap(profile.xyz_to_cam[0], profile.xyz_to_cam[1]);
+        std::swap(profile.temperature[0], profile.temperature[1]);
+        if (!profile.hue_sat_map[1].empty()) std::swap(profile.hue_sat_map[0], profile.hue_sat_map[1]);
+    }
+    return profile;
+}
+
+// --- ICC (matrix profiles only) ---
+
+InputProfile parse_icc(const std::vector<uint8_t>& bytes, const std::string& path) {
+    auto u32 = [&](size_t o) -> uint32_t {
+        if (o + 4 > bytes.size()) throw std::runtime_error("not a valid ICC profile: " + path);
+        return uint32_t(bytes[o]) << 24 | uint32_t(bytes[o + 1]) << 16 | uint32_t(bytes[o + 2]) << 8 | bytes[o + 3];
+    };
+    if (u32(16) != 0x52474220) throw std::runtime_error("ICC profile is not for RGB data: " + path); // 'RGB '
+    float cam_to_xyz[3][3];
+    const uint32_t colourants[3] = {0x7258595A, 0x6758595A, 0x6258595A}; // rXYZ, gXYZ, bXYZ
+    const uint32_t count = u32(128);
+    for (int c = 0; c < 3; ++c) {
+        bool found = false;
+        for (uint32_t i = 0; i < count && !found; ++i) {
+            const size_t e = 132 + size_t(12) * i;
+            if (u32(e) != colourants[c]) continue;
+            const size_t at = u32(e + 4);
+            if (u32(at) != 0x58595A20) break; // 'XYZ '
+            for (int k = 0; k < 3; ++k) cam_to_xyz[k][c] = float(int32_t(u32(at + 8 + 4 * k))) / 65536.0f;
+            found = true;
+        }
+        if (!found) throw std::runtime_error("only matrix ICC profiles (rXYZ, gXYZ, bXYZ) are supported: " + path);
+    }
+    // The colourants are in the D50 connection space; the pipeline's XYZ is D65.
+    float cam_to_xyz_d65[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            cam_to_xyz_d65[i][j] = 0.0f;
+            for (int k = 0; k < 3; ++k) cam_to_xyz_d65[i][j] += kBradfordD50ToD65[i][k] * cam_to_xyz[k][j];
+        }
+    }
+    InputProfile profile;
+    if (!invert(cam_to_xyz_d65, profile.xyz_to_cam[0])) throw std::runtime_error("ICC profile's matrix is singular: " + path);
+    profile.matrix_count = 1;
+    profile.temperature[0] = 6504.0f;
+    return profile;
+}
+
+InputProfile parse_input_profile(const std::vector<uint8_t>& bytes, const std::string& path) {
+    if (bytes.size() >= 4 && ((bytes[0] == 'I' && bytes[1] == 'I' && bytes[2] == 'R' && bytes[3] == 'C') ||
+                              (bytes[0] == 'M' && bytes[1] == 'M' && bytes[2] == 'C' && bytes[3] == 'R'))) {
+        return parse_dcp(bytes, path);
+    }
+    if (bytes.size() >= 132 && std::memcmp(&bytes[36], "acsp", 4) == 0) return parse_icc(bytes, path);
+    throw std::runtime_error("not a DCP or ICC profile: " + path);
+}
+
+// --- .cube ---
+
+CubeLut parse_cube(const std::vector<uint8_t>& bytes, const std::string& path) {
+    CubeLut lut;
+    std::istringstream in(std::string(bytes.begin(), bytes.end()));
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        std::istringstream fields(line.substr(start));
+        if (std::isalpha(static_cast<unsigned char>(line[start]))) {
+            std::string key;
+            fields >> key;
+            if (key == "LUT_3D_SIZE") {
+                fields >> lut.size;
+                if (fields.fail() || lut.size < 2 || lut.size > 256) throw std::runtime_error("bad LUT_3D_SIZE in " + path);
+                lut.data.reserve(size_t(lut.size) * lut.size * lut.size * 3);
+            } else if (key == "DOMAIN_MIN") {
+                fields >> lut.domain_min[0] >> lut.domain_min[1] >> lut.domain_min[2];
+            } else if (key == "DOMAIN_MAX") {
+                fields >> lut.domain_max[0] >> lut.domain_max[1] >> lut.domain_max[2];
+            } else if (key == "LUT_3D_INPUT_RANGE") {
+                float lo = 0.0f, hi = 1.0f;
+                fields >> lo >> hi;
+                for (int c = 0; c < 3; ++c) lut.domain_min[c] = lo, lut.domain_max[c] = hi;
+            } else if (key == "LUT_1D_SIZE") {
+                throw std::runtime_error("1D .cube LUTs are not supported: " + path);
+            }
+            if (fields.fail()) throw std::runtime_error("bad " + key + " line in " + path);
+            continue;
+        }
+        float r, g, b;
+        fields >> r >> g >> b;
+        if (fields.fail()) throw std::runtime_error("bad line in " + path + ": " + line);
+        lut.data.insert(lut.data.end(), {r, g, b});
+    }
+    if (lut.size == 0 || lut.data.size() != size_t(lut.size) * lut.size * lut.size * 3) {
+        throw std::runtime_error("incomplete 3D LUT in " + path);
+    }
+    for (int c = 0; c < 3; ++c) {
+        if (!(lut.domain_max[c] > lut.domain_min[c])) throw std::runtime_error("bad domain in " + path);
+    }
+    return lut;
+}
+
+// --- Applying them ---
+
+// RGB <-> HSV as the DNG SDK does it: hue in [0, 6).
+void rgb_to_hsv(const float rgb[3], float& h, float& s, float& v) {
+    v = std::max({rgb[0], rgb[1], rgb[2]});
+    const float gap = v - std::min({rgb[0], rgb[1], rgb[2]});
+    if (gap <= 0.0f) {
+        h = s = 0.0f;
+        return;
+    }
+    if (rgb[0] == v) {
+        h = (rgb[1] - rgb[2]) / gap;
+        if (h < 0.0f) h += 6.0f;
+    } else if (rgb[1] == v) {
+        h = 2.0f + (rgb[2] - rgb[0]) / gap;
+    } else {
+        h = 4.0f + (rgb[0] - rgb[1]) / gap;
+    }
+    s = gap / v;
+}
+
+void hsv_to_rgb(float h, float s, float v, float rgb[3]) {
+    if (s <= 0.0f) {
+        rgb[0] = rgb[1] = rgb[2] = v;
+        return;
+    }
+    h = std::fmod(h, 6.0f);
+    if (h < 0.0f) h += 6.0f;
+    const int i = std::min(5, int(h));
+    const float f = h - i, p = v * (1.0f - s), q = v * (1.0f - s * f), t = v * (1.0f - s * (1.0f - f));
+    const float table[6][3] = {{v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+    for (int c = 0; c < 3; ++c) rgb[c] = table[i][c];
+}
+
+// The map's (hue shift, saturation scale, value scale) at an HSV colour,
+// interpolated trilinearly, with the hue axis wrapping round.
+void lookup(const HsvMap& map, float h, float s, float v, float out[3]) {
+    const float hf = h * map.hue_divisions / 6.0f;
+    const float sf = std::min(std::max(s, 0.0f), 1.0f) * (map.sat_divisions - 1);
+    float vv = std::min(std::max(v, 0.0f), 1.0f);
+    if (map.srgb_value) vv = srgb_encode(vv);
+    const float vf = vv * (map.val_divisions - 1);
+    const int h0 = int(hf) % map.hue_divisions, h1 = (h0 + 1) % map.hue_divisions;
+    const int s0 = std::min(int(sf), map.sat_divisions - 2);
+    const int v0 = std::min(int(vf), std::max(0, map.val_divisions - 2));
+    const int v1 = std::min(v0 + 1, map.val_divisions - 1);
+    const float ht = hf - std::floor(hf), st = sf - s0, vt = vf - v0;
+    auto at = [&](int vi, int hi, int si, int k) {
+        return map.data[((size_t(vi) * map.hue_divisions + hi) * map.sat_divisions + si) * 3 + k];
+    };
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    for (int k = 0; k < 3; ++k) {
+        float by_v[2];
+        const int vs[2] = {v0, v1};
+        for (int n = 0; n < 2; ++n) {
+            const float lo = lerp(at(vs[n], h0, s0, k), at(vs[n], h0, s0 + 1, k), st);
+            const float hi = lerp(at(vs[n], h1, s0, k), at(vs[n], h1, s0 + 1, k), st);
+            by_v[n] = lerp(lo, hi, ht);
+        }
+        out[k] = lerp(by_v[0], by_v[1], vt);
+    }
+}
+
+void apply_map(float shift_scales[3], float& h, float& s, float& v) {
+    h += shift_scales[0] * (6.0f / 360.0f);
+    s = std::min(s * shift_scales[1], 1.0f);
+    v *= shift_scales[2];
+}
+
+// The weight of the first of two calibrations at `color_temp`, linear in
+// inverse temperature as in DNG.
+float first_weight(const InputProfile& profile, float color_temp) {
+    const float t0 = profile.temperature[0], t1 = profile.temperature[1];
+    if (t0 <= 0.0f || t1 <= 0.0f || t0 == t1 || color_temp <= 0.0f) return 1.0f;
+    const float w = (1.0f / color_temp - 1.0f / t1) / (1.0f / t0 - 1.0f / t1);
+    return std::min(std::max(w, 0.0f), 1.0f);
+}
+
+// Trilinear lookup of an sRGB-encoded colour.
+void sample_cube(const CubeLut& lut, const float in[3], float out[3]) {
+    const int n = lut.size;
+    int i0[3];
+    float t[3];
+    for (int c = 0; c < 3; ++c) {
+        const float x = (in[c] - lut.domain_min[c]) / (lut.domain_max[c] - lut.domain_min[c]);
+        const float f = std::min(std::max(x, 0.0f), 1.0f) * (n - 1);
+        i0[c] = std::min(int(f), n - 2);
+        t[c] = f - i0[c];
+    }
+    auto at = [&](int r, int g, int b, int k) { return lut.data[((size_t(b) * n + g) * n + r) * 3 + k]; };
+    for (int k = 0; k < 3; ++k) {
+        float sum = 0.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            const int dr = corner & 1, dg = (corner >> 1) & 1, db = corner >> 2;
+            const float w = (dr ? t[0] : 1.0f - t[0]) * (dg ? t[1] : 1.0f - t[1]) * (db ? t[2] : 1.0f - t[2]);
+            sum += w * at(i0[0] + dr, i0[1] + dg, i0[2] + db, k);
+        }
+        out[k] = sum;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const InputProfile> load_input_profile(const std::string& path) {
+    return load_cached<InputProfile>(path, parse_input_profile);
+}
+
+std::shared_ptr<const CubeLut> load_cube_lut(const std::string& path) {
+    return load_cached<CubeLut>(path, parse_cube);
+}
+
+bool xyz_to_camera(const InputProfile& profile, float color_temp, float out[3][3]) {
+    if (profile.matrix_count == 0) return false;
+    const float w = profile.matrix_count == 2 ? first_weight(profile, color_temp) : 1.0f;
+    const int second = profile.matrix_count == 2 ? 1 : 0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            out[i][j] = w * profile.xyz_to_cam[0][i][j] + (1.0f - w) * profile.xyz_to_cam[second][i][j];
+        }
+    }
+    return true;
+}
+
+void apply_look(const InputProfile* profile, const CubeLut* lut, float color_temp, float rgb[3]) {
+    if (profile && profile->has_look()) {
+        float pp[3];
+        multiply(kSrgbToProPhoto, rgb, pp);
+        // Colours outside even ProPhoto (only the corners of the grading
+        // LUT's lattice) have no HSV; they are left as they are.
+        if (pp[0] >= 0.0f && pp[1] >= 0.0f && pp[2] >= 0.0f) {
+            float h, s, v;
+            rgb_to_hsv(pp, h, s, v);
+            const HsvMap& first = profile->hue_sat_map[0];
+            const HsvMap& second = profile->hue_sat_map[1];
+            if (!first.empty()) {
+                float a[3];
+                lookup(first, h, s, v, a);
+                if (!second.empty()) {
+                    const float w = first_weight(*profile, color_temp);
+                    float b[3];
+                    lookup(second, h, s, v, b);
+                    for (int k = 0; k < 3; ++k) a[k] = w * a[k] + (1.0f - w) * b[k];
+                }
+                apply_map(a, h, s, v);
+            }
+            if (!profile->look_table.empty()) {
+                float a[3];
+                lookup(profile->look_table, std::fmod(h + 6.0f, 6.0f), s, v, a);
+                apply_map(a, h, s, v);
+            }
+            hsv_to_rgb(h, s, v, pp);
+            multiply(kProPhotoToSrgb, pp, rgb);
+        }
+    }
+    if (lut) {
+        // .cube LUTs are made for sRGB-encoded values.
+        float encoded[3], graded[3];
+        for (int c = 0; c < 3; ++c) encoded[c] = srgb_encode(std::max(rgb[c], 0.0f));
+        sample_cube(*lut, encoded, graded);
+        for (int c = 0; c < 3; ++c) rgb[c] = graded[c] < 0.0f ? -srgb_decode(-graded[c]) : srgb_decode(graded[c]);
+    }
+}
+
+} // namespace ColorProfile
@@ -0,0 +1,71 @@
+#ifndef COLOR_PROFILE_H
+#define COLOR_PROFILE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Camera input profiles (Adobe DCP, or matrix ICC) and creative 3D LUTs
+// (.cube), read once and folded into inputs the pipeline already has. A
+// profile's matrices take the place of the raw's in the colour matrix
+// (PipelineUtils::color_matrix_for). Its hue/saturation maps, and the LUT,
+// are baked into the colour grading LUT ahead of the grading
+// (PipelineUtils::color_grading_lut_for). Neither adds a stage, so neither
+// costs anything per pixel.
+//
+// Files are parsed once per process and shared, keyed by a hash of their
+// contents, so --batch, --looks and every editor render reuse the first
+// parse. Loaders throw std::runtime_error on a file they can't read.
+namespace ColorProfile {
+
+// A DCP ProfileHueSatMap or ProfileLookTable: at each (hue, saturation,
+// value) node of HSV over linear ProPhoto RGB, a hue shift in degrees and
+// scales for the saturation and the value.
+struct HsvMap {
+    int hue_divisions = 0, sat_divisions = 0, val_divisions = 0;
+    bool srgb_value = false;    // The value axis is sRGB-encoded (DCP encoding 1).
+    std::vector<float> data;    // [val][hue][sat][3]
+
+    bool empty() const { return data.empty(); }
+};
+
+struct InputProfile {
+    // XYZ -> camera matrices, as a DNG ColorMatrix, with the colour
+    // temperatures in kelvin they were calibrated at, lower first. A DCP
+    // has one or two, an ICC profile one; 0 leaves the raw's in use.
+    int matrix_count = 0;
+    float xyz_to_cam[2][3][3] = {};
+    float temperature[2] = {0.0f, 0.0f};
+    // The DCP's maps: hue_sat_map[i] for illuminant i (the second may be
+    // empty), then the look table.
+    HsvMap hue_sat_map[2];
+    HsvMap look_table;
+
+    bool has_look() const { return !hue_sat_map[0].empty() || !look_table.empty(); }
+};
+
+// A .cube 3D LUT over sRGB-encoded values in [domain_min, domain_max].
+struct CubeLut {
+    int size = 0;
+    float domain_min[3] = {0.0f, 0.0f, 0.0f};
+    float domain_max[3] = {1.0f, 1.0f, 1.0f};
+    std::vector<float> data; // [b][g][r][3], red fastest as in the file.
+};
+
+// A .dcp file, or an .icc/.icm one with rXYZ/gXYZ/bXYZ colourants (its
+// tone curves are taken to be linear, as camera profiles' are).
+std::shared_ptr<const InputProfile> load_input_profile(const std::string& path);
+std::shared_ptr<const CubeLut> load_cube_lut(const std::string& path);
+
+// The profile's XYZ -> camera matrix at `color_temp`, interpolated in
+// inverse temperature between its two as DNG readers do. False if it has
+// no matrices.
+bool xyz_to_camera(const InputProfile& profile, float color_temp, float out[3][3]);
+
+// Applies the profile's hue/saturation map (for `color_temp`) and look
+// table, then the LUT, to a linear sRGB colour in place. Either may be null.
+void apply_look(const InputProfile* profile, const CubeLut* lut, float color_temp, float rgb[3]);
+
+} // namespace ColorProfile
+
+#endif // COLOR_PROFILE_H
@@ -3,6 +3,8 @@
 #include "pipeline_helpers.h"
 #include <cmath>
 #include <algorithm> // for std::min/max
+#include <thread>
+#include <vector>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -32,6 +34,60 @@ namespace HostColor {
                 return 3.0f*delta*delta*(t - 16.0f/116.0f);
             }
         }
+
+        float lab_f(float t) {
+            const float T = 0.008856451679035631f;
+            return t > T ? std::cbrt(t) : (7.787037037037037f * t) + (16.0f / 116.0f);
+        }
+
+        void linear_srgb_to_lch(float r, float g, float b, float& L, float& C, float& h) {
+            const float Xn = 0.95047f, Yn = 1.0f, Zn = 1.08883f;
+            float X = 0.4124564f*r + 0.3575761f*g + 0.1804375f*b;
+            float Y = 0.2126729f*r + 0.7151522f*g + 0.0721750f*b;
+            float Z = 0.0193339f*r + 0.1191920f*g + 0.9503041f*b;
+            float fX = lab_f(X / Xn), fY = lab_f(Y / Yn), fZ = lab_f(Z / Zn);
+            float a = 500.0f*(fX - fY), bb = 200.0f*(fY - fZ);
+            L = 116.0f*fY - 16.0f;
+            C = sqrtf(a*a + bb*bb);
+            h = (C > 1e-5f) ? atan2f(bb, a) : 0.0f;
+        }
+
+        // ColorGradeBuilder's trilinear lookup, on the host.
+        void sample_color_lut(const Buffer<float, 4>& lut, float L, float C, float h, float out[3]) {
+            const int n = lut.dim(0).extent();
+            float lf = std::max(0.0f, std::min(1.0f, L / 100.f)) * (n - 1);
+            float Cf = std::max(0.0f, std::min(1.0f, C / 150.f)) * (n - 1);
+            float hf = std::max(0.0f, std::min(1.0f, (h + (float)M_PI) / (2.f * (float)M_PI))) * (n - 1);
+            int li = (int)std::floor(lf), Ci = (int)std::floor(Cf), hi = (int)std::floor(hf);
+            float ld = lf - li, Cd = Cf - Ci, hd = hf - hi;
+            auto at = [&](int l, int cc, int hh, int ch) {
+                return lut(std::min(l, n - 1), std::min(cc, n - 1), std::min(hh, n - 1), ch);
+            };
+            auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+            for (int ch = 0; ch < 3; ++ch) {
+                float c00 = lerp(at(li, Ci, hi, ch), at(li + 1, Ci, hi, ch), ld);
+                float c01 = lerp(at(li, Ci, hi + 1, ch), at(li + 1, Ci, hi + 1, ch), ld);
+                float c10 = lerp(at(li, Ci + 1, hi, ch), at(li + 1, Ci + 1, hi, ch), ld);
+                float c11 = lerp(at(li, Ci + 1, hi + 1, ch), at(li + 1, Ci + 1, hi + 1, ch), ld);
+                out[ch] = lerp(lerp(c00, c10, Cd), lerp(c01, c11, Cd), hd);
+            }
+        }
+
+        // Storage order of the 3D LUTs: the channel innermost, as
+        // require_interleaved_lut (stage_color_grading.h) expects.
+        const std::vector<int> kInterleavedLut = {3, 0, 1, 2};
+
+        // Runs fill(begin, end) over [0, size) split across threads.
+        template <typename F>
+        void parallel_slices(int size, F fill) {
+            const int threads = std::max(1, std::min(size, static_cast<int>(std::thread::hardware_concurrency())));
+            std::vector<std::thread> workers;
+            for (int t = 1; t < threads; ++t) {
+                workers.emplace_back(fill, size * t / threads, size * (t + 1) / threads);
+            }
+            fill(0, size / threads);
+            for (auto& w : workers) w.join();
+        }
     }
 
     RGB lch_to_linear_srgb(float L, float C, float h_rads) {
@@ -57,8 +113,9 @@ namespace HostColor {
         return {r, g, b_srgb};
     }
 
-    Halide::Runtime::Buffer<float, 4> generate_color_lut(const ProcessConfig& cfg, int size) {
-        Buffer<float, 4> lut(size, size, size, 3);
+    Halide::Runtime::Buffer<float, 4> generate_color_lut(const ProcessConfig& cfg, int size,
+                                                         const std::function<void(float rgb[3])>& look) {
+        Buffer<float, 4> lut({size, size, size, 3}, kInterleavedLut);
 
         ToneCurveUtils::Spline H_v_H(cfg.curve_hue_vs_hue, 0.0f, true);
         ToneCurveUtils::Spline H_v_S(cfg.curve_hue_vs_sat, 1.0f);
@@ -69,60 +126,105 @@ namespace HostColor {
         // The loop order MUST match the memory layout of the LUT for correctness.
         // Halide buffer layout is (dim0, dim1, dim2, ...), which in this case we
         // have defined as (L, C, H). The innermost loop must correspond to dim0.
-        for (int h_i = 0; h_i < size; ++h_i) {
-            for (int c_i = 0; c_i < size; ++c_i) {
-                for (int l_i = 0; l_i < size; ++l_i) {
-                    // 1. Denormalize grid coordinates to Lch values
-                    float L_in = (float)l_i / (size - 1); // Normalized L [0, 1] for curves
-                    float C_in_norm = (float)c_i / (size - 1); // Normalized C [0, 1] for curves
-                    float h_in_norm = (float)h_i / (size - 1); // Normalized h [0, 1] for curves
-
-                    float L_phys = L_in * 100.0f;
-                    float C_phys = C_in_norm * 150.0f;
-                    float h_rads = (h_in_norm * 2.f * M_PI) - M_PI; // Map to [-pi, pi]
-
-                    float L_out = L_phys;
-                    float C_out = C_phys;
-                    float h_out_rads = h_rads;
-
-                    // 2. Apply curves
-                    h_out_rads += H_v_H.evaluate(h_in_norm) * M_PI; // Additive, scaled to +/- 180 deg
-                    C_out *= H_v_S.evaluate(h_in_norm);
-                    L_out += H_v_L.evaluate(h_in_norm) * 100.0f; // Additive, scaled to +/- 100 L
-                    C_out *= L_v_S.evaluate(L_in);
-
-                    // The Sat vs Sat curve maps a normalized saturation to a new normalized saturation.
-                    // We must normalize the current C_out, evaluate, and then scale back.
-                    C_out = S_v_S.evaluate(C_out / 150.0f) * 150.0f;
-
-                    // 3. Apply color wheels (in Lab space)
-                    float a = C_out * cosf(h_out_rads);
-                    float b = C_out * sinf(h_out_rads);
-
-                    float luma_norm = L_out / 100.f;
-                    float shadow_w = 1.0f - smoothstep(0.0f, 0.5f, luma_norm);
-                    float hi_w = smoothstep(0.5f, 1.0f, luma_norm);
-                    float mid_w = 1.0f - shadow_w - hi_w;
-
-                    const float wheel_scale = 50.0f; // Controls sensitivity of color wheels
-                    a += (cfg.shadows_wheel.x * shadow_w + cfg.midtones_wheel.x * mid_w + cfg.highlights_wheel.x * hi_w) * wheel_scale;
-                    b += (cfg.shadows_wheel.y * shadow_w + cfg.midtones_wheel.y * mid_w + cfg.highlights_wheel.y * hi_w) * wheel_scale;
-
-                    L_out *= (1.0f + cfg.shadows_luma/100.f * shadow_w);
-                    L_out *= (1.0f + cfg.midtones_luma/100.f * mid_w);
-                    L_out *= (1.0f + cfg.highlights_luma/100.f * hi_w);
-
-                    // 4. Convert back to Lch and store in LUT
-                    C_out = sqrtf(a*a + b*b);
-                    // Stabilize hue calculation for near-achromatic colors.
-                    h_out_rads = (C_out > 1e-5f) ? atan2f(b, a) : 0.0f;
-
-                    lut(l_i, c_i, h_i, 0) = L_out;
-                    lut(l_i, c_i, h_i, 1) = C_out;
-                    lut(l_i, c_i, h_i, 2) = h_out_rads;
+        // Each hue slice is independent, so slices are split across threads.
+        auto fill_slices = [&](int h_begin, int h_end) {
+            for (int h_i = h_begin; h_i < h_end; ++h_i) {
+                for (int c_i = 0; c_i < size; ++c_i) {
+                    for (int l_i = 0; l_i < size; ++l_i) {
+                        // 1. Denormalize grid coordinates to Lch values
+                        float L_in = (float)l_i / (size - 1); // Normalized L [0, 1] for curves
+                        float C_in_norm = (float)c_i / (size - 1); // Normalized C [0, 1] for curves
+                        float h_in_norm = (float)h_i / (size - 1); // Normalized h [0, 1] for curves
+
+                        float L_phys = L_in * 100.0f;
+                        float C_phys = C_in_norm * 150.0f;
+                        float h_rads = (h_in_norm * 2.f * M_PI) - M_PI; // Map to [-pi, pi]
+
+                        // The look comes first; the curves below grade its result.
+                        if (look) {
+                            RGB rgb = lch_to_linear_srgb(L_phys, C_phys, h_rads);
+                            float v[3] = {rgb.r, rgb.g, rgb.b};
+                            look(v);
+                            linear_srgb_to_lch(v[0], v[1], v[2], L_phys, C_phys, h_rads);
+                            L_in = std::max(0.0f, std::min(1.0f, L_phys / 100.0f));
+                            C_in_norm = std::max(0.0f, std::min(1.0f, C_phys / 150.0f));
+                            h_in_norm = (h_rads + (float)M_PI) / (2.f * (float)M_PI);
+                        }
+
+                        float L_out = L_phys;
+                        float C_out = C_phys;
+                        float h_out_rads = h_rads;
+
+                        // 2. Apply curves
+                        h_out_rads += H_v_H.evaluate(h_in_norm) * M_PI; // Additive, scaled to +/- 180 deg
+                        C_out *= H_v_S.evaluate(h_in_norm);
+                        L_out += H_v_L.evaluate(h_in_norm) * 100.0f; // Additive, scaled to +/- 100 L
+                        C_out *= L_v_S.evaluate(L_in);
+
+                        // The Sat vs Sat curve maps a normalized saturation to a new normalized saturation.
+                        // We must normalize the current C_out, evaluate, and then scale back.
+                        C_out = S_v_S.evaluate(C_out / 150.0f) * 150.0f;
+
+                        // 3. Apply color wheels (in Lab space)
+                        float a = C_out * cosf(h_out_rads);
+                        float b = C_out * sinf(h_out_rads);
+
+                        float luma_norm = L_out / 100.f;
+                        float shadow_w = 1.0f - smoothstep(0.0f, 0.5f, luma_norm);
+                        float hi_w = smoothstep(0.5f, 1.0f, luma_norm);
+                        float mid_w = 1.0f - shadow_w - hi_w;
+
+                        const float wheel_scale = 50.0f; // Controls sensitivity of color wheels
+                        a += (cfg.shadows_wheel.x * shadow_w + cfg.midtones_wheel.x * mid_w + cfg.highlights_wheel.x * hi_w) * wheel_scale;
+                        b += (cfg.shadows_wheel.y * shadow_w + cfg.midtones_wheel.y * mid_w + cfg.highlights_wheel.y * hi_w) * wheel_scale;
+
+                        L_out *= (1.0f + cfg.shadows_luma/100.f * shadow_w);
+                        L_out *= (1.0f + cfg.midtones_luma/100.f * mid_w);
+                        L_out *= (1.0f + cfg.highlights_luma/100.f * hi_w);
+
+                        // 4. Convert back to Lch and store in LUT
+                        C_out = sqrtf(a*a + b*b);
+                        // Stabilize hue calculation for near-achromatic colors.
+                        h_out_rads = (C_out > 1e-5f) ? atan2f(b, a) : 0.0f;
+
+                        lut(l_i, c_i, h_i, 0) = L_out;
+                        lut(l_i, c_i, h_i, 1) = C_out;
+                        lut(l_i, c_i, h_i, 2) = h_out_rads;
+                    }
                 }
             }
+        };
+
+        parallel_slices(size, fill_slices);
+        return lut;
+    }
+
+    Halide::Runtime::Buffer<float, 4> generate_rgb_color_lut(const Buffer<float, 4>& lch_lut, int size) {
+        Buffer<float, 4> lut({size, size, size, 3}, kInterleavedLut);
+
+        // Node i of each axis is at (i / (size - 1))^2, RgbLutBuilder's shaper.
+        std::vector<float> level(size);
+        for (int i = 0; i < size; ++i) {
+            float t = (float)i / (size - 1);
+            level[i] = t * t;
         }
+
+        auto fill_slices = [&](int b_begin, int b_end) {
+            for (int b_i = b_begin; b_i < b_end; ++b_i) {
+                for (int g_i = 0; g_i < size; ++g_i) {
+                    for (int r_i = 0; r_i < size; ++r_i) {
+                        float L, C, h, graded[3];
+                        linear_srgb_to_lch(level[r_i], level[g_i], level[b_i], L, C, h);
+                        sample_color_lut(lch_lut, L, C, h, graded);
+                        RGB out = lch_to_linear_srgb(graded[0], graded[1], graded[2]);
+                        lut(r_i, g_i, b_i, 0) = out.r;
+                        lut(r_i, g_i, b_i, 1) = out.g;
+                        lut(r_i, g_i, b_i, 2) = out.b;
+                    }
+                }
+            }
+        };
+        parallel_slices(size, fill_slices);
         return lut;
     }
 }
@@ -5,6 +5,8 @@
 #include "HalideBuffer.h"
 #include "process_options.h"
 
+#include <functional>
+
 // --- Halide Pipeline Color Conversion Helpers ---
 // These are generator-side helpers that build Halide expression trees.
 // They are defined as inline functions in the header so that only the
@@ -27,6 +29,37 @@ namespace HalideColor {
             const float delta = 6.0f / 29.0f;
             return select(t > delta, t*t*t, 3.0f*delta*delta*(t - 16.0f/116.0f));
         }
+
+        // --- Fast-math variants (the `fast` flag of the conversions below) ---
+        // Kept well under the noise floor of the pipeline: over the sRGB cube
+        // and highlights up to 4x, the fast forward and inverse conversions
+        // stay within dE76 0.01 of the precise ones (src/tests/test_color_tools.cpp).
+
+        // Cube root for t > 0: an exponent-bit initial guess (~3% off), then
+        // two Newton steps (each squares the relative error), ~1e-6 relative.
+        inline Expr fast_cbrt(Expr t) {
+            Expr y = reinterpret<float>(reinterpret<int32_t>(t) / 3 + 0x2a5137a0);
+            y = (2.0f * y + t / (y * y)) * (1.0f / 3.0f);
+            y = (2.0f * y + t / (y * y)) * (1.0f / 3.0f);
+            return y;
+        }
+
+        inline Expr lab_f_fast(Expr t) {
+            const float T = 0.008856451679035631f;
+            return select(t > T, fast_cbrt(t), (7.787037037037037f * t) + (16.0f / 116.0f));
+        }
+
+        // atan2 from Hastings' minimax polynomial for atan on [0, 1] (max
+        // error 1e-5 rad), folded out to the full circle.
+        inline Expr fast_atan2(Expr y, Expr x) {
+            Expr ax = abs(x), ay = abs(y);
+            Expr a = min(ax, ay) / max(max(ax, ay), 1e-30f);
+            Expr s = a * a;
+            Expr r = a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+            r = select(ay > ax, 1.5707963f - r, r);
+            r = select(x < 0.0f, 3.1415927f - r, r);
+            return select(y < 0.0f, -r, r);
+        }
     }
 
     inline Func linear_srgb_to_xyz(Func srgb, Var x, Var y, Var c) {
@@ -39,29 +72,30 @@ namespace HalideColor {
         return xyz;
     }
 
-    inline Func xyz_to_lab(Func xyz, Var x, Var y, Var c) {
+    inline Func xyz_to_lab(Func xyz, Var x, Var y, Var c, bool fast = false) {
         const float Xn = 0.95047f, Yn = 1.0f, Zn = 1.08883f;
-        Expr fX = lab_f(xyz(x, y, 0)/Xn), fY = lab_f(xyz(x, y, 1)/Yn), fZ = lab_f(xyz(x, y, 2)/Zn);
+        auto f = fast ? lab_f_fast : lab_f;
+        Expr fX = f(xyz(x, y, 0)/Xn), fY = f(xyz(x, y, 1)/Yn), fZ = f(xyz(x, y, 2)/Zn);
         Expr L = 116.0f*fY - 16.0f, a = 500.0f*(fX - fY), b = 200.0f*(fY - fZ);
         Func lab("xyz_to_lab");
         lab(x, y, c) = mux(c, {L, a, b});
         return lab;
     }
 
-    inline Func lab_to_lch(Func lab, Var x, Var y, Var c) {
+    inline Func lab_to_lch(Func lab, Var x, Var y, Var c, bool fast = false) {
         Expr L = lab(x, y, 0), a = lab(x, y, 1), b = lab(x, y, 2);
         Expr C = sqrt(a*a + b*b);
         // Stabilize hue calculation for near-achromatic colors.
-        Expr h = select(C > 1e-5f, atan2(b, a), 0.0f);
+        Expr h = select(C > 1e-5f, fast ? fast_atan2(b, a) : atan2(b, a), 0.0f);
         Func lch("lab_to_lch");
         lch(x, y, c) = mux(c, {L, C, h});
         return lch;
     }
 
-    inline Func lch_to_lab(Func lch, Var x, Var y, Var c) {
+    inline Func lch_to_lab(Func lch, Var x, Var y, Var c, bool fast = false) {
         Expr L = lch(x, y, 0), C = lch(x, y, 1), h = lch(x, y, 2);
-        Expr a = C * cos(h);
-        Expr b = C * sin(h);
+        Expr a = C * (fast ? fast_cos(h) : cos(h));
+        Expr b = C * (fast ? fast_sin(h) : sin(h));
         Func lab("lch_to_lab");
         lab(x, y, c) = mux(c, {L, a, b});
         return lab;
@@ -87,16 +121,18 @@ namespace HalideColor {
         return srgb;
     }
 
-    inline Func linear_srgb_to_lch(Func srgb, Var x, Var y, Var c) {
+    // `fast` swaps the cube root, atan2 and sin/cos for the approximations
+    // above (CMake FAST_COLOR_MATH); sqrt is a single instruction either way.
+    inline Func linear_srgb_to_lch(Func srgb, Var x, Var y, Var c, bool fast = false) {
         Func xyz = linear_srgb_to_xyz(srgb, x, y, c);
-        Func lab = xyz_to_lab(xyz, x, y, c);
-        Func lch = lab_to_lch(lab, x, y, c);
+        Func lab = xyz_to_lab(xyz, x, y, c, fast);
+        Func lch = lab_to_lch(lab, x, y, c, fast);
         xyz.compute_inline(); lab.compute_inline();
         return lch;
     }
 
-    inline Func lch_to_linear_srgb(Func lch, Var x, Var y, Var c) {
-        Func lab = lch_to_lab(lch, x, y, c);
+    inline Func lch_to_linear_srgb(Func lch, Var x, Var y, Var c, bool fast = false) {
+        Func lab = lch_to_lab(lch, x, y, c, fast);
         Func xyz = lab_to_xyz(lab, x, y, c);
         Func srgb = xyz_to_linear_srgb(xyz, x, y, c);
         lab.compute_inline(); xyz.compute_inline();
@@ -115,7 +151,17 @@ namespace HostColor {
     // Generates a 3D LUT from the color parameters in the ProcessConfig.
     // The LUT maps input L*C*h* values to output L*C*h* values.
     // Dimensions are [L_in, C_in, h_in, 3], where the last dim is the output L'C'h' tuple.
-    Halide::Runtime::Buffer<float, 4> generate_color_lut(const ProcessConfig& cfg, int size = 33);
+    // The last dim is innermost in memory.
+    // `look`, if given, maps a linear sRGB colour in place ahead of the
+    // grading (an input profile's maps and a creative LUT; see
+    // PipelineUtils::color_grading_lut_for), so the LUT applies both.
+    Halide::Runtime::Buffer<float, 4> generate_color_lut(const ProcessConfig& cfg, int size = 33,
+                                                         const std::function<void(float rgb[3])>& look = nullptr);
+
+    // Bakes linear sRGB -> LCh -> `lch_lut` -> linear sRGB into one LUT for
+    // RgbLutBuilder, over sqrt-shaped linear RGB in [0, 1].
+    // Dimensions are [r_in, g_in, b_in, 3], laid out like generate_color_lut's.
+    Halide::Runtime::Buffer<float, 4> generate_rgb_color_lut(const Halide::Runtime::Buffer<float, 4>& lch_lut, int size = 65);
 
     // Converts a single Lch color to linear sRGB. Used by the UI.
     RGB lch_to_linear_srgb(float L, float C, float h_rads);
@@ -0,0 +1,62 @@
+#ifndef CSI2_PACKING_H
+#define CSI2_PACKING_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// MIPI CSI-2 packed Bayer layouts, as libcamera's *_CSI2P formats deliver
+// them. RAW10 stores 4 pixels in 5 bytes: their 8 high bits, then one byte
+// with the 2 low bits of each (pixel 0 in bits 0-1). RAW12 stores 2 pixels
+// in 3 bytes: their 8 high bits, then one byte with the 4 low bits of each
+// (pixel 0 in bits 0-3). Rows may be padded past the last group.
+enum class RawPacking { None, Csi2Raw10, Csi2Raw12 };
+
+// The values GeneratorParam<RawPacking> accepts.
+inline const std::map<std::string, RawPacking>& raw_packing_names() {
+    static const std::map<std::string, RawPacking> names = {
+        {"none", RawPacking::None},
+        {"csi2_raw10", RawPacking::Csi2Raw10},
+        {"csi2_raw12", RawPacking::Csi2Raw12},
+    };
+    return names;
+}
+
+// Pixels per group and bytes per group of a packing (1 and 2 unpacked).
+inline int raw_packing_group_pixels(RawPacking packing) {
+    return packing == RawPacking::Csi2Raw10 ? 4 : packing == RawPacking::Csi2Raw12 ? 2 : 1;
+}
+inline int raw_packing_group_bytes(RawPacking packing) {
+    return packing == RawPacking::Csi2Raw10 ? 5 : packing == RawPacking::Csi2Raw12 ? 3 : 2;
+}
+
+// Bytes of packed data in a row of `width` pixels, without padding.
+inline int raw_packing_row_bytes(RawPacking packing, int width) {
+    const int group = raw_packing_group_pixels(packing);
+    return (width + group - 1) / group * raw_packing_group_bytes(packing);
+}
+
+// Host-side expansion of one packed row to `width` 16-bit samples at the
+// sensor's bit depth. The pipeline unpacks in Halide (Csi2UnpackBuilder);
+// this is for writers that need plain samples and for tests.
+inline void csi2_unpack_row(RawPacking packing, const uint8_t* src, uint16_t* dst, int width) {
+    if (packing == RawPacking::Csi2Raw10) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* group = src + (x / 4) * 5;
+            const int i = x % 4;
+            dst[x] = uint16_t((group[i] << 2) | ((group[4] >> (2 * i)) & 0x3));
+        }
+    } else if (packing == RawPacking::Csi2Raw12) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* group = src + (x / 2) * 3;
+            const int i = x % 2;
+            dst[x] = uint16_t((group[i] << 4) | ((group[2] >> (4 * i)) & 0xf));
+        }
+    } else {
+        for (int x = 0; x < width; x++) {
+            dst[x] = uint16_t(src[2 * x] | (src[2 * x + 1] << 8));
+        }
+    }
+}
+
+#endif // CSI2_PACKING_H
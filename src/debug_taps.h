@@ -0,0 +1,41 @@
+#ifndef DEBUG_TAPS_H
+#define DEBUG_TAPS_H
+
+#include <string>
+
+// The intermediates camera_pipe's debug_taps build (process --tap) can
+// show in its `tap` output, by index in tap_stage. The mosaics
+// (normalized_bayer, ca_corrected) and demosaiced are at the raw's
+// resolution, the rest at the output's. A mosaic is repeated across the
+// three channels; lch_local_adjusted is L, C, h.
+enum class DebugTap {
+    NormalizedBayer,
+    CaCorrected,
+    Demosaiced,
+    CorrectedF,
+    Dehazed,
+    LchLocalAdjusted,
+    VignetteCorrected,
+    Count
+};
+
+inline const char* debug_tap_name(DebugTap tap) {
+    static const char* const names[] = {"normalized_bayer", "ca_corrected", "demosaiced", "corrected_f",
+                                        "dehazed", "lch_local_adjusted", "vignette_corrected"};
+    return tap < DebugTap::Count ? names[static_cast<int>(tap)] : "";
+}
+
+// The tap called `name`, or Count.
+inline DebugTap debug_tap_named(const std::string& name) {
+    for (int i = 0; i < static_cast<int>(DebugTap::Count); i++) {
+        if (name == debug_tap_name(static_cast<DebugTap>(i))) return static_cast<DebugTap>(i);
+    }
+    return DebugTap::Count;
+}
+
+// Whether the tap is at the raw's resolution rather than the output's.
+inline bool debug_tap_full_res(DebugTap tap) {
+    return tap == DebugTap::NormalizedBayer || tap == DebugTap::CaCorrected || tap == DebugTap::Demosaiced;
+}
+
+#endif // DEBUG_TAPS_H
@@ -0,0 +1,146 @@
+#include "deep_zoom.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+using Image = Halide::Runtime::Buffer<uint8_t, 3>;
+
+DeepZoomWriter::DeepZoomWriter(const std::string& dzi_path, int width, int height,
+                               ImageEncoders::Format format, const ImageEncoders::EncodeOptions& options)
+    : dzi_path_(dzi_path), width_(width), height_(height), options_(options) {
+    if (format != ImageEncoders::Format::JPEG && format != ImageEncoders::Format::PNG) {
+        throw std::runtime_error("Deep Zoom tiles must be JPEG or PNG");
+    }
+    if (!ImageEncoders::is_supported(format)) {
+        throw std::runtime_error("this build can't write the Deep Zoom tiles' format");
+    }
+    extension_ = format == ImageEncoders::Format::JPEG ? "jpg" : "png";
+    options_.format = format;
+    // PNG tiles are too small to split into strips.
+    options_.png_strips = 1;
+
+    namespace fs = std::filesystem;
+    fs::path base(dzi_path);
+    tiles_dir_ = (base.parent_path() / (base.stem().string() + "_files")).string();
+
+    // Levels halve, rounding up, down to 1x1.
+    const int max_level = static_cast<int>(std::ceil(std::log2(std::max(width, height))));
+    int w = width, h = height;
+    for (int number = max_level; number >= 0; --number) {
+        Level level;
+        level.number = number;
+        level.width = w;
+        level.height = h;
+        level.rows = Image::make_interleaved(w, std::min(h, kTileSize), 3);
+        levels_.push_back(std::move(level));
+        fs::create_directories(fs::path(tiles_dir_) / std::to_string(number));
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+}
+
+void DeepZoomWriter::write_rows(const Image& band) {
+    if (band.width() != width_ || band.channels() != 3) {
+        throw std::runtime_error("Deep Zoom band doesn't match the image");
+    }
+    std::vector<uint8_t> row(static_cast<size_t>(width_) * 3);
+    const int x0 = band.dim(0).min(), y0 = band.dim(1).min(), c0 = band.dim(2).min();
+    for (int y = 0; y < band.height(); ++y) {
+        uint8_t* out = row.data();
+        for (int x = 0; x < width_; ++x) {
+            for (int c = 0; c < 3; ++c) *out++ = band(x0 + x, y0 + y, c0 + c);
+        }
+        push_row(0, row.data());
+    }
+}
+
+// Adds a row to a level, and every second row (or a lone last one) to the
+// next level down, averaged 2x2 with the one before it.
+void DeepZoomWriter::push_row(size_t index, const uint8_t* row) {
+    Level& level = levels_[index];
+    std::copy(row, row + static_cast<size_t>(level.width) * 3, &level.rows(0, level.rows_filled, 0));
+    level.rows_filled++;
+    level.rows_received++;
+    const bool last_row = level.rows_received == level.height;
+    if (level.rows_filled == level.rows.height() || last_row) flush_tile_row(level);
+
+    if (index + 1 == levels_.size()) return;
+    if (!level.has_pending && !last_row) {
+        level.pending.assign(row, row + static_cast<size_t>(level.width) * 3);
+        level.has_pending = true;
+        return;
+    }
+    const uint8_t* a = level.has_pending ? level.pending.data() : row;
+    const uint8_t* b = row;
+    const int next_width = levels_[index + 1].width;
+    std::vector<uint8_t> reduced(static_cast<size_t>(next_width) * 3);
+    for (int x = 0; x < next_width; ++x) {
+        const int x1 = std::min(2 * x + 1, level.width - 1);
+        for (int c = 0; c < 3; ++c) {
+            const int sum = a[6 * x + c] + a[3 * x1 + c] + b[6 * x + c] + b[3 * x1 + c];
+            reduced[3 * x + c] = static_cast<uint8_t>((sum + 2) >> 2);
+        }
+    }
+    level.has_pending = false;
+    push_row(index + 1, reduced.data());
+}
+
+// Cuts the level's buffered rows into tiles and encodes them in parallel.
+void DeepZoomWriter::flush_tile_row(Level& level) {
+    const int columns = (level.width + kTileSize - 1) / kTileSize;
+    const std::string dir = tiles_dir_ + "/" + std::to_string(level.number) + "/";
+    std::vector<std::exception_ptr> errors(columns);
+    auto encode = [&](int column) {
+        const int x = column * kTileSize;
+        Image tile = level.rows.cropped(0, x, std::min(kTileSize, level.width - x))
+                               .cropped(1, 0, level.rows_filled);
+        const std::string path = dir + std::to_string(column) + "_" + std::to_string(level.tile_row) + "." + extension_;
+        try {
+            ImageEncoders::save_image(tile, path, options_);
+        } catch (...) {
+            errors[column] = std::current_exception();
+        }
+    };
+    ThreadPool& pool = ThreadPool::get();
+    if (columns == 1) {
+        encode(0);
+    } else if (pool.running()) {
+        pool.parallel_for(0, columns, encode);
+    } else {
+        std::atomic<int> next{0};
+        const int threads = std::min(columns, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (int column; (column = next++) < columns;) encode(column);
+            });
+        }
+        for (auto& t : workers) t.join();
+    }
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+    tiles_written_ += columns;
+    level.tile_row++;
+    level.rows_filled = 0;
+}
+
+void DeepZoomWriter::finish() {
+    if (levels_.front().rows_received != height_) {
+        throw std::runtime_error("Deep Zoom image finished before all rows were written");
+    }
+    std::ofstream dzi(dzi_path_);
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"" << extension_
+        << "\" Overlap=\"0\" TileSize=\"" << kTileSize << "\">\n"
+        << "  <Size Width=\"" << width_ << "\" Height=\"" << height_ << "\"/>\n"
+        << "</Image>\n";
+    if (!dzi) throw std::runtime_error("Cannot write " + dzi_path_);
+}
@@ -0,0 +1,62 @@
+#ifndef DEEP_ZOOM_H
+#define DEEP_ZOOM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HalideBuffer.h"
+#include "image_encoders.h"
+
+// Writes a Deep Zoom (DZI) tile pyramid of an image while it is rendered,
+// band by band, top to bottom: `<name>.dzi` and `<name>_files/<level>/
+// <column>_<row>.<ext>`, 256x256 tiles with no overlap.
+//
+// Each level holds one row of tiles' worth of rows. When it fills, the
+// tiles are cut from it in place and encoded in parallel, and each pair of
+// rows is averaged 2x2 into the next level as it arrives, so the coarser
+// levels fill as the full-size one does. Memory is about two tile rows of
+// the full width, whatever the image height. Throws std::runtime_error on
+// failure.
+class DeepZoomWriter {
+public:
+    static constexpr int kTileSize = 256;
+
+    // `format` picks the tiles' encoder (JPEG or PNG, options as for a
+    // single output).
+    DeepZoomWriter(const std::string& dzi_path, int width, int height,
+                   ImageEncoders::Format format, const ImageEncoders::EncodeOptions& options);
+
+    // Appends a (width, rows, 3) band, in any layout, below the rows
+    // already written.
+    void write_rows(const Halide::Runtime::Buffer<uint8_t, 3>& band);
+    // Writes the last partial tile rows and the .dzi. All `height` rows
+    // must have been written.
+    void finish();
+
+    int tiles_written() const { return tiles_written_; }
+
+private:
+    struct Level {
+        int number = 0; // The DZI level; the full size is the highest.
+        int width = 0, height = 0;
+        Halide::Runtime::Buffer<uint8_t, 3> rows; // Interleaved, kTileSize rows.
+        int rows_filled = 0;
+        int rows_received = 0;
+        int tile_row = 0;
+        std::vector<uint8_t> pending; // The first row of a pair, for the next level.
+        bool has_pending = false;
+    };
+
+    void push_row(size_t level, const uint8_t* row);
+    void flush_tile_row(Level& level);
+
+    std::string dzi_path_;
+    std::string tiles_dir_;
+    std::string extension_;
+    int width_, height_;
+    ImageEncoders::EncodeOptions options_;
+    std::vector<Level> levels_;
+    int tiles_written_ = 0;
+};
+
+#endif // DEEP_ZOOM_H
@@ -0,0 +1,147 @@
+#include "defect_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace { // Anonymous namespace for local helpers
+
+// The same-colour neighbours two samples away: along the axes first, then
+// the diagonals.
+constexpr int kNeighbours[8][2] = {{-2, 0}, {2, 0}, {0, -2}, {0, 2}, {-2, -2}, {2, -2}, {-2, 2}, {2, 2}};
+
+// The median of the first `n` of `v` (n > 0), reordering them.
+float median(float* v, int n) {
+    std::sort(v, v + n);
+    return n % 2 ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+} // namespace
+
+bool DefectMap::contains(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height) return false;
+    return std::binary_search(pixels.begin(), pixels.end(), uint32_t(y) * uint32_t(width) + uint32_t(x));
+}
+
+DefectMap DefectMap::detect(const std::vector<Halide::Runtime::Buffer<uint16_t, 2>>& dark_frames) {
+    if (dark_frames.empty()) throw std::runtime_error("no dark frames to find defects in");
+    const int width = dark_frames[0].width(), height = dark_frames[0].height();
+    for (const auto& frame : dark_frames) {
+        if (frame.width() != width || frame.height() != height) {
+            throw std::runtime_error("the dark frames differ in size");
+        }
+    }
+
+    // Each pixel's lowest reading over the frames.
+    std::vector<float> lowest(size_t(width) * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint16_t v = 0xffff;
+            for (const auto& frame : dark_frames) {
+                v = std::min(v, frame(frame.dim(0).min() + x, frame.dim(1).min() + y));
+            }
+            lowest[size_t(y) * width + x] = v;
+        }
+    }
+
+    // How far each pixel is above the median of its neighbours.
+    std::vector<float> excess(lowest.size());
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float around[8];
+            int n = 0;
+            for (const auto& d : kNeighbours) {
+                const int nx = x + d[0], ny = y + d[1];
+                if (nx >= 0 && ny >= 0 && nx < width && ny < height) around[n++] = lowest[size_t(ny) * width + nx];
+            }
+            excess[size_t(y) * width + x] = n ? lowest[size_t(y) * width + x] - median(around, n) : 0.0f;
+        }
+    }
+
+    // The noise of the excess, from its median absolute value over about
+    // 64K samples, as in estimate_raw_noise.
+    const int step = std::max(1, int(std::sqrt(double(width) * height / 65536.0)));
+    std::vector<float> samples;
+    for (int y = 0; y < height; y += step) {
+        for (int x = 0; x < width; x += step) samples.push_back(std::abs(excess[size_t(y) * width + x]));
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    const float sigma = samples[samples.size() / 2] / 0.6745f;
+    const float threshold = std::max(kThresholdSigma * sigma, kMinExcess);
+
+    DefectMap map;
+    map.width = width;
+    map.height = height;
+    for (size_t i = 0; i < excess.size(); ++i) {
+        if (excess[i] > threshold) map.pixels.push_back(uint32_t(i));
+    }
+    return map;
+}
+
+DefectMap DefectMap::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Cannot open defect map: " + path);
+    DefectMap map;
+    std::string line;
+    bool have_magic = false, have_size = false;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        if (!have_magic) {
+            std::string magic;
+            int version = 0;
+            fields >> magic >> version;
+            if (magic != "openraw-defects" || version != 1) throw std::runtime_error("not a defect map: " + path);
+            have_magic = true;
+        } else if (!have_size) {
+            std::string key;
+            fields >> key >> map.width >> map.height;
+            if (fields.fail() || key != "size" || map.width <= 0 || map.height <= 0) {
+                throw std::runtime_error("defect map " + path + " has no valid size line");
+            }
+            have_size = true;
+        } else {
+            int x = -1, y = -1;
+            fields >> x >> y;
+            if (fields.fail() || x < 0 || y < 0 || x >= map.width || y >= map.height) {
+                throw std::runtime_error("bad defect in " + path + ": " + line);
+            }
+            map.pixels.push_back(uint32_t(y) * uint32_t(map.width) + uint32_t(x));
+        }
+    }
+    if (!have_size) throw std::runtime_error("not a defect map: " + path);
+    std::sort(map.pixels.begin(), map.pixels.end());
+    map.pixels.erase(std::unique(map.pixels.begin(), map.pixels.end()), map.pixels.end());
+    return map;
+}
+
+void DefectMap::save(const std::string& path) const {
+    std::ofstream out(path);
+    out << "openraw-defects 1\nsize " << width << ' ' << height << '\n';
+    for (uint32_t i : pixels) out << i % uint32_t(width) << ' ' << i / uint32_t(width) << '\n';
+    if (!out) throw std::runtime_error("Cannot write defect map: " + path);
+}
+
+void DefectMap::correct(Halide::Runtime::Buffer<uint16_t, 2>& bayer) const {
+    if (bayer.width() != width || bayer.height() != height) {
+        throw std::runtime_error("the defect map is for " + std::to_string(width) + "x" + std::to_string(height) +
+                                 " raws, not " + std::to_string(bayer.width()) + "x" +
+                                 std::to_string(bayer.height()));
+    }
+    const int x0 = bayer.dim(0).min(), y0 = bayer.dim(1).min();
+    for (uint32_t i : pixels) {
+        const int x = int(i % uint32_t(width)), y = int(i / uint32_t(width));
+        float around[8];
+        int n = 0;
+        // The axial neighbours, and the diagonals only if none of those is
+        // usable (a defect on the frame's edge, or in a cluster).
+        for (int k = 0; k < 8 && !(k == 4 && n > 0); ++k) {
+            const int nx = x + kNeighbours[k][0], ny = y + kNeighbours[k][1];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height || contains(nx, ny)) continue;
+            around[n++] = bayer(x0 + nx, y0 + ny);
+        }
+        if (n) bayer(x0 + x, y0 + y) = uint16_t(median(around, n) + 0.5f);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef DEFECT_MAP_H
+#define DEFECT_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HalideBuffer.h"
+
+// A sensor's fixed defects (hot and stuck pixels) as a list of their
+// coordinates, measured once from dark frames (detect()) and kept in a
+// small text file per camera body. Renders then correct just those
+// samples (correct()), on the host before the pipeline runs, instead of
+// running a neighbourhood filter over every sample of every frame.
+//
+// Coordinates are in the raw's pixels as loaded (RawImageData::width() by
+// height(), after the decoder's crop), so a map only fits the camera and
+// crop it was measured with; load() and correct() check the size.
+//
+// The file is "openraw-defects 1", a "size <width> <height>" line and one
+// "<x> <y>" line per defect. Lines starting with '#' are comments.
+struct DefectMap {
+    int width = 0, height = 0;
+    // y * width + x of each defect, sorted.
+    std::vector<uint32_t> pixels;
+
+    // How far above its neighbours, in units of the frames' noise, a pixel
+    // must be in every dark frame to count as a defect, and the least
+    // excess in raw units, for very clean sensors.
+    static constexpr float kThresholdSigma = 8.0f;
+    static constexpr float kMinExcess = 16.0f;
+
+    bool empty() const { return pixels.empty(); }
+    bool contains(int x, int y) const;
+
+    // Finds the pixels that stand out from their same-colour neighbours in
+    // every one of `dark_frames` (lens capped, the exposure and ISO of the
+    // shots to be corrected). Taking the minimum over the frames leaves out
+    // noise and one-off events such as cosmic rays. Dead pixels read black
+    // in the dark and aren't found. Throws std::runtime_error if the frames
+    // differ in size or there are none.
+    static DefectMap detect(const std::vector<Halide::Runtime::Buffer<uint16_t, 2>>& dark_frames);
+
+    // Reads and writes the file format above. Throw std::runtime_error on
+    // an unreadable or malformed file.
+    static DefectMap load(const std::string& path);
+    void save(const std::string& path) const;
+
+    // Replaces each defect of `bayer` (a mosaic of width x height samples,
+    // from its own min) with the median of its same-colour neighbours two
+    // samples away that aren't defects too. Touches only those samples.
+    // Throws std::runtime_error if the sizes differ.
+    void correct(Halide::Runtime::Buffer<uint16_t, 2>& bayer) const;
+};
+
+#endif // DEFECT_MAP_H
@@ -0,0 +1,100 @@
+#ifndef DEMOSAIC_ADAPTIVE_H
+#define DEMOSAIC_ADAPTIVE_H
+
+#include "Halide.h"
+
+// Content-adaptive demosaic: a cheap interpolation (`fast`) where the image
+// is flat, and a high-quality one (`hq`) only where there is detail.
+//
+// The mosaic is measured in kTileSize x kTileSize tiles: the green
+// gradients (across columns, across rows, and between the two greens of a
+// quad) relative to the tile's level. That maps to a weight for `hq`,
+// 0 below kFlatDetail, 1 above kDetailedDetail. The weight is bilinearly
+// interpolated between tile centres, so the blend of the two outputs is
+// continuous and has no seams at tile edges.
+//
+// With `per_block` the blend is computed in blocks of kBlockWidth x
+// kBlockHeight (`blocks`, indexed (xi, yi, c, bx, by)): every block takes
+// the fast result, and an update over the block, guarded by `needs_hq`,
+// blends in `hq`. The guard depends only on the block, so the block's whole
+// `hq` evaluation is skipped where the weight is 0 throughout its support.
+// `hq`'s stencils must be inlined for that to save anything. Without
+// `per_block` (GPU and autoscheduled builds) the blend is per pixel and
+// both outputs are computed everywhere.
+class DemosaicAdaptive {
+public:
+    static constexpr int kTileSize = 32;
+    static constexpr int kBlockWidth = kTileSize;
+    static constexpr int kBlockHeight = 8;
+    // Tile detail (mean green gradient over mean level) below which only
+    // the fast result is used, and above which only the high-quality one.
+    static constexpr float kFlatDetail = 0.04f;
+    static constexpr float kDetailedDetail = 0.10f;
+
+    Halide::Func output;
+    // The weight of `hq` at each tile's centre, (tx, ty).
+    Halide::Func tile_weight;
+    // Whether any pixel of block (bx, by) has a nonzero weight.
+    Halide::Func needs_hq;
+    // The per-block blend, undefined without `per_block`.
+    Halide::Func blocks;
+    Halide::RDom r;
+    Halide::Var xi, yi, tx, ty;
+
+    DemosaicAdaptive() = default;
+
+    // `deinterleaved` is the (qx, qy, c) quad planes (Gr, R, B, Gb) both
+    // outputs are made from.
+    DemosaicAdaptive(Halide::Func deinterleaved, Halide::Func fast, Halide::Func hq,
+                     Halide::Var x, Halide::Var y, Halide::Var c, bool per_block)
+        : xi("adaptive_xi"), yi("adaptive_yi"), tx("adaptive_tx"), ty("adaptive_ty") {
+        using namespace Halide;
+        Type proc_type = fast.type();
+        const int quads = kTileSize / 2;
+
+        RDom q(0, quads, 0, quads, "adaptive_q");
+        Expr qx = tx * quads + q.x, qy = ty * quads + q.y;
+        Expr gr = cast<float>(deinterleaved(qx, qy, 0));
+        Expr gb = cast<float>(deinterleaved(qx, qy, 3));
+        Expr gradient = absd(gr, cast<float>(deinterleaved(qx + 1, qy, 0))) +
+                        absd(gr, cast<float>(deinterleaved(qx, qy + 1, 0))) +
+                        absd(gr, gb);
+        Expr detail = sum(gradient) / max(sum(gr + gb) * 0.5f, 1e-6f);
+        tile_weight = Func("adaptive_tile_weight");
+        tile_weight(tx, ty) = clamp((detail - kFlatDetail) / (kDetailedDetail - kFlatDetail), 0.0f, 1.0f);
+
+        // Bilinear between tile centres.
+        Expr fx = (cast<float>(x) + 0.5f) / kTileSize - 0.5f;
+        Expr fy = (cast<float>(y) + 0.5f) / kTileSize - 0.5f;
+        Expr tx0 = cast<int>(floor(fx)), ty0 = cast<int>(floor(fy));
+        Expr ax = fx - tx0, ay = fy - ty0;
+        Expr weight = lerp(lerp(tile_weight(tx0, ty0), tile_weight(tx0 + 1, ty0), ax),
+                           lerp(tile_weight(tx0, ty0 + 1), tile_weight(tx0 + 1, ty0 + 1), ax), ay);
+        auto blend = [&](Expr fast_value, Expr px, Expr py, Expr pc) {
+            Expr f = cast<float>(fast_value);
+            Expr w = substitute(y.name(), py, substitute(x.name(), px, weight));
+            return cast(proc_type, f + w * (cast<float>(hq(px, py, pc)) - f));
+        };
+
+        // A pixel's weight reads the tiles within one of its own, and a
+        // block lies inside one tile.
+        RDom n(-1, 3, -1, 3, "adaptive_n");
+        needs_hq = Func("adaptive_needs_hq");
+        needs_hq(tx, ty) = maximum(tile_weight(tx + n.x, ty * kBlockHeight / kTileSize + n.y)) > 0.0f;
+
+        output = Func("demosaic_adaptive");
+        if (per_block) {
+            blocks = Func("demosaic_adaptive_blocks");
+            blocks(xi, yi, c, tx, ty) = fast(tx * kBlockWidth + xi, ty * kBlockHeight + yi, c);
+            r = RDom(0, kBlockWidth, 0, kBlockHeight, "adaptive_r");
+            r.where(needs_hq(tx, ty));
+            blocks(r.x, r.y, c, tx, ty) = blend(blocks(r.x, r.y, c, tx, ty),
+                                                tx * kBlockWidth + r.x, ty * kBlockHeight + r.y, c);
+            output(x, y, c) = blocks(x % kBlockWidth, y % kBlockHeight, c, x / kBlockWidth, y / kBlockHeight);
+        } else {
+            output(x, y, c) = blend(fast(x, y, c), x, y, c);
+        }
+    }
+};
+
+#endif // DEMOSAIC_ADAPTIVE_H
@@ -9,6 +9,11 @@
 // It uses a high-quality green channel interpolation followed by a
 // directionally-adaptive color difference interpolation for red and blue.
 // It is significantly faster than AHD, LMMSE, or RI.
+//
+// Its green interpolation is the same directional average CA correction
+// makes to estimate the shifts (CACorrectBuilder::g_interp). `shared_green`,
+// if defined, is such a full-resolution green plane of the same mosaic; it
+// is then read at the R and B sites instead of interpolating them again.
 template <typename T>
 class DemosaicFastT {
 public:
@@ -16,7 +21,8 @@ public:
     std::vector<Halide::Func> intermediates;
     Halide::Var qx, qy;
 
-    DemosaicFastT(Halide::Func deinterleaved, Halide::Var x_full, Halide::Var y_full, Halide::Var c_full) : qx("fast_qx"), qy("fast_qy") {
+    DemosaicFastT(Halide::Func deinterleaved, Halide::Var x_full, Halide::Var y_full, Halide::Var c_full,
+                  Halide::Func shared_green = Halide::Func()) : qx("fast_qx"), qy("fast_qy") {
         using namespace Halide;
         using namespace Halide::ConciseCasts;
 
@@ -27,7 +33,11 @@ public:
 
         // --- High-quality Green interpolation
         Func g_at_r("g_at_r_fast"), g_at_b("g_at_b_fast");
-        {
+        if (shared_green.defined()) {
+            // R is at (1, 0) of the GRBG quad, B at (0, 1).
+            g_at_r(qx, qy) = cast<float>(shared_green(2 * qx + 1, 2 * qy));
+            g_at_b(qx, qy) = cast<float>(shared_green(2 * qx, 2 * qy + 1));
+        } else {
             Expr gb_cm1 = deinterleaved_f(qx, qy - 1, 3);
             Expr gb_c = deinterleaved_f(qx, qy, 3);
             Expr gr_c = deinterleaved_f(qx, qy, 0);
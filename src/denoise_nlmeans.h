@@ -3,74 +3,71 @@
 
 #include "Halide.h"
 #include "pipeline_helpers.h"
-#include <vector>
+#include <string>
 
-template<typename T>
-class DenoiseNLMeansBuilder_T {
+// Non-local means on one 2D plane, in the per-offset formulation: for each
+// offset (dx, dy) of the search window, the squared difference between the
+// image and its shifted copy is box-summed over the patch (BoxSumBuilder's
+// running sums), which gives every pixel's patch distance for that offset
+// at O(1) per pixel instead of O(patch^2). `accum` folds the offsets into a
+// weight sum and a weighted value sum; the schedule runs its update
+// offset-major (`offset` outermost) with `patch_ssd` computed per offset, so
+// only one offset's distances are live at a time.
+//
+// Weights are exp(-mean squared patch difference / h^2), so `h` is in the
+// input's units (the VST space, for the raw denoiser). The centre offset has
+// weight 1, so the normalization never divides by zero.
+class NLMeansBuilder {
 public:
+    Halide::Func accum;
     Halide::Func output;
-    std::vector<Halide::Func> coarse_intermediates; // Always empty for NL-Means
-    std::vector<Halide::Func> fine_intermediates;
-    Halide::RDom r_search, r_patch;
+    BoxSumBuilder patch_ssd;
+    // The search window offsets, accum's update domain.
+    Halide::RDom offset;
 
-    DenoiseNLMeansBuilder_T(Halide::Func vst_transformed,
-                            Halide::Expr search_area,
-                            Halide::Expr patch_size,
-                            Halide::Expr strength,
-                            Halide::Expr width,
-                            Halide::Expr height,
-                            Halide::Var x, Halide::Var y) {
+    NLMeansBuilder(Halide::Func input, Halide::Var x, Halide::Var y,
+                   int search_radius, int patch_radius, Halide::Expr h,
+                   const std::string& name = "nlmeans")
+        : accum(name + "_accum"), output(name),
+          patch_ssd(diff2(input, x, y, search_radius, name), patch_radius, kBoxBlock,
+                    name + "_patch_ssd", x, y, {offset_var(name)})
+    {
         using namespace Halide;
+        const int W = 2 * search_radius + 1;
+        const float inv_area = 1.0f / float((2 * patch_radius + 1) * (2 * patch_radius + 1));
 
-        // Create an explicit region of definition for the boundary condition.
-        Region bounds = {{0, width}, {0, height}};
-        Func clamped = BoundaryConditions::repeat_edge(vst_transformed, bounds);
-        // FIX: 'clamped' is a local helper. Do not add it to the intermediates list.
-        // This prevents the generator from trying to schedule it, allowing it to be
-        // inlined by default, which is the correct behavior for this type of Func.
+        offset = RDom(0, W * W, name + "_offset");
+        Expr dx = offset % W - search_radius, dy = offset / W - search_radius;
+        Expr w = exp(-patch_ssd.output(x, y, offset) * inv_area / (h * h));
 
-        // Algorithmic parameters
-        // h is the filtering parameter, linked to user strength.
-        // A base_h of 0.6 is a reasonable starting point for VST data with sigma ~1.
-        Expr h = 0.6f * strength * strength;
-        Expr h2 = h*h;
-        // Avoid division by zero if strength is zero
-        Expr inv_h2 = select(h2 > 0.f, 1.0f / h2, 0.f);
-
-        // Create the reduction domains. We store them as members to access their RVars during scheduling.
-        Expr patch_radius = patch_size / 2;
-        Expr search_radius = search_area / 2;
-        r_patch = RDom(-patch_radius, patch_size, -patch_radius, patch_size, "nl_patch");
-        r_search = RDom(-search_radius, search_area, -search_radius, search_area, "nl_search");
-
-        // The ssd_func computes the sum of squared differences for a single pair of patches.
-        Func ssd_func("ssd_func");
-        Var sx("nl_sx"), sy("nl_sy"); // Explicit vars for search domain
-        Expr p1 = clamped(x + r_patch.x, y + r_patch.y);
-        Expr p2 = clamped(x + sx + r_patch.x, y + sy + r_patch.y);
-        ssd_func(x, y, sx, sy) = sum(pow(p1 - p2, 2.0f), "ssd_sum");
-        fine_intermediates.push_back(ssd_func);
-
-        // Compute the weight `w` for each patch in the search window using the ssd_func.
-        Expr ssd = ssd_func(x, y, r_search.x, r_search.y);
-        Expr patch_area = cast<float>(patch_size * patch_size);
-        Expr w = exp(-ssd * inv_h2 / patch_area);
+        accum(x, y) = Tuple(0.0f, 0.0f);
+        accum(x, y) = Tuple(accum(x, y)[0] + w,
+                            accum(x, y)[1] + w * input(x + dx, y + dy));
+        output(x, y) = accum(x, y)[1] / accum(x, y)[0];
+    }
 
-        // Sum of weights and sum of weighted pixel values over the search window.
-        Func total_weight("nlmeans_total_weight");
-        total_weight(x, y) = sum(w, "nl_total_weight_sum");
-        fine_intermediates.push_back(total_weight);
+    // Rows per running-sum block of the patch sums. Short: the schedule
+    // computes them per offset over a strip, which is only a few blocks tall.
+    static constexpr int kBoxBlock = 8;
 
-        Func weighted_sum("nlmeans_weighted_sum");
-        weighted_sum(x, y) = sum(w * clamped(x + r_search.x, y + r_search.y), "nl_weighted_sum");
-        fine_intermediates.push_back(weighted_sum);
+private:
+    // The offset index is a pure Var of the patch sums; one per builder, so
+    // patch_ssd's args and diff2 agree.
+    static Halide::Var offset_var(const std::string& name) {
+        return Halide::Var(name + "_o");
+    }
 
-        // The final NL-Means result is the normalized sum
-        output = Func("denoise_nlmeans_result");
-        output(x, y) = weighted_sum(x, y) / total_weight(x, y);
+    static Halide::Func diff2(Halide::Func input, Halide::Var x, Halide::Var y,
+                              int search_radius, const std::string& name) {
+        using namespace Halide;
+        const int W = 2 * search_radius + 1;
+        Var o = offset_var(name);
+        Expr dx = o % W - search_radius, dy = o / W - search_radius;
+        Func d(name + "_diff2");
+        Expr diff = input(x, y) - input(x + dx, y + dy);
+        d(x, y, o) = diff * diff;
+        return d;
     }
 };
 
 #endif // DENOISE_NLMEANS_H
-
-
@@ -9,11 +9,20 @@
 #include "HalideBuffer.h"
 #include "imgui.h" // Include the main Dear ImGui header to define ImVec2
 #include "raw_load.h" // For RawImageData
+#include "halide_runner.h" // For ViewportRegion
+#include "texture_utils.h" // For PreviewTexture
+#include "tile_cache.h"
+#include "edit_history.h"
+#include "before_render.h"
+#include "export_queue.h"
 
 #include <chrono>
 #include <cstdint>
+#include <deque>
+#include <fstream>
 #include <vector>
 #include <memory> // For std::unique_ptr
+#include <string>
 
 // To enable Lensfun support, compile with -DUSE_LENSFUN and link against liblensfun.
 #ifdef USE_LENSFUN
@@ -31,6 +40,10 @@ struct CameraInfo {
 #endif
 
 
+class Filmstrip; // Defined in filmstrip.h
+class RenderWorker; // Defined in render_worker.h
+class ShaderPreview; // Defined in shader_preview.h
+
 // Enum to identify which curve is currently being edited in the UI.
 enum class ActiveCurveChannel {
     Luma,
@@ -43,7 +56,15 @@ enum class ActiveCurveChannel {
 // This is the central data structure passed to UI rendering functions.
 struct AppState {
     // Static configuration for debouncing
+    // The longest an edit waits before it is rendered; the actual delay
+    // follows the measured render time (full_render_ms).
     static constexpr std::chrono::milliseconds DEBOUNCE_DURATION{200};
+    // Target latency of draft renders, and the coarsest scale they may use.
+    static constexpr float DRAFT_BUDGET_MS = 40.0f;
+    // Levels are quarter octaves (kLevelsPerOctave).
+    static constexpr int MAX_DRAFT_DOWNSAMPLE = 4 * kLevelsPerOctave; // 1:16
+    // Scale of the quick pass shown before a slow full-frame render.
+    static constexpr int COARSE_PASS_DOWNSAMPLE = 3 * kLevelsPerOctave; // 1:8
 
     ProcessConfig params;
 
@@ -52,15 +73,24 @@ struct AppState {
     int blackLevel = 25;
     int whiteLevel = 1023;
     int cfa_pattern = 0; // 0=GRBG, 1=RGGB, 2=GBRG, 3=BGGR
-    int preview_downsample = 2; // 0=1:1, 1=1:2, 2=1:4, etc.
+    // Level of the whole-frame preview (kLevelsPerOctave steps, 0=1:1): the
+    // display-matched level of the frame fitted to the main view, updated
+    // as the view is resized. 1:4 until the view is laid out.
+    int preview_downsample = 2 * kLevelsPerOctave;
 
     // This struct holds the raw bayer data buffer and its metadata.
     RawImageData raw_image_data;
     
     // Halide Buffers (pointers to data owned by raw_image_data or this class)
     Halide::Runtime::Buffer<uint16_t> input_image;
-    Halide::Runtime::Buffer<uint8_t> main_output_planar;
-    Halide::Runtime::Buffer<uint8_t> thumb_output_planar;
+    Halide::Runtime::Buffer<uint8_t> main_output;
+    Halide::Runtime::Buffer<uint8_t> thumb_output;
+    // The part of the frame main_output (and the main texture) covers, and
+    // the region the view needed when the last render was requested.
+    ViewportRegion main_region;
+    ViewportRegion requested_region;
+    // HashPixelParams of main_output's parameters; 0 for stand-in frames.
+    uint64_t main_params_hash = 0;
 
     // We now maintain two separate LUTs:
     // 1. The final, combined LUT for the pipeline and histogram.
@@ -69,13 +99,36 @@ struct AppState {
     Halide::Runtime::Buffer<uint16_t, 2> ui_tone_curve_lut;
 
 
-    // CPU-side copy of interleaved data for OpenGL
+    // Interleaved RGBA storage behind main_output/thumb_output, uploaded to OpenGL
     std::vector<uint8_t> main_output_interleaved;
     std::vector<uint8_t> thumb_output_interleaved;
 
     // OpenGL Textures
-    uint32_t main_texture_id = 0;
-    uint32_t thumb_texture_id = 0;
+    PreviewTexture main_texture;
+    PreviewTexture thumb_texture;
+    // Zoomed-in renders, kept as tiles for panning back over them. Cleared
+    // in main() before the GL context goes away.
+    TileCache tile_cache;
+    // Undo/redo steps, and the whole-frame renders replaced on screen.
+    // Its frames are cleared in main() before the GL context goes away.
+    EditHistory history;
+
+    // --- Before/After Compare State ---
+    // Backslash splits the main view: left of the divider the image as
+    // opened (before_params, rendered once per image and preview scale into
+    // before_texture), right of it the edit, of which only that part is
+    // rendered. compare_split is the divider's position as a fraction of
+    // the frame width. before_texture is deleted in main() before the GL
+    // context goes away.
+    bool compare_active = false;
+    float compare_split = 0.5f;
+    bool compare_dragging = false;
+    ProcessConfig before_params;
+    BeforeRender before_render;
+    PreviewTexture before_texture;
+
+    // Full-resolution exports (Ctrl+E), rendered while the editor is idle.
+    ExportQueue export_queue;
 
     // --- Viewport State ---
     float zoom = 1.0f;                      // The logical zoom level relative to "fit-to-view"
@@ -84,6 +137,7 @@ struct AppState {
     // --- UI State (updated each frame) ---
     ImVec2 main_view_size{1, 1};
     ImVec2 thumb_view_size{1, 1};
+    float display_scale = 1.0f; // Framebuffer pixels per point (HiDPI).
 
     // --- Histogram Data & State ---
     std::vector<float> histogram_luma; // Normalized [0,1] for plotting
@@ -100,11 +154,97 @@ struct AppState {
     // --- Debounce State ---
     std::chrono::steady_clock::time_point next_render_time = std::chrono::steady_clock::time_point::max();
     bool ui_ready = false;
+    // Generation of the render whose results are currently displayed.
+    uint64_t render_generation = 0;
+
+    // --- Interactive Quality State ---
+    // Moving averages of the render time in ms (0 until measured) for full
+    // quality and draft renders, the extra downsampling drafts currently use,
+    // and whether the newest posted render was a draft, i.e. a full-quality
+    // one is owed once the drag ends.
+    float full_render_ms = 0.0f;
+    float draft_render_ms = 0.0f;
+    int draft_downsample_step = kLevelsPerOctave;
+    bool draft_refine_pending = false;
+
+    // --- Render Statistics ---
+    // The last kRenderTimingCount displayed renders, oldest first, for the
+    // statistics overlay (F7). Per-phase distributions over the whole session
+    // are in the Instrumentation registry under "RenderFrame*".
+    struct RenderTiming {
+        float host_ms, pipeline_ms, upload_ms, total_ms;
+        uint64_t heap_peak_bytes;
+        bool draft;
+    };
+    static constexpr size_t kRenderTimingCount = 120;
+    std::deque<RenderTiming> render_timings;
+    bool show_render_stats = false;
+
+    // --- Edit Latency ---
+    // How long an edit takes to reach the screen, by stage: from the change
+    // in the panes (debounce) to the post, the wait for the worker (queue),
+    // RenderFrame's host prep, pipelines and the rest (thumbnail,
+    // histograms), the wait for the UI to pick the frame up (handoff), the
+    // texture upload and the buffer swap (present). pending_edit_time is
+    // the earliest change not yet in a posted render. A render that shows
+    // an edit starts shown_latency; FinishEditLatency completes it after the
+    // swap and adds it to edit_latencies (the last kEditLatencyCount, for
+    // the F9 overlay), the "EditLatency/*" timers and latency_log (F10 or
+    // --latency-log).
+    struct EditLatency {
+        float debounce_ms = 0, queue_ms = 0, host_ms = 0, pipeline_ms = 0, other_ms = 0;
+        float handoff_ms = 0, upload_ms = 0, present_ms = 0, total_ms = 0;
+        bool draft = false;
+    };
+    static constexpr size_t kEditLatencyCount = 120;
+    std::chrono::steady_clock::time_point pending_edit_time;
+    EditLatency shown_latency;
+    bool shown_latency_pending = false;
+    std::chrono::steady_clock::time_point shown_edit_time;
+    std::chrono::steady_clock::time_point shown_finish_time;
+    std::chrono::steady_clock::time_point shown_upload_time;
+    std::deque<EditLatency> edit_latencies;
+    bool show_edit_latency = false;
+    std::ofstream latency_log;
+
+    // --- GPU Preview State ---
+    // While a slider is dragged and the edit is one the shader can show, the
+    // main view draws shader_preview's output from preview_linear instead of
+    // waiting for a render. On release a full render is posted
+    // (shader_refine_generation) and the shader output is shown until it
+    // lands. shader_preview is null if the GL context can't run it.
+    std::unique_ptr<ShaderPreview> shader_preview;
+    LinearSnapshot preview_linear;
+    bool shader_preview_active = false;
+    uint64_t shader_refine_generation = 0;
+
+    // Background renderer. Created in main() once the image is loaded and
+    // reset before the AppState goes away, since it reads from it.
+    std::shared_ptr<RenderWorker> render_worker;
+
+    // --- Startup State ---
+    // The raw decodes on a background thread while the window is already
+    // up (main.cpp). Until raw_loaded is set only RenderLoadingUI runs, and
+    // the raw's embedded JPEG preview, if it has one, stands in for the
+    // image until the first render lands.
+    bool raw_loaded = false;
+    PreviewTexture embedded_preview_texture;
+
+    // --- Filmstrip State ---
+    // The other raws in the image's folder (PageUp/PageDown), with its
+    // neighbours decoded ahead. Null until the image has loaded; reset after
+    // render_worker, whose idle task uses it. filmstrip_shown is the index
+    // of the image being edited, which lags filmstrip->index() while the
+    // one asked for decodes.
+    std::unique_ptr<Filmstrip> filmstrip;
+    int filmstrip_shown = 0;
+    std::string filmstrip_error;
 
 #ifdef USE_LENSFUN
     // --- Lensfun State ---
-    // Use the C++ wrapper class from lensfun.hh for RAII
-    std::unique_ptr<lfDatabase> lensfun_db;
+    // Use the C++ wrapper class from lensfun.hh for RAII. Shared with the
+    // filmstrip's preview renders.
+    std::shared_ptr<lfDatabase> lensfun_db;
     // Cached lists for UI dropdowns
     std::vector<std::string> lensfun_camera_makes;
     std::vector<CameraInfo> lensfun_cameras_in_make; // Updated when make is selected
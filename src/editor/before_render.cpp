@@ -0,0 +1,50 @@
+#include "editor/before_render.h"
+#include "editor/app_state.h"
+
+#include <utility>
+
+bool BeforeRender::request(const ProcessConfig& params, int downsample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (downsample == downsample_) return false; // Rendered or on its way.
+    params_ = params;
+    downsample_ = downsample;
+    wanted_ = true;
+    ready_.reset();
+    return true;
+}
+
+bool BeforeRender::render_next(const AppState& state) {
+    RenderRequest req;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!wanted_) return false;
+        req.params = params_;
+        req.preview_downsample = downsample_;
+    }
+    req.region.downsample = req.preview_downsample; // The whole frame.
+
+    // Its own cache, so the edit's front-end outputs stay in the worker's.
+    auto result = std::make_unique<RenderResult>();
+    if (!RenderFrame(state, req, *result)) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!wanted_ || downsample_ != req.preview_downsample) return true; // Superseded while rendering.
+    wanted_ = false;
+    ready_ = std::move(result);
+    return true;
+}
+
+bool BeforeRender::take(RenderResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ready_) return false;
+    std::swap(result, *ready_);
+    ready_.reset();
+    return true;
+}
+
+void BeforeRender::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wanted_ = false;
+    downsample_ = -1;
+    ready_.reset();
+}
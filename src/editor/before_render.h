@@ -0,0 +1,45 @@
+#ifndef EDITOR_BEFORE_RENDER_H
+#define EDITOR_BEFORE_RENDER_H
+
+#include "editor/halide_runner.h" // For RenderResult
+#include "process_options.h"
+
+#include <memory>
+#include <mutex>
+
+struct AppState;
+
+// The "before" side of the before/after split view (backslash): a whole
+// frame rendered with the parameters the editor was opened with. It only
+// depends on the image and the preview scale, so it is rendered once, on
+// the render worker's idle task, and the "after" side of the view renders
+// only the part right of the divider (ComputeViewportRegion).
+//
+// request() and take() are for the UI thread; render_next() runs on the
+// render worker.
+class BeforeRender {
+public:
+    // Asks for the frame at `downsample` with `params`, dropping a frame
+    // made for another scale. Returns true if the idle task has work now.
+    bool request(const ProcessConfig& params, int downsample);
+
+    // Renders the requested frame. Returns false if there was none to
+    // render or the render was cancelled; a cancelled one is retried.
+    bool render_next(const AppState& state);
+
+    // Moves the finished frame into `result` and returns true, once.
+    bool take(RenderResult& result);
+
+    // Forgets the request and any frame; for when the image changes. Only
+    // call while the render worker is stopped.
+    void reset();
+
+private:
+    std::mutex mutex_;
+    bool wanted_ = false; // Requested and not rendered yet.
+    int downsample_ = -1;
+    ProcessConfig params_;
+    std::unique_ptr<RenderResult> ready_;
+};
+
+#endif // EDITOR_BEFORE_RENDER_H
@@ -0,0 +1,114 @@
+#include "editor/compressed_raw.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <zlib.h>
+
+namespace { // Anonymous namespace for local helpers
+
+// Runs body(0 .. count-1) on the shared pool if it's running, else on a
+// few threads of its own.
+void for_each_strip(int count, const std::function<void(int)>& body) {
+    ThreadPool& pool = ThreadPool::get();
+    if (count == 1) {
+        body(0);
+    } else if (pool.running()) {
+        pool.parallel_for(0, count, body);
+    } else {
+        std::atomic<int> next{0};
+        const int threads = std::min(count, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (int i; (i = next++) < count;) body(i);
+            });
+        }
+        for (auto& t : workers) t.join();
+    }
+}
+
+// Zigzag, so small differences of either sign have a zero high byte.
+inline uint16_t zigzag(int16_t d) { return static_cast<uint16_t>((d << 1) ^ (d >> 15)); }
+inline int16_t unzigzag(uint16_t z) { return static_cast<int16_t>((z >> 1) ^ -(z & 1)); }
+
+} // namespace
+
+CompressedRaw::CompressedRaw(const RawImageData& raw) : meta_(raw) {
+    if (raw.packing != RawPacking::None) throw std::runtime_error("packed raws can't be held compressed");
+    const Halide::Runtime::Buffer<uint16_t, 2>& bayer = raw.bayer_data;
+    width_ = bayer.width();
+    height_ = bayer.height();
+    x_min_ = bayer.dim(0).min();
+    y_min_ = bayer.dim(1).min();
+    meta_.bayer_data = Halide::Runtime::Buffer<uint16_t, 2>();
+    meta_.decoded_image.reset();
+    meta_.mapped_storage.reset();
+
+    strips_.resize((height_ + kStripRows - 1) / kStripRows);
+    std::atomic<bool> failed{false};
+    for_each_strip(static_cast<int>(strips_.size()), [&](int s) {
+        const int y0 = s * kStripRows, rows = std::min(kStripRows, height_ - y0);
+        const size_t count = static_cast<size_t>(width_) * rows;
+        // The low bytes of the strip's differences, then the high bytes.
+        std::vector<uint8_t> planes(2 * count);
+        size_t i = 0;
+        for (int y = y0; y < y0 + rows; y++) {
+            const uint16_t* row = &bayer(x_min_, y_min_ + y);
+            for (int x = 0; x < width_; x++, i++) {
+                const uint16_t z = x < 2 ? row[x] : zigzag(static_cast<int16_t>(row[x] - row[x - 2]));
+                planes[i] = static_cast<uint8_t>(z);
+                planes[count + i] = static_cast<uint8_t>(z >> 8);
+            }
+        }
+        uLongf size = compressBound(static_cast<uLong>(planes.size()));
+        strips_[s].resize(size);
+        if (compress2(strips_[s].data(), &size, planes.data(), static_cast<uLong>(planes.size()), 1) != Z_OK) {
+            failed = true;
+            return;
+        }
+        strips_[s].resize(size);
+        strips_[s].shrink_to_fit();
+    });
+    if (failed) throw std::runtime_error("could not compress the raw");
+}
+
+RawImageData CompressedRaw::expand(Halide::Runtime::Buffer<uint16_t, 2> scratch) const {
+    RawImageData raw = meta_;
+    if (!scratch.data() || scratch.width() != width_ || scratch.height() != height_) {
+        scratch = Halide::Runtime::Buffer<uint16_t, 2>(width_, height_);
+    }
+    scratch.set_min(x_min_, y_min_);
+    std::atomic<bool> damaged{false};
+    for_each_strip(static_cast<int>(strips_.size()), [&](int s) {
+        const int y0 = s * kStripRows, rows = std::min(kStripRows, height_ - y0);
+        const size_t count = static_cast<size_t>(width_) * rows;
+        std::vector<uint8_t> planes(2 * count);
+        uLongf unpacked = static_cast<uLongf>(planes.size());
+        if (uncompress(planes.data(), &unpacked, strips_[s].data(), static_cast<uLong>(strips_[s].size())) != Z_OK ||
+            unpacked != planes.size()) {
+            damaged = true;
+            return;
+        }
+        size_t i = 0;
+        for (int y = y0; y < y0 + rows; y++) {
+            uint16_t* row = &scratch(x_min_, y_min_ + y);
+            for (int x = 0; x < width_; x++, i++) {
+                const uint16_t z = static_cast<uint16_t>(planes[i] | (planes[count + i] << 8));
+                row[x] = x < 2 ? z : static_cast<uint16_t>(row[x - 2] + unzigzag(z));
+            }
+        }
+    });
+    if (damaged) throw std::runtime_error("compressed raw is damaged");
+    raw.bayer_data = scratch;
+    return raw;
+}
+
+size_t CompressedRaw::bytes() const {
+    size_t total = sizeof(*this);
+    for (const auto& strip : strips_) total += strip.size();
+    return total;
+}
@@ -0,0 +1,43 @@
+#ifndef EDITOR_COMPRESSED_RAW_H
+#define EDITOR_COMPRESSED_RAW_H
+
+#include "raw_load.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A decoded raw held compressed in memory, for the filmstrip's prefetch
+// LRU: the mosaic in strips of kStripRows rows, each sample replaced by its
+// difference from the same-colour sample two to its left, then deflated
+// (zlib, fastest level), low bytes and high bytes apart. Neighbouring
+// same-colour samples differ by little more than noise, so most high bytes
+// are zero and the strips shrink to between a half and a third of the
+// 16-bit mosaic on typical 12 and 14-bit raws, less at high ISO.
+//
+// Strips are compressed and expanded in parallel (on the shared pool when
+// it runs). The metadata is kept as is; the RawSpeed storage the mosaic
+// came from is released.
+class CompressedRaw {
+public:
+    static constexpr int kStripRows = 64;
+
+    // Compresses `raw`'s mosaic. Packed (CSI-2) frames aren't supported.
+    explicit CompressedRaw(const RawImageData& raw);
+
+    // The raw with its mosaic expanded into `scratch` if that has the
+    // raw's size, so a caller expanding one raw after another reuses one
+    // buffer; otherwise into a new one.
+    RawImageData expand(Halide::Runtime::Buffer<uint16_t, 2> scratch = Halide::Runtime::Buffer<uint16_t, 2>()) const;
+
+    // Memory held, in bytes.
+    size_t bytes() const;
+
+private:
+    RawImageData meta_; // bayer_data left empty.
+    int width_ = 0, height_ = 0;
+    int x_min_ = 0, y_min_ = 0;
+    std::vector<std::vector<uint8_t>> strips_;
+};
+
+#endif // EDITOR_COMPRESSED_RAW_H
@@ -0,0 +1,123 @@
+#include "editor/edit_history.h"
+#include "editor/app_state.h"
+
+#include <utility>
+
+EditHistory::EditHistory(size_t budget_bytes) : budget_bytes_(budget_bytes) {}
+
+EditHistory::~EditHistory() {
+    clear_frames();
+}
+
+void EditHistory::set_budget(size_t budget_bytes) {
+    budget_bytes_ = budget_bytes;
+    evict_to(budget_bytes_);
+}
+
+void EditHistory::record(const ProcessConfig& params) {
+    const uint64_t hash = HashPixelParams(params);
+    if (!steps_.empty() && hash == current_hash_) return;
+    if (!steps_.empty()) steps_.resize(cursor_ + 1);
+    steps_.push_back(params);
+    if (steps_.size() > kMaxSteps) steps_.erase(steps_.begin());
+    cursor_ = steps_.size() - 1;
+    current_hash_ = hash;
+}
+
+const ProcessConfig* EditHistory::undo() {
+    if (!can_undo()) return nullptr;
+    cursor_--;
+    current_hash_ = HashPixelParams(steps_[cursor_]);
+    return &steps_[cursor_];
+}
+
+const ProcessConfig* EditHistory::redo() {
+    if (!can_redo()) return nullptr;
+    cursor_++;
+    current_hash_ = HashPixelParams(steps_[cursor_]);
+    return &steps_[cursor_];
+}
+
+void EditHistory::keep(Frame&& frame) {
+    if (budget_bytes_ == 0 || frame.main_texture.id == 0) {
+        DeleteTexture(frame.main_texture);
+        DeleteTexture(frame.thumb_texture);
+        return;
+    }
+    Frame old;
+    if (take(frame.params_hash, frame.region, old)) {
+        DeleteTexture(old.main_texture);
+        DeleteTexture(old.thumb_texture);
+    }
+    ReleaseUploadBuffers(frame.main_texture);
+    ReleaseUploadBuffers(frame.thumb_texture);
+    bytes_ += frame_bytes(frame);
+    lru_.push_front(std::move(frame));
+    evict_to(budget_bytes_);
+}
+
+bool EditHistory::take(uint64_t params_hash, const ViewportRegion& region, Frame& frame) {
+    for (auto it = lru_.begin(); it != lru_.end(); ++it) {
+        if (it->params_hash != params_hash || it->region != region) continue;
+        bytes_ -= frame_bytes(*it);
+        frame = std::move(*it);
+        lru_.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void EditHistory::clear_frames() {
+    evict_to(0);
+}
+
+size_t EditHistory::frame_bytes(const Frame& frame) {
+    // RGBA8, plus a third for the mip chain when there is one.
+    auto texture_bytes = [](const PreviewTexture& t) {
+        const size_t base = static_cast<size_t>(t.width) * t.height * 4;
+        return t.levels > 1 ? base + base / 3 : base;
+    };
+    return texture_bytes(frame.main_texture) + texture_bytes(frame.thumb_texture);
+}
+
+void EditHistory::evict_to(size_t budget_bytes) {
+    while (bytes_ > budget_bytes && !lru_.empty()) {
+        Frame& victim = lru_.back();
+        bytes_ -= frame_bytes(victim);
+        DeleteTexture(victim.main_texture);
+        DeleteTexture(victim.thumb_texture);
+        lru_.pop_back();
+    }
+}
+
+void KeepShownFrame(AppState& state) {
+    if (state.main_params_hash == 0 || !state.main_region.is_full_frame() || state.main_texture.id == 0) return;
+    EditHistory::Frame frame;
+    frame.params_hash = state.main_params_hash;
+    frame.region = state.main_region;
+    std::swap(frame.main_texture, state.main_texture);
+    std::swap(frame.thumb_texture, state.thumb_texture);
+    frame.histogram_luma = state.histogram_luma;
+    frame.histogram_r = state.histogram_r;
+    frame.histogram_g = state.histogram_g;
+    frame.histogram_b = state.histogram_b;
+    state.history.keep(std::move(frame));
+}
+
+bool RestoreKeptFrame(AppState& state, const ViewportRegion& region) {
+    EditHistory::Frame frame;
+    if (!state.history.take(HashPixelParams(state.params), region, frame)) return false;
+    KeepShownFrame(state);
+    // Whatever wasn't kept (a draft, a stand-in) is dropped.
+    DeleteTexture(state.main_texture);
+    DeleteTexture(state.thumb_texture);
+    state.main_texture = frame.main_texture;
+    state.thumb_texture = frame.thumb_texture;
+    state.main_region = frame.region;
+    state.main_params_hash = frame.params_hash;
+    std::swap(state.histogram_luma, frame.histogram_luma);
+    std::swap(state.histogram_r, frame.histogram_r);
+    std::swap(state.histogram_g, frame.histogram_g);
+    std::swap(state.histogram_b, frame.histogram_b);
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef EDITOR_EDIT_HISTORY_H
+#define EDITOR_EDIT_HISTORY_H
+
+#include "editor/halide_runner.h" // For ViewportRegion
+#include "editor/texture_utils.h"
+#include "process_options.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+struct AppState;
+
+// Undo/redo for the editor (Ctrl+Z, Ctrl+Shift+Z or Ctrl+Y): a list of
+// parameter snapshots, one per settled edit, and a cursor into it.
+//
+// Whole-frame renders that get replaced on screen are kept, textures and
+// histograms, in a least-recently-used list under a memory budget, keyed by
+// HashPixelParams and the region. Stepping to a state whose render is still
+// there swaps its textures back in without rendering; other states are
+// rendered as usual. (The render worker keeps the matching front-end outputs,
+// see FrontEndHistory, so those renders usually only run the back end.)
+//
+// Only use from the thread that owns the GL context.
+class EditHistory {
+public:
+    static constexpr size_t kMaxSteps = 200;
+
+    // The frame on screen: the textures and what AppState shows with them.
+    struct Frame {
+        uint64_t params_hash = 0;
+        ViewportRegion region;
+        PreviewTexture main_texture;
+        PreviewTexture thumb_texture;
+        std::vector<float> histogram_luma;
+        std::vector<float> histogram_r;
+        std::vector<float> histogram_g;
+        std::vector<float> histogram_b;
+    };
+
+    explicit EditHistory(size_t budget_bytes = size_t(256) << 20);
+    ~EditHistory();
+
+    EditHistory(const EditHistory&) = delete;
+    EditHistory& operator=(const EditHistory&) = delete;
+
+    // Evicts frames until at most `budget_bytes` of textures remain.
+    void set_budget(size_t budget_bytes);
+
+    // Adds `params` as the newest step, dropping the steps that could be
+    // redone, unless it renders the same as the current step.
+    void record(const ProcessConfig& params);
+
+    bool can_undo() const { return cursor_ > 0; }
+    bool can_redo() const { return cursor_ + 1 < steps_.size(); }
+
+    // Moves the cursor and returns the step's parameters, or null if there
+    // is nothing to undo or redo.
+    const ProcessConfig* undo();
+    const ProcessConfig* redo();
+
+    // Keeps `frame`, replacing any frame with the same key. Its textures
+    // are owned by the history from here on.
+    void keep(Frame&& frame);
+
+    // Moves the frame kept for this key into `frame` and returns true, or
+    // returns false if there is none.
+    bool take(uint64_t params_hash, const ViewportRegion& region, Frame& frame);
+
+    // Drops the kept frames; the steps stay. Called when the image changes
+    // and before the GL context goes away.
+    void clear_frames();
+    size_t bytes() const { return bytes_; }
+
+private:
+    static size_t frame_bytes(const Frame& frame);
+    void evict_to(size_t budget_bytes);
+
+    std::vector<ProcessConfig> steps_;
+    uint64_t current_hash_ = 0;
+    size_t cursor_ = 0;
+
+    std::list<Frame> lru_; // Most recently kept first.
+    size_t bytes_ = 0;
+    size_t budget_bytes_;
+};
+
+// Hands the frame `state` shows to state.history if it is a whole-frame
+// render at full quality, leaving the state's textures empty for the next
+// upload.
+void KeepShownFrame(AppState& state);
+
+// Shows the frame state.history kept for the state's parameters and
+// `region`, keeping the one it replaces. Returns false if there is none.
+bool RestoreKeptFrame(AppState& state, const ViewportRegion& region);
+
+#endif // EDITOR_EDIT_HISTORY_H
@@ -1,8 +1,13 @@
 #include "editor_ui.h"
 #include "app_state.h"
 #include "halide_runner.h"
+#include "pipeline_utils.h"
+#include "render_worker.h"
+#include "filmstrip.h"
 #include "texture_utils.h"
+#include "shader_preview.h"
 #include "pane_manager.h"
+#include "instrumentation.h"
 
 // Include all the individual pane headers
 #include "panes/pane_preview.h"
@@ -25,12 +30,387 @@
 #include <cmath>     // for fabsf, powf
 #include <vector>    // for std::vector
 #include <cstring>   // for memcpy
+#include <utility>   // for std::move
 
 // This function now uses the PaneManager to render the right-side panel.
 static bool RenderRightPanel(PaneManager& pane_manager, AppState& state) {
     return pane_manager.render_all_panes(state);
 }
 
+// How long a settled edit waits before it is rendered: about one render's
+// worth, so cheap renders follow almost immediately while expensive ones
+// aren't started (and cancelled) for every intermediate value. Until a render
+// has been timed, and at most, DEBOUNCE_DURATION.
+static std::chrono::steady_clock::duration RenderDebounce(const AppState& state) {
+    const std::chrono::steady_clock::duration cap = AppState::DEBOUNCE_DURATION;
+    if (state.full_render_ms <= 0.0f) return cap;
+    auto estimate = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<float, std::milli>(state.full_render_ms));
+    return std::min(estimate, cap);
+}
+
+// Draws the cached tiles of the zoomed-in view rendered with the current
+// parameters. img_w/img_h are the on-screen size of the whole frame.
+static void DrawCachedTiles(AppState& state, float img_w, float img_h) {
+    ViewportRegion visible;
+    if (ComputeViewportRegion(state, &visible).is_full_frame() || visible.width <= 0 || visible.height <= 0) return;
+
+    const uint64_t params_hash = HashPixelParams(state.params);
+    const float downscale = LevelDownscale(visible.downsample);
+    const float frame_w = static_cast<float>(static_cast<int>(state.input_image.width() / downscale));
+    const float frame_h = static_cast<float>(static_cast<int>(state.input_image.height() / downscale));
+    const int tile_size = TileCache::kTileSize;
+    for (int ty = visible.y / tile_size; ty <= (visible.y + visible.height - 1) / tile_size; ++ty) {
+        for (int tx = visible.x / tile_size; tx <= (visible.x + visible.width - 1) / tile_size; ++tx) {
+            const TileCache::Tile* tile = state.tile_cache.find(params_hash, visible.downsample, tx, ty);
+            if (!tile) continue;
+            ImVec2 tile_pos(tile->x / frame_w * img_w, tile->y / frame_h * img_h);
+            ImVec2 tile_size_px(tile->width / frame_w * img_w, tile->height / frame_h * img_h);
+            ImGui::SetCursorPos(state.pan_offset + tile_pos);
+            ImGui::Image((void*)(intptr_t)tile->texture, tile_size_px, ImVec2(0, 1), ImVec2(1, 0));
+        }
+    }
+}
+
+// Uploads the newest frame and, for zoomed-in renders, keeps its finished
+// tiles in the tile cache.
+static void UploadFrameTextures(AppState& state) {
+    UploadTexture(state.main_texture, state.main_output.width(), state.main_output.height(), state.main_output_interleaved);
+    UploadTexture(state.thumb_texture, state.thumb_output.width(), state.thumb_output.height(), state.thumb_output_interleaved);
+
+    const ViewportRegion& region = state.main_region;
+    if (region.is_full_frame() || state.main_params_hash == 0) return;
+    const float downscale = LevelDownscale(region.downsample);
+    const int frame_w = static_cast<int>(state.input_image.width() / downscale);
+    const int frame_h = static_cast<int>(state.input_image.height() / downscale);
+    // Only the region's interior is cached; the margin (kViewportMargin) is
+    // rendered for pans, not kept.
+    ViewportRegion valid = region;
+    const int x1 = region.x + region.width, y1 = region.y + region.height;
+    valid.x = region.x == 0 ? 0 : region.x + kViewportMargin;
+    valid.y = region.y == 0 ? 0 : region.y + kViewportMargin;
+    valid.width = (x1 == frame_w ? x1 : x1 - kViewportMargin) - valid.x;
+    valid.height = (y1 == frame_h ? y1 : y1 - kViewportMargin) - valid.y;
+    state.tile_cache.insert(state.main_params_hash, region, valid, frame_w, frame_h, state.main_output_interleaved);
+}
+
+static void UploadRenderedFrame(AppState& state) {
+    if (!state.main_output.data()) return;
+    if (state.shown_latency_pending) {
+        state.shown_latency.handoff_ms = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - state.shown_finish_time).count();
+    }
+    Instrumentation::ScopedTimer upload_timer("Upload");
+    UploadFrameTextures(state);
+    const float upload_ms = upload_timer.elapsed_ms();
+    if (!state.render_timings.empty()) {
+        AppState::RenderTiming& timing = state.render_timings.back();
+        timing.upload_ms = upload_ms;
+        timing.total_ms += timing.upload_ms;
+    }
+    if (state.shown_latency_pending) {
+        state.shown_latency.upload_ms = upload_ms;
+        state.shown_upload_time = std::chrono::steady_clock::now();
+    }
+}
+
+static const char* const kEditLatencyStages[] = {"debounce", "queue", "host prep", "pipeline", "render other",
+                                                 "handoff", "upload", "present", "total"};
+static constexpr int kEditLatencyStageCount = 9;
+
+static void EditLatencyStages(const AppState::EditLatency& l, float out[kEditLatencyStageCount]) {
+    const float stages[kEditLatencyStageCount] = {l.debounce_ms, l.queue_ms, l.host_ms, l.pipeline_ms, l.other_ms,
+                                                  l.handoff_ms, l.upload_ms, l.present_ms, l.total_ms};
+    std::copy(stages, stages + kEditLatencyStageCount, out);
+}
+
+// Starts (or, if it is open, stops) logging edit latencies as CSV to `path`.
+static void ToggleLatencyLog(AppState& state, const std::string& path) {
+    if (state.latency_log.is_open()) {
+        state.latency_log.close();
+        std::cerr << "Stopped logging edit latencies to " << path << std::endl;
+        return;
+    }
+    state.latency_log.open(path, std::ios::out | std::ios::trunc);
+    if (!state.latency_log) {
+        std::cerr << "Could not open " << path << std::endl;
+        state.latency_log.close();
+        return;
+    }
+    state.latency_log << "draft";
+    for (const char* stage : kEditLatencyStages) state.latency_log << ',' << stage << "_ms";
+    state.latency_log << '\n';
+    std::cerr << "Logging edit latencies to " << path << " (F10 to stop)..." << std::endl;
+}
+
+// The last edits' latency by stage, p50 and p95 over the rolling window
+// (F9). Drafts are counted apart from full-quality renders.
+static void DrawEditLatency(const AppState& state) {
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                   ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                   ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
+    const ImVec2 pos = ImGui::GetWindowPos();
+    ImGui::SetNextWindowPos(ImVec2(pos.x + ImGui::GetWindowWidth() - 10, pos.y + 10), ImGuiCond_Always, ImVec2(1, 0));
+    if (!ImGui::Begin("Edit Latency", nullptr, flags)) {
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("edit to photon, last %d edits", static_cast<int>(state.edit_latencies.size()));
+    for (int draft = 0; draft < 2; ++draft) {
+        std::vector<float> samples[kEditLatencyStageCount];
+        for (const AppState::EditLatency& l : state.edit_latencies) {
+            if (l.draft != (draft != 0)) continue;
+            float stages[kEditLatencyStageCount];
+            EditLatencyStages(l, stages);
+            for (int s = 0; s < kEditLatencyStageCount; ++s) samples[s].push_back(stages[s]);
+        }
+        if (samples[0].empty()) continue;
+        ImGui::Separator();
+        ImGui::Text("%s (%d)          p50 ms   p95 ms", draft ? "draft" : "full ", static_cast<int>(samples[0].size()));
+        for (int s = 0; s < kEditLatencyStageCount; ++s) {
+            std::vector<float>& v = samples[s];
+            std::sort(v.begin(), v.end());
+            const float p50 = v[(v.size() - 1) / 2];
+            const float p95 = v[std::min(v.size() - 1, static_cast<size_t>(ceilf(0.95f * v.size())) - 1)];
+            ImGui::Text("  %-14s %7.1f  %7.1f", kEditLatencyStages[s], p50, p95);
+        }
+    }
+    ImGui::End();
+}
+
+// The last renders' times as stacked bars (host prep, pipeline, upload;
+// drafts dimmed), with the session's percentiles from the registry.
+static void DrawRenderStats(const AppState& state) {
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                   ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                   ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
+    const ImVec2 pos = ImGui::GetWindowPos();
+    ImGui::SetNextWindowPos(ImVec2(pos.x + 10, pos.y + 10));
+    if (!ImGui::Begin("Render Stats", nullptr, flags)) {
+        ImGui::End();
+        return;
+    }
+
+    float max_ms = 1.0f;
+    for (const auto& t : state.render_timings) max_ms = std::max(max_ms, t.total_ms);
+    const ImVec2 size(360.0f, 80.0f);
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList* draw = ImGui::GetWindowDrawList();
+    const float bar_w = size.x / AppState::kRenderTimingCount;
+    const ImU32 colors[3] = {IM_COL32(230, 180, 60, 255), IM_COL32(80, 160, 230, 255), IM_COL32(120, 200, 120, 255)};
+    for (size_t i = 0; i < state.render_timings.size(); ++i) {
+        const AppState::RenderTiming& t = state.render_timings[i];
+        const float parts[3] = {t.host_ms, t.pipeline_ms, t.upload_ms};
+        float y = origin.y + size.y;
+        const float x = origin.x + i * bar_w;
+        for (int p = 0; p < 3; ++p) {
+            const float h = parts[p] / max_ms * size.y;
+            ImU32 col = colors[p];
+            if (t.draft) col = (col & 0x00FFFFFF) | 0x80000000;
+            draw->AddRectFilled(ImVec2(x, y - h), ImVec2(x + bar_w - 1.0f, y), col);
+            y -= h;
+        }
+    }
+    ImGui::Dummy(size);
+    ImGui::Text("scale %.1f ms   host / pipeline / upload", max_ms);
+    if (!state.render_timings.empty()) {
+        uint64_t max_heap = 0;
+        for (const auto& t : state.render_timings) max_heap = std::max(max_heap, t.heap_peak_bytes);
+        ImGui::Text("pipeline heap  last %.1f MB, max %.1f MB", state.render_timings.back().heap_peak_bytes / (1024.0 * 1024.0),
+                    max_heap / (1024.0 * 1024.0));
+    }
+
+    const Instrumentation::Registry& registry = Instrumentation::Registry::get();
+    auto row = [&](const char* label, const std::string& name) {
+        Instrumentation::LatencyHistogram h = registry.timer(name);
+        if (h.count() == 0) return;
+        ImGui::Text("%-14s %5llu  p50 %7.1f  p95 %7.1f  p99 %7.1f ms", label, (unsigned long long)h.count(),
+                    h.percentile(0.5), h.percentile(0.95), h.percentile(0.99));
+    };
+    row("render", "RenderFrame");
+    row("  host prep", "RenderFrame/Host Prep");
+    row("  CA shifts", "RenderFrame/camera_pipe_ca_shifts");
+    row("  front end", "RenderFrame/camera_pipe_front_f32");
+    row("  warp map", "RenderFrame/camera_pipe_warp_map");
+    row("  back end", "RenderFrame/camera_pipe_back_f32");
+    row("draft", "RenderFrame (draft)");
+    row("upload", "Upload");
+    ImGui::End();
+}
+
+// Resets the view to the whole frame, fitted and centred.
+static void FitToView(AppState& state) {
+    const float source_w = state.input_image.width() - 32;
+    const float source_h = state.input_image.height() - 24;
+    float fit_scale_x = state.main_view_size.x / source_w;
+    float fit_scale_y = state.main_view_size.y / source_h;
+    float fit_scale = std::min(fit_scale_x, fit_scale_y);
+
+    state.zoom = 1.0f;
+    state.pan_offset.x = (state.main_view_size.x - source_w * fit_scale) * 0.5f;
+    state.pan_offset.y = (state.main_view_size.y - source_h * fit_scale) * 0.5f;
+}
+
+// Swaps the filmstrip's image `index` in for the one being edited. The
+// parameters carry over. Its ahead-of-time preview, if it has one for them,
+// is shown until the render posted on the next frame lands.
+static void SwitchToImage(AppState& state, int index, RawImageData raw) {
+    state.render_worker.reset(); // Joins the worker, which reads the image being replaced.
+    state.raw_image_data = std::move(raw);
+    state.input_image = state.raw_image_data.bayer_data;
+    state.cfa_pattern = state.raw_image_data.cfa_pattern;
+    state.blackLevel = state.raw_image_data.black_level;
+    state.whiteLevel = state.raw_image_data.white_level;
+    state.params.input_path = state.filmstrip->path(index);
+    state.filmstrip_shown = index;
+
+    // Nothing rendered from the old image applies any more.
+    state.tile_cache.clear();
+    state.history.clear_frames();
+    state.before_render.reset();
+    DeleteTexture(state.before_texture);
+    PipelineUtils::flush_memoization_cache(); // Its sizes' tables; the worker is stopped.
+    state.preview_linear = LinearSnapshot();
+    state.shader_preview_active = false;
+    state.shader_refine_generation = 0;
+    state.draft_refine_pending = false;
+    state.render_generation = 0;
+    state.main_params_hash = 0;
+    state.main_output = Halide::Runtime::Buffer<uint8_t>();
+    state.thumb_output = Halide::Runtime::Buffer<uint8_t>();
+    RenderResult preview;
+    if (state.filmstrip->take_preview(index, state.params, state.preview_downsample, preview)) {
+        ApplyRenderResult(state, preview);
+        UploadFrameTextures(state);
+    }
+
+    FitToView(state);
+    state.next_render_time = std::chrono::steady_clock::now();
+    StartRenderWorker(state);
+}
+
+// Undoes (or redoes) the last settled edit. A state whose whole-frame render
+// is still kept comes back without rendering; any other is rendered.
+static void StepHistory(AppState& state, bool redo) {
+    // An edit still waiting for its render is a step too (and leaves
+    // nothing to redo).
+    state.history.record(state.params);
+    const ProcessConfig* step = redo ? state.history.redo() : state.history.undo();
+    if (!step) return;
+    const std::string input_path = state.params.input_path; // Steps carry over across the filmstrip.
+    state.params = *step;
+    state.params.input_path = input_path;
+    state.shader_preview_active = false;
+    state.draft_refine_pending = false;
+
+    const ViewportRegion region = ComputeViewportRegion(state);
+    if (region.is_full_frame() && RestoreKeptFrame(state, region)) {
+        // Nothing in flight is for these parameters any more.
+        if (state.render_worker) state.render_worker->cancel();
+        state.requested_region = region;
+        state.next_render_time = std::chrono::steady_clock::time_point::max();
+        if (state.filmstrip) state.filmstrip->set_preview_params(state);
+    } else {
+        state.next_render_time = std::chrono::steady_clock::now();
+    }
+}
+
+// Steps through the filmstrip (PageUp/PageDown or the bar's arrows) and
+// switches once the image asked for has decoded.
+static void UpdateFilmstrip(AppState& state) {
+    Filmstrip& filmstrip = *state.filmstrip;
+    int step = 0;
+    if (!ImGui::IsAnyItemActive()) {
+        if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) step = 1;
+        if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) step = -1;
+    }
+
+    // A bar along the bottom of the main view: position, name and arrows.
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                   ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                   ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
+    const ImVec2 pos = ImGui::GetWindowPos();
+    ImGui::SetNextWindowPos(ImVec2(pos.x + 10, pos.y + ImGui::GetWindowHeight() - 10), ImGuiCond_Always, ImVec2(0, 1));
+    if (ImGui::Begin("Filmstrip", nullptr, flags)) {
+        if (ImGui::ArrowButton("##prev", ImGuiDir_Left)) step = -1;
+        ImGui::SameLine();
+        if (ImGui::ArrowButton("##next", ImGuiDir_Right)) step = 1;
+        ImGui::SameLine();
+        const int shown = filmstrip.index();
+        std::string name = filmstrip.path(shown);
+        name = name.substr(name.find_last_of("/\\") + 1);
+        ImGui::Text("%d / %d  %s%s", shown + 1, filmstrip.size(), name.c_str(),
+                    shown != state.filmstrip_shown ? "  (decoding...)" : "");
+        if (!state.filmstrip_error.empty()) ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.4f, 1.0f), "%s", state.filmstrip_error.c_str());
+    }
+    ImGui::End();
+
+    if (step != 0) {
+        const int target = std::clamp(filmstrip.index() + step, 0, filmstrip.size() - 1);
+        if (target != filmstrip.index()) {
+            filmstrip.set_index(target);
+            state.filmstrip_error.clear();
+        }
+    }
+    if (filmstrip.index() != state.filmstrip_shown) {
+        RawImageData raw;
+        std::string error;
+        if (filmstrip.get(filmstrip.index(), raw, error)) {
+            if (error.empty()) {
+                SwitchToImage(state, filmstrip.index(), std::move(raw));
+            } else {
+                state.filmstrip_error = "Could not load " + filmstrip.path(filmstrip.index()) + ": " + error;
+                filmstrip.set_index(state.filmstrip_shown);
+            }
+        }
+    }
+}
+
+// Draws the raw's embedded preview fitted and centred in a view of
+// `view_size`, as a stand-in until the first render is shown.
+static void DrawEmbeddedPreview(AppState& state, const ImVec2& view_size) {
+    PreviewTexture& texture = state.embedded_preview_texture;
+    if (texture.id == 0) return;
+    const float fit = std::min(view_size.x / texture.width, view_size.y / texture.height);
+    const ImVec2 size(texture.width * fit, texture.height * fit);
+    ImGui::SetCursorPos((view_size - size) * 0.5f);
+    PrepareTextureForDraw(texture, size.x * ImGui::GetIO().DisplayFramebufferScale.x < texture.width);
+    ImGui::Image((void*)(intptr_t)texture.id, size, ImVec2(0, 1), ImVec2(1, 0));
+}
+
+// Follows the main view's size and the display's pixel density with the
+// whole-frame preview level, so the fitted frame is rendered at the size it
+// is drawn at. A resize that crosses a level re-renders the view.
+static void UpdatePreviewLevel(AppState& state, float display_scale) {
+    const int raw_w = state.input_image.width();
+    const int raw_h = state.input_image.height();
+    const ImVec2 view = state.main_view_size;
+    state.display_scale = display_scale > 0.0f ? display_scale : 1.0f;
+    if (raw_w <= 32 || raw_h <= 24 || view.x <= 1.0f || view.y <= 1.0f) return;
+    const float fit_scale = std::min(view.x / (raw_w - 32), view.y / (raw_h - 24));
+    const int level = DisplayMatchedLevel(raw_w, raw_h, (raw_w - 32) * fit_scale, (raw_h - 24) * fit_scale,
+                                          state.display_scale);
+    state.preview_downsample = level;
+    if (state.ui_ready && state.next_render_time == std::chrono::steady_clock::time_point::max() &&
+        ComputeViewportRegion(state) != state.requested_region) {
+        state.next_render_time = std::chrono::steady_clock::now() + RenderDebounce(state);
+    }
+}
+
+// A line in the main view's bottom left corner while exports are queued.
+static void DrawExportProgress(const AppState& state, const ImVec2& view_pos) {
+    const ExportQueue::Status status = state.export_queue.status();
+    if (status.queued == 0) return;
+    std::string text = "Exporting " + status.current + ": " +
+                       std::to_string(static_cast<int>(status.progress * 100.0f)) + "%";
+    if (status.queued > 1) text += " (" + std::to_string(status.queued - 1) + " more queued)";
+    const ImVec2 pos(view_pos.x + 10.0f, view_pos.y + state.main_view_size.y - ImGui::GetTextLineHeight() - 10.0f);
+    ImGui::GetWindowDrawList()->AddText(pos, IM_COL32(255, 255, 255, 220), text.c_str());
+}
+
 static void RenderMainView(AppState& state) {
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0,0));
     ImGui::Begin("Main View", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
@@ -38,9 +418,37 @@ static void RenderMainView(AppState& state) {
 
     state.main_view_size = ImGui::GetContentRegionAvail();
     ImGuiIO& io = ImGui::GetIO();
+    UpdatePreviewLevel(state, io.DisplayFramebufferScale.x);
     ImVec2 cursor_screen_pos = ImGui::GetCursorScreenPos();
 
-    if (ImGui::IsWindowHovered()) {
+    // The compare view's divider, in screen x, and a drag that started on it.
+    float divider_x = 0.0f;
+    if (state.compare_active) {
+        const float source_w = state.input_image.width() - 32;
+        const float source_h = state.input_image.height() - 24;
+        const float fit_scale = std::min(state.main_view_size.x / source_w, state.main_view_size.y / source_h);
+        const float img_w = source_w * fit_scale * state.zoom;
+        divider_x = cursor_screen_pos.x + state.pan_offset.x + state.compare_split * img_w;
+        if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left) &&
+            fabsf(ImGui::GetMousePos().x - divider_x) <= 6.0f) {
+            state.compare_dragging = true;
+        }
+        if (state.compare_dragging) {
+            if (ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+                const float split = (ImGui::GetMousePos().x - cursor_screen_pos.x - state.pan_offset.x) / img_w;
+                state.compare_split = std::clamp(split, 0.0f, 1.0f);
+                divider_x = cursor_screen_pos.x + state.pan_offset.x + state.compare_split * img_w;
+                // Moving the divider left uncovers more of the edit.
+                if (ComputeViewportRegion(state) != state.requested_region) {
+                    state.next_render_time = std::chrono::steady_clock::now() + RenderDebounce(state);
+                }
+            } else {
+                state.compare_dragging = false;
+            }
+        }
+    }
+
+    if (ImGui::IsWindowHovered() && !state.compare_dragging) {
         if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
             const float source_w = state.input_image.width() - 32;
             float fit_scale = std::min(state.main_view_size.x / source_w, state.main_view_size.y / (state.input_image.height() - 24));
@@ -51,7 +459,7 @@ static void RenderMainView(AppState& state) {
             state.pan_offset = mouse_pos_in_window - (state.main_view_size * 0.5f);
             state.pan_offset = state.pan_offset * -1.0f;
 
-            state.next_render_time = std::chrono::steady_clock::now() + AppState::DEBOUNCE_DURATION;
+            state.next_render_time = std::chrono::steady_clock::now() + RenderDebounce(state);
         }
         else if (io.MouseWheel != 0) {
             float old_zoom = state.zoom;
@@ -60,14 +468,23 @@ static void RenderMainView(AppState& state) {
             ImVec2 mouse_pos_in_window = ImGui::GetMousePos() - cursor_screen_pos;
             state.pan_offset = mouse_pos_in_window + (state.pan_offset - mouse_pos_in_window) * (state.zoom / old_zoom);
 
-            state.next_render_time = std::chrono::steady_clock::now() + AppState::DEBOUNCE_DURATION;
+            state.next_render_time = std::chrono::steady_clock::now() + RenderDebounce(state);
         }
         if (ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
             state.pan_offset = state.pan_offset + io.MouseDelta;
+            // When zoomed in only the visible region is rendered, so panning
+            // to a different region needs a new render.
+            if (ComputeViewportRegion(state) != state.requested_region) {
+                state.next_render_time = std::chrono::steady_clock::now() + RenderDebounce(state);
+            }
         }
     }
 
-    if (state.main_texture_id != 0 && state.main_output_planar.data()) {
+    if (state.filmstrip && state.filmstrip->size() > 1) UpdateFilmstrip(state);
+
+    if (state.main_texture.id == 0) DrawEmbeddedPreview(state, state.main_view_size);
+
+    if (state.main_texture.id != 0 && state.main_output.data()) {
         const float source_w = state.input_image.width() - 32;
         const float source_h = state.input_image.height() - 24;
 
@@ -78,13 +495,79 @@ static void RenderMainView(AppState& state) {
         float img_w = source_w * fit_scale * state.zoom;
         float img_h = source_h * fit_scale * state.zoom;
 
-        ImGui::SetCursorPos(state.pan_offset);
-        ImGui::Image((void*)(intptr_t)state.main_texture_id, ImVec2(img_w, img_h), ImVec2(0, 1), ImVec2(1, 0));
+        // Mipmaps are only built (and sampled) while a texture is drawn
+        // smaller than it is, i.e. below 1:1.
+        const float pixel_scale = ImGui::GetIO().DisplayFramebufferScale.x;
+
+        // While a drag is previewed on the GPU, the shader's output (which
+        // covers the region of the cached front-end output) replaces the
+        // last render.
+        const ViewportRegion* shown_region = &state.main_region;
+        uint32_t shader_texture = 0;
+        if (state.shader_preview_active && state.shader_preview) {
+            shader_texture = state.shader_preview->render(state.params, state.preview_linear);
+            if (shader_texture != 0) shown_region = &state.preview_linear.region;
+        }
+        auto draw_main = [&](const ImVec2& size) {
+            if (shader_texture != 0) {
+                ImGui::Image((void*)(intptr_t)shader_texture, size, ImVec2(0, 1), ImVec2(1, 0));
+                return;
+            }
+            PrepareTextureForDraw(state.main_texture, size.x * pixel_scale < state.main_texture.width);
+            ImGui::Image((void*)(intptr_t)state.main_texture.id, size, ImVec2(0, 1), ImVec2(1, 0));
+        };
+
+        const ViewportRegion& region = *shown_region;
+        if (region.is_full_frame()) {
+            ImGui::SetCursorPos(state.pan_offset);
+            draw_main(ImVec2(img_w, img_h));
+        } else {
+            // Only a region of the frame was rendered. Draw the thumbnail over
+            // the whole frame underneath it so areas panned into view show
+            // something until the next render lands.
+            if (state.thumb_texture.id != 0) {
+                PrepareTextureForDraw(state.thumb_texture, img_w * pixel_scale < state.thumb_texture.width);
+                ImGui::SetCursorPos(state.pan_offset);
+                ImGui::Image((void*)(intptr_t)state.thumb_texture.id, ImVec2(img_w, img_h), ImVec2(0, 1), ImVec2(1, 0));
+            }
+            const float downscale = LevelDownscale(region.downsample);
+            const float frame_w = static_cast<float>(static_cast<int>(state.input_image.width() / downscale));
+            const float frame_h = static_cast<float>(static_cast<int>(state.input_image.height() / downscale));
+            ImVec2 region_pos(region.x / frame_w * img_w, region.y / frame_h * img_h);
+            ImVec2 region_size(region.width / frame_w * img_w, region.height / frame_h * img_h);
+            ImGui::SetCursorPos(state.pan_offset + region_pos);
+            draw_main(region_size);
+            if (shader_texture == 0) DrawCachedTiles(state, img_w, img_h);
+        }
+
+        if (state.compare_active) {
+            // The image as opened, left of the divider, over the edit.
+            const ImVec2 window_min = ImGui::GetWindowPos();
+            const ImVec2 view_max = cursor_screen_pos + state.main_view_size;
+            if (state.before_texture.id != 0) {
+                ImGui::PushClipRect(window_min, ImVec2(divider_x, view_max.y), true);
+                PrepareTextureForDraw(state.before_texture, img_w * pixel_scale < state.before_texture.width);
+                ImGui::SetCursorPos(state.pan_offset);
+                ImGui::Image((void*)(intptr_t)state.before_texture.id, ImVec2(img_w, img_h), ImVec2(0, 1), ImVec2(1, 0));
+                ImGui::PopClipRect();
+            }
+            ImDrawList* draw = ImGui::GetWindowDrawList();
+            const bool hot = state.compare_dragging || fabsf(ImGui::GetMousePos().x - divider_x) <= 6.0f;
+            draw->AddLine(ImVec2(divider_x, cursor_screen_pos.y), ImVec2(divider_x, view_max.y),
+                          hot ? IM_COL32(255, 255, 255, 255) : IM_COL32(255, 255, 255, 160), hot ? 3.0f : 1.5f);
+            const char* before_label = state.before_texture.id != 0 ? "Before" : "Before (rendering...)";
+            const ImVec2 label_size = ImGui::CalcTextSize(before_label);
+            draw->AddText(ImVec2(divider_x - label_size.x - 8.0f, cursor_screen_pos.y + 8.0f), IM_COL32(255, 255, 255, 220), before_label);
+            draw->AddText(ImVec2(divider_x + 8.0f, cursor_screen_pos.y + 8.0f), IM_COL32(255, 255, 255, 220), "After");
+        }
     } else {
         ImVec2 center = cursor_screen_pos + state.main_view_size * 0.5f;
         ImGui::GetWindowDrawList()->AddText(center, IM_COL32(255,255,255,200), "Adjust a parameter to render the image.");
     }
 
+    if (state.show_render_stats) DrawRenderStats(state);
+    if (state.show_edit_latency) DrawEditLatency(state);
+    DrawExportProgress(state, cursor_screen_pos);
     ImGui::End();
 }
 
@@ -155,34 +638,200 @@ void RenderUI(AppState& state) {
     RenderMainView(state);
     bool changed = RenderRightPanel(pane_manager, state);
 
+    // F7 toggles the render latency overlay.
+    if (ImGui::IsKeyPressed(ImGuiKey_F7, false)) state.show_render_stats = !state.show_render_stats;
+
+    // F9 toggles the edit latency overlay; F10 starts or stops its CSV log.
+    if (ImGui::IsKeyPressed(ImGuiKey_F9, false)) state.show_edit_latency = !state.show_edit_latency;
+    if (ImGui::IsKeyPressed(ImGuiKey_F10, false)) {
+        ToggleLatencyLog(state, state.params.latency_log_path.empty() ? "rawr_latency.csv" : state.params.latency_log_path);
+    }
+
+    // F8 starts a Chrome trace recording, or writes the one in progress.
+    if (ImGui::IsKeyPressed(ImGuiKey_F8, false)) {
+        TraceEvents::Recorder& recorder = TraceEvents::Recorder::get();
+        const std::string path = state.params.trace_path.empty() ? "rawr_trace.json" : state.params.trace_path;
+        if (!recorder.active()) {
+            recorder.start();
+            std::cerr << "Recording trace (F8 to stop)..." << std::endl;
+        } else if (recorder.write(path)) {
+            std::cerr << "Wrote trace: " << path << std::endl;
+        } else {
+            std::cerr << "Could not write trace to " << path << std::endl;
+        }
+    }
+
+    // Backslash toggles the before/after compare view.
+    if (ImGui::IsKeyPressed(ImGuiKey_Backslash, false) && !ImGui::GetIO().WantTextInput) {
+        state.compare_active = !state.compare_active;
+        state.compare_dragging = false;
+        state.next_render_time = std::chrono::steady_clock::now();
+    }
+    if (state.compare_active) {
+        // The before frame is rendered on the worker's idle task, once per
+        // image and preview scale.
+        ProcessConfig before = state.before_params;
+        before.input_path = state.params.input_path;
+        if (state.before_render.request(before, state.preview_downsample) && state.render_worker) {
+            state.render_worker->kick_idle();
+        }
+        RenderResult before_frame;
+        if (state.before_render.take(before_frame)) {
+            UploadTexture(state.before_texture, before_frame.main_output.width(), before_frame.main_output.height(),
+                          before_frame.main_output_interleaved);
+        }
+    }
+
+    // Ctrl+Z undoes, Ctrl+Shift+Z or Ctrl+Y redoes; not while a widget is
+    // being edited. Ctrl+E queues a full-resolution export of the edit.
+    const ImGuiIO& io = ImGui::GetIO();
+    if (io.KeyCtrl && !io.WantTextInput && !ImGui::IsAnyItemActive()) {
+        if (ImGui::IsKeyPressed(ImGuiKey_Z, false)) StepHistory(state, io.KeyShift);
+        else if (ImGui::IsKeyPressed(ImGuiKey_Y, false)) StepHistory(state, true);
+        else if (ImGui::IsKeyPressed(ImGuiKey_E, false)) {
+            const std::string path = DefaultExportPath(state.params);
+            if (state.export_queue.add(state, state.params, path)) {
+                std::cerr << "Queued export: " << path << std::endl;
+                if (state.render_worker) state.render_worker->kick_idle();
+            }
+        }
+    }
+
     // --- Handle Debounced Pipeline Execution ---
+    // While a slider is dragged, edits the shader can reproduce are shown on
+    // the GPU right away and the Halide render waits for the release. Other
+    // edits are rendered continuously at the draft tier during the drag.
+    const bool dragging = ImGui::IsAnyItemActive();
     if (changed) {
-        state.next_render_time = std::chrono::steady_clock::now() + AppState::DEBOUNCE_DURATION;
+        if (dragging && state.shader_preview && state.preview_linear.serial != 0 &&
+            ShaderPreview::can_preview(state.params, state.preview_linear.params)) {
+            state.shader_preview_active = true;
+            state.shader_refine_generation = 0;
+            state.next_render_time = std::chrono::steady_clock::time_point::max();
+            // Shown on this frame; no render to wait for.
+            state.pending_edit_time = std::chrono::steady_clock::time_point();
+        } else {
+            state.shader_preview_active = false;
+            if (state.pending_edit_time == std::chrono::steady_clock::time_point()) {
+                state.pending_edit_time = std::chrono::steady_clock::now();
+            }
+            state.next_render_time = std::chrono::steady_clock::now();
+            if (!dragging) state.next_render_time += RenderDebounce(state);
+        }
+    } else if (!dragging && state.next_render_time == std::chrono::steady_clock::time_point::max() &&
+               ((state.shader_preview_active && state.shader_refine_generation == 0) || state.draft_refine_pending)) {
+        // Released: render the final parameters at full quality.
+        state.next_render_time = std::chrono::steady_clock::now();
     }
 
     auto now = std::chrono::steady_clock::now();
-    if (state.ui_ready && now >= state.next_render_time) {
-        std::cout << "Debounce triggered: Rerunning Halide pipeline..." << std::endl;
-        RunHalidePipelines(state);
-        if (state.main_output_planar.data()) {
-            CreateOrUpdateTexture(state.main_texture_id, state.main_output_planar.width(), state.main_output_planar.height(), state.main_output_interleaved);
-            CreateOrUpdateTexture(state.thumb_texture_id, state.thumb_output_planar.width(), state.thumb_output_planar.height(), state.thumb_output_interleaved);
+    const bool draft = dragging && !state.shader_preview_active;
+    // A draft doesn't cancel the previous draft but waits for it to land, so
+    // frames keep coming at the rate the machine can render them.
+    const bool draft_in_flight = draft && state.draft_refine_pending && state.render_worker &&
+                                 state.render_worker->busy();
+    if (state.ui_ready && now >= state.next_render_time && !draft_in_flight) {
+        // Hand a snapshot of the parameters to the render worker. A newer
+        // request supersedes (and cancels) whatever it is currently rendering.
+        RenderRequest req = MakeRenderRequest(state, draft);
+        req.edit_time = state.pending_edit_time;
+        req.post_time = now;
+        state.pending_edit_time = std::chrono::steady_clock::time_point();
+        // A refine after a drag already has a stand-in on screen.
+        if (state.shader_preview_active || state.draft_refine_pending) req.progressive = false;
+        state.requested_region = ComputeViewportRegion(state);
+        state.draft_refine_pending = draft;
+        // Every settled edit is an undo step.
+        if (!draft) state.history.record(state.params);
+        if (req.cached) {
+            // The whole view is drawn from cached tiles.
+            state.shader_preview_active = false;
+        } else if (state.render_worker) {
+            uint64_t generation = state.render_worker->post(std::move(req));
+            if (state.shader_preview_active) state.shader_refine_generation = generation;
+            // Neighbours' previews follow the edit once it settles.
+            if (state.filmstrip && !draft) state.filmstrip->set_preview_params(state);
+        } else {
+            state.shader_preview_active = false;
+            RunHalidePipelines(state, draft);
+            UploadRenderedFrame(state);
         }
         state.next_render_time = std::chrono::steady_clock::time_point::max();
     }
 
+    if (state.filmstrip && state.render_worker && state.filmstrip->take_preview_wakeup()) {
+        state.render_worker->kick_idle();
+    }
+
+    // Pick up a finished frame, if any, and upload it.
+    if (state.render_worker && state.render_worker->poll(state)) {
+        UploadRenderedFrame(state);
+    }
+    // The shader output is replaced once the post-release render is shown.
+    if (state.shader_preview_active && state.shader_refine_generation != 0 &&
+        state.render_generation >= state.shader_refine_generation) {
+        state.shader_preview_active = false;
+    }
+
     if (!state.ui_ready && state.main_view_size.x > 1 && state.main_view_size.y > 1) {
         state.ui_ready = true;
-        const float source_w = state.input_image.width() - 32;
-        const float source_h = state.input_image.height() - 24;
-        float fit_scale_x = state.main_view_size.x / source_w;
-        float fit_scale_y = state.main_view_size.y / source_h;
-        float fit_scale = std::min(fit_scale_x, fit_scale_y);
+        FitToView(state);
+        state.next_render_time = std::chrono::steady_clock::now();
+    }
+}
 
-        state.zoom = 1.0f;
-        state.pan_offset.x = (state.main_view_size.x - source_w * fit_scale) * 0.5f;
-        state.pan_offset.y = (state.main_view_size.y - source_h * fit_scale) * 0.5f;
+void RenderLoadingUI(AppState& state) {
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+    ImGui::SetNextWindowViewport(viewport->ID);
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
+    ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove |
+                                     ImGuiWindowFlags_NoDocking | ImGuiWindowFlags_NoBringToFrontOnFocus);
+    ImGui::PopStyleVar();
+    DrawEmbeddedPreview(state, ImGui::GetContentRegionAvail());
+    ImGui::SetCursorPos(ImVec2(12.0f, 10.0f));
+    ImGui::Text("Decoding %s...", state.params.input_path.c_str());
+    ImGui::End();
+}
 
-        state.next_render_time = std::chrono::steady_clock::now();
+void StartRenderWorker(AppState& state) {
+    state.render_worker = std::make_shared<RenderWorker>(state);
+    // The compare view's before frame, then the filmstrip's previews, then
+    // queued exports.
+    AppState* app = &state;
+    Filmstrip* filmstrip = state.filmstrip.get();
+    state.render_worker->set_idle_task([app, filmstrip] {
+        if (app->before_render.render_next(*app)) return true;
+        if (filmstrip && filmstrip->render_next_preview()) return true;
+        return app->export_queue.render_next();
+    });
+}
+
+void StartLatencyLog(AppState& state) {
+    if (!state.params.latency_log_path.empty()) ToggleLatencyLog(state, state.params.latency_log_path);
+}
+
+void FinishEditLatency(AppState& state) {
+    if (!state.shown_latency_pending || state.shown_upload_time == std::chrono::steady_clock::time_point()) return;
+    state.shown_latency_pending = false;
+    const auto now = std::chrono::steady_clock::now();
+    AppState::EditLatency& l = state.shown_latency;
+    l.present_ms = std::chrono::duration<float, std::milli>(now - state.shown_upload_time).count();
+    l.total_ms = std::chrono::duration<float, std::milli>(now - state.shown_edit_time).count();
+    state.shown_upload_time = std::chrono::steady_clock::time_point();
+
+    state.edit_latencies.push_back(l);
+    if (state.edit_latencies.size() > AppState::kEditLatencyCount) state.edit_latencies.pop_front();
+    float stages[kEditLatencyStageCount];
+    EditLatencyStages(l, stages);
+    Instrumentation::Registry& registry = Instrumentation::Registry::get();
+    const std::string prefix = l.draft ? "EditLatency (draft)/" : "EditLatency/";
+    for (int s = 0; s < kEditLatencyStageCount; ++s) registry.record_time(prefix + kEditLatencyStages[s], stages[s]);
+    if (state.latency_log.is_open()) {
+        state.latency_log << (l.draft ? 1 : 0);
+        for (float ms : stages) state.latency_log << ',' << ms;
+        state.latency_log << '\n';
+        state.latency_log.flush();
     }
 }
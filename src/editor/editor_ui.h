@@ -7,4 +7,20 @@ struct AppState;
 // Renders the entire user interface for the application.
 void RenderUI(AppState& state);
 
+// Creates the render worker for the image in `state`, replacing any
+// previous one, with the filmstrip's ahead-of-time previews as its idle
+// task.
+void StartRenderWorker(AppState& state);
+
+// Completes the edit latency sample of the frame just presented; call
+// right after the buffer swap.
+void FinishEditLatency(AppState& state);
+
+// Opens --latency-log, if it was given.
+void StartLatencyLog(AppState& state);
+
+// Renders the view shown while the raw is still decoding: its embedded
+// preview, if any, and a progress note.
+void RenderLoadingUI(AppState& state);
+
 #endif // EDITOR_UI_H
@@ -0,0 +1,156 @@
+#include "editor/export_queue.h"
+#include "editor/app_state.h"
+#include "editor/filmstrip.h"
+#include "editor/shader_preview.h" // AppState's members, to destroy the scratch one
+#include "image_encoders.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+struct ExportQueue::Job {
+    std::string path;
+    ProcessConfig params;
+    int width = 0, height = 0;
+    int next_row = 0; // Rows written; guarded by the queue's mutex.
+
+    // The rest is only touched by the render worker.
+    std::unique_ptr<AppState> state; // Only what RenderFrame reads.
+    RenderCache cache;
+    RenderResult result;
+    ImageEncoders::EncodeOptions options;
+    std::unique_ptr<ImageEncoders::RowStreamWriter> writer; // Onto path + ".part".
+};
+
+ExportQueue::ExportQueue() = default;
+ExportQueue::~ExportQueue() = default;
+
+bool ExportQueue::add(const AppState& state, const ProcessConfig& params, const std::string& path) {
+    using namespace ImageEncoders;
+    const Format format = format_for_path(path);
+    if (format == Format::Auto || !is_supported(format)) {
+        std::cerr << "Can't export to " << path << ": not a format this build writes (JPEG, PNG or TIFF)." << std::endl;
+        return false;
+    }
+    if (!state.input_image.data()) {
+        std::cerr << "Can't export to " << path << ": no image is loaded." << std::endl;
+        return false;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->path = path;
+    job->params = params;
+    job->width = state.input_image.width();
+    job->height = state.input_image.height();
+    // Shallow (refcounted) handles on the loaded raw, so opening another
+    // image leaves this one alive until the export is written. Heap-allocated,
+    // as AppState is large.
+    job->state = std::make_unique<AppState>();
+    job->state->raw_image_data = state.raw_image_data;
+    job->state->input_image = state.input_image;
+    job->state->cfa_pattern = state.cfa_pattern;
+    job->state->blackLevel = state.blackLevel;
+    job->state->whiteLevel = state.whiteLevel;
+#ifdef USE_LENSFUN
+    job->state->lensfun_db = state.lensfun_db;
+#endif
+    // Every band covers new rows, so earlier front-end outputs are no use.
+    job->cache.main_history.budget_bytes = 0;
+
+    job->options.format = format; // The file is written as path + ".part".
+    job->options.jpeg_quality = std::clamp(params.jpeg_quality, 1, 100);
+    if (params.jpeg_subsampling == 444 || params.jpeg_subsampling == 422) {
+        job->options.jpeg_subsampling = params.jpeg_subsampling;
+    }
+    job->options.png_level = std::clamp(params.png_level, 0, 9);
+    if (params.tiff_compression == "lzw") job->options.tiff_compression = TiffCompression::LZW;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+    return true;
+}
+
+bool ExportQueue::render_next() {
+    std::shared_ptr<Job> job;
+    int y0 = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.empty()) return false;
+        job = jobs_.front();
+        y0 = job->next_row;
+    }
+    const std::string part_path = job->path + ".part";
+    // Drops the export, and whatever of it was written. Returns true: the
+    // next one can start.
+    auto fail = [&](const std::string& why) {
+        job->writer.reset();
+        std::remove(part_path.c_str());
+        std::cerr << "Export to " << job->path << " failed: " << why << std::endl;
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+        return true;
+    };
+
+    const int y1 = std::min(y0 + kBandRows, job->height);
+    RenderRequest req;
+    req.params = job->params;
+    req.preview_downsample = 0;
+    req.main_only = true;
+    req.region.downsample = 0;
+    req.region.x = 0;
+    req.region.width = job->width;
+    req.region.y = y0;
+    req.region.height = y1 - y0;
+    if (!RenderFrame(*job->state, req, job->result, &job->cache)) {
+        if (job->result.cancelled) return false;
+        return fail("the pipeline returned an error");
+    }
+
+    try {
+        if (!job->writer) {
+            job->writer = std::make_unique<ImageEncoders::RowStreamWriter>(part_path, job->width, job->height, 3,
+                                                                           job->options);
+        }
+        // Without the alpha channel.
+        Halide::Runtime::Buffer<uint8_t, 3> band = job->result.main_output.cropped(2, 0, 3);
+        job->writer->write_rows(band);
+        if (y1 == job->height) {
+            job->writer->finish();
+            job->writer.reset();
+            if (std::rename(part_path.c_str(), job->path.c_str()) != 0) {
+                throw std::runtime_error("could not rename " + part_path);
+            }
+        }
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->next_row = y1;
+    if (y1 == job->height) {
+        std::cerr << "Exported " << job->path << std::endl;
+        jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+    }
+    return true;
+}
+
+ExportQueue::Status ExportQueue::status() const {
+    Status status;
+    std::lock_guard<std::mutex> lock(mutex_);
+    status.queued = static_cast<int>(jobs_.size());
+    if (!jobs_.empty()) {
+        status.current = jobs_.front()->path;
+        status.progress = static_cast<float>(jobs_.front()->next_row) / jobs_.front()->height;
+    }
+    return status;
+}
+
+std::string DefaultExportPath(const ProcessConfig& params) {
+    if (!params.output_path.empty()) return params.output_path;
+    std::string path = params.input_path;
+    const size_t slash = path.find_last_of("/\\");
+    const size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) path.erase(dot);
+    return path + ".jpg";
+}
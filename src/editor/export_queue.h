@@ -0,0 +1,69 @@
+#ifndef EDITOR_EXPORT_QUEUE_H
+#define EDITOR_EXPORT_QUEUE_H
+
+#include "process_options.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct AppState;
+
+// Full-resolution exports from the editor (Ctrl+E), rendered on the render
+// worker's idle task from the raw already in memory, so there is no second
+// decode. Each export holds a handle on the raw it was queued from and the
+// parameters of that moment, so editing on or opening another image doesn't
+// change it.
+//
+// An export is rendered kBandRows rows at a time, each written through the
+// row-streaming encoders as it lands. RenderFrame runs each band's front end
+// over the rows its warp samples plus the pyramid's reach, and dehaze takes
+// its estimate from the whole frame, so the bands join without seams. A
+// posted render cancels the idle task within a strip, so an export gives up
+// at most the band in flight and editing stays as responsive as with none
+// queued. Exports run after the compare view's frame and the filmstrip's
+// previews, oldest first, and show what the main view shows (the editor's
+// pipelines, no EXIF rotation).
+//
+// add() and status() are for the UI thread; render_next() runs on the
+// render worker.
+class ExportQueue {
+public:
+    static constexpr int kBandRows = 1024;
+
+    struct Status {
+        int queued = 0;        // Including the one in progress.
+        std::string current;   // Path of the one in progress.
+        float progress = 0.0f; // Of that one, 0 to 1.
+    };
+
+    ExportQueue();
+    ~ExportQueue();
+    ExportQueue(const ExportQueue&) = delete;
+    ExportQueue& operator=(const ExportQueue&) = delete;
+
+    // Queues an export of `state`'s image as `params` render it to `path`,
+    // in the format of its extension (JPEG, PNG or TIFF). Returns false,
+    // having said why on stderr, if that format can't be written.
+    bool add(const AppState& state, const ProcessConfig& params, const std::string& path);
+
+    // Renders and writes the next band of the oldest export. Returns false
+    // if there was none or the band was cancelled; a cancelled band is
+    // rendered again next time.
+    bool render_next();
+
+    Status status() const;
+
+private:
+    struct Job;
+
+    mutable std::mutex mutex_;
+    std::deque<std::shared_ptr<Job>> jobs_;
+};
+
+// Where Ctrl+E writes the image: ProcessConfig::output_path if set, else
+// the input's path with a .jpg extension.
+std::string DefaultExportPath(const ProcessConfig& params);
+
+#endif // EDITOR_EXPORT_QUEUE_H
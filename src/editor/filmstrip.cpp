@@ -0,0 +1,333 @@
+#include "editor/filmstrip.h"
+#include "editor/app_state.h"
+#include "editor/shader_preview.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <set>
+#include <utility>
+
+namespace { // Anonymous namespace for local helpers
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+// The raws in `path`'s folder, sorted by name; always includes `path`.
+std::vector<std::string> list_folder(const std::string& path, bool raw_png) {
+    namespace fs = std::filesystem;
+    static const std::set<std::string> raw_exts = {
+        ".dng", ".arw", ".nef", ".nrw", ".cr2", ".cr3", ".crw", ".raf", ".orf",
+        ".rw2", ".pef", ".srw", ".3fr", ".iiq", ".erf", ".mef", ".mos", ".kdc", ".dcr"};
+    const fs::path self(path);
+    std::vector<std::string> files;
+    std::error_code ec;
+    const fs::path dir = self.has_parent_path() ? self.parent_path() : fs::path(".");
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().filename() == self.filename()) continue;
+        const std::string ext = lowercase(it->path().extension().string());
+        if (raw_png ? ext == ".png" : raw_exts.count(ext) > 0 || is_raw_container_path(it->path().string())) {
+            files.push_back((self.has_parent_path() ? it->path() : it->path().filename()).string());
+        }
+    }
+    files.push_back(path);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace
+
+Filmstrip::Filmstrip(const std::string& path, const RawImageData& current, Loader load, bool raw_png, int radius)
+    : files_(list_folder(path, raw_png)), load_(std::move(load)), radius_(std::max(0, radius)) {
+    index_ = static_cast<int>(std::find(files_.begin(), files_.end(), path) - files_.begin());
+    budget_bytes_ = static_cast<size_t>(2 * radius_ + 1) * current.bayer_data.width() *
+                    current.bayer_data.height() * sizeof(uint16_t);
+    Entry entry;
+    entry.raw = current;
+    insert_locked(index_, std::move(entry)); // Before the thread starts, so no lock.
+    thread_ = std::thread(&Filmstrip::decode_loop, this);
+}
+
+Filmstrip::~Filmstrip() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cv_.notify_all();
+    // A decode in progress can't be interrupted; this waits for it.
+    if (thread_.joinable()) thread_.join();
+}
+
+void Filmstrip::set_index(int index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_ = std::clamp(index, 0, size() - 1);
+        if (expanded_index_ != index_) {
+            expanded_ = RawImageData();
+            expanded_index_ = -1;
+        }
+        auto it = std::find(lru_.begin(), lru_.end(), index_);
+        if (it != lru_.end()) lru_.splice(lru_.begin(), lru_, it);
+    }
+    cv_.notify_all();
+}
+
+bool Filmstrip::get(int index, RawImageData& raw, std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(index);
+    if (it == entries_.end()) return false;
+    error = it->second.error;
+    if (!error.empty()) return true;
+    if (it->second.packed) {
+        if (expanded_index_ != index) return false;
+        raw = expanded_;
+    } else {
+        raw = it->second.raw;
+    }
+    return true;
+}
+
+bool Filmstrip::take_preview(int index, const ProcessConfig& params, int preview_downsample, RenderResult& result) {
+    const uint64_t hash = HashPixelParams(params);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(index);
+    if (it == entries_.end() || !it->second.preview || it->second.preview_hash != hash ||
+        it->second.preview_downsample != preview_downsample) {
+        return false;
+    }
+    std::swap(result, *it->second.preview);
+    it->second.preview.reset();
+    it->second.preview_hash = 0;
+    return true;
+}
+
+void Filmstrip::set_preview_params(const AppState& state) {
+    const uint64_t hash = HashPixelParams(state.params);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (hash == preview_hash_ && state.preview_downsample == preview_downsample_) return;
+    preview_params_ = state.params;
+    preview_hash_ = hash;
+    preview_downsample_ = state.preview_downsample;
+#ifdef USE_LENSFUN
+    lensfun_db_ = state.lensfun_db;
+#endif
+    preview_wakeup_ = true;
+}
+
+bool Filmstrip::render_next_preview() {
+    // Only what RenderFrame reads: the image's load-time data and Lensfun.
+    // Heap-allocated, as AppState is large.
+    auto scratch = std::make_unique<AppState>();
+    RenderRequest req;
+    int target = -1;
+    uint64_t hash = 0;
+    std::shared_ptr<const CompressedRaw> packed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (preview_hash_ == 0) return false;
+        for (int d = 1; d <= radius_ && target < 0; d++) {
+            for (int index : {index_ + d, index_ - d}) {
+                auto it = entries_.find(index);
+                if (it != entries_.end() && it->second.error.empty() &&
+                    (it->second.preview_hash != preview_hash_ || it->second.preview_downsample != preview_downsample_)) {
+                    target = index;
+                    break;
+                }
+            }
+        }
+        if (target < 0) return false;
+        packed = entries_[target].packed;
+        if (!packed) scratch->raw_image_data = entries_[target].raw;
+        req.params = preview_params_;
+        req.params.input_path = files_[target];
+        req.preview_downsample = preview_downsample_;
+        hash = preview_hash_;
+#ifdef USE_LENSFUN
+        scratch->lensfun_db = lensfun_db_;
+#endif
+    }
+    if (packed) {
+        try {
+            scratch->raw_image_data = packed->expand(preview_scratch_);
+        } catch (const std::exception&) {
+            return false;
+        }
+        preview_scratch_ = scratch->raw_image_data.bayer_data;
+    }
+    scratch->input_image = scratch->raw_image_data.bayer_data;
+    scratch->cfa_pattern = scratch->raw_image_data.cfa_pattern;
+    scratch->blackLevel = scratch->raw_image_data.black_level;
+    scratch->whiteLevel = scratch->raw_image_data.white_level;
+    scratch->preview_downsample = req.preview_downsample;
+    req.region.downsample = req.preview_downsample; // The whole frame.
+
+    auto preview = std::make_shared<RenderResult>();
+    if (!RenderFrame(*scratch, req, *preview)) return false;
+    // Shown as a stand-in (see ApplyRenderResult): it doesn't advance the
+    // render generation, enter the tile cache or count as a render time.
+    preview->generation = 0;
+    preview->coarse_pass = true;
+    preview->params_hash = 0;
+    preview->render_ms = 0.0f;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(target);
+    if (it != entries_.end()) {
+        it->second.preview = std::move(preview);
+        it->second.preview_hash = hash;
+        it->second.preview_downsample = req.preview_downsample;
+    }
+    return true;
+}
+
+void Filmstrip::decode_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        int index = -1, compress = -1;
+        bool expand = false;
+        cv_.wait(lock, [&] {
+            return quit_ || (expand = current_needs_expanding()) || (index = next_to_decode()) >= 0 ||
+                   (compress = next_to_compress()) >= 0;
+        });
+        if (quit_) return;
+
+        if (expand) {
+            // The image being switched to, strip by strip on the pool.
+            const int current = index_;
+            std::shared_ptr<const CompressedRaw> packed = entries_[current].packed;
+            expanding_ = current;
+            lock.unlock();
+            RawImageData raw;
+            std::string error;
+            try {
+                raw = packed->expand();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            lock.lock();
+            expanding_ = -1;
+            if (index_ == current) {
+                expanded_ = std::move(raw);
+                expanded_index_ = current;
+                if (!error.empty() && entries_.count(current)) entries_[current].error = error;
+            }
+            continue;
+        }
+
+        if (compress >= 0) {
+            RawImageData raw = entries_[compress].raw;
+            lock.unlock();
+            std::shared_ptr<const CompressedRaw> packed;
+            try {
+                packed = std::make_shared<const CompressedRaw>(raw);
+            } catch (const std::exception& e) {
+                fprintf(stderr, "Filmstrip: keeping %s uncompressed: %s\n", files_[compress].c_str(), e.what());
+            }
+            raw = RawImageData();
+            lock.lock();
+            auto it = entries_.find(compress);
+            if (it != entries_.end() && !packed) {
+                it->second.keep_raw = true;
+            } else if (it != entries_.end()) {
+                // The image is still in use where it was handed out, and
+                // expanded_ keeps it for get() while it is the current one.
+                if (compress == index_ && expanded_index_ != index_) {
+                    expanded_ = it->second.raw;
+                    expanded_index_ = index_;
+                }
+                it->second.raw = RawImageData();
+                it->second.packed = packed;
+                evict_locked();
+            }
+            continue;
+        }
+
+        decoding_ = index;
+        const std::string path = files_[index];
+        lock.unlock();
+
+        Entry entry;
+        try {
+            RawImageData raw = load_(path);
+            try {
+                entry.packed = std::make_shared<const CompressedRaw>(raw);
+            } catch (const std::exception&) {
+                entry.raw = std::move(raw); // Kept as it is.
+                entry.keep_raw = true;
+            }
+        } catch (const std::exception& e) {
+            entry.error = e.what();
+        }
+
+        lock.lock();
+        decoding_ = -1;
+        insert_locked(index, std::move(entry));
+        preview_wakeup_ = true;
+    }
+}
+
+bool Filmstrip::current_needs_expanding() const {
+    auto it = entries_.find(index_);
+    return it != entries_.end() && it->second.packed && it->second.error.empty() && expanded_index_ != index_ &&
+           expanding_ != index_;
+}
+
+int Filmstrip::next_to_decode() const {
+    // The current image first, then outwards, next before previous.
+    for (int d = 0; d <= radius_; d++) {
+        for (int index : {index_ + d, index_ - d}) {
+            if (index >= 0 && index < size() && index != decoding_ && !entries_.count(index)) return index;
+        }
+    }
+    // Further out, while an average compressed entry still fits.
+    size_t total = 0, packed_total = 0;
+    int packed_count = 0;
+    for (const auto& [index, entry] : entries_) {
+        total += entry_bytes(entry);
+        if (entry.packed) {
+            packed_total += entry.packed->bytes();
+            packed_count++;
+        }
+    }
+    if (packed_count == 0 || total + packed_total / packed_count > budget_bytes_) return -1;
+    for (int d = radius_ + 1; d < size(); d++) {
+        for (int index : {index_ + d, index_ - d}) {
+            if (index >= 0 && index < size() && index != decoding_ && !entries_.count(index)) return index;
+        }
+    }
+    return -1;
+}
+
+int Filmstrip::next_to_compress() const {
+    for (const auto& [index, entry] : entries_) {
+        if (!entry.packed && !entry.keep_raw && entry.error.empty() && entry.raw.bayer_data.data()) return index;
+    }
+    return -1;
+}
+
+size_t Filmstrip::entry_bytes(const Entry& entry) {
+    if (entry.packed) return entry.packed->bytes();
+    return static_cast<size_t>(entry.raw.bayer_data.width()) * entry.raw.bayer_data.height() * sizeof(uint16_t);
+}
+
+void Filmstrip::insert_locked(int index, Entry entry) {
+    entries_[index] = std::move(entry);
+    lru_.remove(index);
+    lru_.push_front(index);
+    evict_locked();
+}
+
+void Filmstrip::evict_locked() {
+    size_t total = 0;
+    for (const auto& [index, entry] : entries_) total += entry_bytes(entry);
+    for (auto it = lru_.end(); total > budget_bytes_ && it != lru_.begin();) {
+        --it;
+        if (in_window(*it)) continue;
+        total -= entry_bytes(entries_[*it]);
+        entries_.erase(*it);
+        it = lru_.erase(it);
+    }
+}
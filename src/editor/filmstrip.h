@@ -0,0 +1,149 @@
+#ifndef EDITOR_FILMSTRIP_H
+#define EDITOR_FILMSTRIP_H
+
+#include "editor/compressed_raw.h"
+#include "editor/halide_runner.h" // For RenderResult
+#include "process_options.h"
+#include "raw_load.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AppState;
+#ifdef USE_LENSFUN
+struct lfDatabase;
+#endif
+
+// The raw files in the folder of the image the editor was opened with, for
+// stepping through a shoot without relaunching.
+//
+// The images within `radius` of the current one are decoded ahead on a
+// background thread, nearest first, next before previous, and kept in an
+// LRU so stepping back and forth doesn't decode again. The LRU holds them
+// compressed (CompressedRaw), within the memory 2 * radius + 1 mosaics of
+// the first image's size would take; with the window decoded, the thread
+// carries on outwards while the budget has room, so two to three times as
+// many neighbours are kept. The current image is expanded on the same
+// thread once it's asked for, and get() reports it ready after that. For
+// each decoded neighbour the render worker, when it has nothing else to
+// do, renders a whole-frame preview at the current parameters and
+// preview_downsample (render_next_preview), which is shown the moment the
+// image is switched to while its real render runs.
+//
+// All methods except render_next_preview are for the UI thread, which owns
+// the index; render_next_preview runs on the render worker.
+class Filmstrip {
+public:
+    using Loader = std::function<RawImageData(const std::string& path)>;
+
+    // `current` is the image at `path`, already loaded; the others are
+    // loaded with `load`, which may throw. `raw_png` lists PNGs instead of
+    // raws.
+    Filmstrip(const std::string& path, const RawImageData& current, Loader load, bool raw_png, int radius);
+    ~Filmstrip();
+
+    Filmstrip(const Filmstrip&) = delete;
+    Filmstrip& operator=(const Filmstrip&) = delete;
+
+    int size() const { return static_cast<int>(files_.size()); }
+    int index() const { return index_; }
+    const std::string& path(int index) const { return files_[index]; }
+
+    // Makes `index` the current image and re-centres the prefetch window
+    // on it.
+    void set_index(int index);
+
+    // Copies the decoded image at `index` (the buffers are shared, not
+    // copied) into `raw` and returns true once it is ready: decoded and, for
+    // the current image, expanded. If it failed to decode, returns true
+    // with `error` set.
+    bool get(int index, RawImageData& raw, std::string& error);
+    // Moves the preview rendered for `index` into `result` if it was made
+    // with these parameters.
+    bool take_preview(int index, const ProcessConfig& params, int preview_downsample, RenderResult& result);
+
+    // The parameters ahead-of-time previews are rendered with, taken from
+    // the state's current edit. Previews made with others are redone.
+    void set_preview_params(const AppState& state);
+    // True once since the last call if a preview became worth rendering
+    // (an image decoded or the parameters changed); the UI then wakes the
+    // render worker's idle task.
+    bool take_preview_wakeup() { return preview_wakeup_.exchange(false); }
+    // Renders the preview of the nearest decoded neighbour that lacks one.
+    // Returns false if there was none to render or the render was
+    // cancelled.
+    bool render_next_preview();
+
+private:
+    struct Entry {
+        // The image as decoded, until it is compressed; only the image the
+        // editor opened with is inserted this way.
+        RawImageData raw;
+        std::shared_ptr<const CompressedRaw> packed;
+        bool keep_raw = false; // It couldn't be compressed (CompressedRaw).
+        std::string error;
+        std::shared_ptr<RenderResult> preview;
+        uint64_t preview_hash = 0;
+        int preview_downsample = -1;
+    };
+
+    void decode_loop();
+    // The next image to decode, or -1: the window first, then further out
+    // while an entry of the average size would fit the budget. Called with
+    // mutex_ held.
+    int next_to_decode() const;
+    // An entry still held uncompressed, or -1. Called with mutex_ held.
+    int next_to_compress() const;
+    // True if the current image is compressed and not yet expanded.
+    // Called with mutex_ held.
+    bool current_needs_expanding() const;
+    // Adds an entry as most recently used and evicts the least recently
+    // used ones outside the window while over the budget. Called with
+    // mutex_ held.
+    void insert_locked(int index, Entry entry);
+    void evict_locked();
+    static size_t entry_bytes(const Entry& entry);
+    bool in_window(int index) const { return index >= index_ - radius_ && index <= index_ + radius_; }
+
+    std::vector<std::string> files_;
+    Loader load_;
+    int radius_;
+    int index_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool quit_ = false;
+    int decoding_ = -1; // The index being decoded, or -1.
+    std::map<int, Entry> entries_;
+    std::list<int> lru_; // Most recently used first.
+    size_t budget_bytes_ = 0;
+    // The current image expanded, for get(); expanded_index_ is -1 if none.
+    RawImageData expanded_;
+    int expanded_index_ = -1;
+    int expanding_ = -1; // The index being expanded, or -1.
+    // The mosaic previews are expanded into, reused from one to the next.
+    // Only touched by render_next_preview.
+    Halide::Runtime::Buffer<uint16_t, 2> preview_scratch_;
+
+    // Parameters for previews; guarded by mutex_.
+    ProcessConfig preview_params_;
+    uint64_t preview_hash_ = 0; // HashPixelParams(preview_params_), 0 until set.
+    int preview_downsample_ = 2 * kLevelsPerOctave;
+#ifdef USE_LENSFUN
+    std::shared_ptr<lfDatabase> lensfun_db_;
+#endif
+    std::atomic<bool> preview_wakeup_{false};
+
+    std::thread thread_;
+};
+
+#endif // EDITOR_FILMSTRIP_H
@@ -0,0 +1,58 @@
+#include "gl_functions.h"
+#include <SDL.h> // For SDL_GL_GetProcAddress
+
+namespace {
+
+template <typename F>
+void load(F& fn, const char* name) {
+    fn = reinterpret_cast<F>(SDL_GL_GetProcAddress(name));
+}
+
+} // namespace
+
+const GLFunctions& gl() {
+    static const GLFunctions functions = [] {
+        GLFunctions f;
+        load(f.GenerateMipmap, "glGenerateMipmap");
+        load(f.TexStorage2D, "glTexStorage2D");
+        load(f.TexImage3D, "glTexImage3D");
+        load(f.ActiveTexture, "glActiveTexture");
+
+        load(f.GenBuffers, "glGenBuffers");
+        load(f.DeleteBuffers, "glDeleteBuffers");
+        load(f.BindBuffer, "glBindBuffer");
+        load(f.BufferData, "glBufferData");
+        load(f.MapBufferRange, "glMapBufferRange");
+        load(f.UnmapBuffer, "glUnmapBuffer");
+
+        load(f.GenFramebuffers, "glGenFramebuffers");
+        load(f.DeleteFramebuffers, "glDeleteFramebuffers");
+        load(f.BindFramebuffer, "glBindFramebuffer");
+        load(f.FramebufferTexture2D, "glFramebufferTexture2D");
+        load(f.CheckFramebufferStatus, "glCheckFramebufferStatus");
+
+        load(f.CreateShader, "glCreateShader");
+        load(f.ShaderSource, "glShaderSource");
+        load(f.CompileShader, "glCompileShader");
+        load(f.GetShaderiv, "glGetShaderiv");
+        load(f.GetShaderInfoLog, "glGetShaderInfoLog");
+        load(f.DeleteShader, "glDeleteShader");
+        load(f.CreateProgram, "glCreateProgram");
+        load(f.AttachShader, "glAttachShader");
+        load(f.LinkProgram, "glLinkProgram");
+        load(f.GetProgramiv, "glGetProgramiv");
+        load(f.GetProgramInfoLog, "glGetProgramInfoLog");
+        load(f.DeleteProgram, "glDeleteProgram");
+        load(f.UseProgram, "glUseProgram");
+        load(f.GetUniformLocation, "glGetUniformLocation");
+        load(f.Uniform1i, "glUniform1i");
+        load(f.Uniform1f, "glUniform1f");
+        load(f.Uniform2f, "glUniform2f");
+        load(f.Uniform4f, "glUniform4f");
+        load(f.GenVertexArrays, "glGenVertexArrays");
+        load(f.BindVertexArray, "glBindVertexArray");
+        load(f.DeleteVertexArrays, "glDeleteVertexArrays");
+        return f;
+    }();
+    return functions;
+}
@@ -0,0 +1,73 @@
+#ifndef EDITOR_GL_FUNCTIONS_H
+#define EDITOR_GL_FUNCTIONS_H
+
+#include <SDL_opengl.h>
+#include <SDL_opengl_glext.h> // For the function pointer type definitions
+
+// OpenGL entry points beyond 1.1, which have to be looked up at runtime. Any
+// of them may be missing on an old or limited context; callers check the
+// ones they use and fall back (or disable the feature) without them.
+struct GLFunctions {
+    // Textures
+    PFNGLGENERATEMIPMAPPROC GenerateMipmap = nullptr;
+    PFNGLTEXSTORAGE2DPROC TexStorage2D = nullptr; // GL 4.2 / ARB_texture_storage
+    PFNGLTEXIMAGE3DPROC TexImage3D = nullptr;
+    PFNGLACTIVETEXTUREPROC ActiveTexture = nullptr;
+
+    // Buffer objects
+    PFNGLGENBUFFERSPROC GenBuffers = nullptr;
+    PFNGLDELETEBUFFERSPROC DeleteBuffers = nullptr;
+    PFNGLBINDBUFFERPROC BindBuffer = nullptr;
+    PFNGLBUFFERDATAPROC BufferData = nullptr;
+    PFNGLMAPBUFFERRANGEPROC MapBufferRange = nullptr;
+    PFNGLUNMAPBUFFERPROC UnmapBuffer = nullptr;
+
+    // Framebuffer objects
+    PFNGLGENFRAMEBUFFERSPROC GenFramebuffers = nullptr;
+    PFNGLDELETEFRAMEBUFFERSPROC DeleteFramebuffers = nullptr;
+    PFNGLBINDFRAMEBUFFERPROC BindFramebuffer = nullptr;
+    PFNGLFRAMEBUFFERTEXTURE2DPROC FramebufferTexture2D = nullptr;
+    PFNGLCHECKFRAMEBUFFERSTATUSPROC CheckFramebufferStatus = nullptr;
+
+    // Shaders and vertex arrays
+    PFNGLCREATESHADERPROC CreateShader = nullptr;
+    PFNGLSHADERSOURCEPROC ShaderSource = nullptr;
+    PFNGLCOMPILESHADERPROC CompileShader = nullptr;
+    PFNGLGETSHADERIVPROC GetShaderiv = nullptr;
+    PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog = nullptr;
+    PFNGLDELETESHADERPROC DeleteShader = nullptr;
+    PFNGLCREATEPROGRAMPROC CreateProgram = nullptr;
+    PFNGLATTACHSHADERPROC AttachShader = nullptr;
+    PFNGLLINKPROGRAMPROC LinkProgram = nullptr;
+    PFNGLGETPROGRAMIVPROC GetProgramiv = nullptr;
+    PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog = nullptr;
+    PFNGLDELETEPROGRAMPROC DeleteProgram = nullptr;
+    PFNGLUSEPROGRAMPROC UseProgram = nullptr;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation = nullptr;
+    PFNGLUNIFORM1IPROC Uniform1i = nullptr;
+    PFNGLUNIFORM1FPROC Uniform1f = nullptr;
+    PFNGLUNIFORM2FPROC Uniform2f = nullptr;
+    PFNGLUNIFORM4FPROC Uniform4f = nullptr;
+    PFNGLGENVERTEXARRAYSPROC GenVertexArrays = nullptr;
+    PFNGLBINDVERTEXARRAYPROC BindVertexArray = nullptr;
+    PFNGLDELETEVERTEXARRAYSPROC DeleteVertexArrays = nullptr;
+
+    bool has_pbos() const {
+        return GenBuffers && DeleteBuffers && BindBuffer && BufferData && MapBufferRange && UnmapBuffer;
+    }
+    bool has_framebuffers() const {
+        return GenFramebuffers && DeleteFramebuffers && BindFramebuffer && FramebufferTexture2D && CheckFramebufferStatus;
+    }
+    bool has_shaders() const {
+        return CreateShader && ShaderSource && CompileShader && GetShaderiv && GetShaderInfoLog && DeleteShader &&
+               CreateProgram && AttachShader && LinkProgram && GetProgramiv && GetProgramInfoLog && DeleteProgram &&
+               UseProgram && GetUniformLocation && Uniform1i && Uniform1f && Uniform2f && Uniform4f &&
+               GenVertexArrays && BindVertexArray && DeleteVertexArrays && ActiveTexture && TexImage3D;
+    }
+};
+
+// The entry points of the current context, loaded on first use. Only call
+// from the thread that owns the GL context.
+const GLFunctions& gl();
+
+#endif // EDITOR_GL_FUNCTIONS_H
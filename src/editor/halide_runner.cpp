@@ -1,14 +1,17 @@
 #include "editor/halide_runner.h"
 #include "editor/app_state.h"
+#include "instrumentation.h"
+#include "halide_memory.h"
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <utility>
 #include <vector>
 
 // The editor exclusively uses the float32 pipeline.
-// Define this macro to ensure the correct generated header is included.
-#define PIPELINE_PRECISION_F32
-
 // To enable Lensfun support, compile with -DUSE_LENSFUN and link against liblensfun.
 #ifdef USE_LENSFUN
 #include "lensfun/lensfun.h"
@@ -18,176 +21,712 @@
 #include "tone_curve_utils.h"
 #include "pipeline_utils.h"
 
-// Conditionally include the generated pipeline headers
-#if defined(PIPELINE_PRECISION_F32)
-#include "camera_pipe_f32_lib.h"
-#elif defined(PIPELINE_PRECISION_U16)
-#include "camera_pipe_u16_lib.h"
-#else
-#error "PIPELINE_PRECISION_F32 or PIPELINE_PRECISION_U16 must be defined"
-#endif
+// The editor runs the split front-end/back-end variants of the f32 pipeline.
+#include "camera_pipe_front_f32_lib.h"
+#include "camera_pipe_back_f32_lib.h"
+#include "camera_pipe_warp_map_lib.h"
+#include "camera_pipe_ca_shifts_lib.h"
+
+namespace {
+
+// The back end writes RGBA, the layout textures are uploaded in.
+constexpr int kPreviewChannels = 4;
+
+// Points `view` at `pixels`, sized for a width x height chunky RGBA image. The
+// back end writes straight into this memory, which is uploaded to OpenGL as-is.
+void bind_interleaved(std::vector<uint8_t>& pixels, Halide::Runtime::Buffer<uint8_t>& view, int width, int height) {
+    pixels.resize(static_cast<size_t>(width) * height * kPreviewChannels);
+    if (view.data() != pixels.data() || view.width() != width || view.height() != height) {
+        view = Halide::Runtime::Buffer<uint8_t>::make_interleaved(pixels.data(), width, height, kPreviewChannels);
+    }
+}
+
+// Replaces `resident` with `fresh` unless they hold the same data. Keeping
+// the old buffer keeps its device copy valid, so unchanged LUTs aren't
+// uploaded again.
+template <typename T, int D>
+void update_resident(Halide::Runtime::Buffer<T, D>& resident, Halide::Runtime::Buffer<T, D>&& fresh) {
+    if (resident.data() && resident.number_of_elements() == fresh.number_of_elements()) {
+        bool same_shape = true;
+        for (int i = 0; i < fresh.dimensions(); i++) {
+            same_shape = same_shape && resident.dim(i).extent() == fresh.dim(i).extent();
+        }
+        if (same_shape && memcmp(resident.data(), fresh.data(), fresh.size_in_bytes()) == 0) return;
+    }
+    resident = std::move(fresh);
+}
+
+// Box-filters a chunky RGBA image into `dst` (also chunky RGBA). Each
+// destination pixel averages the block of source pixels that maps onto it.
+void downsample_interleaved(const Halide::Runtime::Buffer<uint8_t>& src, Halide::Runtime::Buffer<uint8_t>& dst) {
+    constexpr int C = kPreviewChannels;
+    const int sw = src.width(), sh = src.height();
+    const int dw = dst.width(), dh = dst.height();
+    const uint8_t* src_px = src.data();
+    uint8_t* dst_px = dst.data();
+
+    // Destination column of each source column.
+    std::vector<int> column(sw);
+    std::vector<uint32_t> column_count(dw, 0);
+    for (int x = 0; x < sw; ++x) {
+        column[x] = std::min(dw - 1, static_cast<int>(static_cast<int64_t>(x) * dw / sw));
+        column_count[column[x]]++;
+    }
+
+    std::vector<uint32_t> sums(static_cast<size_t>(dw) * C);
+    int y = 0;
+    for (int dy = 0; dy < dh; ++dy) {
+        const int y_end = dy + 1 == dh ? sh : static_cast<int>(static_cast<int64_t>(dy + 1) * sh / dh);
+        std::fill(sums.begin(), sums.end(), 0u);
+        const int rows = std::max(1, y_end - y);
+        for (; y < y_end; ++y) {
+            const uint8_t* row = src_px + static_cast<size_t>(y) * sw * C;
+            for (int x = 0; x < sw; ++x) {
+                uint32_t* sum = &sums[static_cast<size_t>(column[x]) * C];
+                for (int c = 0; c < C; ++c) sum[c] += row[C * x + c];
+            }
+        }
+        uint8_t* out = dst_px + static_cast<size_t>(dy) * dw * C;
+        for (int dx = 0; dx < dw; ++dx) {
+            const uint32_t n = std::max(1u, column_count[dx] * rows);
+            for (int c = 0; c < C; ++c) {
+                out[C * dx + c] = static_cast<uint8_t>((sums[C * dx + c] + n / 2) / n);
+            }
+        }
+    }
+}
+
+// Copies the planar front-end output into `snapshot` as interleaved RGB.
+void snapshot_linear(const FrontEndCache& fe, const ProcessConfig& cfg, const ViewportRegion& region,
+                     int frame_width, int frame_height, LinearSnapshot& snapshot) {
+    const Halide::Runtime::Buffer<float>& linear = fe.linear;
+    const int w = linear.width(), h = linear.height();
+    const int x0 = linear.dim(0).min(), y0 = linear.dim(1).min();
+    snapshot.rgb.resize(static_cast<size_t>(w) * h * 3);
+    for (int y = 0; y < h; ++y) {
+        float* row = &snapshot.rgb[static_cast<size_t>(y) * w * 3];
+        for (int c = 0; c < 3; ++c) {
+            for (int x = 0; x < w; ++x) {
+                row[3 * x + c] = linear(x0 + x, y0 + y, c);
+            }
+        }
+    }
+    snapshot.serial = fe.serial;
+    snapshot.params = cfg;
+    snapshot.region = region;
+    snapshot.x = x0;
+    snapshot.y = y0;
+    snapshot.width = w;
+    snapshot.height = h;
+    snapshot.frame_width = frame_width;
+    snapshot.frame_height = frame_height;
+}
+
+// Before the main target's front end is recomputed for `cfg`: keeps the
+// output in `fe` in `history`, unless it or the request is a draft, and
+// brings back a kept output that matches, if there is one.
+void recall_front_end(FrontEndCache& fe, FrontEndHistory& history, const ProcessConfig& cfg, float downscale,
+                      int x, int y, int width, int height, bool draft) {
+    if (fe.matches(cfg, downscale, x, y, width, height)) return;
+    auto it = history.entries.begin();
+    while (it != history.entries.end() && !it->matches(cfg, downscale, x, y, width, height)) ++it;
+    const bool found = it != history.entries.end();
+    const bool keep = fe.valid && !fe.draft && !draft && history.budget_bytes > 0;
+    if (!found && !keep) return; // Recompute into the same buffer.
+
+    FrontEndCache recalled;
+    if (found) {
+        history.bytes -= it->linear.size_in_bytes();
+        recalled = std::move(*it);
+        history.entries.erase(it);
+    }
+    const uint64_t serial = fe.serial;
+    if (keep) {
+        history.bytes += fe.linear.size_in_bytes();
+        history.entries.push_front(std::move(fe));
+        while (history.bytes > history.budget_bytes && !history.entries.empty()) {
+            history.bytes -= history.entries.back().linear.size_in_bytes();
+            history.entries.pop_back();
+        }
+    }
+    fe = std::move(recalled);
+    // The serial tells the shader preview its snapshot is stale; keep it
+    // rising even when an older output comes back.
+    fe.serial = serial + 1;
+}
+
+} // namespace
+
+bool FrontEndCache::matches(const ProcessConfig& cfg, float downscale, int x, int y, int width, int height) const {
+    return valid &&
+           downscale_factor == downscale &&
+           linear.dim(0).min() == x && linear.dim(1).min() == y &&
+           linear.width() == width && linear.height() == height &&
+           params.demosaic_algorithm == cfg.demosaic_algorithm &&
+           params.exposure == cfg.exposure &&
+           params.denoise_strength == cfg.denoise_strength &&
+           params.denoise_eps == cfg.denoise_eps &&
+           params.denoise_algorithm == cfg.denoise_algorithm &&
+           params.color_temp == cfg.color_temp &&
+           params.input_profile == cfg.input_profile &&
+           params.tint == cfg.tint &&
+           params.green_balance == cfg.green_balance &&
+           params.ca_strength == cfg.ca_strength &&
+           (cfg.ca_strength == 0.0f || PipelineUtils::tca_lut_inputs_match(params, cfg));
+}
+
+bool WarpMapCache::matches(const ProcessConfig& cfg, int width_of_frame, int height_of_frame,
+                           int x, int y, int width, int height) const {
+    return valid &&
+           frame_width == width_of_frame && frame_height == height_of_frame &&
+           map.dim(0).min() == x && map.dim(1).min() == y &&
+           map.width() == width && map.height() == height &&
+           PipelineUtils::distortion_lut_inputs_match(params, cfg) &&
+           PipelineUtils::tca_lut_inputs_match(params, cfg) &&
+           params.ca_red_cyan == cfg.ca_red_cyan && params.ca_blue_yellow == cfg.ca_blue_yellow &&
+           params.geo_rotate == cfg.geo_rotate && params.geo_scale == cfg.geo_scale &&
+           params.geo_aspect == cfg.geo_aspect &&
+           params.geo_keystone_v == cfg.geo_keystone_v && params.geo_keystone_h == cfg.geo_keystone_h &&
+           params.geo_offset_x == cfg.geo_offset_x && params.geo_offset_y == cfg.geo_offset_y;
+}
+
+namespace {
+
+// How far past a pixel the back end reads its input, in frame pixels. The
+// local laplacian pyramid (8 levels; each downsample reaches 2 pixels past
+// its footprint and each upsample 1, at that level's scale) reads about
+// 2 * 2^8 around it, but only when it runs (see local_laplacian_active).
+constexpr int kPyramidReach = 512;
+// The sharpen stencil after the geometry stage (SharpenBuilder's kRadius)
+// reads the warp map this far past the region.
+constexpr int kSharpenReach = 5;
+// Long edge of the front end dehaze's estimate is taken from: one pixel per
+// sample of its grid (DehazeBuilder's kGridCells * kSamples).
+constexpr int kDehazeStatsEdge = 768;
+
+// Mirrors LocalLaplacianBuilder's is_default: otherwise the back end
+// selects the pointwise look and the pyramid's output is never used.
+bool local_laplacian_active(const ProcessConfig& cfg) {
+    return cfg.ll_detail != 0 || cfg.ll_clarity != 0 || cfg.ll_shadows != 0 || cfg.ll_highlights != 0 ||
+           cfg.ll_blacks != 0 || cfg.ll_whites != 0 || cfg.ll_debug_level > 0;
+}
+
+// Grows the frame rectangle [x0, x1) x [y0, y1) into a render region: by
+// kViewportMargin, and snapped to a grid so small pans reuse the cached
+// front end. A region covering the whole frame is returned as full-frame.
+ViewportRegion grow_region(int downsample, int x0, int y0, int x1, int y1, int frame_w, int frame_h) {
+    const int snap = 64;
+    x0 = std::max(0, ((x0 - kViewportMargin) / snap) * snap);
+    y0 = std::max(0, ((y0 - kViewportMargin) / snap) * snap);
+    x1 = std::min(frame_w, ((x1 + kViewportMargin + snap - 1) / snap) * snap);
+    y1 = std::min(frame_h, ((y1 + kViewportMargin + snap - 1) / snap) * snap);
+
+    ViewportRegion region;
+    region.downsample = downsample;
+    if (x0 == 0 && y0 == 0 && x1 == frame_w && y1 == frame_h) return region; // Full frame at this scale.
+    region.x = x0;
+    region.y = y0;
+    region.width = x1 - x0;
+    region.height = y1 - y0;
+    return region;
+}
+
+} // namespace
+
+uint64_t HashPixelParams(const ProcessConfig& cfg) {
+    // FNV-1a over the fields that change the rendered pixels.
+    uint64_t h = 14695981039346656037ull;
+    auto bytes = [&](const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    };
+    auto value = [&](const auto& v) { bytes(&v, sizeof(v)); };
+    auto text = [&](const std::string& s) { value(s.size()); bytes(s.data(), s.size()); };
+    auto points = [&](const std::vector<Point>& pts) {
+        value(pts.size());
+        for (const Point& p : pts) { value(p.x); value(p.y); }
+    };
+
+    text(cfg.demosaic_algorithm); text(cfg.denoise_algorithm); text(cfg.input_profile); text(cfg.look_lut);
+    value(cfg.color_temp); value(cfg.tint); value(cfg.exposure); value(cfg.green_balance); value(cfg.ca_strength);
+    value(cfg.dehaze_strength); value(cfg.denoise_strength); value(cfg.denoise_eps);
+    value(cfg.sharpen_strength); value(cfg.sharpen_radius); value(cfg.sharpen_threshold);
+    value(cfg.ll_detail); value(cfg.ll_clarity); value(cfg.ll_shadows); value(cfg.ll_highlights);
+    value(cfg.ll_blacks); value(cfg.ll_whites); value(cfg.ll_debug_level);
+    value(cfg.tonemap_algorithm); value(cfg.gamma); value(cfg.contrast); value(cfg.curve_mode);
+    points(cfg.curve_points_luma); points(cfg.curve_points_r); points(cfg.curve_points_g); points(cfg.curve_points_b);
+    value(cfg.shadows_wheel.x); value(cfg.shadows_wheel.y); value(cfg.shadows_luma);
+    value(cfg.midtones_wheel.x); value(cfg.midtones_wheel.y); value(cfg.midtones_luma);
+    value(cfg.highlights_wheel.x); value(cfg.highlights_wheel.y); value(cfg.highlights_luma);
+    points(cfg.curve_hue_vs_hue); points(cfg.curve_hue_vs_sat); points(cfg.curve_hue_vs_lum);
+    points(cfg.curve_lum_vs_sat); points(cfg.curve_sat_vs_sat);
+    text(cfg.camera_make); text(cfg.camera_model); text(cfg.lens_profile_name); value(cfg.focal_length);
+    value(cfg.aperture); value(cfg.focus_distance); value(cfg.lens_tca);
+    value(cfg.ca_red_cyan); value(cfg.ca_blue_yellow);
+    value(cfg.vignette_amount); value(cfg.vignette_midpoint); value(cfg.vignette_roundness); value(cfg.vignette_highlights);
+    value(cfg.dist_k1); value(cfg.dist_k2); value(cfg.dist_k3);
+    value(cfg.geo_rotate); value(cfg.geo_scale); value(cfg.geo_aspect); value(cfg.geo_keystone_v);
+    value(cfg.geo_keystone_h); value(cfg.geo_offset_x); value(cfg.geo_offset_y);
+    return h;
+}
+
+int DisplayMatchedLevel(int raw_width, int raw_height, float view_width, float view_height, float pixel_scale) {
+    const float raw_per_screen = std::min(raw_width / (view_width * pixel_scale), raw_height / (view_height * pixel_scale));
+    if (!(raw_per_screen > 1.0f)) return 0;
+    // Rounded down, so the frame is never rendered smaller than it's drawn.
+    return static_cast<int>(floorf(log2f(raw_per_screen) * kLevelsPerOctave + 1e-3f));
+}
+
+ViewportRegion ComputeViewportRegion(const AppState& state, ViewportRegion* visible) {
+    ViewportRegion region;
+    region.downsample = state.preview_downsample;
+    if (visible) *visible = region;
+
+    const int raw_w = state.input_image.width();
+    const int raw_h = state.input_image.height();
+    const ImVec2 view = state.main_view_size;
+    if (raw_w <= 32 || raw_h <= 24 || view.x <= 1.0f || view.y <= 1.0f) return region;
+
+    // Mirrors the layout in RenderMainView: the whole frame is drawn at
+    // pan_offset with this on-screen size.
+    const float fit_scale = std::min(view.x / (raw_w - 32), view.y / (raw_h - 24));
+    const float img_w = (raw_w - 32) * fit_scale * state.zoom;
+    const float img_h = (raw_h - 24) * fit_scale * state.zoom;
+    const ImVec2 pan = state.pan_offset;
+
+    // The frame at the size it's drawn at, in screen pixels: zoomed out
+    // that's coarser than the fitted preview.
+    const int downsample = DisplayMatchedLevel(raw_w, raw_h, img_w, img_h, state.display_scale);
+    region.downsample = downsample;
+    if (visible) visible->downsample = downsample;
+
+    // The whole image is on screen (or none of it is): the regular preview,
+    // unless the compare view shows part of it from the before render.
+    const bool whole = pan.x >= 0 && pan.y >= 0 && pan.x + img_w <= view.x && pan.y + img_h <= view.y;
+    if (whole && !state.compare_active) return region;
+    if (pan.x >= view.x || pan.y >= view.y || pan.x + img_w <= 0 || pan.y + img_h <= 0) return region;
+
+    const float downscale = LevelDownscale(downsample);
+    const int frame_w = static_cast<int>(raw_w / downscale);
+    const int frame_h = static_cast<int>(raw_h / downscale);
+
+    // The visible rectangle in frame pixels; in the compare view only the
+    // part right of the divider (at least a column, so it isn't empty).
+    int x0 = std::max(0, static_cast<int>(floorf(-pan.x / img_w * frame_w)));
+    const int y0 = std::max(0, static_cast<int>(floorf(-pan.y / img_h * frame_h)));
+    const int x1 = std::min(frame_w, static_cast<int>(ceilf((view.x - pan.x) / img_w * frame_w)));
+    const int y1 = std::min(frame_h, static_cast<int>(ceilf((view.y - pan.y) / img_h * frame_h)));
+    if (state.compare_active) {
+        x0 = std::min(std::max(x0, static_cast<int>(floorf(state.compare_split * frame_w))), x1 - 1);
+    }
+    if (visible) {
+        visible->downsample = downsample;
+        visible->x = x0;
+        visible->y = y0;
+        visible->width = x1 - x0;
+        visible->height = y1 - y0;
+    }
+    return grow_region(downsample, x0, y0, x1, y1, frame_w, frame_h);
+}
+
+RenderRequest MakeRenderRequest(const AppState& state, bool draft) {
+    RenderRequest req;
+    req.params = state.params;
+    req.preview_downsample = state.preview_downsample;
+    ViewportRegion visible;
+    req.region = ComputeViewportRegion(state, &visible);
+    if (!draft && !req.region.is_full_frame()) {
+        // Only render the part of the view the tile cache doesn't have.
+        ViewportRegion missing;
+        if (!state.tile_cache.missing_bounds(HashPixelParams(req.params), visible, missing)) {
+            req.cached = true;
+        } else {
+            const float downscale = LevelDownscale(req.region.downsample);
+            const int frame_w = static_cast<int>(state.input_image.width() / downscale);
+            const int frame_h = static_cast<int>(state.input_image.height() / downscale);
+            // Whole tiles, so that every one of them can be cached afterwards.
+            const int x1 = std::min(frame_w, missing.x + missing.width);
+            const int y1 = std::min(frame_h, missing.y + missing.height);
+            req.region = grow_region(req.region.downsample, missing.x, missing.y, x1, y1, frame_w, frame_h);
+        }
+    }
+    req.want_linear = state.shader_preview != nullptr;
+    req.have_linear_serial = state.preview_linear.serial;
+    if (draft) {
+        req.draft = true;
+        req.params.demosaic_algorithm = "fast";
+        req.params.ca_strength = 0.0f;
+        // A zoomed-in region is already small; only coarsen the full frame.
+        if (req.region.is_full_frame()) {
+            req.region.downsample = std::min(req.region.downsample + state.draft_downsample_step,
+                                             AppState::MAX_DRAFT_DOWNSAMPLE);
+            req.preview_downsample = req.region.downsample;
+        }
+        // Keep the shader preview's snapshot at full quality.
+        req.want_linear = false;
+    }
+    // Full-frame renders that are slow enough to notice (or not timed yet)
+    // show a coarse pass first.
+    req.progressive = !draft && req.region.is_full_frame() &&
+                      req.region.downsample < AppState::COARSE_PASS_DOWNSAMPLE &&
+                      (state.full_render_ms <= 0.0f || state.full_render_ms > AppState::DRAFT_BUDGET_MS);
+    return req;
+}
 
-void RunHalidePipelines(AppState& state) {
-    const ProcessConfig& cfg = state.params;
+RenderRequest MakeCoarsePass(const RenderRequest& req) {
+    RenderRequest coarse = req;
+    coarse.region = ViewportRegion();
+    coarse.region.downsample = AppState::COARSE_PASS_DOWNSAMPLE;
+    coarse.preview_downsample = coarse.region.downsample;
+    coarse.progressive = false;
+    coarse.coarse_pass = true;
+    coarse.want_linear = false;
+    return coarse;
+}
+
+bool RenderFrame(const AppState& state, const RenderRequest& req, RenderResult& out, RenderCache* cache) {
+    Instrumentation::ScopedTimer frame_timer(req.coarse_pass ? "RenderFrame (coarse)" : req.draft ? "RenderFrame (draft)" : "RenderFrame");
+    const ProcessConfig& cfg = req.params;
+    out.generation = req.generation;
+    out.draft = req.draft;
+    out.coarse_pass = req.coarse_pass;
+    out.cancelled = false;
+    // Drafts and coarse passes are stand-ins; don't let them into the tile cache.
+    out.params_hash = req.draft || req.coarse_pass ? 0 : HashPixelParams(cfg);
+    out.render_ms = 0.0f;
+    out.host_ms = 0.0f;
+    out.pipeline_ms = 0.0f;
+    out.heap_peak_bytes = 0;
+    out.linear.serial = 0;
+    out.edit_time = req.edit_time;
+    out.post_time = req.post_time;
+    out.start_time = std::chrono::steady_clock::now();
+    HalideMemory::Tracker::get().begin_run();
+
+    RenderCache local_cache;
+    if (!cache) cache = &local_cache;
+
+    // Shallow (refcounted) handle on the loaded raw, which never changes after
+    // load. It lives in the cache so its device copy does too.
+    if (cache->input.data() != state.input_image.data()) {
+        cache->input = state.input_image;
+        cache->host_inputs_valid = false; // A new raw: its matrices and levels differ too.
+        cache->ca_shifts_valid = false;   // And so does its lens.
+        HalideMemory::Pool::get().trim(); // As do the sizes of its intermediates.
+    }
+    Halide::Runtime::Buffer<uint16_t>& input_image = cache->input;
 
     // --- Common Setup ---
-    int demosaic_id = 3; // default to 'fast'
-    if (cfg.demosaic_algorithm == "ahd") demosaic_id = 0;
-    else if (cfg.demosaic_algorithm == "lmmse") demosaic_id = 1;
-    else if (cfg.demosaic_algorithm == "ri") demosaic_id = 2;
+    int demosaic_id = PipelineUtils::demosaic_algorithm_id(cfg.demosaic_algorithm);
+    if (demosaic_id < 0) demosaic_id = 3; // default to 'fast'
 
     float exposure_multiplier = powf(2.0f, cfg.exposure);
-    float denoise_strength_norm = std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f));
+    const float denoise_strength = std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f));
+    int denoise_id = PipelineUtils::denoise_algorithm_id(cfg.denoise_algorithm);
+    if (denoise_id < 0) denoise_id = 0; // default to 'guided'
 
-    // Generate the tone curve LUT and store it in the state to be passed to the pipeline.
-    state.pipeline_tone_curve_lut = ToneCurveUtils::generate_pipeline_lut(cfg);
-    auto color_grading_lut = HostColor::generate_color_lut(cfg);
-    auto distortion_lut = PipelineUtils::LensCorrection::generate_identity_lut(); // Start with identity
+    // Rebuild only the host-side inputs whose parameters changed since the
+    // last render; the rest keep their buffers (and device copies).
+    const bool have_host_inputs = cache->host_inputs_valid;
+    const ProcessConfig& prev = cache->host_params;
 
+    std::optional<Instrumentation::ScopedTimer> host_timer(std::in_place, "Host Prep");
+    if (!have_host_inputs || !PipelineUtils::tone_lut_inputs_match(prev, cfg)) {
+        update_resident(cache->tone_curve_lut, ToneCurveUtils::generate_pipeline_lut(cfg));
+    }
+    if (!have_host_inputs || !PipelineUtils::color_lut_inputs_match(prev, cfg)) {
+        update_resident(cache->color_grading_lut, PipelineUtils::color_grading_lut_for(cfg));
+        update_resident(cache->rgb_color_lut, HostColor::generate_rgb_color_lut(cache->color_grading_lut));
+    }
+
+    if (!have_host_inputs || !PipelineUtils::distortion_lut_inputs_match(prev, cfg)) {
+        // Memoised, so the fuzzy Lensfun search only runs when the lens or
+        // focal length actually changes.
+        auto distortion_lut = PipelineUtils::LensCorrection::distortion_lut_for(cfg, [&]() -> const lfDatabase* {
 #ifdef USE_LENSFUN
-    bool needs_lensfun = !cfg.camera_make.empty() && !cfg.camera_model.empty() &&
-                         cfg.lens_profile_name != "None" && !cfg.lens_profile_name.empty();
-    bool lensfun_applied = false;
-    if (needs_lensfun && state.lensfun_db) {
-        const lfCamera** cams = lf_db_find_cameras(state.lensfun_db.get(), cfg.camera_make.c_str(), cfg.camera_model.c_str());
-        if (cams && cams[0]) {
-            const lfCamera* cam = cams[0];
-            const lfLens** lenses = lf_db_find_lenses_hd(state.lensfun_db.get(), cam, nullptr, cfg.lens_profile_name.c_str(), 0);
-            if (lenses && lenses[0]) {
-                const lfLens* lens = lenses[0];
-                lfLensCalibDistortion dist_model;
-                if (lens->InterpolateDistortion(cfg.focal_length, dist_model)) {
-                    if (dist_model.Model == LF_DIST_MODEL_POLY3 || dist_model.Model == LF_DIST_MODEL_POLY5 || dist_model.Model == LF_DIST_MODEL_PTLENS) {
-                        distortion_lut = PipelineUtils::LensCorrection::generate_distortion_lut(dist_model);
-                        lensfun_applied = true;
-                    }
-                }
+            return state.lensfun_db.get();
+#else
+            return nullptr;
+#endif
+        });
+        update_resident(cache->distortion_lut, std::move(distortion_lut));
+    }
+    if (!have_host_inputs || !PipelineUtils::vignetting_lut_inputs_match(prev, cfg)) {
+        auto vignetting_lut = PipelineUtils::LensCorrection::vignetting_lut_for(cfg, [&]() -> const lfDatabase* {
+#ifdef USE_LENSFUN
+            return state.lensfun_db.get();
+#else
+            return nullptr;
+#endif
+        });
+        update_resident(cache->vignetting_lut, std::move(vignetting_lut));
+    }
+    if (!have_host_inputs || !PipelineUtils::tca_lut_inputs_match(prev, cfg)) {
+        auto tca_lut = PipelineUtils::LensCorrection::tca_lut_for(cfg, [&]() -> const lfDatabase* {
+#ifdef USE_LENSFUN
+            return state.lensfun_db.get();
+#else
+            return nullptr;
+#endif
+        });
+        update_resident(cache->tca_lut, std::move(tca_lut));
+    }
+
+    // The single interpolated color matrix for this white balance.
+    if (!have_host_inputs || !PipelineUtils::color_matrix_inputs_match(prev, cfg)) {
+        Halide::Runtime::Buffer<float, 2> color_matrix(4, 3);
+        PipelineUtils::color_matrix_for(state.raw_image_data, cfg, color_matrix);
+        update_resident(cache->color_matrix, std::move(color_matrix));
+    }
+    if (!have_host_inputs) {
+        cache->black_level_cfa = PipelineUtils::make_black_level_buffer(state.raw_image_data);
+    }
+    cache->host_params = cfg;
+    cache->host_inputs_valid = true;
+    out.host_ms = host_timer->elapsed_ms();
+    host_timer.reset();
+
+    auto wb_gains = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    Halide::Runtime::Buffer<float, 2>& color_matrix = cache->color_matrix;
+    Halide::Runtime::Buffer<int, 2>& black_level_cfa = cache->black_level_cfa;
+
+    // CA correction's shift field is estimated once per raw, by the first
+    // render with CA correction on, at that render's white balance. Until
+    // then the front end is given a zero tile it never reads.
+    // A TCA profile corrects the CA instead, so then nothing is estimated.
+    const float ca_strength = PipelineUtils::LensCorrection::ca_estimate_strength(cfg, cache->tca_lut);
+    if (!cache->ca_shifts.data()) cache->ca_shifts = PipelineUtils::make_ca_shifts_buffer();
+    if (ca_strength > 0.0f && !cache->ca_shifts_valid) {
+        Halide::Runtime::Buffer<float, 4> ca_shifts =
+            PipelineUtils::make_ca_shifts_buffer(input_image.width(), input_image.height());
+        Instrumentation::ScopedTimer ca_timer("camera_pipe_ca_shifts");
+        int result = camera_pipe_ca_shifts(input_image, state.cfa_pattern, cfg.green_balance,
+                                           wb_gains.r, wb_gains.g, wb_gains.b,
+                                           state.whiteLevel, black_level_cfa, ca_shifts);
+        out.pipeline_ms += ca_timer.elapsed_ms();
+        if (result != 0) {
+            out.cancelled = result == RENDER_CANCELLED;
+            if (result != RENDER_CANCELLED) {
+                std::cerr << "CA shift estimate returned an error: " << result << std::endl;
             }
-            if (lenses) lf_free(lenses);
+            return false;
         }
-        if (cams) lf_free(cams);
+        cache->ca_shifts = std::move(ca_shifts);
+        cache->ca_shifts_valid = true;
     }
 
-    // If a lensfun profile was NOT applied, check for manual overrides.
-    if (!lensfun_applied) {
-        const float e = 1e-6f;
-        if (fabsf(cfg.dist_k1) > e || fabsf(cfg.dist_k2) > e || fabsf(cfg.dist_k3) > e) {
-            lfLensCalibDistortion manual_model;
-            manual_model.Model = LF_DIST_MODEL_POLY5; // Treat manual k1/k2 as POLY5
-            manual_model.Terms[0] = cfg.dist_k1;
-            manual_model.Terms[1] = cfg.dist_k2;
-            // Note: k3 is ignored as POLY5 solver only uses k1, k2.
-            distortion_lut = PipelineUtils::LensCorrection::generate_distortion_lut(manual_model);
+    // The front end (raw -> linear RGB) only depends on a few parameters. Its
+    // output is cached per render target and reused while only look
+    // parameters change, so most edits only rerun the back end.
+
+    // The back end counts the histograms of whatever region it renders.
+    Halide::Runtime::Buffer<uint32_t, 2> histogram(256, 4);
+
+    // Brings `fe` up to date for cfg: the front end over the frame rectangle
+    // [x, x + width) x [y, y + height) at `downscale`.
+    auto run_front = [&](FrontEndCache& fe, float downscale, int x, int y, int width, int height) -> int {
+        if (fe.matches(cfg, downscale, x, y, width, height)) return 0;
+        fe.valid = false;
+        if (!fe.linear.data() || fe.linear.width() != width || fe.linear.height() != height) {
+            fe.linear = Halide::Runtime::Buffer<float>(std::vector<int>{width, height, 3});
+        }
+        fe.linear.set_min(x, y, 0);
+        Instrumentation::ScopedTimer front_timer("camera_pipe_front_f32");
+        int result = camera_pipe_front_f32(input_image, state.cfa_pattern, cfg.green_balance, downscale, demosaic_id,
+                                           wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
+                                           exposure_multiplier, denoise_strength, cfg.denoise_eps, denoise_id,
+                                           ca_strength, cache->ca_shifts,
+                                           state.blackLevel, state.whiteLevel, black_level_cfa,
+                                           fe.linear);
+        out.pipeline_ms += front_timer.elapsed_ms();
+        if (result != 0) return result;
+        fe.valid = true;
+        fe.params = cfg;
+        fe.downscale_factor = downscale;
+        fe.draft = req.draft;
+        fe.serial++;
+        return 0;
+    };
+
+    // Dehaze's haze estimate comes from the whole frame, at one size for
+    // every target, so regions, the thumbnail and export bands all agree.
+    if (cfg.dehaze_strength != 0.0f) {
+        const int long_edge = std::max(input_image.width(), input_image.height());
+        const float downscale = std::max(1.0f, static_cast<float>(long_edge) / kDehazeStatsEdge);
+        const int width = static_cast<int>(input_image.width() / downscale);
+        const int height = static_cast<int>(input_image.height() / downscale);
+        int result = run_front(cache->dehaze_stats, downscale, 0, 0, width, height);
+        if (result != 0) {
+            out.cancelled = result == RENDER_CANCELLED;
+            if (result != RENDER_CANCELLED) {
+                std::cerr << "Dehaze estimate front end returned an error: " << result << std::endl;
+            }
+            return false;
         }
     }
-#endif
 
-    // Calculate white balance gains and the single interpolated color matrix.
-    auto wb_gains = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
-    Halide::Runtime::Buffer<float, 2> color_matrix(4, 3);
-    PipelineUtils::get_interpolated_color_matrix(state.raw_image_data, cfg.color_temp, color_matrix);
+    // Renders the region covered by `output` (which may have non-zero mins)
+    // of a frame_width x frame_height frame. The warp map covers the region
+    // plus the sharpen stencil's reach, and the front end the map's source
+    // rectangle plus the pyramid's reach: Halide can't infer either across
+    // the separately compiled pipelines, and the back end clamps to what it's
+    // given. With `history`, earlier front-end outputs are kept and recalled.
+    auto run_split = [&](FrontEndCache& fe, WarpMapCache& warp, FrontEndHistory* history, float downscale,
+                         int frame_width, int frame_height, Halide::Runtime::Buffer<uint8_t>& output) -> int {
+        const int map_x0 = std::max(0, output.dim(0).min() - kSharpenReach);
+        const int map_y0 = std::max(0, output.dim(1).min() - kSharpenReach);
+        const int map_x1 = std::min(frame_width, output.dim(0).max() + 1 + kSharpenReach);
+        const int map_y1 = std::min(frame_height, output.dim(1).max() + 1 + kSharpenReach);
+        const int map_width = map_x1 - map_x0, map_height = map_y1 - map_y0;
+        if (!warp.matches(cfg, frame_width, frame_height, map_x0, map_y0, map_width, map_height)) {
+            warp.valid = false;
+            if (!warp.map.data() || warp.map.width() != map_width || warp.map.height() != map_height) {
+                warp.map = Halide::Runtime::Buffer<float>(std::vector<int>{map_width, map_height, 4});
+            }
+            warp.map.set_min(map_x0, map_y0, 0);
+            Instrumentation::ScopedTimer warp_timer("camera_pipe_warp_map");
+            int result = camera_pipe_warp_map(frame_width, frame_height, cache->distortion_lut, cache->tca_lut,
+                                              cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                              cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                              cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                              cfg.geo_offset_x, cfg.geo_offset_y,
+                                              warp.map);
+            out.pipeline_ms += warp_timer.elapsed_ms();
+            if (result != 0) return result;
+            int row_min = 0, row_max = frame_height - 1, col_min = 0, col_max = frame_width - 1;
+            PipelineUtils::LensCorrection::warp_source_rect(cache->distortion_lut, cache->tca_lut,
+                                                            PipelineUtils::LensCorrection::warp_params(cfg),
+                                                            frame_width, frame_height,
+                                                            map_x0, map_x1, map_y0, map_y1,
+                                                            row_min, row_max, col_min, col_max);
+            warp.source_x0 = col_min;
+            warp.source_y0 = row_min;
+            warp.source_x1 = col_max + 1;
+            warp.source_y1 = row_max + 1;
+            warp.valid = true;
+            warp.params = cfg;
+            warp.frame_width = frame_width;
+            warp.frame_height = frame_height;
+        }
+
+        const int reach = local_laplacian_active(cfg) ? kPyramidReach : 0;
+        const int x = std::max(0, warp.source_x0 - reach);
+        const int y = std::max(0, warp.source_y0 - reach);
+        const int width = std::min(frame_width, warp.source_x1 + reach) - x;
+        const int height = std::min(frame_height, warp.source_y1 + reach) - y;
+        if (history) recall_front_end(fe, *history, cfg, downscale, x, y, width, height, req.draft);
+        int result = run_front(fe, downscale, x, y, width, height);
+        if (result != 0) return result;
+
+        // With dehaze off its estimate is never used; any buffer will do.
+        Halide::Runtime::Buffer<float>& dehaze_stats =
+            cfg.dehaze_strength != 0.0f ? cache->dehaze_stats.linear : fe.linear;
+        Instrumentation::ScopedTimer back_timer("camera_pipe_back_f32");
+        result = camera_pipe_back_f32(fe.linear, frame_width, frame_height, cache->tone_curve_lut,
+                                    cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                                    cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
+                                    cfg.ll_debug_level,
+                                    cache->color_grading_lut, cache->rgb_color_lut,
+                                    cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
+                                    cache->vignetting_lut,
+                                    cfg.dehaze_strength, dehaze_stats,
+                                    cache->distortion_lut, cache->tca_lut,
+                                    cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                    cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                    cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                    cfg.geo_offset_x, cfg.geo_offset_y,
+                                    warp.map,
+                                    output, histogram);
+        if (result == 0) {
+            histogram.copy_to_host();
+            // GPU builds leave the result on the device. `output` is a view onto
+            // the texture upload buffer, so this reads it back straight into it.
+            result = output.copy_to_host();
+        }
+        out.pipeline_ms += back_timer.elapsed_ms();
+        return result;
+    };
 
     // --- Main Preview Pipeline ---
     {
-        float downscale_factor = powf(2.0f, state.preview_downsample);
-        int out_width = static_cast<int>(state.input_image.width() / downscale_factor);
-        int out_height = static_cast<int>(state.input_image.height() / downscale_factor);
-
-        if (!state.main_output_planar.data() || state.main_output_planar.width() != out_width || state.main_output_planar.height() != out_height) {
-            state.main_output_planar = Halide::Runtime::Buffer<uint8_t>(std::vector<int>{out_width, out_height, 3});
-        }
-
-        int result = camera_pipe_f32(state.input_image, state.cfa_pattern, cfg.green_balance, downscale_factor, demosaic_id,
-                                  wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
-                                  exposure_multiplier, cfg.ca_strength,
-                                  denoise_strength_norm, cfg.denoise_eps,
-                                  state.blackLevel, state.whiteLevel, state.pipeline_tone_curve_lut,
-                                  0.f, 0.f, 0.f, /* sharpen */
-                                  cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
-                                  cfg.ll_debug_level,
-                                  color_grading_lut,
-                                  cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
-                                  cfg.dehaze_strength,
-                                  distortion_lut,
-                                  cfg.ca_red_cyan, cfg.ca_blue_yellow,
-                                  cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
-                                  cfg.geo_keystone_v, cfg.geo_keystone_h,
-                                  cfg.geo_offset_x, cfg.geo_offset_y,
-                                  state.main_output_planar);
-
-        if (result != 0) { std::cerr << "Main Halide pipeline returned an error: " << result << std::endl; }
-
-        state.main_output_interleaved.resize(out_width * out_height * 3);
-        // The pipeline's output is planar (x, y, c). We interleave it for OpenGL.
-        for (int y = 0; y < out_height; ++y) {
-            for (int x = 0; x < out_width; ++x) {
-                int inter_idx = (y * out_width + x) * 3;
-                state.main_output_interleaved[inter_idx + 0] = state.main_output_planar(x, y, 0);
-                state.main_output_interleaved[inter_idx + 1] = state.main_output_planar(x, y, 1);
-                state.main_output_interleaved[inter_idx + 2] = state.main_output_planar(x, y, 2);
+        const ViewportRegion& region = req.region;
+        float downscale_factor = LevelDownscale(region.downsample);
+        int frame_width = static_cast<int>(input_image.width() / downscale_factor);
+        int frame_height = static_cast<int>(input_image.height() / downscale_factor);
+
+        int out_x = 0, out_y = 0, out_width = frame_width, out_height = frame_height;
+        if (!region.is_full_frame()) {
+            out_x = region.x;
+            out_y = region.y;
+            out_width = region.width;
+            out_height = region.height;
+        }
+
+        bind_interleaved(out.main_output_interleaved, out.main_output, out_width, out_height);
+        // Only the region is computed; run_split sizes the front end and the
+        // warp map for what the back end reads around it.
+        out.main_output.set_min(out_x, out_y, 0);
+        out.main_region = region;
+
+        FrontEndCache& main_cache = req.coarse_pass ? cache->coarse : cache->main;
+        WarpMapCache& main_warp = req.coarse_pass ? cache->coarse_warp : cache->main_warp;
+        FrontEndHistory* main_history = req.coarse_pass ? nullptr : &cache->main_history;
+        int result = run_split(main_cache, main_warp, main_history, downscale_factor, frame_width, frame_height,
+                               out.main_output);
+
+        if (result != 0) {
+            out.cancelled = result == RENDER_CANCELLED;
+            if (result != RENDER_CANCELLED) {
+                std::cerr << "Main Halide pipeline returned an error: " << result << std::endl;
             }
+            return false;
+        }
+
+        if (req.want_linear && !req.coarse_pass && cache->main.serial != req.have_linear_serial) {
+            snapshot_linear(cache->main, cache->main.params, region, frame_width, frame_height, out.linear);
         }
     }
 
-    // --- Thumbnail Pipeline (for histogram/preview) ---
-    {
+    // --- Thumbnail (for histogram/preview) ---
+    if (!req.main_only) {
         const int thumb_width = 256;
-        float thumb_downscale = static_cast<float>(state.input_image.width()) / thumb_width;
-        int thumb_height = static_cast<int>(state.input_image.height() / thumb_downscale);
-
-        if (!state.thumb_output_planar.data() || state.thumb_output_planar.width() != thumb_width || state.thumb_output_planar.height() != thumb_height) {
-            state.thumb_output_planar = Halide::Runtime::Buffer<uint8_t>(std::vector<int>{thumb_width, thumb_height, 3});
-        }
-
-        int result = camera_pipe_f32(state.input_image, state.cfa_pattern, cfg.green_balance, thumb_downscale, demosaic_id,
-                                  wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
-                                  exposure_multiplier, cfg.ca_strength,
-                                  denoise_strength_norm, cfg.denoise_eps,
-                                  state.blackLevel, state.whiteLevel, state.pipeline_tone_curve_lut,
-                                  0.f, 0.f, 0.f, /* sharpen */
-                                  cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
-                                  cfg.ll_debug_level,
-                                  color_grading_lut,
-                                  cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
-                                  cfg.dehaze_strength,
-                                  distortion_lut,
-                                  cfg.ca_red_cyan, cfg.ca_blue_yellow,
-                                  cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
-                                  cfg.geo_keystone_v, cfg.geo_keystone_h,
-                                  cfg.geo_offset_x, cfg.geo_offset_y,
-                                  state.thumb_output_planar);
-
-        if (result != 0) { std::cerr << "Thumbnail Halide pipeline returned an error: " << result << std::endl; }
-
-        // Interleave the thumbnail for OpenGL texture update.
-        state.thumb_output_interleaved.resize(thumb_width * thumb_height * 3);
-        for (int y = 0; y < thumb_height; ++y) {
-            for (int x = 0; x < thumb_width; ++x) {
-                int inter_idx = (y * thumb_width + x) * 3;
-                state.thumb_output_interleaved[inter_idx + 0] = state.thumb_output_planar(x, y, 0);
-                state.thumb_output_interleaved[inter_idx + 1] = state.thumb_output_planar(x, y, 1);
-                state.thumb_output_interleaved[inter_idx + 2] = state.thumb_output_planar(x, y, 2);
+        float thumb_downscale = static_cast<float>(input_image.width()) / thumb_width;
+        int thumb_height = static_cast<int>(input_image.height() / thumb_downscale);
+
+        bind_interleaved(out.thumb_output_interleaved, out.thumb_output, thumb_width, thumb_height);
+
+        if (req.region.is_full_frame() && out.main_output.width() >= thumb_width) {
+            // The main preview already covers the whole frame; shrinking it
+            // is far cheaper than running the pipeline again.
+            downsample_interleaved(out.main_output, out.thumb_output);
+        } else {
+            // Zoomed in: the main preview only has part of the frame, so the
+            // navigator needs its own render.
+            int result = run_split(cache->thumb, cache->thumb_warp, nullptr, thumb_downscale, thumb_width, thumb_height,
+                                   out.thumb_output);
+
+            if (result != 0) {
+                out.cancelled = result == RENDER_CANCELLED;
+                if (result != RENDER_CANCELLED) {
+                    std::cerr << "Thumbnail Halide pipeline returned an error: " << result << std::endl;
+                }
+                return false;
             }
         }
 
-        // Calculate histograms from the processed thumbnail
+        // The histograms come from the last back-end run: the full-frame
+        // preview, or the thumbnail when zoomed in (it still covers the
+        // whole frame).
         const int hist_size = 256;
-        state.histogram_r.assign(hist_size, 0);
-        state.histogram_g.assign(hist_size, 0);
-        state.histogram_b.assign(hist_size, 0);
-        state.histogram_luma.assign(hist_size, 0);
-
-        for (int y = 0; y < thumb_height; ++y) {
-            for (int x = 0; x < thumb_width; ++x) {
-                uint8_t r = state.thumb_output_planar(x, y, 0);
-                uint8_t g = state.thumb_output_planar(x, y, 1);
-                uint8_t b = state.thumb_output_planar(x, y, 2);
-                uint8_t luma = static_cast<uint8_t>(0.299f * r + 0.587f * g + 0.114f * b);
-                state.histogram_r[r]++;
-                state.histogram_g[g]++;
-                state.histogram_b[b]++;
-                state.histogram_luma[luma]++;
-            }
+        out.histogram_r.resize(hist_size);
+        out.histogram_g.resize(hist_size);
+        out.histogram_b.resize(hist_size);
+        out.histogram_luma.resize(hist_size);
+        for (int i = 0; i < hist_size; ++i) {
+            out.histogram_r[i] = static_cast<float>(histogram(i, 0));
+            out.histogram_g[i] = static_cast<float>(histogram(i, 1));
+            out.histogram_b[i] = static_cast<float>(histogram(i, 2));
+            out.histogram_luma[i] = static_cast<float>(histogram(i, 3));
         }
 
         // Normalize histograms
@@ -198,9 +737,92 @@ void RunHalidePipelines(AppState& state) {
                 for (float& v : hist) v /= max_val;
             }
         };
-        normalize_hist(state.histogram_r);
-        normalize_hist(state.histogram_g);
-        normalize_hist(state.histogram_b);
-        normalize_hist(state.histogram_luma);
+        normalize_hist(out.histogram_r);
+        normalize_hist(out.histogram_g);
+        normalize_hist(out.histogram_b);
+        normalize_hist(out.histogram_luma);
+    }
+
+    out.heap_peak_bytes = HalideMemory::Tracker::get().end_run().peak_bytes;
+    out.render_ms = frame_timer.elapsed_ms();
+    out.finish_time = std::chrono::steady_clock::now();
+    return true;
+}
+
+void ApplyRenderResult(AppState& state, RenderResult& result) {
+    // The frame on screen is kept for undo if this one differs from it.
+    if (result.params_hash != state.main_params_hash || result.main_region != state.main_region) {
+        KeepShownFrame(state);
+    }
+    std::swap(state.main_region, result.main_region);
+    state.main_params_hash = result.params_hash;
+    std::swap(state.main_output, result.main_output);
+    std::swap(state.thumb_output, result.thumb_output);
+    std::swap(state.main_output_interleaved, result.main_output_interleaved);
+    std::swap(state.thumb_output_interleaved, result.thumb_output_interleaved);
+    std::swap(state.histogram_luma, result.histogram_luma);
+    std::swap(state.histogram_r, result.histogram_r);
+    std::swap(state.histogram_g, result.histogram_g);
+    std::swap(state.histogram_b, result.histogram_b);
+    // A coarse pass only stands in for its request's frame.
+    if (!result.coarse_pass) state.render_generation = result.generation;
+    if (result.linear.serial != 0) {
+        std::swap(state.preview_linear, result.linear);
+    }
+
+    // The frame shows an edit: start its latency sample, which the upload
+    // and FinishEditLatency complete. A coarse pass is left out; the sample
+    // is taken when the requested frame lands.
+    if (result.edit_time != std::chrono::steady_clock::time_point() && !result.coarse_pass) {
+        auto ms = [](auto from, auto to) { return std::chrono::duration<float, std::milli>(to - from).count(); };
+        AppState::EditLatency& l = state.shown_latency;
+        l = AppState::EditLatency();
+        l.debounce_ms = ms(result.edit_time, result.post_time);
+        l.queue_ms = ms(result.post_time, result.start_time);
+        l.host_ms = result.host_ms;
+        l.pipeline_ms = result.pipeline_ms;
+        l.other_ms = std::max(0.0f, result.render_ms - result.host_ms - result.pipeline_ms);
+        l.draft = result.draft;
+        state.shown_latency_pending = true;
+        state.shown_edit_time = result.edit_time;
+        state.shown_finish_time = result.finish_time;
+    }
+
+    if (result.render_ms > 0.0f) {
+        // upload_ms is filled in once the frame is uploaded.
+        state.render_timings.push_back({result.host_ms, result.pipeline_ms, 0.0f, result.render_ms,
+                                        result.heap_peak_bytes, result.draft});
+        if (state.render_timings.size() > AppState::kRenderTimingCount) state.render_timings.pop_front();
+    }
+
+    if (result.render_ms > 0.0f && !result.coarse_pass) {
+        float& estimate = result.draft ? state.draft_render_ms : state.full_render_ms;
+        estimate = estimate > 0.0f ? 0.7f * estimate + 0.3f * result.render_ms : result.render_ms;
+        // Coarsen drafts until they fit the budget, and refine them again
+        // when there is plenty of headroom, half an octave at a time. The
+        // estimate restarts at each step since it no longer describes the
+        // new size.
+        if (result.draft) {
+            int& step = state.draft_downsample_step;
+            const int half_octave = kLevelsPerOctave / 2;
+            if (estimate > AppState::DRAFT_BUDGET_MS && state.preview_downsample + step < AppState::MAX_DRAFT_DOWNSAMPLE) {
+                step += half_octave;
+                estimate = 0.0f;
+            } else if (estimate < AppState::DRAFT_BUDGET_MS / 3 && step > half_octave) {
+                step -= half_octave;
+                estimate = 0.0f;
+            }
+        }
+    }
+}
+
+void RunHalidePipelines(AppState& state, bool draft) {
+    static RenderCache cache; // Only ever used from the UI thread.
+    // Applying a result swaps the frame it replaces into it, so this holds
+    // the frame before the shown one, whose buffers the next render reuses.
+    // The state is only touched once a render succeeds.
+    static RenderResult result;
+    if (RenderFrame(state, MakeRenderRequest(state, draft), result, &cache)) {
+        ApplyRenderResult(state, result);
     }
 }
@@ -1,11 +1,268 @@
 #ifndef EDITOR_HALIDE_RUNNER_H
 #define EDITOR_HALIDE_RUNNER_H
 
+#include "process_options.h"
+#include "HalideBuffer.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
 // Forward-declare the AppState struct to avoid circular dependencies and redefinition errors.
 // The full definition will be included in the .cpp file.
 struct AppState;
 
+// Error code a pipeline returns when it was aborted because a newer render
+// superseded it (see RenderWorker). Not reported as an error.
+constexpr int RENDER_CANCELLED = -9999;
+
+// Preview scales go in steps of a quarter octave: at level n the frame is
+// downscaled by 2^(n / kLevelsPerOctave), so level 8 is 1:4. The steps are
+// fine enough that a display-matched preview (DisplayMatchedLevel) has at
+// most 19% more pixels per axis than reach the screen, and coarse enough
+// that resizing the window only changes the buffer sizes now and then.
+constexpr int kLevelsPerOctave = 4;
+inline float LevelDownscale(int level) { return std::exp2(static_cast<float>(level) / kLevelsPerOctave); }
+
+// The part of the frame the main preview covers, in pixels of the frame
+// downscaled by LevelDownscale(downsample). A zero width means the whole
+// frame.
+struct ViewportRegion {
+    int downsample = 2 * kLevelsPerOctave;
+    int x = 0, y = 0, width = 0, height = 0;
+
+    bool is_full_frame() const { return width <= 0 || height <= 0; }
+    bool operator==(const ViewportRegion& o) const {
+        return downsample == o.downsample && x == o.x && y == o.y && width == o.width && height == o.height;
+    }
+    bool operator!=(const ViewportRegion& o) const { return !(*this == o); }
+};
+
+// Rendered regions extend this many frame pixels past the view (or to the
+// frame edge), so small pans reuse the cached front end and tiles. The
+// front end under a region covers everything its back end reads (the
+// geometry warp's source plus the pyramid's reach, see RenderFrame), so the
+// region itself matches the full-frame render.
+constexpr int kViewportMargin = 128;
+
+// A snapshot of everything a render depends on that can change while the
+// editor is running. The load-time data (raw buffer, black/white levels,
+// Lensfun database) is read from AppState, which does not change after load.
+struct RenderRequest {
+    ProcessConfig params;
+    int preview_downsample = 2 * kLevelsPerOctave;
+    // When zoomed in, only the visible part of the frame (plus a margin) is
+    // rendered, at the scale matching the zoom level.
+    ViewportRegion region;
+    uint64_t generation = 0;
+    // Rendered at the interactive tier used while a slider is held (see
+    // MakeRenderRequest).
+    bool draft = false;
+    // Only the main output: no thumbnail or histograms (export bands, see
+    // ExportQueue).
+    bool main_only = false;
+    // Ask the render worker to publish a coarse full-frame pass (see
+    // MakeCoarsePass) before rendering this request.
+    bool progressive = false;
+    // This is that coarse pass: a stand-in, not the requested frame.
+    bool coarse_pass = false;
+    // Everything in view is in the tile cache already; nothing to render.
+    bool cached = false;
+    // Hand back a copy of the main front-end output (for the shader preview)
+    // whenever it differs from the snapshot with this serial.
+    bool want_linear = false;
+    uint64_t have_linear_serial = 0;
+    // When the edit this render shows was made in the panes and when the
+    // request was posted, for the edit latency breakdown. Left at the epoch
+    // for renders no edit asked for (pans, refines after a drag).
+    std::chrono::steady_clock::time_point edit_time;
+    std::chrono::steady_clock::time_point post_time;
+};
+
+// An interleaved RGB copy of the main target's front-end output, which the
+// shader preview redraws from while a slider is dragged.
+struct LinearSnapshot {
+    uint64_t serial = 0;         // 0 if empty.
+    ProcessConfig params;        // The parameters the front end ran with.
+    ViewportRegion region;       // The part of the frame it covers.
+    int x = 0, y = 0, width = 0, height = 0;
+    int frame_width = 0, frame_height = 0;
+    std::vector<float> rgb;
+};
+
+// The products of one render: the preview, its thumbnail and the normalized
+// histograms (counted by the back end at preview resolution). main_output/thumb_output are chunky RGBA views
+// onto the *_interleaved vectors, which are uploaded to OpenGL directly.
+struct RenderResult {
+    uint64_t generation = 0;
+    bool draft = false;
+    bool coarse_pass = false; // A stand-in until the requested frame lands.
+    // RenderFrame returned false because a newer render cancelled it, not
+    // because a pipeline failed.
+    bool cancelled = false;
+    // HashPixelParams of the parameters, or 0 if the frame shouldn't be
+    // kept in the tile cache.
+    uint64_t params_hash = 0;
+    float render_ms = 0.0f; // Wall time of the RenderFrame call.
+    float host_ms = 0.0f;     // Of which rebuilding host-side inputs (LUTs, matrices).
+    float pipeline_ms = 0.0f; // Of which running the Halide pipelines.
+    uint64_t heap_peak_bytes = 0; // Most pipeline heap live at once (halide_memory.h).
+    // The request's edit_time and post_time, and when RenderFrame started
+    // and finished.
+    std::chrono::steady_clock::time_point edit_time;
+    std::chrono::steady_clock::time_point post_time;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point finish_time;
+    // The region main_output_* covers. main_output has matching mins.
+    ViewportRegion main_region;
+    Halide::Runtime::Buffer<uint8_t> main_output;
+    Halide::Runtime::Buffer<uint8_t> thumb_output;
+    std::vector<uint8_t> main_output_interleaved;
+    std::vector<uint8_t> thumb_output_interleaved;
+    std::vector<float> histogram_luma;
+    std::vector<float> histogram_r;
+    std::vector<float> histogram_g;
+    std::vector<float> histogram_b;
+    // Only filled (serial != 0) when the request asked for it and the front
+    // end output changed.
+    LinearSnapshot linear;
+};
+
+// Cached output of the front-end pipeline (raw -> linear RGB) for one render
+// target, together with the parameters it was computed with.
+struct FrontEndCache {
+    bool valid = false;
+    ProcessConfig params;
+    float downscale_factor = 0.0f;
+    Halide::Runtime::Buffer<float> linear;
+    uint64_t serial = 0; // Bumped every time `linear` is recomputed.
+    bool draft = false;  // Computed for a draft request.
+
+    // True if the cached buffer is still valid for these parameters and
+    // covers the region [x, x + width) x [y, y + height). Only the parameters
+    // that feed the front end are compared.
+    bool matches(const ProcessConfig& cfg, float downscale, int x, int y, int width, int height) const;
+};
+
+// Cached output of camera_pipe_warp_map for one render target: the geometry
+// stage's source coordinates for the region the back end renders. Only the
+// geometry, lens and frame size invalidate it, so look edits gather through
+// it instead of recomputing the mapping per pixel.
+struct WarpMapCache {
+    bool valid = false;
+    ProcessConfig params;
+    int frame_width = 0, frame_height = 0;
+    Halide::Runtime::Buffer<float> map;
+    // The frame rectangle [source_x0, source_x1) x [source_y0, source_y1)
+    // the mapping samples (warp_source_rect), so the front end is run over
+    // what the back end actually reads.
+    int source_x0 = 0, source_y0 = 0, source_x1 = 0, source_y1 = 0;
+
+    // True if `map` was built with these parameters for a frame_width x
+    // frame_height frame and covers [x, x + width) x [y, y + height). Only
+    // the parameters that feed the mapping are compared.
+    bool matches(const ProcessConfig& cfg, int frame_width, int frame_height, int x, int y, int width, int height) const;
+};
+
+// Front-end outputs the main target has moved on from, most recently used
+// first, so stepping back through the edit history (EditHistory) picks up an
+// earlier state's front end instead of running it again. Drafts' outputs
+// aren't kept. Bounded by budget_bytes of `linear` buffers.
+struct FrontEndHistory {
+    size_t budget_bytes = size_t(256) << 20;
+    size_t bytes = 0;
+    std::list<FrontEndCache> entries;
+};
+
+struct RenderCache {
+    FrontEndCache main;
+    FrontEndHistory main_history;
+    FrontEndCache thumb;
+    // Used by coarse passes, so they don't evict the main output.
+    FrontEndCache coarse;
+    // The back end's warp map for each of the targets above.
+    WarpMapCache main_warp;
+    WarpMapCache thumb_warp;
+    WarpMapCache coarse_warp;
+    // A small front end of the whole frame, which dehaze takes its haze
+    // estimate from, so every target and region gets the same one.
+    FrontEndCache dehaze_stats;
+
+    // Pipeline inputs that persist across renders. In GPU builds the
+    // pipelines upload a buffer to the device when they first see it and
+    // reuse the device copy afterwards, so the raw is uploaded once and a
+    // LUT only when its contents change (see RenderFrame).
+    Halide::Runtime::Buffer<uint16_t> input;
+    Halide::Runtime::Buffer<uint16_t, 2> tone_curve_lut;
+    Halide::Runtime::Buffer<float, 4> color_grading_lut;
+    Halide::Runtime::Buffer<float, 4> rgb_color_lut;
+    Halide::Runtime::Buffer<float, 1> distortion_lut;
+    Halide::Runtime::Buffer<float, 1> vignetting_lut;
+    Halide::Runtime::Buffer<float, 2> tca_lut;
+    Halide::Runtime::Buffer<float, 2> color_matrix;
+    Halide::Runtime::Buffer<int, 2> black_level_cfa;
+    // CA correction's shift field for `input` (camera_pipe_ca_shifts), kept
+    // until the raw changes.
+    Halide::Runtime::Buffer<float, 4> ca_shifts;
+    bool ca_shifts_valid = false;
+
+    // The parameters the host-built inputs above were last generated from.
+    // RenderFrame only rebuilds an input when a parameter it depends on
+    // differs from these, so e.g. an exposure change rebuilds none of them.
+    bool host_inputs_valid = false;
+    ProcessConfig host_params;
+};
+
+// A hash of the parameters that change the rendered pixels, for keying
+// cached renders.
+uint64_t HashPixelParams(const ProcessConfig& cfg);
+
+// The coarsest level at which a raw_width x raw_height frame, drawn
+// view_width x view_height points large on a display with pixel_scale
+// pixels per point, still has a rendered pixel for every screen pixel.
+// Never below 0 (1:1).
+int DisplayMatchedLevel(int raw_width, int raw_height, float view_width, float view_height, float pixel_scale);
+
+// Picks the main preview region for the current zoom and pan. Returns a
+// full-frame region at the display-matched level unless the view is zoomed in
+// far enough that part of the image is off screen, or the compare view
+// leaves only the part right of its divider to the edit. `visible`, if given, is
+// set to the on-screen part of the frame at the region's level (without the
+// margin).
+ViewportRegion ComputeViewportRegion(const AppState& state, ViewportRegion* visible = nullptr);
+
+// Builds a render request from the current UI state. When zoomed in, the
+// region is trimmed to the part of the view missing from state.tile_cache
+// (and `cached` is set if nothing is). A draft request trades
+// quality for latency: the fast demosaic, no CA correction and, for the full
+// frame, state.draft_downsample_step extra levels of downsampling.
+RenderRequest MakeRenderRequest(const AppState& state, bool draft = false);
+
+// The quick pass shown ahead of a progressive request: the whole frame at
+// level AppState::COARSE_PASS_DOWNSAMPLE, binned straight from the raw.
+RenderRequest MakeCoarsePass(const RenderRequest& req);
+
+// Runs the preview pipeline for `req` into `out`, reusing its buffers where
+// the sizes match. The thumbnail is downsampled from the preview when that
+// covers the whole frame; only zoomed-in views run a separate thumbnail
+// render. Only reads load-time data from `state`, so
+// it is safe to call from a worker thread while the UI keeps editing params.
+// The front-end output is cached in `cache` (if given) and reused when only
+// back-end parameters changed. Returns false if a pipeline failed or was
+// cancelled (out.cancelled tells which).
+bool RenderFrame(const AppState& state, const RenderRequest& req, RenderResult& out,
+                 RenderCache* cache = nullptr);
+
+// Swaps a completed result into the AppState fields the UI draws from. The
+// previous buffers end up in `result` so they can be reused. Also folds the
+// render time into the state's latency estimates.
+void ApplyRenderResult(AppState& state, RenderResult& result);
+
 // Main function to execute the Halide pipelines for preview and thumbnail.
-void RunHalidePipelines(AppState& state);
+// Synchronous convenience wrapper around RenderFrame.
+void RunHalidePipelines(AppState& state, bool draft = false);
 
 #endif // EDITOR_HALIDE_RUNNER_H
@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <set>
 #include <tuple>
+#include <future>
+#include <chrono>
 
 #include "imgui.h"
 #include "imgui_internal.h" // For accessing internal context state
@@ -14,13 +16,20 @@
 #include <SDL_opengl.h>
 #include <SDL_opengl_glext.h> 
 #include "raw_load.h" // Use the unified raw loader
+#include "embedded_preview.h"
 
 #include "process_options.h"
 #include "app_state.h"
 #include "editor_theme.h"
 #include "editor_ui.h"
 #include "halide_runner.h"
+#include "pipeline_utils.h"
+#include "render_worker.h"
+#include "filmstrip.h"
 #include "texture_utils.h"
+#include "shader_preview.h"
+#include "trace_events.h"
+#include "thread_pool.h"
 #include "halide_image_io.h"
 #include "tone_curve_utils.h"
 
@@ -39,6 +48,14 @@ int main(int argc, char** argv) {
         std::cout << "Usage: ./rawr <path_to_image.png> [options...]" << std::endl;
         return 1;
     }
+    app_state.tile_cache.set_budget(static_cast<size_t>(std::max(0, app_state.params.tile_cache_mb)) << 20);
+    app_state.history.set_budget(static_cast<size_t>(std::max(0, app_state.params.history_cache_mb)) << 20);
+    ThreadPool::get().configure_halide(app_state.params.threads, app_state.params.thread_pool,
+                                       ThreadPool::cores_named(app_state.params.affinity));
+    PipelineUtils::set_memoization_cache_size();
+    // With --trace the whole session is recorded, including the raw load.
+    if (!app_state.params.trace_path.empty()) TraceEvents::Recorder::get().start();
+    StartLatencyLog(app_state);
 
     // Initialize curve points from config, or create a default linear curve if none were provided.
     auto ensure_default_curve = [](std::vector<Point>& points){
@@ -51,52 +68,56 @@ int main(int argc, char** argv) {
     ensure_default_curve(app_state.params.curve_points_r);
     ensure_default_curve(app_state.params.curve_points_g);
     ensure_default_curve(app_state.params.curve_points_b);
+    // The compare view's "before" side.
+    app_state.before_params = app_state.params;
 
     // Eagerly allocate the tone curve LUT buffers to prevent crashes.
     // They have a fixed size, so we can do this once at startup.
     app_state.pipeline_tone_curve_lut = Halide::Runtime::Buffer<uint16_t, 2>(65536, 3);
     app_state.ui_tone_curve_lut = Halide::Runtime::Buffer<uint16_t, 2>(65536, 3);
 
+    // --- Load Input Image ---
+    // The raw decodes (and the Lensfun database loads) in the background
+    // while the window comes up showing the raw's embedded preview, so the
+    // first thing on screen doesn't wait for the slowest step.
+    set_raw_decode_threads(app_state.params.decode_threads);
+    // Also the filmstrip's loader, for the rest of the folder.
+    Filmstrip::Loader load_image = [raw_png = app_state.params.raw_png,
+                                    half_size = app_state.params.half_size](const std::string& path) {
+        RawImageData raw = raw_png ? load_raw_png(path) : load_raw(path);
+        return half_size ? bin_raw_half(raw) : raw;
+    };
+    std::future<RawImageData> raw_future = std::async(std::launch::async, load_image, app_state.params.input_path);
+
     // --- Initialize Lensfun Database ---
+    // Nothing reads the Lensfun fields until the raw is in, and the UI
+    // waits for both.
+    std::future<void> lensfun_future = std::async(std::launch::async, [&app_state]() {
 #ifdef USE_LENSFUN
-    app_state.lensfun_db.reset(new lfDatabase());
-    if (app_state.lensfun_db) {
-        app_state.lensfun_db->Load();
-        const lfCamera *const *cameras = app_state.lensfun_db->GetCameras();
-        std::set<std::string> makes;
-        if (cameras) {
-            for (int i = 0; cameras[i]; i++) {
-                makes.insert(cameras[i]->Maker);
+        app_state.lensfun_db.reset(new lfDatabase());
+        if (app_state.lensfun_db) {
+            app_state.lensfun_db->Load();
+            const lfCamera *const *cameras = app_state.lensfun_db->GetCameras();
+            std::set<std::string> makes;
+            if (cameras) {
+                for (int i = 0; cameras[i]; i++) {
+                    makes.insert(cameras[i]->Maker);
+                }
             }
+            app_state.lensfun_camera_makes.assign(makes.begin(), makes.end());
+            std::sort(app_state.lensfun_camera_makes.begin(), app_state.lensfun_camera_makes.end());
+        } else {
+            std::cerr << "Warning: Could not create Lensfun database." << std::endl;
         }
-        app_state.lensfun_camera_makes.assign(makes.begin(), makes.end());
-        std::sort(app_state.lensfun_camera_makes.begin(), app_state.lensfun_camera_makes.end());
-    } else {
-        std::cerr << "Warning: Could not create Lensfun database." << std::endl;
-    }
+#else
+        (void)app_state;
 #endif
+    });
+
+    // Decoded at a reduced scale; it only has to fill the window.
+    Halide::Runtime::Buffer<uint8_t, 3> embedded_preview;
+    if (!app_state.params.raw_png) load_embedded_preview(app_state.params.input_path, 2048, embedded_preview);
 
-    // --- Load Input Image ---
-    try {
-        if (app_state.params.raw_png) {
-             app_state.raw_image_data = load_raw_png(app_state.params.input_path);
-        } else {
-             app_state.raw_image_data = load_raw(app_state.params.input_path);
-        }
-        
-        // Transfer loaded data to the AppState's direct members for the pipeline
-        app_state.input_image = app_state.raw_image_data.bayer_data;
-        app_state.cfa_pattern = app_state.raw_image_data.cfa_pattern;
-        app_state.blackLevel = app_state.raw_image_data.black_level;
-        app_state.whiteLevel = app_state.raw_image_data.white_level;
-
-        std::cout << "Loaded image: " << app_state.params.input_path << " (" 
-                  << app_state.input_image.width() << "x" << app_state.input_image.height() << ")" << std::endl;
-    } catch (const std::runtime_error& e) {
-        std::cerr << "Failed to load input image: " << e.what() << std::endl;
-        return 1;
-    }
-    
     // Setup SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0) {
         printf("Error: %s\n", SDL_GetError());
@@ -164,7 +185,25 @@ int main(int argc, char** argv) {
     // Setup Platform/Renderer backends
     ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
     ImGui_ImplOpenGL3_Init(glsl_version);
-    
+    // GPU preview of slider drags; stays null if the context can't run it.
+    app_state.shader_preview = ShaderPreview::create(glsl_version);
+
+    if (embedded_preview.data()) {
+        const int w = embedded_preview.width(), h = embedded_preview.height();
+        std::vector<uint8_t> rgba(static_cast<size_t>(w) * h * 4);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                uint8_t* p = &rgba[(static_cast<size_t>(y) * w + x) * 4];
+                p[0] = embedded_preview(x, y, 0);
+                p[1] = embedded_preview(x, y, 1);
+                p[2] = embedded_preview(x, y, 2);
+                p[3] = 255;
+            }
+        }
+        UploadTexture(app_state.embedded_preview_texture, w, h, rgba);
+        embedded_preview = Halide::Runtime::Buffer<uint8_t, 3>();
+    }
+
     // Main event-driven loop
     bool done = false;
 
@@ -179,13 +218,44 @@ int main(int argc, char** argv) {
             }
         }
 
+        if (!app_state.raw_loaded &&
+            raw_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+            lensfun_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            lensfun_future.get();
+            try {
+                app_state.raw_image_data = raw_future.get();
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Failed to load input image: " << e.what() << std::endl;
+                return 1;
+            }
+
+            // Transfer loaded data to the AppState's direct members for the pipeline
+            app_state.input_image = app_state.raw_image_data.bayer_data;
+            app_state.cfa_pattern = app_state.raw_image_data.cfa_pattern;
+            app_state.blackLevel = app_state.raw_image_data.black_level;
+            app_state.whiteLevel = app_state.raw_image_data.white_level;
+
+            std::cout << "Loaded image: " << app_state.params.input_path << " ("
+                      << app_state.input_image.width() << "x" << app_state.input_image.height() << ")" << std::endl;
+
+            app_state.filmstrip = std::make_unique<Filmstrip>(app_state.params.input_path, app_state.raw_image_data,
+                                                              load_image, app_state.params.raw_png,
+                                                              app_state.params.filmstrip_radius);
+            app_state.filmstrip_shown = app_state.filmstrip->index();
+
+            // Start the background renderer now that the load-time data is in place.
+            StartRenderWorker(app_state);
+            app_state.raw_loaded = true;
+        }
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
         
         // Render all UI components and handle pipeline execution internally
-        RenderUI(app_state);
+        if (app_state.raw_loaded) RenderUI(app_state);
+        else RenderLoadingUI(app_state);
 
         // Rendering
         ImGui::Render();
@@ -203,12 +273,25 @@ int main(int argc, char** argv) {
         }
 
         SDL_GL_SwapWindow(window);
+        FinishEditLatency(app_state);
         SDL_Delay(1); 
     }
 
     // Cleanup
-    DeleteTexture(app_state.main_texture_id);
-    DeleteTexture(app_state.thumb_texture_id);
+    app_state.render_worker.reset(); // Joins the worker thread.
+    app_state.filmstrip.reset();
+    if (TraceEvents::Recorder::get().active()) {
+        const std::string trace_path = app_state.params.trace_path.empty() ? "rawr_trace.json" : app_state.params.trace_path;
+        if (TraceEvents::Recorder::get().write(trace_path)) std::cerr << "Wrote trace: " << trace_path << std::endl;
+    }
+    DeleteTexture(app_state.main_texture);
+    DeleteTexture(app_state.thumb_texture);
+    DeleteTexture(app_state.embedded_preview_texture);
+    DeleteTexture(app_state.before_texture);
+    app_state.shader_preview.reset();
+    app_state.tile_cache.clear();
+    app_state.history.clear_frames();
+    PipelineUtils::flush_memoization_cache();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
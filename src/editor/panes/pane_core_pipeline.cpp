@@ -7,7 +7,7 @@ namespace Panes {
 bool render_core_pipeline(AppState& state) {
     bool changed = false;
 
-    const char* demosaic_items[] = { "fast", "ahd", "lmmse", "ri" };
+    const char* demosaic_items[] = { "fast", "ahd", "lmmse", "ri", "adaptive" };
     int current_item_idx = 0;
     for (int n = 0; n < IM_ARRAYSIZE(demosaic_items); n++) {
         if (state.params.demosaic_algorithm == demosaic_items[n]) {
@@ -162,6 +162,14 @@ bool render_lens_correction(AppState& state) {
             if (ImGui::SliderFloat("Focal Length", &params.focal_length, 1.0f, 600.0f, "%.1f mm", ImGuiSliderFlags_Logarithmic)) {
                 changed = true;
             }
+            // The profile's vignetting is corrected at this aperture; 0 is off.
+            if (ImGui::SliderFloat("Aperture", &params.aperture, 0.0f, 32.0f, params.aperture > 0.0f ? "f/%.1f" : "Off")) {
+                changed = true;
+            }
+            // Lateral CA from the profile's TCA calibration; replaces CA Correction's estimate.
+            if (ImGui::Checkbox("Profile CA", &params.lens_tca)) {
+                changed = true;
+            }
 
             // -- Apply Button and Feedback --
             if (ImGui::Button("Apply Profile", ImVec2(-1, 0))) {
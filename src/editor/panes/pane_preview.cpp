@@ -17,7 +17,9 @@ bool render_preview(AppState& state) {
             float thumb_height = available_width / aspect;
             state.thumb_view_size = ImVec2(available_width, thumb_height);
 
-            ImGui::Image((void*)(intptr_t)state.thumb_texture_id, state.thumb_view_size, ImVec2(0, 1), ImVec2(1, 0));
+            const float pixel_scale = ImGui::GetIO().DisplayFramebufferScale.x;
+            PrepareTextureForDraw(state.thumb_texture, available_width * pixel_scale < state.thumb_texture.width);
+            ImGui::Image((void*)(intptr_t)state.thumb_texture.id, state.thumb_view_size, ImVec2(0, 1), ImVec2(1, 0));
 
             ImVec2 thumb_pos = ImGui::GetItemRectMin();
             ImVec2 thumb_max = ImGui::GetItemRectMax();
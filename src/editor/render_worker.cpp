@@ -0,0 +1,176 @@
+#include "editor/render_worker.h"
+#include "editor/app_state.h"
+
+#include "halide_memory.h"
+#include "HalideRuntime.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+namespace {
+
+// Generation of the newest posted request, and of the render currently
+// running on the worker (0 when idle). The Halide runtime hooks are global,
+// so this state is too; the editor only ever runs one worker.
+std::atomic<uint64_t> g_latest_generation{0};
+std::atomic<uint64_t> g_active_generation{0};
+// The idle task's state: none, running, or cancelled by post().
+enum IdleState : int { kIdleNone, kIdleRunning, kIdleCancelled };
+std::atomic<int> g_idle_state{kIdleNone};
+
+// Runs before every parallel task (one strip of a parallel loop). Once a newer
+// request has been posted the remaining strips are skipped and the pipeline
+// returns RENDER_CANCELLED.
+int cancellable_do_task(void* user_context, halide_task_t f, int idx, uint8_t* closure) {
+    uint64_t active = g_active_generation.load(std::memory_order_relaxed);
+    if (active != 0 && active < g_latest_generation.load(std::memory_order_relaxed)) {
+        return RENDER_CANCELLED;
+    }
+    if (g_idle_state.load(std::memory_order_relaxed) == kIdleCancelled) {
+        return RENDER_CANCELLED;
+    }
+    return halide_default_do_task(user_context, f, idx, closure);
+}
+
+} // namespace
+
+RenderWorker::RenderWorker(const AppState& state) : state_(state) {
+    halide_set_custom_do_task(cancellable_do_task);
+    // Every render reports its pipeline heap peak (the F7 overlay), and
+    // reuses the intermediates of the last one.
+    HalideMemory::Tracker::install();
+    HalideMemory::Pool::get().set_enabled(true);
+    cache_.main_history.budget_bytes = static_cast<size_t>(std::max(0, state.params.history_cache_mb)) << 20;
+    thread_ = std::thread(&RenderWorker::run, this);
+}
+
+RenderWorker::~RenderWorker() {
+    stop();
+}
+
+void RenderWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (quit_) return;
+        quit_ = true;
+        // Abort whatever is in flight so shutdown doesn't wait on a full render.
+        g_latest_generation.store(UINT64_MAX);
+        int running = kIdleRunning;
+        g_idle_state.compare_exchange_strong(running, kIdleCancelled);
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    halide_set_custom_do_task(halide_default_do_task);
+    HalideMemory::Tracker::uninstall();
+    HalideMemory::Pool::get().set_enabled(false);
+    HalideMemory::Pool::get().trim();
+}
+
+uint64_t RenderWorker::post(RenderRequest req) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation = next_generation_++;
+        req.generation = generation;
+        pending_ = std::move(req);
+        has_pending_ = true;
+        g_latest_generation.store(generation);
+        int running = kIdleRunning;
+        g_idle_state.compare_exchange_strong(running, kIdleCancelled);
+    }
+    cv_.notify_one();
+    return generation;
+}
+
+bool RenderWorker::poll(AppState& state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_ready_) return false;
+    ApplyRenderResult(state, ready_);
+    has_ready_ = false;
+    return true;
+}
+
+void RenderWorker::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    has_pending_ = false;
+    has_ready_ = false;
+    // A generation no request has, so the active render sees it as stale.
+    first_wanted_generation_ = next_generation_++;
+    g_latest_generation.store(first_wanted_generation_);
+}
+
+bool RenderWorker::busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_pending_ || rendering_;
+}
+
+void RenderWorker::set_idle_task(std::function<bool()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_task_ = std::move(task);
+        idle_pending_ = static_cast<bool>(idle_task_);
+    }
+    cv_.notify_one();
+}
+
+void RenderWorker::kick_idle() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_pending_ = static_cast<bool>(idle_task_);
+    }
+    cv_.notify_one();
+}
+
+void RenderWorker::run() {
+    while (true) {
+        RenderRequest req;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return quit_ || has_pending_ || idle_pending_; });
+            if (quit_) return;
+            if (!has_pending_) {
+                std::function<bool()> task = idle_task_;
+                idle_pending_ = false;
+                g_idle_state.store(kIdleRunning);
+                lock.unlock();
+                const bool more = task();
+                lock.lock();
+                g_idle_state.store(kIdleNone);
+                // Cancelled or done; a posted request is picked up next.
+                if (more && !has_pending_) idle_pending_ = true;
+                continue;
+            }
+            req = std::move(pending_);
+            has_pending_ = false;
+            rendering_ = true;
+        }
+
+        g_active_generation.store(req.generation);
+        if (req.progressive && RenderFrame(state_, MakeCoarsePass(req), back_, &cache_)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (req.generation >= first_wanted_generation_) {
+                std::swap(back_, ready_);
+                has_ready_ = true;
+            }
+            if (has_pending_) {
+                // Already superseded: don't start the full pass.
+                rendering_ = false;
+                g_active_generation.store(0);
+                continue;
+            }
+        }
+        bool ok = RenderFrame(state_, req, back_, &cache_);
+        g_active_generation.store(0);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        rendering_ = false;
+        if (idle_task_) idle_pending_ = true;
+        // Only publish complete frames; a cancelled render leaves the
+        // previous frame on screen until its replacement finishes.
+        if (ok && req.generation >= first_wanted_generation_) {
+            std::swap(back_, ready_);
+            has_ready_ = true;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef EDITOR_RENDER_WORKER_H
+#define EDITOR_RENDER_WORKER_H
+
+#include "editor/halide_runner.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct AppState;
+
+// Runs the editor's Halide pipelines on a background thread so the UI never
+// blocks on a render.
+//
+// - The UI thread posts RenderRequest snapshots. Only the newest pending
+//   request is kept (latest wins); posting also cancels the render that is
+//   currently in flight.
+// - Cancellation is checked by a custom Halide do_task handler between
+//   parallel tasks (strips), so an obsolete render aborts within one strip.
+// - Completed frames are handed back through a double-buffered slot. poll()
+//   swaps the newest finished frame into the AppState fields the UI draws
+//   from, and the old buffers are recycled by the worker.
+// - Progressive requests are rendered twice: a coarse full-frame pass is
+//   published first and the requested frame replaces it. A newer request
+//   skips whichever pass hasn't finished.
+// - With nothing to render, the worker runs an optional idle task (e.g.
+//   the filmstrip's ahead-of-time previews). Posting a request cancels the
+//   pipeline the idle task is running, like a superseded render.
+class RenderWorker {
+public:
+    explicit RenderWorker(const AppState& state);
+    ~RenderWorker();
+
+    RenderWorker(const RenderWorker&) = delete;
+    RenderWorker& operator=(const RenderWorker&) = delete;
+
+    // Queue a render. Supersedes any pending request and cancels the active one.
+    // Returns the generation assigned to it; AppState::render_generation
+    // reaches it once the frame has been swapped in.
+    uint64_t post(RenderRequest req);
+
+    // If a frame finished since the last call, swap it into `state` and return true.
+    bool poll(AppState& state);
+
+    // Drops the pending request and cancels the active one, whose frame
+    // poll() won't hand out. For when the frame on screen was replaced
+    // without rendering (RestoreKeptFrame).
+    void cancel();
+
+    // True while a request is pending or being rendered.
+    bool busy() const;
+
+    // Sets the idle task. It is called on the worker thread while no
+    // request is pending, again after every render and whenever kick_idle()
+    // is called, and repeatedly for as long as it returns true.
+    void set_idle_task(std::function<bool()> task);
+    void kick_idle();
+
+    // Stop the worker thread. Called by the destructor.
+    void stop();
+
+private:
+    void run();
+
+    const AppState& state_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool quit_ = false;
+
+    bool has_pending_ = false;
+    RenderRequest pending_;
+    bool rendering_ = false;
+
+    std::function<bool()> idle_task_;
+    bool idle_pending_ = false;
+
+    // back_ is only touched by the worker thread; ready_ is guarded by mutex_.
+    RenderResult back_;
+    RenderResult ready_;
+    bool has_ready_ = false;
+    // Frames of requests older than this were cancelled; guarded by mutex_.
+    uint64_t first_wanted_generation_ = 0;
+
+    // Front-end outputs, only touched by the worker thread.
+    RenderCache cache_;
+
+    uint64_t next_generation_ = 1;
+};
+
+#endif // EDITOR_RENDER_WORKER_H
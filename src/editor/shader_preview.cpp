@@ -0,0 +1,377 @@
+#include "editor/shader_preview.h"
+#include "editor/gl_functions.h"
+
+#include "color_tools.h"
+#include "pipeline_utils.h"
+#include "tone_curve_utils.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A triangle covering the whole target, generated from gl_VertexID so no
+// vertex buffer is needed.
+const char* kVertexShader = R"(
+void main() {
+    vec2 p = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+    gl_Position = vec4(p, 0.0, 1.0);
+}
+)";
+
+// Mirrors the back end's point-wise stages (HalideColor, ColorGradeBuilder,
+// VignetteBuilder and pipeline_apply_curve) for one pixel. Keep in sync.
+const char* kFragmentShader = R"(
+uniform sampler2D linear_tex;    // Front-end output, RGB.
+uniform sampler2D tone_lut_tex;  // 256x256 RGB16: tone curve entry i is texel (i & 255, i >> 8).
+uniform sampler3D color_lut_tex; // (L, C, h) grid of output LCh.
+uniform int color_lut_size;
+uniform float exposure_scale;    // Exposure relative to the front-end output's.
+uniform vec4 vignette;           // amount, midpoint, roundness, highlights, as fractions.
+uniform vec2 region_origin;      // Frame position of texel (0, 0).
+uniform vec2 frame_size;
+out vec4 frag_color;
+
+const float PI = 3.14159265358979;
+
+float lab_f(float t) {
+    return t > 0.008856451679035631 ? pow(t, 1.0 / 3.0) : 7.787037037037037 * t + 16.0 / 116.0;
+}
+
+float lab_f_inv(float t) {
+    const float delta = 6.0 / 29.0;
+    return t > delta ? t * t * t : 3.0 * delta * delta * (t - 16.0 / 116.0);
+}
+
+vec3 linear_srgb_to_lch(vec3 c) {
+    float X = dot(vec3(0.4124564, 0.3575761, 0.1804375), c);
+    float Y = dot(vec3(0.2126729, 0.7151522, 0.0721750), c);
+    float Z = dot(vec3(0.0193339, 0.1191920, 0.9503041), c);
+    float fX = lab_f(X / 0.95047), fY = lab_f(Y), fZ = lab_f(Z / 1.08883);
+    float L = 116.0 * fY - 16.0, a = 500.0 * (fX - fY), b = 200.0 * (fY - fZ);
+    float C = sqrt(a * a + b * b);
+    return vec3(L, C, C > 1e-5 ? atan(b, a) : 0.0);
+}
+
+vec3 lch_to_linear_srgb(vec3 lch) {
+    float a = lch.y * cos(lch.z), b = lch.y * sin(lch.z);
+    float fY = (lch.x + 16.0) / 116.0, fX = a / 500.0 + fY, fZ = fY - b / 200.0;
+    float X = lab_f_inv(fX) * 0.95047, Y = lab_f_inv(fY), Z = lab_f_inv(fZ) * 1.08883;
+    return vec3( 3.2404542 * X - 1.5371385 * Y - 0.4985314 * Z,
+                -0.9692660 * X + 1.8760108 * Y + 0.0415560 * Z,
+                 0.0556434 * X - 0.2040259 * Y + 1.0572252 * Z);
+}
+
+vec3 color_lut(ivec3 i) {
+    return texelFetch(color_lut_tex, clamp(i, ivec3(0), ivec3(color_lut_size - 1)), 0).rgb;
+}
+
+// Trilinear lookup with clamped edges, as in ColorGradeBuilder.
+vec3 color_grade(vec3 lch) {
+    vec3 n = clamp(vec3(lch.x / 100.0, lch.y / 150.0, (lch.z + PI) / (2.0 * PI)), 0.0, 1.0);
+    vec3 f = n * float(color_lut_size - 1);
+    ivec3 i = ivec3(floor(f));
+    vec3 d = f - vec3(i);
+    vec3 c00 = mix(color_lut(i),                 color_lut(i + ivec3(1, 0, 0)), d.x);
+    vec3 c01 = mix(color_lut(i + ivec3(0, 0, 1)), color_lut(i + ivec3(1, 0, 1)), d.x);
+    vec3 c10 = mix(color_lut(i + ivec3(0, 1, 0)), color_lut(i + ivec3(1, 1, 0)), d.x);
+    vec3 c11 = mix(color_lut(i + ivec3(0, 1, 1)), color_lut(i + ivec3(1, 1, 1)), d.x);
+    return mix(mix(c00, c10, d.y), mix(c01, c11, d.y), d.z);
+}
+
+vec3 apply_vignette(vec3 rgb, vec2 pos) {
+    float amount = vignette.x;
+    vec2 center = (frame_size - 1.0) * 0.5;
+    vec2 scale = mix(vec2(min(center.x, center.y)), center, vignette.z);
+    vec2 n = (pos - center) / (scale + 1e-6);
+    float r = sqrt(max(0.0, dot(n, n)));
+    float factor = 1.0 - amount * pow(r, 0.25 * pow(32.0, vignette.y));
+    float luma = dot(vec3(0.299, 0.587, 0.114), rgb);
+    float protection = mix(factor, 1.0, smoothstep(0.75, 1.0, luma) * vignette.w);
+    return rgb * (amount < 0.0 ? protection : factor);
+}
+
+float tone_curve(float v, int channel) {
+    int i = int(clamp(v, 0.0, 1.0) * 65535.0);
+    return texelFetch(tone_lut_tex, ivec2(i & 255, i >> 8), 0)[channel];
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec3 rgb = texelFetch(linear_tex, p, 0).rgb * exposure_scale;
+    rgb = lch_to_linear_srgb(color_grade(linear_srgb_to_lch(rgb)));
+    rgb = apply_vignette(rgb, region_origin + vec2(p));
+    frag_color = vec4(tone_curve(rgb.r, 0), tone_curve(rgb.g, 1), tone_curve(rgb.b, 2), 1.0);
+}
+)";
+
+GLuint compile(GLenum type, const char* glsl_version, const char* body) {
+    const GLFunctions& f = gl();
+    std::string source = std::string(glsl_version) + "\n" + body;
+    const char* text = source.c_str();
+    GLuint shader = f.CreateShader(type);
+    f.ShaderSource(shader, 1, &text, nullptr);
+    f.CompileShader(shader);
+    GLint ok = GL_FALSE;
+    f.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[2048] = {};
+        f.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Warning: shader preview disabled, shader failed to compile:\n" << log << std::endl;
+        f.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+void set_nearest(GLenum target) {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+} // namespace
+
+std::unique_ptr<ShaderPreview> ShaderPreview::create(const char* glsl_version) {
+    const GLFunctions& f = gl();
+    if (!f.has_shaders() || !f.has_framebuffers()) {
+        std::cerr << "Warning: shader preview disabled, the GL context lacks shader or framebuffer support." << std::endl;
+        return nullptr;
+    }
+
+    GLuint vs = compile(GL_VERTEX_SHADER, glsl_version, kVertexShader);
+    GLuint fs = vs ? compile(GL_FRAGMENT_SHADER, glsl_version, kFragmentShader) : 0;
+    if (!fs) {
+        if (vs) f.DeleteShader(vs);
+        return nullptr;
+    }
+    GLuint program = f.CreateProgram();
+    f.AttachShader(program, vs);
+    f.AttachShader(program, fs);
+    f.LinkProgram(program);
+    f.DeleteShader(vs);
+    f.DeleteShader(fs);
+    GLint ok = GL_FALSE;
+    f.GetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[2048] = {};
+        f.GetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Warning: shader preview disabled, shader failed to link:\n" << log << std::endl;
+        f.DeleteProgram(program);
+        return nullptr;
+    }
+
+    std::unique_ptr<ShaderPreview> preview(new ShaderPreview());
+    preview->program_ = program;
+    preview->u_exposure_scale_ = f.GetUniformLocation(program, "exposure_scale");
+    preview->u_vignette_ = f.GetUniformLocation(program, "vignette");
+    preview->u_region_origin_ = f.GetUniformLocation(program, "region_origin");
+    preview->u_frame_size_ = f.GetUniformLocation(program, "frame_size");
+    preview->u_color_lut_size_ = f.GetUniformLocation(program, "color_lut_size");
+
+    GLint prev_program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
+    f.UseProgram(program);
+    f.Uniform1i(f.GetUniformLocation(program, "linear_tex"), 0);
+    f.Uniform1i(f.GetUniformLocation(program, "tone_lut_tex"), 1);
+    f.Uniform1i(f.GetUniformLocation(program, "color_lut_tex"), 2);
+    f.UseProgram(prev_program);
+
+    f.GenVertexArrays(1, &preview->vertex_array_);
+    return preview;
+}
+
+ShaderPreview::~ShaderPreview() {
+    const GLFunctions& f = gl();
+    GLuint textures[] = {output_texture_, linear_texture_, tone_lut_texture_, color_lut_texture_};
+    for (GLuint t : textures) {
+        if (t) glDeleteTextures(1, &t);
+    }
+    if (framebuffer_) f.DeleteFramebuffers(1, &framebuffer_);
+    if (vertex_array_) f.DeleteVertexArrays(1, &vertex_array_);
+    if (program_) f.DeleteProgram(program_);
+}
+
+bool ShaderPreview::can_preview(const ProcessConfig& cfg, const ProcessConfig& linear_params) {
+    const float e = 1e-6f;
+    // The front end's other parameters are baked into the cached output.
+    bool same_front_end = cfg.demosaic_algorithm == linear_params.demosaic_algorithm &&
+                          cfg.color_temp == linear_params.color_temp &&
+                          cfg.input_profile == linear_params.input_profile &&
+                          cfg.tint == linear_params.tint &&
+                          cfg.green_balance == linear_params.green_balance &&
+                          cfg.ca_strength == linear_params.ca_strength &&
+                          cfg.denoise_strength == linear_params.denoise_strength &&
+                          cfg.denoise_eps == linear_params.denoise_eps &&
+                          cfg.denoise_algorithm == linear_params.denoise_algorithm;
+    // Stages the shader leaves out.
+    bool no_dehaze = fabsf(cfg.dehaze_strength) < e;
+    bool no_sharpen = cfg.sharpen_strength == 0.0f;
+    bool no_local_laplacian = fabsf(cfg.ll_detail) < e && fabsf(cfg.ll_clarity) < e &&
+                              fabsf(cfg.ll_shadows) < e && fabsf(cfg.ll_highlights) < e &&
+                              fabsf(cfg.ll_blacks) < e && fabsf(cfg.ll_whites) < e &&
+                              cfg.ll_debug_level < 0;
+    bool no_geometry = fabsf(cfg.geo_rotate) < e && fabsf(cfg.geo_scale - 100.f) < e &&
+                       fabsf(cfg.geo_aspect - 1.f) < e && fabsf(cfg.geo_keystone_v) < e &&
+                       fabsf(cfg.geo_keystone_h) < e && fabsf(cfg.geo_offset_x) < e &&
+                       fabsf(cfg.geo_offset_y) < e &&
+                       fabsf(cfg.ca_red_cyan) < e && fabsf(cfg.ca_blue_yellow) < e;
+    bool no_distortion = (cfg.lens_profile_name.empty() || cfg.lens_profile_name == "None") &&
+                         fabsf(cfg.dist_k1) < e && fabsf(cfg.dist_k2) < e && fabsf(cfg.dist_k3) < e;
+    return same_front_end && no_dehaze && no_sharpen && no_local_laplacian && no_geometry && no_distortion;
+}
+
+bool ShaderPreview::ensure_target(int width, int height) {
+    const GLFunctions& f = gl();
+    if (output_texture_ && width == output_width_ && height == output_height_) return true;
+
+    if (!output_texture_) glGenTextures(1, &output_texture_);
+    glBindTexture(GL_TEXTURE_2D, output_texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint prev_framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_framebuffer);
+    if (!framebuffer_) f.GenFramebuffers(1, &framebuffer_);
+    f.BindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    f.FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output_texture_, 0);
+    bool complete = f.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    f.BindFramebuffer(GL_FRAMEBUFFER, prev_framebuffer);
+
+    output_width_ = complete ? width : 0;
+    output_height_ = complete ? height : 0;
+    output_valid_ = false;
+    return complete;
+}
+
+void ShaderPreview::update_luts(const ProcessConfig& cfg) {
+    const GLFunctions& f = gl();
+    const bool tone_stale = !luts_valid_ || !PipelineUtils::tone_lut_inputs_match(lut_params_, cfg);
+    const bool color_stale = !luts_valid_ || !PipelineUtils::color_lut_inputs_match(lut_params_, cfg);
+
+    if (tone_stale) {
+        // The shader indexes the table linearly, so it always takes the full one.
+        auto lut = ToneCurveUtils::generate_pipeline_lut(cfg, ToneCurveUtils::kFullToneCurveSize);
+        std::vector<uint16_t> texels(static_cast<size_t>(lut.width()) * 3);
+        for (int i = 0; i < lut.width(); ++i) {
+            for (int ch = 0; ch < 3; ++ch) texels[3 * i + ch] = lut(i, ch);
+        }
+        if (!tone_lut_texture_) glGenTextures(1, &tone_lut_texture_);
+        glBindTexture(GL_TEXTURE_2D, tone_lut_texture_);
+        set_nearest(GL_TEXTURE_2D);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, 256, lut.width() / 256, 0, GL_RGB, GL_UNSIGNED_SHORT, texels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    if (color_stale) {
+        auto lut = PipelineUtils::color_grading_lut_for(cfg);
+        const int n = lut.dim(0).extent();
+        std::vector<float> texels(static_cast<size_t>(n) * n * n * 3);
+        size_t i = 0;
+        for (int h = 0; h < n; ++h) {
+            for (int c = 0; c < n; ++c) {
+                for (int l = 0; l < n; ++l) {
+                    for (int ch = 0; ch < 3; ++ch) texels[i++] = lut(l, c, h, ch);
+                }
+            }
+        }
+        if (!color_lut_texture_) glGenTextures(1, &color_lut_texture_);
+        glBindTexture(GL_TEXTURE_3D, color_lut_texture_);
+        set_nearest(GL_TEXTURE_3D);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        f.TexImage3D(GL_TEXTURE_3D, 0, GL_RGB32F, n, n, n, 0, GL_RGB, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        color_lut_size_ = n;
+    }
+
+    if (tone_stale || color_stale) {
+        lut_params_ = cfg;
+        luts_valid_ = true;
+        output_valid_ = false;
+    }
+}
+
+uint32_t ShaderPreview::render(const ProcessConfig& cfg, const LinearSnapshot& linear) {
+    const GLFunctions& f = gl();
+    if (linear.serial == 0 || linear.width <= 0 || linear.height <= 0) return 0;
+    if (!ensure_target(linear.width, linear.height)) return 0;
+
+    if (linear.serial != linear_serial_) {
+        if (!linear_texture_) glGenTextures(1, &linear_texture_);
+        glBindTexture(GL_TEXTURE_2D, linear_texture_);
+        set_nearest(GL_TEXTURE_2D);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, linear.width, linear.height, 0, GL_RGB, GL_FLOAT, linear.rgb.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        linear_serial_ = linear.serial;
+    }
+    update_luts(cfg);
+
+    const float exposure_scale = exp2f(cfg.exposure - linear.params.exposure);
+    const float vignette[4] = {cfg.vignette_amount * 0.01f, cfg.vignette_midpoint * 0.01f,
+                               cfg.vignette_roundness * 0.01f, cfg.vignette_highlights * 0.01f};
+    if (output_valid_ && rendered_serial_ == linear_serial_ && exposure_scale == exposure_scale_ &&
+        memcmp(vignette, vignette_, sizeof(vignette)) == 0) {
+        return output_texture_;
+    }
+
+    // Runs between ImGui frames, so leave the state the way it was found.
+    GLint prev_framebuffer = 0, prev_program = 0, prev_vertex_array = 0, prev_active_texture = 0;
+    GLint prev_viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_framebuffer);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vertex_array);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    const GLenum caps[] = {GL_BLEND, GL_SCISSOR_TEST, GL_DEPTH_TEST, GL_CULL_FACE};
+    GLboolean prev_caps[4];
+    for (int i = 0; i < 4; ++i) {
+        prev_caps[i] = glIsEnabled(caps[i]);
+        glDisable(caps[i]);
+    }
+
+    f.BindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glViewport(0, 0, output_width_, output_height_);
+    f.UseProgram(program_);
+    f.Uniform1f(u_exposure_scale_, exposure_scale);
+    f.Uniform4f(u_vignette_, vignette[0], vignette[1], vignette[2], vignette[3]);
+    f.Uniform2f(u_region_origin_, static_cast<float>(linear.x), static_cast<float>(linear.y));
+    f.Uniform2f(u_frame_size_, static_cast<float>(linear.frame_width), static_cast<float>(linear.frame_height));
+    f.Uniform1i(u_color_lut_size_, color_lut_size_);
+    f.ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, linear_texture_);
+    f.ActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, tone_lut_texture_);
+    f.ActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, color_lut_texture_);
+    f.BindVertexArray(vertex_array_);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+    f.ActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    f.ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    f.ActiveTexture(prev_active_texture);
+    f.BindVertexArray(prev_vertex_array);
+    f.UseProgram(prev_program);
+    f.BindFramebuffer(GL_FRAMEBUFFER, prev_framebuffer);
+    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+    for (int i = 0; i < 4; ++i) {
+        if (prev_caps[i]) glEnable(caps[i]);
+    }
+
+    output_valid_ = true;
+    rendered_serial_ = linear_serial_;
+    exposure_scale_ = exposure_scale;
+    memcpy(vignette_, vignette, sizeof(vignette));
+    return output_texture_;
+}
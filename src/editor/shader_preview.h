@@ -0,0 +1,75 @@
+#ifndef EDITOR_SHADER_PREVIEW_H
+#define EDITOR_SHADER_PREVIEW_H
+
+#include "editor/halide_runner.h"
+#include "process_options.h"
+
+#include <cstdint>
+#include <memory>
+
+// Redraws the preview on the GPU from a cached front-end output while a
+// slider is being dragged, so tone, curve, grading and vignette edits show up
+// within a display frame instead of after a debounced Halide render.
+//
+// The fragment shader repeats the point-wise part of the back end: exposure,
+// the LCh color grading LUT, vignette and the tone curve LUT. It does not do
+// dehaze, the local laplacian or lens geometry, so it is only used while
+// those are neutral (see can_preview). The Halide render of the final
+// parameters replaces it once the slider is released.
+//
+// Only use from the thread that owns the GL context.
+class ShaderPreview {
+public:
+    // Compiles the shaders for `glsl_version` (the "#version ..." line the
+    // ImGui backend was initialized with). Returns null, after printing a
+    // warning, if the context can't run them.
+    static std::unique_ptr<ShaderPreview> create(const char* glsl_version);
+    ~ShaderPreview();
+
+    ShaderPreview(const ShaderPreview&) = delete;
+    ShaderPreview& operator=(const ShaderPreview&) = delete;
+
+    // True if rendering `cfg` from a front-end output computed with
+    // `linear_params` matches the full pipeline: only exposure may differ
+    // from the front end's parameters, and the stages the shader skips must
+    // be neutral.
+    static bool can_preview(const ProcessConfig& cfg, const ProcessConfig& linear_params);
+
+    // Renders `cfg` from `linear` and returns the RGBA8 texture holding the
+    // result (linear.width x linear.height, rows in the same order as the
+    // Halide output), or 0 on failure. `linear` is uploaded the first time
+    // its serial is seen; the LUTs are regenerated only when their
+    // parameters change.
+    uint32_t render(const ProcessConfig& cfg, const LinearSnapshot& linear);
+
+private:
+    ShaderPreview() = default;
+
+    bool ensure_target(int width, int height);
+    void update_luts(const ProcessConfig& cfg);
+
+    uint32_t program_ = 0;
+    uint32_t vertex_array_ = 0;
+    uint32_t framebuffer_ = 0;
+    uint32_t output_texture_ = 0;
+    int output_width_ = 0, output_height_ = 0;
+
+    uint32_t linear_texture_ = 0;
+    uint64_t linear_serial_ = 0;
+
+    uint32_t tone_lut_texture_ = 0;
+    uint32_t color_lut_texture_ = 0;
+    int color_lut_size_ = 0;
+    bool luts_valid_ = false;
+    ProcessConfig lut_params_;
+
+    // The inputs of the last render, to skip redrawing an unchanged frame.
+    bool output_valid_ = false;
+    float exposure_scale_ = 0.0f;
+    float vignette_[4] = {};
+    uint64_t rendered_serial_ = 0;
+
+    int u_exposure_scale_ = -1, u_vignette_ = -1, u_region_origin_ = -1, u_frame_size_ = -1, u_color_lut_size_ = -1;
+};
+
+#endif // EDITOR_SHADER_PREVIEW_H
@@ -1,58 +1,139 @@
 #include "texture_utils.h"
-#include <SDL.h> // Include the main SDL header to get SDL_GL_GetProcAddress
-#include <SDL_opengl.h>
-#include <SDL_opengl_glext.h> // For the function pointer type definition
+#include "gl_functions.h"
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <iostream>
 
-void CreateOrUpdateTexture(uint32_t& texture_id, int width, int height, const std::vector<uint8_t>& pixel_data) {
-    // Define the function pointer as a static variable. It will be initialized to nullptr once.
-    static PFNGLGENERATEMIPMAPPROC p_glGenerateMipmap = nullptr;
-    // A flag to ensure we only try to load the function pointer once.
-    static bool loader_initialized = false;
-
-    // Lazy-load the function pointer on the very first call to this function.
-    if (!loader_initialized) {
-        p_glGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)SDL_GL_GetProcAddress("glGenerateMipmap");
-        if (!p_glGenerateMipmap) {
-            std::cerr << "Warning: glGenerateMipmap could not be loaded. Texture minification will be lower quality." << std::endl;
-        }
-        loader_initialized = true;
-    }
-
-    if (pixel_data.empty() || width <= 0 || height <= 0) return;
-
-    if (texture_id == 0) {
-        glGenTextures(1, &texture_id);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-        // Set up high-quality filtering with mipmaps
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // Trilinear for minification
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);              // Bilinear for magnification
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+namespace {
+
+// Warns once about the missing entry points the fallbacks below cover.
+void check_support() {
+    static bool checked = false;
+    if (checked) return;
+    checked = true;
+    if (!gl().GenerateMipmap) {
+        std::cerr << "Warning: glGenerateMipmap could not be loaded. Texture minification will be lower quality." << std::endl;
+    }
+    if (!gl().has_pbos()) {
+        std::cerr << "Warning: pixel buffer objects are unavailable. Texture uploads will be synchronous." << std::endl;
+    }
+}
+
+int mip_levels(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1) levels++;
+    return levels;
+}
+
+// Creates `texture` with storage for a width x height RGBA8 image (and its
+// mip chain, if mipmaps can be generated).
+void allocate(PreviewTexture& texture, int width, int height) {
+    const GLFunctions& f = gl();
+    if (texture.id != 0) glDeleteTextures(1, &texture.id);
+    glGenTextures(1, &texture.id);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    texture.levels = f.GenerateMipmap ? mip_levels(width, height) : 1;
+    if (f.TexStorage2D) {
+        f.TexStorage2D(GL_TEXTURE_2D, texture.levels, GL_RGBA8, width, height);
     } else {
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-    }
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    
-    // Upload base level of the texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixel_data.data());
-    
-    // Generate the mipmap chain for high-quality minification, ONLY if the pointer is valid.
-    if (p_glGenerateMipmap) {
-        p_glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    
-    // It's good practice to reset the alignment to the default value.
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    
+        // Mutable storage: glGenerateMipmap allocates the other levels.
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+    }
+    texture.width = width;
+    texture.height = height;
+    texture.mipmaps_valid = false;
+    texture.mipmapped_filter = false;
+}
+
+// Copies `rgba` into the next buffer of the ring and starts the texture
+// upload from it. Returns false if the buffer can't be mapped.
+bool upload_through_pbo(PreviewTexture& texture, const std::vector<uint8_t>& rgba) {
+    const GLFunctions& f = gl();
+    const size_t bytes = static_cast<size_t>(texture.width) * texture.height * 4;
+    if (texture.pbos[0] == 0) {
+        f.GenBuffers(PreviewTexture::kPboCount, texture.pbos);
+    }
+    GLuint pbo = texture.pbos[texture.next_pbo];
+    texture.next_pbo = (texture.next_pbo + 1) % PreviewTexture::kPboCount;
+
+    f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    // Respecifying the store orphans the previous contents, so mapping never
+    // waits for an upload that is still reading them.
+    f.BufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+    void* dst = f.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst) {
+        f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    memcpy(dst, rgba.data(), bytes);
+    f.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // With a buffer bound, the pointer is an offset into it and the call
+    // returns without waiting for the copy.
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture.width, texture.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+} // namespace
+
+void UploadTexture(PreviewTexture& texture, int width, int height, const std::vector<uint8_t>& rgba) {
+    if (width <= 0 || height <= 0 || rgba.size() < static_cast<size_t>(width) * height * 4) return;
+    check_support();
+
+    if (texture.id == 0 || texture.width != width || texture.height != height) {
+        allocate(texture, width, height);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+    }
+
+    // RGBA rows are always 4-byte aligned, the default unpack alignment.
+    if (!gl().has_pbos() || !upload_through_pbo(texture, rgba)) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+    texture.mipmaps_valid = false;
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void PrepareTextureForDraw(PreviewTexture& texture, bool minified) {
+    if (texture.id == 0) return;
+    const bool use_mipmaps = minified && texture.levels > 1 && gl().GenerateMipmap;
+    if (use_mipmaps == texture.mipmapped_filter && (!use_mipmaps || texture.mipmaps_valid)) return;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    if (use_mipmaps && !texture.mipmaps_valid) {
+        gl().GenerateMipmap(GL_TEXTURE_2D);
+        texture.mipmaps_valid = true;
+    }
+    if (use_mipmaps != texture.mipmapped_filter) {
+        // Trilinear when shrunk; at 1:1 or zoomed in only level 0 is needed.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, use_mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        texture.mipmapped_filter = use_mipmaps;
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void DeleteTexture(uint32_t& texture_id) {
-    if (texture_id != 0) {
-        glDeleteTextures(1, &texture_id);
-        texture_id = 0;
+void ReleaseUploadBuffers(PreviewTexture& texture) {
+    if (texture.pbos[0] != 0 && gl().DeleteBuffers) {
+        gl().DeleteBuffers(PreviewTexture::kPboCount, texture.pbos);
+    }
+    for (uint32_t& pbo : texture.pbos) pbo = 0;
+    texture.next_pbo = 0;
+}
+
+void DeleteTexture(PreviewTexture& texture) {
+    ReleaseUploadBuffers(texture);
+    if (texture.id != 0) {
+        glDeleteTextures(1, &texture.id);
     }
+    texture = PreviewTexture();
 }
@@ -5,10 +5,37 @@
 #include <vector>
 #include "HalideBuffer.h"
 
-// Creates a new OpenGL texture or updates an existing one with data from an interleaved byte vector.
-void CreateOrUpdateTexture(uint32_t& texture_id, int width, int height, const std::vector<uint8_t>& pixel_data);
+// An RGBA8 OpenGL texture that rendered previews are streamed into. Its
+// storage is only allocated when the size changes, and uploads go through a
+// ring of pixel buffer objects so the driver copies them asynchronously.
+struct PreviewTexture {
+    static constexpr int kPboCount = 2;
 
-// Deletes an OpenGL texture.
-void DeleteTexture(uint32_t& texture_id);
+    uint32_t id = 0;
+    int width = 0;
+    int height = 0;
+    int levels = 1;                // Mip levels the storage has room for.
+    bool mipmaps_valid = false;    // Levels above 0 were built from the current level 0.
+    bool mipmapped_filter = false; // GL_TEXTURE_MIN_FILTER currently samples the mip chain.
+
+    uint32_t pbos[kPboCount] = {};
+    int next_pbo = 0;
+};
+
+// Uploads a width x height chunky RGBA8 image into `texture`, creating the
+// texture (or reallocating it, if the size changed) as needed.
+void UploadTexture(PreviewTexture& texture, int width, int height, const std::vector<uint8_t>& rgba);
+
+// Call before drawing `texture`. If it is drawn smaller than its size
+// (`minified`) the mip chain is built, when stale, and sampled; otherwise
+// only level 0 is sampled and no mipmaps are built.
+void PrepareTextureForDraw(PreviewTexture& texture, bool minified);
+
+// Deletes the upload buffers but keeps the texture, for one that is only
+// drawn from now on. The next upload into it creates them again.
+void ReleaseUploadBuffers(PreviewTexture& texture);
+
+// Deletes the texture and its upload buffers.
+void DeleteTexture(PreviewTexture& texture);
 
 #endif // TEXTURE_UTILS_H
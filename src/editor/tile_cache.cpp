@@ -0,0 +1,122 @@
+#include "editor/tile_cache.h"
+#include <SDL_opengl.h>
+
+#include <algorithm>
+#include <cstring>
+
+size_t TileCache::KeyHash::operator()(const Key& k) const {
+    uint64_t h = k.params_hash;
+    h = h * 1099511628211ull ^ static_cast<uint32_t>(k.downsample);
+    h = h * 1099511628211ull ^ static_cast<uint32_t>(k.tx);
+    h = h * 1099511628211ull ^ static_cast<uint32_t>(k.ty);
+    return static_cast<size_t>(h);
+}
+
+TileCache::TileCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {}
+
+TileCache::~TileCache() {
+    clear();
+}
+
+void TileCache::set_budget(size_t budget_bytes) {
+    budget_bytes_ = budget_bytes;
+    evict_to(budget_bytes_);
+}
+
+void TileCache::insert(uint64_t params_hash, const ViewportRegion& region, const ViewportRegion& valid,
+                       int frame_width, int frame_height, const std::vector<uint8_t>& rgba) {
+    if (region.is_full_frame() || valid.width <= 0 || valid.height <= 0 || budget_bytes_ == 0) return;
+    if (rgba.size() < static_cast<size_t>(region.width) * region.height * 4) return;
+
+    // Tiles entirely inside `valid`; edge tiles are clipped to the frame.
+    const int tx0 = (valid.x + kTileSize - 1) / kTileSize;
+    const int ty0 = (valid.y + kTileSize - 1) / kTileSize;
+    const int valid_x1 = valid.x + valid.width, valid_y1 = valid.y + valid.height;
+    const int tx1 = valid_x1 == frame_width ? (frame_width + kTileSize - 1) / kTileSize : valid_x1 / kTileSize;
+    const int ty1 = valid_y1 == frame_height ? (frame_height + kTileSize - 1) / kTileSize : valid_y1 / kTileSize;
+
+    std::vector<uint8_t> pixels;
+    for (int ty = ty0; ty < ty1; ++ty) {
+        for (int tx = tx0; tx < tx1; ++tx) {
+            Key key{params_hash, region.downsample, tx, ty};
+            auto it = index_.find(key);
+            if (it != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                continue;
+            }
+
+            Tile tile;
+            tile.x = tx * kTileSize;
+            tile.y = ty * kTileSize;
+            tile.width = std::min(kTileSize, frame_width - tile.x);
+            tile.height = std::min(kTileSize, frame_height - tile.y);
+            const size_t row_bytes = static_cast<size_t>(tile.width) * 4;
+            pixels.resize(row_bytes * tile.height);
+            for (int row = 0; row < tile.height; ++row) {
+                const size_t src = (static_cast<size_t>(tile.y + row - region.y) * region.width + (tile.x - region.x)) * 4;
+                memcpy(&pixels[row * row_bytes], &rgba[src], row_bytes);
+            }
+
+            glGenTextures(1, &tile.texture);
+            glBindTexture(GL_TEXTURE_2D, tile.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tile.width, tile.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            lru_.push_front(Entry{key, tile});
+            index_[key] = lru_.begin();
+            bytes_ += pixels.size();
+        }
+    }
+    evict_to(budget_bytes_);
+}
+
+const TileCache::Tile* TileCache::find(uint64_t params_hash, int downsample, int tx, int ty) {
+    auto it = index_.find(Key{params_hash, downsample, tx, ty});
+    if (it == index_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->tile;
+}
+
+bool TileCache::missing_bounds(uint64_t params_hash, const ViewportRegion& visible, ViewportRegion& missing) const {
+    if (visible.width <= 0 || visible.height <= 0) return false;
+    const int tx0 = visible.x / kTileSize, tx1 = (visible.x + visible.width - 1) / kTileSize;
+    const int ty0 = visible.y / kTileSize, ty1 = (visible.y + visible.height - 1) / kTileSize;
+
+    int mx0 = tx1 + 1, my0 = ty1 + 1, mx1 = tx0 - 1, my1 = ty0 - 1;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            if (index_.count(Key{params_hash, visible.downsample, tx, ty})) continue;
+            mx0 = std::min(mx0, tx);
+            my0 = std::min(my0, ty);
+            mx1 = std::max(mx1, tx);
+            my1 = std::max(my1, ty);
+        }
+    }
+    if (mx1 < mx0) return false;
+
+    // In frame pixels; the caller clips to the frame.
+    missing.downsample = visible.downsample;
+    missing.x = mx0 * kTileSize;
+    missing.y = my0 * kTileSize;
+    missing.width = (mx1 + 1 - mx0) * kTileSize;
+    missing.height = (my1 + 1 - my0) * kTileSize;
+    return true;
+}
+
+void TileCache::clear() {
+    evict_to(0);
+}
+
+void TileCache::evict_to(size_t budget_bytes) {
+    while (bytes_ > budget_bytes && !lru_.empty()) {
+        Entry& victim = lru_.back();
+        glDeleteTextures(1, &victim.tile.texture);
+        bytes_ -= static_cast<size_t>(victim.tile.width) * victim.tile.height * 4;
+        index_.erase(victim.key);
+        lru_.pop_back();
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef EDITOR_TILE_CACHE_H
+#define EDITOR_TILE_CACHE_H
+
+#include "editor/halide_runner.h" // For ViewportRegion
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Finished zoomed-in renders, cut into fixed-size tiles and kept as textures,
+// so panning back over an area already rendered with the current parameters
+// draws it from here instead of rendering it again.
+//
+// Tiles are keyed by (HashPixelParams of the render's parameters, downsample
+// level, tile column, tile row). An edit simply stops matching the old tiles,
+// which age out of the least-recently-used list once the memory budget is
+// exceeded.
+//
+// Only use from the thread that owns the GL context.
+class TileCache {
+public:
+    static constexpr int kTileSize = 256; // In frame pixels at the tile's level.
+
+    struct Tile {
+        uint32_t texture = 0;
+        int x = 0, y = 0, width = 0, height = 0; // Frame pixels at its level.
+    };
+
+    explicit TileCache(size_t budget_bytes = size_t(256) << 20);
+    ~TileCache();
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    // Evicts tiles until at most `budget_bytes` of textures remain.
+    void set_budget(size_t budget_bytes);
+
+    // Uploads the tiles that lie entirely inside `valid` and aren't cached
+    // yet. `rgba` holds the chunky RGBA render of `region` (rows from
+    // region.y down); `valid` is the part of it whose pixels are final, at
+    // the same level. frame_width/height bound the edge tiles.
+    void insert(uint64_t params_hash, const ViewportRegion& region, const ViewportRegion& valid,
+                int frame_width, int frame_height, const std::vector<uint8_t>& rgba);
+
+    // The cached tile, marked as recently used, or null.
+    const Tile* find(uint64_t params_hash, int downsample, int tx, int ty);
+
+    // Sets `missing` to the bounding box of the tiles overlapping `visible`
+    // that aren't cached. Returns false if all of them are.
+    bool missing_bounds(uint64_t params_hash, const ViewportRegion& visible, ViewportRegion& missing) const;
+
+    void clear();
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Key {
+        uint64_t params_hash;
+        int downsample, tx, ty;
+        bool operator==(const Key& o) const {
+            return params_hash == o.params_hash && downsample == o.downsample && tx == o.tx && ty == o.ty;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    struct Entry {
+        Key key;
+        Tile tile;
+    };
+
+    void evict_to(size_t budget_bytes);
+
+    std::list<Entry> lru_; // Most recently used first.
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    size_t bytes_ = 0;
+    size_t budget_bytes_;
+};
+
+#endif // EDITOR_TILE_CACHE_H
@@ -0,0 +1,271 @@
+#include "embedded_preview.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <vector>
+
+// To decode the preview, compile with -DUSE_LIBJPEG and link against
+// libjpeg (or libjpeg-turbo).
+#ifdef USE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+namespace { // Anonymous namespace for local helpers
+
+// Random access to the file's TIFF structures in its byte order.
+class TiffFile {
+public:
+    explicit TiffFile(const std::string& path) : in_(path, std::ios::binary) {
+        in_.seekg(0, std::ios::end);
+        size_ = in_ ? static_cast<uint64_t>(in_.tellg()) : 0;
+    }
+
+    bool read(uint64_t offset, void* dst, size_t n) {
+        offset += base_;
+        if (offset + n > size_) return false;
+        in_.clear();
+        in_.seekg(static_cast<std::streamoff>(offset));
+        return static_cast<bool>(in_.read(static_cast<char*>(dst), static_cast<std::streamsize>(n)));
+    }
+
+    uint16_t u16(const uint8_t* p) const {
+        return little_ ? static_cast<uint16_t>(p[0] | p[1] << 8) : static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+    uint32_t u32(const uint8_t* p) const {
+        return little_ ? static_cast<uint32_t>(p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24)
+                       : static_cast<uint32_t>(static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+    }
+
+    uint64_t size() const { return size_; }
+    bool little_ = true;
+    // Where offsets count from: 0, or the TIFF header of a JPEG's Exif.
+    uint64_t base_ = 0;
+
+private:
+    std::ifstream in_;
+    uint64_t size_ = 0;
+};
+
+constexpr uint16_t kNewSubfileType = 0x00fe;
+constexpr uint16_t kCompression = 0x0103;
+constexpr uint16_t kStripOffsets = 0x0111;
+constexpr uint16_t kOrientation = 0x0112;
+constexpr uint16_t kStripByteCounts = 0x0117;
+constexpr uint16_t kSubIFDs = 0x014a;
+constexpr uint16_t kJpegOffset = 0x0201;
+constexpr uint16_t kJpegLength = 0x0202;
+constexpr int kMaxIfds = 64;
+constexpr uint16_t kMaxEntries = 1024;
+
+struct Preview {
+    uint64_t offset = 0, length = 0;
+};
+
+// Walks the IFD chain from `first` and every SubIFD, keeping the largest
+// JPEG that starts with an SOI marker.
+Preview largest_tiff_jpeg(TiffFile& file, uint32_t first) {
+    Preview best;
+    std::vector<uint32_t> pending = {first};
+    std::set<uint32_t> seen;
+    auto consider = [&](uint64_t offset, uint64_t length) {
+        uint8_t soi[2];
+        if (length > best.length && offset + length <= file.size() && file.read(offset, soi, 2) &&
+            soi[0] == 0xff && soi[1] == 0xd8) {
+            best = {offset, length};
+        }
+    };
+    while (!pending.empty() && static_cast<int>(seen.size()) < kMaxIfds) {
+        const uint32_t ifd = pending.back();
+        pending.pop_back();
+        if (ifd == 0 || !seen.insert(ifd).second) continue;
+        uint8_t count_bytes[2];
+        if (!file.read(ifd, count_bytes, 2)) continue;
+        const uint16_t count = std::min(file.u16(count_bytes), kMaxEntries);
+        std::vector<uint8_t> entries(count * 12u + 4u);
+        if (!file.read(ifd + 2u, entries.data(), entries.size())) continue;
+
+        uint64_t jpeg_offset = 0, jpeg_length = 0, strip_offset = 0, strip_length = 0;
+        uint32_t subfile_type = 0, compression = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            const uint8_t* e = &entries[i * 12u];
+            const uint16_t tag = file.u16(e), type = file.u16(e + 2);
+            const uint32_t n = file.u32(e + 4);
+            // SHORT and LONG values that fit in the entry.
+            const uint32_t value = type == 3 ? file.u16(e + 8) : file.u32(e + 8);
+            switch (tag) {
+            case kNewSubfileType: subfile_type = value; break;
+            case kCompression: compression = value; break;
+            case kStripOffsets: if (n == 1) strip_offset = value; break;
+            case kStripByteCounts: if (n == 1) strip_length = value; break;
+            case kJpegOffset: jpeg_offset = value; break;
+            case kJpegLength: jpeg_length = value; break;
+            case kSubIFDs:
+                if (n == 1) {
+                    pending.push_back(value);
+                } else if (n <= kMaxIfds) {
+                    std::vector<uint8_t> offsets(n * 4u);
+                    if (file.read(value, offsets.data(), offsets.size())) {
+                        for (uint32_t k = 0; k < n; k++) pending.push_back(file.u32(&offsets[k * 4u]));
+                    }
+                }
+                break;
+            default: break;
+            }
+        }
+        if (jpeg_offset && jpeg_length) consider(jpeg_offset, jpeg_length);
+        // A JPEG-compressed image that is a reduced-resolution copy (DNG
+        // previews), or old-style JPEG. Lossless JPEG raw data (compression
+        // 7 in the full-size IFD) fails the SOI-and-subfile test.
+        if (strip_offset && strip_length && (compression == 6 || (compression == 7 && (subfile_type & 1)))) {
+            consider(strip_offset, strip_length);
+        }
+        pending.push_back(file.u32(&entries[count * 12u]));
+    }
+    return best;
+}
+
+// The Orientation entry of the IFD at `ifd`, 1 where it has none.
+int ifd_orientation(TiffFile& file, uint32_t ifd) {
+    uint8_t count_bytes[2];
+    if (!file.read(ifd, count_bytes, 2)) return 1;
+    const uint16_t count = std::min(file.u16(count_bytes), kMaxEntries);
+    std::vector<uint8_t> entries(count * 12u);
+    if (!file.read(ifd + 2u, entries.data(), entries.size())) return 1;
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* e = &entries[i * 12u];
+        if (file.u16(e) != kOrientation) continue;
+        const int value = file.u16(e + 8);
+        return value >= 1 && value <= 8 ? value : 1;
+    }
+    return 1;
+}
+
+// The orientation in the Exif of the JPEG at `offset` (RAF keeps it there
+// rather than in a TIFF structure of its own), 1 where it has none. Only
+// the segments ahead of the image data are read.
+int jpeg_exif_orientation(TiffFile& file, uint64_t offset, uint64_t length) {
+    uint64_t pos = offset + 2; // Past the SOI.
+    uint8_t segment[10];
+    while (pos + 4 <= offset + length && file.read(pos, segment, 4) && segment[0] == 0xff) {
+        const uint8_t marker = segment[1];
+        const uint32_t size = static_cast<uint32_t>(segment[2] << 8 | segment[3]);
+        if (marker == 0xda || marker == 0xd9 || size < 2) break; // Start of scan, or end of image.
+        if (marker == 0xe1 && size >= 16 && file.read(pos + 4, segment, 6) && memcmp(segment, "Exif\0\0", 6) == 0) {
+            file.base_ = pos + 10;
+            if (!file.read(0, segment, 8)) break;
+            if (segment[0] == 'I' && segment[1] == 'I') file.little_ = true;
+            else if (segment[0] == 'M' && segment[1] == 'M') file.little_ = false;
+            else break;
+            const int orientation = ifd_orientation(file, file.u32(segment + 4));
+            file.base_ = 0;
+            return orientation;
+        }
+        pos += 2 + size;
+    }
+    file.base_ = 0;
+    return 1;
+}
+
+#ifdef USE_LIBJPEG
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+bool decode_jpeg(const std::vector<uint8_t>& bytes, int min_long_edge, Halide::Runtime::Buffer<uint8_t, 3>& rgb) {
+    jpeg_decompress_struct cinfo;
+    JpegError err;
+    // Declared ahead of setjmp, so a longjmp doesn't skip its destructor.
+    Halide::Runtime::Buffer<uint8_t, 3> out;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpeg_error_exit;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(bytes.data()), static_cast<unsigned long>(bytes.size()));
+    jpeg_read_header(&cinfo, TRUE);
+    const unsigned long_edge = std::max(cinfo.image_width, cinfo.image_height);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    for (unsigned denom = 8; denom > 1; denom /= 2) {
+        if (long_edge / denom >= static_cast<unsigned>(std::max(1, min_long_edge))) {
+            cinfo.scale_denom = denom;
+            break;
+        }
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+    out = Halide::Runtime::Buffer<uint8_t, 3>::make_interleaved(
+        static_cast<int>(cinfo.output_width), static_cast<int>(cinfo.output_height), 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &out(0, static_cast<int>(cinfo.output_scanline), 0);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    rgb = std::move(out);
+    return true;
+}
+#endif // USE_LIBJPEG
+
+} // namespace
+
+bool find_embedded_preview(const std::string& path, uint64_t& offset, uint64_t& length, int* orientation) {
+    TiffFile file(path);
+    uint8_t header[92];
+    if (!file.read(0, header, 8)) return false;
+
+    // RAF: a fixed header with the JPEG's offset and length, big-endian.
+    if (memcmp(header, "FUJIFILM", 8) == 0) {
+        if (!file.read(0, header, sizeof(header))) return false;
+        file.little_ = false;
+        offset = file.u32(header + 84);
+        length = file.u32(header + 88);
+        if (!offset || !length || offset + length > file.size()) return false;
+        if (orientation) *orientation = jpeg_exif_orientation(file, offset, length);
+        return true;
+    }
+
+    if (header[0] == 'I' && header[1] == 'I') file.little_ = true;
+    else if (header[0] == 'M' && header[1] == 'M') file.little_ = false;
+    else return false;
+    // TIFF, and the ORF and RW2 variants of its magic number.
+    const uint16_t magic = file.u16(header + 2);
+    if (magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) return false;
+    Preview preview = largest_tiff_jpeg(file, file.u32(header + 4));
+    if (!preview.length) return false;
+    offset = preview.offset;
+    length = preview.length;
+    if (orientation) *orientation = ifd_orientation(file, file.u32(header + 4));
+    return true;
+}
+
+bool load_embedded_preview(const std::string& path, int min_long_edge, Halide::Runtime::Buffer<uint8_t, 3>& rgb,
+                           int* orientation) {
+#ifdef USE_LIBJPEG
+    uint64_t offset = 0, length = 0;
+    if (!find_embedded_preview(path, offset, length, orientation)) return false;
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> bytes(length);
+    in.seekg(static_cast<std::streamoff>(offset));
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(length))) return false;
+    return decode_jpeg(bytes, min_long_edge, rgb);
+#else
+    (void)path;
+    (void)min_long_edge;
+    (void)rgb;
+    (void)orientation;
+    return false;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef EMBEDDED_PREVIEW_H
+#define EMBEDDED_PREVIEW_H
+
+#include <cstdint>
+#include <string>
+#include "HalideBuffer.h"
+
+// The JPEG preview most raw files carry, for showing something while the
+// raw itself decodes.
+//
+// TIFF-based raws (DNG, NEF, CR2, ARW, PEF, ORF, RW2, ...) are walked IFD by
+// IFD, following the IFD chain and SubIFDs, reading only the directory
+// entries; the largest JPEG found (JPEGInterchangeFormat, or a JPEG-
+// compressed reduced-resolution image) is taken. RAF's header points at its
+// preview directly. Other containers have none.
+
+// The preview's byte range in the file. False if there is none. With
+// `orientation`, also the raw's EXIF orientation (1-8, 1 where the file has
+// none), which previews are stored unrotated for, as the raw is.
+bool find_embedded_preview(const std::string& path, uint64_t& offset, uint64_t& length,
+                           int* orientation = nullptr);
+
+// Decodes the preview to interleaved RGB, scaled down by a power of two (in
+// the JPEG decoder, so the cost follows the output size) as far as it can
+// be while its longer side stays at least `min_long_edge`. False if there is
+// no preview, it doesn't decode, or this build has no JPEG decoder
+// (USE_LIBJPEG). `orientation` is as find_embedded_preview's.
+bool load_embedded_preview(const std::string& path, int min_long_edge, Halide::Runtime::Buffer<uint8_t, 3>& rgb,
+                           int* orientation = nullptr);
+
+#endif // EMBEDDED_PREVIEW_H
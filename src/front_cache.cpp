@@ -0,0 +1,330 @@
+#include "front_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace { // Anonymous namespace for local helpers
+
+constexpr char kEntryMagic[8] = {'O', 'R', 'F', 'R', 'O', 'N', 'T', '1'};
+// file_digest() hashes a file in reads of this size.
+constexpr size_t kDigestChunk = 1 << 20;
+
+struct EntryHeader {
+    char magic[8];
+    uint32_t width = 0, height = 0, channels = 0, strip_rows = 0, strips = 0;
+};
+
+// float32 <-> IEEE float16, rounding to nearest even. Values past the
+// float16 range become infinities; the front end's linear output is well
+// inside it.
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t mag = bits & 0x7fffffffu;
+    if (mag > 0x7f800000u) return static_cast<uint16_t>(sign | 0x7e00u);
+    if (mag >= 0x47800000u) return static_cast<uint16_t>(sign | 0x7c00u);
+    if (mag < 0x38800000u) {
+        // A float16 subnormal, or zero.
+        if (mag < 0x33000000u) return static_cast<uint16_t>(sign);
+        const uint32_t mantissa = (mag & 0x7fffffu) | 0x800000u;
+        const int shift = 126 - static_cast<int>(mag >> 23);
+        const uint32_t rounded = (mantissa + (1u << (shift - 1)) - 1 + ((mantissa >> shift) & 1)) >> shift;
+        return static_cast<uint16_t>(sign | rounded);
+    }
+    const uint32_t rebased = mag - 0x38000000u;
+    return static_cast<uint16_t>(sign | ((rebased + 0xfffu + ((rebased >> 13) & 1)) >> 13));
+}
+
+float half_to_float(uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1fu;
+    const uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0) {
+        const float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// A 64-bit hash over 8-byte words, finished with the splitmix64 mixer.
+// Not cryptographic; it only has to tell files and settings apart.
+struct Hasher {
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+
+    void add(const uint8_t* data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            mix(word);
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, data + i, size - i);
+        mix(tail ^ (static_cast<uint64_t>(size - i) << 56));
+    }
+
+    void mix(uint64_t word) {
+        state ^= word * 0x87c37b91114253d5ull;
+        state = ((state << 31) | (state >> 33)) * 0x4cf5ad432745937full;
+    }
+
+    std::string hex() const {
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(z));
+        return text;
+    }
+};
+
+// Runs body(0 .. count-1) on the shared pool if it's running, else on a
+// few threads of its own.
+void for_each_strip(int count, const std::function<void(int)>& body) {
+    ThreadPool& pool = ThreadPool::get();
+    if (count == 1) {
+        body(0);
+    } else if (pool.running()) {
+        pool.parallel_for(0, count, body);
+    } else {
+        std::atomic<int> next{0};
+        const int threads = std::min(count, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (int i; (i = next++) < count;) body(i);
+            });
+        }
+        for (auto& t : workers) t.join();
+    }
+}
+
+} // namespace
+
+FrontCache::FrontCache(const std::string& dir, int64_t max_bytes) : dir_(dir), max_bytes_(max_bytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) fprintf(stderr, "Warning: could not create front-end cache %s: %s\n", dir_.c_str(), ec.message().c_str());
+}
+
+std::string FrontCache::file_digest(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return "";
+    Hasher hasher;
+    std::vector<uint8_t> chunk(kDigestChunk);
+    uint64_t total = 0;
+    while (in) {
+        in.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        const size_t got = static_cast<size_t>(in.gcount());
+        if (got == 0) break;
+        hasher.add(chunk.data(), got);
+        total += got;
+    }
+    hasher.mix(total);
+    return hasher.hex();
+}
+
+std::string FrontCache::file_digest(const uint8_t* data, size_t size) {
+    // In the same chunks as the file is read in, which the digest depends on.
+    Hasher hasher;
+    for (size_t offset = 0; offset < size; offset += kDigestChunk) {
+        hasher.add(data + offset, std::min(kDigestChunk, size - offset));
+    }
+    hasher.mix(size);
+    return hasher.hex();
+}
+
+std::string FrontCache::key(const std::string& file_digest, const std::string& settings) {
+    Hasher hasher;
+    const std::string text = std::string(kEntryMagic, sizeof(kEntryMagic)) + '\n' + file_digest + '\n' + settings;
+    hasher.add(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    return file_digest + "-" + hasher.hex();
+}
+
+std::string FrontCache::path_for(const std::string& key) const {
+    return dir_ + "/" + key + ".front";
+}
+
+bool FrontCache::contains(const std::string& key) const {
+    std::error_code ec;
+    return std::filesystem::is_regular_file(path_for(key), ec);
+}
+
+bool FrontCache::load(const std::string& key, Halide::Runtime::Buffer<float, 3>& linear) {
+    const std::string path = path_for(key);
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    std::vector<uint8_t> entry;
+    if (in) {
+        entry.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+    }
+    Halide::Runtime::Buffer<float, 3> out;
+    if (!in || !decode(entry.data(), entry.size(), out)) {
+        misses_++;
+        return false;
+    }
+    // Mark it used for the LRU.
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    linear = std::move(out);
+    hits_++;
+    return true;
+}
+
+void FrontCache::store(const std::string& key, const Halide::Runtime::Buffer<float, 3>& linear) {
+    const std::vector<uint8_t> entry = encode(linear);
+    const std::string path = path_for(key);
+    const std::string temp = path + ".tmp" + std::to_string(getpid()) + "." +
+                             std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    bool ok = !entry.empty();
+    if (ok) {
+        std::ofstream out(temp, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+        ok = static_cast<bool>(out.flush());
+    }
+    std::error_code ec;
+    if (ok) std::filesystem::rename(temp, path, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(temp, ec);
+        fprintf(stderr, "Warning: could not write front-end cache entry %s\n", path.c_str());
+        return;
+    }
+    evict();
+}
+
+std::vector<uint8_t> FrontCache::encode(const Halide::Runtime::Buffer<float, 3>& linear) {
+    const int width = linear.width(), height = linear.height();
+    const int strips = (height + kStripRows - 1) / kStripRows;
+    std::vector<std::vector<uint8_t>> packed(strips);
+    std::atomic<bool> failed{false};
+    for_each_strip(strips, [&](int s) {
+        const int y0 = s * kStripRows, rows = std::min(kStripRows, height - y0);
+        std::vector<uint16_t> halves;
+        halves.reserve(static_cast<size_t>(width) * rows * 3);
+        for (int c = 0; c < 3; c++) {
+            for (int y = y0; y < y0 + rows; y++) {
+                for (int x = 0; x < width; x++) halves.push_back(float_to_half(linear(x + linear.dim(0).min(),
+                                                                                      y + linear.dim(1).min(),
+                                                                                      c + linear.dim(2).min())));
+            }
+        }
+        const uLong raw_size = static_cast<uLong>(halves.size() * sizeof(uint16_t));
+        uLongf size = compressBound(raw_size);
+        packed[s].resize(size);
+        // The fastest level: a re-export shouldn't wait on the compressor.
+        if (compress2(packed[s].data(), &size, reinterpret_cast<const Bytef*>(halves.data()), raw_size, 1) != Z_OK) {
+            failed = true;
+            return;
+        }
+        packed[s].resize(size);
+    });
+    if (failed) return {};
+
+    EntryHeader header;
+    memcpy(header.magic, kEntryMagic, sizeof(kEntryMagic));
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.channels = 3;
+    header.strip_rows = kStripRows;
+    header.strips = static_cast<uint32_t>(strips);
+    std::vector<uint8_t> entry(reinterpret_cast<const uint8_t*>(&header),
+                               reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+    for (const auto& strip : packed) {
+        const uint32_t size = static_cast<uint32_t>(strip.size());
+        entry.insert(entry.end(), reinterpret_cast<const uint8_t*>(&size),
+                     reinterpret_cast<const uint8_t*>(&size) + sizeof(size));
+    }
+    for (const auto& strip : packed) entry.insert(entry.end(), strip.begin(), strip.end());
+    return entry;
+}
+
+bool FrontCache::decode(const uint8_t* data, size_t size, Halide::Runtime::Buffer<float, 3>& linear) {
+    EntryHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kEntryMagic, sizeof(kEntryMagic)) != 0 || header.channels != 3 ||
+        header.width == 0 || header.height == 0 || header.strip_rows == 0 ||
+        header.strips != (header.height + header.strip_rows - 1) / header.strip_rows ||
+        (size - sizeof(header)) / sizeof(uint32_t) < header.strips) {
+        return false;
+    }
+    std::vector<uint32_t> sizes(header.strips);
+    memcpy(sizes.data(), data + sizeof(header), sizes.size() * sizeof(uint32_t));
+    const uint8_t* packed = data + sizeof(header) + sizes.size() * sizeof(uint32_t);
+    std::vector<size_t> offsets(header.strips + 1, 0);
+    for (uint32_t s = 0; s < header.strips; s++) offsets[s + 1] = offsets[s] + sizes[s];
+    if (offsets.back() > size - static_cast<size_t>(packed - data)) return false;
+
+    const int width = static_cast<int>(header.width), height = static_cast<int>(header.height);
+    const int strip_rows = static_cast<int>(header.strip_rows);
+    Halide::Runtime::Buffer<float, 3> out(width, height, 3);
+    std::atomic<bool> damaged{false};
+    for_each_strip(static_cast<int>(header.strips), [&](int s) {
+        const int y0 = s * strip_rows, rows = std::min(strip_rows, height - y0);
+        std::vector<uint16_t> halves(static_cast<size_t>(width) * rows * 3);
+        uLongf unpacked = static_cast<uLongf>(halves.size() * sizeof(uint16_t));
+        if (uncompress(reinterpret_cast<Bytef*>(halves.data()), &unpacked, packed + offsets[s], sizes[s]) != Z_OK ||
+            unpacked != halves.size() * sizeof(uint16_t)) {
+            damaged = true;
+            return;
+        }
+        // Planar within the strip: each channel's rows in turn.
+        const uint16_t* h = halves.data();
+        for (int c = 0; c < 3; c++) {
+            for (int y = y0; y < y0 + rows; y++) {
+                for (int x = 0; x < width; x++) out(x, y, c) = half_to_float(*h++);
+            }
+        }
+    });
+    if (damaged) return false;
+    linear = std::move(out);
+    return true;
+}
+
+// Deletes the least recently used entries until the directory fits.
+void FrontCache::evict() {
+    namespace fs = std::filesystem;
+    std::lock_guard<std::mutex> lock(evict_mutex_);
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        int64_t size;
+    };
+    std::vector<Entry> entries;
+    int64_t total = 0;
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(dir_, ec)) {
+        if (!item.is_regular_file(ec) || item.path().extension() != ".front") continue;
+        Entry entry{item.path(), item.last_write_time(ec), static_cast<int64_t>(item.file_size(ec))};
+        if (ec) continue;
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (total <= max_bytes_) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    // The newest entry stays even if it alone is over the limit.
+    for (size_t i = 0; i + 1 < entries.size() && total > max_bytes_; i++) {
+        if (fs::remove(entries[i].path, ec)) total -= entries[i].size;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef FRONT_CACHE_H
+#define FRONT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "HalideBuffer.h"
+
+// An on-disk cache of the split pipeline's front-end output (linear,
+// white-balanced camera RGB after demosaic, CA correction and the colour
+// matrix), so that re-exporting an image with a new crop, look or size
+// runs only the back end.
+//
+// Entries are keyed by a digest of the raw file's contents and of the
+// front-end options (see key()). Each is one file in the cache directory:
+// a small header, then the image as float16 in strips of kStripRows rows,
+// each strip zlib-compressed on its own so strips are packed and unpacked
+// in parallel. Writes go to a temporary file that is renamed into place, so
+// a reader never sees a partial entry, and several processes can share a
+// directory.
+//
+// The directory is kept under `max_bytes` by evicting the least recently
+// used entries after each store; load() refreshes an entry's mtime, which
+// is what "used" means. Errors are not fatal: a damaged or unreadable entry
+// is a miss and a failed store is reported and ignored.
+class FrontCache {
+public:
+    static constexpr int kStripRows = 64;
+
+    FrontCache(const std::string& dir, int64_t max_bytes);
+
+    // A digest of the file's contents, or "" if it can't be read. Cheap
+    // next to a decode, so it's taken on every lookup rather than trusting
+    // paths or mtimes.
+    static std::string file_digest(const std::string& path);
+    // file_digest() of a file with these contents, already in memory.
+    static std::string file_digest(const uint8_t* data, size_t size);
+    // The entry key for a file digest and a front-end settings string.
+    static std::string key(const std::string& file_digest, const std::string& settings);
+
+    bool contains(const std::string& key) const;
+    // Reads an entry into `linear` (x, y, c), planar, 3 channels. False on
+    // a miss.
+    bool load(const std::string& key, Halide::Runtime::Buffer<float, 3>& linear);
+    // Writes `linear` (any layout) as the entry for `key`, then evicts.
+    void store(const std::string& key, const Halide::Runtime::Buffer<float, 3>& linear);
+
+    // An entry's contents for `linear`, and back, for entries that travel
+    // outside a cache directory (process_f32 --front-out, web/). decode()
+    // returns false on a damaged entry.
+    static std::vector<uint8_t> encode(const Halide::Runtime::Buffer<float, 3>& linear);
+    static bool decode(const uint8_t* data, size_t size, Halide::Runtime::Buffer<float, 3>& linear);
+
+    int hits() const { return hits_; }
+    int misses() const { return misses_; }
+
+private:
+    std::string path_for(const std::string& key) const;
+    void evict();
+
+    std::string dir_;
+    int64_t max_bytes_;
+    std::mutex evict_mutex_;
+    std::atomic<int> hits_{0}, misses_{0};
+};
+
+#endif // FRONT_CACHE_H
@@ -2,6 +2,7 @@
 #define HALIDE_ALGORITHM_GUIDED_FILTER_H
 
 #include "Halide.h"
+#include "pipeline_helpers.h"
 #include <vector>
 #include <string>
 
@@ -50,6 +51,7 @@ public:
     // --- Outputs ---
     Func output;
     std::vector<Func> intermediates;
+    std::vector<BoxSumBuilder> boxes;
 
     // --- Constructor ---
     // It now accepts the Vars to use for defining the final output Func.
@@ -81,15 +83,23 @@ public:
         intermediates.push_back(box_p);
         intermediates.push_back(box_Ip);
 
-        // --- Convolve moments with a box filter ---
-        // FIX: Pass the correct Vars (`xi`, `yi`, `ci`) to the box filter helpers.
-        Func mean_I = box_filter_2d(box_I, R, R, "mean_I", xi, yi);
-        Func mean_II = box_filter_2d(box_II, R, R, "mean_II", xi, yi);
+        // --- Average moments over the box ---
+        // Running sums (BoxSumBuilder); their scans are in `boxes`, to be
+        // scheduled as producers.
+        const int box_block = 32;
+        boxes.emplace_back(box_I, R, box_block, "sum_I", xi, yi);
+        boxes.emplace_back(box_II, R, box_block, "sum_II", xi, yi);
+        boxes.emplace_back(box_p, R, box_block, "sum_p", xi, yi, std::vector<Var>{ci});
+        boxes.emplace_back(box_Ip, R, box_block, "sum_Ip", xi, yi, std::vector<Var>{ci});
+
+        const float inv_area = 1.0f / ((2 * R + 1) * (2 * R + 1));
+        Func mean_I("mean_I"), mean_II("mean_II"), mean_p("mean_p"), mean_Ip("mean_Ip");
+        mean_I(xi, yi) = boxes[0].output(xi, yi) * inv_area;
+        mean_II(xi, yi) = boxes[1].output(xi, yi) * inv_area;
+        mean_p(xi, yi, ci) = boxes[2].output(xi, yi, ci) * inv_area;
+        mean_Ip(xi, yi, ci) = boxes[3].output(xi, yi, ci) * inv_area;
         intermediates.push_back(mean_I);
         intermediates.push_back(mean_II);
-
-        Func mean_p = box_filter_3d(box_p, R, R, "mean_p", xi, yi, ci);
-        Func mean_Ip = box_filter_3d(box_Ip, R, R, "mean_Ip", xi, yi, ci);
         intermediates.push_back(mean_p);
         intermediates.push_back(mean_Ip);
 
@@ -120,6 +130,72 @@ public:
     }
 };
 
+/** \name GuidedUpsampleBuilder
+ *
+ *  The fast guided filter (He & Sun, 2015) as an upsampler. `coarse_image`
+ *  and `coarse_guide` are 2D Funcs on a grid of `cell`-pixel cells: the
+ *  image to refine and the guide's means over each cell. The regression is
+ *  solved on the grid, and its coefficients are averaged over
+ *  (2 * radius + 1)^2 cells there. `output` upsamples them bilinearly and
+ *  applies them to the full-resolution `guide`, one multiply-add per pixel.
+ *
+ *  The grid Funcs in `coarse` are small and meant to be computed whole;
+ *  `output` is pointwise.
+ */
+class GuidedUpsampleBuilder {
+public:
+    Func output;
+    std::vector<Func> coarse;
+
+    GuidedUpsampleBuilder(Func coarse_image, Func coarse_guide, Func guide,
+                          Expr grid_width, Expr grid_height, Expr cell,
+                          Var x, Var y, int radius, Expr eps, const std::string &name = "guided_upsample") {
+        Var gx(name + "_gx"), gy(name + "_gy");
+        const Region grid = {{0, grid_width}, {0, grid_height}};
+        const int w = 2 * radius + 1;
+        const float inv_area = 1.0f / (w * w);
+
+        Func I = BoundaryConditions::repeat_edge(coarse_guide, grid);
+        Func p = BoundaryConditions::repeat_edge(coarse_image, grid);
+        Func II(name + "_II"), Ip(name + "_Ip");
+        II(gx, gy) = I(gx, gy) * I(gx, gy);
+        Ip(gx, gy) = I(gx, gy) * p(gx, gy);
+
+        Func sum_I = box_filter_2d(I, w, w, name + "_I", gx, gy);
+        Func sum_II = box_filter_2d(II, w, w, name + "_II", gx, gy);
+        Func sum_p = box_filter_2d(p, w, w, name + "_p", gx, gy);
+        Func sum_Ip = box_filter_2d(Ip, w, w, name + "_Ip", gx, gy);
+
+        Expr mean_I = sum_I(gx, gy) * inv_area, mean_p = sum_p(gx, gy) * inv_area;
+        Expr var_I = sum_II(gx, gy) * inv_area - mean_I * mean_I;
+        Expr cov_Ip = sum_Ip(gx, gy) * inv_area - mean_I * mean_p;
+        Func a(name + "_a"), b(name + "_b");
+        a(gx, gy) = cov_Ip / (var_I + eps);
+        b(gx, gy) = mean_p - a(gx, gy) * mean_I;
+        coarse.push_back(a);
+        coarse.push_back(b);
+
+        // Each pixel's coefficients are the mean over the windows it's in.
+        Func mean_a(name + "_mean_a"), mean_b(name + "_mean_b");
+        mean_a(gx, gy) = box_filter_2d(BoundaryConditions::repeat_edge(a, grid), w, w, name + "_a", gx, gy)(gx, gy) * inv_area;
+        mean_b(gx, gy) = box_filter_2d(BoundaryConditions::repeat_edge(b, grid), w, w, name + "_b", gx, gy)(gx, gy) * inv_area;
+        coarse.push_back(mean_a);
+        coarse.push_back(mean_b);
+
+        // Bilinear, between the cell centres.
+        Func up_a = BoundaryConditions::repeat_edge(mean_a, grid);
+        Func up_b = BoundaryConditions::repeat_edge(mean_b, grid);
+        Expr fx = (cast<float>(x) + 0.5f) / cell - 0.5f, fy = (cast<float>(y) + 0.5f) / cell - 0.5f;
+        Expr ix = cast<int>(floor(fx)), iy = cast<int>(floor(fy));
+        Expr wx = fx - cast<float>(ix), wy = fy - cast<float>(iy);
+        auto bilerp = [&](Func f) {
+            return lerp(lerp(f(ix, iy), f(ix + 1, iy), wx), lerp(f(ix, iy + 1), f(ix + 1, iy + 1), wx), wy);
+        };
+        output = Func(name + "_result");
+        output(x, y) = bilerp(up_a) * guide(x, y) + bilerp(up_b);
+    }
+};
+
 }  // namespace Halide
 
 #endif
@@ -0,0 +1,373 @@
+#ifndef HALIDE_MEMORY_H
+#define HALIDE_MEMORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "HalideRuntime.h"
+
+// Heap accounting for Halide pipelines, through halide_set_custom_malloc/
+// free: live bytes, the peak of a pipeline run, and how many allocations it
+// made. Only pipeline intermediates go through halide_malloc - host
+// Buffers and device memory don't - so this is what the schedule decides
+// to keep around (root-level full-frame Funcs, pyramid levels, strip
+// buffers of the parallel loops).
+//
+// begin_run/end_run bracket one invocation. The hooks are global, so runs
+// on several threads at once are counted together; process and rawr only
+// ever run one pipeline at a time.
+//
+// With the Pool enabled, freed blocks are kept for the next run instead of
+// going back to the system: the same sizes come back every run as long as
+// the resolution doesn't change, and a reused block skips the page faults
+// and zeroing of fresh memory, which for the multi-hundred-MB root
+// intermediates is a visible part of a run.
+//
+// With huge pages on, the blocks above kThreadCacheMax are mapped aligned to
+// 2 MB and advised as transparent huge pages, so a full-frame intermediate
+// takes a few hundred TLB entries instead of tens of thousands. Their pages
+// are still placed by first touch, and the strip loops do the touching.
+namespace HalideMemory {
+
+// Size-class pool behind the tracker's allocator. Blocks up to
+// kThreadCacheMax (the strip buffers of parallel loops) go on free lists
+// of the thread that freed them, so Halide's workers reuse them without
+// contention; larger ones (root-level intermediates, pyramid levels) go
+// to a shared arena and are reused for requests up to 1/8 smaller.
+class Pool {
+public:
+    static constexpr size_t kThreadCacheMax = 16 << 20;
+    static constexpr size_t kThreadCacheLimit = 64 << 20; // Per thread.
+
+    static Pool& get() {
+        static Pool pool;
+        return pool;
+    }
+
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Back the large blocks with huge pages (Linux only). Retained blocks
+    // are released first; only switch while no pipeline is running, since a
+    // block goes back the way it was allocated.
+    void set_huge_pages(bool on) {
+        trim();
+#ifdef __linux__
+        huge_pages_.store(on, std::memory_order_relaxed);
+#else
+        (void)on;
+#endif
+    }
+    bool huge_pages() const { return huge_pages_.load(std::memory_order_relaxed); }
+
+    // Most bytes the shared arena keeps while nothing uses them; blocks
+    // freed beyond it go back to the system.
+    void set_arena_limit(size_t bytes) {
+        std::lock_guard<std::mutex> lock(arena_mutex_);
+        arena_limit_ = bytes;
+        trim_arena_locked(arena_limit_);
+    }
+
+    // Releases every retained block. Call when the resolution changes, so
+    // blocks sized for the old one don't linger.
+    void trim() {
+        {
+            std::lock_guard<std::mutex> lock(caches_mutex_);
+            for (ThreadCache* cache : caches_) cache->clear();
+        }
+        std::lock_guard<std::mutex> lock(arena_mutex_);
+        trim_arena_locked(0);
+    }
+
+    // Bytes held for reuse (not in use by any pipeline).
+    uint64_t retained_bytes() const { return retained_.load(std::memory_order_relaxed); }
+
+    // A block of at least `size` bytes; `size` is updated to its capacity,
+    // which must be passed back to give().
+    void* take(size_t& size) {
+        size = class_size(size);
+        if (enabled()) {
+            void* block = size <= kThreadCacheMax ? thread_cache().take(size) : take_from_arena(size);
+            if (block) return block;
+        }
+        return system_alloc(size);
+    }
+
+    void give(void* block, size_t size) {
+        if (enabled()) {
+            const bool kept = size <= kThreadCacheMax ? thread_cache().give(block, size) : give_to_arena(block, size);
+            if (kept) return;
+        }
+        system_free(block, size);
+    }
+
+private:
+    static constexpr size_t kHugePage = size_t(2) << 20;
+
+    // Blocks above kThreadCacheMax are mapped with huge pages when on;
+    // rounding them to 2 MB first keeps whole pages in each.
+    void* system_alloc(size_t size) {
+#ifdef __linux__
+        if (size > kThreadCacheMax && huge_pages()) {
+            // Over-map by a page and unmap the ends, for 2 MB alignment.
+            const size_t mapped = size + kHugePage;
+            void* raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) return nullptr;
+            const uintptr_t base = reinterpret_cast<uintptr_t>(raw);
+            const uintptr_t aligned = (base + kHugePage - 1) & ~(uintptr_t)(kHugePage - 1);
+            if (aligned > base) munmap(raw, aligned - base);
+            const uintptr_t tail = aligned + size;
+            if (base + mapped > tail) munmap(reinterpret_cast<void*>(tail), base + mapped - tail);
+            madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+            return reinterpret_cast<void*>(aligned);
+        }
+#endif
+        return std::malloc(size);
+    }
+
+    void system_free(void* block, size_t size) {
+#ifdef __linux__
+        if (size > kThreadCacheMax && huge_pages()) {
+            munmap(block, size);
+            return;
+        }
+#endif
+        std::free(block);
+    }
+
+    // Four classes per power of two (at most 25% slack) for cached sizes;
+    // arena blocks are rounded to 64 KB.
+    size_t class_size(size_t n) const {
+        if (n > kThreadCacheMax && huge_pages()) return (n + kHugePage - 1) & ~(kHugePage - 1);
+        if (n > kThreadCacheMax) return (n + 0xFFFF) & ~size_t(0xFFFF);
+        if (n <= 1024) return (n + 127) & ~size_t(127);
+        size_t p = 1024;
+        while (p * 2 <= n) p *= 2;
+        const size_t step = p / 4;
+        return (n + step - 1) / step * step;
+    }
+
+    class ThreadCache {
+    public:
+        explicit ThreadCache(Pool& pool) : pool_(pool) {
+            std::lock_guard<std::mutex> lock(pool_.caches_mutex_);
+            pool_.caches_.insert(this);
+        }
+        ~ThreadCache() {
+            {
+                std::lock_guard<std::mutex> lock(pool_.caches_mutex_);
+                pool_.caches_.erase(this);
+            }
+            clear();
+        }
+
+        void* take(size_t size) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = free_.find(size);
+            if (it == free_.end() || it->second.empty()) return nullptr;
+            void* block = it->second.back();
+            it->second.pop_back();
+            bytes_ -= size;
+            pool_.retained_.fetch_sub(size, std::memory_order_relaxed);
+            return block;
+        }
+
+        bool give(void* block, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (bytes_ + size > kThreadCacheLimit) return false;
+            free_[size].push_back(block);
+            bytes_ += size;
+            pool_.retained_.fetch_add(size, std::memory_order_relaxed);
+            return true;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& list : free_) {
+                for (void* block : list.second) std::free(block);
+            }
+            pool_.retained_.fetch_sub(bytes_, std::memory_order_relaxed);
+            free_.clear();
+            bytes_ = 0;
+        }
+
+    private:
+        Pool& pool_;
+        // Only contended by trim().
+        std::mutex mutex_;
+        std::map<size_t, std::vector<void*>> free_;
+        size_t bytes_ = 0;
+    };
+
+    ThreadCache& thread_cache() {
+        thread_local ThreadCache cache(*this);
+        return cache;
+    }
+
+    void* take_from_arena(size_t& size) {
+        std::lock_guard<std::mutex> lock(arena_mutex_);
+        auto it = arena_.lower_bound(size);
+        if (it == arena_.end() || it->first > size + size / 8) return nullptr;
+        void* block = it->second;
+        size = it->first;
+        arena_bytes_ -= size;
+        retained_.fetch_sub(size, std::memory_order_relaxed);
+        arena_.erase(it);
+        return block;
+    }
+
+    bool give_to_arena(void* block, size_t size) {
+        std::lock_guard<std::mutex> lock(arena_mutex_);
+        if (size > arena_limit_) return false;
+        arena_.emplace(size, block);
+        arena_bytes_ += size;
+        retained_.fetch_add(size, std::memory_order_relaxed);
+        trim_arena_locked(arena_limit_);
+        return true;
+    }
+
+    // Frees the smallest blocks until at most `limit` bytes are kept.
+    void trim_arena_locked(size_t limit) {
+        while (arena_bytes_ > limit && !arena_.empty()) {
+            auto it = arena_.begin();
+            arena_bytes_ -= it->first;
+            retained_.fetch_sub(it->first, std::memory_order_relaxed);
+            system_free(it->second, it->first);
+            arena_.erase(it);
+        }
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<bool> huge_pages_{false};
+    std::atomic<uint64_t> retained_{0};
+    std::mutex caches_mutex_;
+    std::set<ThreadCache*> caches_;
+    std::mutex arena_mutex_;
+    std::multimap<size_t, void*> arena_;
+    size_t arena_bytes_ = 0;
+    size_t arena_limit_ = size_t(1) << 30;
+};
+
+struct RunStats {
+    uint64_t peak_bytes = 0;    // Most bytes live at once during the run.
+    uint64_t total_bytes = 0;   // Sum of all allocations.
+    uint64_t allocations = 0;
+    uint64_t largest_bytes = 0; // Largest single allocation.
+};
+
+class Tracker {
+public:
+    static Tracker& get() {
+        static Tracker tracker;
+        return tracker;
+    }
+
+    // Routes halide_malloc/halide_free through the tracker (and the Pool,
+    // once enabled). Before this (and after uninstall) nothing is counted. Only switch while no
+    // pipeline is running: the pipelines free everything they allocate
+    // before returning, but a block must go back to the allocator it came
+    // from.
+    static void install() {
+        halide_set_custom_malloc(&tracked_malloc);
+        halide_set_custom_free(&tracked_free);
+    }
+    static void uninstall() {
+        halide_set_custom_malloc(&halide_default_malloc);
+        halide_set_custom_free(&halide_default_free);
+    }
+
+    void begin_run() {
+        peak_.store(static_cast<uint64_t>(std::max<int64_t>(0, live_.load())));
+        total_.store(0);
+        count_.store(0);
+        largest_.store(0);
+    }
+
+    RunStats end_run() {
+        RunStats run;
+        run.peak_bytes = peak_.load();
+        run.total_bytes = total_.load();
+        run.allocations = count_.load();
+        run.largest_bytes = largest_.load();
+        runs_.fetch_add(1);
+        store_max(worst_peak_, run.peak_bytes);
+        store_max(worst_allocations_, run.allocations);
+        store_max(worst_largest_, run.largest_bytes);
+        return run;
+    }
+
+    int64_t live_bytes() const { return live_.load(); }
+    uint64_t runs() const { return runs_.load(); }
+
+    // The worst of every run since startup, for a report at exit.
+    RunStats worst_run() const {
+        RunStats run;
+        run.peak_bytes = worst_peak_.load();
+        run.allocations = worst_allocations_.load();
+        run.largest_bytes = worst_largest_.load();
+        return run;
+    }
+
+private:
+    // Halide vectorizes loads past the end of a buffer up to the alignment,
+    // as its own allocator allows; sizes are rounded up the same way.
+    static constexpr size_t kAlignment = 128;
+
+    struct Header {
+        void* base;
+        size_t capacity; // Of the block at base, for Pool::give.
+        size_t size;
+    };
+
+    static void* tracked_malloc(void* /*user_context*/, size_t size) {
+        const size_t padded = (size + kAlignment - 1) & ~(kAlignment - 1);
+        size_t capacity = padded + kAlignment + sizeof(Header);
+        void* base = Pool::get().take(capacity);
+        if (!base) return nullptr;
+        const uintptr_t start = reinterpret_cast<uintptr_t>(base) + sizeof(Header);
+        void* ptr = reinterpret_cast<void*>((start + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1));
+        Header* header = static_cast<Header*>(ptr) - 1;
+        header->base = base;
+        header->capacity = capacity;
+        header->size = padded;
+
+        Tracker& t = get();
+        const int64_t live = t.live_.fetch_add(static_cast<int64_t>(padded)) + static_cast<int64_t>(padded);
+        store_max(t.peak_, static_cast<uint64_t>(live));
+        store_max(t.largest_, padded);
+        t.total_.fetch_add(padded);
+        t.count_.fetch_add(1);
+        return ptr;
+    }
+
+    static void tracked_free(void* /*user_context*/, void* ptr) {
+        if (!ptr) return;
+        Header* header = static_cast<Header*>(ptr) - 1;
+        get().live_.fetch_sub(static_cast<int64_t>(header->size));
+        Pool::get().give(header->base, header->capacity);
+    }
+
+    static void store_max(std::atomic<uint64_t>& target, uint64_t value) {
+        uint64_t current = target.load(std::memory_order_relaxed);
+        while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    std::atomic<int64_t> live_{0};
+    std::atomic<uint64_t> peak_{0}, total_{0}, count_{0}, largest_{0};
+    std::atomic<uint64_t> runs_{0}, worst_peak_{0}, worst_allocations_{0}, worst_largest_{0};
+};
+
+} // namespace HalideMemory
+
+#endif // HALIDE_MEMORY_H
@@ -0,0 +1,667 @@
+#include "image_encoders.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+// To enable JPEG output, compile with -DUSE_LIBJPEG and link against
+// libjpeg(-turbo).
+#ifdef USE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+namespace ImageEncoders {
+
+namespace { // Anonymous namespace for local helpers
+
+using Image = Halide::Runtime::Buffer<uint8_t, 3>;
+
+// Hands out rows of the image as interleaved bytes. An interleaved buffer is
+// read in place; anything else is gathered into a one-row scratch buffer.
+class RowReader {
+public:
+    RowReader(const Image& image, int out_channels)
+        : image_(image), channels_(out_channels) {
+        in_place_ = image.dim(0).stride() == image.channels() && image.dim(2).stride() == 1 &&
+                    out_channels == image.channels();
+        if (!in_place_) scratch_.resize(static_cast<size_t>(image.width()) * out_channels);
+    }
+
+    // Row y, counted from the top of the image (not from dim(1).min()).
+    const uint8_t* row(int y) {
+        const int x0 = image_.dim(0).min(), y0 = image_.dim(1).min(), c0 = image_.dim(2).min();
+        if (in_place_) return &image_(x0, y0 + y, c0);
+        uint8_t* out = scratch_.data();
+        for (int x = 0; x < image_.width(); ++x) {
+            for (int c = 0; c < channels_; ++c) {
+                *out++ = image_(x0 + x, y0 + y, c0 + c);
+            }
+        }
+        return scratch_.data();
+    }
+
+private:
+    const Image& image_;
+    int channels_;
+    bool in_place_;
+    std::vector<uint8_t> scratch_;
+};
+
+struct FileCloser {
+    void operator()(FILE* f) const { if (f) fclose(f); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+FilePtr open_for_write(const std::string& path) {
+    FilePtr f(fopen(path.c_str(), "wb"));
+    if (!f) throw std::runtime_error("Cannot open " + path + " for writing");
+    return f;
+}
+
+void write_all(FILE* f, const void* data, size_t size, const std::string& path) {
+    if (size && fwrite(data, 1, size, f) != size) throw std::runtime_error("Write failed: " + path);
+}
+
+// --- PNG ---
+
+void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+void write_png_chunk(FILE* f, const char type[4], const uint8_t* data, size_t size, const std::string& path) {
+    std::vector<uint8_t> header;
+    put_be32(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    if (size) crc = crc32(crc, data, static_cast<uInt>(size));
+    std::vector<uint8_t> trailer;
+    put_be32(trailer, static_cast<uint32_t>(crc));
+    write_all(f, header.data(), header.size(), path);
+    write_all(f, data, size, path);
+    write_all(f, trailer.data(), trailer.size(), path);
+}
+
+inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    if (pb <= pc) return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+
+// Filters one row into out[0..bytes] (filter byte first). prev is null for
+// the top row.
+void filter_row(PngFilter filter, const uint8_t* row, const uint8_t* prev, size_t bytes, int bpp, uint8_t* out) {
+    auto apply = [&](int type, uint8_t* dst) {
+        dst[0] = static_cast<uint8_t>(type);
+        for (size_t i = 0; i < bytes; ++i) {
+            int a = i >= static_cast<size_t>(bpp) ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= static_cast<size_t>(bpp)) ? prev[i - bpp] : 0;
+            int pred = 0;
+            switch (type) {
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = (a + b) / 2; break;
+                case 4: pred = paeth(a, b, c); break;
+                default: break;
+            }
+            dst[i + 1] = static_cast<uint8_t>(row[i] - pred);
+        }
+    };
+
+    switch (filter) {
+        case PngFilter::None: apply(0, out); return;
+        case PngFilter::Sub: apply(1, out); return;
+        case PngFilter::Up: apply(2, out); return;
+        case PngFilter::Paeth: apply(4, out); return;
+        case PngFilter::Adaptive: break;
+    }
+
+    // Pick the filter with the smallest sum of absolute (signed) residuals,
+    // the usual libpng heuristic.
+    std::vector<uint8_t> candidate(bytes + 1);
+    uint64_t best = UINT64_MAX;
+    for (int type = 0; type <= 4; ++type) {
+        apply(type, candidate.data());
+        uint64_t sum = 0;
+        for (size_t i = 1; i <= bytes; ++i) sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(candidate[i])));
+        if (sum < best) {
+            best = sum;
+            std::copy(candidate.begin(), candidate.end(), out);
+        }
+    }
+}
+
+struct DeflatedStrip {
+    std::vector<uint8_t> data;
+    uLong adler = 1;
+    size_t raw_size = 0;
+};
+
+// Filters and deflates rows [y_begin, y_end) as a raw deflate fragment. All
+// but the last strip end on a sync flush, so the fragments concatenate into
+// one valid stream. `above` is the row before the image's first row (from the
+// previous band), or null at the top of the file.
+void deflate_strip(const Image& image, int channels, int y_begin, int y_end, bool last,
+                   const uint8_t* above, const EncodeOptions& options, DeflatedStrip& strip) {
+    const size_t bytes = static_cast<size_t>(image.width()) * channels;
+    RowReader current(image, channels), previous(image, channels);
+    std::vector<uint8_t> prev_row, filtered(bytes + 1);
+
+    z_stream zs = {};
+    if (deflateInit2(&zs, options.png_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::vector<uint8_t> out(deflateBound(&zs, static_cast<uLong>((bytes + 1) * (y_end - y_begin))) + 64);
+    zs.next_out = out.data();
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    const uint8_t* prev = above;
+    if (y_begin > 0) {
+        const uint8_t* p = previous.row(y_begin - 1);
+        prev_row.assign(p, p + bytes);
+        prev = prev_row.data();
+    }
+    for (int y = y_begin; y < y_end; ++y) {
+        const uint8_t* row = current.row(y);
+        filter_row(options.png_filter, row, prev, bytes, channels, filtered.data());
+        strip.adler = adler32(strip.adler, filtered.data(), static_cast<uInt>(filtered.size()));
+        strip.raw_size += filtered.size();
+
+        zs.next_in = filtered.data();
+        zs.avail_in = static_cast<uInt>(filtered.size());
+        int flush = (y + 1 == y_end) ? (last ? Z_FINISH : Z_SYNC_FLUSH) : Z_NO_FLUSH;
+        int ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR || zs.avail_in != 0) {
+            deflateEnd(&zs);
+            throw std::runtime_error("deflate failed");
+        }
+        prev_row.assign(row, row + bytes);
+        prev = prev_row.data();
+    }
+    out.resize(out.size() - zs.avail_out);
+    strip.data = std::move(out);
+    deflateEnd(&zs);
+}
+
+} // namespace
+
+namespace detail {
+
+// Base for the per-format writers behind RowStreamWriter.
+class StreamEncoder {
+public:
+    StreamEncoder(const std::string& path, int width, int height, int channels)
+        : path_(path), width_(width), height_(height), channels_(channels), file_(open_for_write(path)) {}
+    virtual ~StreamEncoder() = default;
+
+    // Encodes the band's rows, which follow those already written.
+    virtual void write_rows(const Image& band) = 0;
+    // Writes whatever follows the last row.
+    virtual void finish() = 0;
+
+protected:
+    void write(const void* data, size_t size) { write_all(file_.get(), data, size, path_); }
+
+    std::string path_;
+    int width_, height_, channels_;
+    FilePtr file_;
+};
+
+} // namespace detail
+
+namespace {
+
+using detail::StreamEncoder;
+
+class PngEncoder : public StreamEncoder {
+public:
+    PngEncoder(const std::string& path, int width, int height, int channels, const EncodeOptions& options)
+        : StreamEncoder(path, width, height, channels), options_(options) {
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        write(signature, sizeof(signature));
+
+        std::vector<uint8_t> ihdr;
+        put_be32(ihdr, static_cast<uint32_t>(width));
+        put_be32(ihdr, static_cast<uint32_t>(height));
+        ihdr.push_back(8);                         // bit depth
+        ihdr.push_back(channels == 4 ? 6 : 2);     // RGBA / RGB
+        ihdr.push_back(0);                         // deflate
+        ihdr.push_back(0);                         // adaptive filtering
+        ihdr.push_back(0);                         // no interlace
+        write_png_chunk(file_.get(), "IHDR", ihdr.data(), ihdr.size(), path_);
+
+        // One zlib stream across all bands: header, the concatenated strips,
+        // combined Adler-32.
+        idat_ = {0x78, 0x9c};
+    }
+
+    void write_rows(const Image& band) override {
+        const int rows = band.height();
+        const bool last_band = rows_done_ + rows == height_;
+        // With the shared pool running the strips go to its workers rather
+        // than threads of their own.
+        ThreadPool& pool = ThreadPool::get();
+        const int cores = pool.running() ? pool.size() : static_cast<int>(std::thread::hardware_concurrency());
+        int strips = options_.png_strips > 0 ? options_.png_strips : std::max(1, cores);
+        strips = std::max(1, std::min(strips, rows / 16));
+
+        const uint8_t* above = above_.empty() ? nullptr : above_.data();
+        std::vector<DeflatedStrip> parts(strips);
+        std::vector<std::exception_ptr> errors(strips);
+        auto work = [&](int s) {
+            int y_begin = static_cast<int>(static_cast<int64_t>(rows) * s / strips);
+            int y_end = static_cast<int>(static_cast<int64_t>(rows) * (s + 1) / strips);
+            try {
+                deflate_strip(band, channels_, y_begin, y_end, last_band && s + 1 == strips, above,
+                              options_, parts[s]);
+            } catch (...) {
+                errors[s] = std::current_exception();
+            }
+        };
+        if (strips == 1) {
+            work(0);
+        } else if (pool.running()) {
+            pool.parallel_for(0, strips, work);
+        } else {
+            std::vector<std::thread> workers;
+            for (int s = 0; s < strips; ++s) workers.emplace_back(work, s);
+            for (auto& t : workers) t.join();
+        }
+        for (auto& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+
+        for (const auto& part : parts) {
+            idat_.insert(idat_.end(), part.data.begin(), part.data.end());
+            adler_ = adler32_combine(adler_, part.adler, static_cast<z_off_t>(part.raw_size));
+        }
+        size_t written = 0;
+        while (idat_.size() - written >= kMaxChunk) {
+            write_png_chunk(file_.get(), "IDAT", idat_.data() + written, kMaxChunk, path_);
+            written += kMaxChunk;
+        }
+        idat_.erase(idat_.begin(), idat_.begin() + written);
+
+        RowReader reader(band, channels_);
+        const uint8_t* r = reader.row(rows - 1);
+        above_.assign(r, r + static_cast<size_t>(width_) * channels_);
+        rows_done_ += rows;
+    }
+
+    void finish() override {
+        put_be32(idat_, static_cast<uint32_t>(adler_));
+        write_png_chunk(file_.get(), "IDAT", idat_.data(), idat_.size(), path_);
+        write_png_chunk(file_.get(), "IEND", nullptr, 0, path_);
+    }
+
+private:
+    static constexpr size_t kMaxChunk = 1 << 20;
+
+    EncodeOptions options_;
+    std::vector<uint8_t> idat_;   // Compressed data not yet written out.
+    std::vector<uint8_t> above_;  // Last row of the previous band.
+    uLong adler_ = 1;
+    int rows_done_ = 0;
+};
+
+// --- JPEG ---
+
+#ifdef USE_LIBJPEG
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegError* err = reinterpret_cast<JpegError*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jump, 1);
+}
+
+class JpegEncoder : public StreamEncoder {
+public:
+    JpegEncoder(const std::string& path, int width, int height, int channels, const EncodeOptions& options)
+        : StreamEncoder(path, width, height, channels) {
+        cinfo_.err = jpeg_std_error(&err_.mgr);
+        err_.mgr.error_exit = jpeg_error_exit;
+        if (setjmp(err_.jump)) fail();
+        jpeg_create_compress(&cinfo_);
+        created_ = true;
+        jpeg_stdio_dest(&cinfo_, file_.get());
+        cinfo_.image_width = static_cast<JDIMENSION>(width);
+        cinfo_.image_height = static_cast<JDIMENSION>(height);
+        cinfo_.input_components = 3;
+        cinfo_.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&cinfo_);
+        jpeg_set_quality(&cinfo_, std::max(1, std::min(100, options.jpeg_quality)), TRUE);
+        cinfo_.comp_info[0].h_samp_factor = options.jpeg_subsampling == 444 ? 1 : 2;
+        cinfo_.comp_info[0].v_samp_factor = options.jpeg_subsampling == 420 ? 2 : 1;
+        cinfo_.dct_method = JDCT_ISLOW;
+        jpeg_start_compress(&cinfo_, TRUE);
+    }
+
+    ~JpegEncoder() override {
+        if (created_) jpeg_destroy_compress(&cinfo_);
+    }
+
+    void write_rows(const Image& band) override {
+        // JPEG has no alpha; RGBA buffers are read as RGB.
+        RowReader rows(band, 3);
+        if (setjmp(err_.jump)) fail();
+        for (int y = 0; y < band.height(); ++y) {
+            JSAMPROW row = const_cast<JSAMPROW>(rows.row(y));
+            jpeg_write_scanlines(&cinfo_, &row, 1);
+        }
+    }
+
+    void finish() override {
+        if (setjmp(err_.jump)) fail();
+        jpeg_finish_compress(&cinfo_);
+    }
+
+private:
+    [[noreturn]] void fail() {
+        if (created_) jpeg_destroy_compress(&cinfo_);
+        created_ = false;
+        throw std::runtime_error(std::string("JPEG encode failed: ") + err_.message);
+    }
+
+    jpeg_compress_struct cinfo_;
+    JpegError err_;
+    bool created_ = false;
+};
+#endif // USE_LIBJPEG
+
+// --- TIFF ---
+
+// TIFF-flavoured LZW: MSB-first codes of 9-12 bits, starting with a clear
+// code and widening one code early, as libtiff does.
+class LzwEncoder {
+public:
+    explicit LzwEncoder(std::vector<uint8_t>& out) : out_(out) { reset(); put(kClear); }
+
+    void add(const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            uint8_t c = data[i];
+            if (prefix_ < 0) {
+                prefix_ = c;
+                continue;
+            }
+            uint32_t key = (static_cast<uint32_t>(prefix_) << 8) | c;
+            auto it = table_.find(key);
+            if (it != table_.end()) {
+                prefix_ = it->second;
+                continue;
+            }
+            put(prefix_);
+            table_.emplace(key, next_code_++);
+            bump();
+            prefix_ = c;
+        }
+    }
+
+    void finish() {
+        if (prefix_ >= 0) {
+            put(prefix_);
+            next_code_++;
+            bump();
+        }
+        put(kEoi);
+        if (bit_count_ > 0) out_.push_back(static_cast<uint8_t>(bit_buffer_ << (8 - bit_count_)));
+        bit_count_ = 0;
+    }
+
+private:
+    static constexpr int kClear = 256, kEoi = 257, kMaxCode = 4095;
+
+    void reset() {
+        table_.clear();
+        next_code_ = 258;
+        width_ = 9;
+    }
+
+    void bump() {
+        if (next_code_ == kMaxCode - 1) {
+            put(kClear);
+            reset();
+        } else if (next_code_ > (1 << width_) - 1) {
+            width_++;
+        }
+    }
+
+    void put(int code) {
+        bit_buffer_ = (bit_buffer_ << width_) | static_cast<uint32_t>(code);
+        bit_count_ += width_;
+        while (bit_count_ >= 8) {
+            bit_count_ -= 8;
+            out_.push_back(static_cast<uint8_t>(bit_buffer_ >> bit_count_));
+        }
+        bit_buffer_ &= (1u << bit_count_) - 1;
+    }
+
+    std::vector<uint8_t>& out_;
+    std::unordered_map<uint32_t, int> table_;
+    int next_code_ = 258;
+    int width_ = 9;
+    int prefix_ = -1;
+    uint32_t bit_buffer_ = 0;
+    int bit_count_ = 0;
+};
+
+void put_le16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put_le32(std::vector<uint8_t>& out, uint32_t v) {
+    put_le16(out, static_cast<uint16_t>(v));
+    put_le16(out, static_cast<uint16_t>(v >> 16));
+}
+
+class TiffEncoder : public StreamEncoder {
+public:
+    TiffEncoder(const std::string& path, int width, int height, int channels, const EncodeOptions& options)
+        : StreamEncoder(path, width, height, channels),
+          row_bytes_(static_cast<size_t>(width) * channels),
+          rows_per_strip_(std::max<int>(1, static_cast<int>((64 * 1024) / std::max<size_t>(1, row_bytes_)))),
+          lzw_(options.tiff_compression == TiffCompression::LZW) {
+        std::vector<uint8_t> header = {'I', 'I', 42, 0, 0, 0, 0, 0}; // IFD offset patched in finish()
+        write(header.data(), header.size());
+        pos_ = static_cast<uint32_t>(header.size());
+    }
+
+    // Rows are collected into strips, which go straight after the header.
+    void write_rows(const Image& band) override {
+        RowReader rows(band, channels_);
+        for (int y = 0; y < band.height(); ++y) {
+            const uint8_t* r = rows.row(y);
+            pending_.insert(pending_.end(), r, r + row_bytes_);
+            if (++pending_rows_ == rows_per_strip_) flush_strip();
+        }
+    }
+
+    void finish() override {
+        if (pending_rows_ > 0) flush_strip();
+        if (pos_ & 1) {
+            const uint8_t pad = 0;
+            write(&pad, 1);
+            pos_++;
+        }
+
+        // Out-of-line tag values live after the IFD.
+        struct Tag { uint16_t id, type; uint32_t count; std::vector<uint8_t> value; };
+        auto short_tag = [](uint16_t id, std::vector<uint16_t> v) {
+            Tag t{id, 3, static_cast<uint32_t>(v.size()), {}};
+            for (uint16_t x : v) put_le16(t.value, x);
+            return t;
+        };
+        auto long_tag = [](uint16_t id, const std::vector<uint32_t>& v) {
+            Tag t{id, 4, static_cast<uint32_t>(v.size()), {}};
+            for (uint32_t x : v) put_le32(t.value, x);
+            return t;
+        };
+        auto rational_tag = [](uint16_t id, uint32_t num, uint32_t den) {
+            Tag t{id, 5, 1, {}};
+            put_le32(t.value, num);
+            put_le32(t.value, den);
+            return t;
+        };
+
+        std::vector<Tag> tags;
+        tags.push_back(long_tag(256, {static_cast<uint32_t>(width_)}));
+        tags.push_back(long_tag(257, {static_cast<uint32_t>(height_)}));
+        tags.push_back(short_tag(258, std::vector<uint16_t>(channels_, 8)));
+        tags.push_back(short_tag(259, {static_cast<uint16_t>(lzw_ ? 5 : 1)}));
+        tags.push_back(short_tag(262, {2})); // RGB
+        tags.push_back(long_tag(273, offsets_));
+        tags.push_back(short_tag(277, {static_cast<uint16_t>(channels_)}));
+        tags.push_back(long_tag(278, {static_cast<uint32_t>(rows_per_strip_)}));
+        tags.push_back(long_tag(279, counts_));
+        tags.push_back(rational_tag(282, 72, 1));
+        tags.push_back(rational_tag(283, 72, 1));
+        tags.push_back(short_tag(284, {1})); // chunky
+        tags.push_back(short_tag(296, {2})); // inch
+        if (channels_ == 4) tags.push_back(short_tag(338, {2})); // unassociated alpha
+
+        const uint32_t ifd_offset = pos_;
+        uint32_t extra_offset = ifd_offset + 2 + static_cast<uint32_t>(tags.size()) * 12 + 4;
+        std::vector<uint8_t> ifd, extra;
+        put_le16(ifd, static_cast<uint16_t>(tags.size()));
+        for (const auto& t : tags) {
+            put_le16(ifd, t.id);
+            put_le16(ifd, t.type);
+            put_le32(ifd, t.count);
+            if (t.value.size() <= 4) {
+                std::vector<uint8_t> inline_value = t.value;
+                inline_value.resize(4, 0);
+                ifd.insert(ifd.end(), inline_value.begin(), inline_value.end());
+            } else {
+                put_le32(ifd, extra_offset + static_cast<uint32_t>(extra.size()));
+                extra.insert(extra.end(), t.value.begin(), t.value.end());
+                if (extra.size() & 1) extra.push_back(0);
+            }
+        }
+        put_le32(ifd, 0); // no next IFD
+        write(ifd.data(), ifd.size());
+        write(extra.data(), extra.size());
+
+        std::vector<uint8_t> ifd_pointer;
+        put_le32(ifd_pointer, ifd_offset);
+        if (fseek(file_.get(), 4, SEEK_SET) != 0) throw std::runtime_error("Write failed: " + path_);
+        write(ifd_pointer.data(), ifd_pointer.size());
+    }
+
+private:
+    void flush_strip() {
+        const std::vector<uint8_t>* data = &pending_;
+        if (lzw_) {
+            encoded_.clear();
+            LzwEncoder enc(encoded_);
+            enc.add(pending_.data(), pending_.size());
+            enc.finish();
+            data = &encoded_;
+        }
+        write(data->data(), data->size());
+        offsets_.push_back(pos_);
+        counts_.push_back(static_cast<uint32_t>(data->size()));
+        pos_ += static_cast<uint32_t>(data->size());
+        pending_.clear();
+        pending_rows_ = 0;
+    }
+
+    size_t row_bytes_;
+    int rows_per_strip_;
+    bool lzw_;
+    std::vector<uint8_t> pending_, encoded_;
+    int pending_rows_ = 0;
+    std::vector<uint32_t> offsets_, counts_;
+    uint32_t pos_ = 0;
+};
+
+std::unique_ptr<StreamEncoder> make_encoder(const std::string& path, int width, int height, int channels,
+                                            const EncodeOptions& options) {
+    if (channels != 3 && channels != 4) {
+        throw std::runtime_error("Image encoders expect 3 or 4 channels");
+    }
+    Format format = options.format == Format::Auto ? format_for_path(path) : options.format;
+    switch (format) {
+        case Format::PNG: return std::make_unique<PngEncoder>(path, width, height, channels, options);
+        case Format::TIFF: return std::make_unique<TiffEncoder>(path, width, height, channels, options);
+        case Format::JPEG:
+#ifdef USE_LIBJPEG
+            return std::make_unique<JpegEncoder>(path, width, height, channels, options);
+#else
+            throw std::runtime_error("JPEG output needs a build with libjpeg (USE_LIBJPEG)");
+#endif
+        case Format::Auto: break;
+    }
+    throw std::runtime_error("Unknown output format for " + path);
+}
+
+} // namespace
+
+Format format_for_path(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return Format::Auto;
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "png") return Format::PNG;
+    if (ext == "jpg" || ext == "jpeg") return Format::JPEG;
+    if (ext == "tif" || ext == "tiff") return Format::TIFF;
+    return Format::Auto;
+}
+
+bool is_supported(Format format) {
+#ifndef USE_LIBJPEG
+    if (format == Format::JPEG) return false;
+#endif
+    return format != Format::Auto;
+}
+
+RowStreamWriter::RowStreamWriter(const std::string& path, int width, int height, int channels,
+                                 const EncodeOptions& options)
+    : height_(height), channels_(channels), encoder_(make_encoder(path, width, height, channels, options)) {}
+
+RowStreamWriter::~RowStreamWriter() = default;
+
+void RowStreamWriter::write_rows(const Image& band) {
+    if (!encoder_ || band.channels() != channels_ || band.height() > height_ - rows_written_) {
+        throw std::runtime_error("Band does not fit the image being written");
+    }
+    if (band.height() == 0) return;
+    encoder_->write_rows(band);
+    rows_written_ += band.height();
+}
+
+void RowStreamWriter::finish() {
+    if (rows_written_ != height_) {
+        throw std::runtime_error("Image finished after " + std::to_string(rows_written_) + " of " +
+                                 std::to_string(height_) + " rows");
+    }
+    encoder_->finish();
+    encoder_.reset();
+}
+
+void save_image(const Image& image, const std::string& path, const EncodeOptions& options) {
+    RowStreamWriter writer(path, image.width(), image.height(), image.channels(), options);
+    writer.write_rows(image);
+    writer.finish();
+}
+
+} // namespace ImageEncoders
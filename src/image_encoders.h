@@ -0,0 +1,72 @@
+#ifndef IMAGE_ENCODERS_H
+#define IMAGE_ENCODERS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "HalideBuffer.h"
+
+// Encoders for the pipeline's 8-bit RGB/RGBA output. They read the buffer in
+// whatever layout the pipeline produced (planar or interleaved) one row at a
+// time, so no converted copy of the frame is made, and are considerably
+// faster than Halide::Tools::convert_and_save_image.
+namespace ImageEncoders {
+
+enum class Format { Auto, PNG, JPEG, TIFF };
+
+enum class PngFilter { None, Sub, Up, Paeth, Adaptive };
+
+enum class TiffCompression { None, LZW };
+
+struct EncodeOptions {
+    Format format = Format::Auto; // Auto picks from the file extension.
+
+    int jpeg_quality = 92;        // 1-100
+    int jpeg_subsampling = 420;   // 444, 422 or 420
+
+    int png_level = 6;            // zlib level, 0-9
+    PngFilter png_filter = PngFilter::Up;
+    int png_strips = 0;           // Rows are deflated in this many strips in parallel. 0 = one per core.
+
+    TiffCompression tiff_compression = TiffCompression::None;
+};
+
+// Returns the format for a path's extension, or Auto if it isn't one of ours.
+Format format_for_path(const std::string& path);
+
+// True if this build can write `format` (JPEG needs libjpeg).
+bool is_supported(Format format);
+
+namespace detail { class StreamEncoder; }
+
+// Writes an image a band of rows at a time, top to bottom, so the whole
+// frame never has to be in memory. Bands may be any height; each is encoded
+// as it arrives. Throws std::runtime_error on failure.
+class RowStreamWriter {
+public:
+    RowStreamWriter(const std::string& path, int width, int height, int channels,
+                    const EncodeOptions& options = EncodeOptions());
+    ~RowStreamWriter();
+
+    // Appends a (width, rows, channels) band below the rows already written.
+    void write_rows(const Halide::Runtime::Buffer<uint8_t, 3>& band);
+    // Completes the file. All `height` rows must have been written.
+    void finish();
+
+    int rows_written() const { return rows_written_; }
+
+private:
+    int height_;
+    int channels_;
+    int rows_written_ = 0;
+    std::unique_ptr<detail::StreamEncoder> encoder_;
+};
+
+// Writes a (width, height, 3 or 4) buffer. Throws std::runtime_error on
+// failure or if the format can't be determined.
+void save_image(const Halide::Runtime::Buffer<uint8_t, 3>& image, const std::string& path,
+                const EncodeOptions& options = EncodeOptions());
+
+} // namespace ImageEncoders
+
+#endif // IMAGE_ENCODERS_H
@@ -0,0 +1,209 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace_events.h"
+
+// Named timers, counters, byte counters and peaks shared by process and rawr.
+//
+// Timers keep a log-bucketed latency histogram (four buckets per octave from
+// 1 us), so repeated scopes - editor renders, batch files - give a
+// distribution rather than one line each. ScopedTimers nest per thread: a
+// timer opened inside another is recorded as "outer/inner". Every scope is
+// also added to the Chrome trace while one is recorded (trace_events.h).
+namespace Instrumentation {
+
+class LatencyHistogram {
+public:
+    static constexpr int kBucketsPerOctave = 4;
+    static constexpr int kBuckets = 27 * kBucketsPerOctave; // 1 us .. ~134 s
+
+    void add(double ms) {
+        const double us = std::max(ms * 1000.0, 1.0);
+        const int b = std::min(kBuckets - 1, static_cast<int>(std::log2(us) * kBucketsPerOctave));
+        buckets_[b]++;
+        count_++;
+        total_ms_ += ms;
+        min_ms_ = count_ == 1 ? ms : std::min(min_ms_, ms);
+        max_ms_ = std::max(max_ms_, ms);
+    }
+
+    // The p-th quantile (0..1), as the geometric middle of the bucket it falls
+    // in, clamped to the observed range.
+    double percentile(double p) const {
+        if (count_ == 0) return 0.0;
+        const uint64_t rank = static_cast<uint64_t>(std::ceil(p * count_));
+        uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += buckets_[b];
+            if (seen >= std::max<uint64_t>(rank, 1)) {
+                const double mid_us = std::exp2((b + 0.5) / kBucketsPerOctave);
+                return std::min(max_ms_, std::max(min_ms_, mid_us / 1000.0));
+            }
+        }
+        return max_ms_;
+    }
+
+    uint64_t count() const { return count_; }
+    double total_ms() const { return total_ms_; }
+    double mean_ms() const { return count_ ? total_ms_ / count_ : 0.0; }
+    double min_ms() const { return min_ms_; }
+    double max_ms() const { return max_ms_; }
+
+private:
+    std::array<uint32_t, kBuckets> buckets_{};
+    uint64_t count_ = 0;
+    double total_ms_ = 0.0, min_ms_ = 0.0, max_ms_ = 0.0;
+};
+
+class Registry {
+public:
+    static Registry& get() {
+        static Registry registry;
+        return registry;
+    }
+
+    void record_time(const std::string& name, double ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_[name].add(ms);
+    }
+    void add_count(const std::string& name, int64_t n = 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_[name] += n;
+    }
+    void add_bytes(const std::string& name, uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_[name] += bytes;
+    }
+    // Keeps the largest value seen, e.g. a per-run memory peak.
+    void record_peak_bytes(const std::string& name, uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t& peak = peaks_[name];
+        peak = std::max(peak, bytes);
+    }
+
+    // A copy of the named timer (empty if it was never recorded).
+    LatencyHistogram timer(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = timers_.find(name);
+        return it == timers_.end() ? LatencyHistogram() : it->second;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_.clear();
+        counters_.clear();
+        bytes_.clear();
+        peaks_.clear();
+    }
+
+    // One line per timer (sorted by name, so nested timers follow their
+    // parent), then the counters.
+    void print_summary(FILE* out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (timers_.empty() && counters_.empty() && bytes_.empty() && peaks_.empty()) return;
+        fprintf(out, "\n%-44s %7s %10s %10s %10s %10s %10s\n", "Timer", "count", "total ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+        for (const auto& t : timers_) {
+            const LatencyHistogram& h = t.second;
+            fprintf(out, "%-44s %7llu %10.2f %10.2f %10.2f %10.2f %10.2f\n", t.first.c_str(),
+                    (unsigned long long)h.count(), h.total_ms(), h.percentile(0.5), h.percentile(0.95),
+                    h.percentile(0.99), h.max_ms());
+        }
+        for (const auto& c : counters_) fprintf(out, "%-44s %lld\n", c.first.c_str(), (long long)c.second);
+        for (const auto& b : bytes_) fprintf(out, "%-44s %.2f MB\n", b.first.c_str(), b.second / (1024.0 * 1024.0));
+        for (const auto& p : peaks_) fprintf(out, "%-44s %.2f MB peak\n", p.first.c_str(), p.second / (1024.0 * 1024.0));
+    }
+
+    bool write_json(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) return false;
+        fprintf(f, "{\n  \"timers\": {");
+        const char* sep = "\n";
+        for (const auto& t : timers_) {
+            const LatencyHistogram& h = t.second;
+            fprintf(f, "%s    \"%s\": {\"count\": %llu, \"total_ms\": %.4f, \"mean_ms\": %.4f, \"min_ms\": %.4f, "
+                       "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+                    sep, t.first.c_str(), (unsigned long long)h.count(), h.total_ms(), h.mean_ms(), h.min_ms(),
+                    h.percentile(0.5), h.percentile(0.95), h.percentile(0.99), h.max_ms());
+            sep = ",\n";
+        }
+        fprintf(f, "\n  },\n  \"counters\": {");
+        sep = "\n";
+        for (const auto& c : counters_) {
+            fprintf(f, "%s    \"%s\": %lld", sep, c.first.c_str(), (long long)c.second);
+            sep = ",\n";
+        }
+        fprintf(f, "\n  },\n  \"bytes\": {");
+        sep = "\n";
+        for (const auto& b : bytes_) {
+            fprintf(f, "%s    \"%s\": %llu", sep, b.first.c_str(), (unsigned long long)b.second);
+            sep = ",\n";
+        }
+        fprintf(f, "\n  },\n  \"peak_bytes\": {");
+        sep = "\n";
+        for (const auto& p : peaks_) {
+            fprintf(f, "%s    \"%s\": %llu", sep, p.first.c_str(), (unsigned long long)p.second);
+            sep = ",\n";
+        }
+        fprintf(f, "\n  }\n}\n");
+        fclose(f);
+        return true;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, LatencyHistogram> timers_;
+    std::map<std::string, int64_t> counters_;
+    std::map<std::string, uint64_t> bytes_;
+    std::map<std::string, uint64_t> peaks_;
+};
+
+// Times a scope into the registry (and the trace), nested under the
+// ScopedTimer enclosing it on the same thread.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const std::string& name)
+        : name_(name), start_(TraceEvents::Clock::now()) {
+        std::vector<std::string>& stack = scope_stack();
+        path_ = stack.empty() ? name_ : stack.back() + "/" + name_;
+        stack.push_back(path_);
+    }
+
+    ~ScopedTimer() {
+        const auto end = TraceEvents::Clock::now();
+        scope_stack().pop_back();
+        Registry::get().record_time(path_, std::chrono::duration<double, std::milli>(end - start_).count());
+        TraceEvents::Recorder::get().complete(name_, "host", start_, end);
+    }
+
+    double elapsed_ms() const {
+        return std::chrono::duration<double, std::milli>(TraceEvents::Clock::now() - start_).count();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    static std::vector<std::string>& scope_stack() {
+        thread_local std::vector<std::string> stack;
+        return stack;
+    }
+
+    std::string name_, path_;
+    TraceEvents::Clock::time_point start_;
+};
+
+} // namespace Instrumentation
+
+#endif // INSTRUMENTATION_H
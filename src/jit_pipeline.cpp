@@ -0,0 +1,142 @@
+#include "jit_pipeline.h"
+#include "camera_metadata_cache.h" // For openraw_cache_dir()
+
+#include "Halide.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <dlfcn.h>
+#include <unistd.h>
+
+namespace JitPipeline {
+
+namespace { // Anonymous namespace for local helpers
+
+constexpr const char* kFunctionName = "camera_pipe_f32_jit";
+
+std::string digest(const std::string& text) {
+    uint64_t h = 14695981039346656037ull; // FNV-1a
+    for (unsigned char ch : text) {
+        h = (h ^ ch) * 1099511628211ull;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    return hex;
+}
+
+// Runs the generator in process, as the build does, to write
+// <dir>/<name>.o. The runtime is left out: the executable has one.
+bool compile_object(const std::vector<std::string>& params, const std::string& dir, const std::string& name) {
+    std::vector<std::string> args = {"jit_pipeline", "-g", "camera_pipe_f32", "-f", kFunctionName,
+                                     "-o", dir, "-n", name, "-e", "object", "target=host-no_runtime"};
+    args.insert(args.end(), params.begin(), params.end());
+    std::vector<char*> argv;
+    for (std::string& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    try {
+        return Halide::Internal::generate_filter_main(static_cast<int>(args.size()), argv.data()) == 0;
+    } catch (const std::exception& e) {
+        fprintf(stderr, "JIT: generator failed: %s\n", e.what());
+        return false;
+    }
+}
+
+// Links the object into a shared library at `path`, through a temporary
+// file renamed into place so concurrent runs never load a partial one.
+bool link_library(const std::string& object, const std::string& path) {
+    const char* cxx = getenv("CXX");
+    const std::string tmp = path + ".tmp" + std::to_string(static_cast<long>(getpid()));
+    const std::string cmd = std::string(cxx && *cxx ? cxx : "c++") + " -shared -o '" + tmp + "' '" + object + "'";
+    if (std::system(cmd.c_str()) != 0) {
+        fprintf(stderr, "JIT: link failed: %s\n", cmd.c_str());
+        std::remove(tmp.c_str());
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+CameraPipeFn load_library(const std::string& path) {
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "JIT: can't load %s: %s\n", path.c_str(), dlerror());
+        return nullptr;
+    }
+    // Kept open for the life of the process.
+    return reinterpret_cast<CameraPipeFn>(dlsym(handle, kFunctionName));
+}
+
+} // namespace
+
+std::vector<std::string> Specialization::generator_params() const {
+    std::vector<std::string> params;
+    if (width > 0 && height > 0) {
+        params.push_back("bind_width=" + std::to_string(width));
+        params.push_back("bind_height=" + std::to_string(height));
+    }
+    auto bind = [&](const char* name, int value) {
+        if (value >= 0) params.push_back(std::string(name) + "=" + std::to_string(value));
+    };
+    bind("bind_cfa_pattern", cfa_pattern);
+    bind("bind_black_level", black_level);
+    bind("bind_white_level", white_level);
+    bind("bind_demosaic", demosaic_id);
+    bind("bind_denoise", denoise_id);
+    if (!off.empty()) {
+        std::string stages;
+        for (const std::string& stage : off) stages += (stages.empty() ? "" : "+") + stage;
+        params.push_back("bind_off=" + stages);
+    }
+    return params;
+}
+
+CameraPipeFn get(const Specialization& spec, const std::vector<std::string>& schedule_params,
+                 const std::string& build_id) {
+    std::vector<std::string> params = schedule_params;
+    for (const std::string& param : spec.generator_params()) params.push_back(param);
+    std::string text = build_id;
+    for (const std::string& param : params) text += "\n" + param;
+    const std::string key = digest(text);
+
+    // One compile per specialization, however many threads ask for it.
+    static std::mutex mutex;
+    static std::map<std::string, CameraPipeFn> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded.find(key);
+    if (it != loaded.end()) return it->second;
+
+    CameraPipeFn fn = nullptr;
+    const std::string cache = openraw_cache_dir(true);
+    const std::string dir = cache.empty() ? "" : cache + "/jit";
+    std::error_code ec;
+    if (!dir.empty()) std::filesystem::create_directories(dir, ec);
+    if (dir.empty() || ec) {
+        fprintf(stderr, "JIT: no cache directory; using the AOT pipeline\n");
+    } else {
+        const std::string name = "camera_pipe_f32_" + key;
+        const std::string library = dir + "/" + name + ".so";
+        if (!std::filesystem::exists(library)) {
+            fprintf(stderr, "JIT: compiling camera_pipe_f32 for");
+            for (const std::string& param : spec.generator_params()) fprintf(stderr, " %s", param.c_str());
+            fprintf(stderr, "\n");
+            const std::string object = dir + "/" + name + ".o";
+            const bool built = compile_object(params, dir, name) && link_library(object, library);
+            std::remove(object.c_str());
+            if (!built) fprintf(stderr, "JIT: compile failed; using the AOT pipeline\n");
+        }
+        if (std::filesystem::exists(library)) fn = load_library(library);
+    }
+    loaded[key] = fn;
+    return fn;
+}
+
+} // namespace JitPipeline
@@ -0,0 +1,50 @@
+#ifndef JIT_PIPELINE_H
+#define JIT_PIPELINE_H
+
+#include <string>
+#include <vector>
+
+#include "camera_pipe_f32_lib.h"
+
+// camera_pipe_f32 compiled at run time for one camera and recipe
+// (process --jit, BUILD_JIT_PIPELINE).
+//
+// The AOT pipeline handles any raw size, CFA layout, level and algorithm.
+// In a batch from one camera those are the same for every file, so the
+// generator is run again with them bound as constants (the bind_* generator
+// params of CameraPipeGenerator) and the bounds, selects and boundary
+// conditions that depend on them fold away. The result has the same
+// signature as camera_pipe_f32; the bound inputs are ignored.
+//
+// Each build is compiled to an object, linked into a shared library with
+// the system compiler ($CXX, else c++) and loaded. The library is kept in
+// <openraw cache>/jit, named by a digest of the specialization and the
+// build ID, so later runs load it without compiling. It leaves the Halide
+// runtime out and uses the executable's.
+namespace JitPipeline {
+
+using CameraPipeFn = decltype(&camera_pipe_f32);
+
+// The values a build binds. -1 (0 for the size) leaves one to the caller.
+struct Specialization {
+    int width = 0, height = 0;
+    int cfa_pattern = -1;
+    int black_level = -1, white_level = -1;
+    int demosaic_id = -1, denoise_id = -1;
+    // Stages off for every run: ca, denoise, dehaze, vignette.
+    std::vector<std::string> off;
+
+    // The generator params that bind these, "name=value" each.
+    std::vector<std::string> generator_params() const;
+};
+
+// The pipeline for `spec`: loaded from the cache, or compiled and stored
+// there first. `schedule_params` are the generator params the AOT build was
+// scheduled with. Returns nullptr, after saying why on stderr, if it can't
+// be built; callers then run camera_pipe_f32.
+CameraPipeFn get(const Specialization& spec, const std::vector<std::string>& schedule_params,
+                 const std::string& build_id);
+
+} // namespace JitPipeline
+
+#endif // JIT_PIPELINE_H
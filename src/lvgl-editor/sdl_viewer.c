@@ -2,6 +2,8 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include "lvgl.h"
+#include "raw_pipeline_c.h"
+#include <stdio.h>
 
 #define SDL_MAIN_HANDLED        /*To fix SDL's "undefined reference to WinMain" issue*/
 #include <SDL2/SDL.h>
@@ -88,6 +90,57 @@ lv_obj_t* sdl_viewer_create_main_screen(void) {
     return screen;
 }
 
+static void free_draw_buf_cb(lv_event_t *e) {
+    lv_draw_buf_destroy((lv_draw_buf_t *)lv_event_get_user_data(e));
+}
+
+lv_obj_t* sdl_viewer_show_raw(lv_obj_t *parent, const char *path, const char *options) {
+    // The pipeline packs the display's own pixels, so LVGL only has to blit them.
+    lv_color_format_t cf = lv_display_get_color_format(lvDisplay);
+    raw_pipeline_display_format_t format;
+    if (cf == LV_COLOR_FORMAT_RGB565) {
+        format = RAW_PIPELINE_RGB565;
+    } else if (cf == LV_COLOR_FORMAT_ARGB8888 || cf == LV_COLOR_FORMAT_XRGB8888) {
+        format = RAW_PIPELINE_ARGB8888;
+    } else {
+        fprintf(stderr, "Error: no raw rendering for the display's color format %d\n", (int)cf);
+        return NULL;
+    }
+
+    raw_pipeline_t *pipeline = raw_pipeline_create();
+    if (!pipeline) return NULL;
+    if (raw_pipeline_set_options(pipeline, options) != 0 || raw_pipeline_load(pipeline, path) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, raw_pipeline_error(pipeline));
+        raw_pipeline_destroy(pipeline);
+        return NULL;
+    }
+
+    lv_obj_update_layout(parent);
+    int32_t width = lv_obj_get_content_width(parent);
+    int32_t height = lv_obj_get_content_height(parent);
+    lv_draw_buf_t *buf = lv_draw_buf_create(width, height, cf, LV_STRIDE_AUTO);
+    if (!buf) {
+        raw_pipeline_destroy(pipeline);
+        return NULL;
+    }
+    lv_draw_buf_clear(buf, NULL);
+    int result = raw_pipeline_render_display(pipeline, buf->data, width, height, buf->header.stride, format);
+    if (result != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, raw_pipeline_error(pipeline));
+    }
+    raw_pipeline_destroy(pipeline);
+    if (result != 0) {
+        lv_draw_buf_destroy(buf);
+        return NULL;
+    }
+
+    lv_obj_t *canvas = lv_canvas_create(parent);
+    lv_canvas_set_draw_buf(canvas, buf);
+    lv_obj_add_event_cb(canvas, free_draw_buf_cb, LV_EVENT_DELETE, buf);
+    lv_obj_center(canvas);
+    return canvas;
+}
+
 void sdl_viewer_loop(void) {
     Uint32 lastTick = SDL_GetTicks();
     while(1) {
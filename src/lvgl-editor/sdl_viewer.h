@@ -11,6 +11,12 @@ int sdl_viewer_init(void);
 // Returns a pointer to the created screen object
 lv_obj_t* sdl_viewer_create_main_screen(void);
 
+// Show the raw at `path`, rendered with the process `options` (NULL for the
+// defaults) by the raw_pipeline library straight into a canvas buffer in
+// the display's colour format, fitted to `parent`.
+// Returns the canvas, or NULL if the raw can't be loaded or rendered
+lv_obj_t* sdl_viewer_show_raw(lv_obj_t* parent, const char* path, const char* options);
+
 // Handle SDL events and LVGL tasks in an infinite loop.
 void sdl_viewer_loop(void);
 
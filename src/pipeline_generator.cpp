@@ -4,10 +4,9 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <memory>
 #include <type_traits>
-
-// Sharpening is disabled to focus on the local adjustments.
-#define NO_SHARPEN 1
+#include <stdexcept>
 
 // Include the individual pipeline stages
 #include "stage_denoise.h"
@@ -16,6 +15,7 @@
 #include "stage_deinterleave.h"
 #include "stage_demosaic.h" // Now the dispatcher
 #include "stage_resize.h"
+#include "stage_bayer_bin.h"
 #include "stage_color_correct.h"
 #include "stage_sharpen.h"
 #include "stage_local_adjust_laplacian.h" // The new stage
@@ -25,6 +25,16 @@
 #include "stage_dehaze.h"
 #include "stage_vignette.h"
 #include "stage_lens_geometry.h"
+#include "stage_histogram.h"
+#include "stage_raw_stats.h"
+#include "stage_firebreak.h"
+#include "stage_masked_adjust.h"
+#include "stage_fixed_look.h"
+#include "stage_csi2_unpack.h"
+#include "stage_burst_merge.h"
+#include "stage_temporal_denoise.h"
+#include "stage_export_pyramid.h"
+#include "debug_taps.h"
 
 #include "pipeline_schedule.h"
 
@@ -39,128 +49,311 @@ using namespace Halide;
 // Shared variables (moved outside anonymous namespace)
 Var x("x"), y("y"), c("c"), yi("yi"), yo("yo"), yii("yii"), xi("xi"), xo("xo"), tile("tile");
 
-template <typename T>
-class CameraPipeGenerator : public Halide::Generator<CameraPipeGenerator<T>> {
+// T is the processing type; RawT the raw input's, uint16_t samples or
+// uint8_t CSI-2 packed rows (raw_packing).
+template <typename T, typename RawT = uint16_t>
+class CameraPipeGenerator : public Halide::Generator<CameraPipeGenerator<T, RawT>> {
 public:
     // --- Generator Parameters for build-time features ---
     GeneratorParam<bool> profile{"profile", false};
     GeneratorParam<bool> trace{"trace", false};
+    // Output layout: planar by default, or chunky (channel stride 1) RGB or
+    // RGBA with opaque alpha, which can be uploaded to OpenGL as-is.
+    GeneratorParam<bool> interleaved_output{"interleaved_output", false};
+    GeneratorParam<int> output_channels{"output_channels", 3};
+    // Manual CPU schedule tiling (CpuTiling in pipeline_schedule.h), and the
+    // pyramid level from which the local Laplacian is built from the
+    // low-fi raw path instead of the full-resolution image.
+    GeneratorParam<int> strip_size{"strip_size", 32};
+    GeneratorParam<int> tile_width{"tile_width", 256};
+    GeneratorParam<int> cutover_level{"cutover_level", 3};
+    // Intensity samples of the local Laplacian's fast mode (see
+    // LocalLaplacianBuilder); 0 keeps the per-level gain estimator.
+    GeneratorParam<int> ll_fast_levels{"ll_fast_levels", 0};
+    // Approximate cube root, atan2 and sin/cos in the LCh conversions
+    // (HalideColor, color_tools.h), within dE76 0.01 of the precise path.
+    GeneratorParam<bool> fast_color_math{"fast_color_math", false};
+    GeneratorParam<bool> tetrahedral_color_lut{"tetrahedral_color_lut", false};
+    // Storage type of the full-frame buffers between schedule phases
+    // (vignette_corrected, resampled): float32, float16 or uint16. See
+    // stage_firebreak.h.
+    GeneratorParam<FirebreakType> firebreak_type{"firebreak_type", FirebreakType::Float32, firebreak_type_names()};
+    // Output rows per chunk when the pre-warp image is computed inside the
+    // output loop instead of as a full-frame buffer (see
+    // CpuTiling::geometry_chunk); 0 keeps the firebreak.
+    GeneratorParam<int> geometry_chunk{"geometry_chunk", 0};
+    // Schedule for small-memory devices (CpuTiling::low_memory): no
+    // full-frame intermediates, smaller strips, more recomputation. process
+    // switches to this build over its --memory-budget. CPU only.
+    GeneratorParam<bool> low_memory{"low_memory", false};
+    // Radius of the raw denoiser's guided filter, in pixels of each CFA
+    // plane. Its box sums are running sums, so a larger radius costs about
+    // the same.
+    GeneratorParam<int> denoise_radius{"denoise_radius", 2};
+    // Search and patch radii of the raw denoiser's NL-means mode, in plane
+    // pixels. Patch sums are running sums, so only the search window (one
+    // pass per offset) sets its cost.
+    GeneratorParam<int> nlmeans_search_radius{"nlmeans_search_radius", 4};
+    GeneratorParam<int> nlmeans_patch_radius{"nlmeans_patch_radius", 1};
+    // Estimate the CA shift field on a half-size mosaic (see
+    // CAShiftEstimateBuilder), for a quarter of the sums.
+    GeneratorParam<bool> ca_estimate_binned{"ca_estimate_binned", false};
+    // Layout of the packed raw input (RawT = uint8_t): csi2_raw10 or
+    // csi2_raw12, unpacked as linear_exposed reads it. none for uint16_t.
+    GeneratorParam<RawPacking> raw_packing{"raw_packing", RawPacking::None, raw_packing_names()};
+    // Smaller copies of the output made in the same run (process --outputs):
+    // this many extra outputs, reduced_0..., each reduced to its buffer's
+    // size (ExportPyramidBuilder). Planar RGB CPU builds only.
+    GeneratorParam<int> export_sizes{"export_sizes", 0};
+    // A debugging build (process --tap): an extra tap_stage input and a
+    // float `tap` output showing that intermediate (DebugTap in
+    // debug_taps.h) over the tap buffer's region. The tap reads stages the
+    // manual schedule computes inside other stages' loops, so this build
+    // needs an autoscheduler. Without it neither exists.
+    GeneratorParam<bool> debug_taps{"debug_taps", false};
+    // A build for one camera and recipe (process --jit, jit_pipeline.h):
+    // these inputs bound to constants, so the bounds, selects and boundary
+    // conditions that depend on them fold away. -1 (0 for the raw's size)
+    // leaves the input to the caller. A bound input stays in the signature
+    // and is ignored.
+    GeneratorParam<int> bind_width{"bind_width", 0};
+    GeneratorParam<int> bind_height{"bind_height", 0};
+    GeneratorParam<int> bind_cfa_pattern{"bind_cfa_pattern", -1};
+    GeneratorParam<int> bind_black_level{"bind_black_level", -1};
+    GeneratorParam<int> bind_white_level{"bind_white_level", -1};
+    GeneratorParam<int> bind_demosaic{"bind_demosaic", -1};
+    GeneratorParam<int> bind_denoise{"bind_denoise", -1};
+    // Stages off for every run, bound to their bypass strength: any of ca,
+    // denoise, dehaze and vignette, '+'-separated.
+    GeneratorParam<std::string> bind_off{"bind_off", ""};
 
     // --- Define the processing type for this pipeline variant ---
     using proc_type = T;
     const Halide::Type halide_proc_type = Halide::type_of<proc_type>();
 
     // --- Inputs ---
-    typename Generator<CameraPipeGenerator<T>>::template Input<Buffer<uint16_t, 2>> input{"input"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<int> cfa_pattern{"cfa_pattern"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> green_balance{"green_balance"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> downscale_factor{"downscale_factor"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<int> demosaic_algorithm_id{"demosaic_algorithm_id"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<RawT, 2>> input{"input"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> cfa_pattern{"cfa_pattern"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> green_balance{"green_balance"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> downscale_factor{"downscale_factor"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> demosaic_algorithm_id{"demosaic_algorithm_id"};
     
     // White Balance and Color Correction Inputs
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> wb_r_gain{"wb_r_gain"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> wb_g_gain{"wb_g_gain"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> wb_b_gain{"wb_b_gain"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<Buffer<float, 2>> color_matrix{"color_matrix"};
-
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> exposure_multiplier{"exposure_multiplier"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ca_correction_strength{"ca_correction_strength"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> denoise_strength{"denoise_strength"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> denoise_eps{"denoise_eps"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<int> blackLevel{"blackLevel"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<int> whiteLevel{"whiteLevel"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<Buffer<uint16_t, 2>> tone_curve_lut{"tone_curve_lut"};
-
-    // Sharpening inputs (kept for API compatibility, but disabled by NO_SHARPEN)
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> sharpen_strength{"sharpen_strength"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> sharpen_radius{"sharpen_radius"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> sharpen_threshold{"sharpen_threshold"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> wb_r_gain{"wb_r_gain"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> wb_g_gain{"wb_g_gain"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> wb_b_gain{"wb_b_gain"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> exposure_multiplier{"exposure_multiplier"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ca_correction_strength{"ca_correction_strength"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> denoise_strength{"denoise_strength"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> denoise_eps{"denoise_eps"};
+    // 0 = guided filter, 1 = NL-means (DenoiseBuilder::GUIDED / NLMEANS).
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> denoise_algorithm_id{"denoise_algorithm_id"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> blackLevel{"blackLevel"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> whiteLevel{"whiteLevel"};
+    // Per-CFA-site black levels, indexed by (x & 1, y & 1) in raw coordinates.
+    // blackLevel is their mean and is used where a single level is needed.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<uint16_t, 2>> tone_curve_lut{"tone_curve_lut"};
+
+    // Output sharpening (stage_sharpen.h): strength (0 = off), blur sigma in
+    // output pixels, and the luma detail below which nothing is sharpened.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> sharpen_strength{"sharpen_strength"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> sharpen_radius{"sharpen_radius"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> sharpen_threshold{"sharpen_threshold"};
 
     // New inputs for local adjustments
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_detail{"ll_detail"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_clarity{"ll_clarity"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_shadows{"ll_shadows"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_highlights{"ll_highlights"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_blacks{"ll_blacks"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ll_whites{"ll_whites"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<int> ll_debug_level{"ll_debug_level"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_detail{"ll_detail"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_clarity{"ll_clarity"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_shadows{"ll_shadows"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_highlights{"ll_highlights"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_blacks{"ll_blacks"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ll_whites{"ll_whites"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> ll_debug_level{"ll_debug_level"};
 
     // New input for global color grading
-    typename Generator<CameraPipeGenerator<T>>::template Input<Buffer<float, 4>> color_grading_lut{"color_grading_lut"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 4>> color_grading_lut{"color_grading_lut"};
+    // The same look baked into linear RGB (HostColor::generate_rgb_color_lut),
+    // used while the local adjustments are at their defaults.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 4>> rgb_color_lut{"rgb_color_lut"};
 
     // Vignette inputs
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> vignette_amount{"vignette_amount"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> vignette_midpoint{"vignette_midpoint"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> vignette_roundness{"vignette_roundness"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> vignette_highlights{"vignette_highlights"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> vignette_amount{"vignette_amount"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> vignette_midpoint{"vignette_midpoint"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> vignette_roundness{"vignette_roundness"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> vignette_highlights{"vignette_highlights"};
+    // The lens profile's vignetting correction, as VignetteBuilder takes it.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 1>> vignetting_lut{"vignetting_lut"};
 
     // New input for dehaze
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> dehaze_strength{"dehaze_strength"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> dehaze_strength{"dehaze_strength"};
 
     // New inputs for Lens Correction & Geometry
-    typename Generator<CameraPipeGenerator<T>>::template Input<Buffer<float, 1>> distortion_lut{"distortion_lut"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ca_red_cyan{"ca_red_cyan"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> ca_blue_yellow{"ca_blue_yellow"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_rotate{"geo_rotate"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_scale{"geo_scale"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_aspect{"geo_aspect"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_keystone_v{"geo_keystone_v"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_keystone_h{"geo_keystone_h"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_offset_x{"geo_offset_x"};
-    typename Generator<CameraPipeGenerator<T>>::template Input<float> geo_offset_y{"geo_offset_y"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 1>> distortion_lut{"distortion_lut"};
+    // The lens profile's lateral CA (TCA) scales, as lens_warp_source takes them.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 2>> tca_lut{"tca_lut"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ca_red_cyan{"ca_red_cyan"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> ca_blue_yellow{"ca_blue_yellow"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_rotate{"geo_rotate"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_scale{"geo_scale"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_aspect{"geo_aspect"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_keystone_v{"geo_keystone_v"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_keystone_h{"geo_keystone_h"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_offset_x{"geo_offset_x"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<float> geo_offset_y{"geo_offset_y"};
+
+    // Rows of the pre-warp image the output can sample (inclusive). Banded
+    // renders narrow this to the band's footprint; otherwise 0 and height-1.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> warp_src_row_min{"warp_src_row_min"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> warp_src_row_max{"warp_src_row_max"};
+    // The furthest any output row samples from its own row of the pre-warp
+    // image (PipelineUtils::LensCorrection::warp_row_reach); the image height
+    // when unknown.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> warp_src_row_reach{"warp_src_row_reach"};
+    // Columns of the pre-warp image the output can sample (inclusive), for
+    // crops: an output region narrower than the frame; otherwise 0 and
+    // width-1.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> warp_src_col_min{"warp_src_col_min"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> warp_src_col_max{"warp_src_col_max"};
+
+    // EXIF orientation of the output, 1 (as stored) to 8. 5-8 swap the axes,
+    // so the output is then out_height x out_width.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int> orientation{"orientation"};
+
+    // Masked local adjustments (stage_masked_adjust.h): the layers' coverage
+    // masks (cell x, cell y, layer), their exposure in stops, and the tiles
+    // the masks touch in each row of tiles.
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 3>> adjust_masks{"adjust_masks"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<float, 1>> adjust_exposure{"adjust_exposure"};
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<Buffer<int32_t, 2>> adjust_tiles{"adjust_tiles"};
 
 
     // --- Output ---
-    typename Generator<CameraPipeGenerator<T>>::template Output<Buffer<uint8_t, 3>> processed{"processed"};
+    using OutputU8 = typename Generator<CameraPipeGenerator<T, RawT>>::template Output<Buffer<uint8_t, 3>>;
+    OutputU8 processed{"processed"};
+    std::vector<OutputU8*> reduced;
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Input<int>* tap_stage = nullptr;
+    typename Generator<CameraPipeGenerator<T, RawT>>::template Output<Buffer<float, 3>>* tap = nullptr;
+
+    void configure() {
+        for (int i = 0; i < export_sizes; i++) {
+            reduced.push_back(this->template add_output<Buffer<uint8_t, 3>>("reduced_" + std::to_string(i)));
+        }
+        if (debug_taps) {
+            tap_stage = this->template add_input<int>("tap_stage");
+            tap = this->template add_output<Buffer<float, 3>>("tap");
+        }
+    }
 
     void generate() {
         using namespace Halide::ConciseCasts;
         // ========== THE ALGORITHM ==========
+        const bool packed_input = std::is_same<RawT, uint8_t>::value;
+        if (packed_input == (raw_packing == RawPacking::None)) {
+            throw std::runtime_error("raw_packing must be csi2_raw10 or csi2_raw12 for a uint8 raw, and none otherwise");
+        }
+        // A packed raw is read through the unpack, inlined like the bounds.
+        Func raw_samples = input;
         Expr full_res_width = input.width();
+        if (packed_input) {
+            Csi2UnpackBuilder unpack_builder(input, raw_packing, x, y);
+            raw_samples = unpack_builder.output;
+            full_res_width = Csi2UnpackBuilder::pixel_width(input.width(), raw_packing);
+        }
         Expr full_res_height = input.height();
 
+        // The inputs a specialized build binds (see bind_*).
+        if ((bind_width > 0) != (bind_height > 0) || (packed_input && bind_width > 0)) {
+            throw std::runtime_error("bind_width and bind_height go together, on unpacked raws only");
+        }
+        if (bind_width > 0) {
+            full_res_width = Expr((int)bind_width);
+            full_res_height = Expr((int)bind_height);
+            input.dim(0).set_bounds(0, full_res_width);
+            input.dim(1).set_bounds(0, full_res_height);
+        }
+        auto bound = [](int value, Expr input_value) { return value >= 0 ? Expr(value) : input_value; };
+        const std::string off = "+" + bind_off.value() + "+";
+        auto bound_off = [&](const char* stage, Expr strength) {
+            return off.find("+" + std::string(stage) + "+") != std::string::npos ? Expr(0.0f) : strength;
+        };
+        Expr cfa_pattern_v = bound(bind_cfa_pattern, cfa_pattern);
+        Expr black_level_v = bound(bind_black_level, blackLevel);
+        Expr white_level_v = bound(bind_white_level, whiteLevel);
+        Expr demosaic_id_v = bound(bind_demosaic, demosaic_algorithm_id);
+        Expr denoise_id_v = bound(bind_denoise, denoise_algorithm_id);
+        Expr ca_strength_v = bound_off("ca", ca_correction_strength);
+        Expr denoise_strength_v = bound_off("denoise", denoise_strength);
+        Expr dehaze_strength_v = bound_off("dehaze", dehaze_strength);
+        Expr vignette_amount_v = bound_off("vignette", vignette_amount);
+
         // The final output dimensions are determined by the downscale factor.
         Expr out_width = cast<int>(full_res_width / downscale_factor);
         Expr out_height = cast<int>(full_res_height / downscale_factor);
 
         // Create a bounded version of the raw data that is safe to read from.
         Func raw_bounded("raw_bounded");
-        raw_bounded = BoundaryConditions::repeat_edge(input, {{0, full_res_width}, {0, full_res_height}});
+        raw_bounded = BoundaryConditions::repeat_edge(raw_samples, {{0, full_res_width}, {0, full_res_height}});
 
-        // Normalize, convert to float, and apply exposure compensation in one step.
+        // Subtract the per-site black level, normalize, convert to float and
+        // apply exposure compensation in one step. The loader no longer
+        // rescales the raw, so this is the only pass over it before demosaic.
         Func linear_exposed("linear_exposed");
-        Expr inv_range = 1.0f / (cast<float>(whiteLevel) - cast<float>(blackLevel));
-        linear_exposed(x, y) = (cast<float>(raw_bounded(x, y)) - cast<float>(blackLevel)) * inv_range * exposure_multiplier;
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        Expr inv_range = 1.0f / (cast<float>(white_level_v) - site_black);
+        linear_exposed(x, y) = (cast<float>(raw_bounded(x, y)) - site_black) * inv_range * exposure_multiplier;
 
-        BayerNormalizeBuilder normalize_builder(linear_exposed, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+        // Computed per strip from the u16 raw (see schedule_front_end_producers).
+        BayerNormalizeBuilder normalize_builder(linear_exposed, cfa_pattern_v, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
         Func normalized_bayer = normalize_builder.output;
 
-        DenoiseBuilder denoise_builder(linear_exposed, x, y,
-                                       denoise_strength, denoise_eps,
-                                       this->get_target(), this->using_autoscheduler());
-        Func denoised("denoised");
-        denoised(x, y) = select(denoise_strength < 0.001f, linear_exposed(x, y), denoise_builder.output(x, y));
+        // Raw denoise per CFA plane, on the mosaic CA correction reads.
+        DenoiseBuilder denoise_builder(normalized_bayer, x, y, c,
+                                       denoise_strength_v, denoise_eps,
+                                       {wb_g_gain, wb_r_gain, wb_b_gain, wb_g_gain * green_balance},
+                                       denoise_id_v, denoise_radius,
+                                       nlmeans_search_radius, nlmeans_patch_radius);
+        Func denoised = denoise_builder.output;
 
-        CACorrectBuilder ca_builder(normalized_bayer, x, y,
-                                    ca_correction_strength,
+        // CA correction's shift field, estimated once per run. It reads its
+        // own inlined copy of the mosaic, ahead of the denoiser: the
+        // per-strip one can't feed a whole-image stage.
+        BayerNormalizeBuilder ca_estimate_normalize(linear_exposed, cfa_pattern_v, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+        CAShiftEstimateBuilder ca_estimate(ca_estimate_normalize.output, x, y, full_res_width, full_res_height,
+                                           ca_estimate_binned);
+        CACorrectBuilder ca_builder(denoised, x, y,
+                                    ca_strength_v,
                                     full_res_width, full_res_height,
-                                    this->get_target(), this->using_autoscheduler());
+                                    this->get_target(), this->using_autoscheduler(), ca_estimate.output);
         Func ca_corrected = ca_builder.output;
 
         // The input to deinterleave is now guaranteed to be GRBG.
         Func deinterleaved_hi_fi = pipeline_deinterleave(ca_corrected, x, y, c);
 
-        DemosaicDispatcherT<float> demosaic_dispatcher{deinterleaved_hi_fi, demosaic_algorithm_id, x, y, c};
+        // The fast demosaic takes CA correction's green plane as its own.
+        // The adaptive demosaic's per-block branch is for the CPU schedule.
+        DemosaicDispatcherT<float> demosaic_dispatcher{deinterleaved_hi_fi, demosaic_id_v, x, y, c,
+                                                       ca_builder.g_interp,
+                                                       !this->get_target().has_gpu_feature() && !this->using_autoscheduler()};
         Func demosaiced = demosaic_dispatcher.output;
 
-        // --- Bicubic Downscaling Step ---
-        ResizeBicubicBuilder resize_builder(demosaiced, "resize",
+        // --- Lanczos Downscaling Step (factors below the binning threshold) ---
+        ResizeBuilder resize_builder(demosaiced, "resize",
                                             full_res_width, full_res_height,
                                             out_width, out_height, x, y, c);
 
+        // --- Bayer-domain binning for large downscale factors ---
+        // Bins the CFA planes straight to the output grid and skips the
+        // full-resolution demosaic entirely (see schedule specializations).
+        BayerBinBuilder bin_builder(deinterleaved_hi_fi, full_res_width, full_res_height,
+                                    downscale_factor, x, y, c);
+
         Func downscaled("downscaled");
         Expr is_no_op_resize = abs(downscale_factor - 1.0f) < 1e-6f;
-        downscaled(x, y, c) = select(is_no_op_resize, demosaiced(x, y, c), resize_builder.output(x, y, c));
+        downscaled(x, y, c) = select(is_no_op_resize, demosaiced(x, y, c),
+                                     bin_builder.use_binning, bin_builder.output(x, y, c),
+                                     resize_builder.output(x, y, c));
 
         ColorCorrectBuilder_T<T> color_correct_builder(downscaled, halide_proc_type, color_matrix, x, y, c);
         Func corrected_hi_fi = color_correct_builder.output;
@@ -173,48 +366,98 @@ public:
             corrected_f(x, y, c) = cast<float>(corrected_hi_fi(x, y, c)) / 65535.0f;
         }
 
-        DehazeBuilder dehaze_builder(corrected_f, dehaze_strength, x, y, c);
+        // The pyramid's low-fi splice starts from the white-balanced mosaic,
+        // one RGB pixel per 2x2 block. The mosaic is only computed per strip
+        // of phase 1, so the splice (computed once per run) reads its own
+        // inlined copy straight from the raw.
+        Func lowfi_sensor_rgb("lowfi_sensor_rgb");
+        Expr lowfi_gr = normalized_bayer(2 * x, 2 * y), lowfi_r = normalized_bayer(2 * x + 1, 2 * y);
+        Expr lowfi_b = normalized_bayer(2 * x, 2 * y + 1), lowfi_gb = normalized_bayer(2 * x + 1, 2 * y + 1);
+        lowfi_sensor_rgb(x, y, c) = mux(c, {lowfi_r, avg(lowfi_gr, lowfi_gb), lowfi_b});
+        normalized_bayer.clone_in(lowfi_sensor_rgb);
+
+        // Dehaze's estimates are made once per run too, so they sample the
+        // same copy through the colour matrix, at output coordinates.
+        Func dehaze_stats("dehaze_stats");
+        Expr stats_x = cast<int>((cast<float>(x) + 0.5f) * downscale_factor * 0.5f);
+        Expr stats_y = cast<int>((cast<float>(y) + 0.5f) * downscale_factor * 0.5f);
+        Func cc_matrix = color_correct_builder.cc_matrix;
+        std::vector<Expr> stats_srgb;
+        for (int i = 0; i < 3; i++) {
+            stats_srgb.push_back(cc_matrix(3, i) + cc_matrix(0, i) * lowfi_sensor_rgb(stats_x, stats_y, 0) +
+                                 cc_matrix(1, i) * lowfi_sensor_rgb(stats_x, stats_y, 1) +
+                                 cc_matrix(2, i) * lowfi_sensor_rgb(stats_x, stats_y, 2));
+        }
+        dehaze_stats(x, y, c) = clamp(mux(c, stats_srgb), 0.0f, 1.0f);
+
+        DehazeBuilder dehaze_builder(corrected_f, dehaze_stats, dehaze_strength_v, out_width, out_height, x, y, c);
         Func dehazed = dehaze_builder.output;
 
         // --- COLOR PROCESSING PIPELINE (Corrected Order) ---
         // 1. Convert from linear sRGB to L*C*h*.
-        Func srgb_to_lch = HalideColor::linear_srgb_to_lch(dehazed, x, y, c);
+        Func srgb_to_lch = HalideColor::linear_srgb_to_lch(dehazed, x, y, c, fast_color_math);
 
         // 2. Perform local adjustments.
         const int J = 8;
-        const int cutover_level = 3;
         LocalLaplacianBuilder local_laplacian_builder(
             srgb_to_lch,
-            raw_bounded, color_correct_builder.cc_matrix,
-            cfa_pattern, wb_r_gain, wb_g_gain, wb_b_gain, green_balance, exposure_multiplier,
+            lowfi_sensor_rgb, color_correct_builder.cc_matrix,
             x, y, c,
             ll_detail, ll_clarity, ll_shadows, ll_highlights, ll_blacks, ll_whites, ll_debug_level,
-            blackLevel, whiteLevel,
-            out_width, out_height, full_res_width, full_res_height, downscale_factor,
-            J, cutover_level);
+            out_width, out_height, full_res_width / 2, full_res_height / 2, downscale_factor,
+            J, cutover_level, ll_fast_levels);
         Func lch_local_adjusted = local_laplacian_builder.output;
 
         // 3. Apply the global 3D LUT for color grading.
-        ColorGradeBuilder color_grade_builder(lch_local_adjusted, color_grading_lut, color_grading_lut.dim(0).extent(), x, y, c);
+        ColorGradeBuilder color_grade_builder(lch_local_adjusted, color_grading_lut, color_grading_lut.dim(0).extent(), x, y, c,
+                                              tetrahedral_color_lut);
         Func lch_final = color_grade_builder.output;
 
         // 4. Convert the final L''C''H'' back to linear sRGB.
-        Func graded_srgb = HalideColor::lch_to_linear_srgb(lch_final, x, y, c);
+        Func graded_srgb = HalideColor::lch_to_linear_srgb(lch_final, x, y, c, fast_color_math);
+
+        // With the local adjustments at their defaults, steps 1-4 are a
+        // function of each pixel's colour alone: one lookup in the baked LUT.
+        // The u16 variant does that and the dehaze before it in fixed point,
+        // straight from the colour-matrix output.
+        RgbLutBuilder baked_look(dehazed, rgb_color_lut, rgb_color_lut.dim(0).extent(), x, y, c);
+        Func baked_srgb = baked_look.output;
+        std::unique_ptr<FixedPointLookBuilder> fixed_look;
+        if (!std::is_same<T, float>::value) {
+            fixed_look = std::make_unique<FixedPointLookBuilder>(corrected_hi_fi, &dehaze_builder,
+                                                                 rgb_color_lut, rgb_color_lut.dim(0).extent(), x, y, c);
+            baked_srgb = Func("fixed_look_f");
+            baked_srgb(x, y, c) = cast<float>(fixed_look->output(x, y, c)) * (1.0f / FixedPointLookBuilder::kOutScale);
+        }
+        Func look_srgb("look_srgb");
+        look_srgb(x, y, c) = select(local_laplacian_builder.is_default, baked_srgb(x, y, c), graded_srgb(x, y, c));
 
         // 5. Apply Vignette Correction
-        VignetteBuilder vignette_builder(graded_srgb, out_width, out_height,
-                                         vignette_amount, vignette_midpoint, vignette_roundness, vignette_highlights,
+        VignetteBuilder vignette_builder(look_srgb, out_width, out_height,
+                                         vignette_amount_v, vignette_midpoint, vignette_roundness, vignette_highlights,
+                                         vignetting_lut, vignetting_lut.dim(0).extent(),
                                          x, y, c);
-        Func vignette_corrected = vignette_builder.output;
+        FirebreakBuilder vignette_firebreak(vignette_builder.output, firebreak_type, "vignette_corrected");
+        Func vignette_corrected = vignette_firebreak.output;
+        // Dodge and burn, on the tiles the masks touch.
+        MaskedAdjustBuilder masked_adjust(vignette_firebreak, firebreak_type,
+                                          adjust_masks, adjust_masks.dim(0).extent(), adjust_masks.dim(1).extent(),
+                                          adjust_exposure, adjust_exposure.dim(0).extent(),
+                                          adjust_tiles, adjust_tiles.dim(0).extent(), adjust_tiles.dim(1).extent(),
+                                          warp_src_col_min, warp_src_col_max, y, c);
 
         // --- LENS & GEOMETRY CORRECTION STAGE ---
         LensGeometryBuilder lens_geometry_builder(vignette_corrected, x, y, c, out_width, out_height,
                                                   distortion_lut, distortion_lut.dim(0).extent(),
+                                                  tca_lut, tca_lut.dim(0).extent(),
                                                   ca_red_cyan, ca_blue_yellow,
                                                   geo_rotate, geo_scale, geo_aspect,
                                                   geo_keystone_v, geo_keystone_h,
-                                                  geo_offset_x, geo_offset_y);
-        Func resampled = lens_geometry_builder.output;
+                                                  geo_offset_x, geo_offset_y,
+                                                  warp_src_row_min, warp_src_row_max, warp_src_row_reach,
+                                                  warp_src_col_min, warp_src_col_max);
+        FirebreakBuilder resampled_firebreak(lens_geometry_builder.output, firebreak_type, "resampled");
+        Func resampled = resampled_firebreak.output;
 
         // --- RESAMPLE BYPASS SWITCH ---
         const float e = 1e-6f;
@@ -226,7 +469,7 @@ public:
         // We can check just the first and last elements as a proxy.
         Expr is_distort_default = abs(distortion_lut(0) - 1.0f) < e &&
                                   abs(distortion_lut(distortion_lut.dim(0).extent() - 1) - 1.0f) < e;
-        Expr is_ca_default = abs(ca_red_cyan) < e && abs(ca_blue_yellow) < e;
+        Expr is_ca_default = abs(ca_red_cyan) < e && abs(ca_blue_yellow) < e && tca_lut.dim(0).extent() <= 1;
         Expr is_no_op_resample = is_geo_default && is_distort_default && is_ca_default;
 
         Func resampled_or_bypass("resampled_or_bypass");
@@ -251,51 +494,912 @@ public:
         Var lut_x("lut_x_var"), lut_c("lut_c_var");
         tone_curve_func(lut_x, lut_c) = tone_curve_lut(lut_x, lut_c);
 
-        Func curved = pipeline_apply_curve<T>(sharpened, blackLevel, whiteLevel,
+        Func curved = pipeline_apply_curve<T>(sharpened, black_level_v, white_level_v,
                                            tone_curve_func, tone_curve_lut.dim(0).extent(), x, y, c,
                                            this->get_target(), this->using_autoscheduler());
 
+        const int channels = output_channels;
+        if (channels != 3 && channels != 4) {
+            throw std::runtime_error("output_channels must be 3 or 4");
+        }
+
+        // The orientation is a remap of the output coordinates onto the
+        // upright image, so rotated and mirrored renders cost no extra pass:
+        // 5-8 swap the axes, then 2, 3, 7 and 8 mirror the upright columns
+        // and 3, 4, 6 and 7 its rows. schedule_output_phase specializes on
+        // each value.
+        Expr swap_axes = orientation >= 5 && orientation <= 8;
+        Expr mirror_x = orientation == 2 || orientation == 3 || orientation == 7 || orientation == 8;
+        Expr mirror_y = orientation == 3 || orientation == 4 || orientation == 6 || orientation == 7;
+        Expr upright_x = select(swap_axes, y, x), upright_y = select(swap_axes, x, y);
+        upright_x = select(mirror_x, out_width - 1 - upright_x, upright_x);
+        upright_y = select(mirror_y, out_height - 1 - upright_y, upright_y);
+
         Func final_stage("final_stage");
-        Expr final_val = curved(x, y, c);
+        Expr final_val = curved(upright_x, upright_y, channels == 4 ? min(c, 2) : Expr(c));
+        Expr final_u8;
         if (std::is_same<proc_type, float>::value) {
-            final_stage(x, y, c) = u8_sat(final_val * 255.0f);
+            final_u8 = u8_sat(final_val * 255.0f);
         } else {
-            final_stage(x, y, c) = u8_sat(final_val >> 8);
+            final_u8 = u8_sat(final_val >> 8);
+        }
+        final_stage(x, y, c) = channels == 4 ? select(c < 3, final_u8, u8(255)) : final_u8;
+
+        if (interleaved_output) {
+            processed.dim(0).set_stride(channels);
+            processed.dim(2).set_min(0).set_extent(channels).set_stride(1);
+        } else if (channels == 4) {
+            throw std::runtime_error("RGBA output requires interleaved_output=true");
         }
 
         // ========== ESTIMATES ==========
         const int out_width_est = 4000;
         const int out_height_est = 3000;
-        input.set_estimates({{0, out_width_est}, {0, out_height_est}});
+        input.set_estimates({{0, packed_input ? raw_packing_row_bytes(raw_packing, out_width_est) : out_width_est}, {0, out_height_est}});
         cfa_pattern.set_estimate(4); // RGGB is common, but account for new patterns
         green_balance.set_estimate(1.0f);
         downscale_factor.set_estimate(1.0f);
         demosaic_algorithm_id.set_estimate(3);
+        denoise_algorithm_id.set_estimate(0);
         ll_debug_level.set_estimate(-1);
         color_matrix.set_estimates({{0, 4}, {0, 3}});
+        black_level_cfa.set_estimates({{0, 2}, {0, 2}});
         tone_curve_lut.set_estimates({{0, 65536}, {0, 3}});
         color_grading_lut.set_estimates({{0, 33}, {0, 33}, {0, 33}, {0, 3}});
+        rgb_color_lut.set_estimates({{0, 65}, {0, 65}, {0, 65}, {0, 3}});
+        require_interleaved_lut(color_grading_lut);
+        require_interleaved_lut(rgb_color_lut);
+        vignetting_lut.set_estimates({{0, 256}});
         distortion_lut.set_estimates({{0, 2048}});
-        final_stage.set_estimates({{0, out_width_est}, {0, out_height_est}, {0, 3}});
+        tca_lut.set_estimates({{0, 256}, {0, 2}});
+        warp_src_row_min.set_estimate(0);
+        warp_src_row_max.set_estimate(out_height_est - 1);
+        warp_src_row_reach.set_estimate(out_height_est);
+        warp_src_col_min.set_estimate(0);
+        warp_src_col_max.set_estimate(out_width_est - 1);
+        orientation.set_estimate(1);
+        adjust_masks.set_estimates({{0, out_width_est / MaskedAdjustGrid::kCellSize},
+                                    {0, out_height_est / MaskedAdjustGrid::kCellSize}, {0, 1}});
+        adjust_exposure.set_estimates({{0, 1}});
+        adjust_tiles.set_estimates({{0, 4}, {0, out_height_est / MaskedAdjustGrid::kTileSize}});
+        final_stage.set_estimates({{0, out_width_est}, {0, out_height_est}, {0, channels}});
+
+        if (debug_taps) {
+            if (!this->using_autoscheduler()) {
+                throw std::runtime_error("debug_taps needs an autoscheduler");
+            }
+            Expr stage = *tap_stage;
+            auto is = [&](DebugTap t) { return stage == static_cast<int>(t); };
+            Func tapped("tapped");
+            tapped(x, y, c) = select(is(DebugTap::NormalizedBayer), cast<float>(normalized_bayer(x, y)),
+                                     is(DebugTap::CaCorrected), cast<float>(ca_corrected(x, y)),
+                                     is(DebugTap::Demosaiced), cast<float>(demosaiced(x, y, c)),
+                                     is(DebugTap::CorrectedF), corrected_f(x, y, c),
+                                     is(DebugTap::Dehazed), cast<float>(dehazed(x, y, c)),
+                                     is(DebugTap::LchLocalAdjusted), cast<float>(lch_local_adjusted(x, y, c)),
+                                     is(DebugTap::VignetteCorrected), cast<float>(vignette_corrected(x, y, c)),
+                                     0.0f);
+            tap_stage->set_estimate(static_cast<int>(DebugTap::Demosaiced));
+            tapped.set_estimates({{0, out_width_est}, {0, out_height_est}, {0, 3}});
+            *tap = tapped;
+        }
 
         // ========== SCHEDULE ==========
         // The schedule is now complex enough to warrant its own file.
         schedule_pipeline<T>(this->using_autoscheduler(), this->get_target(),
-            denoised, normalized_bayer, ca_builder, deinterleaved_hi_fi, demosaiced, demosaic_dispatcher,
-            downscaled, is_no_op_resize, resize_builder,
-            corrected_hi_fi, dehazed, resampled, resampled_or_bypass, is_no_op_resample, sharpened, local_laplacian_builder, curved, final_stage,
+            normalize_builder, &denoise_builder, ca_estimate, ca_builder, deinterleaved_hi_fi, demosaiced, demosaic_dispatcher,
+            downscaled, is_no_op_resize, resize_builder, bin_builder,
+            corrected_hi_fi, dehaze_builder, resampled_firebreak.stored, resampled_or_bypass, is_no_op_resample, sharpen_builder, local_laplacian_builder, curved,
+            is_compact_tone_curve(tone_curve_lut.dim(0).extent()), final_stage,
             color_correct_builder, tone_curve_func, lch_final,
-            srgb_to_lch, graded_srgb, vignette_corrected, halide_proc_type,
+            srgb_to_lch, graded_srgb, look_srgb, fixed_look.get(), vignette_firebreak.stored, halide_proc_type,
+            StageBypasses{ca_builder.is_bypassed, dehaze_builder.is_bypassed,
+                          local_laplacian_builder.is_default, vignette_builder.is_bypassed,
+                          denoise_builder.is_bypassed},
             x, y, c, xo, xi, yo, yi,
-            J, cutover_level);
+            CpuTiling{strip_size, tile_width, geometry_chunk, low_memory}, J, cutover_level, channels, interleaved_output,
+            orientation, &masked_adjust);
+
+        processed = final_stage;
+
+        if (!reduced.empty()) {
+            if (interleaved_output || channels != 3 || this->get_target().has_gpu_feature()) {
+                throw std::runtime_error("export_sizes needs planar RGB output on the CPU");
+            }
+            // The pyramid reads the whole output, so it must start at the origin.
+            processed.dim(0).set_min(0);
+            processed.dim(1).set_min(0);
+            ExportPyramidBuilder pyramid(final_stage, processed.dim(0).extent(), processed.dim(1).extent(), x, y, c);
+            std::vector<Func> reductions;
+            for (size_t i = 0; i < reduced.size(); i++) {
+                OutputU8& out = *reduced[i];
+                reductions.push_back(pyramid.reduce(out.dim(0).extent(), out.dim(1).extent(),
+                                                    "reduced_" + std::to_string(i)));
+                reductions.back().set_estimates({{0, 2048}, {0, 1536}, {0, 3}});
+            }
+            schedule_export_pyramid(this->using_autoscheduler(), this->get_target(), pyramid, reductions, x, y, yo, yi);
+            for (size_t i = 0; i < reduced.size(); i++) {
+                *reduced[i] = reductions[i];
+            }
+        }
+    }
+};
+
+// ============================================================================
+// Split pipelines for the editor.
+//
+// The editor caches the output of the front end (raw -> linear, camera
+// corrected RGB at the preview resolution) and only reruns the back end
+// (look stages -> u8) when a downstream parameter changes. The stage code is
+// the same as in CameraPipeGenerator; only the cut point differs.
+// ============================================================================
+class CameraPipeFrontGenerator : public Halide::Generator<CameraPipeFrontGenerator> {
+public:
+    Input<Buffer<uint16_t, 2>> input{"input"};
+    Input<int> cfa_pattern{"cfa_pattern"};
+    Input<float> green_balance{"green_balance"};
+    Input<float> downscale_factor{"downscale_factor"};
+    Input<int> demosaic_algorithm_id{"demosaic_algorithm_id"};
+    Input<float> wb_r_gain{"wb_r_gain"};
+    Input<float> wb_g_gain{"wb_g_gain"};
+    Input<float> wb_b_gain{"wb_b_gain"};
+    Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+    Input<float> exposure_multiplier{"exposure_multiplier"};
+    // Same meaning as on CameraPipeGenerator: the raw denoiser's strength in
+    // [0, 1], its regularization and its algorithm.
+    Input<float> denoise_strength{"denoise_strength"};
+    Input<float> denoise_eps{"denoise_eps"};
+    Input<int> denoise_algorithm_id{"denoise_algorithm_id"};
+    Input<float> ca_correction_strength{"ca_correction_strength"};
+    // The raw's CA shift field from camera_pipe_ca_shifts (see
+    // CAShiftGrid). Read with its edges repeated, so any size will do while
+    // the strength is 0.
+    Input<Buffer<float, 4>> ca_shifts{"ca_shifts"};
+    Input<int> blackLevel{"blackLevel"};
+    Input<int> whiteLevel{"whiteLevel"};
+    Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+
+    // Linear, camera-corrected sRGB-primaries RGB in [0, 1], at the output resolution.
+    Output<Buffer<float, 3>> linear{"linear"};
+
+    // Same meaning as on CameraPipeGenerator.
+    GeneratorParam<int> strip_size{"strip_size", 32};
+    GeneratorParam<int> tile_width{"tile_width", 256};
+    GeneratorParam<int> denoise_radius{"denoise_radius", 2};
+    GeneratorParam<int> nlmeans_search_radius{"nlmeans_search_radius", 4};
+    GeneratorParam<int> nlmeans_patch_radius{"nlmeans_patch_radius", 1};
+
+    void generate() {
+        Expr full_res_width = input.width();
+        Expr full_res_height = input.height();
+        Expr out_width = cast<int>(full_res_width / downscale_factor);
+        Expr out_height = cast<int>(full_res_height / downscale_factor);
+
+        Func raw_bounded("raw_bounded");
+        raw_bounded = BoundaryConditions::repeat_edge(input, {{0, full_res_width}, {0, full_res_height}});
+
+        Func linear_exposed("linear_exposed");
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        Expr inv_range = 1.0f / (cast<float>(whiteLevel) - site_black);
+        linear_exposed(x, y) = (cast<float>(raw_bounded(x, y)) - site_black) * inv_range * exposure_multiplier;
+
+        BayerNormalizeBuilder normalize_builder(linear_exposed, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+
+        DenoiseBuilder denoise_builder(normalize_builder.output, x, y, c,
+                                       denoise_strength, denoise_eps,
+                                       {wb_g_gain, wb_r_gain, wb_b_gain, wb_g_gain * green_balance},
+                                       denoise_algorithm_id, denoise_radius,
+                                       nlmeans_search_radius, nlmeans_patch_radius);
+
+        CACorrectBuilder ca_builder(denoise_builder.output, x, y,
+                                    ca_correction_strength,
+                                    full_res_width, full_res_height,
+                                    get_target(), using_autoscheduler(),
+                                    BoundaryConditions::repeat_edge(ca_shifts));
+
+        Func deinterleaved_hi_fi = pipeline_deinterleave(ca_builder.output, x, y, c);
+
+        // The fast demosaic takes CA correction's green plane as its own.
+        // The adaptive demosaic's per-block branch is for the CPU schedule.
+        DemosaicDispatcherT<float> demosaic_dispatcher{deinterleaved_hi_fi, demosaic_algorithm_id, x, y, c,
+                                                       ca_builder.g_interp,
+                                                       !get_target().has_gpu_feature() && !using_autoscheduler()};
+        Func demosaiced = demosaic_dispatcher.output;
+
+        ResizeBuilder resize_builder(demosaiced, "resize",
+                                            full_res_width, full_res_height,
+                                            out_width, out_height, x, y, c);
+        BayerBinBuilder bin_builder(deinterleaved_hi_fi, full_res_width, full_res_height,
+                                    downscale_factor, x, y, c);
+
+        Func downscaled("downscaled");
+        Expr is_no_op_resize = abs(downscale_factor - 1.0f) < 1e-6f;
+        downscaled(x, y, c) = select(is_no_op_resize, demosaiced(x, y, c),
+                                     bin_builder.use_binning, bin_builder.output(x, y, c),
+                                     resize_builder.output(x, y, c));
+
+        ColorCorrectBuilder_T<float> color_correct_builder(downscaled, Float(32), color_matrix, x, y, c);
+        Func corrected_hi_fi = color_correct_builder.output;
+
+        Func corrected_f("corrected_f");
+        corrected_f(x, y, c) = corrected_hi_fi(x, y, c);
+
+        // ========== ESTIMATES ==========
+        input.set_estimates({{0, 4000}, {0, 3000}});
+        cfa_pattern.set_estimate(4);
+        green_balance.set_estimate(1.0f);
+        downscale_factor.set_estimate(4.0f);
+        demosaic_algorithm_id.set_estimate(3);
+        denoise_algorithm_id.set_estimate(0);
+        color_matrix.set_estimates({{0, 4}, {0, 3}});
+        ca_shifts.set_estimates({{0, 250}, {0, 188}, {0, 2}, {0, 2}});
+        corrected_f.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+
+        // ========== SCHEDULE ==========
+        schedule_front_end(using_autoscheduler(), get_target(),
+                           normalize_builder, &denoise_builder, ca_builder, deinterleaved_hi_fi,
+                           demosaiced, demosaic_dispatcher, downscaled, is_no_op_resize,
+                           resize_builder, bin_builder, corrected_hi_fi,
+                           color_correct_builder.cc_matrix, corrected_f,
+                           StageBypasses{ca_builder.is_bypassed, Expr(), Expr(), Expr(), denoise_builder.is_bypassed},
+                           x, y, c, xo, xi, yo, yi, CpuTiling{strip_size, tile_width});
+
+        linear = corrected_f;
+    }
+};
+
+class CameraPipeBackGenerator : public Halide::Generator<CameraPipeBackGenerator> {
+public:
+    // The front end's output. It may cover only part of the frame (a
+    // viewport region with non-zero mins); frame_width/frame_height give the
+    // size of the whole frame at this scale, which the position-dependent
+    // stages (pyramid, vignette, lens geometry) are defined against.
+    Input<Buffer<float, 3>> linear{"linear"};
+    Input<int> frame_width{"frame_width"};
+    Input<int> frame_height{"frame_height"};
+    Input<Buffer<uint16_t, 2>> tone_curve_lut{"tone_curve_lut"};
+
+    // Same meaning as on CameraPipeGenerator, in the region's pixels.
+    Input<float> sharpen_strength{"sharpen_strength"};
+    Input<float> sharpen_radius{"sharpen_radius"};
+    Input<float> sharpen_threshold{"sharpen_threshold"};
+
+    Input<float> ll_detail{"ll_detail"};
+    Input<float> ll_clarity{"ll_clarity"};
+    Input<float> ll_shadows{"ll_shadows"};
+    Input<float> ll_highlights{"ll_highlights"};
+    Input<float> ll_blacks{"ll_blacks"};
+    Input<float> ll_whites{"ll_whites"};
+    Input<int> ll_debug_level{"ll_debug_level"};
+
+    Input<Buffer<float, 4>> color_grading_lut{"color_grading_lut"};
+    Input<Buffer<float, 4>> rgb_color_lut{"rgb_color_lut"};
+
+    Input<float> vignette_amount{"vignette_amount"};
+    Input<float> vignette_midpoint{"vignette_midpoint"};
+    Input<float> vignette_roundness{"vignette_roundness"};
+    Input<float> vignette_highlights{"vignette_highlights"};
+    Input<Buffer<float, 1>> vignetting_lut{"vignetting_lut"};
+
+    Input<float> dehaze_strength{"dehaze_strength"};
+    // The front end's output for the whole frame, at any size (a small
+    // downscale will do; `linear` itself when that is the whole frame).
+    // Dehaze estimates the haze from it, so every region and band of a frame
+    // gets the same estimate, as in CameraPipeGenerator.
+    Input<Buffer<float, 3>> dehaze_stats{"dehaze_stats"};
+
+    Input<Buffer<float, 1>> distortion_lut{"distortion_lut"};
+    Input<Buffer<float, 2>> tca_lut{"tca_lut"};
+    Input<float> ca_red_cyan{"ca_red_cyan"};
+    Input<float> ca_blue_yellow{"ca_blue_yellow"};
+    Input<float> geo_rotate{"geo_rotate"};
+    Input<float> geo_scale{"geo_scale"};
+    Input<float> geo_aspect{"geo_aspect"};
+    Input<float> geo_keystone_v{"geo_keystone_v"};
+    Input<float> geo_keystone_h{"geo_keystone_h"};
+    Input<float> geo_offset_x{"geo_offset_x"};
+    Input<float> geo_offset_y{"geo_offset_y"};
+    // camera_pipe_warp_map's output for the parameters above, covering at
+    // least the region `processed` covers plus the sharpen stencil's reach
+    // (clipped to the frame). The geometry stage only gathers
+    // through it; the parameters still decide whether it is skipped.
+    Input<Buffer<float, 3>> warp_map{"warp_map"};
+
+    Output<Buffer<uint8_t, 3>> processed{"processed"};
+    // 256 bins x (R, G, B, luma) counts over the region `processed` covers.
+    Output<Buffer<uint32_t, 2>> histogram{"histogram"};
+
+    // Same meaning as on CameraPipeGenerator.
+    GeneratorParam<bool> interleaved_output{"interleaved_output", false};
+    GeneratorParam<int> output_channels{"output_channels", 3};
+    GeneratorParam<int> strip_size{"strip_size", 32};
+    GeneratorParam<int> tile_width{"tile_width", 256};
+    GeneratorParam<FirebreakType> firebreak_type{"firebreak_type", FirebreakType::Float32, firebreak_type_names()};
+    GeneratorParam<int> ll_fast_levels{"ll_fast_levels", 0};
+    GeneratorParam<bool> fast_color_math{"fast_color_math", false};
+    GeneratorParam<bool> tetrahedral_color_lut{"tetrahedral_color_lut", false};
+
+    void generate() {
+        using namespace Halide::ConciseCasts;
+        Expr out_width = frame_width;
+        Expr out_height = frame_height;
+
+        // Clamp to the region that was actually computed. Halide can't
+        // infer this pipeline's reads across to the front end, so a caller
+        // rendering part of the frame gives it the warp's source rectangle
+        // plus the pyramid's reach (see RenderFrame in the editor); only what
+        // lies outside the frame is then clamped.
+        Func linear_bounded("linear_bounded");
+        linear_bounded = BoundaryConditions::repeat_edge(linear);
+
+        // Dehaze's estimates sample the whole-frame stats image at output
+        // coordinates, clamped to [0, 1] like CameraPipeGenerator's.
+        Func stats_frame("dehaze_stats_frame");
+        Expr stats_x = clamp(cast<int>((cast<float>(x) + 0.5f) * dehaze_stats.dim(0).extent() / out_width),
+                             0, dehaze_stats.dim(0).extent() - 1) + dehaze_stats.dim(0).min();
+        Expr stats_y = clamp(cast<int>((cast<float>(y) + 0.5f) * dehaze_stats.dim(1).extent() / out_height),
+                             0, dehaze_stats.dim(1).extent() - 1) + dehaze_stats.dim(1).min();
+        stats_frame(x, y, c) = clamp(dehaze_stats(stats_x, stats_y, c), 0.0f, 1.0f);
+
+        DehazeBuilder dehaze_builder(linear_bounded, stats_frame, dehaze_strength, out_width, out_height, x, y, c);
+        Func dehazed = dehaze_builder.output;
+
+        Func srgb_to_lch = HalideColor::linear_srgb_to_lch(dehazed, x, y, c, fast_color_math);
+
+        // The input is already a materialized, resized buffer, so the whole
+        // pyramid is built from it; there is no raw data to splice a low-fi
+        // path from (cutover_level = 0 disables the splice).
+        const int J = 8;
+        const int cutover_level = 0;
+        Func no_lowfi("no_lowfi"), no_matrix("no_matrix");
+        no_lowfi(x, y, c) = 0.0f;
+        no_matrix(x, y) = 0.0f;
+        LocalLaplacianBuilder local_laplacian_builder(
+            srgb_to_lch,
+            no_lowfi, no_matrix,
+            x, y, c,
+            ll_detail, ll_clarity, ll_shadows, ll_highlights, ll_blacks, ll_whites, ll_debug_level,
+            out_width, out_height, out_width, out_height, Expr(1.0f),
+            J, cutover_level, ll_fast_levels);
+        Func lch_local_adjusted = local_laplacian_builder.output;
+
+        ColorGradeBuilder color_grade_builder(lch_local_adjusted, color_grading_lut, color_grading_lut.dim(0).extent(), x, y, c,
+                                              tetrahedral_color_lut);
+        Func lch_final = color_grade_builder.output;
+
+        Func graded_srgb = HalideColor::lch_to_linear_srgb(lch_final, x, y, c, fast_color_math);
+
+        RgbLutBuilder baked_look(dehazed, rgb_color_lut, rgb_color_lut.dim(0).extent(), x, y, c);
+        Func look_srgb("look_srgb");
+        look_srgb(x, y, c) = select(local_laplacian_builder.is_default, baked_look.output(x, y, c), graded_srgb(x, y, c));
+
+        VignetteBuilder vignette_builder(look_srgb, out_width, out_height,
+                                         vignette_amount, vignette_midpoint, vignette_roundness, vignette_highlights,
+                                         vignetting_lut, vignetting_lut.dim(0).extent(),
+                                         x, y, c);
+        FirebreakBuilder vignette_firebreak(vignette_builder.output, firebreak_type, "vignette_corrected");
+        Func vignette_corrected = vignette_firebreak.output;
+
+        LensGeometryBuilder lens_geometry_builder(vignette_corrected, x, y, c, out_width, out_height, warp_map);
+        FirebreakBuilder resampled_firebreak(lens_geometry_builder.output, firebreak_type, "resampled");
+        Func resampled = resampled_firebreak.output;
+
+        const float e = 1e-6f;
+        Expr is_geo_default = abs(geo_rotate) < e && abs(geo_scale - 100.f) < e &&
+                              abs(geo_aspect - 1.f) < e && abs(geo_keystone_v) < e &&
+                              abs(geo_keystone_h) < e && abs(geo_offset_x) < e &&
+                              abs(geo_offset_y) < e;
+        Expr is_distort_default = abs(distortion_lut(0) - 1.0f) < e &&
+                                  abs(distortion_lut(distortion_lut.dim(0).extent() - 1) - 1.0f) < e;
+        Expr is_ca_default = abs(ca_red_cyan) < e && abs(ca_blue_yellow) < e && tca_lut.dim(0).extent() <= 1;
+        Expr is_no_op_resample = is_geo_default && is_distort_default && is_ca_default;
+
+        Func resampled_or_bypass("resampled_or_bypass");
+        resampled_or_bypass(x, y, c) = select(is_no_op_resample,
+                                              vignette_corrected(x, y, c),
+                                              resampled(x, y, c));
+
+        SharpenBuilder_T<float> sharpen_builder(resampled_or_bypass, sharpen_strength, sharpen_radius, sharpen_threshold,
+                                                out_width, out_height, x, y, c);
+        Func sharpened = sharpen_builder.output;
+
+        Func tone_curve_func("tone_curve_func");
+        Var lut_x("lut_x_var"), lut_c("lut_c_var");
+        tone_curve_func(lut_x, lut_c) = tone_curve_lut(lut_x, lut_c);
+
+        Func curved = pipeline_apply_curve<float>(sharpened, Expr(0), Expr(1),
+                                                  tone_curve_func, tone_curve_lut.dim(0).extent(), x, y, c,
+                                                  get_target(), using_autoscheduler());
+
+        const int channels = output_channels;
+        if (channels != 3 && channels != 4) {
+            throw std::runtime_error("output_channels must be 3 or 4");
+        }
+
+        Func final_stage("final_stage");
+        Expr final_u8 = u8_sat(curved(x, y, channels == 4 ? min(c, 2) : Expr(c)) * 255.0f);
+        final_stage(x, y, c) = channels == 4 ? select(c < 3, final_u8, u8(255)) : final_u8;
+
+        if (interleaved_output) {
+            processed.dim(0).set_stride(channels);
+            processed.dim(2).set_min(0).set_extent(channels).set_stride(1);
+        } else if (channels == 4) {
+            throw std::runtime_error("RGBA output requires interleaved_output=true");
+        }
+
+        // The scopes are counted from the final 8-bit values at the preview's
+        // own resolution, in the same pipeline call.
+        HistogramBuilder histogram_builder(final_stage,
+                                           processed.dim(0).min(), processed.dim(0).extent(),
+                                           processed.dim(1).min(), processed.dim(1).extent());
+        histogram.dim(0).set_bounds(0, HistogramBuilder::kBins);
+        histogram.dim(1).set_bounds(0, HistogramBuilder::kChannels);
+
+        // ========== ESTIMATES ==========
+        linear.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+        dehaze_stats.set_estimates({{0, 768}, {0, 576}, {0, 3}});
+        frame_width.set_estimate(1000);
+        frame_height.set_estimate(750);
+        ll_debug_level.set_estimate(-1);
+        tone_curve_lut.set_estimates({{0, 65536}, {0, 3}});
+        color_grading_lut.set_estimates({{0, 33}, {0, 33}, {0, 33}, {0, 3}});
+        rgb_color_lut.set_estimates({{0, 65}, {0, 65}, {0, 65}, {0, 3}});
+        require_interleaved_lut(color_grading_lut);
+        require_interleaved_lut(rgb_color_lut);
+        vignetting_lut.set_estimates({{0, 256}});
+        distortion_lut.set_estimates({{0, 2048}});
+        tca_lut.set_estimates({{0, 256}, {0, 2}});
+        warp_map.set_estimates({{0, 1000}, {0, 750}, {0, WarpMapBuilder::kPlanes}});
+        final_stage.set_estimates({{0, 1000}, {0, 750}, {0, channels}});
+        histogram_builder.output.set_estimates({{0, HistogramBuilder::kBins}, {0, HistogramBuilder::kChannels}});
+
+        // ========== SCHEDULE ==========
+        schedule_back_end(using_autoscheduler(), get_target(),
+                          dehaze_builder, srgb_to_lch, local_laplacian_builder, lch_final, graded_srgb, look_srgb,
+                          vignette_firebreak.stored, resampled_firebreak.stored, resampled_or_bypass, is_no_op_resample,
+                          sharpen_builder, tone_curve_func, curved,
+                          is_compact_tone_curve(tone_curve_lut.dim(0).extent()), final_stage,
+                          StageBypasses{Expr(), dehaze_builder.is_bypassed,
+                                        local_laplacian_builder.is_default, vignette_builder.is_bypassed},
+                          x, y, c, xo, xi, yo, yi,
+                          CpuTiling{strip_size, tile_width}, J, cutover_level, channels, interleaved_output);
+        schedule_histogram(using_autoscheduler(), get_target(), histogram_builder);
 
         processed = final_stage;
+        histogram = histogram_builder.output;
+    }
+};
+
+// Builds the back end's warp_map: the lens & geometry stage's inverse
+// mapping for every pixel of a region of the frame. The editor reruns this
+// only when the geometry, lens or frame size changes.
+// CA correction's shift field for a raw (CAShiftEstimateBuilder), which the
+// editor and process --looks compute once per raw and pass to the front
+// end. Lateral CA comes from the lens, so it isn't redone between edits.
+// Exposure doesn't change the estimate; white balance is taken as it is
+// when the raw is first estimated.
+class CameraPipeCAShiftsGenerator : public Halide::Generator<CameraPipeCAShiftsGenerator> {
+public:
+    Input<Buffer<uint16_t, 2>> input{"input"};
+    Input<int> cfa_pattern{"cfa_pattern"};
+    Input<float> green_balance{"green_balance"};
+    Input<float> wb_r_gain{"wb_r_gain"};
+    Input<float> wb_g_gain{"wb_g_gain"};
+    Input<float> wb_b_gain{"wb_b_gain"};
+    Input<int> whiteLevel{"whiteLevel"};
+    Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+
+    // (bx, by, c, v), see CAShiftGrid.
+    Output<Buffer<float, 4>> ca_shifts{"ca_shifts"};
+
+    // Same meaning as on CameraPipeGenerator.
+    GeneratorParam<bool> ca_estimate_binned{"ca_estimate_binned", false};
+
+    void generate() {
+        Expr full_res_width = input.width();
+        Expr full_res_height = input.height();
+
+        Func raw_bounded("raw_bounded");
+        raw_bounded = BoundaryConditions::repeat_edge(input, {{0, full_res_width}, {0, full_res_height}});
+
+        Func linear("linear");
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        linear(x, y) = (cast<float>(raw_bounded(x, y)) - site_black) / (cast<float>(whiteLevel) - site_black);
+
+        BayerNormalizeBuilder normalize_builder(linear, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+        CAShiftEstimateBuilder estimate(normalize_builder.output, x, y, full_res_width, full_res_height,
+                                        ca_estimate_binned);
+        ca_shifts.dim(2).set_bounds(0, 2);
+        ca_shifts.dim(3).set_bounds(0, 2);
+
+        // ========== ESTIMATES ==========
+        input.set_estimates({{0, 4000}, {0, 3000}});
+        cfa_pattern.set_estimate(1);
+        green_balance.set_estimate(1.0f);
+        black_level_cfa.set_estimates({{0, 2}, {0, 2}});
+        estimate.output.set_estimates({{0, 250}, {0, 188}, {0, 2}, {0, 2}});
+
+        // ========== SCHEDULE ==========
+        schedule_ca_shifts(using_autoscheduler(), get_target(), estimate);
+
+        ca_shifts = estimate.output;
+    }
+};
+
+// A raw's exposure and white balance statistics (RawStatsBuilder), which
+// process reduces to --auto-exposure and --auto-wb settings before the
+// render. It reads the raw once, at a quarter of camera_pipe's cost for
+// its first stage.
+class RawStatsGenerator : public Halide::Generator<RawStatsGenerator> {
+public:
+    Input<Buffer<uint16_t, 2>> input{"input"};
+    Input<int> cfa_pattern{"cfa_pattern"};
+    Input<int> whiteLevel{"whiteLevel"};
+    Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+
+    // (bin, k), see RawStatsBuilder.
+    Output<Buffer<float, 2>> stats{"stats"};
+
+    void generate() {
+        Func linear("linear");
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        linear(x, y) = (cast<float>(input(x, y)) - site_black) / (cast<float>(whiteLevel) - site_black);
+
+        // The blocks stay inside the raw, so no boundary condition; the
+        // normalize's partner reads stay inside their 2x2 block.
+        BayerNormalizeBuilder normalize_builder(linear, cfa_pattern, 1.0f, 1.0f, 1.0f, 1.0f, x, y);
+        RawStatsBuilder stats_builder(normalize_builder.output, input.width(), input.height());
+        stats.dim(0).set_bounds(0, RawStatsBuilder::kBins + 1);
+        stats.dim(1).set_bounds(0, RawStatsBuilder::kValues);
+
+        // ========== ESTIMATES ==========
+        input.set_estimates({{0, 4056}, {0, 3040}});
+        cfa_pattern.set_estimate(1);
+        whiteLevel.set_estimate(4095);
+        black_level_cfa.set_estimates({{0, 2}, {0, 2}});
+        stats_builder.output.set_estimates({{0, RawStatsBuilder::kBins + 1}, {0, RawStatsBuilder::kValues}});
+
+        // ========== SCHEDULE ==========
+        schedule_raw_stats(using_autoscheduler(), get_target(), stats_builder);
+
+        stats = stats_builder.output;
+    }
+};
+
+class CameraPipeWarpMapGenerator : public Halide::Generator<CameraPipeWarpMapGenerator> {
+public:
+    Input<int> frame_width{"frame_width"};
+    Input<int> frame_height{"frame_height"};
+    Input<Buffer<float, 1>> distortion_lut{"distortion_lut"};
+    Input<Buffer<float, 2>> tca_lut{"tca_lut"};
+    Input<float> ca_red_cyan{"ca_red_cyan"};
+    Input<float> ca_blue_yellow{"ca_blue_yellow"};
+    Input<float> geo_rotate{"geo_rotate"};
+    Input<float> geo_scale{"geo_scale"};
+    Input<float> geo_aspect{"geo_aspect"};
+    Input<float> geo_keystone_v{"geo_keystone_v"};
+    Input<float> geo_keystone_h{"geo_keystone_h"};
+    Input<float> geo_offset_x{"geo_offset_x"};
+    Input<float> geo_offset_y{"geo_offset_y"};
+
+    // (x, y, k), see WarpMapBuilder.
+    Output<Buffer<float, 3>> warp_map{"warp_map"};
+
+    void generate() {
+        Var k("k");
+        WarpMapBuilder warp_map_builder(x, y, k, frame_width, frame_height,
+                                        distortion_lut, distortion_lut.dim(0).extent(),
+                                        tca_lut, tca_lut.dim(0).extent(),
+                                        ca_red_cyan, ca_blue_yellow,
+                                        geo_rotate, geo_scale, geo_aspect,
+                                        geo_keystone_v, geo_keystone_h,
+                                        geo_offset_x, geo_offset_y);
+        warp_map.dim(2).set_bounds(0, WarpMapBuilder::kPlanes);
+
+        // ========== ESTIMATES ==========
+        frame_width.set_estimate(1000);
+        frame_height.set_estimate(750);
+        distortion_lut.set_estimates({{0, 2048}});
+        tca_lut.set_estimates({{0, 256}, {0, 2}});
+        warp_map_builder.output.set_estimates({{0, 1000}, {0, 750}, {0, WarpMapBuilder::kPlanes}});
+
+        // ========== SCHEDULE ==========
+        schedule_warp_map(using_autoscheduler(), get_target(), warp_map_builder, x, y, k);
+
+        warp_map = warp_map_builder.output;
+    }
+};
+
+// The camera frontend's live view: camera_pipe_u16 cut down to what fits a
+// 33 ms frame at display resolution on a Pi. The raw is Bayer-binned
+// straight to the output grid (no full-resolution demosaic), then colour
+// corrected, looked up in the baked look LUT in fixed point and tone
+// curved. There is no denoise, CA correction, dehaze, local adjustment,
+// vignette or lens geometry: the preview shows the colour and tone process
+// renders, not its detail. Output is interleaved RGBA, for a straight GLES
+// texture upload.
+//
+// The alpha channel carries the exposure and focus aids as flags, computed
+// in the same strips as the colour: bit 0 is focus peaking, bit 1 zebra.
+class CameraPipePreviewGenerator : public Halide::Generator<CameraPipePreviewGenerator> {
+public:
+    GeneratorParam<int> strip_size{"strip_size", 16};
+
+    Input<Buffer<uint16_t, 2>> input{"input"};
+    Input<int> cfa_pattern{"cfa_pattern"};
+    Input<float> green_balance{"green_balance"};
+    // Raw pixels per output pixel; 2 or more (BayerBinBuilder).
+    Input<float> downscale_factor{"downscale_factor"};
+    Input<float> wb_r_gain{"wb_r_gain"};
+    Input<float> wb_g_gain{"wb_g_gain"};
+    Input<float> wb_b_gain{"wb_b_gain"};
+    Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+    Input<float> exposure_multiplier{"exposure_multiplier"};
+    Input<int> blackLevel{"blackLevel"};
+    Input<int> whiteLevel{"whiteLevel"};
+    Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+    Input<Buffer<uint16_t, 2>> tone_curve_lut{"tone_curve_lut"};
+    Input<Buffer<float, 4>> rgb_color_lut{"rgb_color_lut"};
+    // Focus peaking marks binned green Laplacians over this fraction of the
+    // local level; zebras mark pixels with a channel at or over zebra_level
+    // (8-bit output units).
+    Input<float> peaking_threshold{"peaking_threshold"};
+    Input<int> zebra_level{"zebra_level"};
+
+    Output<Buffer<uint8_t, 3>> processed{"processed"};
+    // 256 bins x (R, G, B, luma) counts of `processed`.
+    Output<Buffer<uint32_t, 2>> histogram{"histogram"};
+
+    void generate() {
+        using namespace Halide::ConciseCasts;
+        Expr full_res_width = input.width();
+        Expr full_res_height = input.height();
+
+        Func raw_bounded("raw_bounded");
+        raw_bounded = BoundaryConditions::repeat_edge(input, {{0, full_res_width}, {0, full_res_height}});
+
+        Func linear_exposed("linear_exposed");
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        Expr inv_range = 1.0f / (cast<float>(whiteLevel) - site_black);
+        linear_exposed(x, y) = (cast<float>(raw_bounded(x, y)) - site_black) * inv_range * exposure_multiplier;
+
+        BayerNormalizeBuilder normalize_builder(linear_exposed, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+        Func deinterleaved = pipeline_deinterleave(normalize_builder.output, x, y, c);
+        BayerBinBuilder bin_builder(deinterleaved, full_res_width, full_res_height, downscale_factor, x, y, c);
+
+        ColorCorrectBuilder_T<uint16_t> color_correct_builder(bin_builder.output, UInt(16), color_matrix, x, y, c);
+        Func corrected = color_correct_builder.output;
+
+        // The u16 pipeline's default look path, without the dehaze.
+        FixedPointLookBuilder look(corrected, nullptr, rgb_color_lut, rgb_color_lut.dim(0).extent(), x, y, c);
+        Func look_u16("look_u16");
+        look_u16(x, y, c) = u16_sat(u32(look.output(x, y, c)) * 65535 / uint32_t(FixedPointLookBuilder::kOutScale));
+
+        Func tone_curve_func("tone_curve_func");
+        Var lut_x("lut_x_var"), lut_c("lut_c_var");
+        tone_curve_func(lut_x, lut_c) = tone_curve_lut(lut_x, lut_c);
+        Func curved = pipeline_apply_curve<uint16_t>(look_u16, blackLevel, whiteLevel,
+                                                     tone_curve_func, tone_curve_lut.dim(0).extent(), x, y, c,
+                                                     get_target(), using_autoscheduler());
+
+        // Focus peaking on the binned green, relative to its level so edges
+        // in the shadows show as well as those in the highlights.
+        Func green("preview_green");
+        green(x, y) = bin_builder.output(x, y, 1);
+        Expr laplacian = 4.0f * green(x, y) - green(x - 1, y) - green(x + 1, y) - green(x, y - 1) - green(x, y + 1);
+        Expr peak = abs(laplacian) > peaking_threshold * (green(x, y) + 0.01f);
+        Expr zebra = max(curved(x, y, 0), curved(x, y, 1), curved(x, y, 2)) >> 8 >= cast<uint16_t>(zebra_level);
+        Expr aid_flags = select(peak, u8(1), u8(0)) | select(zebra, u8(2), u8(0));
+
+        const int channels = 4;
+        Func final_stage("final_stage");
+        final_stage(x, y, c) = select(c < 3, u8_sat(curved(x, y, min(c, 2)) >> 8), aid_flags);
+        processed.dim(0).set_stride(channels);
+        processed.dim(2).set_min(0).set_extent(channels).set_stride(1);
+
+        HistogramBuilder histogram_builder(final_stage,
+                                           processed.dim(0).min(), processed.dim(0).extent(),
+                                           processed.dim(1).min(), processed.dim(1).extent(), strip_size);
+        histogram.dim(0).set_bounds(0, HistogramBuilder::kBins);
+        histogram.dim(1).set_bounds(0, HistogramBuilder::kChannels);
+
+        // ========== ESTIMATES ==========
+        input.set_estimates({{0, 2028}, {0, 1520}});
+        cfa_pattern.set_estimate(1);
+        green_balance.set_estimate(1.0f);
+        downscale_factor.set_estimate(2.0f);
+        color_matrix.set_estimates({{0, 4}, {0, 3}});
+        black_level_cfa.set_estimates({{0, 2}, {0, 2}});
+        tone_curve_lut.set_estimates({{0, 65536}, {0, 3}});
+        rgb_color_lut.set_estimates({{0, 65}, {0, 65}, {0, 65}, {0, 3}});
+        require_interleaved_lut(rgb_color_lut);
+        peaking_threshold.set_estimate(0.25f);
+        zebra_level.set_estimate(250);
+        final_stage.set_estimates({{0, 1014}, {0, 760}, {0, channels}});
+        histogram_builder.output.set_estimates({{0, HistogramBuilder::kBins}, {0, HistogramBuilder::kChannels}});
+
+        // ========== SCHEDULE ==========
+        schedule_preview(using_autoscheduler(), get_target(), bin_builder, corrected, color_correct_builder.cc_matrix,
+                         look, tone_curve_func, curved, is_compact_tone_curve(tone_curve_lut.dim(0).extent()), final_stage,
+                         x, y, c, yo, yi, strip_size, channels);
+        schedule_histogram(using_autoscheduler(), get_target(), histogram_builder);
+
+        processed = final_stage;
+        histogram = histogram_builder.output;
+    }
+};
+
+// The live view's chain written straight into an embedded display's frame
+// buffer (src/lvgl-editor/pipeline_display.h): PixelT is the display's
+// pixel, uint16_t for RGB565 or uint32_t for ARGB8888 as LVGL lays them
+// out. The pixels are packed from the tone-curved 16-bit colour in the same
+// pass, RGB565 with a 4x4 ordered dither, and the output rows may be any
+// stride the draw buffer has, so the raw goes to the screen in one pass.
+// There are no exposure aids or histogram.
+template <typename PixelT>
+class CameraPipeDisplayGenerator : public Halide::Generator<CameraPipeDisplayGenerator<PixelT>> {
+public:
+    GeneratorParam<int> strip_size{"strip_size", 16};
+
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<Buffer<uint16_t, 2>> input{"input"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<int> cfa_pattern{"cfa_pattern"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> green_balance{"green_balance"};
+    // Raw pixels per output pixel; 2 or more (BayerBinBuilder).
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> downscale_factor{"downscale_factor"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> wb_r_gain{"wb_r_gain"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> wb_g_gain{"wb_g_gain"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> wb_b_gain{"wb_b_gain"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<float> exposure_multiplier{"exposure_multiplier"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<int> blackLevel{"blackLevel"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<int> whiteLevel{"whiteLevel"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<Buffer<int, 2>> black_level_cfa{"black_level_cfa"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<Buffer<uint16_t, 2>> tone_curve_lut{"tone_curve_lut"};
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Input<Buffer<float, 4>> rgb_color_lut{"rgb_color_lut"};
+
+    typename Generator<CameraPipeDisplayGenerator<PixelT>>::template Output<Buffer<PixelT, 2>> display{"display"};
+
+    void generate() {
+        using namespace Halide::ConciseCasts;
+        Expr full_res_width = input.width();
+        Expr full_res_height = input.height();
+
+        Func raw_bounded("raw_bounded");
+        raw_bounded = BoundaryConditions::repeat_edge(input, {{0, full_res_width}, {0, full_res_height}});
+
+        Func linear_exposed("linear_exposed");
+        Expr site_black = cast<float>(black_level_cfa(x & 1, y & 1));
+        Expr inv_range = 1.0f / (cast<float>(whiteLevel) - site_black);
+        linear_exposed(x, y) = (cast<float>(raw_bounded(x, y)) - site_black) * inv_range * exposure_multiplier;
+
+        BayerNormalizeBuilder normalize_builder(linear_exposed, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, x, y);
+        Func deinterleaved = pipeline_deinterleave(normalize_builder.output, x, y, c);
+        BayerBinBuilder bin_builder(deinterleaved, full_res_width, full_res_height, downscale_factor, x, y, c);
+
+        ColorCorrectBuilder_T<uint16_t> color_correct_builder(bin_builder.output, UInt(16), color_matrix, x, y, c);
+        Func corrected = color_correct_builder.output;
+
+        FixedPointLookBuilder look(corrected, nullptr, rgb_color_lut, rgb_color_lut.dim(0).extent(), x, y, c);
+        Func look_u16("look_u16");
+        look_u16(x, y, c) = u16_sat(u32(look.output(x, y, c)) * 65535 / uint32_t(FixedPointLookBuilder::kOutScale));
+
+        Func tone_curve_func("tone_curve_func");
+        Var lut_x("lut_x_var"), lut_c("lut_c_var");
+        tone_curve_func(lut_x, lut_c) = tone_curve_lut(lut_x, lut_c);
+        Func curved = pipeline_apply_curve<uint16_t>(look_u16, blackLevel, whiteLevel,
+                                                     tone_curve_func, tone_curve_lut.dim(0).extent(), x, y, c,
+                                                     this->get_target(), this->using_autoscheduler());
+
+        Func packed("packed");
+        if (std::is_same<PixelT, uint16_t>::value) {
+            // The 4x4 Bayer threshold (0..15) of the pixel, as a fraction of
+            // one output step below 2^16: (v * levels + threshold) >> 16
+            // rounds v up with probability equal to its remainder.
+            Expr xx = x & 3, yy = y & 3, xy = xx ^ yy;
+            Expr bayer = ((xy & 1) << 3) | ((yy & 1) << 2) | (xy & 2) | ((yy >> 1) & 1);
+            Expr threshold = u32(bayer * 2 + 1) << 11;
+            auto quantize = [&](int ch, uint32_t levels) {
+                return u16((u32(curved(x, y, ch)) * levels + threshold) >> 16);
+            };
+            packed(x, y) = (quantize(0, 31) << 11) | (quantize(1, 63) << 5) | quantize(2, 31);
+        } else {
+            auto to8 = [&](int ch) { return u32(curved(x, y, ch) >> 8); };
+            packed(x, y) = (u32(0xff) << 24) | (to8(0) << 16) | (to8(1) << 8) | to8(2);
+        }
+
+        // ========== ESTIMATES ==========
+        input.set_estimates({{0, 2028}, {0, 1520}});
+        cfa_pattern.set_estimate(1);
+        green_balance.set_estimate(1.0f);
+        downscale_factor.set_estimate(2.0f);
+        color_matrix.set_estimates({{0, 4}, {0, 3}});
+        black_level_cfa.set_estimates({{0, 2}, {0, 2}});
+        tone_curve_lut.set_estimates({{0, 65536}, {0, 3}});
+        rgb_color_lut.set_estimates({{0, 65}, {0, 65}, {0, 65}, {0, 3}});
+        require_interleaved_lut(rgb_color_lut);
+        packed.set_estimates({{0, 1014}, {0, 760}});
+
+        // ========== SCHEDULE ==========
+        schedule_display(this->using_autoscheduler(), this->get_target(), bin_builder, corrected, color_correct_builder.cc_matrix,
+                         look, tone_curve_func, curved, is_compact_tone_curve(tone_curve_lut.dim(0).extent()), packed,
+                         x, y, c, yo, yi, strip_size);
+
+        display = packed;
+    }
+};
+
+// Merges a burst of raw frames into one mosaic (BurstMergeBuilder) for
+// camera_pipe to process as if it were a single, longer exposure. process
+// runs this ahead of the pipeline when given --burst-frames.
+class BurstMergeGenerator : public Halide::Generator<BurstMergeGenerator> {
+public:
+    // Rows per parallel strip of the merged output.
+    GeneratorParam<int> strip_size{"strip_size", 32};
+
+    // (x, y, n) raw samples; frame 0 is the reference.
+    Input<Buffer<uint16_t, 3>> frames{"frames"};
+    // Noise standard deviation of one frame, in raw units.
+    Input<float> noise_sigma{"noise_sigma"};
+    Input<float> merge_strength{"merge_strength"};
+
+    Output<Buffer<uint16_t, 2>> merged{"merged"};
+
+    void generate() {
+        BurstMergeBuilder merge(frames, frames.dim(0).extent(), frames.dim(1).extent(), frames.dim(2).extent(),
+                                noise_sigma, merge_strength, x, y);
+
+        // ========== ESTIMATES ==========
+        frames.set_estimates({{0, 4000}, {0, 3000}, {0, 4}});
+        noise_sigma.set_estimate(16.0f);
+        merge_strength.set_estimate(8.0f);
+        merge.output.set_estimates({{0, 4000}, {0, 3000}});
+
+        // ========== SCHEDULE ==========
+        schedule_burst_merge(using_autoscheduler(), get_target(), merge, x, y, strip_size);
+
+        merged = merge.output;
+    }
+};
+
+// Blends a raw frame with the previous output of a sequence
+// (TemporalDenoiseBuilder); the caller keeps `denoised` as the next frame's
+// `history`. The camera frontend runs this ahead of camera_pipe_preview.
+class TemporalDenoiseGenerator : public Halide::Generator<TemporalDenoiseGenerator> {
+public:
+    // Rows per parallel strip of the output; even, to keep whole CFA blocks.
+    GeneratorParam<int> strip_size{"strip_size", 32};
+
+    Input<Buffer<uint16_t, 2>> frame{"frame"};
+    Input<Buffer<uint16_t, 2>> history{"history"};
+    // Noise standard deviation of one frame, in raw units.
+    Input<float> noise_sigma{"noise_sigma"};
+    // The history's weight on static content, [0, 0.95]; 0 passes the frame through.
+    Input<float> strength{"strength"};
+
+    Output<Buffer<uint16_t, 2>> denoised{"denoised"};
+
+    void generate() {
+        TemporalDenoiseBuilder td(frame, history, frame.dim(0).extent(), frame.dim(1).extent(),
+                                  noise_sigma, strength, x, y);
+
+        // ========== ESTIMATES ==========
+        frame.set_estimates({{0, 4056}, {0, 3040}});
+        history.set_estimates({{0, 4056}, {0, 3040}});
+        noise_sigma.set_estimate(16.0f);
+        strength.set_estimate(0.8f);
+        td.output.set_estimates({{0, 4056}, {0, 3040}});
+
+        // ========== SCHEDULE ==========
+        schedule_temporal_denoise(using_autoscheduler(), get_target(), td, x, y, strip_size);
+
+        denoised = td.output;
     }
 };
 
 // Explicitly instantiate the generator for both float and uint16_t.
 template class CameraPipeGenerator<float>;
 template class CameraPipeGenerator<uint16_t>;
+template class CameraPipeGenerator<float, uint8_t>;
 
 // Create a non-templated alias for the f32 generator to satisfy
 // the existing build system which looks for "camera_pipe".
@@ -305,4 +1409,31 @@ class CameraPipe : public CameraPipeGenerator<float> {};
 HALIDE_REGISTER_GENERATOR(CameraPipe, camera_pipe)
 HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<float>, camera_pipe_f32)
 HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<uint16_t>, camera_pipe_u16)
+// The f32 pipeline on CSI-2 packed raws (BUILD_PACKED_RAW_PIPELINES), built
+// as camera_pipe_f32_raw10 and camera_pipe_f32_raw12 with raw_packing.
+using CameraPipePackedF32 = CameraPipeGenerator<float, uint8_t>;
+HALIDE_REGISTER_GENERATOR(CameraPipePackedF32, camera_pipe_f32_packed)
+// Same pipeline, built for a GPU target (see HALIDE_GPU_TARGET in CMakeLists.txt).
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<float>, camera_pipe_f32_gpu)
+// Same pipeline with float16 firebreaks (BUILD_F16_PIPELINE). Compute stays
+// float32: the LUT indices (tone curve, grading and distortion LUTs) and the
+// local Laplacian's pyramid base and remap need more than float16's 11 bits,
+// and every other stage lives in per-strip buffers that fit in cache anyway.
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<float>, camera_pipe_f16)
+// Same pipelines, built with the Halide profiler (BUILD_PROFILE_PIPELINES).
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<float>, camera_pipe_f32_profile)
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<uint16_t>, camera_pipe_u16_profile)
+// And with Halide tracing of pipelines and realizations (BUILD_TRACE_PIPELINES).
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<float>, camera_pipe_f32_trace)
+HALIDE_REGISTER_GENERATOR(CameraPipeGenerator<uint16_t>, camera_pipe_u16_trace)
+HALIDE_REGISTER_GENERATOR(CameraPipeFrontGenerator, camera_pipe_front_f32)
+HALIDE_REGISTER_GENERATOR(CameraPipeBackGenerator, camera_pipe_back_f32)
+HALIDE_REGISTER_GENERATOR(CameraPipeWarpMapGenerator, camera_pipe_warp_map)
+HALIDE_REGISTER_GENERATOR(CameraPipeCAShiftsGenerator, camera_pipe_ca_shifts)
+HALIDE_REGISTER_GENERATOR(RawStatsGenerator, raw_stats)
+HALIDE_REGISTER_GENERATOR(BurstMergeGenerator, burst_merge)
+HALIDE_REGISTER_GENERATOR(CameraPipePreviewGenerator, camera_pipe_preview)
+HALIDE_REGISTER_GENERATOR(CameraPipeDisplayGenerator<uint16_t>, camera_pipe_display_rgb565)
+HALIDE_REGISTER_GENERATOR(CameraPipeDisplayGenerator<uint32_t>, camera_pipe_display_argb8888)
+HALIDE_REGISTER_GENERATOR(TemporalDenoiseGenerator, temporal_denoise)
 
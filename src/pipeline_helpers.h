@@ -2,7 +2,10 @@
 #define PIPELINE_HELPERS_H
 
 #include "Halide.h"
+#include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 // A helper to saturate to the processing type's range.
 // For uint16_t, this is 0-65535.
@@ -51,6 +54,69 @@ inline Halide::Expr smoothstep(Halide::Expr edge0, Halide::Expr edge1, Halide::E
     return t * t * (3.0f - 2.0f * t);
 }
 
+// Sums `f` over the (2 * radius + 1)^2 box around each (x, y) with separable
+// running sums. Each row is cut into blocks of `block` samples: the first sum
+// of a block is taken over the whole window, and each following one adds the
+// sample entering the window and subtracts the one leaving it. The columns of
+// the horizontal sums are then summed down the same way. That is about
+// 4 + 2 * (2 * radius + 1) / block adds per pixel, so widening the box costs
+// next to nothing.
+//
+// `scan_x` and `scan_y` hold the running sums, indexed by (offset within the
+// block, block), and have update definitions, so they need a schedule: as
+// strip-level producers of the consumer, with `block` the strip height, each
+// strip scans its own rows. `sum_x` and `output` only index into them and are
+// inlined. Dimensions of `f` after x and y are passed in `rest`.
+class BoxSumBuilder {
+public:
+    Halide::Func scan_x, scan_y;
+    Halide::Func sum_x, output;
+    // The offset within a block and the block index. scan_x is
+    // (offset, y, block, rest...) and scan_y (x, offset, block, rest...).
+    Halide::Var offset{"box_offset"}, block_index{"box_block"};
+
+    BoxSumBuilder(Halide::Func f, int radius, int block, const std::string& name,
+                  Halide::Var x, Halide::Var y, const std::vector<Halide::Var>& rest = {})
+        : scan_x(name + "_scan_x"), scan_y(name + "_scan_y"), sum_x(name + "_sum_x"), output(name)
+    {
+        using namespace Halide;
+        if (radius < 0 || block < 1) {
+            throw std::runtime_error("BoxSumBuilder: needs radius >= 0 and block >= 1");
+        }
+        const int R = radius, B = block;
+
+        auto vars = [&](std::vector<Var> v) {
+            v.insert(v.end(), rest.begin(), rest.end());
+            return v;
+        };
+        auto at = [&](std::vector<Expr> v) {
+            v.insert(v.end(), rest.begin(), rest.end());
+            return v;
+        };
+        Var i = offset, b = block_index;
+        RDom window(-R, 2 * R + 1, name + "_window");
+        RDom step(1, B - 1, name + "_step");
+
+        // Along x.
+        Expr x0 = b * B;
+        scan_x(vars({i, y, b})) = 0.0f;
+        scan_x(at({0, y, b})) = sum(cast<float>(f(at({x0 + window, y}))), name + "_start_x");
+        scan_x(at({step, y, b})) = scan_x(at({step - 1, y, b}))
+                                 + cast<float>(f(at({x0 + step + R, y})))
+                                 - cast<float>(f(at({x0 + step - R - 1, y})));
+        sum_x(vars({x, y})) = scan_x(at({x % B, y, x / B}));
+
+        // Down y, over the horizontal sums.
+        Expr y0 = b * B;
+        scan_y(vars({x, i, b})) = 0.0f;
+        scan_y(at({x, 0, b})) = sum(sum_x(at({x, y0 + window})), name + "_start_y");
+        scan_y(at({x, step, b})) = scan_y(at({x, step - 1, b}))
+                                 + sum_x(at({x, y0 + step + R}))
+                                 - sum_x(at({x, y0 + step - R - 1}));
+        output(vars({x, y})) = scan_y(at({x, y % B, y / B}));
+    }
+};
+
 #endif // PIPELINE_HELPERS_H
 
 
@@ -2,11 +2,760 @@
 #define PIPELINE_SCHEDULE_H
 
 #include "Halide.h"
+#include "pipeline_helpers.h"
+#include "stage_bayer_normalize.h"
 #include "stage_ca_correct.h"
+#include "stage_denoise.h"
 #include "stage_demosaic.h"
 #include "stage_resize.h"
+#include "stage_bayer_bin.h"
 #include "stage_local_adjust_laplacian.h"
 #include "stage_color_correct.h"
+#include "stage_histogram.h"
+#include "stage_raw_stats.h"
+#include "stage_lens_geometry.h"
+#include "stage_fixed_look.h"
+#include "stage_burst_merge.h"
+#include "stage_temporal_denoise.h"
+#include "stage_export_pyramid.h"
+#include "stage_masked_adjust.h"
+#include "stage_sharpen.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tiling of the manual CPU schedules. Each generator exposes these as
+// GeneratorParams, so the build can use values tuned for its target
+// (tune_schedule.sh, schedule_tuning.txt): the best strip height in
+// particular depends on how much of a strip's working set fits in cache.
+struct CpuTiling {
+    int strip_size = 32;   // Rows per parallel strip of the tiled phases.
+    int tile_size_x = 256; // Columns per tile within a strip.
+    // Output rows per chunk of the fused geometry schedule, or 0 for the
+    // full-frame firebreak. See schedule_pipeline.
+    int geometry_chunk = 0;
+    // Trade time for memory (the low_memory generator param): strips of at
+    // most kLowMemoryStripRows, the geometry warp always fused (chunks of
+    // kLowMemoryChunkRows if geometry_chunk is 0), per-tile rather than
+    // per-strip storage for the stages computed per tile, and the pointwise
+    // look stages inlined. See schedule_pipeline.
+    bool low_memory = false;
+
+    static constexpr int kLowMemoryStripRows = 16;
+    static constexpr int kLowMemoryChunkRows = 128;
+};
+
+// When each optional stage passes its input through, as the exact Exprs its
+// select tests (the builders' is_bypassed / is_default). The schedules
+// specialize the stage on its condition: in the specialized loop nest the
+// select folds to the input, the producers only the other side reads are
+// never computed, and a run with the stage at its default is a straight
+// pass. Undefined conditions (stages compiled out) are skipped.
+struct StageBypasses {
+    Halide::Expr ca_correct;
+    Halide::Expr dehaze;
+    Halide::Expr local_laplacian;
+    Halide::Expr vignette;
+    Halide::Expr denoise;
+};
+
+// Specializes `s` on every combination of `conditions`: each one is nested
+// inside the others' specializations as well as tried without them, so any
+// subset of stages at their defaults gets its own loop nest. 2^n - 1
+// specializations; use on few conditions.
+inline void specialize_combinations(Halide::Stage s, const std::vector<Halide::Expr>& conditions, size_t i = 0)
+{
+    for (; i < conditions.size(); i++) {
+        if (!conditions[i].defined()) continue;
+        specialize_combinations(s.specialize(conditions[i]), conditions, i + 1);
+    }
+}
+
+// --- Shared schedule fragments ---
+// These are used by the monolithic pipeline as well as by the split
+// front-end/back-end pipelines used by the editor.
+
+// Schedules a BoxSumBuilder's running sums per strip of `consumer`. The
+// vertical scan steps a whole row at a time, so it vectorizes along x; the
+// horizontal one steps along the row and stays scalar.
+inline void schedule_box_sum(BoxSumBuilder box, Halide::LoopLevel at, Halide::Var x, int vec_f)
+{
+    box.scan_x.compute_at(at).store_at(at).vectorize(box.offset, vec_f);
+    box.scan_y.compute_at(at).store_at(at).vectorize(x, vec_f);
+    box.scan_y.update(0).vectorize(x, vec_f);
+    box.scan_y.update(1).vectorize(x, vec_f);
+}
+
+inline void schedule_box_sum(BoxSumBuilder box, Halide::Func consumer, Halide::Var x, Halide::Var yo, int vec_f)
+{
+    schedule_box_sum(box, Halide::LoopLevel(consumer, yo), x, vec_f);
+}
+
+// Schedules an NLMeansBuilder per strip of `consumer`, offset-major: the
+// accumulators' update runs the search offsets outermost, and each offset's
+// patch sums are computed over the strip just before they're folded in.
+inline void schedule_nlmeans(NLMeansBuilder nlm, Halide::Func consumer, Halide::Var x, Halide::Var yo, int vec_f)
+{
+    Halide::Var y = nlm.accum.args()[1];
+    nlm.accum.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+    nlm.accum.update(0).reorder(x, y, nlm.offset.x).vectorize(x, vec_f);
+    schedule_box_sum(nlm.patch_ssd, Halide::LoopLevel(nlm.accum, nlm.offset.x), x, vec_f);
+}
+
+// Schedules a CA shift estimate (CAShiftEstimateBuilder, or the one a
+// CACorrectBuilder makes for itself) once for the whole image: the tile
+// sums in parallel rows of tiles, each over the rows of green it needs,
+// then the small blurred field. Computing it per strip of the consumer
+// would redo the tiles the strips share. Does nothing for a builder given
+// its shifts.
+inline void schedule_ca_shift_estimate(Halide::Func g_interp, Halide::Func block_shifts,
+                                       Halide::Func blur_x, Halide::Func blur_y,
+                                       Halide::Var bx, Halide::Var by, int vec_f)
+{
+    if (!block_shifts.defined()) return;
+    Halide::Var x = g_interp.args()[0];
+    block_shifts.compute_root().parallel(by).vectorize(bx, vec_f);
+    g_interp.compute_at(block_shifts, by).vectorize(x, vec_f);
+    blur_y.compute_root().parallel(by).vectorize(bx, vec_f);
+    blur_x.compute_at(blur_y, by).vectorize(bx, vec_f);
+}
+
+inline void schedule_ca_shift_estimate(CAShiftEstimateBuilder& estimate, int vec_f)
+{
+    schedule_ca_shift_estimate(estimate.g_interp, estimate.block_shifts, estimate.blur_x, estimate.blur_y,
+                               estimate.bx, estimate.by, vec_f);
+}
+
+inline void schedule_ca_shift_estimate(CACorrectBuilder& ca_builder, int vec_f)
+{
+    schedule_ca_shift_estimate(ca_builder.estimate_g_interp, ca_builder.block_shifts, ca_builder.blur_x,
+                               ca_builder.blur_y, ca_builder.bx, ca_builder.by, vec_f);
+}
+
+// Schedules DemosaicAdaptive's per-block branch inside `consumer`'s strips:
+// the tile weights, then each block's fast result and, in the blocks that
+// need it, the blend with the inlined high-quality demosaic. The reader
+// (the dispatcher's output) must align its vectors to `vec_f` so its
+// loads from the blocks are dense.
+inline void schedule_demosaic_adaptive(DemosaicAdaptive& adaptive, Halide::Func consumer, Halide::Var yo, int vec_f)
+{
+    if (!adaptive.blocks.defined()) return;
+    Halide::Var c = adaptive.blocks.args()[2];
+    adaptive.tile_weight.compute_at(consumer, yo).store_at(consumer, yo);
+    adaptive.blocks.compute_at(consumer, yo).store_at(consumer, yo)
+        .bound(adaptive.xi, 0, DemosaicAdaptive::kBlockWidth)
+        .bound(adaptive.yi, 0, DemosaicAdaptive::kBlockHeight)
+        .bound(c, 0, 3)
+        .vectorize(adaptive.xi, vec_f).unroll(c);
+    adaptive.blocks.update().vectorize(adaptive.r.x, vec_f).unroll(c);
+}
+
+// Schedules the raw front end (CFA remap, denoise, CA correction,
+// deinterleave, demosaic, resize and colour matrix) at strip granularity
+// inside `consumer`'s `yo` loop.
+inline void schedule_front_end_producers(
+    Halide::Func consumer,
+    BayerNormalizeBuilder& normalize,
+    DenoiseBuilder* denoise,
+    CACorrectBuilder& ca_builder,
+    Halide::Func deinterleaved_hi_fi,
+    Halide::Func demosaiced,
+    DemosaicDispatcherT<float>& demosaic_dispatcher,
+    Halide::Func downscaled,
+    Halide::Expr is_no_op_resize,
+    ResizeBuilder& resize_builder,
+    BayerBinBuilder& bin_builder,
+    Halide::Func corrected_hi_fi,
+    const StageBypasses& bypasses,
+    Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var yo,
+    int vec, int vec_f)
+{
+    using namespace Halide;
+
+    // The canonical mosaic is read straight from the u16 raw per strip,
+    // with no full-frame float buffer. The remap swaps neighbouring
+    // columns, so x is split into column pairs: each lane of a pair has a
+    // constant source offset, and the vectors across pairs are strided
+    // loads and stores instead of a gather.
+    Var xp("bayer_xp"), xq("bayer_xq");
+    normalize.output.compute_at(consumer, yo).store_at(consumer, yo)
+        .align_bounds(x, 2).split(x, xp, xq, 2).unroll(xq).vectorize(xp, vec_f);
+    normalize.specialize_cfa();
+
+    if (denoise) {
+        // The mosaic CA correction reads, and the planes behind it at
+        // quarter resolution. At strength 0 neither is computed.
+        denoise->output.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+        if (bypasses.denoise.defined()) denoise->output.specialize(bypasses.denoise);
+        denoise->planes.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+        denoise->planes.bound(c, 0, 4).unroll(c);
+        // One loop nest per filter; the other's producers aren't referenced
+        // from it, so they aren't computed.
+        denoise->planes.specialize(denoise->algo_id == DenoiseBuilder::GUIDED);
+        denoise->planes.specialize(denoise->algo_id == DenoiseBuilder::NLMEANS);
+        for (const BoxSumBuilder& box : denoise->box_sums) schedule_box_sum(box, consumer, x, yo, vec_f);
+        for (const NLMeansBuilder& nlm : denoise->nlmeans) schedule_nlmeans(nlm, consumer, x, yo, vec_f);
+    }
+    ca_builder.output.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+    if (bypasses.ca_correct.defined()) ca_builder.output.specialize(bypasses.ca_correct);
+    ca_builder.g_interp.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+    schedule_ca_shift_estimate(ca_builder, vec_f);
+
+    deinterleaved_hi_fi.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec_f);
+    demosaiced.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec);
+    demosaiced.bound(c, 0, 3).unroll(c);
+    demosaiced.align_bounds(x, vec);
+
+    // One loop nest per demosaic algorithm. Each specialization substitutes
+    // the algorithm id, so the dispatcher's select folds to a single
+    // algorithm and the others drop out of the inner loop entirely.
+    // Unknown ids fall through to the generic (select) path.
+    {
+        typedef DemosaicDispatcherT<float> D;
+        Expr algo = demosaic_dispatcher.algo_id;
+        demosaiced.specialize(algo == D::AHD);
+        demosaiced.specialize(algo == D::LMMSE);
+        demosaiced.specialize(algo == D::RI);
+        demosaiced.specialize(algo == D::FAST);
+        demosaiced.specialize(algo == D::ADAPTIVE);
+        schedule_demosaic_adaptive(demosaic_dispatcher.adaptive, consumer, yo, vec_f);
+
+        // RI's full-resolution green and colour-difference planes are each
+        // read once per output channel. Materialize them per row of the
+        // demosaic instead of recomputing them three times. They are only
+        // referenced from the RI specialization, so the other paths skip them.
+        for (auto& f : demosaic_dispatcher.ri_intermediates) {
+            std::string n = f.name();
+            if (n == "g_final_ri" || n == "cd_r_interp" || n == "cd_b_interp") {
+                f.compute_at(demosaiced, y).vectorize(f.args()[0], vec_f);
+            }
+        }
+    }
+
+    downscaled.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec);
+    downscaled.bound(c, 0, 3).unroll(c);
+    // Full-res, binned and resampled paths each get their own loop nest. In the
+    // binned path `demosaiced` is never referenced, so it isn't computed.
+    downscaled.specialize(is_no_op_resize);
+    downscaled.specialize(bin_builder.use_binning);
+
+    resize_builder.interp_y.compute_at(downscaled, y).vectorize(resize_builder.x_coord, vec_f);
+    // The tables depend only on the sizes, so they are kept across runs.
+    for (Func t : resize_builder.tables) t.compute_root().memoize();
+    bin_builder.bin_x.compute_at(downscaled, y).vectorize(x, vec_f);
+
+    corrected_hi_fi.compute_at(consumer, yo).store_at(consumer, yo).vectorize(x, vec);
+    corrected_hi_fi.bound(c, 0, 3).unroll(c);
+}
+
+// Schedules the local Laplacian pyramid inside `consumer` (tiled with xo/yo).
+// Hi-fi levels are computed per tile, low-fi (spliced) levels per strip.
+// The per-tile levels are stored per strip, so each tile reuses the rows its
+// left neighbour computed, or with `store_per_tile` per tile, recomputing
+// that overlap to keep only a tile of each level.
+inline void schedule_local_laplacian(
+    Halide::Func consumer,
+    LocalLaplacianBuilder& ll,
+    Halide::Var xo, Halide::Var yo,
+    int J, int cutover_level, int vec_f,
+    bool store_per_tile = false)
+{
+    using namespace Halide;
+#ifndef BYPASS_LAPLACIAN_PYRAMID
+    const Var hi_fi_store = store_per_tile ? xo : yo;
+    // Depends only on the shadows and highlights sliders, so it is kept
+    // across runs (PipelineUtils::set_memoization_cache_size).
+    ll.remap_lut.compute_root().memoize();
+
+    ll.gPyramid[0].compute_at(consumer, xo).store_at(consumer, hi_fi_store);
+    bool perform_splice = (cutover_level > 0 && cutover_level < J);
+
+    if (perform_splice) {
+        // The splice level is 1/2^cutover_level of the output, but each strip
+        // reaches far into it through the coarse levels, so it is computed
+        // once up front in row bands, with the low-fi path up to it per band.
+        Var lx = ll.lowfi_spliced.args()[0], ly = ll.lowfi_spliced.args()[1];
+        Var lyo("lowfi_yo"), lyi("lowfi_yi");
+        ll.lowfi_spliced.compute_root().split(ly, lyo, lyi, 8).parallel(lyo).vectorize(lx, vec_f);
+        for (auto& f : ll.low_fi_intermediates) f.compute_at(ll.lowfi_spliced, lyo).vectorize(f.args()[0], vec_f);
+        for (auto& f : ll.lowfi_downsample_helpers) f.compute_at(ll.lowfi_spliced, lyo).vectorize(f.args()[0], vec_f);
+        if (ll.lowfi_resize_builder) {
+            auto& builder = ll.lowfi_resize_builder;
+            Var hy = builder->output.args()[1];
+            builder->interp_y.compute_at(builder->output, hy).vectorize(builder->x_coord, vec_f);
+            for (Func t : builder->tables) t.compute_root().memoize();
+            builder->specialize_exact();
+        }
+        for (int j = 1; j < cutover_level; j++) ll.gPyramid[j].compute_at(consumer, xo).store_at(consumer, hi_fi_store).vectorize(ll.gPyramid[j].args()[0], vec_f);
+        for (int j = cutover_level; j < J; j++) ll.gPyramid[j].compute_at(consumer, yo).store_at(consumer, yo).vectorize(ll.gPyramid[j].args()[0], vec_f);
+    } else {
+        for (int j = 1; j < J; j++) ll.gPyramid[j].compute_at(consumer, xo).store_at(consumer, hi_fi_store).vectorize(ll.gPyramid[j].args()[0], vec_f);
+    }
+
+    for (int j = 0; j < J; j++) {
+        auto& helpers = (perform_splice && j >= cutover_level) ? ll.low_freq_pyramid_helpers : ll.high_freq_pyramid_helpers;
+        auto compute_loc = (perform_splice && j >= cutover_level) ? yo : xo;
+        auto store_loc = (perform_splice && j >= cutover_level) ? yo : hi_fi_store;
+        for (auto& f : helpers) f.compute_at(consumer, compute_loc).store_at(consumer, store_loc);
+        ll.inLPyramid[j].compute_at(consumer, compute_loc).store_at(consumer, store_loc).vectorize(ll.inLPyramid[j].args()[0], vec_f);
+        ll.outLPyramid[j].compute_at(consumer, compute_loc).store_at(consumer, store_loc).vectorize(ll.outLPyramid[j].args()[0], vec_f);
+    }
+    // The fast mode's per-sample pyramids go where the levels they mirror do.
+    for (size_t j = 0; j < ll.fastGPyramid.size(); j++) {
+        auto& f = ll.fastGPyramid[j];
+        auto compute_loc = (perform_splice && (int)j >= cutover_level) ? yo : xo;
+        auto store_loc = (perform_splice && (int)j >= cutover_level) ? yo : hi_fi_store;
+        f.compute_at(consumer, compute_loc).store_at(consumer, store_loc).vectorize(f.args()[0], vec_f);
+        f.bound(ll.fast_k, 0, ll.fast_levels);
+    }
+    for (size_t j = 0; j < ll.fastLPyramid.size(); j++) {
+        auto& f = ll.fastLPyramid[j];
+        auto compute_loc = (perform_splice && (int)j >= cutover_level) ? yo : xo;
+        auto store_loc = (perform_splice && (int)j >= cutover_level) ? yo : hi_fi_store;
+        f.compute_at(consumer, compute_loc).store_at(consumer, store_loc).vectorize(f.args()[0], vec_f);
+        f.bound(ll.fast_k, 0, ll.fast_levels);
+    }
+    for (int j = 0; j < J; ++j) {
+        auto& f = ll.reconstructedGPyramid[j];
+        auto compute_loc = (perform_splice && j >= cutover_level) ? yo : xo;
+        auto store_loc = (perform_splice && j >= cutover_level) ? yo : hi_fi_store;
+        f.compute_at(consumer, compute_loc).store_at(consumer, store_loc).vectorize(f.args()[0], vec_f);
+    }
+#endif
+}
+
+// These are all pointwise stages that lead into `consumer` (tiled with xo/yo).
+// The fixed-point look's LUT conversion, once per run: 65^3 points, split
+// by slice.
+inline void schedule_fixed_look_lut(FixedPointLookBuilder& fixed_look, int vec_f)
+{
+    fixed_look.lut_q.compute_root()
+        .reorder(fixed_look.lut_c, fixed_look.lut_r, fixed_look.lut_g, fixed_look.lut_b)
+        .bound(fixed_look.lut_c, 0, 3).unroll(fixed_look.lut_c)
+        .parallel(fixed_look.lut_b)
+        .vectorize(fixed_look.lut_r, vec_f);
+}
+
+// Dehaze's estimates on its coarse grid, once per run: a few hundred
+// cells on a side, split by row. The atmospheric light is three values.
+inline void schedule_dehaze_estimate(DehazeBuilder& dehaze, int vec_f)
+{
+    for (Halide::Func f : dehaze.coarse) {
+        std::vector<Halide::Var> args = f.args();
+        f.compute_root();
+        if (args.size() >= 2) f.parallel(args[1]).vectorize(args[0], vec_f);
+    }
+    dehaze.atmosphere.bound(dehaze.atmosphere.args()[0], 0, 3);
+}
+
+inline void schedule_look_stages(
+    Halide::Func consumer,
+    DehazeBuilder& dehaze,
+    Halide::Func srgb_to_lch,
+    LocalLaplacianBuilder& ll,
+    Halide::Func color_graded,
+    Halide::Func lch_to_srgb,
+    Halide::Func look,
+    FixedPointLookBuilder* fixed_look,
+    const StageBypasses& bypasses,
+    Halide::Var x, Halide::Var c, Halide::Var xo, Halide::Var yo,
+    int vec_f,
+    bool low_memory = false)
+{
+    // Low memory: a tile of storage each, and the stages read only at their
+    // own pixel (the grade, the LCh to sRGB conversion and the look select)
+    // inlined into the next, so they're recomputed per channel instead.
+    const Halide::Var store = low_memory ? xo : yo;
+    // The refined transmission is shared by a pixel's channels, and the
+    // grid behind it is computed up front.
+    schedule_dehaze_estimate(dehaze, vec_f);
+    dehaze.transmission.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f);
+    dehaze.output.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+    if (bypasses.dehaze.defined()) dehaze.output.specialize(bypasses.dehaze);
+    srgb_to_lch.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+    ll.output.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+    // With the sliders at 0 the pyramid, computed per tile and strip above,
+    // is skipped along with the select.
+    if (bypasses.local_laplacian.defined()) ll.output.specialize(bypasses.local_laplacian);
+    if (!low_memory) {
+        color_graded.compute_at(consumer, xo).store_at(consumer, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+        lch_to_srgb.compute_at(consumer, xo).store_at(consumer, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+        // At the defaults `look` is the baked LUT alone, and none of the
+        // above (bar dehaze) is computed.
+        look.compute_at(consumer, xo).store_at(consumer, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+        if (bypasses.local_laplacian.defined()) look.specialize(bypasses.local_laplacian);
+    }
+    if (fixed_look) {
+        // The dehaze and lattice position are shared by a pixel's channels,
+        // so they're computed per tile rather than inlined into each one.
+        // The float dehaze above is then unused, bar its estimates.
+        fixed_look->inv_transmission.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f);
+        fixed_look->dehazed.compute_at(consumer, xo).store_at(consumer, store).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+        fixed_look->dehazed.specialize(fixed_look->dehaze_bypassed);
+        schedule_fixed_look_lut(*fixed_look, vec_f);
+    }
+}
+
+// Schedules the output phase: the geometry firebreak, then the tiled final
+// conversion with the pointwise tail computed per tile.
+//
+// With an `orientation` (CameraPipeGenerator's EXIF remap of final_stage),
+// each of the eight values gets its own loop nest, in which the remap folds
+// to constants. The mirrored ones keep the tiling below and read a mirrored
+// row with reversed vector loads. The transposing ones (5-8) tile the
+// output so each tile still covers strip_size rows by tile_size_x columns
+// of the upright image, and every stage computed per tile or strip sees
+// the same footprint as without the remap. The final conversion then
+// transposes vec x vec blocks of `curved` as it stores rows of the output.
+template <typename P>
+void schedule_output_phase(
+    const Halide::Target& target,
+    Halide::Func resampled,
+    Halide::Func resampled_or_bypass,
+    Halide::Expr is_no_op_resample,
+    Halide::Func sharpened,
+    Halide::Func curved,
+    Halide::Expr is_compact_curve,
+    Halide::Func final_stage,
+    Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var xo, Halide::Var xi, Halide::Var yo, Halide::Var yi,
+    int tile_size_x, int strip_size,
+    int output_channels, bool interleaved_output,
+    Halide::Var chunk = Halide::Var("geometry_chunk"), int chunk_strips = 0,
+    Halide::Expr orientation = Halide::Expr(),
+    SharpenBuilder_T<P>* sharpen = nullptr)
+{
+    using namespace Halide;
+    int vec = target.template natural_vector_size<P>();
+    int vec_f = target.template natural_vector_size<float>();
+
+    if (chunk_strips > 0) {
+        // Fused: the caller computes the warp's input per `chunk` of strips,
+        // so the warp runs per tile straight from it.
+        resampled.compute_at(final_stage, xo).vectorize(x, vec_f);
+    } else {
+        // This is the geometry "firebreak". It consumes the entire `vignette_corrected` buffer.
+        resampled.compute_root()
+            .parallel(y)
+            .vectorize(x, vec_f);
+    }
+    resampled.bound(c, 0, 3).unroll(c);
+
+    // Taken before the tiling below, which the transposing ones replace.
+    std::vector<std::pair<int, Stage>> oriented;
+    if (orientation.defined()) {
+        for (int k = 1; k <= 8; k++) oriented.emplace_back(k, final_stage.specialize(orientation == k));
+    }
+
+    // The strip loop, split into chunks for the fused warp.
+    auto parallelize = [&](Stage s) {
+        if (chunk_strips > 0) {
+            s.split(yo, chunk, yo, chunk_strips).parallel(chunk);
+        } else {
+            s.parallel(yo);
+        }
+    };
+
+    // This is the final output phase. It consumes the `resampled_or_bypass` buffer.
+    auto tile_rows = [&](Stage s) {
+        s.tile(x, y, xo, yo, xi, yi, tile_size_x, strip_size);
+        if (interleaved_output) {
+            // Channels innermost and unrolled under the vectorized x loop, so each
+            // vector of pixels is written with one interleaving store.
+            s.reorder(c, xi, yi, xo, yo);
+        } else {
+            s.reorder(xi, yi, c, xo, yo);
+        }
+        parallelize(s);
+        s.vectorize(xi, vec).unroll(c);
+    };
+    // The output's x is the upright image's y: yo and xi run over its rows,
+    // xo over its tiles of columns, and yi over blocks of vec columns, the
+    // level `curved` is computed at.
+    auto tile_transposed = [&](Stage s) {
+        Var yt("yt");
+        s.split(x, yo, xi, strip_size)
+         .split(y, xo, yi, tile_size_x)
+         .split(yi, yi, yt, vec);
+        if (interleaved_output) {
+            s.reorder(c, xi, yt, yi, xo, yo);
+        } else {
+            s.reorder(xi, yt, c, yi, xo, yo);
+        }
+        parallelize(s);
+        s.vectorize(xi, vec).vectorize(yt).unroll(c);
+    };
+
+    final_stage.compute_root();
+    tile_rows(final_stage);
+    for (auto& [k, s] : oriented) {
+        if (k >= 5) {
+            tile_transposed(s);
+        } else {
+            tile_rows(s);
+        }
+    }
+    final_stage.bound(c, 0, output_channels);
+
+    // Give the bypass switch a concrete schedule so we can specialize it.
+    // It's pointwise, so compute it at the same tile level as its consumer, `sharpened`.
+    resampled_or_bypass
+        .compute_at(final_stage, xo).store_at(final_stage, yo)
+        .vectorize(x, vec_f)
+        .bound(c, 0, 3).unroll(c);
+    resampled_or_bypass.specialize(is_no_op_resample);
+
+    // Schedule the final pointwise stages relative to `final_stage`.
+    sharpened.compute_at(final_stage, xo).store_at(final_stage, yo).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    if (sharpen) {
+        // The unsharp mask runs in the same tile loop. `luma` is stored per
+        // strip, so each tile computes only the columns its left neighbour
+        // didn't (the horizontal pass's halo); the passes are per tile, with
+        // kRadius rows of halo above and below. At strength 0 the
+        // specialization reads the input straight through, and none of
+        // them run.
+        sharpen->kernel.compute_root();
+        sharpen->luma.compute_at(final_stage, xo).store_at(final_stage, yo).vectorize(x, vec_f);
+        sharpen->luma_x.compute_at(final_stage, xo).vectorize(x, vec_f);
+        sharpen->gain.compute_at(final_stage, xo).vectorize(x, vec_f);
+        sharpened.specialize(sharpen->is_bypassed);
+    }
+    curved.compute_at(final_stage, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    curved.specialize(is_compact_curve);
+}
+
+// --- GPU schedule fragments ---
+// Every materialized stage gets its own kernel, tiled over its first two
+// dimensions. Small stencil producers are computed per block of their
+// consumer, which places them in shared memory.
+
+struct GpuVars {
+    Halide::Var bx{"gpu_block_x"}, by{"gpu_block_y"};
+    Halide::Var tx{"gpu_thread_x"}, ty{"gpu_thread_y"};
+};
+
+// Computes `f` at root as its own kernel. Any dimensions after the first two
+// (channels, pyramid planes) are looped over inside each thread.
+inline void gpu_kernel(Halide::Func f, const GpuVars& v, int tile_x = 16, int tile_y = 16) {
+    if (!f.defined()) return;
+    std::vector<Halide::Var> args = f.args();
+    f.compute_root();
+    if (args.size() >= 2) {
+        f.gpu_tile(args[0], args[1], v.bx, v.by, v.tx, v.ty, tile_x, tile_y);
+    } else {
+        f.gpu_tile(args[0], v.bx, v.tx, tile_x * tile_y);
+    }
+}
+
+// Computes `f` per GPU block of `consumer` (scheduled with gpu_kernel), in
+// shared memory, with one thread per point of its first two dimensions.
+inline void gpu_shared(Halide::Func f, Halide::Func consumer, const GpuVars& v) {
+    if (!f.defined()) return;
+    std::vector<Halide::Var> args = f.args();
+    f.compute_at(consumer, v.bx);
+    if (args.size() >= 2) {
+        f.gpu_threads(args[0], args[1]);
+    } else {
+        f.gpu_threads(args[0]);
+    }
+}
+
+// A BoxSumBuilder's scans as kernels, one thread per row (or column) of a
+// block, each running that block's sum serially.
+inline void gpu_box_sum(BoxSumBuilder box, const GpuVars& v) {
+    Halide::Var x = box.scan_y.args()[0], y = box.scan_x.args()[1];
+    box.scan_x.compute_root().gpu_tile(box.offset, y, v.bx, v.by, v.tx, v.ty, 16, 16);
+    box.scan_y.compute_root().gpu_tile(x, box.offset, v.bx, v.by, v.tx, v.ty, 16, 16);
+    for (int u = 0; u < 2; u++) {
+        box.scan_x.update(u).gpu_tile(y, box.block_index, v.bx, v.by, v.tx, v.ty, 64, 1);
+        box.scan_y.update(u).gpu_tile(x, box.block_index, v.bx, v.by, v.tx, v.ty, 64, 1);
+    }
+}
+
+// An NLMeansBuilder as one kernel, a thread per pixel. Each thread walks
+// the search offsets and computes its own patch sums for each, so on the
+// GPU the patch cost stays O(patch^2); the per-offset planes a whole-frame
+// running sum would need don't fit in memory.
+inline void gpu_nlmeans(NLMeansBuilder nlm, const GpuVars& v) {
+    Halide::Var x = nlm.accum.args()[0], y = nlm.accum.args()[1];
+    nlm.accum.compute_root().gpu_tile(x, y, v.bx, v.by, v.tx, v.ty, 16, 16);
+    nlm.accum.update(0).gpu_tile(x, y, v.bx, v.by, v.tx, v.ty, 16, 16);
+    nlm.patch_ssd.scan_x.compute_at(nlm.accum, nlm.offset.x);
+    nlm.patch_ssd.scan_y.compute_at(nlm.accum, nlm.offset.x);
+}
+
+// GPU version of schedule_front_end_producers. Each stage is a kernel; CA's
+// shift blur and the demosaic intermediates are tiled through shared memory.
+inline void schedule_front_end_producers_gpu(
+    const GpuVars& v,
+    BayerNormalizeBuilder& normalize,
+    DenoiseBuilder* denoise,
+    CACorrectBuilder& ca_builder,
+    Halide::Func deinterleaved_hi_fi,
+    Halide::Func demosaiced,
+    DemosaicDispatcherT<float>& demosaic_dispatcher,
+    Halide::Func downscaled,
+    Halide::Expr is_no_op_resize,
+    ResizeBuilder& resize_builder,
+    BayerBinBuilder& bin_builder,
+    Halide::Func corrected_hi_fi,
+    const StageBypasses& bypasses,
+    Halide::Var c)
+{
+    using namespace Halide;
+
+    gpu_kernel(normalize.output, v);
+    normalize.specialize_cfa();
+    if (denoise) {
+        gpu_kernel(denoise->output, v);
+        if (bypasses.denoise.defined()) denoise->output.specialize(bypasses.denoise);
+        denoise->planes.bound(c, 0, 4);
+        gpu_kernel(denoise->planes, v);
+        denoise->planes.specialize(denoise->algo_id == DenoiseBuilder::GUIDED);
+        denoise->planes.specialize(denoise->algo_id == DenoiseBuilder::NLMEANS);
+        for (const BoxSumBuilder& box : denoise->box_sums) gpu_box_sum(box, v);
+        for (const NLMeansBuilder& nlm : denoise->nlmeans) gpu_nlmeans(nlm, v);
+    }
+
+    gpu_kernel(ca_builder.g_interp, v);
+    gpu_kernel(ca_builder.estimate_g_interp, v);
+    gpu_kernel(ca_builder.block_shifts, v, 8, 8);
+    gpu_kernel(ca_builder.blur_y, v, 8, 8);
+    gpu_shared(ca_builder.blur_x, ca_builder.blur_y, v);
+    gpu_kernel(ca_builder.output, v);
+    // The shift estimation kernels are skipped when nothing reads them.
+    if (bypasses.ca_correct.defined()) ca_builder.output.specialize(bypasses.ca_correct);
+
+    gpu_kernel(deinterleaved_hi_fi, v);
+
+    demosaiced.bound(c, 0, 3);
+    gpu_kernel(demosaiced, v);
+    std::set<std::string> shared;
+    for (auto& f : demosaic_dispatcher.all_intermediates) {
+        if (f.defined() && shared.insert(f.name()).second) gpu_shared(f, demosaiced, v);
+    }
+    {
+        // Same per-algorithm loop nests as the CPU schedule; the
+        // intermediates of the other algorithms drop out of each kernel.
+        typedef DemosaicDispatcherT<float> D;
+        Expr algo = demosaic_dispatcher.algo_id;
+        demosaiced.specialize(algo == D::AHD);
+        demosaiced.specialize(algo == D::LMMSE);
+        demosaiced.specialize(algo == D::RI);
+        demosaiced.specialize(algo == D::FAST);
+        demosaiced.specialize(algo == D::ADAPTIVE);
+    }
+    // ADAPTIVE's blend is per pixel on the GPU; only its tile weights are
+    // a kernel of their own.
+    gpu_kernel(demosaic_dispatcher.adaptive.tile_weight, v, 8, 8);
+
+    downscaled.bound(c, 0, 3);
+    gpu_kernel(downscaled, v);
+    downscaled.specialize(is_no_op_resize);
+    downscaled.specialize(bin_builder.use_binning);
+    gpu_shared(resize_builder.interp_y, downscaled, v);
+    for (Func t : resize_builder.tables) gpu_kernel(t, v);
+    gpu_shared(bin_builder.bin_x, downscaled, v);
+
+    corrected_hi_fi.bound(c, 0, 3);
+    gpu_kernel(corrected_hi_fi, v);
+}
+
+// GPU version of schedule_local_laplacian: one kernel per stage of every
+// pyramid level, including the low-fi splice inputs.
+inline void schedule_local_laplacian_gpu(const GpuVars& v, LocalLaplacianBuilder& ll, int J)
+{
+#ifndef BYPASS_LAPLACIAN_PYRAMID
+    // Some levels alias each other (the coarsest inL level is the coarsest
+    // gPyramid level, the splice level is a low-fi intermediate), so only
+    // schedule each Func once.
+    std::set<std::string> scheduled;
+    auto kernel = [&](Halide::Func f) {
+        if (f.defined() && scheduled.insert(f.name()).second) gpu_kernel(f, v);
+    };
+
+    kernel(ll.remap_lut);
+    for (auto& f : ll.low_fi_intermediates) kernel(f);
+    for (auto& f : ll.lowfi_downsample_helpers) kernel(f);
+    kernel(ll.lowfi_spliced);
+    if (ll.lowfi_resize_builder) {
+        gpu_shared(ll.lowfi_resize_builder->interp_y, ll.lowfi_resize_builder->output, v);
+        for (Func t : ll.lowfi_resize_builder->tables) gpu_kernel(t, v);
+        ll.lowfi_resize_builder->specialize_exact();
+    }
+    for (auto& f : ll.high_freq_pyramid_helpers) kernel(f);
+    for (auto& f : ll.low_freq_pyramid_helpers) kernel(f);
+    for (int j = 0; j < J; j++) {
+        kernel(ll.gPyramid[j]);
+        kernel(ll.inLPyramid[j]);
+        kernel(ll.outLPyramid[j]);
+        kernel(ll.reconstructedGPyramid[j]);
+    }
+    for (auto& f : ll.fastGPyramid) {
+        f.bound(ll.fast_k, 0, ll.fast_levels);
+        kernel(f);
+    }
+    for (auto& f : ll.fastLPyramid) {
+        f.bound(ll.fast_k, 0, ll.fast_levels);
+        kernel(f);
+    }
+#endif
+}
+
+// GPU version of the look stages and output phase. The LCh input of the
+// pyramid is a kernel; the pointwise look stages are inlined into
+// `vignette_corrected`, and the pointwise tail into `final_stage`.
+inline void schedule_back_end_gpu(
+    const GpuVars& v,
+    Halide::Func srgb_to_lch,
+    Halide::Func vignette_corrected,
+    Halide::Func resampled,
+    Halide::Func resampled_or_bypass,
+    Halide::Expr is_no_op_resample,
+    Halide::Func final_stage,
+    const StageBypasses& bypasses,
+    Halide::Var c, int output_channels)
+{
+    srgb_to_lch.bound(c, 0, 3);
+    gpu_kernel(srgb_to_lch, v);
+
+    // Dehaze and the pyramid's output are inlined into this kernel, so it
+    // carries their bypasses along with its own.
+    vignette_corrected.bound(c, 0, 3);
+    gpu_kernel(vignette_corrected, v);
+    specialize_combinations(vignette_corrected, {bypasses.local_laplacian, bypasses.dehaze, bypasses.vignette});
+
+    resampled.bound(c, 0, 3);
+    gpu_kernel(resampled, v);
+
+    final_stage.bound(c, 0, output_channels);
+    gpu_kernel(final_stage, v);
+    gpu_shared(resampled_or_bypass, final_stage, v);
+    resampled_or_bypass.specialize(is_no_op_resample);
+}
+
+// Dehaze's grid gets a kernel per stage, the atmospheric light's argmax a
+// single thread. The refinement is pointwise, and inlined with the
+// dehaze into `vignette_corrected`'s kernel.
+inline void schedule_dehaze_estimate_gpu(const GpuVars& v, DehazeBuilder& dehaze)
+{
+    for (Halide::Func f : dehaze.coarse) {
+        if (f.name() == dehaze.atmosphere.name()) continue;
+        gpu_kernel(f, v);
+    }
+    dehaze.atmosphere.compute_root().gpu_single_thread();
+}
+
+// The sharpening blur's passes get a kernel each, the vertical one with the
+// mask, so the output's kernel reads one gain per pixel.
+template <typename P>
+void schedule_sharpen_gpu(const GpuVars& v, SharpenBuilder_T<P>& sharpen) {
+    sharpen.kernel.compute_root();
+    gpu_kernel(sharpen.luma, v);
+    gpu_kernel(sharpen.luma_x, v);
+    gpu_kernel(sharpen.gain, v);
+}
 
 // This schedule function encapsulates the complex scheduling logic for the
 // Laplacian-based pipeline. It is called from the main generator.
@@ -14,167 +763,505 @@ template <typename P> // P is the processing type (e.g. float, uint16_t)
 void schedule_pipeline(
     bool is_autoscheduled,
     const Halide::Target& target,
-    Halide::Func denoised,
-    Halide::Func normalized_bayer,
+    BayerNormalizeBuilder& normalize,
+    DenoiseBuilder* denoise,
+    CAShiftEstimateBuilder& ca_estimate,
     CACorrectBuilder& ca_builder,
     Halide::Func deinterleaved_hi_fi,
     Halide::Func demosaiced,
     DemosaicDispatcherT<float>& demosaic_dispatcher,
     Halide::Func downscaled,
     Halide::Expr is_no_op_resize,
-    ResizeBicubicBuilder& resize_builder,
+    ResizeBuilder& resize_builder,
+    BayerBinBuilder& bin_builder,
     Halide::Func corrected_hi_fi,
-    Halide::Func dehazed,
+    DehazeBuilder& dehaze,
     Halide::Func resampled,
     Halide::Func resampled_or_bypass,
     Halide::Expr is_no_op_resample,
-    Halide::Func sharpened,
+    SharpenBuilder_T<P>& sharpen,
     LocalLaplacianBuilder& local_laplacian_builder,
     Halide::Func curved,
+    Halide::Expr is_compact_curve,
     Halide::Func final_stage,
     ColorCorrectBuilder_T<P>& color_correct_builder,
     Halide::Func tone_curve_func,
     Halide::Func color_graded,
     Halide::Func srgb_to_lch,
     Halide::Func lch_to_srgb,
+    Halide::Func look,
+    FixedPointLookBuilder* fixed_look,
     Halide::Func vignette_corrected,
     Halide::Type halide_proc_type,
+    const StageBypasses& bypasses,
     Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var xo, Halide::Var xi, Halide::Var yo, Halide::Var yi,
-    int J, int cutover_level)
+    const CpuTiling& tiling, int J, int cutover_level,
+    int output_channels = 3, bool interleaved_output = false,
+    Halide::Expr orientation = Halide::Expr(),
+    MaskedAdjustBuilder* masked_adjust = nullptr)
 {
     using namespace Halide;
 
     if (is_autoscheduled) {
         // Autoscheduler will determine the schedule.
     } else if (target.has_gpu_feature()) {
-        // A simple manual GPU schedule. Note the two "firebreaks" at vignette_corrected and resampled.
-        Var block_x("gpu_block_x"), block_y("gpu_block_y");
-        Var thread_x("gpu_thread_x"), thread_y("gpu_thread_y");
-
-        // Phase 1 output
-        vignette_corrected.compute_root().gpu_tile(x, y, block_x, block_y, thread_x, thread_y, 16, 16, c);
-        // Phase 2 output
-        final_stage.compute_root().gpu_tile(x, y, block_x, block_y, thread_x, thread_y, 16, 16, c);
-        // Intermediate firebreak
-        resampled.compute_root();
-        resampled_or_bypass.specialize(is_no_op_resample);
+        // Manual GPU schedule. Same firebreaks as the CPU schedule
+        // (vignette_corrected and resampled), with the producers in between
+        // split into one kernel per stage.
+        GpuVars v;
 
+        // Small lookup tables are built on the host and copied over.
+        color_correct_builder.cc_matrix.compute_root();
+        tone_curve_func.compute_root();
 
+        gpu_kernel(ca_estimate.g_interp, v);
+        gpu_kernel(ca_estimate.block_shifts, v, 8, 8);
+        gpu_kernel(ca_estimate.blur_y, v, 8, 8);
+        gpu_shared(ca_estimate.blur_x, ca_estimate.blur_y, v);
+        schedule_front_end_producers_gpu(v, normalize, denoise, ca_builder, deinterleaved_hi_fi,
+                                         demosaiced, demosaic_dispatcher, downscaled, is_no_op_resize,
+                                         resize_builder, bin_builder, corrected_hi_fi, bypasses, c);
+        schedule_local_laplacian_gpu(v, local_laplacian_builder, J);
+        schedule_back_end_gpu(v, srgb_to_lch, vignette_corrected, resampled, resampled_or_bypass,
+                              is_no_op_resample, final_stage, bypasses, c, output_channels);
+        schedule_dehaze_estimate_gpu(v, dehaze);
+        schedule_sharpen_gpu(v, sharpen);
+        if (masked_adjust) {
+            vignette_corrected.update(0).gpu_blocks(y).gpu_threads(masked_adjust->r.x);
+        }
     } else {
         // High-performance manual CPU schedule implementing a two-phase execution.
         int vec = target.template natural_vector_size<P>();
         int vec_f = target.template natural_vector_size<float>();
-        const int strip_size = 32;
-        const int tile_size_x = 256;
-
-        Var byi("byi"), byo("byo");
-        normalized_bayer.compute_root().split(y, byo, byi, 128).parallel(byo).vectorize(x, vec_f);
+        const int strip_size = tiling.low_memory ? std::min(tiling.strip_size, CpuTiling::kLowMemoryStripRows)
+                                                 : tiling.strip_size;
+        const int tile_size_x = tiling.tile_size_x;
+        const int geometry_chunk = (tiling.low_memory && tiling.geometry_chunk <= 0) ? CpuTiling::kLowMemoryChunkRows
+                                                                                     : tiling.geometry_chunk;
 
         // --- GLOBAL LOOKUP TABLES ---
         color_correct_builder.cc_matrix.compute_root();
         tone_curve_func.compute_root();
+        // The CA shift field, once per run; skipped at strength 0, when
+        // only the bypassed loop nest runs.
+        schedule_ca_shift_estimate(ca_estimate, vec_f);
 
         // --- PHASE 1: Original Tiled Pipeline ---
         // This phase computes everything up to the point before resampling.
         // `vignette_corrected` is the final output of this phase, materialized at root.
-        vignette_corrected.compute_root()
+        //
+        // With a geometry chunk, it is instead computed per chunk of output
+        // rows, inside final_stage's parallel loop: the warp's footprint is
+        // clamped to warp_src_row_reach rows either side of the output row
+        // (stage_lens_geometry.h), so a chunk needs only its own rows of
+        // `vignette_corrected` plus that reach, and the two phases run as one
+        // pass with no full-frame buffer between them. Each chunk recomputes
+        // the reach rows its neighbours also use, so the chunk should be
+        // several times the reach.
+        //
+        // The low-memory schedule always does this. Its only whole-frame
+        // buffers are then the input, the output and the small ones computed
+        // once per run (the local Laplacian's splice level, 1/4^cutover_level
+        // of the pixels, and the CA shift field), so beyond those its peak
+        // grows with the output width W and thread count T alone, as about
+        // T * W * ((chunk + 2 * reach) * firebreak bytes per pixel
+        //          + (strip + stencil halo) * front-end bytes per pixel).
+        // PERF.md has the numbers.
+        Var chunk("geometry_chunk");
+        const int chunk_strips = geometry_chunk > 0 ? std::max(1, geometry_chunk / strip_size) : 0;
+        if (chunk_strips > 0) {
+            vignette_corrected.compute_at(final_stage, chunk);
+        } else {
+            vignette_corrected.compute_root();
+        }
+        vignette_corrected
             .tile(x, y, xo, yo, xi, yi, tile_size_x, strip_size)
             .reorder(xi, yi, c, xo, yo)
             .parallel(yo)
             .vectorize(xi, vec_f);
         vignette_corrected.bound(c, 0, 3).unroll(c);
+        if (tiling.low_memory) {
+            // The look select is inlined here (schedule_look_stages), so its
+            // bypass goes with the vignette's.
+            specialize_combinations(vignette_corrected, {bypasses.local_laplacian, bypasses.vignette});
+        } else if (bypasses.vignette.defined()) {
+            vignette_corrected.specialize(bypasses.vignette);
+        }
+        // Dodge and burn: each row walks its list of touched tiles, a
+        // vector of pixels at a time.
+        if (masked_adjust) {
+            vignette_corrected.update(0)
+                .reorder(masked_adjust->r.x, c, masked_adjust->r.y, y)
+                .parallel(y, strip_size)
+                .vectorize(masked_adjust->r.x, vec_f)
+                .unroll(c);
+        }
 
-        // Schedule all producers relative to `vignette_corrected` instead of `final_stage`.
-        denoised.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec_f);
-        ca_builder.output.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec_f);
-        ca_builder.g_interp.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec_f);
-        ca_builder.block_shifts.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(ca_builder.bx, vec_f);
-        ca_builder.blur_y.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(ca_builder.bx, vec_f);
-        ca_builder.blur_x.compute_at(ca_builder.blur_y, ca_builder.by).vectorize(ca_builder.bx, vec_f);
+        schedule_front_end_producers(vignette_corrected, normalize, denoise, ca_builder, deinterleaved_hi_fi,
+                                     demosaiced, demosaic_dispatcher, downscaled, is_no_op_resize,
+                                     resize_builder, bin_builder, corrected_hi_fi, bypasses,
+                                     x, y, c, yo, vec, vec_f);
 
-        deinterleaved_hi_fi.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec_f);
-        demosaiced.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec);
-        demosaiced.bound(c, 0, 3).unroll(c);
+        schedule_local_laplacian(vignette_corrected, local_laplacian_builder, xo, yo, J, cutover_level, vec_f,
+                                 tiling.low_memory);
+        schedule_look_stages(vignette_corrected, dehaze, srgb_to_lch, local_laplacian_builder,
+                             color_graded, lch_to_srgb, look, fixed_look, bypasses, x, c, xo, yo, vec_f,
+                             tiling.low_memory);
 
-        downscaled.specialize(is_no_op_resize);
-        downscaled.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec);
-        downscaled.bound(c, 0, 3).unroll(c);
 
-        resize_builder.interp_y.compute_at(downscaled, y).vectorize(resize_builder.x_coord, vec_f);
+        // --- PHASE 2: Geometry, Sharpen, and Final Conversion ---
+        schedule_output_phase<P>(target, resampled, resampled_or_bypass, is_no_op_resample,
+                                 sharpen.output, curved, is_compact_curve, final_stage,
+                                 x, y, c, xo, xi, yo, yi, tile_size_x, strip_size,
+                                 output_channels, interleaved_output, chunk, chunk_strips, orientation,
+                                 &sharpen);
+    }
+}
 
-        corrected_hi_fi.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(x, vec);
-        corrected_hi_fi.bound(c, 0, 3).unroll(c);
+// --- Split pipelines (editor) ---
 
-#ifndef BYPASS_LAPLACIAN_PYRAMID
-        local_laplacian_builder.remap_lut.compute_root();
+// Front end: raw -> linear, camera-corrected RGB at the output resolution.
+// `linear_out` is the pipeline output and is tiled into strips like phase 1
+// of the monolithic schedule.
+inline void schedule_front_end(
+    bool is_autoscheduled,
+    const Halide::Target& target,
+    BayerNormalizeBuilder& normalize,
+    DenoiseBuilder* denoise,
+    CACorrectBuilder& ca_builder,
+    Halide::Func deinterleaved_hi_fi,
+    Halide::Func demosaiced,
+    DemosaicDispatcherT<float>& demosaic_dispatcher,
+    Halide::Func downscaled,
+    Halide::Expr is_no_op_resize,
+    ResizeBuilder& resize_builder,
+    BayerBinBuilder& bin_builder,
+    Halide::Func corrected_hi_fi,
+    Halide::Func cc_matrix,
+    Halide::Func linear_out,
+    const StageBypasses& bypasses,
+    Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var xo, Halide::Var xi, Halide::Var yo, Halide::Var yi,
+    const CpuTiling& tiling)
+{
+    using namespace Halide;
 
-        local_laplacian_builder.gPyramid[0].compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo);
-        bool perform_splice = (cutover_level > 0 && cutover_level < J);
+    if (is_autoscheduled) {
+        // Autoscheduler will determine the schedule.
+    } else if (target.has_gpu_feature()) {
+        GpuVars v;
+        cc_matrix.compute_root();
+        linear_out.bound(c, 0, 3);
+        gpu_kernel(linear_out, v);
+        schedule_front_end_producers_gpu(v, normalize, denoise, ca_builder, deinterleaved_hi_fi,
+                                         demosaiced, demosaic_dispatcher, downscaled, is_no_op_resize,
+                                         resize_builder, bin_builder, corrected_hi_fi, bypasses, c);
+    } else {
+        int vec_f = target.natural_vector_size<float>();
+        const int strip_size = tiling.strip_size;
+        const int tile_size_x = tiling.tile_size_x;
 
-        if (perform_splice) {
-            for (auto& f : local_laplacian_builder.low_fi_intermediates) f.compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo);
-            if (local_laplacian_builder.lowfi_resize_builder) {
-                auto& builder = local_laplacian_builder.lowfi_resize_builder;
-                Var hy = builder->output.args()[1];
-                builder->interp_y.compute_at(builder->output, hy).vectorize(builder->x_coord, vec_f);
-            }
-            for (int j = 1; j < cutover_level; j++) local_laplacian_builder.gPyramid[j].compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(local_laplacian_builder.gPyramid[j].args()[0], vec_f);
-            for (int j = cutover_level; j < J; j++) local_laplacian_builder.gPyramid[j].compute_at(vignette_corrected, yo).store_at(vignette_corrected, yo).vectorize(local_laplacian_builder.gPyramid[j].args()[0], vec_f);
-        } else {
-            for (int j = 1; j < J; j++) local_laplacian_builder.gPyramid[j].compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(local_laplacian_builder.gPyramid[j].args()[0], vec_f);
-        }
+        cc_matrix.compute_root();
 
-        for (int j = 0; j < J; j++) {
-            auto& helpers = (perform_splice && j >= cutover_level) ? local_laplacian_builder.low_freq_pyramid_helpers : local_laplacian_builder.high_freq_pyramid_helpers;
-            auto compute_loc = (perform_splice && j >= cutover_level) ? yo : xo;
-            for (auto& f : helpers) f.compute_at(vignette_corrected, compute_loc).store_at(vignette_corrected, yo);
-            local_laplacian_builder.inLPyramid[j].compute_at(vignette_corrected, compute_loc).store_at(vignette_corrected, yo).vectorize(local_laplacian_builder.inLPyramid[j].args()[0], vec_f);
-            local_laplacian_builder.outLPyramid[j].compute_at(vignette_corrected, compute_loc).store_at(vignette_corrected, yo).vectorize(local_laplacian_builder.outLPyramid[j].args()[0], vec_f);
-        }
-        for (int b = 0; b < J; ++b) {
-            for (int j = 0; j <= b; ++j) {
-                auto& f = local_laplacian_builder.reconstructedGPyramid[b][j];
-                auto compute_loc = (perform_splice && j >= cutover_level) ? yo : xo;
-                f.compute_at(vignette_corrected, compute_loc).store_at(vignette_corrected, yo).vectorize(f.args()[0], vec_f);
-            }
-        }
-#endif
-        // These are all pointwise stages that lead into vignette_corrected.
-        dehazed.compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
-        srgb_to_lch.compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
-        local_laplacian_builder.output.compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
-        color_graded.compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
-        lch_to_srgb.compute_at(vignette_corrected, xo).store_at(vignette_corrected, yo).vectorize(x, vec_f).bound(c,0,3).unroll(c);
+        linear_out.compute_root()
+            .tile(x, y, xo, yo, xi, yi, tile_size_x, strip_size)
+            .reorder(xi, yi, c, xo, yo)
+            .parallel(yo)
+            .vectorize(xi, vec_f);
+        linear_out.bound(c, 0, 3).unroll(c);
 
+        schedule_front_end_producers(linear_out, normalize, denoise, ca_builder, deinterleaved_hi_fi,
+                                     demosaiced, demosaic_dispatcher, downscaled, is_no_op_resize,
+                                     resize_builder, bin_builder, corrected_hi_fi, bypasses,
+                                     x, y, c, yo, vec_f, vec_f);
+    }
+}
 
-        // --- PHASE 2: Geometry, Sharpen, and Final Conversion ---
+// Back end: linear RGB -> dehaze, LCh, local Laplacian, grading, vignette,
+// geometry and curve -> u8. Same two-phase structure as the monolithic
+// schedule, minus the raw producers.
+inline void schedule_back_end(
+    bool is_autoscheduled,
+    const Halide::Target& target,
+    DehazeBuilder& dehaze,
+    Halide::Func srgb_to_lch,
+    LocalLaplacianBuilder& local_laplacian_builder,
+    Halide::Func color_graded,
+    Halide::Func lch_to_srgb,
+    Halide::Func look,
+    Halide::Func vignette_corrected,
+    Halide::Func resampled,
+    Halide::Func resampled_or_bypass,
+    Halide::Expr is_no_op_resample,
+    SharpenBuilder_T<float>& sharpen,
+    Halide::Func tone_curve_func,
+    Halide::Func curved,
+    Halide::Expr is_compact_curve,
+    Halide::Func final_stage,
+    const StageBypasses& bypasses,
+    Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var xo, Halide::Var xi, Halide::Var yo, Halide::Var yi,
+    const CpuTiling& tiling, int J, int cutover_level,
+    int output_channels = 3, bool interleaved_output = false)
+{
+    using namespace Halide;
 
-        // This is the geometry "firebreak". It consumes the entire `vignette_corrected` buffer.
-        resampled.compute_root()
-            .parallel(y)
-            .vectorize(x, vec_f);
-        resampled.bound(c, 0, 3).unroll(c);
+    if (is_autoscheduled) {
+        // Autoscheduler will determine the schedule.
+    } else if (target.has_gpu_feature()) {
+        GpuVars v;
+        tone_curve_func.compute_root();
+        schedule_local_laplacian_gpu(v, local_laplacian_builder, J);
+        schedule_back_end_gpu(v, srgb_to_lch, vignette_corrected, resampled, resampled_or_bypass,
+                              is_no_op_resample, final_stage, bypasses, c, output_channels);
+        schedule_dehaze_estimate_gpu(v, dehaze);
+        schedule_sharpen_gpu(v, sharpen);
+    } else {
+        int vec_f = target.natural_vector_size<float>();
+        const int strip_size = tiling.strip_size;
+        const int tile_size_x = tiling.tile_size_x;
+
+        tone_curve_func.compute_root();
 
-        // This is the final output phase. It consumes the `resampled_or_bypass` buffer.
-        final_stage.compute_root()
+        vignette_corrected.compute_root()
             .tile(x, y, xo, yo, xi, yi, tile_size_x, strip_size)
             .reorder(xi, yi, c, xo, yo)
             .parallel(yo)
-            .vectorize(xi, vec);
-        final_stage.bound(c, 0, 3).unroll(c);
+            .vectorize(xi, vec_f);
+        vignette_corrected.bound(c, 0, 3).unroll(c);
+        if (bypasses.vignette.defined()) vignette_corrected.specialize(bypasses.vignette);
+
+        schedule_local_laplacian(vignette_corrected, local_laplacian_builder, xo, yo, J, cutover_level, vec_f);
+        schedule_look_stages(vignette_corrected, dehaze, srgb_to_lch, local_laplacian_builder,
+                             color_graded, lch_to_srgb, look, nullptr, bypasses, x, c, xo, yo, vec_f);
+
+        schedule_output_phase<float>(target, resampled, resampled_or_bypass, is_no_op_resample,
+                                     sharpen.output, curved, is_compact_curve, final_stage,
+                                     x, y, c, xo, xi, yo, yi, tile_size_x, strip_size,
+                                     output_channels, interleaved_output, Var("geometry_chunk"), 0, Expr(),
+                                     &sharpen);
+    }
+}
+// process --outputs' smaller sizes (ExportPyramidBuilder). Each pyramid
+// level is computed whole once the output is, in parallel strips of rows;
+// the reductions, a few hundred to a couple of thousand pixels across, read
+// them the same way.
+inline void schedule_export_pyramid(bool is_autoscheduled, const Halide::Target& target,
+                                    ExportPyramidBuilder& pyramid, std::vector<Halide::Func>& reduced,
+                                    Halide::Var x, Halide::Var y, Halide::Var yo, Halide::Var yi)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec = target.natural_vector_size<float>();
+    for (Func& level : pyramid.levels) {
+        level.compute_root()
+            .split(y, yo, yi, 16, TailStrategy::GuardWithIf).parallel(yo)
+            .vectorize(x, vec, TailStrategy::GuardWithIf);
+    }
+    for (Func& r : reduced) {
+        r.split(y, yo, yi, 16, TailStrategy::GuardWithIf).parallel(yo)
+            .vectorize(x, vec, TailStrategy::GuardWithIf);
+    }
+}
+
+// Schedules the histogram outputs. The strips are counted in parallel, each
+// pass over a strip's pixels feeding all four channels. GPU builds run this
+// on the host too: a per-bin scatter would need atomics, and the output is
+// copied back for display anyway.
+// The editor's warp map: the mapping is evaluated once per pixel as a tuple,
+// a few rows at a time, and written out plane by plane.
+inline void schedule_warp_map(bool is_autoscheduled, const Halide::Target& target, WarpMapBuilder& warp,
+                              Halide::Var x, Halide::Var y, Halide::Var k)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    warp.output.bound(k, 0, WarpMapBuilder::kPlanes);
+    if (target.has_gpu_feature()) {
+        GpuVars v;
+        gpu_kernel(warp.output, v);
+        warp.output.unroll(k);
+        return;
+    }
+
+    const int vec_f = target.natural_vector_size<float>();
+    warp.output.compute_root().reorder(x, k, y).parallel(y, 8).vectorize(x, vec_f);
+    warp.source.compute_at(warp.output, y).vectorize(x, vec_f);
+}
+
+// The CA shift field on its own (camera_pipe_ca_shifts), run once per raw.
+// The blurred field is small; it is computed whole after the tile sums.
+inline void schedule_ca_shifts(bool is_autoscheduled, const Halide::Target& target, CAShiftEstimateBuilder& estimate)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    if (target.has_gpu_feature()) {
+        GpuVars v;
+        gpu_kernel(estimate.g_interp, v);
+        gpu_kernel(estimate.block_shifts, v, 8, 8);
+        gpu_kernel(estimate.blur_y, v, 8, 8);
+        gpu_shared(estimate.blur_x, estimate.blur_y, v);
+        gpu_kernel(estimate.output, v, 8, 8);
+        return;
+    }
+
+    const int vec_f = target.natural_vector_size<float>();
+    schedule_ca_shift_estimate(estimate, vec_f);
+    estimate.output.compute_root().vectorize(estimate.bx, vec_f);
+}
 
-        // Give the bypass switch a concrete schedule so we can specialize it.
-        // It's pointwise, so compute it at the same tile level as its consumer, `sharpened`.
-        resampled_or_bypass
-            .compute_at(final_stage, xo).store_at(final_stage, yo)
-            .vectorize(x, vec_f)
-            .bound(c, 0, 3).unroll(c);
-        resampled_or_bypass.specialize(is_no_op_resample);
+inline void schedule_histogram(bool is_autoscheduled, const Halide::Target &target, HistogramBuilder& hist)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec = target.natural_vector_size<uint32_t>();
+
+    hist.partial.compute_root().vectorize(hist.bin, vec);
+    hist.partial.update()
+        .reorder(hist.r_pixels.z, hist.r_pixels.x, hist.r_pixels.y, hist.strip)
+        .unroll(hist.r_pixels.z)
+        .parallel(hist.strip);
+
+    hist.output.compute_root().vectorize(hist.bin, vec);
+    hist.output.update().reorder(hist.bin, hist.ch, hist.r_strips.x).vectorize(hist.bin, vec);
+}
+
+// The raw statistics (RawStatsGenerator): the normalize is inlined into
+// the per-strip partials, and the strips are binned in parallel.
+inline void schedule_raw_stats(bool is_autoscheduled, const Halide::Target& target, RawStatsBuilder& stats)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec_f = target.natural_vector_size<float>();
+
+    stats.partial.compute_root().vectorize(stats.bin, vec_f);
+    stats.partial.update()
+        .reorder(stats.r_blocks.z, stats.r_blocks.x, stats.r_blocks.y, stats.strip)
+        .unroll(stats.r_blocks.z)
+        .parallel(stats.strip);
+
+    stats.output.compute_root().vectorize(stats.bin, vec_f);
+    stats.output.update().reorder(stats.bin, stats.k, stats.r_strips.x).vectorize(stats.bin, vec_f);
+}
+
+// The live view (CameraPipePreviewGenerator): the whole chain runs per
+// strip of output rows, the Bayer bin reading its quads straight from the
+// raw, so nothing frame-sized is stored. Only the colour matrix and the
+// LUTs are computed ahead. The bin is stored per strip, with a row of halo
+// each side for focus peaking's Laplacian, and the tone-curved colour per
+// row, since the zebra flags in the alpha lane read all three channels.
+inline void schedule_preview(bool is_autoscheduled, const Halide::Target& target,
+                             BayerBinBuilder& bin_builder, Halide::Func corrected, Halide::Func cc_matrix,
+                             FixedPointLookBuilder& look, Halide::Func tone_curve_func,
+                             Halide::Func curved, Halide::Expr is_compact_curve,
+                             Halide::Func final_stage,
+                             Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var yo, Halide::Var yi,
+                             int strip_size, int output_channels)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec = target.natural_vector_size<uint16_t>();
+    const int vec_f = target.natural_vector_size<float>();
+
+    cc_matrix.compute_root();
+    tone_curve_func.compute_root();
+    schedule_fixed_look_lut(look, vec_f);
+
+    // Channels innermost under the vectorized x loop: one interleaving
+    // store per vector of RGBA pixels.
+    final_stage.compute_root()
+        .split(y, yo, yi, strip_size)
+        .reorder(c, x, yi, yo)
+        .parallel(yo)
+        .vectorize(x, vec)
+        .bound(c, 0, output_channels).unroll(c);
+
+    bin_builder.bin_x.compute_at(final_stage, yo).vectorize(x, vec_f);
+    bin_builder.output.compute_at(final_stage, yo).vectorize(x, vec_f);
+    corrected.compute_at(final_stage, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    curved.compute_at(final_stage, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    curved.specialize(is_compact_curve);
+}
+
+// The live view into a display buffer (CameraPipeDisplayGenerator): the
+// same strips as schedule_preview, with each row's pixels packed as the
+// tone-curved colour is produced. No halo: there is no focus peaking.
+inline void schedule_display(bool is_autoscheduled, const Halide::Target& target,
+                             BayerBinBuilder& bin_builder, Halide::Func corrected, Halide::Func cc_matrix,
+                             FixedPointLookBuilder& look, Halide::Func tone_curve_func,
+                             Halide::Func curved, Halide::Expr is_compact_curve,
+                             Halide::Func packed,
+                             Halide::Var x, Halide::Var y, Halide::Var c, Halide::Var yo, Halide::Var yi,
+                             int strip_size)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec = target.natural_vector_size<uint16_t>();
+    const int vec_f = target.natural_vector_size<float>();
+
+    cc_matrix.compute_root();
+    tone_curve_func.compute_root();
+    schedule_fixed_look_lut(look, vec_f);
+
+    packed.compute_root()
+        .split(y, yo, yi, strip_size)
+        .reorder(x, yi, yo)
+        .parallel(yo)
+        .vectorize(x, vec);
+
+    bin_builder.bin_x.compute_at(packed, yo).vectorize(x, vec_f);
+    bin_builder.output.compute_at(packed, yo).vectorize(x, vec_f);
+    corrected.compute_at(packed, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    curved.compute_at(packed, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    curved.specialize(is_compact_curve);
+}
+
+// The burst merge: the grey pyramid and each level's tile search are small
+// and computed whole, parallel over rows and tile rows (the search's costs
+// per tile, so only one tile's are live); the merged mosaic is produced in
+// parallel strips of `strip_size` rows.
+inline void schedule_burst_merge(bool is_autoscheduled, const Halide::Target& target, BurstMergeBuilder& merge,
+                                 Halide::Var x, Halide::Var y, int strip_size)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
 
-        // Schedule the final pointwise stages relative to `final_stage`.
-        sharpened.compute_at(final_stage, xo).store_at(final_stage, yo).vectorize(x, vec).bound(c, 0, 3).unroll(c);
-        curved.compute_at(final_stage, yi).vectorize(x, vec).bound(c, 0, 3).unroll(c);
+    const int vec_f = target.natural_vector_size<float>();
+    for (auto& g : merge.grey) {
+        Var gx = g.args()[0], gy = g.args()[1], gn = g.args()[2];
+        g.compute_root().reorder(gx, gy, gn).parallel(gy, 8).vectorize(gx, vec_f);
+    }
+    for (size_t l = 0; l < merge.search.size(); l++) {
+        merge.search[l].compute_root().reorder(merge.tx, merge.ty, merge.n).parallel(merge.ty);
+        merge.cost[l].compute_at(merge.search[l], merge.tx).vectorize(merge.sx, vec_f);
     }
+    merge.merge_weight.compute_root();
+    merge.window.compute_root();
+
+    Var yo("burst_yo"), yi("burst_yi");
+    merge.output.compute_root().split(y, yo, yi, strip_size).parallel(yo).vectorize(x, vec_f);
+}
+
+// The temporal denoise: parallel strips of `strip_size` (even) rows, each
+// computing its quad rows' gate weights ahead of the blend. The bypass
+// (strength 0) is its own copy loop.
+inline void schedule_temporal_denoise(bool is_autoscheduled, const Halide::Target& target, TemporalDenoiseBuilder& td,
+                                      Halide::Var x, Halide::Var y, int strip_size)
+{
+    using namespace Halide;
+    if (is_autoscheduled) return;
+
+    const int vec = target.natural_vector_size<uint16_t>();
+    const int vec_f = target.natural_vector_size<float>();
+    Var yo("temporal_yo"), yi("temporal_yi");
+    td.output.compute_root().split(y, yo, yi, strip_size).parallel(yo).vectorize(x, vec);
+    td.output.specialize(td.is_bypassed);
+    td.weight.compute_at(td.output, yo).vectorize(td.qx, vec_f);
 }
+
 #endif // PIPELINE_SCHEDULE_H
 
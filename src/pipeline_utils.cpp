@@ -1,72 +1,35 @@
 #include "pipeline_utils.h"
+#include "color_profile.h"
+#include "color_tools.h"
+#include "process_options.h"
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <algorithm> // For std::max/min
 
+#ifdef USE_LENSFUN
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unistd.h>
+#include "camera_metadata_cache.h" // For openraw_cache_dir()
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 namespace PipelineUtils {
 
-// --- White Balance ---
-RGBGains kelvin_to_rgb_gains(float temp, float tint) {
-    // This is a standard algorithm for converting temperature to RGB multipliers,
-    // based on the method used in dcraw.
-    double r, g, b;
-    double temp_d = temp;
-
-    if (temp_d <= 6600.0) {
-        r = 255.0;
-        double g_temp = temp_d / 100.0;
-        g = 99.4708025861 * log(g_temp) - 161.1195681661;
-
-        if (temp_d <= 1900.0) {
-            b = 0;
-        } else {
-            double b_temp = (temp_d - 600.0) / 100.0;
-            b = 138.5177312231 * log(b_temp) - 305.0447927307;
-        }
-    } else {
-        double r_temp = (temp_d - 6000.0) / 100.0;
-        r = 329.698727446 * pow(r_temp, -0.1332047592);
-        
-        double g_temp = (temp_d - 6000.0) / 100.0;
-        g = 288.1221695283 * pow(g_temp, -0.0755148492);
-
-        b = 255.0;
-    }
-
-    r = std::max(0.0, std::min(255.0, r));
-    g = std::max(0.0, std::min(255.0, g));
-    b = std::max(0.0, std::min(255.0, b));
-    
-    // Apply tint, which primarily adjusts the green channel.
-    // A positive tint value should shift towards magenta (less green).
-    g *= (1.0 - tint * 0.5);
-
-    // To white balance, we need gains that are inversely proportional to the light color.
-    // We normalize these gains so the green channel multiplier is 1.0.
-    RGBGains final_gains;
-    if (r > 1e-6 && g > 1e-6 && b > 1e-6) {
-        final_gains.r = static_cast<float>(g / r);
-        final_gains.g = 1.0f;
-        final_gains.b = static_cast<float>(g / b);
-    } else {
-        // Avoid division by zero in extreme cases, return neutral gains.
-        final_gains.r = 1.0f;
-        final_gains.g = 1.0f;
-        final_gains.b = 1.0f;
-    }
-
-    return final_gains;
-}
-
-
 // --- Lens Correction LUT Generation ---
 namespace LensCorrection {
     const int LUT_SIZE = 2048;
     const float MAX_RD_SQUARED_NORM = 3.0f;
+    const int VIGNETTING_LUT_SIZE = 256;
+    const int TCA_LUT_SIZE = 256;
 
     // Solves the depressed cubic equation: r_u^3 + p*r_u + q = 0
     // using Cardano's method. We only need the single, positive real root.
@@ -131,6 +94,170 @@ namespace LensCorrection {
         return lut;
     }
 
+    // The inverse mapping of stage_lens_geometry.h, evaluated on the host:
+    // source_points(ox, oy, f) calls f with the pre-warp (x, y) each of the
+    // green, red and blue samples of output pixel (ox, oy) reads, and
+    // source_rows(ox, oy, f) with just the rows.
+    class InverseWarp {
+    public:
+        InverseWarp(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                    const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& p, int width, int height)
+            : lut(distortion_lut), tca(tca_lut), p(p),
+              center_x((width - 1.0f) / 2.0f), center_y((height - 1.0f) / 2.0f),
+              half_diag_sq(((float)width * width + (float)height * height) / 4.0f),
+              lut_width(distortion_lut.dim(0).extent()), tca_width(tca_lut.dim(0).extent()),
+              max_radius_sq(std::max(center_x, center_y) * std::max(center_x, center_y)) {
+            const float angle_rad = p.rotate * (float)(M_PI / 180.0f);
+            cos_a = cosf(-angle_rad);
+            sin_a = sinf(-angle_rad);
+            kv = p.keystone_v / 100.f;
+            kh = p.keystone_h / 100.f;
+            inv_scale = 100.f / p.scale;
+        }
+
+        template <typename F>
+        void source_rows(int ox, int oy, F f) const {
+            source_points(ox, oy, [&](float, float y) { f(y); });
+        }
+
+        template <typename F>
+        void source_points(int ox, int oy, F f) const {
+            float cx = (float)ox - center_x, cy = (float)oy - center_y;
+            float rx = cx * cos_a - cy * sin_a;
+            float ry = cx * sin_a + cy * cos_a;
+            float denom = 1.f - kv * ry / center_y - kh * rx / center_x;
+            denom = denom > 1e-4f ? denom : 1e-4f;
+            cx = rx / denom * inv_scale * p.aspect + center_x - p.offset_x;
+            cy = ry / denom * inv_scale + center_y - p.offset_y;
+
+            float dx = cx - center_x, dy = cy - center_y;
+            float lut_f = (dx * dx + dy * dy) / half_diag_sq * (lut_width - 1.0f) / MAX_RD_SQUARED_NORM;
+            int i0 = std::max(0, std::min((int)floorf(lut_f), lut_width - 2));
+            float frac = lut_f - floorf(lut_f);
+            float factor = lut(i0) + (lut(i0 + 1) - lut(i0)) * frac;
+            dx *= factor;
+            dy *= factor;
+
+            // Red and blue are scaled about the centre by the profile's TCA
+            // and the CA terms.
+            float rd_sq = dx * dx + dy * dy;
+            float r2 = rd_sq / max_radius_sq;
+            float tca_scale[2] = {1.f, 1.f};
+            if (tca_width > 1) {
+                float tca_f = rd_sq / half_diag_sq * (tca_width - 1.0f) / MAX_RD_SQUARED_NORM;
+                int t0 = std::max(0, std::min((int)floorf(tca_f), tca_width - 2));
+                float tca_frac = tca_f - t0;
+                for (int ch = 0; ch < 2; ++ch) {
+                    tca_scale[ch] = tca(t0, ch) + (tca(t0 + 1, ch) - tca(t0, ch)) * tca_frac;
+                }
+            }
+            f(center_x + dx, center_y + dy);
+            const float k[2] = {p.ca_red_cyan, p.ca_blue_yellow};
+            for (int ch = 0; ch < 2; ++ch) {
+                float s = tca_scale[ch] * (1.f + k[ch] * ca_scale * r2);
+                f(center_x + dx * s, center_y + dy * s);
+            }
+        }
+
+    private:
+        static constexpr float ca_scale = 2e-5f;
+        const Halide::Runtime::Buffer<float, 1>& lut;
+        const Halide::Runtime::Buffer<float, 2>& tca;
+        const WarpParams& p;
+        const float center_x, center_y, half_diag_sq;
+        const int lut_width, tca_width;
+        const float max_radius_sq;
+        float cos_a, sin_a, kv, kh, inv_scale;
+    };
+
+    // Visits the edges of output columns [x_begin, x_end) of rows
+    // [y_begin, y_end) plus a coarse interior grid. The mapping is smooth, so
+    // that finds the extremes of anything computed from it over the region;
+    // the callers' margin covers what falls between grid points.
+    template <typename F>
+    void visit_rect(int x_begin, int x_end, int y_begin, int y_end, F visit) {
+        const int step = 8;
+        for (int ox = x_begin; ox < x_end; ++ox) {
+            visit(ox, y_begin);
+            visit(ox, y_end - 1);
+        }
+        for (int oy = y_begin; oy < y_end; ++oy) {
+            visit(x_begin, oy);
+            visit(x_end - 1, oy);
+            if ((oy - y_begin) % step == 0) {
+                for (int ox = x_begin; ox < x_end; ox += step) visit(ox, oy);
+            }
+        }
+    }
+
+    template <typename F>
+    void visit_band(int width, int y_begin, int y_end, F visit) {
+        visit_rect(0, width, y_begin, y_end, visit);
+    }
+
+    const int WARP_ROW_MARGIN = 2;
+
+    void warp_source_rows(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                          const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& p, int width,
+                          int height, int y_begin, int y_end, int& row_min, int& row_max) {
+        const InverseWarp warp(distortion_lut, tca_lut, p, width, height);
+        float lo = INFINITY, hi = -INFINITY;
+        visit_band(width, y_begin, y_end, [&](int ox, int oy) {
+            warp.source_rows(ox, oy, [&](float y) {
+                lo = std::min(lo, y);
+                hi = std::max(hi, y);
+            });
+        });
+
+        if (!std::isfinite(lo) || !std::isfinite(hi)) {
+            row_min = 0;
+            row_max = height - 1;
+            return;
+        }
+        row_min = std::max(0, std::min(height - 1, (int)floorf(lo) - WARP_ROW_MARGIN));
+        row_max = std::max(row_min, std::min(height - 1, (int)ceilf(hi) + WARP_ROW_MARGIN));
+    }
+
+    void warp_source_rect(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                          const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& p,
+                          int width, int height, int x_begin, int x_end, int y_begin, int y_end,
+                          int& row_min, int& row_max, int& col_min, int& col_max) {
+        const InverseWarp warp(distortion_lut, tca_lut, p, width, height);
+        float x_lo = INFINITY, x_hi = -INFINITY, y_lo = INFINITY, y_hi = -INFINITY;
+        visit_rect(x_begin, x_end, y_begin, y_end, [&](int ox, int oy) {
+            warp.source_points(ox, oy, [&](float x, float y) {
+                x_lo = std::min(x_lo, x);
+                x_hi = std::max(x_hi, x);
+                y_lo = std::min(y_lo, y);
+                y_hi = std::max(y_hi, y);
+            });
+        });
+
+        if (!std::isfinite(x_lo) || !std::isfinite(x_hi) || !std::isfinite(y_lo) || !std::isfinite(y_hi)) {
+            row_min = 0;
+            row_max = height - 1;
+            col_min = 0;
+            col_max = width - 1;
+            return;
+        }
+        row_min = std::max(0, std::min(height - 1, (int)floorf(y_lo) - WARP_ROW_MARGIN));
+        row_max = std::max(row_min, std::min(height - 1, (int)ceilf(y_hi) + WARP_ROW_MARGIN));
+        col_min = std::max(0, std::min(width - 1, (int)floorf(x_lo) - WARP_ROW_MARGIN));
+        col_max = std::max(col_min, std::min(width - 1, (int)ceilf(x_hi) + WARP_ROW_MARGIN));
+    }
+
+    int warp_row_reach(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                       const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& p,
+                       int width, int height) {
+        const InverseWarp warp(distortion_lut, tca_lut, p, width, height);
+        float reach = 0.f;
+        visit_band(width, 0, height, [&](int ox, int oy) {
+            warp.source_rows(ox, oy, [&](float y) { reach = std::max(reach, fabsf(y - (float)oy)); });
+        });
+        if (!std::isfinite(reach)) return height;
+        return std::min(height, (int)ceilf(reach) + WARP_ROW_MARGIN);
+    }
+
 #ifdef USE_LENSFUN
     Halide::Runtime::Buffer<float, 1> generate_distortion_lut(const lfLensCalibDistortion& model) {
         Halide::Runtime::Buffer<float, 1> lut(LUT_SIZE);
@@ -166,10 +293,455 @@ namespace LensCorrection {
         }
         return lut;
     }
+
+    namespace {
+    constexpr char kLensIndexMagic[8] = {'O', 'R', 'L', 'E', 'N', 'S', 'I', 'X'};
+
+    struct LensKey {
+        std::string make, model, lens;
+        float focal;
+        bool operator<(const LensKey& o) const {
+            return std::tie(make, model, lens, focal) < std::tie(o.make, o.model, o.lens, o.focal);
+        }
+    };
+
+    // On-disk form of a found profile: just enough of lfLensCalibDistortion
+    // to rebuild the LUT without loading the database.
+    struct StoredLens {
+        int32_t model;
+        float focal;
+        float terms[3];
+    };
+
+    std::string lens_index_path() {
+        std::string dir = openraw_cache_dir();
+        return dir.empty() ? "" : dir + "/lensfun.idx";
+    }
+
+    void write_str(std::ostream& os, const std::string& s) {
+        uint32_t n = static_cast<uint32_t>(s.size());
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        os.write(s.data(), n);
+    }
+
+    bool read_str(std::istream& is, std::string& s) {
+        uint32_t n;
+        if (!is.read(reinterpret_cast<char*>(&n), sizeof(n)) || n > 4096) return false;
+        s.resize(n);
+        return n == 0 || static_cast<bool>(is.read(&s[0], n));
+    }
+
+    // The index is tagged with the Lensfun version it was built against;
+    // entries from another version are ignored and the file is rewritten.
+    std::map<LensKey, StoredLens> read_lens_index() {
+        std::map<LensKey, StoredLens> entries;
+        std::string path = lens_index_path();
+        if (path.empty()) return entries;
+        std::ifstream is(path, std::ios::binary);
+        char magic[sizeof(kLensIndexMagic)];
+        int32_t version = 0;
+        uint32_t count = 0;
+        if (!is.read(magic, sizeof(magic)) || memcmp(magic, kLensIndexMagic, sizeof(magic)) != 0) return entries;
+        if (!is.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != LF_VERSION) return entries;
+        if (!is.read(reinterpret_cast<char*>(&count), sizeof(count))) return entries;
+        for (uint32_t i = 0; i < count; ++i) {
+            LensKey key;
+            StoredLens stored;
+            if (!read_str(is, key.make) || !read_str(is, key.model) || !read_str(is, key.lens)) break;
+            if (!is.read(reinterpret_cast<char*>(&key.focal), sizeof(key.focal))) break;
+            if (!is.read(reinterpret_cast<char*>(&stored), sizeof(stored))) break;
+            entries[key] = stored;
+        }
+        return entries;
+    }
+
+    void write_lens_index(const std::map<LensKey, StoredLens>& entries) {
+        std::string dir = openraw_cache_dir(true);
+        if (dir.empty()) return;
+        std::string path = lens_index_path();
+        std::string tmp = path + ".tmp" + std::to_string(static_cast<long>(getpid()));
+        {
+            std::ofstream os(tmp, std::ios::binary);
+            int32_t version = LF_VERSION;
+            uint32_t count = static_cast<uint32_t>(entries.size());
+            os.write(kLensIndexMagic, sizeof(kLensIndexMagic));
+            os.write(reinterpret_cast<const char*>(&version), sizeof(version));
+            os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& [key, stored] : entries) {
+                write_str(os, key.make);
+                write_str(os, key.model);
+                write_str(os, key.lens);
+                os.write(reinterpret_cast<const char*>(&key.focal), sizeof(key.focal));
+                os.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+            }
+            if (!os) return;
+        }
+        rename(tmp.c_str(), path.c_str());
+    }
+
+    bool is_supported_model(lfDistortionModel model) {
+        return model == LF_DIST_MODEL_POLY3 || model == LF_DIST_MODEL_POLY5 || model == LF_DIST_MODEL_PTLENS;
+    }
+
+    ResolvedLens resolve_from_db(const LensKey& key, const lfDatabase* db) {
+        ResolvedLens r;
+        const lfCamera** cams = lf_db_find_cameras(db, key.make.c_str(), key.model.c_str());
+        if (cams && cams[0]) {
+            const lfLens** lenses = lf_db_find_lenses_hd(db, cams[0], nullptr, key.lens.c_str(), 0);
+            if (!lenses || !lenses[0]) {
+                r.status = LensLookup::LensNotFound;
+            } else if (!lenses[0]->InterpolateDistortion(key.focal, r.model)) {
+                r.status = LensLookup::NoCalibration;
+            } else {
+                r.status = is_supported_model(r.model.Model) ? LensLookup::Found : LensLookup::UnsupportedModel;
+            }
+            if (lenses) lf_free(lenses);
+        }
+        if (cams) lf_free(cams);
+        return r;
+    }
+    } // namespace
+
+    const ResolvedLens& resolve_lens(const std::string& camera_make, const std::string& camera_model,
+                                     const std::string& lens_name, float focal_length,
+                                     const std::function<const lfDatabase*()>& get_db) {
+        static std::mutex mutex;
+        static std::map<LensKey, ResolvedLens> resolved;
+        static std::map<LensKey, StoredLens> disk_index;
+        static bool disk_index_loaded = false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        LensKey key{camera_make, camera_model, lens_name, focal_length};
+        auto it = resolved.find(key);
+        if (it != resolved.end()) return it->second;
+
+        if (!disk_index_loaded) {
+            disk_index = read_lens_index();
+            disk_index_loaded = true;
+        }
+
+        ResolvedLens r;
+        auto stored = disk_index.find(key);
+        if (stored != disk_index.end()) {
+            r.status = LensLookup::Found;
+            r.model.Model = static_cast<lfDistortionModel>(stored->second.model);
+            r.model.Focal = stored->second.focal;
+            for (int i = 0; i < 3; ++i) r.model.Terms[i] = stored->second.terms[i];
+        } else if (const lfDatabase* db = get_db()) {
+            r = resolve_from_db(key, db);
+            if (r.status == LensLookup::Found) {
+                // Only found profiles are persisted, so a later database
+                // update can still supply a lens that is missing today.
+                StoredLens s{static_cast<int32_t>(r.model.Model), r.model.Focal,
+                             {r.model.Terms[0], r.model.Terms[1], r.model.Terms[2]}};
+                disk_index[key] = s;
+                write_lens_index(disk_index);
+            }
+        }
+        if (r.status == LensLookup::Found) {
+            r.lut = generate_distortion_lut(r.model);
+        }
+        return resolved.emplace(key, std::move(r)).first->second;
+    }
 #endif // USE_LENSFUN
 
+    WarpParams warp_params(const ProcessConfig& cfg) {
+        WarpParams warp;
+        warp.ca_red_cyan = cfg.ca_red_cyan;
+        warp.ca_blue_yellow = cfg.ca_blue_yellow;
+        warp.rotate = cfg.geo_rotate;
+        warp.scale = cfg.geo_scale;
+        warp.aspect = cfg.geo_aspect;
+        warp.keystone_v = cfg.geo_keystone_v;
+        warp.keystone_h = cfg.geo_keystone_h;
+        warp.offset_x = cfg.geo_offset_x;
+        warp.offset_y = cfg.geo_offset_y;
+        return warp;
+    }
+
+    Halide::Runtime::Buffer<float, 1> distortion_lut_for(const ProcessConfig& cfg,
+                                                         const std::function<const lfDatabase*()>& get_db,
+                                                         bool verbose) {
+#ifdef USE_LENSFUN
+        bool needs_lensfun = !cfg.camera_make.empty() && !cfg.camera_model.empty() &&
+                             cfg.lens_profile_name != "None" && !cfg.lens_profile_name.empty();
+        if (needs_lensfun) {
+            if (verbose) {
+                fprintf(stderr, "Attempting to load Lensfun profile...\n");
+                fprintf(stderr, "  Camera: %s %s\n", cfg.camera_make.c_str(), cfg.camera_model.c_str());
+                fprintf(stderr, "  Lens: %s @ %.1fmm\n", cfg.lens_profile_name.c_str(), cfg.focal_length);
+            }
+
+            // Memoised, and the database is only loaded if this profile
+            // isn't already in the on-disk lens index.
+            const auto& resolved = resolve_lens(cfg.camera_make, cfg.camera_model, cfg.lens_profile_name,
+                                                cfg.focal_length, get_db);
+
+            const char* model_name = "Unknown";
+            if (resolved.model.Model == LF_DIST_MODEL_POLY3) model_name = "POLY3";
+            else if (resolved.model.Model == LF_DIST_MODEL_POLY5) model_name = "POLY5";
+            else if (resolved.model.Model == LF_DIST_MODEL_PTLENS) model_name = "PTLENS";
+
+            if (resolved.status == LensLookup::Found) {
+                if (verbose) fprintf(stderr, "  -> Profile loaded (%s). Using inverse distortion LUT.\n", model_name);
+                return resolved.lut;
+            }
+            if (verbose) {
+                switch (resolved.status) {
+                    case LensLookup::CameraNotFound:
+                        fprintf(stderr, "  -> Warning: Camera '%s %s' not found in Lensfun database.\n", cfg.camera_make.c_str(), cfg.camera_model.c_str());
+                        break;
+                    case LensLookup::LensNotFound:
+                        fprintf(stderr, "  -> Warning: Lens profile '%s' not found for specified camera.\n", cfg.lens_profile_name.c_str());
+                        break;
+                    case LensLookup::NoCalibration:
+                        fprintf(stderr, "  -> Warning: Could not retrieve distortion params for this focal length.\n");
+                        break;
+                    case LensLookup::UnsupportedModel:
+                        fprintf(stderr, "  -> Warning: Lens profile uses an unsupported distortion model (%s). Distortion not applied.\n", model_name);
+                        break;
+                    case LensLookup::Found:
+                        break;
+                }
+            }
+        }
+
+        // No profile applied: the manual terms, if any.
+        const float e = 1e-6f;
+        if (fabsf(cfg.dist_k1) > e || fabsf(cfg.dist_k2) > e || fabsf(cfg.dist_k3) > e) {
+            if (verbose) fprintf(stderr, "Using manual distortion parameters k1, k2, k3...\n");
+            lfLensCalibDistortion manual_model;
+            manual_model.Model = LF_DIST_MODEL_POLY5; // Treat manual k1/k2 as POLY5
+            manual_model.Terms[0] = cfg.dist_k1;
+            manual_model.Terms[1] = cfg.dist_k2;
+            // Note: k3 is ignored as POLY5 solver only uses k1, k2.
+            return generate_distortion_lut(manual_model);
+        }
+#else
+        (void)cfg;
+        (void)get_db;
+        (void)verbose;
+#endif
+        return generate_identity_lut();
+    }
+
+    Halide::Runtime::Buffer<float, 1> vignetting_lut_for(const ProcessConfig& cfg,
+                                                         const std::function<const lfDatabase*()>& get_db,
+                                                         bool verbose) {
+        Halide::Runtime::Buffer<float, 1> none(1);
+        none(0) = 1.0f;
+#ifdef USE_LENSFUN
+        bool needs_lensfun = !cfg.camera_make.empty() && !cfg.camera_model.empty() &&
+                             cfg.lens_profile_name != "None" && !cfg.lens_profile_name.empty() && cfg.aperture > 0.0f;
+        if (!needs_lensfun) return none;
+
+        // Memoised for the process; unlike the distortion model it isn't
+        // in the on-disk index, so a new aperture loads the database.
+        using Key = std::tuple<std::string, std::string, std::string, float, float, float>;
+        static std::mutex mutex;
+        static std::map<Key, Halide::Runtime::Buffer<float, 1>> resolved;
+        std::lock_guard<std::mutex> lock(mutex);
+        Key key{cfg.camera_make, cfg.camera_model, cfg.lens_profile_name, cfg.focal_length, cfg.aperture,
+                cfg.focus_distance};
+        auto it = resolved.find(key);
+        if (it != resolved.end()) return it->second;
+
+        Halide::Runtime::Buffer<float, 1> lut = none;
+        lfLensCalibVignetting model = {};
+        bool found = false;
+        if (const lfDatabase* db = get_db()) {
+            const lfCamera** cams = lf_db_find_cameras(db, cfg.camera_make.c_str(), cfg.camera_model.c_str());
+            if (cams && cams[0]) {
+                const lfLens** lenses = lf_db_find_lenses_hd(db, cams[0], nullptr, cfg.lens_profile_name.c_str(), 0);
+                found = lenses && lenses[0] &&
+                        lenses[0]->InterpolateVignetting(cfg.focal_length, cfg.aperture, cfg.focus_distance, model) &&
+                        model.Model == LF_VIGNETTING_MODEL_PA;
+                if (lenses) lf_free(lenses);
+            }
+            if (cams) lf_free(cams);
+        }
+        if (found) {
+            // Lensfun's PA model darkens by 1 + k1 r^2 + k2 r^4 + k3 r^6, r
+            // over the half-diagonal; the correction is its reciprocal.
+            lut = Halide::Runtime::Buffer<float, 1>(VIGNETTING_LUT_SIZE);
+            for (int i = 0; i < VIGNETTING_LUT_SIZE; ++i) {
+                const float r2 = powf((float)i / (VIGNETTING_LUT_SIZE - 1), 2.0f);
+                const float falloff =
+                    1.0f + r2 * (model.Terms[0] + r2 * (model.Terms[1] + r2 * model.Terms[2]));
+                lut(i) = falloff > 1e-3f ? 1.0f / falloff : 1.0f;
+            }
+        }
+        if (verbose) {
+            if (found) {
+                fprintf(stderr, "Lens vignetting at f/%.1f: corner gain %.2f.\n", cfg.aperture,
+                        lut(VIGNETTING_LUT_SIZE - 1));
+            } else {
+                fprintf(stderr, "  -> Warning: No vignetting calibration for this lens at f/%.1f. Vignetting not corrected.\n",
+                        cfg.aperture);
+            }
+        }
+        return resolved.emplace(key, lut).first->second;
+#else
+        (void)cfg;
+        (void)get_db;
+        (void)verbose;
+        return none;
+#endif
+    }
+
+    Halide::Runtime::Buffer<float, 2> tca_lut_for(const ProcessConfig& cfg,
+                                                  const std::function<const lfDatabase*()>& get_db,
+                                                  bool verbose) {
+        Halide::Runtime::Buffer<float, 2> none(1, 2);
+        none.fill(1.0f);
+#ifdef USE_LENSFUN
+        bool needs_lensfun = cfg.lens_tca && !cfg.camera_make.empty() && !cfg.camera_model.empty() &&
+                             cfg.lens_profile_name != "None" && !cfg.lens_profile_name.empty();
+        if (!needs_lensfun) return none;
+
+        // Memoised for the process, like the vignetting calibration.
+        using Key = std::tuple<std::string, std::string, std::string, float>;
+        static std::mutex mutex;
+        static std::map<Key, Halide::Runtime::Buffer<float, 2>> resolved;
+        std::lock_guard<std::mutex> lock(mutex);
+        Key key{cfg.camera_make, cfg.camera_model, cfg.lens_profile_name, cfg.focal_length};
+        auto it = resolved.find(key);
+        if (it != resolved.end()) return it->second;
+
+        Halide::Runtime::Buffer<float, 2> lut = none;
+        lfLensCalibTCA model = {};
+        bool found = false;
+        if (const lfDatabase* db = get_db()) {
+            const lfCamera** cams = lf_db_find_cameras(db, cfg.camera_make.c_str(), cfg.camera_model.c_str());
+            if (cams && cams[0]) {
+                const lfLens** lenses = lf_db_find_lenses_hd(db, cams[0], nullptr, cfg.lens_profile_name.c_str(), 0);
+                found = lenses && lenses[0] && lenses[0]->InterpolateTCA(cfg.focal_length, model) &&
+                        (model.Model == LF_TCA_MODEL_LINEAR || model.Model == LF_TCA_MODEL_POLY3);
+                if (lenses) lf_free(lenses);
+            }
+            if (cams) lf_free(cams);
+        }
+        if (found) {
+            // Lensfun's TCA models give where red and blue really land as a
+            // scale of the radius: k (linear), or b r^2 + c r + v (poly3),
+            // r over the half-diagonal. Sampling there corrects it.
+            lut = Halide::Runtime::Buffer<float, 2>(TCA_LUT_SIZE, 2);
+            for (int i = 0; i < TCA_LUT_SIZE; ++i) {
+                const float r = sqrtf((float)i * MAX_RD_SQUARED_NORM / (float)(TCA_LUT_SIZE - 1));
+                for (int ch = 0; ch < 2; ++ch) {
+                    if (model.Model == LF_TCA_MODEL_LINEAR) {
+                        lut(i, ch) = model.Terms[ch];
+                    } else {
+                        lut(i, ch) = model.Terms[4 + ch] * r * r + model.Terms[2 + ch] * r + model.Terms[ch];
+                    }
+                }
+            }
+        }
+        if (verbose) {
+            if (found) {
+                const int corner = (int)((TCA_LUT_SIZE - 1) / MAX_RD_SQUARED_NORM); // r = 1
+                fprintf(stderr, "Lens TCA from profile: red x%.5f, blue x%.5f at the corner.\n",
+                        lut(corner, 0), lut(corner, 1));
+            } else {
+                fprintf(stderr, "  -> Warning: No TCA calibration for this lens at %.1fmm. TCA not corrected from the profile.\n",
+                        cfg.focal_length);
+            }
+        }
+        return resolved.emplace(key, lut).first->second;
+#else
+        (void)cfg;
+        (void)get_db;
+        (void)verbose;
+        return none;
+#endif
+    }
+
+    float ca_estimate_strength(const ProcessConfig& cfg, const Halide::Runtime::Buffer<float, 2>& tca_lut) {
+        return tca_lut.dim(0).extent() > 1 ? 0.0f : cfg.ca_strength;
+    }
+
 } // namespace LensCorrection
 
+int demosaic_algorithm_id(const std::string& name)
+{
+    if (name == "ahd") return 0;
+    if (name == "lmmse") return 1;
+    if (name == "ri") return 2;
+    if (name == "fast") return 3;
+    if (name == "adaptive") return 4;
+    return -1;
+}
+
+int denoise_algorithm_id(const std::string& name)
+{
+    if (name == "guided") return 0;
+    if (name == "nlmeans") return 1;
+    return -1;
+}
+
+namespace {
+bool same_points(const std::vector<Point>& a, const std::vector<Point>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].x != b[i].x || a[i].y != b[i].y) return false;
+    }
+    return true;
+}
+
+bool same_point(const Point& a, const Point& b) { return a.x == b.x && a.y == b.y; }
+} // namespace
+
+bool tone_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    return a.contrast == b.contrast && a.tone_curve_size == b.tone_curve_size &&
+           same_points(a.curve_points_luma, b.curve_points_luma) &&
+           same_points(a.curve_points_r, b.curve_points_r) &&
+           same_points(a.curve_points_g, b.curve_points_g) &&
+           same_points(a.curve_points_b, b.curve_points_b);
+}
+
+bool color_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    // A profile's hue/saturation maps are picked by the colour temperature.
+    return a.input_profile == b.input_profile && a.look_lut == b.look_lut &&
+           (a.input_profile.empty() || a.color_temp == b.color_temp) &&
+           same_points(a.curve_hue_vs_hue, b.curve_hue_vs_hue) &&
+           same_points(a.curve_hue_vs_sat, b.curve_hue_vs_sat) &&
+           same_points(a.curve_hue_vs_lum, b.curve_hue_vs_lum) &&
+           same_points(a.curve_lum_vs_sat, b.curve_lum_vs_sat) &&
+           same_points(a.curve_sat_vs_sat, b.curve_sat_vs_sat) &&
+           same_point(a.shadows_wheel, b.shadows_wheel) && a.shadows_luma == b.shadows_luma &&
+           same_point(a.midtones_wheel, b.midtones_wheel) && a.midtones_luma == b.midtones_luma &&
+           same_point(a.highlights_wheel, b.highlights_wheel) && a.highlights_luma == b.highlights_luma;
+}
+
+bool distortion_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    return a.camera_make == b.camera_make && a.camera_model == b.camera_model &&
+           a.lens_profile_name == b.lens_profile_name && a.focal_length == b.focal_length &&
+           a.dist_k1 == b.dist_k1 && a.dist_k2 == b.dist_k2 && a.dist_k3 == b.dist_k3;
+}
+
+bool vignetting_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    return a.camera_make == b.camera_make && a.camera_model == b.camera_model &&
+           a.lens_profile_name == b.lens_profile_name && a.focal_length == b.focal_length &&
+           a.aperture == b.aperture && a.focus_distance == b.focus_distance;
+}
+
+bool tca_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    if (a.lens_tca != b.lens_tca) return false;
+    return !a.lens_tca ||
+           (a.camera_make == b.camera_make && a.camera_model == b.camera_model &&
+            a.lens_profile_name == b.lens_profile_name && a.focal_length == b.focal_length);
+}
+
+bool color_matrix_inputs_match(const ProcessConfig& a, const ProcessConfig& b)
+{
+    return a.color_temp == b.color_temp && a.input_profile == b.input_profile;
+}
+
 
 void prepare_color_matrices(const RawImageData& raw_data,
                             Halide::Runtime::Buffer<float, 2>& matrix_3200,
@@ -218,5 +790,271 @@ void get_interpolated_color_matrix(const RawImageData& raw_data,
     }
 }
 
+void color_matrix_for(const RawImageData& raw_data, const ProcessConfig& cfg,
+                      Halide::Runtime::Buffer<float, 2>& output_matrix)
+{
+    float xyz_to_cam[3][3];
+    if (cfg.input_profile.empty() ||
+        !ColorProfile::xyz_to_camera(*ColorProfile::load_input_profile(cfg.input_profile), cfg.color_temp,
+                                     xyz_to_cam)) {
+        get_interpolated_color_matrix(raw_data, cfg.color_temp, output_matrix);
+        return;
+    }
+    float cam_to_srgb[3][4];
+    camera_to_srgb_matrix(xyz_to_cam, cam_to_srgb);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            output_matrix(j, i) = cam_to_srgb[i][j];
+        }
+    }
+}
+
+Halide::Runtime::Buffer<float, 4> color_grading_lut_for(const ProcessConfig& cfg)
+{
+    std::shared_ptr<const ColorProfile::InputProfile> profile;
+    std::shared_ptr<const ColorProfile::CubeLut> lut;
+    if (!cfg.input_profile.empty()) profile = ColorProfile::load_input_profile(cfg.input_profile);
+    if (!cfg.look_lut.empty()) lut = ColorProfile::load_cube_lut(cfg.look_lut);
+    if (!lut && !(profile && profile->has_look())) return HostColor::generate_color_lut(cfg);
+
+    const float color_temp = cfg.color_temp;
+    return HostColor::generate_color_lut(cfg, 33, [&](float rgb[3]) {
+        ColorProfile::apply_look(profile.get(), lut.get(), color_temp, rgb);
+    });
+}
+
+Halide::Runtime::Buffer<int, 2> make_black_level_buffer(const RawImageData& raw_data)
+{
+    Halide::Runtime::Buffer<int, 2> levels(2, 2);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            levels(x, y) = raw_data.black_levels[y][x];
+        }
+    }
+    return levels;
+}
+
+namespace {
+
+constexpr int kStatsBinsPerStop = 16; // RawStatsBuilder::kBinsPerStop
+constexpr int kStatsStops = 16;       // RawStatsBuilder::kStops
+constexpr int kStatsValues = 4;       // RawStatsBuilder::kValues
+
+} // namespace
+
+Halide::Runtime::Buffer<float, 2> make_raw_stats_buffer()
+{
+    return Halide::Runtime::Buffer<float, 2>(kStatsBinsPerStop * kStatsStops + 1, kStatsValues);
+}
+
+AutoSettings auto_settings(const Halide::Runtime::Buffer<float, 2>& stats, const RawImageData& raw_data,
+                           bool white_patch)
+{
+    constexpr int kBinsPerStop = kStatsBinsPerStop, kStops = kStatsStops;
+    constexpr int kBins = kBinsPerStop * kStops;
+    constexpr float kMidGrey = 0.18f, kHighlight = 0.95f, kMaxStops = 4.0f;
+    AutoSettings out;
+
+    double total = 0.0, unclipped = 0.0;
+    for (int i = 0; i <= kBins; i++) total += stats(i, 0);
+    for (int i = 0; i < kBins; i++) unclipped += stats(i, 0);
+    if (unclipped <= 0.0) return out;
+
+    // The green level below which `fraction` of the blocks fall, at the
+    // centre of its bin; the clipped blocks count as the brightest.
+    auto percentile = [&](double fraction, int& bin) {
+        double seen = 0.0;
+        for (bin = 0; bin < kBins; bin++) {
+            seen += stats(bin, 0);
+            if (seen >= fraction * total) break;
+        }
+        if (bin == kBins) return 1.0f;
+        return std::exp2((bin + 0.5f) / kBinsPerStop - kStops);
+    };
+    int median_bin = 0, p99_bin = 0, patch_bin = 0;
+    const float median = percentile(0.5, median_bin);
+    const float p99 = percentile(0.99, p99_bin);
+    const float highlight_stops = std::log2(kHighlight / p99);
+    float stops = std::log2(kMidGrey / median);
+    stops = std::min(stops, std::max(highlight_stops, 0.0f));
+    out.exposure = std::max(-kMaxStops, std::min(kMaxStops, stops));
+    out.valid = true;
+
+    // The neutral, in camera RGB.
+    percentile(white_patch ? 0.98 * unclipped / total : 0.0, patch_bin);
+    double count = 0.0, sum[3] = {0.0, 0.0, 0.0};
+    for (int i = std::min(patch_bin, kBins - 1); i < kBins; i++) {
+        count += stats(i, 0);
+        for (int ch = 0; ch < 3; ch++) sum[ch] += stats(i, ch + 1);
+    }
+    if (sum[0] <= 0.0 || sum[1] <= 0.0 || sum[2] <= 0.0) return out;
+    const float neutral[3] = {float(sum[0] / count), float(sum[1] / count), float(sum[2] / count)};
+
+    // Search temperature and tint for the gains and matrix that render it
+    // grey, as the colour correction stage would.
+    float best_error = std::numeric_limits<float>::max();
+    Halide::Runtime::Buffer<float, 2> matrix(4, 3);
+    for (int t = 20; t <= 120; t++) {
+        const float temp = t * 100.0f;
+        get_interpolated_color_matrix(raw_data, temp, matrix);
+        for (int g = -50; g <= 50; g++) {
+            const float tint = g * 0.02f;
+            const RGBGains gains = kelvin_to_rgb_gains(temp, tint);
+            const float sensor[3] = {neutral[0] * gains.r, neutral[1] * gains.g, neutral[2] * gains.b};
+            float rgb[3];
+            for (int ch = 0; ch < 3; ch++) {
+                rgb[ch] = matrix(3, ch) + matrix(0, ch) * sensor[0] + matrix(1, ch) * sensor[1] +
+                          matrix(2, ch) * sensor[2];
+            }
+            if (rgb[0] <= 0.0f || rgb[1] <= 0.0f || rgb[2] <= 0.0f) continue;
+            const float rg = std::log(rgb[0] / rgb[1]), bg = std::log(rgb[2] / rgb[1]);
+            const float error = rg * rg + bg * bg;
+            if (error < best_error) {
+                best_error = error;
+                out.color_temp = temp;
+                out.tint = tint;
+            }
+        }
+    }
+    return out;
+}
+
+void upright_rect(int orientation, int width, int height, int& x_begin, int& x_end, int& y_begin, int& y_end) {
+    if (orientation_swaps_axes(orientation)) {
+        std::swap(x_begin, y_begin);
+        std::swap(x_end, y_end);
+    }
+    const bool mirror_x = orientation == 2 || orientation == 3 || orientation == 7 || orientation == 8;
+    const bool mirror_y = orientation == 3 || orientation == 4 || orientation == 6 || orientation == 7;
+    if (mirror_x) {
+        const int begin = width - x_end;
+        x_end = width - x_begin;
+        x_begin = begin;
+    }
+    if (mirror_y) {
+        const int begin = height - y_end;
+        y_end = height - y_begin;
+        y_begin = begin;
+    }
+}
+
+namespace {
+
+// The coverage of an adjustment layer at (x, y), in pixels of a width x
+// height output as rendered.
+float layer_coverage(const AdjustLayer& layer, float x, float y, int width, int height) {
+    auto smoothstep = [](float t) {
+        t = std::max(0.0f, std::min(1.0f, t));
+        return t * t * (3.0f - 2.0f * t);
+    };
+    if (layer.shape == "linear") {
+        const float x0 = layer.a * width, y0 = layer.b * height;
+        const float dx = layer.c * width - x0, dy = layer.d * height - y0;
+        const float len_sq = dx * dx + dy * dy;
+        if (len_sq <= 0.0f) return 0.0f;
+        return 1.0f - smoothstep(((x - x0) * dx + (y - y0) * dy) / len_sq);
+    }
+    const float radius = layer.c * std::max(width, height);
+    const float inner = radius * (1.0f - std::max(0.0f, std::min(1.0f, layer.d)));
+    const float dist = std::hypot(x - layer.a * width, y - layer.b * height);
+    if (dist <= inner) return 1.0f;
+    if (dist >= radius) return 0.0f;
+    return smoothstep((radius - dist) / (radius - inner));
+}
+
+} // namespace
+
+LocalAdjustInputs make_local_adjust_inputs(const ProcessConfig& cfg, int width, int height, int orientation)
+{
+    constexpr int kCellSize = 8;  // MaskedAdjustGrid::kCellSize
+    constexpr int kTileSize = 64; // MaskedAdjustGrid::kTileSize
+    LocalAdjustInputs in;
+    const int layers = static_cast<int>(cfg.adjust_layers.size());
+    if (layers == 0 || width <= 0 || height <= 0) {
+        in.masks = Halide::Runtime::Buffer<float, 3>(1, 1, 1);
+        in.masks.fill(0.0f);
+        in.exposure = Halide::Runtime::Buffer<float, 1>(1);
+        in.exposure.fill(0.0f);
+        in.tiles = Halide::Runtime::Buffer<int32_t, 2>(1, 1);
+        in.tiles.fill(-1);
+        return in;
+    }
+
+    // The layers are placed on the output as rendered; the masks are in
+    // the upright image.
+    const bool swap = orientation_swaps_axes(orientation);
+    const bool mirror_x = orientation == 2 || orientation == 3 || orientation == 7 || orientation == 8;
+    const bool mirror_y = orientation == 3 || orientation == 4 || orientation == 6 || orientation == 7;
+    const int shown_width = swap ? height : width, shown_height = swap ? width : height;
+    const int cells_x = (width + kCellSize - 1) / kCellSize, cells_y = (height + kCellSize - 1) / kCellSize;
+    in.masks = Halide::Runtime::Buffer<float, 3>(cells_x, cells_y, layers);
+    in.exposure = Halide::Runtime::Buffer<float, 1>(layers);
+    std::vector<uint8_t> touched(static_cast<size_t>(cells_x) * cells_y, 0);
+    for (int l = 0; l < layers; l++) {
+        const AdjustLayer& layer = cfg.adjust_layers[l];
+        in.exposure(l) = layer.exposure;
+        for (int cy = 0; cy < cells_y; cy++) {
+            for (int cx = 0; cx < cells_x; cx++) {
+                // The cell's centre, mapped back through final_stage's mirror
+                // then swap to the output as shown.
+                float sx = (cx + 0.5f) * kCellSize, sy = (cy + 0.5f) * kCellSize;
+                if (mirror_x) sx = width - sx;
+                if (mirror_y) sy = height - sy;
+                if (swap) std::swap(sx, sy);
+                const float coverage = layer_coverage(layer, sx, sy, shown_width, shown_height);
+                in.masks(cx, cy, l) = coverage;
+                if (coverage != 0.0f) touched[static_cast<size_t>(cy) * cells_x + cx] = 1;
+            }
+        }
+    }
+
+    // A tile is listed if a cell within one of it is non-zero: bilinear
+    // sampling reaches the neighbouring cell.
+    const int cells_per_tile = kTileSize / kCellSize;
+    const int tiles_x = (width + kTileSize - 1) / kTileSize, tiles_y = (height + kTileSize - 1) / kTileSize;
+    std::vector<std::vector<int32_t>> rows(tiles_y);
+    size_t list_length = 1;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            const int cx0 = std::max(0, tx * cells_per_tile - 1), cx1 = std::min(cells_x, (tx + 1) * cells_per_tile + 1);
+            const int cy0 = std::max(0, ty * cells_per_tile - 1), cy1 = std::min(cells_y, (ty + 1) * cells_per_tile + 1);
+            bool any = false;
+            for (int cy = cy0; cy < cy1 && !any; cy++) {
+                for (int cx = cx0; cx < cx1 && !any; cx++) {
+                    any = touched[static_cast<size_t>(cy) * cells_x + cx] != 0;
+                }
+            }
+            if (any) rows[ty].push_back(tx);
+        }
+        list_length = std::max(list_length, rows[ty].size());
+        in.touched_tiles += static_cast<int>(rows[ty].size());
+    }
+    in.tiles = Halide::Runtime::Buffer<int32_t, 2>(static_cast<int>(list_length), tiles_y);
+    in.tiles.fill(-1);
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (size_t k = 0; k < rows[ty].size(); k++) in.tiles(static_cast<int>(k), ty) = rows[ty][k];
+    }
+    return in;
+}
+
+Halide::Runtime::Buffer<float, 4> make_ca_shifts_buffer(int width, int height)
+{
+    constexpr int kTileSize = 16; // CAShiftGrid::kTileSize
+    Halide::Runtime::Buffer<float, 4> shifts(std::max(1, (width + kTileSize - 1) / kTileSize),
+                                             std::max(1, (height + kTileSize - 1) / kTileSize), 2, 2);
+    shifts.fill(0.0f);
+    return shifts;
+}
+
+void set_memoization_cache_size(int64_t bytes)
+{
+    halide_memoization_cache_set_size(bytes);
+}
+
+void flush_memoization_cache()
+{
+    halide_memoization_cache_cleanup();
+}
+
 } // namespace PipelineUtils
 
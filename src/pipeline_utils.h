@@ -3,30 +3,125 @@
 
 #include "HalideBuffer.h"
 #include "raw_load.h"
+#include "white_balance.h"
+#include <functional>
+#include <string>
 
 // To enable Lensfun support, compile with -DUSE_LENSFUN and link against liblensfun.
 #ifdef USE_LENSFUN
 #include "lensfun/lensfun.h"
 #endif
 
-namespace PipelineUtils {
-
-// --- White Balance ---
-struct RGBGains { float r, g, b; };
-// Calculates white balance gains for a given temperature and tint.
-RGBGains kelvin_to_rgb_gains(float temp, float tint);
+struct ProcessConfig;
+struct lfDatabase;
 
+namespace PipelineUtils {
 
 // --- Lens Correction LUT Generation ---
 namespace LensCorrection {
     Halide::Runtime::Buffer<float, 1> generate_identity_lut();
 
+    // The lens & geometry stage's parameters, as passed to the pipeline.
+    struct WarpParams {
+        float ca_red_cyan = 0.f, ca_blue_yellow = 0.f;
+        float rotate = 0.f, scale = 100.f, aspect = 1.f;
+        float keystone_v = 0.f, keystone_h = 0.f;
+        float offset_x = 0.f, offset_y = 0.f;
+    };
+
+    // Finds the (inclusive) range of pre-warp rows that output rows
+    // [y_begin, y_end) of a width x height image sample, by evaluating the
+    // same inverse mapping as stage_lens_geometry.h on a grid over the band.
+    // Used to bound banded renders; keep the two in sync.
+    void warp_source_rows(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                          const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& params, int width, int height, int y_begin, int y_end, int& row_min, int& row_max);
+
+    // The same for the output region [x_begin, x_end) x [y_begin, y_end),
+    // also finding the (inclusive) range of pre-warp columns it samples.
+    // Used to bound renders of a crop.
+    void warp_source_rect(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                          const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& params,
+                          int width, int height, int x_begin, int x_end, int y_begin, int y_end,
+                          int& row_min, int& row_max, int& col_min, int& col_max);
+
+    // The furthest any output row of a width x height image reads from its
+    // own row in the pre-warp image, found the same way. Passed to the
+    // pipeline so the lens & geometry stage's footprint is bounded per strip
+    // (see LensGeometryBuilder::src_row_reach).
+    int warp_row_reach(const Halide::Runtime::Buffer<float, 1>& distortion_lut,
+                       const Halide::Runtime::Buffer<float, 2>& tca_lut, const WarpParams& params,
+                       int width, int height);
+
+    // The lens & geometry parameters of a config.
+    WarpParams warp_params(const ProcessConfig& cfg);
+
+    // The distortion LUT for the config's lens: its Lensfun profile (see
+    // resolve_lens) if one is found, else its manual k1/k2 terms, else the
+    // identity. With `verbose` the lookup is reported on stderr.
+    Halide::Runtime::Buffer<float, 1> distortion_lut_for(const ProcessConfig& cfg,
+                                                         const std::function<const lfDatabase*()>& get_db,
+                                                         bool verbose = false);
+
+    // VignetteBuilder's lens_gain for the config's lens: from its Lensfun
+    // vignetting calibration at cfg.aperture and cfg.focus_distance, or a
+    // single 1 (no correction) if there is none or the aperture is 0.
+    Halide::Runtime::Buffer<float, 1> vignetting_lut_for(const ProcessConfig& cfg,
+                                                         const std::function<const lfDatabase*()>& get_db,
+                                                         bool verbose = false);
+
+    // lens_warp_source's tca_lut for the config's lens with cfg.lens_tca:
+    // the red and blue scales of its Lensfun TCA calibration at
+    // cfg.focal_length, (TCA_LUT_SIZE, 2), or a single pair of 1s (none)
+    // if it has none.
+    Halide::Runtime::Buffer<float, 2> tca_lut_for(const ProcessConfig& cfg,
+                                                  const std::function<const lfDatabase*()>& get_db,
+                                                  bool verbose = false);
+
+    // The strength to run the CA estimate (CACorrectBuilder) at:
+    // cfg.ca_strength, or 0 where `tca_lut` is a profile, which then
+    // corrects the CA instead.
+    float ca_estimate_strength(const ProcessConfig& cfg, const Halide::Runtime::Buffer<float, 2>& tca_lut);
+
 #ifdef USE_LENSFUN
     // Generates a distortion correction LUT from a lensfun model.
     Halide::Runtime::Buffer<float, 1> generate_distortion_lut(const lfLensCalibDistortion& model);
+
+    enum class LensLookup { Found, CameraNotFound, LensNotFound, NoCalibration, UnsupportedModel };
+
+    struct ResolvedLens {
+        LensLookup status = LensLookup::CameraNotFound;
+        lfLensCalibDistortion model = {};
+        Halide::Runtime::Buffer<float, 1> lut; // Only set when status == Found.
+    };
+
+    // Resolves a camera/lens/focal length to its distortion model and LUT.
+    // Results are memoised for the process and found profiles are recorded in
+    // an on-disk index, so `get_db` (which should load the Lensfun database
+    // on first call) is only invoked for profiles not seen before.
+    const ResolvedLens& resolve_lens(const std::string& camera_make, const std::string& camera_model,
+                                     const std::string& lens_name, float focal_length,
+                                     const std::function<const lfDatabase*()>& get_db);
 #endif
 } // namespace LensCorrection
 
+// The pipeline's demosaic_algorithm_id for a --demosaic name and its
+// denoise_algorithm_id for a --denoise-algorithm name, or -1 if unknown.
+int demosaic_algorithm_id(const std::string& name);
+int denoise_algorithm_id(const std::string& name);
+
+// --- Dirty tracking of host-built inputs ---
+// True if the two configs produce the same tone curve LUT
+// (ToneCurveUtils::generate_pipeline_lut), color grading LUT
+// (color_grading_lut_for), distortion LUT (distortion_lut_for), vignetting
+// LUT (vignetting_lut_for), TCA LUT (tca_lut_for) or color matrix
+// (color_matrix_for). Anything else only feeds the pipelines directly.
+bool tone_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+bool color_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+bool distortion_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+bool vignetting_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+bool tca_lut_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+bool color_matrix_inputs_match(const ProcessConfig& a, const ProcessConfig& b);
+
 // Prepares the 3200K and 7000K color matrices for the Halide pipeline.
 void prepare_color_matrices(const RawImageData& raw_data,
                             Halide::Runtime::Buffer<float, 2>& matrix_3200,
@@ -38,6 +133,77 @@ void get_interpolated_color_matrix(const RawImageData& raw_data,
                                    float color_temp,
                                    Halide::Runtime::Buffer<float, 2>& output_matrix);
 
+// The color matrix and color grading LUT to render `cfg` with. With
+// cfg.input_profile (ColorProfile), its matrices stand in for the raw's and
+// its hue/saturation maps, then cfg.look_lut, are baked into the grading
+// LUT; without them these are get_interpolated_color_matrix and
+// HostColor::generate_color_lut. Throws std::runtime_error if a file can't
+// be read.
+void color_matrix_for(const RawImageData& raw_data, const ProcessConfig& cfg,
+                      Halide::Runtime::Buffer<float, 2>& output_matrix);
+Halide::Runtime::Buffer<float, 4> color_grading_lut_for(const ProcessConfig& cfg);
+
+// Packs the per-CFA-site black levels into the 2x2 buffer the pipeline
+// indexes as (x & 1, y & 1).
+Halide::Runtime::Buffer<int, 2> make_black_level_buffer(const RawImageData& raw_data);
+
+// The buffer camera_pipe_ca_shifts fills for a raw of this size: one shift
+// per 16x16 tile (CAShiftGrid in stage_ca_correct.h), for R and B, vertical
+// and horizontal. With `width` and `height` 0, a single zero tile, which is
+// what the front end is given while CA correction is off.
+Halide::Runtime::Buffer<float, 4> make_ca_shifts_buffer(int width = 0, int height = 0);
+
+// --- Auto exposure and white balance ---
+// What raw_stats' output for a raw (RawStatsBuilder: log2-green bins of its
+// 2x2 blocks, with their R, G, B sums) says it needs. `exposure` is the
+// stops that put the median block at mid grey, held back so the 99th
+// percentile doesn't clip, within +-4. `color_temp` and `tint` are the
+// setting whose gains and colour matrix render the neutral grey: the mean
+// of the unclipped blocks (grey world), or with `white_patch` of the
+// brightest 2% of them; color_temp is 0 if no setting renders it. Not
+// `valid` if the raw has no unclipped blocks. make_raw_stats_buffer() is
+// the buffer raw_stats fills.
+struct AutoSettings {
+    bool valid = false;
+    float exposure = 0.0f;
+    float color_temp = 0.0f;
+    float tint = 0.0f;
+};
+Halide::Runtime::Buffer<float, 2> make_raw_stats_buffer();
+AutoSettings auto_settings(const Halide::Runtime::Buffer<float, 2>& stats, const RawImageData& raw_data,
+                           bool white_patch);
+
+// --- Orientation ---
+// camera_pipe's orientation input renders a width x height upright image
+// in EXIF orientation 1-8; 5-8 swap the output's axes. upright_rect maps
+// an output region [x_begin, x_end) x [y_begin, y_end) to the region of
+// the upright image it shows, in place.
+inline bool orientation_swaps_axes(int orientation) { return orientation >= 5 && orientation <= 8; }
+void upright_rect(int orientation, int width, int height, int& x_begin, int& x_end, int& y_begin, int& y_end);
+
+// --- Masked local adjustments ---
+// camera_pipe's adjust_* inputs (stage_masked_adjust.h) for
+// cfg.adjust_layers over a width x height upright output in `orientation`:
+// each layer's mask rasterized at one cell per 8x8 pixels, its exposure,
+// and per row of 64x64 tiles the columns of the tiles any mask touches,
+// padded with -1. With no layers, one empty cell and no tiles.
+struct LocalAdjustInputs {
+    Halide::Runtime::Buffer<float, 3> masks;
+    Halide::Runtime::Buffer<float, 1> exposure;
+    Halide::Runtime::Buffer<int32_t, 2> tiles;
+    int touched_tiles = 0;
+};
+LocalAdjustInputs make_local_adjust_inputs(const ProcessConfig& cfg, int width, int height, int orientation);
+
+// --- Memoization cache ---
+// The Funcs scheduled with memoize() (tables that depend only on scalar
+// inputs, see pipeline_schedule.h) keep their results across runs in one
+// cache shared by every pipeline in the process, keyed on those inputs.
+constexpr int64_t kMemoizationCacheBytes = 16 << 20;
+void set_memoization_cache_size(int64_t bytes = kMemoizationCacheBytes);
+// Frees every cached result. No pipeline may be running.
+void flush_memoization_cache();
+
 } // namespace PipelineUtils
 
 #endif // PIPELINE_UTILS_H
@@ -11,6 +11,31 @@
 #include <memory>  // for std::shared_ptr
 #include <tuple>   // for std::tuple
 #include <vector>  // for std::vector
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 // To enable Lensfun support, compile with -DUSE_LENSFUN and link against liblensfun.
 #ifdef USE_LENSFUN
@@ -19,32 +44,121 @@
 
 #include "raw_load.h"
 #include "HalideBuffer.h"
+#include "HalideRuntime.h"
 #include "halide_image_io.h"
 #include "halide_malloc_trace.h"
 #include "tone_curve_utils.h"
 #include "process_options.h"
 #include "color_tools.h"
-#include "simple_timer.h"
+#include "instrumentation.h"
+#include "halide_memory.h"
+#include "thread_pool.h"
 #include "pipeline_utils.h" // Use the new shared utility header
+#include "image_encoders.h"
+#include "deep_zoom.h"
+#include "front_cache.h"
+#include "read_ahead.h"
+#include "defect_map.h"
+#include "raw_row_stream.h"
+#include "embedded_preview.h"
 
 // Conditionally include the generated pipeline headers based on the
 // macro defined by CMake.
-#if defined(PIPELINE_PRECISION_F32)
+#if defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_GPU)
+#include "camera_pipe_f32_gpu_lib.h"
+// Same signature as the CPU build; call it through the usual name.
+#define camera_pipe_f32 camera_pipe_f32_gpu
+#elif defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_HALF)
+#include "camera_pipe_f16_lib.h"
+// The f32 pipeline with float16 firebreaks; same signature again.
+#define camera_pipe_f32 camera_pipe_f16
+#elif defined(PIPELINE_PRECISION_F32)
 #include "camera_pipe_f32_lib.h"
+#ifdef PIPELINE_PACKED_RAW
+#include "camera_pipe_f32_raw10_lib.h"
+#include "camera_pipe_f32_raw12_lib.h"
+#endif
+#ifdef PIPELINE_PROFILE
+#include "camera_pipe_f32_profile_lib.h"
+#endif
+#ifdef PIPELINE_TRACE
+#include "camera_pipe_f32_trace_lib.h"
+#endif
+#ifdef PIPELINE_LOW_MEMORY
+#include "camera_pipe_f32_lowmem_lib.h"
+#endif
 #elif defined(PIPELINE_PRECISION_U16)
 #include "camera_pipe_u16_lib.h"
+#ifdef PIPELINE_PROFILE
+#include "camera_pipe_u16_profile_lib.h"
+#endif
+#ifdef PIPELINE_TRACE
+#include "camera_pipe_u16_trace_lib.h"
+#endif
+#ifdef PIPELINE_LOW_MEMORY
+#include "camera_pipe_u16_lowmem_lib.h"
+#endif
 #else
 #error "PIPELINE_PRECISION_F32 or PIPELINE_PRECISION_U16 must be defined"
 #endif
 
-// By default, the auto-scheduled pipeline is not compiled or run.
-#define NO_AUTO_SCHEDULE
-#ifndef NO_AUTO_SCHEDULE
-    #if defined(PIPELINE_PRECISION_F32)
-    #include "camera_pipe_f32_auto_schedule_lib.h"
-    #elif defined(PIPELINE_PRECISION_U16)
-    #include "camera_pipe_u16_auto_schedule_lib.h"
-    #endif
+// Burst alignment and merge, run ahead of the pipeline on --burst-frames.
+#include "burst_merge_lib.h"
+// The raw's exposure and white balance statistics, for --auto-exposure and
+// --auto-wb.
+#include "raw_stats_lib.h"
+// The live view's binned chain, for --thumbnail from the raw.
+#include "camera_pipe_display_argb8888_lib.h"
+
+// camera_pipe_f32 with two reduced outputs, for --outputs (process_f32 only).
+#ifdef PIPELINE_EXPORT_SIZES
+#include "camera_pipe_f32_export_lib.h"
+#endif
+
+// camera_pipe_f32 with a debug tap, for --tap (process_f32 only).
+#ifdef PIPELINE_TAP
+#include "camera_pipe_f32_tap_lib.h"
+#include "debug_taps.h"
+#endif
+
+// The editor's front/back split, built for the CPU with planar output, for
+// --looks and --front-cache (process_f32 only).
+#ifdef PIPELINE_LOOKS
+#include "camera_pipe_look_front_lib.h"
+#include "camera_pipe_look_back_lib.h"
+#include "camera_pipe_look_warp_map_lib.h"
+#include "camera_pipe_look_ca_shifts_lib.h"
+#endif
+
+// camera_pipe_f32 compiled for the camera and recipe at run time, for --jit
+// (process_f32 with BUILD_JIT_PIPELINE).
+#ifdef PIPELINE_JIT
+#include "jit_pipeline.h"
+#endif
+
+// Autoscheduled builds of the same pipeline (BUILD_AUTOSCHEDULED_PIPELINES),
+// selected with --schedule.
+#if defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_GPU)
+#ifdef PIPELINE_AUTO_ANDERSON2021
+#include "camera_pipe_f32_gpu_auto_anderson2021_lib.h"
+#define camera_pipe_f32_auto_anderson2021 camera_pipe_f32_gpu_auto_anderson2021
+#endif
+#elif defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_HALF)
+// No autoscheduled builds of the f16 variant.
+#elif defined(PIPELINE_PRECISION_F32)
+#ifdef PIPELINE_AUTO_ADAMS2019
+#include "camera_pipe_f32_auto_adams2019_lib.h"
+#endif
+#ifdef PIPELINE_AUTO_MULLAPUDI2016
+#include "camera_pipe_f32_auto_mullapudi2016_lib.h"
+#endif
+#elif defined(PIPELINE_PRECISION_U16)
+#ifdef PIPELINE_AUTO_ADAMS2019
+#include "camera_pipe_u16_auto_adams2019_lib.h"
+#endif
+#ifdef PIPELINE_AUTO_MULLAPUDI2016
+#include "camera_pipe_u16_auto_mullapudi2016_lib.h"
+#endif
 #endif
 
 using namespace Halide::Runtime;
@@ -86,225 +200,3486 @@ void print_lut_sample(const Buffer<float, 4>& lut) {
     printf("-----------------------------------------------------------------\n\n");
 }
 
-} // namespace
+// Pipeline inputs that only depend on the config, so a batch builds them once.
+struct SharedInputs {
+    int demosaic_id = 3;
+    int denoise_id = 0;
+    Buffer<float, 1> distortion_lut;
+    Buffer<float, 1> vignetting_lut;
+    Buffer<float, 2> tca_lut;
+    // The CA estimate's strength: cfg.ca_strength, or 0 where tca_lut is
+    // the lens's TCA profile (ca_estimate_strength).
+    float ca_strength = 0.0f;
+    Buffer<uint16_t, 2> tone_curve_lut;
+    Buffer<float, 4> color_grading_lut;
+    Buffer<float, 4> rgb_color_lut;
+};
 
+// Pipeline inputs derived from a particular raw file.
+struct FrameInputs {
+    Buffer<float, 2> color_matrix;
+    PipelineUtils::RGBGains wb_gains;
+    Buffer<int, 2> black_level_cfa;
+    PipelineUtils::LocalAdjustInputs adjust; // --adjust, at the frame's output size
+};
 
-int main(int argc, char **argv) {
-    SimpleTimer total_timer("Total Application Time");
+#ifdef USE_LENSFUN
+const lfDatabase* lensfun_database() {
+    static std::unique_ptr<lfDatabase> ldb;
+    if (!ldb) {
+        Instrumentation::ScopedTimer db_timer("Lensfun Database Load");
+        ldb.reset(new lfDatabase());
+        ldb->Load();
+    }
+    return ldb.get();
+}
+#endif
 
-    if (argc == 1) {
-        print_usage();
-        return 0;
+SharedInputs prepare_shared_inputs(const ProcessConfig& cfg) {
+    SharedInputs shared;
+
+    // Convert string-based algorithm name to the integer ID the Halide pipeline expects
+    shared.demosaic_id = PipelineUtils::demosaic_algorithm_id(cfg.demosaic_algorithm);
+    if (shared.demosaic_id < 0) {
+        std::cerr << "Warning: unknown demosaic algorithm '" << cfg.demosaic_algorithm << "'. Defaulting to fast.\n";
+        shared.demosaic_id = 3;
+    }
+    shared.denoise_id = PipelineUtils::denoise_algorithm_id(cfg.denoise_algorithm);
+    if (shared.denoise_id < 0) {
+        std::cerr << "Warning: unknown denoise algorithm '" << cfg.denoise_algorithm << "'. Defaulting to guided.\n";
+        shared.denoise_id = 0;
     }
 
-    // --- Argument Parsing using the new shared parser ---
-    ProcessConfig cfg;
-    try {
-        cfg = parse_args(argc, argv);
-    } catch (const std::runtime_error& e) {
-        fprintf(stderr, "%s\n", e.what());
-        return 1;
+    {
+        Instrumentation::ScopedTimer lens_timer("Lens Correction LUT Generation");
+        // The database is only loaded if this profile isn't already in the
+        // on-disk lens index, and then kept for later lookups.
+#ifdef USE_LENSFUN
+        shared.distortion_lut = PipelineUtils::LensCorrection::distortion_lut_for(cfg, lensfun_database, true);
+        shared.vignetting_lut = PipelineUtils::LensCorrection::vignetting_lut_for(cfg, lensfun_database, true);
+        shared.tca_lut = PipelineUtils::LensCorrection::tca_lut_for(cfg, lensfun_database, true);
+#else
+        shared.distortion_lut = PipelineUtils::LensCorrection::distortion_lut_for(cfg, nullptr, true);
+        shared.vignetting_lut = PipelineUtils::LensCorrection::vignetting_lut_for(cfg, nullptr, true);
+        shared.tca_lut = PipelineUtils::LensCorrection::tca_lut_for(cfg, nullptr, true);
+#endif
+        shared.ca_strength = PipelineUtils::LensCorrection::ca_estimate_strength(cfg, shared.tca_lut);
+        if (shared.ca_strength != cfg.ca_strength) {
+            fprintf(stderr, "Lateral CA corrected from the lens profile; the CA estimate is skipped.\n");
+        }
     }
 
-    if (cfg.input_path.empty() || cfg.output_path.empty()) {
-        fprintf(stderr, "Error: --input and --output arguments are required for command-line processing.\n\n");
-        print_usage();
-        return 1;
+    {
+        Instrumentation::ScopedTimer lut_timer("Host LUT Generation");
+        shared.tone_curve_lut = ToneCurveUtils::generate_pipeline_lut(cfg);
+        shared.color_grading_lut = PipelineUtils::color_grading_lut_for(cfg);
+        print_lut_sample(shared.color_grading_lut);
+        shared.rgb_color_lut = HostColor::generate_rgb_color_lut(shared.color_grading_lut);
     }
+    return shared;
+}
 
-    // --- Load Input using the new raw_load module ---
-    RawImageData raw_data;
+// Loads one input file at full size, from `file` if it has been read
+// already (ReadAhead). Packed raw containers stay packed when `keep_packed`
+// and this build has the packed pipelines.
+RawImageData load_input_file_full(const ProcessConfig& cfg, const std::string& path, bool keep_packed,
+                                  const RawFileBytes& file) {
+    if (is_raw_container_path(path)) {
+        fprintf(stderr, "input (raw container): %s\n", path.c_str());
+#ifndef PIPELINE_PACKED_RAW
+        keep_packed = false;
+#endif
+        return file.data ? load_raw_container(path, keep_packed, file) : load_raw_container(path, keep_packed);
+    }
     if (cfg.raw_png) {
-        fprintf(stderr, "input (raw png): %s\n", cfg.input_path.c_str());
-        raw_data = load_raw_png(cfg.input_path);
-    } else {
-        fprintf(stderr, "input (rawspeed): %s\n", cfg.input_path.c_str());
-        raw_data = load_raw(cfg.input_path);
+        fprintf(stderr, "input (raw png): %s\n", path.c_str());
+        return load_raw_png(path);
     }
-    
-    Buffer<uint16_t, 2> input = raw_data.bayer_data;
-    int cfa_pattern = raw_data.cfa_pattern;
-    int blackLevel = raw_data.black_level;
-    int whiteLevel = raw_data.white_level;
+    fprintf(stderr, "input (rawspeed): %s (%d decode threads)\n", path.c_str(), get_raw_decode_threads());
+    return load_raw(path, file);
+}
 
-    fprintf(stderr, "       %d %d\n", input.width(), input.height());
+// With --affinity numa, copies the mosaic into fresh memory written in
+// ThreadPool::for_each_node_block bands, so each node's band of rows is in
+// the memory of the node whose strips read it. The decoder wrote it from
+// one thread, on one node.
+void place_rows_by_node(RawImageData& raw) {
+    ThreadPool& pool = ThreadPool::get();
+    if (pool.node_count() < 2 || raw.packing != RawPacking::None) return;
+    const Buffer<uint16_t, 2>& src = raw.bayer_data;
+    Buffer<uint16_t, 2> placed(src.width(), src.height()); // Not touched until the copy.
+    placed.set_min(src.dim(0).min(), src.dim(1).min());
+    pool.for_each_node_block(src.height(), [&](int begin, int end) {
+        for (int y = src.dim(1).min() + begin; y < src.dim(1).min() + end; ++y) {
+            std::copy(&src(src.dim(0).min(), y), &src(src.dim(0).min(), y) + src.width(),
+                      &placed(src.dim(0).min(), y));
+        }
+    });
+    raw.bayer_data = placed;
+    raw.decoded_image.reset();
+    raw.mapped_storage.reset();
+}
 
+// --defect-map's map, read on first use and kept for the run. Batch
+// decoders ask for it from several threads.
+const DefectMap& defect_map(const std::string& path) {
+    static std::mutex mutex;
+    static std::map<std::string, DefectMap> maps;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = maps.find(path);
+    if (it == maps.end()) {
+        it = maps.emplace(path, DefectMap::load(path)).first;
+        fprintf(stderr, "defect map: %s (%zu pixels)\n", path.c_str(), it->second.pixels.size());
+    }
+    return it->second;
+}
 
-    // Convert string-based algorithm name to the integer ID the Halide pipeline expects
-    int demosaic_id = 3; // default to 'fast'
-    if (cfg.demosaic_algorithm == "ahd") demosaic_id = 0;
-    else if (cfg.demosaic_algorithm == "lmmse") demosaic_id = 1;
-    else if (cfg.demosaic_algorithm == "ri") demosaic_id = 2;
-    else if (cfg.demosaic_algorithm != "fast") {
-        std::cerr << "Warning: unknown demosaic algorithm '" << cfg.demosaic_algorithm << "'. Defaulting to fast.\n";
+// Corrects the map's defects in place, in a copy of the mosaic if it's a
+// view of the (read-only) mapped or read-ahead file.
+void correct_defects(RawImageData& raw, const DefectMap& map) {
+    if (map.empty()) return;
+    if (raw.mapped_storage) {
+        raw.bayer_data = raw.bayer_data.copy();
+        raw.mapped_storage.reset();
     }
+    map.correct(raw.bayer_data);
+}
 
-    // Calculate output dimensions based on crop and downscale factor
-    int out_width = static_cast<int>(input.width() / cfg.downscale_factor);
-    int out_height = static_cast<int>(input.height() / cfg.downscale_factor);
+// Loads one input file, with --defect-map's defects corrected, then binned
+// to half size with --half-size. Frames with a defect map are unpacked.
+RawImageData load_input_file(const ProcessConfig& cfg, const std::string& path, bool keep_packed,
+                             const RawFileBytes& file = RawFileBytes()) {
+    if (!cfg.defect_map_path.empty()) keep_packed = false;
+    RawImageData raw = load_input_file_full(cfg, path, keep_packed, file);
+    if (!cfg.defect_map_path.empty()) correct_defects(raw, defect_map(cfg.defect_map_path));
+    if (cfg.half_size && raw.packing != RawPacking::None) {
+        fprintf(stderr, "--half-size: %s stays packed at full size\n", path.c_str());
+    } else if (cfg.half_size) {
+        raw = bin_raw_half(raw);
+    }
+    if (cfg.affinity == "numa") place_rows_by_node(raw);
+    return raw;
+}
 
-    Buffer<float, 1> distortion_lut;
-    {
-        SimpleTimer lens_timer("Lens Correction LUT Generation");
-        distortion_lut = PipelineUtils::LensCorrection::generate_identity_lut();
-#ifdef USE_LENSFUN
-        bool needs_lensfun = !cfg.camera_make.empty() && !cfg.camera_model.empty() &&
-                             cfg.lens_profile_name != "None" && !cfg.lens_profile_name.empty();
-        bool lensfun_applied = false;
-        if (needs_lensfun) {
-            fprintf(stderr, "Attempting to load Lensfun profile...\n");
-            fprintf(stderr, "  Camera: %s %s\n", cfg.camera_make.c_str(), cfg.camera_model.c_str());
-            fprintf(stderr, "  Lens: %s @ %.1fmm\n", cfg.lens_profile_name.c_str(), cfg.focal_length);
-
-            lfDatabase ldb;
-            ldb.Load();
-
-            const lfCamera** cams = lf_db_find_cameras(&ldb, cfg.camera_make.c_str(), cfg.camera_model.c_str());
-            if (!cams || !cams[0]) {
-                fprintf(stderr, "  -> Warning: Camera '%s %s' not found in Lensfun database.\n", cfg.camera_make.c_str(), cfg.camera_model.c_str());
-            } else {
-                const lfCamera *cam = cams[0]; // Use the first match
-                const lfLens** lenses = lf_db_find_lenses_hd(&ldb, cam, nullptr, cfg.lens_profile_name.c_str(), 0);
-                if (!lenses || !lenses[0]) {
-                    fprintf(stderr, "  -> Warning: Lens profile '%s' not found for specified camera.\n", cfg.lens_profile_name.c_str());
-                } else {
-                    const lfLens *lens = lenses[0]; // Use the best match
-                    lfLensCalibDistortion distortion_model;
-                    if (lens->InterpolateDistortion(cfg.focal_length, distortion_model)) {
-                        const char* model_name = "Unknown";
-                        if (distortion_model.Model == LF_DIST_MODEL_POLY3) model_name = "POLY3";
-                        else if (distortion_model.Model == LF_DIST_MODEL_POLY5) model_name = "POLY5";
-                        else if (distortion_model.Model == LF_DIST_MODEL_PTLENS) model_name = "PTLENS";
-
-                        if (distortion_model.Model == LF_DIST_MODEL_POLY3 ||
-                            distortion_model.Model == LF_DIST_MODEL_POLY5 ||
-                            distortion_model.Model == LF_DIST_MODEL_PTLENS) {
-
-                            fprintf(stderr, "  -> Profile loaded (%s). Generating inverse distortion LUT...\n", model_name);
-                            distortion_lut = PipelineUtils::LensCorrection::generate_distortion_lut(distortion_model);
-                            lensfun_applied = true;
-                        } else {
-                            fprintf(stderr, "  -> Warning: Lens profile uses an unsupported distortion model (%s). Distortion not applied.\n", model_name);
-                        }
-                    } else {
-                        fprintf(stderr, "  -> Warning: Could not retrieve distortion params for this focal length.\n");
-                    }
-                }
-                if (lenses) lf_free((void*)lenses);
-            }
-            if (cams) lf_free((void*)cams);
+// The noise of a mosaic in raw units, from the median absolute difference
+// of same-site neighbours two pixels apart: texture only widens the tails,
+// which the median ignores, so this holds on all but very busy frames.
+float estimate_raw_noise(const RawImageData& raw) {
+    const Buffer<uint16_t, 2>& bayer = raw.bayer_data;
+    const int x0 = bayer.dim(0).min(), y0 = bayer.dim(1).min();
+    const int width = bayer.dim(0).extent(), height = bayer.dim(1).extent();
+    // About 64K samples, on a grid spread over the frame.
+    const int step = std::max(1, int(std::sqrt(double(width) * height / 65536.0)));
+    std::vector<float> diffs;
+    diffs.reserve(size_t(width / step + 1) * (height / step + 1));
+    for (int y = 0; y < height; y += step) {
+        for (int x = 0; x + 2 < width; x += step) {
+            diffs.push_back(std::abs(float(bayer(x0 + x, y0 + y)) - float(bayer(x0 + x + 2, y0 + y))));
         }
+    }
+    if (diffs.empty()) return 0.0f;
+    std::nth_element(diffs.begin(), diffs.begin() + diffs.size() / 2, diffs.end());
+    // MAD to sigma for a Gaussian, and the difference of two samples has
+    // sqrt(2) times the noise of one.
+    return diffs[diffs.size() / 2] / 0.6745f / std::sqrt(2.0f);
+}
 
-        if (!lensfun_applied) {
-            const float e = 1e-6f;
-            if (fabsf(cfg.dist_k1) > e || fabsf(cfg.dist_k2) > e || fabsf(cfg.dist_k3) > e) {
-                fprintf(stderr, "Using manual distortion parameters k1, k2, k3...\n");
-                lfLensCalibDistortion manual_model;
-                manual_model.Model = LF_DIST_MODEL_POLY5;
-                manual_model.Terms[0] = cfg.dist_k1;
-                manual_model.Terms[1] = cfg.dist_k2;
-                distortion_lut = PipelineUtils::LensCorrection::generate_distortion_lut(manual_model);
-            }
+// Aligns cfg.burst_paths to `reference` and merges them into it
+// (burst_merge). The result keeps the reference's metadata and is
+// unpacked, whatever the inputs were.
+RawImageData merge_burst(const ProcessConfig& cfg, RawImageData reference) {
+    const int width = reference.width(), height = reference.height();
+    const int count = 1 + int(cfg.burst_paths.size());
+    Buffer<uint16_t, 3> frames(width, height, count);
+    auto add_frame = [&](const RawImageData& raw, int n) {
+        Buffer<uint16_t, 2> samples = raw.bayer_data;
+        samples.set_min(0, 0);
+        frames.sliced(2, n).copy_from(samples);
+    };
+    add_frame(reference, 0);
+    for (int n = 1; n < count; ++n) {
+        const std::string& path = cfg.burst_paths[n - 1];
+        RawImageData raw = load_input_file(cfg, path, false);
+        if (raw.width() != width || raw.height() != height || raw.cfa_pattern != reference.cfa_pattern) {
+            throw std::runtime_error("burst frame " + path + " does not match the size and CFA of the reference");
         }
-#endif
+        add_frame(raw, n);
     }
-    
-    Buffer<uint8_t, 3> output(out_width, out_height, 3);
 
-    Buffer<uint16_t, 2> tone_curve_lut;
-    Buffer<float, 4> color_grading_lut;
+    const float noise = cfg.burst_noise > 0.0f ? cfg.burst_noise : estimate_raw_noise(reference);
+    fprintf(stderr, "Merging a burst of %d frames (noise %.1f, strength %.1f).\n", count, noise, cfg.burst_strength);
+    Buffer<uint16_t, 2> merged(width, height);
+    {
+        Instrumentation::ScopedTimer merge_timer("Burst Merge");
+        if (burst_merge(frames.raw_buffer(), noise, cfg.burst_strength, merged.raw_buffer()) != 0) {
+            throw std::runtime_error("burst merge failed");
+        }
+    }
+
+    reference.bayer_data = merged;
+    reference.packing = RawPacking::None;
+    reference.packed_data = Buffer<uint8_t, 2>();
+    reference.decoded_image.reset();
+    reference.mapped_storage.reset();
+    return reference;
+}
+
+RawImageData load_input(const ProcessConfig& cfg, const std::string& path, const RawFileBytes& file = RawFileBytes()) {
+    if (!cfg.burst_paths.empty()) {
+        return merge_burst(cfg, load_input_file(cfg, path, false, file));
+    }
+    return load_input_file(cfg, path, true, file);
+}
+
+// --auto-exposure and --auto-wb: reduces the raw's statistics (raw_stats)
+// to settings and folds them into `cfg`, ahead of the frame's inputs.
+void apply_auto_settings(ProcessConfig& cfg, const RawImageData& raw_data, bool verbose) {
+    if (!cfg.auto_exposure && cfg.auto_wb.empty()) return;
+    if (!raw_data.bayer_data.data()) {
+        fprintf(stderr, "Warning: --auto-exposure and --auto-wb need an unpacked raw; using the set values.\n");
+        return;
+    }
+    Buffer<uint16_t, 2> input = raw_data.bayer_data;
+    Buffer<int, 2> black_level_cfa = PipelineUtils::make_black_level_buffer(raw_data);
+    Buffer<float, 2> stats = PipelineUtils::make_raw_stats_buffer();
     {
-        SimpleTimer lut_timer("Host LUT Generation");
-        tone_curve_lut = ToneCurveUtils::generate_pipeline_lut(cfg);
-        color_grading_lut = HostColor::generate_color_lut(cfg);
-        print_lut_sample(color_grading_lut);
+        Instrumentation::ScopedTimer stats_timer("Raw Stats");
+        if (raw_stats(input, raw_data.cfa_pattern, raw_data.white_level, black_level_cfa, stats) != 0) {
+            throw std::runtime_error("raw stats failed");
+        }
+    }
+    const PipelineUtils::AutoSettings settings = PipelineUtils::auto_settings(stats, raw_data, cfg.auto_wb == "white");
+    if (!settings.valid) {
+        if (verbose) fprintf(stderr, "Auto settings: the raw is clipped throughout; using the set values.\n");
+        return;
+    }
+    if (cfg.auto_exposure) cfg.exposure += settings.exposure;
+    if (!cfg.auto_wb.empty() && settings.color_temp > 0.0f) {
+        cfg.color_temp = settings.color_temp;
+        cfg.tint = settings.tint;
+    }
+    if (verbose) {
+        fprintf(stderr, "Auto settings: exposure %+.2f stops, %.0fK, tint %+.2f.\n", cfg.exposure, cfg.color_temp,
+                cfg.tint);
     }
-    
+}
+
+// The EXIF orientation the output is rendered in: --orientation, else the
+// raw's.
+int output_orientation(const ProcessConfig& cfg, const RawImageData& raw_data) {
+    return cfg.orientation > 0 ? cfg.orientation : raw_data.orientation;
+}
+
+FrameInputs prepare_frame_inputs(const ProcessConfig& cfg, const RawImageData& raw_data, bool verbose) {
+    FrameInputs frame;
     // Get the final interpolated color matrix for the pipeline.
-    Buffer<float, 2> color_matrix(4, 3);
-    PipelineUtils::get_interpolated_color_matrix(raw_data, cfg.color_temp, color_matrix);
+    frame.color_matrix = Buffer<float, 2>(4, 3);
+    PipelineUtils::color_matrix_for(raw_data, cfg, frame.color_matrix);
+
+    if (verbose) {
+        if (!cfg.input_profile.empty()) {
+            fprintf(stderr, "Using the color matrix from %s for temp %.0fK.\n", cfg.input_profile.c_str(), cfg.color_temp);
+        } else if (raw_data.has_matrix) {
+            fprintf(stderr, "Using interpolated color matrix from RAW file metadata for temp %.0fK.\n", cfg.color_temp);
+        } else {
+            fprintf(stderr, "Using interpolated hardcoded DNG color matrices for temp %.0fK.\n", cfg.color_temp);
+        }
+    }
+
+    frame.wb_gains = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    frame.black_level_cfa = PipelineUtils::make_black_level_buffer(raw_data);
+    frame.adjust = PipelineUtils::make_local_adjust_inputs(cfg, static_cast<int>(raw_data.width() / cfg.downscale_factor),
+                                                           static_cast<int>(raw_data.height() / cfg.downscale_factor),
+                                                           output_orientation(cfg, raw_data));
+    if (verbose && !cfg.adjust_layers.empty()) {
+        fprintf(stderr, "Masked adjustments: %zu layer(s) over %d tile(s).\n", cfg.adjust_layers.size(),
+                frame.adjust.touched_tiles);
+    }
+    return frame;
+}
+
+ImageEncoders::EncodeOptions encode_options(const ProcessConfig& cfg) {
+    using namespace ImageEncoders;
+    EncodeOptions options;
+    options.jpeg_quality = cfg.jpeg_quality;
+    options.jpeg_subsampling = cfg.jpeg_subsampling;
+    if (cfg.jpeg_subsampling != 444 && cfg.jpeg_subsampling != 422 && cfg.jpeg_subsampling != 420) {
+        std::cerr << "Warning: unknown jpeg-subsampling '" << cfg.jpeg_subsampling << "'. Defaulting to 420.\n";
+        options.jpeg_subsampling = 420;
+    }
+    options.png_level = std::max(0, std::min(9, cfg.png_level));
+    if (cfg.png_filter == "none") options.png_filter = PngFilter::None;
+    else if (cfg.png_filter == "sub") options.png_filter = PngFilter::Sub;
+    else if (cfg.png_filter == "up") options.png_filter = PngFilter::Up;
+    else if (cfg.png_filter == "paeth") options.png_filter = PngFilter::Paeth;
+    else if (cfg.png_filter == "adaptive") options.png_filter = PngFilter::Adaptive;
+    else std::cerr << "Warning: unknown png-filter '" << cfg.png_filter << "'. Defaulting to up.\n";
+    options.png_strips = cfg.png_strips;
+    if (cfg.tiff_compression == "lzw") options.tiff_compression = TiffCompression::LZW;
+    else if (cfg.tiff_compression != "none") {
+        std::cerr << "Warning: unknown tiff-compression '" << cfg.tiff_compression << "'. Defaulting to none.\n";
+    }
+    return options;
+}
+
+// Writes the output with our own encoders where the format is one of theirs,
+// else through Halide's generic image IO.
+void save_output(const Buffer<uint8_t, 3>& output, const std::string& path,
+                 const ImageEncoders::EncodeOptions& options) {
+    Instrumentation::ScopedTimer encode_timer("Encode");
+    ImageEncoders::Format format = ImageEncoders::format_for_path(path);
+    if (ImageEncoders::is_supported(format)) {
+        ImageEncoders::save_image(output, path, options);
+    } else {
+        // Halide's writers expect the image to start at the origin; a crop
+        // doesn't.
+        Buffer<uint8_t, 3> image = output;
+        image.set_min(0, 0, 0);
+        convert_and_save_image(image, path);
+    }
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (!ec) Instrumentation::Registry::get().add_bytes("output file bytes", size);
+}
+
+// The part of the output that is rendered, in pixels of the downscaled and
+// oriented frame: the --crop rectangle, clipped to the frame, else all of it.
+struct OutputRegion {
+    int x = 0, y = 0, width = 0, height = 0;
+};
+
+// The region of a downscaled upright frame of `out_width` x `out_height`
+// rendered in `orientation`, and below of a raw's.
+OutputRegion output_region(const ProcessConfig& cfg, int out_width, int out_height, int orientation) {
+    if (PipelineUtils::orientation_swaps_axes(orientation)) std::swap(out_width, out_height);
+    if (cfg.crop_width <= 0 || cfg.crop_height <= 0) return {0, 0, out_width, out_height};
+    OutputRegion r;
+    r.x = std::min(cfg.crop_x, out_width);
+    r.y = std::min(cfg.crop_y, out_height);
+    r.width = std::min(cfg.crop_width, out_width - r.x);
+    r.height = std::min(cfg.crop_height, out_height - r.y);
+    if (r.width <= 0 || r.height <= 0) {
+        throw std::runtime_error("--crop lies outside the " + std::to_string(out_width) + "x" +
+                                 std::to_string(out_height) + " image");
+    }
+    return r;
+}
+
+OutputRegion output_region(const ProcessConfig& cfg, const RawImageData& raw_data) {
+    return output_region(cfg, static_cast<int>(raw_data.width() / cfg.downscale_factor),
+                         static_cast<int>(raw_data.height() / cfg.downscale_factor), output_orientation(cfg, raw_data));
+}
+
+// Output dimensions follow the input and the downscale factor, or the crop.
+// A crop keeps its place in the frame (the buffer's min), which is how the
+// pipeline knows which pixels to render.
+Buffer<uint8_t, 3> make_output(const ProcessConfig& cfg, const RawImageData& raw_data) {
+    const OutputRegion r = output_region(cfg, raw_data);
+    Buffer<uint8_t, 3> output(r.width, r.height, 3);
+    output.set_min(r.x, r.y, 0);
+    return output;
+}
+
+ThreadPool::Cores thread_cores(const ProcessConfig& cfg) {
+    return ThreadPool::cores_named(cfg.affinity);
+}
+
+// The --schedule names this build can run, manual first.
+std::vector<std::string> available_schedules() {
+    std::vector<std::string> schedules = {"manual"};
+#ifdef PIPELINE_AUTO_ADAMS2019
+    schedules.push_back("auto-adams2019");
+#endif
+#ifdef PIPELINE_AUTO_MULLAPUDI2016
+    schedules.push_back("auto-mullapudi2016");
+#endif
+#ifdef PIPELINE_AUTO_ANDERSON2021
+    schedules.push_back("auto-anderson2021");
+#endif
+    return schedules;
+}
+
+const std::string& build_id();
+
+#ifdef PIPELINE_JIT
+// What a --jit build binds for this raw and config: the values that stay
+// the same across a batch from one camera with one recipe. The stages are
+// bound off under the same conditions as their bypasses.
+JitPipeline::Specialization jit_specialization(const ProcessConfig& cfg, const RawImageData& raw_data,
+                                               const SharedInputs& shared) {
+    JitPipeline::Specialization spec;
+    spec.width = raw_data.width();
+    spec.height = raw_data.height();
+    spec.cfa_pattern = raw_data.cfa_pattern;
+    spec.black_level = raw_data.black_level;
+    spec.white_level = raw_data.white_level;
+    spec.demosaic_id = shared.demosaic_id;
+    spec.denoise_id = shared.denoise_id;
+    if (shared.ca_strength < 0.001f) spec.off.push_back("ca");
+    if (cfg.denoise_strength / 100.0f < 0.001f) spec.off.push_back("denoise");
+    if (cfg.dehaze_strength < 0.001f) spec.off.push_back("dehaze");
+    if (cfg.vignette_amount == 0.0f) spec.off.push_back("vignette");
+    return spec;
+}
 
-    if (raw_data.has_matrix) {
-        fprintf(stderr, "Using interpolated color matrix from RAW file metadata for temp %.0fK.\n", cfg.color_temp);
+// The generator params camera_pipe_f32 was built with (PIPELINE_JIT_PARAMS,
+// space-separated), so a --jit build has the same schedule.
+const std::vector<std::string>& jit_schedule_params() {
+    static const std::vector<std::string> params = [] {
+        std::vector<std::string> list;
+        std::istringstream is(PIPELINE_JIT_PARAMS);
+        for (std::string param; is >> param;) list.push_back(param);
+        return list;
+    }();
+    return params;
+}
+#endif
+
+// Reduced outputs of camera_pipe_f32_export (the export_sizes generator param).
+constexpr int kExportSizes = 2;
+
+#ifdef PIPELINE_LOW_MEMORY
+// Rough peak heap of one run writing `output`, for --memory-budget: the raw,
+// the output, the normal schedule's two full-frame float32 RGB firebreaks
+// (none in the low-memory one; CpuTiling::low_memory), and each thread's
+// strip and, for the low-memory schedule, warp chunk. The strip figures sum
+// the storage of the stages each strip keeps. --mem-report measures the real
+// peak; PERF.md has both for common widths.
+int64_t estimate_peak_bytes(const ProcessConfig& cfg, const RawImageData& raw_data,
+                            const Buffer<uint8_t, 3>& output, int warp_row_reach, bool low_memory) {
+    constexpr int64_t kFirebreakBytes = 3 * sizeof(float);
+    constexpr int64_t kStripHaloRows = 32;
+    constexpr int64_t kStripBytes = 160, kLowMemoryStripBytes = 112;
+    constexpr int64_t kStripRows = 32, kLowMemoryStripRows = 16, kLowMemoryChunkRows = 128;
+
+    const int64_t width = output.width(), rows = output.height();
+    const int64_t threads = cfg.threads > 0 ? cfg.threads : std::max(1u, std::thread::hardware_concurrency());
+    int64_t bytes = static_cast<int64_t>(raw_data.width()) * raw_data.height() * sizeof(uint16_t) +
+                    width * rows * output.channels();
+    if (low_memory) {
+        bytes += threads * width * ((kLowMemoryChunkRows + 2 * warp_row_reach) * kFirebreakBytes +
+                                    (kLowMemoryStripRows + kStripHaloRows) * kLowMemoryStripBytes);
     } else {
-        fprintf(stderr, "Using interpolated hardcoded DNG color matrices for temp %.0fK.\n", cfg.color_temp);
+        bytes += width * (2 * rows + 2 * warp_row_reach) * kFirebreakBytes +
+                 threads * width * (kStripRows + kStripHaloRows) * kStripBytes;
     }
-    
-    auto wb_gains = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    return bytes;
+}
+
+// Whether this run goes to the low-memory build: when the normal schedule's
+// estimate is over --memory-budget. Says so the first time.
+bool use_low_memory_schedule(const ProcessConfig& cfg, const RawImageData& raw_data,
+                             const Buffer<uint8_t, 3>& output, int warp_row_reach) {
+    if (cfg.memory_budget_mb <= 0) return false;
+    const int64_t budget = static_cast<int64_t>(cfg.memory_budget_mb) << 20;
+    const int64_t normal = estimate_peak_bytes(cfg, raw_data, output, warp_row_reach, false);
+    if (normal <= budget) return false;
+    static std::once_flag reported;
+    std::call_once(reported, [&] {
+        const int64_t low = estimate_peak_bytes(cfg, raw_data, output, warp_row_reach, true);
+        fprintf(stdout, "Memory budget %d MB: about %lld MB with the normal schedule, %lld MB with the "
+                        "low-memory one; using the low-memory schedule.\n",
+                cfg.memory_budget_mb, static_cast<long long>(normal >> 20), static_cast<long long>(low >> 20));
+        if (low > budget) {
+            fprintf(stdout, "Still over budget; --stream-rows bounds the output buffer too.\n");
+        }
+    });
+    return true;
+}
+#endif
+
+// Runs the pipeline once and waits for it. Returns the Halide error code.
+// `output` may cover just a band of rows of the full output (see
+// render_streamed); only what that band needs is computed. With `reduced`
+// (kExportSizes buffers, --outputs), camera_pipe_f32_export also fills each
+// with the whole output reduced to that buffer's size. With `tap` (--tap),
+// camera_pipe_f32_tap also fills it with cfg.tap's intermediate. With
+// `input_query`, nothing is rendered: Halide's bounds inference sets its
+// shape to the part of the mosaic `output` reads (see render_streamed).
+int run_pipeline(const ProcessConfig& cfg, const RawImageData& raw_data, const SharedInputs& shared,
+                 const FrameInputs& frame, Buffer<uint8_t, 3>& output,
+                 std::vector<Buffer<uint8_t, 3>>* reduced = nullptr, Buffer<float, 3>* tap = nullptr,
+                 Buffer<uint16_t, 2>* input_query = nullptr) {
+    // A buffer with no memory makes the call a bounds query.
+    Buffer<uint16_t, 2> input = input_query ? Buffer<uint16_t, 2>(nullptr, raw_data.width(), raw_data.height())
+                                            : raw_data.bayer_data;
+    int cfa_pattern = raw_data.cfa_pattern;
+    int blackLevel = raw_data.black_level;
+    int whiteLevel = raw_data.white_level;
+    int demosaic_id = shared.demosaic_id;
+    Buffer<float, 1> distortion_lut = shared.distortion_lut;
+    Buffer<float, 1> vignetting_lut = shared.vignetting_lut;
+    Buffer<float, 2> tca_lut = shared.tca_lut;
+    Buffer<uint16_t, 2> tone_curve_lut = shared.tone_curve_lut;
+    Buffer<float, 4> color_grading_lut = shared.color_grading_lut;
+    Buffer<float, 4> rgb_color_lut = shared.rgb_color_lut;
+    Buffer<float, 2> color_matrix = frame.color_matrix;
+    Buffer<int, 2> black_level_cfa = frame.black_level_cfa;
+    const PipelineUtils::RGBGains& wb_gains = frame.wb_gains;
+    Buffer<float, 3> adjust_masks = frame.adjust.masks;
+    Buffer<float, 1> adjust_exposure = frame.adjust.exposure;
+    Buffer<int32_t, 2> adjust_tiles = frame.adjust.tiles;
 
     float denoise_strength_norm = std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f));
     float exposure_multiplier = powf(2.0f, cfg.exposure);
 
-    // --- Halide Pipeline Execution and Benchmarking ---
-    double best_time = std::numeric_limits<double>::infinity();
-    for (int i = 0; i < cfg.timing_iterations; i++) {
-        auto start = std::chrono::high_resolution_clock::now();
+    // The geometry warp's source rows can't be bounded by Halide, so work
+    // out on the host how far from its own row any output row samples, and
+    // for a band or crop of the output which rows and columns it samples.
+    // These are in the upright image, which the orientation remaps.
+    const int out_width = static_cast<int>(raw_data.width() / cfg.downscale_factor);
+    const int out_height = static_cast<int>(raw_data.height() / cfg.downscale_factor);
+    const int orientation = output_orientation(cfg, raw_data);
+    const PipelineUtils::LensCorrection::WarpParams warp = PipelineUtils::LensCorrection::warp_params(cfg);
+    const int warp_row_reach =
+        PipelineUtils::LensCorrection::warp_row_reach(distortion_lut, tca_lut, warp, out_width, out_height);
+    int warp_row_min = 0, warp_row_max = out_height - 1;
+    int warp_col_min = 0, warp_col_max = out_width - 1;
+    int x_begin = output.dim(0).min(), x_end = output.dim(0).max() + 1;
+    int y_begin = output.dim(1).min(), y_end = output.dim(1).max() + 1;
+    PipelineUtils::upright_rect(orientation, out_width, out_height, x_begin, x_end, y_begin, y_end);
+    if (x_begin > 0 || x_end < out_width || y_begin > 0 || y_end < out_height) {
+        PipelineUtils::LensCorrection::warp_source_rect(distortion_lut, tca_lut, warp, out_width, out_height,
+                                                        x_begin, x_end, y_begin, y_end,
+                                                        warp_row_min, warp_row_max, warp_col_min, warp_col_max);
+    }
+
+    // Pooled intermediates are sized for one output; let them go when a
+    // file of another size (or another downscale) comes along. --sequence
+    // runs several pipelines at once, all of one size.
+    static std::mutex pooled_mutex;
+    static std::tuple<int, int, float> pooled_for;
+    const std::tuple<int, int, float> frame_size(raw_data.width(), raw_data.height(), cfg.downscale_factor);
+    {
+        std::lock_guard<std::mutex> lock(pooled_mutex);
+        if (frame_size != pooled_for) {
+            HalideMemory::Pool::get().trim();
+            pooled_for = frame_size;
+        }
+    }
+
+    int result = 0;
+    Instrumentation::ScopedTimer pipeline_timer(input_query ? "Bounds Query" : "Halide Pipeline");
+    if (cfg.mem_report && !input_query) HalideMemory::Tracker::get().begin_run();
         #if defined(PIPELINE_PRECISION_F32)
-            camera_pipe_f32(input, cfa_pattern, cfg.green_balance, cfg.downscale_factor, demosaic_id, 
-                              wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
-                              exposure_multiplier, cfg.ca_strength,
-                              denoise_strength_norm, cfg.denoise_eps,
-                              blackLevel, whiteLevel, tone_curve_lut,
-                              0.f, 0.f, 0.f, /* sharpen */
-                              cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
-                              cfg.ll_debug_level,
-                              color_grading_lut,
-                              cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
-                              cfg.dehaze_strength,
-                              distortion_lut,
-                              cfg.ca_red_cyan, cfg.ca_blue_yellow,
-                              cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
-                              cfg.geo_keystone_v, cfg.geo_keystone_h,
-                              cfg.geo_offset_x, cfg.geo_offset_y,
-                              output);
+            auto camera_pipe = camera_pipe_f32;
+            #ifdef PIPELINE_AUTO_ADAMS2019
+            if (cfg.schedule == "auto-adams2019") camera_pipe = camera_pipe_f32_auto_adams2019;
+            #endif
+            #ifdef PIPELINE_AUTO_MULLAPUDI2016
+            if (cfg.schedule == "auto-mullapudi2016") camera_pipe = camera_pipe_f32_auto_mullapudi2016;
+            #endif
+            #ifdef PIPELINE_AUTO_ANDERSON2021
+            if (cfg.schedule == "auto-anderson2021") camera_pipe = camera_pipe_f32_auto_anderson2021;
+            #endif
+            #ifdef PIPELINE_PROFILE
+            if (cfg.profile) camera_pipe = camera_pipe_f32_profile;
+            #endif
+            #ifdef PIPELINE_TRACE
+            if (!cfg.profile && !cfg.trace_path.empty()) camera_pipe = camera_pipe_f32_trace;
+            #endif
+            #ifdef PIPELINE_LOW_MEMORY
+            if (camera_pipe == camera_pipe_f32 && use_low_memory_schedule(cfg, raw_data, output, warp_row_reach)) {
+                camera_pipe = camera_pipe_f32_lowmem;
+            }
+            #endif
+            #ifdef PIPELINE_JIT
+            if (cfg.jit && camera_pipe == camera_pipe_f32 && raw_data.packing == RawPacking::None) {
+                if (auto jit = JitPipeline::get(jit_specialization(cfg, raw_data, shared), jit_schedule_params(),
+                                                build_id())) {
+                    camera_pipe = jit;
+                }
+            }
+            #endif
+            // Packed frames have their own pipelines, with the same signature.
+            halide_buffer_t* raw_input = input.raw_buffer();
+            #ifdef PIPELINE_PACKED_RAW
+            Buffer<uint8_t, 2> packed_input = raw_data.packed_data;
+            if (raw_data.packing != RawPacking::None) {
+                camera_pipe = raw_data.packing == RawPacking::Csi2Raw10 ? camera_pipe_f32_raw10 : camera_pipe_f32_raw12;
+                raw_input = packed_input.raw_buffer();
+            }
+            #endif
+            auto run = [&](auto pipe, auto&... outputs) {
+                return pipe(raw_input, cfa_pattern, cfg.green_balance, cfg.downscale_factor, demosaic_id,
+                            wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
+                            exposure_multiplier, shared.ca_strength,
+                            denoise_strength_norm, cfg.denoise_eps, shared.denoise_id,
+                            blackLevel, whiteLevel, black_level_cfa, tone_curve_lut,
+                            cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                            cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
+                            cfg.ll_debug_level,
+                            color_grading_lut, rgb_color_lut,
+                            cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
+                            vignetting_lut,
+                            cfg.dehaze_strength,
+                            distortion_lut, tca_lut,
+                            cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                            cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                            cfg.geo_keystone_v, cfg.geo_keystone_h,
+                            cfg.geo_offset_x, cfg.geo_offset_y,
+                            warp_row_min, warp_row_max, warp_row_reach,
+                            warp_col_min, warp_col_max, orientation,
+                            adjust_masks, adjust_exposure, adjust_tiles,
+                            outputs...);
+            };
+            #ifdef PIPELINE_TAP
+            if (tap) {
+                // tap_stage is the tap build's last input, so it goes ahead of the outputs.
+                int tap_stage = static_cast<int>(debug_tap_named(cfg.tap));
+                result = run(camera_pipe_f32_tap, tap_stage, output, *tap);
+            } else
+            #endif
+            #ifdef PIPELINE_EXPORT_SIZES
+            // Takes 16-bit samples; --outputs loads packed frames expanded.
+            if (reduced) result = run(camera_pipe_f32_export, output, (*reduced)[0], (*reduced)[1]);
+            else result = run(camera_pipe, output);
+            #else
+            result = run(camera_pipe, output);
+            #endif
         #elif defined(PIPELINE_PRECISION_U16)
-            camera_pipe_u16(input, cfa_pattern, cfg.green_balance, cfg.downscale_factor, demosaic_id,
+            auto camera_pipe = camera_pipe_u16;
+            #ifdef PIPELINE_AUTO_ADAMS2019
+            if (cfg.schedule == "auto-adams2019") camera_pipe = camera_pipe_u16_auto_adams2019;
+            #endif
+            #ifdef PIPELINE_AUTO_MULLAPUDI2016
+            if (cfg.schedule == "auto-mullapudi2016") camera_pipe = camera_pipe_u16_auto_mullapudi2016;
+            #endif
+            #ifdef PIPELINE_PROFILE
+            if (cfg.profile) camera_pipe = camera_pipe_u16_profile;
+            #endif
+            #ifdef PIPELINE_TRACE
+            if (!cfg.profile && !cfg.trace_path.empty()) camera_pipe = camera_pipe_u16_trace;
+            #endif
+            #ifdef PIPELINE_LOW_MEMORY
+            if (camera_pipe == camera_pipe_u16 && use_low_memory_schedule(cfg, raw_data, output, warp_row_reach)) {
+                camera_pipe = camera_pipe_u16_lowmem;
+            }
+            #endif
+            result = camera_pipe(input, cfa_pattern, cfg.green_balance, cfg.downscale_factor, demosaic_id,
                               wb_gains.r, wb_gains.g, wb_gains.b, color_matrix,
-                              exposure_multiplier, cfg.ca_strength,
-                              denoise_strength_norm, cfg.denoise_eps,
-                              blackLevel, whiteLevel, tone_curve_lut,
-                              0.f, 0.f, 0.f, /* sharpen */
+                              exposure_multiplier, shared.ca_strength,
+                              denoise_strength_norm, cfg.denoise_eps, shared.denoise_id,
+                              blackLevel, whiteLevel, black_level_cfa, tone_curve_lut,
+                              cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
                               cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
                               cfg.ll_debug_level,
-                              color_grading_lut,
+                              color_grading_lut, rgb_color_lut,
                               cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
+                              vignetting_lut,
                               cfg.dehaze_strength,
-                              distortion_lut,
+                              distortion_lut, tca_lut,
                               cfg.ca_red_cyan, cfg.ca_blue_yellow,
                               cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
                               cfg.geo_keystone_v, cfg.geo_keystone_h,
                               cfg.geo_offset_x, cfg.geo_offset_y,
+                              warp_row_min, warp_row_max, warp_row_reach,
+                              warp_col_min, warp_col_max, orientation,
+                              adjust_masks, adjust_exposure, adjust_tiles,
                               output);
         #endif
+    if (input_query) {
+        *input_query = input;
+        return result;
+    }
+    if (cfg.mem_report) {
+        const HalideMemory::RunStats mem = HalideMemory::Tracker::get().end_run();
+        Instrumentation::Registry& registry = Instrumentation::Registry::get();
+        registry.record_peak_bytes("pipeline heap", mem.peak_bytes);
+        registry.add_count("pipeline allocations", static_cast<int64_t>(mem.allocations));
+        registry.add_bytes("pipeline bytes allocated", mem.total_bytes);
+    }
+    if (result == 0) {
         output.device_sync();
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = end - start;
-        if (elapsed.count() < best_time) {
-            best_time = elapsed.count();
+    }
+    return result;
+}
+
+// Rows in a band must cover at least one strip of the output schedule.
+constexpr int kMinStreamRows = 32;
+
+// True if the output can be written band by band (--stream-rows with one of
+// the row-streaming encoders' formats).
+bool can_stream(const ProcessConfig& cfg, const std::string& output_path) {
+    return cfg.stream_rows > 0 && ImageEncoders::is_supported(ImageEncoders::format_for_path(output_path));
+}
+
+// Renders the output in bands of roughly cfg.stream_rows rows and encodes
+// each as it completes. Halide's bounds inference sizes every intermediate
+// for the band plus the halo its consumers need (pyramid levels, filters,
+// the warp footprint from run_pipeline), so peak memory follows the band
+// rather than the frame; the halos are recomputed for each band. Returns the
+// Halide error code and throws std::runtime_error if encoding fails. Sets
+// `bands` to the number of bands rendered. The bands also go to
+// `deep_zoom` if there is one, and `path` may then be empty.
+//
+// With `rows` (--stream-input), raw_data's mosaic is still being read in
+// from the top. Each band asks Halide which rows it reads (a bounds query,
+// which includes every halo) and waits only for those, so the first bands
+// render while the rest of the file is read. Stages that need the whole
+// frame (the dehaze estimate) make the first band wait for all of it.
+int render_streamed(const ProcessConfig& cfg, const RawImageData& raw_data, const SharedInputs& shared,
+                    const FrameInputs& frame, const std::string& path,
+                    const ImageEncoders::EncodeOptions& options, int& bands,
+                    DeepZoomWriter* deep_zoom = nullptr, RawRowStream* rows = nullptr) {
+    const OutputRegion region = output_region(cfg, raw_data);
+    const int out_width = region.width;
+    const int out_height = region.height;
+    // Spread the remainder over the bands rather than leaving a short last
+    // band, so no band falls below kMinStreamRows. A Deep Zoom export
+    // without --stream-rows goes a tile row at a time.
+    const int rows = std::max(kMinStreamRows, cfg.stream_rows > 0 ? cfg.stream_rows : DeepZoomWriter::kTileSize);
+    bands = std::max(1, out_height / rows);
+
+    std::unique_ptr<ImageEncoders::RowStreamWriter> writer;
+    if (!path.empty()) writer = std::make_unique<ImageEncoders::RowStreamWriter>(path, out_width, out_height, 3, options);
+    for (int b = 0; b < bands; ++b) {
+        const int y_begin = static_cast<int>(static_cast<int64_t>(out_height) * b / bands);
+        const int y_end = static_cast<int>(static_cast<int64_t>(out_height) * (b + 1) / bands);
+        Buffer<uint8_t, 3> band(out_width, y_end - y_begin, 3);
+        band.set_min(region.x, region.y + y_begin, 0);
+        if (rows && !rows->done()) {
+            Buffer<uint16_t, 2> needed;
+            int result = run_pipeline(cfg, raw_data, shared, frame, band, nullptr, nullptr, &needed);
+            if (result != 0) return result;
+            Instrumentation::ScopedTimer wait_timer("Wait for Raw Rows");
+            rows->wait_rows(needed.dim(1).max() + 1);
         }
+        int result = run_pipeline(cfg, raw_data, shared, frame, band);
+        if (result != 0) return result;
+        // GPU builds leave the result on the device.
+        band.copy_to_host();
+        Instrumentation::ScopedTimer encode_timer("Encode Rows");
+        if (writer) writer->write_rows(band);
+        if (deep_zoom) deep_zoom->write_rows(band);
     }
+    if (deep_zoom) deep_zoom->finish();
+    if (!writer) return 0;
+    writer->finish();
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (!ec) Instrumentation::Registry::get().add_bytes("output file bytes", size);
+    return 0;
+}
 
-    if (getenv("HL_PROFILE") == nullptr) {
-        #if defined(PIPELINE_PRECISION_F32)
-            fprintf(stdout, "Using float32 pipeline.\n");
-        #elif defined(PIPELINE_PRECISION_U16)
-            fprintf(stdout, "Using uint16_t pipeline.\n");
-        #endif
-        fprintf(stdout, "Halide pipeline execution time: %f ms\n", best_time * 1000.0);
+// --stream-input's reader for the single --input, or nullptr if the input
+// loads whole: it only applies to a raw container rendered band by band
+// with nothing that rewrites the mosaic first. Says why not.
+std::unique_ptr<RawRowStream> open_row_stream(const ProcessConfig& cfg) {
+    if (!cfg.stream_input) return nullptr;
+    const char* why_not = nullptr;
+    if (!is_raw_container_path(cfg.input_path)) {
+        why_not = "RawSpeed decodes a file whole; only raw containers stream";
+    } else if (!cfg.output_path.empty() &&
+               !(ImageEncoders::is_supported(ImageEncoders::format_for_path(cfg.output_path)) &&
+                 (cfg.stream_rows > 0 || !cfg.deep_zoom_path.empty()))) {
+        why_not = "the output isn't rendered in bands (--stream-rows with PNG, JPEG or TIFF)";
+    } else if (!cfg.burst_paths.empty() || !cfg.defect_map_path.empty() || cfg.half_size || cfg.affinity == "numa" ||
+               !cfg.tap.empty()) {
+        why_not = "--burst-frames, --defect-map, --half-size, --affinity numa and --tap need the whole raw";
+    }
+    if (why_not) {
+        fprintf(stderr, "Warning: --stream-input: %s; loading it first.\n", why_not);
+        return nullptr;
+    }
+    fprintf(stderr, "input (raw container, streamed): %s\n", cfg.input_path.c_str());
+    return std::make_unique<RawRowStream>(cfg.input_path);
+}
+
+// --- Split pipeline and front-end cache ---
+
+#ifdef PIPELINE_LOOKS
+// The options camera_pipe_look_front depends on. Looks that agree on them
+// share one front-end render, and they key --front-cache entries. Keys are
+// taken before apply_auto_settings, which needs the decoded raw: its result
+// only depends on the raw (which the cache's file digest covers) and on the
+// values it starts from, so the key carries the auto options instead.
+std::string front_end_key(const ProcessConfig& cfg) {
+    std::ostringstream key;
+    key << cfg.demosaic_algorithm << ' ' << cfg.downscale_factor << ' ' << cfg.exposure << ' '
+        << cfg.color_temp << ' ' << cfg.tint << ' ' << cfg.green_balance << ' ' << cfg.ca_strength << ' '
+        << cfg.raw_png << ' ' << cfg.half_size << ' ' << cfg.defect_map_path << ' '
+        << cfg.denoise_strength << ' ' << cfg.denoise_eps << ' ' << cfg.denoise_algorithm;
+    if (cfg.auto_exposure || !cfg.auto_wb.empty()) {
+        key << " auto=" << cfg.auto_exposure << '/' << cfg.auto_wb;
+    }
+    // The input profile's matrices go into the colour matrix; keyed by its
+    // contents, so editing the file in place isn't served a stale entry.
+    if (!cfg.input_profile.empty()) {
+        key << " profile=" << FrontCache::file_digest(cfg.input_profile);
+    }
+    // A TCA profile replaces the CA estimate, so the lens decides it too.
+    if (cfg.lens_tca && cfg.ca_strength > 0.0f) {
+        key << ' ' << cfg.camera_make << '/' << cfg.camera_model << '/' << cfg.lens_profile_name << '@'
+            << cfg.focal_length;
+    }
+    return key.str();
+}
+
+// Runs camera_pipe_look_front: the raw to linear camera RGB, (x, y, c)
+// planar at the downscaled size. --auto-exposure and --auto-wb are resolved
+// here, from `raw`, as the monolithic paths do before rendering.
+int run_front_end(const ProcessConfig& set_cfg, const RawImageData& raw, const SharedInputs& shared,
+                  Buffer<float, 3>& linear) {
+    ProcessConfig cfg = set_cfg;
+    apply_auto_settings(cfg, raw, false);
+    const FrameInputs frame = prepare_frame_inputs(cfg, raw, false);
+    Buffer<uint16_t, 2> input = raw.bayer_data;
+    Buffer<float, 2> color_matrix = frame.color_matrix;
+    Buffer<int, 2> black_level_cfa = frame.black_level_cfa;
+    // The CA shift field, estimated once per raw; a zero placeholder with CA
+    // correction off.
+    Buffer<float, 4> ca_shifts = PipelineUtils::make_ca_shifts_buffer();
+    if (shared.ca_strength > 0.0f) {
+        ca_shifts = PipelineUtils::make_ca_shifts_buffer(raw.width(), raw.height());
+        Instrumentation::ScopedTimer ca_timer("camera_pipe_look_ca_shifts");
+        int result = camera_pipe_look_ca_shifts(input, raw.cfa_pattern, cfg.green_balance,
+                                                frame.wb_gains.r, frame.wb_gains.g, frame.wb_gains.b,
+                                                raw.white_level, black_level_cfa, ca_shifts);
+        if (result != 0) return result;
+    }
+    linear = Buffer<float, 3>(static_cast<int>(raw.width() / cfg.downscale_factor),
+                              static_cast<int>(raw.height() / cfg.downscale_factor), 3);
+    Instrumentation::ScopedTimer front_timer("camera_pipe_look_front");
+    return camera_pipe_look_front(input, raw.cfa_pattern, cfg.green_balance, cfg.downscale_factor,
+                                  shared.demosaic_id, frame.wb_gains.r, frame.wb_gains.g, frame.wb_gains.b,
+                                  color_matrix, powf(2.0f, cfg.exposure),
+                                  std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f)), cfg.denoise_eps,
+                                  shared.denoise_id, shared.ca_strength, ca_shifts,
+                                  raw.black_level, raw.white_level, black_level_cfa, linear);
+}
+
+// Runs the warp map and camera_pipe_look_back on a front end's output into
+// a (width, height, 3) `output`.
+int run_back_end(const ProcessConfig& cfg, const SharedInputs& shared, Buffer<float, 3> linear,
+                 Buffer<uint8_t, 3>& output) {
+    const int width = linear.width(), height = linear.height();
+    // (x, y, WarpMapBuilder::kPlanes)
+    Buffer<float, 3> warp_map(width, height, 4);
+    int result = camera_pipe_look_warp_map(width, height, shared.distortion_lut, shared.tca_lut,
+                                           cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                           cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                           cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                           cfg.geo_offset_x, cfg.geo_offset_y, warp_map);
+    if (result != 0) return result;
+    Buffer<uint32_t, 2> histogram(256, 4);
+    Instrumentation::ScopedTimer back_timer("camera_pipe_look_back");
+    return camera_pipe_look_back(linear, width, height, shared.tone_curve_lut,
+                                 cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                                 cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights,
+                                 cfg.ll_blacks, cfg.ll_whites, cfg.ll_debug_level,
+                                 shared.color_grading_lut, shared.rgb_color_lut,
+                                 cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness,
+                                 cfg.vignette_highlights, shared.vignetting_lut, cfg.dehaze_strength,
+                                 linear, shared.distortion_lut, shared.tca_lut,
+                                 cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                 cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                 cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                 cfg.geo_offset_x, cfg.geo_offset_y,
+                                 warp_map, output, histogram);
+}
+
+// The --front-cache of the process, or nullptr without one. The first
+// config to ask opens it; server jobs can't move it.
+FrontCache* front_cache(const ProcessConfig& cfg) {
+    if (cfg.front_cache_dir.empty()) return nullptr;
+    static FrontCache cache(cfg.front_cache_dir, static_cast<int64_t>(cfg.front_cache_mb) << 20);
+    return &cache;
+}
+
+// The digest an input's cache entries are keyed by, or "" if it isn't
+// cached: no cache, an unreadable file, or a burst (the merge depends on
+// the other frames too).
+std::string front_cache_digest(const ProcessConfig& cfg, const std::string& input_path,
+                               const RawFileBytes& file = RawFileBytes()) {
+    if (!front_cache(cfg) || !cfg.burst_paths.empty()) return "";
+    return file.data ? FrontCache::file_digest(file.data, file.size) : FrontCache::file_digest(input_path);
+}
+
+// The raw the front end takes: the 16-bit mosaic, so packed containers are
+// expanded.
+RawImageData load_front_end_input(const ProcessConfig& cfg, const std::string& input_path,
+                                  const RawFileBytes& file = RawFileBytes()) {
+    return cfg.burst_paths.empty() ? load_input_file(cfg, input_path, false, file) : load_input(cfg, input_path, file);
+}
+
+// output_orientation for `input_path` without decoding it, for front ends
+// read from --front-cache: raw containers and PNGs have none.
+int input_orientation(const ProcessConfig& cfg, const std::string& input_path) {
+    if (cfg.orientation > 0) return cfg.orientation;
+    if (cfg.raw_png || is_raw_container_path(input_path)) return 1;
+    return load_raw_orientation(input_path);
+}
+
+// Whether the split pipeline renders `cfg` as camera_pipe does. It has no
+// masked adjustments, so --adjust renders take the monolithic pipeline even
+// with --front-cache.
+bool split_renders(const ProcessConfig& cfg) {
+    return cfg.adjust_layers.empty();
+}
+
+// Runs the back end on a front end's output, then turns it to EXIF
+// `orientation` and cuts out --crop on the host. camera_pipe does both as a
+// remap of its output coordinates, after the last stage, so the pixels are
+// the ones it would write; only the crop's saving is lost.
+int run_back_end_oriented(const ProcessConfig& cfg, const SharedInputs& shared, const Buffer<float, 3>& linear,
+                          int orientation, Buffer<uint8_t, 3>& output) {
+    const int width = linear.width(), height = linear.height();
+    const OutputRegion r = output_region(cfg, width, height, orientation);
+    Buffer<uint8_t, 3> upright(width, height, 3);
+    int result = run_back_end(cfg, shared, linear, upright);
+    if (result != 0) return result;
+    if (orientation == 1 && r.width == width && r.height == height) {
+        output = upright;
+        return 0;
+    }
+    output = Buffer<uint8_t, 3>(r.width, r.height, 3);
+    output.set_min(r.x, r.y, 0);
+    for (int y = r.y; y < r.y + r.height; ++y) {
+        for (int x = r.x; x < r.x + r.width; ++x) {
+            int x_begin = x, x_end = x + 1, y_begin = y, y_end = y + 1;
+            PipelineUtils::upright_rect(orientation, width, height, x_begin, x_end, y_begin, y_end);
+            for (int c = 0; c < 3; ++c) output(x, y, c) = upright(x_begin, y_begin, c);
+        }
+    }
+    return 0;
+}
+
+// Renders an input through the split pipeline, taking the front end from
+// --front-cache when it's there and storing it when it isn't, so only the
+// first render of an input and front-end setting decodes it. Renders the
+// split pipeline can't match (split_renders) take the monolithic one.
+// Returns the Halide error code; `hit` says where the front end came from,
+// and `linear_out`, if given, receives the front end's output.
+int render_front_cached(const ProcessConfig& cfg, const std::string& input_path, const SharedInputs& shared,
+                        Buffer<uint8_t, 3>& output, bool& hit, Buffer<float, 3>* linear_out = nullptr) {
+    hit = false;
+    if (!split_renders(cfg)) {
+        const RawImageData raw = load_front_end_input(cfg, input_path);
+        if (linear_out) {
+            int result = run_front_end(cfg, raw, shared, *linear_out);
+            if (result != 0) return result;
+        }
+        ProcessConfig raw_cfg = cfg;
+        apply_auto_settings(raw_cfg, raw, false);
+        const FrameInputs frame = prepare_frame_inputs(raw_cfg, raw, false);
+        output = make_output(raw_cfg, raw);
+        int result = run_pipeline(raw_cfg, raw, shared, frame, output);
+        // GPU builds leave the result on the device.
+        if (result == 0) output.copy_to_host();
+        return result;
+    }
+    FrontCache* cache = front_cache(cfg);
+    const std::string digest = front_cache_digest(cfg, input_path);
+    const std::string key = digest.empty() ? "" : FrontCache::key(digest, front_end_key(cfg));
+    Buffer<float, 3> linear;
+    int orientation;
+    hit = !key.empty() && cache->load(key, linear);
+    if (hit) {
+        orientation = input_orientation(cfg, input_path);
+    } else {
+        const RawImageData raw = load_front_end_input(cfg, input_path);
+        orientation = output_orientation(cfg, raw);
+        int result = run_front_end(cfg, raw, shared, linear);
+        if (result != 0) return result;
+        if (!key.empty()) cache->store(key, linear);
     }
+    if (linear_out) *linear_out = linear;
+    return run_back_end_oriented(cfg, shared, linear, orientation, output);
+}
+#endif
+
+// --- Profiling ---
 
-#ifndef NO_AUTO_SCHEDULE
-    // Auto-schedule benchmarking would go here
+#ifdef PIPELINE_PROFILE
+#if defined(PIPELINE_PRECISION_F32)
+const char* kProfiledPipeline = "camera_pipe_f32_profile";
+#else
+const char* kProfiledPipeline = "camera_pipe_u16_profile";
 #endif
-    
-    {
-        SimpleTimer save_timer("Image Save");
-        fprintf(stderr, "output: %s\n", cfg.output_path.c_str());
-        convert_and_save_image(output, cfg.output_path);
-        fprintf(stderr, "        %d %d\n", output.width(), output.height());
+
+// Prints the profiler's per-Func time, memory peak and thread utilization
+// for the runs since the last halide_profiler_reset(), heaviest first, and
+// writes the same as JSON to `json_path`. Resets the profiler afterwards, so
+// the runtime doesn't print its own report again at exit.
+void report_profile(const std::string& json_path) {
+    halide_profiler_pipeline_stats* stats = halide_profiler_get_pipeline_state(kProfiledPipeline);
+    if (stats == nullptr || stats->runs == 0) {
+        fprintf(stderr, "Warning: no profile was recorded for %s.\n", kProfiledPipeline);
+        return;
+    }
+
+    auto threads = [](uint64_t num, uint64_t den) { return den > 0 ? (double)num / den : 0.0; };
+    const double total_ms = stats->time / 1e6;
+    const double per_run_ms = total_ms / stats->runs;
+
+    std::vector<int> order;
+    for (int i = 0; i < stats->num_funcs; i++) {
+        if (stats->funcs[i].time > 0 || stats->funcs[i].memory_peak > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return stats->funcs[a].time > stats->funcs[b].time; });
+
+    fprintf(stdout, "\nProfile of %s: %d runs, %.3f ms/run, %.2f threads active, peak %.1f MB\n",
+            kProfiledPipeline, stats->runs, per_run_ms,
+            threads(stats->active_threads_numerator, stats->active_threads_denominator),
+            stats->memory_peak / (1024.0 * 1024.0));
+    fprintf(stdout, "  %-40s %10s %7s %8s %10s %8s\n", "Func", "ms/run", "%", "threads", "peak MB", "allocs");
+    for (int i : order) {
+        const halide_profiler_func_stats& f = stats->funcs[i];
+        fprintf(stdout, "  %-40s %10.3f %6.1f%% %8.2f %10.2f %8d\n",
+                f.name, f.time / 1e6 / stats->runs, total_ms > 0 ? 100.0 * f.time / stats->time : 0.0,
+                threads(f.active_threads_numerator, f.active_threads_denominator),
+                f.memory_peak / (1024.0 * 1024.0), f.num_allocs);
+    }
+
+    FILE* json = fopen(json_path.c_str(), "w");
+    if (json == nullptr) {
+        fprintf(stderr, "Warning: could not write profile to %s\n", json_path.c_str());
+    } else {
+        fprintf(json, "{\n  \"pipeline\": \"%s\",\n  \"runs\": %d,\n  \"ms_per_run\": %.4f,\n"
+                      "  \"threads\": %.3f,\n  \"memory_peak_bytes\": %llu,\n  \"funcs\": [\n",
+                kProfiledPipeline, stats->runs, per_run_ms,
+                threads(stats->active_threads_numerator, stats->active_threads_denominator),
+                (unsigned long long)stats->memory_peak);
+        for (size_t k = 0; k < order.size(); k++) {
+            const halide_profiler_func_stats& f = stats->funcs[order[k]];
+            fprintf(json, "    {\"name\": \"%s\", \"ms_per_run\": %.4f, \"threads\": %.3f, "
+                          "\"memory_peak_bytes\": %llu, \"stack_peak_bytes\": %llu, \"allocs\": %d}%s\n",
+                    f.name, f.time / 1e6 / stats->runs,
+                    threads(f.active_threads_numerator, f.active_threads_denominator),
+                    (unsigned long long)f.memory_peak, (unsigned long long)f.stack_peak, f.num_allocs,
+                    k + 1 < order.size() ? "," : "");
+        }
+        fprintf(json, "  ]\n}\n");
+        fclose(json);
+        fprintf(stderr, "profile: %s\n", json_path.c_str());
+    }
+    halide_profiler_reset();
+}
+#endif
+
+// Prints the heap use of the pipeline runs so far (--mem-report): the
+// worst run's peak and allocation count, and - when the profiled pipeline
+// ran - the Funcs with the largest peaks, which is where an over-large
+// root-level intermediate shows up. Call before report_profile, which
+// resets the profiler.
+void report_memory(const ProcessConfig& cfg) {
+    if (!cfg.mem_report) return;
+    const HalideMemory::Tracker& tracker = HalideMemory::Tracker::get();
+    if (tracker.runs() == 0) return;
+    const HalideMemory::RunStats worst = tracker.worst_run();
+    const double mb = 1024.0 * 1024.0;
+    fprintf(stdout, "\nPipeline heap over %llu runs: peak %.1f MB, up to %llu allocations, largest %.1f MB\n",
+            (unsigned long long)tracker.runs(), worst.peak_bytes / mb, (unsigned long long)worst.allocations,
+            worst.largest_bytes / mb);
+#ifdef PIPELINE_PROFILE
+    halide_profiler_pipeline_stats* stats = cfg.profile ? halide_profiler_get_pipeline_state(kProfiledPipeline) : nullptr;
+    if (stats == nullptr || stats->runs == 0) return;
+    std::vector<int> order;
+    for (int i = 0; i < stats->num_funcs; i++) {
+        if (stats->funcs[i].memory_peak > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return stats->funcs[a].memory_peak > stats->funcs[b].memory_peak; });
+    fprintf(stdout, "  %-40s %10s %10s %8s\n", "Func", "peak MB", "total MB", "allocs");
+    for (size_t k = 0; k < order.size() && k < 12; k++) {
+        const halide_profiler_func_stats& f = stats->funcs[order[k]];
+        fprintf(stdout, "  %-40s %10.2f %10.2f %8d\n", f.name, f.memory_peak / mb,
+                f.memory_total / mb / stats->runs, f.num_allocs / stats->runs);
+    }
+#endif
+}
+
+// --- Batch mode ---
+
+// A bounded FIFO between batch stages. push() blocks while the queue is
+// full; pop() blocks while it is empty and returns false once the queue has
+// been closed and drained.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
     }
 
-    std::string curve_png_path = cfg.output_path.substr(0, cfg.output_path.find_last_of('.')) + "_curve.png";
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return !items_.empty() || closed_; });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_, not_empty_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+};
+
+struct BatchJob {
+    size_t index = 0;
+    std::string input_path;
+    std::string output_path;
+    RawImageData raw;
+    // With --front-cache: the front end's output, read from the cache in
+    // place of `raw`, or rendered and then stored by the encode worker, and
+    // the orientation it's rendered in.
+    Buffer<float, 3> linear;
+    int orientation = 1;
+    std::string cache_key;
+    bool store_front = false;
+    Buffer<uint8_t, 3> output;
+    std::string error;
+    bool saved = false; // Already written by a streamed render.
+    double decode_ms = 0, process_ms = 0, encode_ms = 0;
+};
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// --batch and --sequence take either a directory (every raw file in it,
+// sorted by name) or a text file with one input path per line.
+std::vector<std::string> collect_inputs(const ProcessConfig& cfg, const std::string& path) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> inputs;
+    if (fs::is_directory(path)) {
+        static const std::set<std::string> raw_exts = {
+            ".dng", ".arw", ".nef", ".nrw", ".cr2", ".cr3", ".crw", ".raf", ".orf",
+            ".rw2", ".pef", ".srw", ".3fr", ".iiq", ".erf", ".mef", ".mos", ".kdc", ".dcr"};
+        for (const auto& entry : fs::directory_iterator(path)) {
+            if (!entry.is_regular_file()) continue;
+            std::string ext = lowercase(entry.path().extension().string());
+            if (cfg.raw_png ? ext == ".png" : raw_exts.count(ext) > 0 || is_raw_container_path(entry.path().string())) {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    } else {
+        std::ifstream list(path);
+        if (!list) throw std::runtime_error("Cannot open input list: " + path);
+        std::string line;
+        while (std::getline(list, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            inputs.push_back(line);
+        }
+    }
+    return inputs;
+}
+
+// The reader that keeps --batch and --sequence inputs in memory ahead of
+// their decode; none with --read-ahead 0, or for PNG mosaics, which the
+// image loader reads from their paths.
+std::unique_ptr<ReadAhead> make_read_ahead(const ProcessConfig& cfg, const std::vector<std::string>& inputs) {
+    if (cfg.read_ahead_files <= 0 || cfg.raw_png || inputs.size() < 2) return nullptr;
+    auto reader = std::make_unique<ReadAhead>(inputs, cfg.read_ahead_files,
+                                              static_cast<size_t>(std::max(1, cfg.read_ahead_mb)) << 20);
+    fprintf(stderr, "read-ahead: %d files, up to %d MB (%s)\n", cfg.read_ahead_files, std::max(1, cfg.read_ahead_mb),
+            reader->backend());
+    return reader;
+}
+
+// "{name}" in the output template is replaced by the input's file stem. A
+// template without it is treated as a directory for <stem>.png files.
+std::string batch_output_path(const std::string& output_template, const std::string& input_path) {
+    std::string stem = std::filesystem::path(input_path).stem().string();
+    size_t pos = output_template.find("{name}");
+    if (pos != std::string::npos) {
+        return output_template.substr(0, pos) + stem + output_template.substr(pos + 6);
+    }
+    return (std::filesystem::path(output_template) / (stem + ".png")).string();
+}
+
+// --- Incremental batch ---
+
+// Identifies the build: a digest of the running executable, which has the
+// pipelines linked in, so any rebuild that could change a render changes
+// it.
+const std::string& build_id() {
+    static const std::string id = [] {
+        std::string digest;
+#ifdef __linux__
+        digest = FrontCache::file_digest("/proc/self/exe");
+#endif
+        return digest.empty() ? std::string(__DATE__ " " __TIME__) : digest;
+    }();
+    return id;
+}
+
+// An input's size and modification time, or "" if it can't be stat'ed.
+std::string input_stamp(const std::string& path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) return "";
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return "";
+    return std::to_string(size) + ":" + std::to_string(mtime.time_since_epoch().count());
+}
+
+// The --batch-manifest file: one "<key>\t<output path>" line per output
+// written, the key being the input's stamp and a hash of the settings and
+// build that rendered it. Entries are appended as outputs are saved, so an
+// interrupted run keeps what it finished; the last entry for an output
+// wins, and compact() rewrites the file with one line each.
+class BatchManifest {
+public:
+    explicit BatchManifest(const std::string& path) : path_(path) {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            const size_t tab = line.find('\t');
+            if (tab != std::string::npos) entries_[line.substr(tab + 1)] = line.substr(0, tab);
+        }
+    }
+
+    // The job key of an input under settings_hash(), "" if it has none.
+    static std::string job_key(const std::string& input_path, const std::string& settings_hash) {
+        const std::string stamp = input_stamp(input_path);
+        return stamp.empty() ? "" : stamp + ":" + settings_hash;
+    }
+
+    static std::string settings_hash(const ProcessConfig& cfg) {
+        std::ostringstream hex;
+        hex << std::hex << std::hash<std::string>()(render_settings(cfg) + build_id());
+        return hex.str();
+    }
+
+    // True if `output_path` was last written for `key` and is still there.
+    bool is_current(const std::string& output_path, const std::string& key) const {
+        auto it = entries_.find(output_path);
+        std::error_code ec;
+        return !key.empty() && it != entries_.end() && it->second == key &&
+               std::filesystem::is_regular_file(output_path, ec);
+    }
+
+    // Safe to call from several threads.
+    void record(const std::string& output_path, const std::string& key) {
+        if (key.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[output_path] = key;
+        if (!log_.is_open()) log_.open(path_, std::ios::app);
+        log_ << key << '\t' << output_path << '\n' << std::flush;
+    }
+
+    void compact() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        log_.close();
+        const std::string temp = path_ + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            for (const auto& [output, key] : entries_) out << key << '\t' << output << '\n';
+            if (!out.flush()) {
+                fprintf(stderr, "Warning: could not rewrite batch manifest %s\n", path_.c_str());
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp, path_, ec);
+    }
+
+private:
+    std::string path_;
+    std::map<std::string, std::string> entries_; // Output path -> key.
+    std::mutex mutex_;
+    std::ofstream log_;
+};
+
+// Decode, Halide and encode run as three stages joined by bounded queues:
+// a pool of decode workers, the pipeline on this thread, and a pool of
+// encode workers. Config-only inputs (LUTs, lens profile) are built once.
+// With --batch-manifest, inputs whose outputs are current are dropped before
+// anything is scheduled.
+int run_batch(const ProcessConfig& cfg) {
+    std::vector<std::string> inputs;
+    try {
+        inputs = collect_inputs(cfg, cfg.batch_path);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "Error: no input files found for --batch %s\n", cfg.batch_path.c_str());
+        return 1;
+    }
+    if (cfg.output_path.find("{name}") == std::string::npos) {
+        std::filesystem::create_directories(cfg.output_path);
+    }
+
+    std::unique_ptr<BatchManifest> manifest;
+    std::vector<std::string> job_keys; // Parallel to inputs.
+    if (!cfg.batch_manifest_path.empty()) {
+        manifest = std::make_unique<BatchManifest>(cfg.batch_manifest_path);
+        const std::string settings = BatchManifest::settings_hash(cfg);
+        std::vector<std::string> changed;
+        for (const std::string& input : inputs) {
+            std::string key = BatchManifest::job_key(input, settings);
+            if (manifest->is_current(batch_output_path(cfg.output_path, input), key)) continue;
+            changed.push_back(input);
+            job_keys.push_back(std::move(key));
+        }
+        fprintf(stderr, "batch: %zu of %zu files unchanged since %s, skipped\n", inputs.size() - changed.size(),
+                inputs.size(), cfg.batch_manifest_path.c_str());
+        inputs = std::move(changed);
+        if (inputs.empty()) {
+            fprintf(stdout, "Batch: nothing to do.\n");
+            return 0;
+        }
+    }
+
+    // Split the cores so the stages don't oversubscribe them: each decoder
+    // gets a slice for RawSpeed, each encoder one core, Halide the rest.
+    const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int decoders = std::max(1, cfg.batch_decode_workers);
+    const int encoders = std::max(1, cfg.batch_encode_workers);
+    const int threads_per_decode = cfg.decode_threads > 0 ? cfg.decode_threads : std::max(1, cores / (4 * decoders));
+    const int halide_threads = cfg.threads > 0 ? cfg.threads
+                                               : std::max(1, cores - decoders * threads_per_decode - encoders);
+    set_raw_decode_threads(threads_per_decode);
+    ThreadPool::get().configure_halide(halide_threads, cfg.thread_pool, thread_cores(cfg));
+    fprintf(stderr, "batch: %zu files, %d decoder(s) x %d thread(s), %d Halide thread(s)%s, %d encoder(s)\n",
+            inputs.size(), decoders, threads_per_decode, halide_threads, cfg.thread_pool ? " (shared pool)" : "",
+            encoders);
+
+    const SharedInputs shared = prepare_shared_inputs(cfg);
+    // The decoders take the files in the order they're handed out, which is
+    // the order they're read in.
+    const std::unique_ptr<ReadAhead> read_ahead = make_read_ahead(cfg, inputs);
+    // The encoders already have their own cores; don't split PNGs further
+    // unless asked to.
+    ImageEncoders::EncodeOptions batch_encode = encode_options(cfg);
+    if (cfg.png_strips == 0) batch_encode.png_strips = 1;
+
+    using JobPtr = std::unique_ptr<BatchJob>;
+    BoundedQueue<JobPtr> decoded(decoders + 1);
+    BoundedQueue<JobPtr> processed(encoders + 1);
+    std::atomic<size_t> next_input{0};
+    std::atomic<int> failures{0};
+    std::mutex report_mutex;
+    auto batch_start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> decode_workers;
+    for (int i = 0; i < decoders; ++i) {
+        decode_workers.emplace_back([&] {
+            for (size_t n; (n = next_input++) < inputs.size();) {
+                auto job = std::make_unique<BatchJob>();
+                job->index = n;
+                job->input_path = inputs[n];
+                job->output_path = batch_output_path(cfg.output_path, inputs[n]);
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    const RawFileBytes file = read_ahead ? read_ahead->take(n) : RawFileBytes();
+#ifdef PIPELINE_LOOKS
+                    if (front_cache(cfg) && split_renders(cfg)) {
+                        const std::string digest = front_cache_digest(cfg, job->input_path, file);
+                        if (!digest.empty()) job->cache_key = FrontCache::key(digest, front_end_key(cfg));
+                        if (job->cache_key.empty() || !front_cache(cfg)->load(job->cache_key, job->linear)) {
+                            job->raw = load_front_end_input(cfg, job->input_path, file);
+                            job->orientation = output_orientation(cfg, job->raw);
+                        } else {
+                            job->orientation = input_orientation(cfg, job->input_path);
+                        }
+                    } else {
+                        job->raw = load_input(cfg, job->input_path, file);
+                    }
+#else
+                    job->raw = load_input(cfg, job->input_path, file);
+#endif
+                } catch (const std::exception& e) {
+                    job->error = e.what();
+                }
+                job->decode_ms = ms_since(start);
+                decoded.push(std::move(job));
+            }
+        });
+    }
+
+    std::vector<std::thread> encode_workers;
+    for (int i = 0; i < encoders; ++i) {
+        encode_workers.emplace_back([&] {
+            JobPtr job;
+            while (processed.pop(job)) {
+                if (job->error.empty() && !job->saved) {
+                    auto start = std::chrono::steady_clock::now();
+                    try {
+                        save_output(job->output, job->output_path, batch_encode);
+                    } catch (const std::exception& e) {
+                        job->error = e.what();
+                    }
+                    job->encode_ms = ms_since(start);
+                }
+#ifdef PIPELINE_LOOKS
+                if (job->error.empty() && job->store_front) front_cache(cfg)->store(job->cache_key, job->linear);
+                job->linear = Buffer<float, 3>();
+#endif
+                if (manifest && job->error.empty()) manifest->record(job->output_path, job_keys[job->index]);
+                std::lock_guard<std::mutex> lock(report_mutex);
+                if (job->error.empty()) {
+                    fprintf(stderr, "[%zu/%zu] %s -> %s: decode %.1f ms, pipeline %.1f ms, save %.1f ms\n",
+                            job->index + 1, inputs.size(), job->input_path.c_str(), job->output_path.c_str(),
+                            job->decode_ms, job->process_ms, job->encode_ms);
+                } else {
+                    failures++;
+                    fprintf(stderr, "[%zu/%zu] %s: FAILED: %s\n",
+                            job->index + 1, inputs.size(), job->input_path.c_str(), job->error.c_str());
+                }
+            }
+        });
+    }
+
+    // The Halide stage. Frames arrive in decode-completion order.
+    double total_pipeline_ms = 0;
+    std::thread closer([&] {
+        for (auto& t : decode_workers) t.join();
+        decoded.close();
+    });
+    JobPtr job;
+    while (decoded.pop(job)) {
+        if (job->error.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            int result = 0;
+#ifdef PIPELINE_LOOKS
+            if (front_cache(cfg) && split_renders(cfg)) {
+                // Through the split pipeline, skipping the front end on a
+                // cache hit. The store is left to the encode workers.
+                if (!job->linear.data()) {
+                    result = run_front_end(cfg, job->raw, shared, job->linear);
+                    job->store_front = result == 0 && !job->cache_key.empty();
+                }
+                if (result == 0) {
+                    try {
+                        result = run_back_end_oriented(cfg, shared, job->linear, job->orientation, job->output);
+                    } catch (const std::exception& e) {
+                        job->error = e.what();
+                    }
+                }
+            } else
+#endif
+            if (can_stream(cfg, job->output_path)) {
+                // Streamed frames are encoded here, band by band, so they
+                // never exist whole for the encode workers.
+                int bands = 0;
+                try {
+                    ProcessConfig job_cfg = cfg;
+                    apply_auto_settings(job_cfg, job->raw, false);
+                    FrameInputs frame = prepare_frame_inputs(job_cfg, job->raw, false);
+                    result = render_streamed(job_cfg, job->raw, shared, frame, job->output_path, batch_encode, bands);
+                    job->saved = result == 0;
+                } catch (const std::exception& e) {
+                    job->error = e.what();
+                }
+            } else {
+                ProcessConfig job_cfg = cfg;
+                apply_auto_settings(job_cfg, job->raw, false);
+                FrameInputs frame = prepare_frame_inputs(job_cfg, job->raw, false);
+                job->output = make_output(job_cfg, job->raw);
+                result = run_pipeline(job_cfg, job->raw, shared, frame, job->output);
+                // GPU builds leave the result on the device.
+                if (result == 0) job->output.copy_to_host();
+            }
+            if (result != 0) {
+                job->error = "Halide pipeline failed with error " + std::to_string(result);
+            }
+            job->process_ms = ms_since(start);
+            total_pipeline_ms += job->process_ms;
+        }
+        // The raw is no longer needed; release it before the encode.
+        job->raw = RawImageData();
+        processed.push(std::move(job));
+    }
+    closer.join();
+    processed.close();
+    for (auto& t : encode_workers) t.join();
+    if (manifest) manifest->compact();
+
+    double total_ms = ms_since(batch_start);
+    size_t succeeded = inputs.size() - static_cast<size_t>(failures.load());
+    fprintf(stdout, "Batch: %zu of %zu files in %.2f s (%.1f ms/file wall, %.1f ms/file pipeline).\n",
+            succeeded, inputs.size(), total_ms / 1000.0, total_ms / inputs.size(),
+            succeeded ? total_pipeline_ms / succeeded : 0.0);
+#ifdef PIPELINE_LOOKS
+    if (FrontCache* cache = front_cache(cfg)) {
+        fprintf(stdout, "Front-end cache: %d hit(s), %d miss(es).\n", cache->hits(), cache->misses());
+    }
+#endif
+    report_memory(cfg);
+    return failures == 0 ? 0 : 1;
+}
+
+// --- Thumbnails ---
+
+// `image` (its first three channels, in any layout) averaged down to fit
+// `size` pixels on its long edge, and turned from the stored orientation to
+// EXIF `orientation` as camera_pipe turns its output. Interleaved RGB.
+Buffer<uint8_t, 3> fit_thumbnail(const Buffer<uint8_t, 3>& image, int size, int orientation) {
+    const int width = image.width(), height = image.height();
+    const int x_min = image.dim(0).min(), y_min = image.dim(1).min();
+    const float scale = std::max(1.0f, float(std::max(width, height)) / size);
+    const int fit_width = std::max(1, int(std::lround(width / scale)));
+    const int fit_height = std::max(1, int(std::lround(height / scale)));
+    const bool swap = PipelineUtils::orientation_swaps_axes(orientation);
+    Buffer<uint8_t, 3> out = Buffer<uint8_t, 3>::make_interleaved(swap ? fit_height : fit_width,
+                                                                  swap ? fit_width : fit_height, 3);
+    for (int y = 0; y < out.height(); ++y) {
+        for (int x = 0; x < out.width(); ++x) {
+            // The fitted pixel this one shows, and the box of image pixels
+            // that pixel covers.
+            int x_begin = x, x_end = x + 1, y_begin = y, y_end = y + 1;
+            PipelineUtils::upright_rect(orientation, fit_width, fit_height, x_begin, x_end, y_begin, y_end);
+            const int sx0 = x_begin * width / fit_width, sx1 = std::max(sx0 + 1, x_end * width / fit_width);
+            const int sy0 = y_begin * height / fit_height, sy1 = std::max(sy0 + 1, y_end * height / fit_height);
+            const int count = (sx1 - sx0) * (sy1 - sy0);
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int sy = sy0; sy < sy1; ++sy) {
+                    for (int sx = sx0; sx < sx1; ++sx) sum += image(x_min + sx, y_min + sy, c);
+                }
+                out(x, y, c) = static_cast<uint8_t>((sum + count / 2) / count);
+            }
+        }
+    }
+    return out;
+}
+
+// --thumbnail: writes the input's thumbnail to cfg.output_path. The
+// embedded JPEG is taken when it is at least cfg.thumbnail long, as it only
+// needs decoding (scaled down in the decoder) and averaging down. Otherwise
+// the raw is binned straight to the thumbnail's size through
+// camera_pipe_display_argb8888, the live view's chain: white balance, color
+// matrix, the look's color LUT and the tone curve, without denoise, local
+// contrast or lens geometry. `shared` may be null, and is then built only
+// if the raw is rendered. Returns the Halide error code, 0 on success.
+int run_thumbnail(ProcessConfig cfg, const SharedInputs* shared) {
+    const auto start = std::chrono::steady_clock::now();
+    Buffer<uint8_t, 3> thumbnail;
+    const char* source = "embedded JPEG";
+    {
+        Instrumentation::ScopedTimer thumbnail_timer("Thumbnail");
+        Buffer<uint8_t, 3> preview;
+        int orientation = 1;
+        if (!cfg.raw_png && !is_raw_container_path(cfg.input_path) &&
+            load_embedded_preview(cfg.input_path, cfg.thumbnail, preview, &orientation) &&
+            std::max(preview.width(), preview.height()) >= cfg.thumbnail) {
+            thumbnail = fit_thumbnail(preview, cfg.thumbnail, cfg.orientation > 0 ? cfg.orientation : orientation);
+        } else {
+            source = "raw";
+            const RawImageData raw = load_input_file(cfg, cfg.input_path, false);
+            apply_auto_settings(cfg, raw, false);
+            std::unique_ptr<SharedInputs> built;
+            if (!shared) {
+                built = std::make_unique<SharedInputs>(prepare_shared_inputs(cfg));
+                shared = built.get();
+            }
+            Buffer<float, 2> color_matrix(4, 3);
+            PipelineUtils::color_matrix_for(raw, cfg, color_matrix);
+            const PipelineUtils::RGBGains wb = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+            // The pipeline bins by 2 or more; smaller raws give a smaller
+            // thumbnail.
+            const float factor = std::max(2.0f, float(std::max(raw.width(), raw.height())) / cfg.thumbnail);
+            const int width = std::max(1, int(raw.width() / factor));
+            const int height = std::max(1, int(raw.height() / factor));
+            Buffer<uint32_t, 2> pixels(width, height);
+            Buffer<uint16_t, 2> input = raw.bayer_data;
+            const int result = camera_pipe_display_argb8888(
+                input, raw.cfa_pattern, cfg.green_balance, factor, wb.r, wb.g, wb.b, color_matrix,
+                powf(2.0f, cfg.exposure), raw.black_level, raw.white_level, PipelineUtils::make_black_level_buffer(raw),
+                shared->tone_curve_lut, shared->rgb_color_lut, pixels);
+            if (result != 0) return result;
+            // The pixels are B, G, R, A bytes: R, G, B is the first three
+            // channels counted back from byte 2.
+            halide_dimension_t dims[3] = {{0, width, 4}, {0, height, width * 4}, {0, 3, -1}};
+            const Buffer<uint8_t, 3> rgb(reinterpret_cast<uint8_t*>(pixels.data()) + 2, 3, dims);
+            thumbnail = fit_thumbnail(rgb, cfg.thumbnail, output_orientation(cfg, raw));
+        }
+    }
+    save_output(thumbnail, cfg.output_path, encode_options(cfg));
+    fprintf(stderr, "thumbnail: %s -> %s, %dx%d from the %s in %.1f ms\n", cfg.input_path.c_str(),
+            cfg.output_path.c_str(), thumbnail.width(), thumbnail.height(), source, ms_since(start));
+    return 0;
+}
+
+// --- Defect calibration ---
+
+// --calibrate-defects: finds the pixels that stand out in every dark frame
+// (DefectMap::detect) and writes them to --output, for --defect-map.
+int run_calibrate_defects(const ProcessConfig& cfg) {
+    std::vector<std::string> inputs = collect_inputs(cfg, cfg.calibrate_defects_path);
+    if (inputs.empty()) {
+        fprintf(stderr, "Error: no dark frames in %s\n", cfg.calibrate_defects_path.c_str());
+        return 1;
+    }
+    try {
+        std::vector<Buffer<uint16_t, 2>> frames;
+        for (const std::string& path : inputs) {
+            RawImageData raw = load_input_file_full(cfg, path, false, RawFileBytes());
+            frames.push_back(raw.bayer_data.copy());
+        }
+        Instrumentation::ScopedTimer detect_timer("Defect Detection");
+        DefectMap map = DefectMap::detect(frames);
+        map.save(cfg.output_path);
+        fprintf(stderr, "%zu defects in %d dark frames of %dx%d: %s\n", map.pixels.size(), int(frames.size()),
+                map.width, map.height, cfg.output_path.c_str());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+// --- Sequence mode ---
+
+// A frame's mean level in stops (log2 of the black-subtracted mean over
+// white), from 2x2 blocks on a grid of about 64K spread over the frame.
+// Deflicker only needs differences between frames, so the CFA's colour
+// mix doesn't matter as long as it is the same for all of them.
+float frame_log_level(const RawImageData& raw) {
+    const Buffer<uint16_t, 2>& bayer = raw.bayer_data;
+    const int x0 = bayer.dim(0).min(), y0 = bayer.dim(1).min();
+    const int width = bayer.dim(0).extent() & ~1, height = bayer.dim(1).extent() & ~1;
+    const int step = std::max(2, int(std::sqrt(double(width) * height / 65536.0)) & ~1);
+    double sum = 0.0;
+    int64_t count = 0;
+    for (int y = 0; y + 1 < height; y += step) {
+        for (int x = 0; x + 1 < width; x += step) {
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    sum += double(bayer(x0 + x + dx, y0 + y + dy)) - raw.black_levels[(y + dy) & 1][(x + dx) & 1];
+                }
+            }
+            count += 4;
+        }
+    }
+    const double range = std::max(1, raw.white_level - raw.black_level);
+    return float(std::log2(std::max(1e-6, sum / std::max<int64_t>(1, count) / range)));
+}
+
+// Per-frame exposure offsets in stops that take out flicker: each frame is
+// moved to the mean of the levels within +-window/2 frames of it, so slow
+// changes (sunset, a ramped exposure) stay and frame-to-frame jumps go.
+std::vector<float> deflicker_offsets(const std::vector<float>& levels, int window) {
+    const int n = int(levels.size());
+    const int half = std::max(0, window / 2);
+    std::vector<float> offsets(n, 0.0f);
+    for (int i = 0; i < n; i++) {
+        const int lo = std::max(0, i - half), hi = std::min(n - 1, i + half);
+        double sum = 0.0;
+        for (int j = lo; j <= hi; j++) sum += levels[j];
+        offsets[i] = float(sum / (hi - lo + 1)) - levels[i];
+    }
+    return offsets;
+}
+
+// Writes a planar RGB output as interleaved rgb24 rows, the layout of
+// ffmpeg's rawvideo. Returns false on a write error (a closed pipe).
+bool write_rgb24(const Buffer<uint8_t, 3>& image, FILE* out) {
+    std::vector<uint8_t> row(size_t(image.width()) * 3);
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            row[3 * x + 0] = image(x, y, 0);
+            row[3 * x + 1] = image(x, y, 1);
+            row[3 * x + 2] = image(x, y, 2);
+        }
+        if (fwrite(row.data(), 1, row.size(), out) != row.size()) return false;
+    }
+    return true;
+}
+
+// Renders an ordered list of raws to one stream of rgb24 frames, for
+// ffmpeg's rawvideo input, on --output (a file or fifo, or "-" for stdout).
+//
+// With --deflicker, a first pass decodes every frame for its level and
+// smooths the levels into per-frame exposure offsets (deflicker_offsets).
+// The render runs cfg.sequence_jobs frames at once, each worker decoding
+// and running its own pipeline call; finished frames are written strictly
+// in order, and a worker that runs more than 2 * sequence_jobs frames
+// ahead of the writer waits, which bounds the frames held for reordering.
+int run_sequence(const ProcessConfig& cfg) {
+    std::vector<std::string> inputs;
+    try {
+        inputs = collect_inputs(cfg, cfg.sequence_path);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "Error: no input files found for --sequence %s\n", cfg.sequence_path.c_str());
+        return 1;
+    }
+    const int jobs = std::max(1, cfg.sequence_jobs);
+    const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    set_raw_decode_threads(cfg.decode_threads > 0 ? cfg.decode_threads : std::max(1, cores / (2 * jobs)));
+    auto sequence_start = std::chrono::steady_clock::now();
+
+    // --- Pass 1: levels and deflicker offsets ---
+    std::vector<float> offsets(inputs.size(), 0.0f);
+    if (cfg.deflicker_window > 1) {
+        std::vector<float> levels(inputs.size(), 0.0f);
+        std::atomic<size_t> next{0};
+        std::atomic<int> failures{0};
+        const std::unique_ptr<ReadAhead> read_ahead = make_read_ahead(cfg, inputs);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < jobs; i++) {
+            workers.emplace_back([&] {
+                for (size_t n; (n = next++) < inputs.size();) {
+                    try {
+                        const RawFileBytes file = read_ahead ? read_ahead->take(n) : RawFileBytes();
+                        levels[n] = frame_log_level(load_input_file(cfg, inputs[n], false, file));
+                    } catch (const std::exception& e) {
+                        fprintf(stderr, "%s: %s\n", inputs[n].c_str(), e.what());
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (auto& t : workers) t.join();
+        if (failures > 0) return 1;
+        offsets = deflicker_offsets(levels, cfg.deflicker_window);
+        float max_offset = 0.0f;
+        for (float o : offsets) max_offset = std::max(max_offset, std::abs(o));
+        fprintf(stderr, "sequence: deflicker over %d frames, largest correction %.2f stops (%.1f s)\n",
+                cfg.deflicker_window, max_offset, ms_since(sequence_start) / 1000.0);
+    }
+
+    // --- Output ---
+    // Frames go to stdout for "-"; everything else process prints to
+    // stdout is moved to stderr so it can't end up in the video.
+    FILE* video = nullptr;
+    if (cfg.output_path == "-") {
+        fflush(stdout);
+        const int video_fd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        video = video_fd >= 0 ? fdopen(video_fd, "wb") : nullptr;
+    } else {
+        video = fopen(cfg.output_path.c_str(), "wb");
+    }
+    if (!video) {
+        fprintf(stderr, "Error: cannot open %s for the video stream.\n", cfg.output_path.c_str());
+        return 1;
+    }
+
+    // --- Pass 2: render in parallel, write in order ---
+    const SharedInputs shared = prepare_shared_inputs(cfg);
+    const size_t max_ahead = size_t(2 * jobs);
+    std::mutex mutex;
+    std::condition_variable frame_done, frame_written;
+    std::map<size_t, Buffer<uint8_t, 3>> finished;
+    size_t next_to_write = 0;
+    bool failed = false;
+    int out_width = 0, out_height = 0;
+    std::atomic<size_t> next{0};
+    const std::unique_ptr<ReadAhead> read_ahead = make_read_ahead(cfg, inputs);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++) {
+        workers.emplace_back([&] {
+            for (size_t n; (n = next++) < inputs.size();) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    frame_written.wait(lock, [&] { return failed || n < next_to_write + max_ahead; });
+                    if (failed) return;
+                }
+                Buffer<uint8_t, 3> output;
+                std::string error;
+                try {
+                    ProcessConfig frame_cfg = cfg;
+                    frame_cfg.exposure += offsets[n];
+                    RawImageData raw = load_input(frame_cfg, inputs[n], read_ahead ? read_ahead->take(n) : RawFileBytes());
+                    apply_auto_settings(frame_cfg, raw, false);
+                    FrameInputs frame = prepare_frame_inputs(frame_cfg, raw, false);
+                    output = make_output(frame_cfg, raw);
+                    const int result = run_pipeline(frame_cfg, raw, shared, frame, output);
+                    if (result != 0) error = "Halide pipeline failed with error " + std::to_string(result);
+                    else output.copy_to_host();
+                } catch (const std::exception& e) {
+                    error = e.what();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error.empty()) {
+                    fprintf(stderr, "[%zu/%zu] %s: FAILED: %s\n", n + 1, inputs.size(), inputs[n].c_str(), error.c_str());
+                    failed = true;
+                    frame_written.notify_all();
+                } else {
+                    finished[n] = std::move(output);
+                }
+                frame_done.notify_all();
+            }
+        });
+    }
+
+    // The writer: this thread, in frame order.
+    for (size_t n = 0; n < inputs.size(); n++) {
+        Buffer<uint8_t, 3> image;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frame_done.wait(lock, [&] { return failed || finished.count(n) > 0; });
+            if (failed) break;
+            image = std::move(finished[n]);
+            finished.erase(n);
+        }
+        if (n == 0) {
+            out_width = image.width();
+            out_height = image.height();
+            fprintf(stderr, "sequence: %zu frames of %dx%d rgb24, e.g. ffmpeg -f rawvideo -pix_fmt rgb24 "
+                            "-s %dx%d -r 25 -i - out.mp4\n",
+                    inputs.size(), out_width, out_height, out_width, out_height);
+        }
+        bool ok = image.width() == out_width && image.height() == out_height;
+        if (!ok) fprintf(stderr, "%s: frame size differs from the first frame's\n", inputs[n].c_str());
+        if (ok && !write_rgb24(image, video)) {
+            fprintf(stderr, "Error: writing frame %zu to %s failed.\n", n + 1, cfg.output_path.c_str());
+            ok = false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) failed = true;
+        next_to_write = n + 1;
+        frame_written.notify_all();
+        if (failed) break;
+    }
+    for (auto& t : workers) t.join();
+    fclose(video);
+
+    const double total_ms = ms_since(sequence_start);
+    fprintf(stderr, "Sequence: %zu of %zu frames in %.2f s (%.1f ms/frame, %d in flight).\n",
+            next_to_write, inputs.size(), total_ms / 1000.0, total_ms / inputs.size(), jobs);
+    report_memory(cfg);
+    return failed ? 1 : 0;
+}
+
+// --- Server mode ---
+
+// Splits a TCP address, "host:port" or ":port", into its parts. Anything
+// else (a path) is a Unix socket.
+bool split_tcp_address(const std::string& address, std::string& host, std::string& port) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size() || address.find('/') != std::string::npos) return false;
+    port = address.substr(colon + 1);
+    if (!std::all_of(port.begin(), port.end(), [](unsigned char ch) { return std::isdigit(ch); })) return false;
+    host = address.substr(0, colon);
+    return true;
+}
+
+// Whether a --serve host only takes connections from this machine. ":port"
+// listens on loopback.
+bool loopback_host(const std::string& host) {
+    return host.empty() || host == "localhost" || host == "::1" || host.rfind("127.", 0) == 0;
+}
+
+// Opens a listening socket on a --serve address. Returns -1 on failure.
+int listen_on(const std::string& address) {
+    std::string host, port;
+    if (!split_tcp_address(address, host, port)) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) return -1;
+        strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        unlink(address.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* a = found; a != nullptr && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+// Connects to a --serve address. Returns -1 on failure.
+int connect_to(const std::string& address) {
+    std::string host, port;
+    if (!split_tcp_address(address, host, port)) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) return -1;
+        strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* a = found; a != nullptr && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd >= 0) {
+        // Job lines are short and each waits on the reply to the last.
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+struct ServerJob {
+    int priority = 0;
+    uint64_t sequence = 0;
+    std::string id;
+    std::vector<std::string> args;
+    std::chrono::steady_clock::time_point received;
+    std::function<void(const std::string&)> reply;
+};
+
+// Higher priority first, then arrival order.
+struct ServerJobOrder {
+    bool operator()(const ServerJob& a, const ServerJob& b) const {
+        if (a.priority != b.priority) return a.priority < b.priority;
+        return a.sequence > b.sequence;
+    }
+};
+
+class ServerJobQueue {
+public:
+    void push(ServerJob job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return;
+        job.sequence = next_sequence_++;
+        jobs_.push(std::move(job));
+        ready_.notify_one();
+    }
+
+    bool pop(ServerJob& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return !jobs_.empty() || closed_; });
+        if (jobs_.empty()) return false;
+        job = jobs_.top();
+        jobs_.pop();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::priority_queue<ServerJob, std::vector<ServerJob>, ServerJobOrder> jobs_;
+    uint64_t next_sequence_ = 0;
+    bool closed_ = false;
+};
+
+// Parses one job line and queues it. Returns false for "quit". Jobs from
+// a TCP client (`remote`) can't quit the server or name shared memory,
+// which are only for clients on this machine, on the Unix socket or stdin,
+// and must carry `--token <token>` if `token` is set.
+bool submit_job_line(const std::string& line, ServerJobQueue& queue,
+                     std::function<void(const std::string&)> reply, bool remote = false,
+                     const std::string& token = "") {
+    static std::atomic<uint64_t> next_id{0};
+    std::vector<std::string> tokens = split_option_line(line);
+    if (tokens.empty()) return true;
+    if (tokens.size() == 1 && tokens[0] == "quit") {
+        if (!remote) return false;
+        reply("error " + std::to_string(next_id++) + " quit is not allowed over TCP");
+        return true;
+    }
+
+    ServerJob job;
+    job.received = std::chrono::steady_clock::now();
+    job.reply = std::move(reply);
+    job.id = std::to_string(next_id++);
+    try {
+        std::string job_token;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if ((tokens[i] == "--id" || tokens[i] == "--priority" || tokens[i] == "--token") &&
+                i + 1 < tokens.size()) {
+                if (tokens[i] == "--id") job.id = tokens[i + 1];
+                else if (tokens[i] == "--token") job_token = tokens[i + 1];
+                else job.priority = std::stoi(tokens[i + 1]);
+                ++i;
+            } else if (tokens[i] == "--help" || tokens[i] == "--serve" || tokens[i] == "--batch") {
+                throw std::runtime_error("option " + tokens[i] + " is not allowed in a job");
+            } else if (remote && tokens[i] == "--output-shm") {
+                throw std::runtime_error("option --output-shm is not allowed over TCP");
+            } else {
+                job.args.push_back(tokens[i]);
+            }
+        }
+        if (remote && job_token != token) throw std::runtime_error("job lacks the server's --token");
+    } catch (const std::exception& e) {
+        job.reply("error " + job.id + " " + e.what());
+        return true;
+    }
+    queue.push(std::move(job));
+    return true;
+}
+
+// What the server keeps from one job to the next.
+struct ServerState {
+    // Config-only inputs, while consecutive jobs share the same options.
+    std::string shared_key;
+    std::unique_ptr<SharedInputs> shared;
+    // The last input decoded for a --crop or --frame-size job, which farm
+    // coordinators send one band of an image after another.
+    std::string raw_key;
+    std::unique_ptr<RawImageData> raw;
+};
+
+// True if `path` is /proc/<pid>/fd/<n> (or /proc/self/...) and names a
+// memfd.
+bool is_memfd_path(const std::string& path) {
+    const std::string proc = "/proc/";
+    if (path.compare(0, proc.size(), proc) != 0) return false;
+    const size_t fd_dir = path.find("/fd/", proc.size());
+    if (fd_dir == std::string::npos) return false;
+    auto digits = [](const std::string& t) {
+        return !t.empty() && t.find_first_not_of("0123456789") == std::string::npos;
+    };
+    const std::string pid = path.substr(proc.size(), fd_dir - proc.size());
+    if ((pid != "self" && !digits(pid)) || !digits(path.substr(fd_dir + 4))) return false;
+    char target[256];
+    const ssize_t length = readlink(path.c_str(), target, sizeof(target) - 1);
+    return length > 0 && std::string(target, static_cast<size_t>(length)).compare(0, 7, "/memfd:") == 0;
+}
+
+// A job's --output-shm region, mapped for the job in its --shm-layout for
+// an output region `r`. Throws std::runtime_error if the region can't be
+// opened or is too small for the output.
+class SharedOutput {
+public:
+    SharedOutput(const ProcessConfig& cfg, const OutputRegion& r) {
+        planar_ = cfg.shm_layout == "planar";
+        const int channels = cfg.shm_layout == "rgba8" ? 4 : 3;
+        const int row = planar_ ? r.width : r.width * channels;
+        stride_ = cfg.shm_stride > 0 ? cfg.shm_stride : row;
+        if (stride_ < row) {
+            throw std::runtime_error("--shm-stride " + std::to_string(stride_) + " is shorter than a row of " +
+                                     std::to_string(row) + " bytes");
+        }
+        bytes_ = static_cast<size_t>(stride_) * r.height * (planar_ ? 3 : 1);
+
+        // A bare "/name" is a POSIX shared memory object; otherwise only a
+        // file directly in /dev/shm (not through a symlink) or a memfd's
+        // /proc/<pid>/fd/<n>, so a job can't write over other files. None is
+        // created or truncated: the client sizes it.
+        const std::string& name = cfg.output_shm;
+        const bool posix = name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos;
+        const std::string dev_shm = "/dev/shm/";
+        const std::string leaf = name.compare(0, dev_shm.size(), dev_shm) == 0 ? name.substr(dev_shm.size()) : "";
+        const bool in_dev_shm = !leaf.empty() && leaf != "." && leaf != ".." && leaf.find('/') == std::string::npos;
+        if (!posix && !in_dev_shm && !is_memfd_path(name)) {
+            throw std::runtime_error("--output-shm " + name +
+                                     " is not a shared memory name (/name), a file in /dev/shm or a memfd");
+        }
+        const int fd = posix ? shm_open(name.c_str(), O_RDWR, 0)
+                             : open(name.c_str(), O_RDWR | (in_dev_shm ? O_NOFOLLOW : 0));
+        if (fd < 0) throw std::runtime_error("can't open --output-shm " + name + ": " + strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < bytes_) {
+            close(fd);
+            throw std::runtime_error("--output-shm " + name + " is smaller than the " + std::to_string(bytes_) +
+                                     " bytes the " + std::to_string(r.width) + "x" + std::to_string(r.height) +
+                                     " output needs");
+        }
+        void* data = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("can't map --output-shm " + name + ": " + strerror(errno));
+        data_ = static_cast<uint8_t*>(data);
+
+        halide_dimension_t planar[3] = {{r.x, r.width, 1}, {r.y, r.height, stride_}, {0, 3, stride_ * r.height}};
+        halide_dimension_t interleaved[3] = {{r.x, r.width, channels}, {r.y, r.height, stride_}, {0, channels, 1}};
+        buffer_ = Buffer<uint8_t, 3>(data_, 3, planar_ ? planar : interleaved);
+    }
+    ~SharedOutput() { munmap(data_, bytes_); }
+    SharedOutput(const SharedOutput&) = delete;
+    SharedOutput& operator=(const SharedOutput&) = delete;
+
+    // The planar layout is camera_pipe's own, so the pipeline renders into
+    // buffer() directly; the interleaved ones are written from its output.
+    bool planar() const { return planar_; }
+    Buffer<uint8_t, 3>& buffer() { return buffer_; }
+    // Copies `output` (the size and mins of `r`) into the region, with an
+    // opaque alpha for rgba8.
+    void write(const Buffer<uint8_t, 3>& output) {
+        if (buffer_.channels() == 4) buffer_.sliced(2, 3).fill(255);
+        buffer_.cropped(2, 0, 3).copy_from(output);
+    }
+    // The reply's "<width> <height> <stride>".
+    std::string reply_fields() const {
+        return std::to_string(buffer_.width()) + " " + std::to_string(buffer_.height()) + " " + std::to_string(stride_);
+    }
+
+private:
+    bool planar_ = false;
+    int stride_ = 0;
+    size_t bytes_ = 0;
+    uint8_t* data_ = nullptr;
+    Buffer<uint8_t, 3> buffer_;
+};
+
+// Runs one job against the server's base config. A job with --frame-size
+// renders nothing and is answered with the output's full size instead,
+// "size <id> <width> <height>". A job with --output-shm is answered with
+// the region's name and the output's size and row stride in place of the
+// output path.
+std::string run_server_job(const ProcessConfig& base, const ServerJob& job, ServerState& state) {
+    std::vector<char*> argv;
+    std::string program = "process";
+    argv.push_back(&program[0]);
+    std::vector<std::string> args = job.args;
+    const auto probe = std::find(args.begin(), args.end(), "--frame-size");
+    const bool frame_size_only = probe != args.end();
+    if (frame_size_only) args.erase(probe);
+    // Neither the paths nor the crop change the shared inputs.
+    std::string key;
+    for (size_t i = 0; i < args.size(); ++i) {
+        argv.push_back(&args[i][0]);
+        bool per_render = (args[i] == "--input" || args[i] == "--output" || args[i] == "--output-shm" ||
+                           args[i] == "--crop") && i + 1 < args.size();
+        if (per_render) {
+            argv.push_back(&args[i + 1][0]);
+            ++i;
+        } else {
+            key += args[i] + '\n';
+        }
+    }
+    ProcessConfig cfg = parse_args(static_cast<int>(argv.size()), argv.data(), base);
+    const bool to_shm = !cfg.output_shm.empty();
+    if (cfg.input_path.empty() || (cfg.output_path.empty() && !to_shm && !frame_size_only)) {
+        throw std::runtime_error("job needs --input and --output (or --output-shm)");
+    }
+    if (to_shm && cfg.thumbnail > 0) throw std::runtime_error("--output-shm can't be used with --thumbnail");
+    std::string shm_fields;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!state.shared || key != state.shared_key) {
+        state.shared = std::make_unique<SharedInputs>(prepare_shared_inputs(cfg));
+        state.shared_key = key;
+    }
+    const SharedInputs& shared = *state.shared;
+    const bool keep_raw = frame_size_only || cfg.crop_width > 0;
+    if (!keep_raw) state.raw.reset();
+    int result;
+    if (cfg.thumbnail > 0 && !frame_size_only) {
+        result = run_thumbnail(cfg, &shared);
+    } else
+#ifdef PIPELINE_LOOKS
+    // Crops (farm bands, editor tiles) render only their region through
+    // camera_pipe, from the raw kept below, rather than the whole frame
+    // through the split pipeline.
+    if (front_cache(cfg) && !frame_size_only && cfg.crop_width <= 0) {
+        Buffer<uint8_t, 3> output;
+        bool hit = false;
+        result = render_front_cached(cfg, cfg.input_path, shared, output, hit);
+        if (result == 0 && to_shm) {
+            const OutputRegion r{output.dim(0).min(), output.dim(1).min(), output.width(), output.height()};
+            SharedOutput region(cfg, r);
+            region.write(output);
+            shm_fields = region.reply_fields();
+        } else if (result == 0) {
+            save_output(output, cfg.output_path, encode_options(cfg));
+        }
+    } else
+#endif
+    {
+        std::unique_ptr<RawImageData> loaded;
+        const RawImageData* raw = nullptr;
+        const std::string raw_key = cfg.input_path + '\n' + input_stamp(cfg.input_path) + '\n' + key;
+        if (keep_raw && state.raw && state.raw_key == raw_key) {
+            raw = state.raw.get();
+        } else {
+            loaded = std::make_unique<RawImageData>(load_input(cfg, cfg.input_path));
+            raw = loaded.get();
+            if (keep_raw) {
+                state.raw = std::move(loaded);
+                state.raw_key = raw_key;
+            }
+        }
+        const RawImageData& raw_data = *raw;
+        if (frame_size_only) {
+            ProcessConfig whole = cfg;
+            whole.crop_width = whole.crop_height = 0;
+            const OutputRegion frame = output_region(whole, raw_data);
+            return "size " + job.id + " " + std::to_string(frame.width) + " " + std::to_string(frame.height);
+        }
+        apply_auto_settings(cfg, raw_data, false);
+        FrameInputs frame = prepare_frame_inputs(cfg, raw_data, false);
+        if (to_shm) {
+            SharedOutput region(cfg, output_region(cfg, raw_data));
+            Buffer<uint8_t, 3> output = region.planar() ? region.buffer() : make_output(cfg, raw_data);
+            result = run_pipeline(cfg, raw_data, shared, frame, output);
+            if (result == 0) {
+                // GPU builds leave the result on the device.
+                output.copy_to_host();
+                if (!region.planar()) region.write(output);
+                shm_fields = region.reply_fields();
+            }
+        } else if (can_stream(cfg, cfg.output_path)) {
+            int bands = 0;
+            result = render_streamed(cfg, raw_data, shared, frame, cfg.output_path, encode_options(cfg), bands);
+        } else {
+            Buffer<uint8_t, 3> output = make_output(cfg, raw_data);
+            result = run_pipeline(cfg, raw_data, shared, frame, output);
+            if (result == 0) {
+                // GPU builds leave the result on the device.
+                output.copy_to_host();
+                save_output(output, cfg.output_path, encode_options(cfg));
+            }
+        }
+    }
+    if (result != 0) {
+        throw std::runtime_error("Halide pipeline failed with error " + std::to_string(result));
+    }
+
+    std::ostringstream reply;
+    reply << std::fixed << std::setprecision(1) << "ok " << job.id << " "
+          << std::chrono::duration<double, std::milli>(start - job.received).count() << " "
+          << ms_since(start) << " ";
+    if (to_shm) reply << cfg.output_shm << " " << shm_fields;
+    else reply << cfg.output_path;
+    return reply.str();
+}
+
+// A client connection. The socket closes once the reader has finished and
+// every job from it has been answered.
+struct ServerConnection {
+    explicit ServerConnection(int fd) : fd(fd) {}
+    ~ServerConnection() { close(fd); }
+    void send(const std::string& line) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        std::string out = line + "\n";
+        const char* p = out.data();
+        size_t left = out.size();
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n <= 0) return; // Client went away; drop the reply.
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+    }
+    int fd;
+    std::mutex write_mutex;
+};
+
+// Keeps the pipeline, camera metadata, Lensfun database and Halide thread
+// pool warm across jobs, which are read from stdin, a Unix socket or TCP
+// and run one at a time in priority order. TCP listens on loopback unless
+// --serve names a host; its jobs need --serve-token's token when one is set,
+// and can't stop the server.
+int run_server(const ProcessConfig& base) {
+    set_raw_decode_threads(base.decode_threads);
+    // A client that disconnects before its reply must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+    // Shared with the connection threads, which may outlive this function.
+    auto queue_ptr = std::make_shared<ServerJobQueue>();
+    ServerJobQueue& queue = *queue_ptr;
+
+    std::thread worker([&] {
+        ServerState state;
+        ServerJob job;
+        while (queue.pop(job)) {
+            std::string reply;
+            try {
+                reply = run_server_job(base, job, state);
+            } catch (const std::exception& e) {
+                reply = "error " + job.id + " " + e.what();
+            }
+            job.reply(reply);
+            job = ServerJob(); // Drop the reply handle, and with it the connection.
+        }
+    });
+
+    if (base.serve_path == "-") {
+        fprintf(stderr, "serving jobs on stdin\n");
+        // Replies own stdout; point everything else printed there (timers,
+        // pipeline logs) at stderr so it can't interleave with the protocol.
+        fflush(stdout);
+        FILE* replies = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        std::mutex replies_mutex;
+        auto reply = [&](const std::string& line) {
+            std::lock_guard<std::mutex> lock(replies_mutex);
+            fprintf(replies, "%s\n", line.c_str());
+            fflush(replies);
+        };
+        std::string line;
+        while (std::getline(std::cin, line) && submit_job_line(line, queue, reply)) {}
+    } else {
+        int listen_fd = listen_on(base.serve_path);
+        if (listen_fd < 0) {
+            fprintf(stderr, "Error: cannot listen on %s\n", base.serve_path.c_str());
+            queue.close();
+            worker.join();
+            return 1;
+        }
+        std::string host, port;
+        const bool tcp = split_tcp_address(base.serve_path, host, port);
+        fprintf(stderr, "serving jobs on %s\n", base.serve_path.c_str());
+        if (tcp && !loopback_host(host) && base.serve_token.empty()) {
+            fprintf(stderr, "Warning: %s takes jobs from other machines with no --serve-token; any of them can "
+                            "read and write files as this process.\n", base.serve_path.c_str());
+        }
+        const std::string token = base.serve_token;
+
+        auto quit = std::make_shared<std::atomic<bool>>(false);
+        while (!*quit) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            auto conn = std::make_shared<ServerConnection>(fd);
+            std::thread([conn, queue_ptr, quit, listen_fd, tcp, token] {
+                std::string buffer;
+                char chunk[4096];
+                ssize_t n;
+                while ((n = read(conn->fd, chunk, sizeof(chunk))) > 0) {
+                    buffer.append(chunk, static_cast<size_t>(n));
+                    size_t eol;
+                    while ((eol = buffer.find('\n')) != std::string::npos) {
+                        std::string line = buffer.substr(0, eol);
+                        buffer.erase(0, eol + 1);
+                        if (!submit_job_line(line, *queue_ptr, [conn](const std::string& r) { conn->send(r); },
+                                             tcp, token)) {
+                            // Wake the accept loop so it can exit.
+                            *quit = true;
+                            shutdown(listen_fd, SHUT_RDWR);
+                            return;
+                        }
+                    }
+                }
+            }).detach();
+        }
+        close(listen_fd);
+        if (!tcp) unlink(base.serve_path.c_str());
+    }
+
+    queue.close();
+    worker.join();
+    report_memory(base);
+    return 0;
+}
+
+// --- Farm mode ---
+
+// A connection to one --serve server: job lines out, reply lines back.
+class FarmWorker {
+public:
+    explicit FarmWorker(const std::string& address) : address_(address), fd_(connect_to(address)) {
+        if (fd_ < 0) throw std::runtime_error("cannot connect to " + address);
+    }
+    ~FarmWorker() { close(fd_); }
+    FarmWorker(const FarmWorker&) = delete;
+    FarmWorker& operator=(const FarmWorker&) = delete;
+
+    const std::string& address() const { return address_; }
+
+    bool send(const std::string& line) {
+        std::string out = line + "\n";
+        const char* p = out.data();
+        size_t left = out.size();
+        while (left > 0) {
+            ssize_t n = write(fd_, p, left);
+            if (n <= 0) return false;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Blocks for the next line. Returns false once the server has gone.
+    bool read_line(std::string& line) {
+        size_t eol;
+        while ((eol = buffer_.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            ssize_t n = read(fd_, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            buffer_.append(chunk, static_cast<size_t>(n));
+        }
+        line = buffer_.substr(0, eol);
+        buffer_.erase(0, eol + 1);
+        return true;
+    }
+
+private:
+    std::string address_;
+    int fd_;
+    std::string buffer_;
+};
+
+// Runs `jobs` (job lines without --id) on the workers, at most `in_flight`
+// at a time on each. The jobs wait in one queue and a worker takes the next
+// as soon as one of its own is answered, so faster or less loaded workers
+// take more of them. The jobs of a worker that disconnects go back on the
+// queue for the others. done(i) is called, on the worker's thread, for
+// each job answered "ok", and returning false from it stops the farm.
+// Returns false, with `error` set, when a job fails, done() stops it or no
+// worker is left.
+bool run_farm_jobs(std::vector<std::unique_ptr<FarmWorker>>& workers, const std::vector<std::string>& jobs,
+                   int in_flight, const std::function<bool(size_t)>& done, std::string& error) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<size_t> queue;
+    for (size_t i = 0; i < jobs.size(); ++i) queue.push_back(i);
+    size_t remaining = jobs.size();
+    size_t live = workers.size();
+    bool failed = false;
+
+    auto serve = [&](FarmWorker& worker) {
+        std::map<std::string, size_t> sent; // Job id -> index.
+        auto lose_worker = [&](const std::string& why) {
+            std::lock_guard<std::mutex> lock(mutex);
+            fprintf(stderr, "farm: lost %s (%s); requeueing %zu jobs\n", worker.address().c_str(), why.c_str(),
+                    sent.size());
+            for (const auto& s : sent) queue.push_front(s.second);
+            if (--live == 0 && remaining > 0 && !failed) {
+                failed = true;
+                error = "no farm workers left";
+            }
+            changed.notify_all();
+        };
+        while (true) {
+            std::vector<size_t> take;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return failed || remaining == 0 || !queue.empty() || !sent.empty(); });
+                if (failed || remaining == 0) return;
+                while (sent.size() + take.size() < static_cast<size_t>(in_flight) && !queue.empty()) {
+                    take.push_back(queue.front());
+                    queue.pop_front();
+                }
+            }
+            for (size_t k = 0; k < take.size(); ++k) {
+                const std::string id = "farm" + std::to_string(take[k]);
+                sent[id] = take[k];
+                if (!worker.send("--id " + id + " " + jobs[take[k]])) {
+                    {
+                        // The ones not sent yet go back first.
+                        std::lock_guard<std::mutex> lock(mutex);
+                        for (size_t j = take.size(); j-- > k + 1;) queue.push_front(take[j]);
+                    }
+                    lose_worker("write failed");
+                    return;
+                }
+            }
+            std::string line;
+            if (!worker.read_line(line)) {
+                lose_worker("disconnected");
+                return;
+            }
+            std::istringstream reply(line);
+            std::string status, id;
+            reply >> status >> id;
+            auto it = sent.find(id);
+            if (it == sent.end()) continue; // Not ours.
+            const size_t index = it->second;
+            sent.erase(it);
+            if (status != "ok") {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failed) error = worker.address() + ": " + line;
+                failed = true;
+                changed.notify_all();
+                return;
+            }
+            const bool go_on = done(index);
+            std::lock_guard<std::mutex> lock(mutex);
+            remaining--;
+            if (!go_on && !failed) {
+                failed = true;
+                error = "stopped";
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) threads.emplace_back(serve, std::ref(*worker));
+    for (auto& t : threads) t.join();
+    return !failed;
+}
+
+// A job line's word for `arg`, quoted if it has spaces (split_option_line).
+std::string job_word(const std::string& arg) {
+    return arg.find_first_of(" \t") == std::string::npos ? arg : "\"" + arg + "\"";
+}
+
+// Renders one --input across the workers: the output is cut into bands of
+// whole rows, each a --crop job whose band every worker renders with the
+// halo it needs from the shared raw (the servers keep the decoded raw
+// between bands). The bands come back as binary PPMs in the scratch
+// directory and are encoded into --output in order as they arrive.
+int run_farm_image(const ProcessConfig& cfg, const std::string& options,
+                   std::vector<std::unique_ptr<FarmWorker>>& workers) {
+    namespace fs = std::filesystem;
+    const std::string input = fs::absolute(cfg.input_path).string();
+    const std::string base_job = options + " --input " + job_word(input);
+
+    // One worker reports the output's size, and keeps the raw decoded for
+    // its first band.
+    std::string line;
+    if (!workers[0]->send("--id size --frame-size " + base_job) || !workers[0]->read_line(line)) {
+        fprintf(stderr, "Error: %s went away\n", workers[0]->address().c_str());
+        return 1;
+    }
+    std::istringstream size_reply(line);
+    std::string status, id;
+    int width = 0, height = 0;
+    size_reply >> status >> id >> width >> height;
+    if (status != "size" || width <= 0 || height <= 0) {
+        fprintf(stderr, "Error: %s: %s\n", workers[0]->address().c_str(), line.c_str());
+        return 1;
+    }
+
+    const fs::path scratch = fs::absolute(cfg.farm_scratch.empty()
+        ? fs::path(cfg.output_path).parent_path() / (".farm-" + std::to_string(getpid()))
+        : fs::path(cfg.farm_scratch));
+    fs::create_directories(scratch);
+    struct ScratchCleanup {
+        fs::path dir;
+        bool remove_dir;
+        ~ScratchCleanup() {
+            std::error_code ec;
+            if (remove_dir) fs::remove_all(dir, ec);
+        }
+    } cleanup{scratch, cfg.farm_scratch.empty()};
+
+    // Same spread as render_streamed: no band much shorter than the rest.
+    const int bands = std::max(1, (height + cfg.farm_band_rows - 1) / cfg.farm_band_rows);
+    std::vector<std::string> jobs, band_paths;
+    std::vector<int> band_top;
+    for (int b = 0; b < bands; ++b) {
+        const int y_begin = static_cast<int>(static_cast<int64_t>(height) * b / bands);
+        const int y_end = static_cast<int>(static_cast<int64_t>(height) * (b + 1) / bands);
+        band_paths.push_back((scratch / ("band_" + std::to_string(b) + ".ppm")).string());
+        band_top.push_back(y_begin);
+        jobs.push_back(base_job + " --crop 0," + std::to_string(y_begin) + "," + std::to_string(width) + "," +
+                       std::to_string(y_end - y_begin) + " --output " + job_word(band_paths.back()));
+    }
+    fprintf(stderr, "farm: %dx%d in %d bands on %zu workers\n", width, height, bands, workers.size());
+
+    // Bands finish in any order; the writer takes them top to bottom.
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::vector<bool> ready(bands, false);
+    bool finished = false;
+    bool ok = false;
+    std::atomic<bool> writer_failed{false};
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    std::thread dispatch([&] {
+        const bool result = run_farm_jobs(workers, jobs, cfg.farm_jobs, [&](size_t b) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[b] = true;
+            arrived.notify_all();
+            return !writer_failed;
+        }, error);
+        std::lock_guard<std::mutex> lock(mutex);
+        ok = result;
+        finished = true;
+        arrived.notify_all();
+    });
+
+    try {
+        ImageEncoders::RowStreamWriter writer(cfg.output_path, width, height, 3, encode_options(cfg));
+        for (int b = 0; b < bands; ++b) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                arrived.wait(lock, [&] { return ready[b] || finished; });
+                if (!ready[b]) break;
+            }
+            Buffer<uint8_t, 3> band = load_image(band_paths[b]);
+            if (band.width() != width || band.height() != (b + 1 < bands ? band_top[b + 1] : height) - band_top[b]) {
+                throw std::runtime_error("band " + std::to_string(b) + " came back the wrong size");
+            }
+            Instrumentation::ScopedTimer encode_timer("Encode Rows");
+            writer.write_rows(band);
+            fs::remove(band_paths[b]);
+        }
+        if (writer.rows_written() == height) writer.finish();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        writer_failed = true;
+    }
+    dispatch.join();
+    if (writer_failed) return 1;
+    if (!ok) {
+        fprintf(stderr, "Error: %s\n", error.c_str());
+        return 1;
+    }
+    fprintf(stdout, "Farm render: %f ms in %d bands on %zu workers\n", ms_since(start), bands, workers.size());
+    fprintf(stderr, "output: %s\n", cfg.output_path.c_str());
+    return 0;
+}
+
+// Renders a --batch across the workers, a whole file per job.
+int run_farm_batch(const ProcessConfig& cfg, const std::string& options,
+                   std::vector<std::unique_ptr<FarmWorker>>& workers) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> inputs;
+    try {
+        inputs = collect_inputs(cfg, cfg.batch_path);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "Error: no input files found for --batch %s\n", cfg.batch_path.c_str());
+        return 1;
+    }
+    if (cfg.output_path.find("{name}") == std::string::npos) {
+        fs::create_directories(cfg.output_path);
+    }
+    std::vector<std::string> jobs;
+    for (const std::string& input : inputs) {
+        const std::string output = fs::absolute(batch_output_path(cfg.output_path, input)).string();
+        jobs.push_back(options + " --input " + job_word(fs::absolute(input).string()) + " --output " + job_word(output));
+    }
+
+    std::atomic<size_t> rendered{0};
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    const bool ok = run_farm_jobs(workers, jobs, cfg.farm_jobs, [&](size_t) {
+        rendered++;
+        return true;
+    }, error);
+    fprintf(stdout, "Farm batch: %zu of %zu files in %f ms on %zu workers\n", rendered.load(), inputs.size(),
+            ms_since(start), workers.size());
+    if (!ok) {
+        fprintf(stderr, "Error: %s\n", error.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// The coordinator of --farm. `options` are the command line's pipeline
+// options, sent with every job; the workers apply them on top of their own.
+int run_farm(const ProcessConfig& cfg, const std::string& options) {
+    std::vector<std::unique_ptr<FarmWorker>> workers;
+    std::stringstream list(cfg.farm_workers);
+    std::string address;
+    while (std::getline(list, address, ',')) {
+        if (address.empty()) continue;
+        try {
+            workers.push_back(std::make_unique<FarmWorker>(address));
+        } catch (const std::exception& e) {
+            fprintf(stderr, "Warning: %s; leaving it out\n", e.what());
+        }
+    }
+    if (workers.empty()) {
+        fprintf(stderr, "Error: no farm worker could be reached (--farm %s)\n", cfg.farm_workers.c_str());
+        return 1;
+    }
+    // A worker that goes away mid-write must not kill the coordinator.
+    signal(SIGPIPE, SIG_IGN);
+    return cfg.batch_path.empty() ? run_farm_image(cfg, options, workers) : run_farm_batch(cfg, options, workers);
+}
+
+// The command line minus what the coordinator itself handles, as one job
+// line's worth of options. Values are taken the way parse_args takes them.
+// --serve-token goes to the workers as the job's --token.
+std::string farm_job_options(int argc, char** argv) {
+    static const std::set<std::string> kCoordinatorOnly = {
+        "--farm", "--farm-band-rows", "--farm-jobs", "--farm-scratch", "--input", "--output", "--batch",
+        "--batch-decoders", "--batch-encoders", "--batch-manifest", "--metrics", "--trace", "--front-cache",
+        "--front-cache-mb"};
+    std::string options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = arg.rfind("--", 0) == 0 && i + 1 < argc &&
+                               (argv[i + 1][0] != '-' || std::string(argv[i + 1]) == "-");
+        if (kCoordinatorOnly.count(arg) || arg.rfind("--", 0) != 0) {
+            if (has_value) ++i;
+            continue;
+        }
+        if (arg == "--serve-token" && has_value) {
+            options += (options.empty() ? "" : " ") + std::string("--token ") + job_word(argv[++i]);
+            continue;
+        }
+        options += (options.empty() ? "" : " ") + job_word(arg);
+        if (has_value) options += " " + job_word(argv[++i]);
+    }
+    return options;
+}
+
+} // namespace
+
+
+// --- Export sizes ---
+
+#ifdef PIPELINE_EXPORT_SIZES
+// Renders --outputs: one decode and one run of camera_pipe_f32_export,
+// which writes the full output and up to kExportSizes reductions of it
+// (ExportPyramidBuilder), then encodes every requested size in parallel.
+int run_export(ProcessConfig cfg) {
+    std::vector<const ExportSize*> full_files, reduced_files;
+    for (const ExportSize& size : cfg.export_sizes) {
+        (size.long_edge == 0 ? full_files : reduced_files).push_back(&size);
+    }
+    if (reduced_files.size() > static_cast<size_t>(kExportSizes)) {
+        fprintf(stderr, "Error: --outputs takes at most %d reduced sizes besides full.\n", kExportSizes);
+        return 1;
+    }
+    auto export_start = std::chrono::steady_clock::now();
+
+    RawImageData raw;
+    try {
+        raw = cfg.burst_paths.empty() ? load_input_file(cfg, cfg.input_path, false) : load_input(cfg, cfg.input_path);
+        apply_auto_settings(cfg, raw, true);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s: %s\n", cfg.input_path.c_str(), e.what());
+        return 1;
+    }
+    const SharedInputs shared = prepare_shared_inputs(cfg);
+    const FrameInputs frame = prepare_frame_inputs(cfg, raw, true);
+    Buffer<uint8_t, 3> output = make_output(cfg, raw);
+
+    // Slots no size asked for get a pixel, which costs nothing to fill.
+    const int full_edge = std::max(output.width(), output.height());
+    std::vector<Buffer<uint8_t, 3>> reduced;
+    for (int i = 0; i < kExportSizes; i++) {
+        int width = 1, height = 1;
+        if (i < static_cast<int>(reduced_files.size())) {
+            const int edge = reduced_files[i]->long_edge;
+            if (edge > full_edge) {
+                fprintf(stderr, "Error: --outputs size %d is larger than the full output (%dx%d).\n",
+                        edge, output.width(), output.height());
+                return 1;
+            }
+            width = std::max(1, static_cast<int>(std::lround(double(output.width()) * edge / full_edge)));
+            height = std::max(1, static_cast<int>(std::lround(double(output.height()) * edge / full_edge)));
+        }
+        reduced.emplace_back(width, height, 3);
+    }
+
+    auto pipeline_start = std::chrono::steady_clock::now();
+    int result = run_pipeline(cfg, raw, shared, frame, output, &reduced);
+    if (result != 0) {
+        fprintf(stderr, "Halide pipeline failed with error %d\n", result);
+        return 1;
+    }
+    const double pipeline_ms = ms_since(pipeline_start);
+    raw = RawImageData();
+
+    auto encode_start = std::chrono::steady_clock::now();
+    std::atomic<int> failures{0};
+    std::vector<std::thread> encoders;
+    auto encode = [&](const Buffer<uint8_t, 3>& image, const std::string& path) {
+        encoders.emplace_back([&, image, path] {
+            try {
+                save_output(image, path, encode_options(cfg));
+                fprintf(stderr, "output: %s (%dx%d)\n", path.c_str(), image.width(), image.height());
+            } catch (const std::exception& e) {
+                fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+                failures++;
+            }
+        });
+    };
+    for (const ExportSize* size : full_files) encode(output, size->path);
+    for (size_t i = 0; i < reduced_files.size(); i++) encode(reduced[i], reduced_files[i]->path);
+    for (auto& t : encoders) t.join();
+
+    fprintf(stdout, "Export: %zu files in %.2f s (pipeline %.1f ms, encodes %.1f ms in parallel).\n",
+            cfg.export_sizes.size(), ms_since(export_start) / 1000.0, pipeline_ms, ms_since(encode_start));
+    report_memory(cfg);
+    return failures == 0 ? 0 : 1;
+}
+#endif
+
+#ifdef PIPELINE_TAP
+// --tap: renders through camera_pipe_f32_tap and writes the tapped
+// intermediate to --output instead of the image, in 8 bits: colour and
+// mosaics sRGB-encoded, LCh as L / 100, C / 100 and the hue over a turn.
+int run_tap(const ProcessConfig& cfg, const RawImageData& raw_data, const SharedInputs& shared,
+            const FrameInputs& frame) {
+    if (!raw_data.bayer_data.data()) {
+        fprintf(stderr, "Error: --tap needs an unpacked raw.\n");
+        return 1;
+    }
+    const DebugTap stage = debug_tap_named(cfg.tap);
+    const float scale = debug_tap_full_res(stage) ? 1.0f : 1.0f / cfg.downscale_factor;
+    Buffer<float, 3> tap(static_cast<int>(raw_data.width() * scale), static_cast<int>(raw_data.height() * scale), 3);
+    Buffer<uint8_t, 3> output = make_output(cfg, raw_data);
+    const int result = run_pipeline(cfg, raw_data, shared, frame, output, nullptr, &tap);
+    if (result != 0) {
+        fprintf(stderr, "Halide pipeline failed with error %d\n", result);
+        return 1;
+    }
+
+    const bool lch = stage == DebugTap::LchLocalAdjusted;
+    Buffer<uint8_t, 3> image(tap.width(), tap.height(), 3);
+    image.for_each_element([&](int x, int y, int c) {
+        float v = tap(x, y, c);
+        if (!lch) {
+            v = std::max(0.0f, std::min(1.0f, v));
+            v = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+        } else if (c < 2) {
+            v /= 100.0f;
+        } else {
+            v = (v + float(M_PI)) / float(2.0 * M_PI);
+        }
+        image(x, y, c) = static_cast<uint8_t>(std::max(0.0f, std::min(255.0f, v * 255.0f + 0.5f)));
+    });
+    fprintf(stderr, "Writing tap %s (%dx%d) to %s.\n", cfg.tap.c_str(), tap.width(), tap.height(),
+            cfg.output_path.c_str());
+    save_output(image, cfg.output_path, encode_options(cfg));
+    return 0;
+}
+#endif
+
+// --- Multi-look mode ---
+
+#ifdef PIPELINE_LOOKS
+struct Look {
+    std::string name;
+    ProcessConfig cfg;
+    std::string output_path;
+};
+
+// "{look}" in the output template is replaced by the look's name and
+// "{name}" by the input's file stem. A template without "{look}" is treated
+// as a directory for <stem>_<look>.png files.
+std::string look_output_path(const std::string& output_template, const std::string& input_path,
+                             const std::string& look) {
+    std::string path = output_template;
+    size_t pos = path.find("{look}");
+    if (pos == std::string::npos) {
+        std::string stem = std::filesystem::path(input_path).stem().string();
+        return (std::filesystem::path(output_template) / (stem + "_" + look + ".png")).string();
+    }
+    path = path.substr(0, pos) + look + path.substr(pos + 6);
+    return batch_output_path(path, input_path);
+}
+
+// A looks file has one look per line: its name, then options as on the
+// command line, applied over the base config. Blank lines and lines
+// starting with '#' are skipped.
+std::vector<Look> read_looks(const ProcessConfig& base) {
+    std::ifstream file(base.looks_path);
+    if (!file) throw std::runtime_error("Cannot open looks file: " + base.looks_path);
+    std::vector<Look> looks;
+    std::set<std::string> names;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::vector<std::string> tokens = split_option_line(line);
+        if (tokens.empty() || tokens[0][0] == '#') continue;
+        Look look;
+        look.name = tokens[0];
+        if (!names.insert(look.name).second) throw std::runtime_error("look '" + look.name + "' is defined twice");
+        std::vector<char*> argv;
+        std::string program = "process";
+        argv.push_back(&program[0]);
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            static const std::set<std::string> not_per_look = {
+                "--input", "--output", "--batch", "--sequence", "--serve", "--looks", "--burst-frames", "--help"};
+            if (not_per_look.count(tokens[i])) {
+                throw std::runtime_error("option " + tokens[i] + " is not allowed in look '" + look.name + "'");
+            }
+            argv.push_back(&tokens[i][0]);
+        }
+        look.cfg = parse_args(static_cast<int>(argv.size()), argv.data(), base);
+        look.output_path = look_output_path(base.output_path, base.input_path, look.name);
+        looks.push_back(std::move(look));
+    }
+    return looks;
+}
+
+// Renders every look of --looks from one decode of --input. The pipeline
+// is the editor's split of camera_pipe_f32 (built here for the CPU with
+// planar output): the raw -> linear front end runs once per distinct
+// front-end setting (front_end_key), and only the back end, with each
+// look's LUTs and warp map, runs per look. Back ends run cfg.look_jobs at a
+// time; the encodes follow on the same worker. With --front-cache, front
+// ends are read from it when present, and the input isn't decoded at all
+// if every one is.
+int run_looks(const ProcessConfig& cfg) {
+    std::vector<Look> looks;
+    try {
+        looks = read_looks(cfg);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    if (looks.empty()) {
+        fprintf(stderr, "Error: no looks in %s\n", cfg.looks_path.c_str());
+        return 1;
+    }
+    auto looks_start = std::chrono::steady_clock::now();
+
+    // --- Front ends ---
+    // Each look's LUTs and lens profile are built here too, on this thread:
+    // the Lensfun database isn't safe to load from several at once. Front
+    // ends already in --front-cache are read from it, and the input is only
+    // decoded if one isn't.
+    std::vector<SharedInputs> shared(looks.size());
+    std::map<std::string, Buffer<float, 3>> linear;
+    std::map<std::string, size_t> missing; // Front-end key -> first look needing it.
+    const std::string digest = front_cache_digest(cfg, cfg.input_path);
+    auto cache_key = [&](const ProcessConfig& lc) {
+        return digest.empty() ? std::string() : FrontCache::key(digest, front_end_key(lc));
+    };
+    for (size_t n = 0; n < looks.size(); n++) {
+        shared[n] = prepare_shared_inputs(looks[n].cfg);
+        const std::string key = front_end_key(looks[n].cfg);
+        if (linear.count(key) || missing.count(key)) continue;
+        Buffer<float, 3> cached;
+        if (!digest.empty() && front_cache(cfg)->load(cache_key(looks[n].cfg), cached)) {
+            linear.emplace(key, std::move(cached));
+        } else {
+            missing.emplace(key, n);
+        }
+    }
+    double decode_ms = 0;
+    auto front_start = std::chrono::steady_clock::now();
+    if (!missing.empty()) {
+        RawImageData raw;
+        try {
+            raw = load_front_end_input(cfg, cfg.input_path);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "%s: %s\n", cfg.input_path.c_str(), e.what());
+            return 1;
+        }
+        decode_ms = ms_since(front_start);
+        for (const auto& [key, n] : missing) {
+            Buffer<float, 3> out;
+            int result = run_front_end(looks[n].cfg, raw, shared[n], out);
+            if (result != 0) {
+                fprintf(stderr, "Error: front end for look '%s' failed with error %d\n", looks[n].name.c_str(), result);
+                return 1;
+            }
+            if (!digest.empty()) front_cache(cfg)->store(cache_key(looks[n].cfg), out);
+            linear.emplace(key, std::move(out));
+        }
+        // The mosaic is released here, before the back ends.
+    }
+    const double front_ms = ms_since(front_start) - decode_ms;
+
+    // --- Back ends, in parallel ---
+    std::atomic<size_t> next{0};
+    std::atomic<int> failures{0};
+    auto back_start = std::chrono::steady_clock::now();
+    auto render_look = [&](size_t n) {
+        const Look& look = looks[n];
+        Buffer<float, 3> front = linear.at(front_end_key(look.cfg));
+        Buffer<uint8_t, 3> output(front.width(), front.height(), 3);
+        int result = run_back_end(look.cfg, shared[n], front, output);
+        if (result != 0) throw std::runtime_error("Halide pipeline failed with error " + std::to_string(result));
+        save_output(output, look.output_path, encode_options(look.cfg));
+    };
+    const int jobs = std::max(1, std::min(cfg.look_jobs, static_cast<int>(looks.size())));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++) {
+        workers.emplace_back([&] {
+            for (size_t n; (n = next++) < looks.size();) {
+                try {
+                    render_look(n);
+                    fprintf(stderr, "[%zu/%zu] %s -> %s\n", n + 1, looks.size(), looks[n].name.c_str(),
+                            looks[n].output_path.c_str());
+                } catch (const std::exception& e) {
+                    fprintf(stderr, "[%zu/%zu] %s: FAILED: %s\n", n + 1, looks.size(), looks[n].name.c_str(), e.what());
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    const double back_ms = ms_since(back_start);
+    fprintf(stdout, "Looks: %zu of %zu in %.2f s (decode %.1f ms, %zu front ends %.1f ms, %zu cached, back ends "
+                    "and encodes %.1f ms/look wall, %d at once).\n",
+            looks.size() - static_cast<size_t>(failures.load()), looks.size(), ms_since(looks_start) / 1000.0,
+            decode_ms, missing.size(), front_ms, linear.size() - missing.size(), back_ms / looks.size(), jobs);
+    report_memory(cfg);
+    return failures == 0 ? 0 : 1;
+}
+#endif
+
+// --- Front-end cache, single input ---
+
+#ifdef PIPELINE_LOOKS
+// process --input with --front-cache: one render through the split
+// pipeline, the front end read from the cache or rendered into it.
+int run_front_cached(const ProcessConfig& cfg) {
+    const SharedInputs shared = prepare_shared_inputs(cfg);
+    Buffer<uint8_t, 3> output;
+    Buffer<float, 3> linear;
+    bool hit = false;
+    int result;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        result = render_front_cached(cfg, cfg.input_path, shared, output, hit,
+                                     cfg.front_out_path.empty() ? nullptr : &linear);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s: %s\n", cfg.input_path.c_str(), e.what());
+        return 1;
+    }
+    if (result != 0) {
+        fprintf(stderr, "Halide pipeline failed with error %d\n", result);
+        return 1;
+    }
+    fprintf(stdout, "Front end %s; render: %f ms\n", hit ? "from cache" : "rendered", ms_since(start));
+    if (!cfg.front_out_path.empty()) {
+        const std::vector<uint8_t> entry = FrontCache::encode(linear);
+        std::ofstream out(cfg.front_out_path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+        if (entry.empty() || !out.flush()) {
+            fprintf(stderr, "Error: could not write front end to %s\n", cfg.front_out_path.c_str());
+            return 1;
+        }
+        fprintf(stderr, "front end: %s (%d x %d, %zu bytes)\n", cfg.front_out_path.c_str(), linear.width(),
+                linear.height(), entry.size());
+    }
+    fprintf(stderr, "output: %s\n", cfg.output_path.c_str());
+    try {
+        save_output(output, cfg.output_path, encode_options(cfg));
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    fprintf(stderr, "        %d %d\n", output.width(), output.height());
+    report_memory(cfg);
+    printf("Success!\n");
+    return 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+    const auto app_start = std::chrono::steady_clock::now();
+
+    if (argc == 1) {
+        print_usage();
+        return 0;
+    }
+
+    // --- Argument Parsing using the new shared parser ---
+    ProcessConfig cfg;
+    try {
+        cfg = parse_args(argc, argv);
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    // Record from here on; the trace is written on every way out of main.
+    struct TraceWriter {
+        std::string path;
+        ~TraceWriter() {
+            if (path.empty()) return;
+            if (TraceEvents::Recorder::get().write(path)) fprintf(stderr, "trace:  %s\n", path.c_str());
+            else fprintf(stderr, "Warning: could not write trace to %s\n", path.c_str());
+        }
+    } trace_writer{cfg.trace_path};
+    // Prints the timers and counters, and writes them to --metrics, on the
+    // way out of main.
+    struct MetricsReport {
+        std::string path;
+        std::chrono::steady_clock::time_point start;
+        ~MetricsReport() {
+            Instrumentation::Registry& registry = Instrumentation::Registry::get();
+            registry.record_time("Total Application Time",
+                                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            registry.print_summary(stdout);
+            if (path.empty()) return;
+            if (registry.write_json(path)) fprintf(stderr, "metrics: %s\n", path.c_str());
+            else fprintf(stderr, "Warning: could not write metrics to %s\n", path.c_str());
+        }
+    } metrics_report{cfg.metrics_path, app_start};
+    if (!cfg.trace_path.empty()) {
+        TraceEvents::Recorder::get().start();
+#ifdef PIPELINE_TRACE
+        halide_set_custom_trace(&TraceEvents::Recorder::halide_trace_hook);
+#endif
+    }
+
+    if (cfg.schedule != "compare") {
+        const std::vector<std::string> schedules = available_schedules();
+        if (std::find(schedules.begin(), schedules.end(), cfg.schedule) == schedules.end()) {
+            fprintf(stderr, "Error: this build has no '%s' schedule (BUILD_AUTOSCHEDULED_PIPELINES).\n",
+                    cfg.schedule.c_str());
+            return 1;
+        }
+    }
+#ifndef PIPELINE_JIT
+    if (cfg.jit) {
+        fprintf(stderr, "Warning: this build has no JIT pipeline (BUILD_JIT_PIPELINE); --jit ignored.\n");
+    }
+#endif
+#ifndef PIPELINE_LOW_MEMORY
+    if (cfg.memory_budget_mb > 0) {
+        fprintf(stderr, "Warning: this build has no low-memory pipeline (BUILD_LOW_MEMORY_PIPELINES); "
+                        "--memory-budget ignored.\n");
+    }
+#endif
+
+    ThreadPool::get().configure_halide(cfg.threads, cfg.thread_pool, thread_cores(cfg));
+    PipelineUtils::set_memoization_cache_size();
+    if (cfg.mem_report || cfg.alloc_pool || cfg.huge_pages) HalideMemory::Tracker::install();
+    HalideMemory::Pool::get().set_enabled(cfg.alloc_pool);
+    HalideMemory::Pool::get().set_huge_pages(cfg.huge_pages);
+
+#ifndef PIPELINE_PROFILE
+    if (cfg.profile) {
+        fprintf(stderr, "Warning: this build has no profiled pipeline (BUILD_PROFILE_PIPELINES); ignoring --profile.\n");
+        cfg.profile = false;
+    }
+#endif
+#ifndef PIPELINE_LOOKS
+    if (!cfg.front_cache_dir.empty()) {
+        fprintf(stderr, "Warning: --front-cache needs the look pipelines, which only process_f32 links; ignoring it.\n");
+        cfg.front_cache_dir.clear();
+    }
+    if (!cfg.front_out_path.empty()) {
+        fprintf(stderr, "Error: --front-out needs the look pipelines, which only process_f32 links.\n");
+        return 1;
+    }
+#endif
+
+    if (!cfg.calibrate_defects_path.empty()) {
+        if (cfg.output_path.empty()) {
+            fprintf(stderr, "Error: --calibrate-defects requires --output <defect map file>.\n\n");
+            print_usage();
+            return 1;
+        }
+        set_raw_decode_threads(cfg.decode_threads);
+        return run_calibrate_defects(cfg);
+    }
+
+    if (!cfg.output_shm.empty() && cfg.serve_path.empty()) {
+        fprintf(stderr, "Error: --output-shm is an option of --serve jobs, for clients on the same machine.\n");
+        return 1;
+    }
+    if (!cfg.serve_path.empty()) {
+        return run_server(cfg);
+    }
+
+    if (cfg.thumbnail > 0) {
+        if (cfg.input_path.empty() || cfg.output_path.empty()) {
+            fprintf(stderr, "Error: --thumbnail requires --input and --output.\n\n");
+            print_usage();
+            return 1;
+        }
+        if (!cfg.batch_path.empty() || !cfg.sequence_path.empty() || !cfg.looks_path.empty() ||
+            !cfg.farm_workers.empty() || !cfg.burst_paths.empty()) {
+            fprintf(stderr, "Error: --thumbnail renders one --input (or one per --serve job); it can't be combined "
+                            "with --batch, --sequence, --looks, --farm or --burst-frames.\n");
+            return 1;
+        }
+        set_raw_decode_threads(cfg.decode_threads);
+        try {
+            const int result = run_thumbnail(cfg, nullptr);
+            if (result != 0) fprintf(stderr, "Error: Halide pipeline failed with error %d\n", result);
+            return result == 0 ? 0 : 1;
+        } catch (const std::exception& e) {
+            fprintf(stderr, "Error: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    if (!cfg.farm_workers.empty()) {
+        if (cfg.output_path.empty() || (cfg.input_path.empty() == cfg.batch_path.empty())) {
+            fprintf(stderr, "Error: --farm renders one --input or a --batch, to --output.\n\n");
+            print_usage();
+            return 1;
+        }
+        if (!cfg.sequence_path.empty() || !cfg.looks_path.empty() || !cfg.export_sizes.empty() ||
+            !cfg.deep_zoom_path.empty() || (cfg.batch_path.empty() && cfg.crop_width > 0)) {
+            fprintf(stderr, "Error: --farm can't be combined with --sequence, --looks, --outputs, --deep-zoom "
+                            "or --crop.\n");
+            return 1;
+        }
+        return run_farm(cfg, farm_job_options(argc, argv));
+    }
+
+    if (!cfg.sequence_path.empty()) {
+        if (!cfg.burst_paths.empty() || !cfg.batch_path.empty() || !cfg.looks_path.empty()) {
+            fprintf(stderr, "Error: --sequence can't be combined with --burst-frames, --batch or --looks.\n");
+            return 1;
+        }
+        if (cfg.output_path.empty()) {
+            fprintf(stderr, "Error: --sequence requires --output <file, fifo or - for stdout>.\n\n");
+            print_usage();
+            return 1;
+        }
+        if (cfg.mem_report && cfg.sequence_jobs > 1) {
+            fprintf(stderr, "Warning: --mem-report counts the %d pipelines in flight together.\n", cfg.sequence_jobs);
+        }
+        return run_sequence(cfg);
+    }
+
+    if (!cfg.export_sizes.empty()) {
+        if (!cfg.batch_path.empty() || !cfg.looks_path.empty() || cfg.input_path.empty()) {
+            fprintf(stderr, "Error: --outputs renders one --input; it can't be used with --batch or --looks.\n\n");
+            print_usage();
+            return 1;
+        }
+#ifdef PIPELINE_EXPORT_SIZES
+        set_raw_decode_threads(cfg.decode_threads);
+        return run_export(cfg);
+#else
+        fprintf(stderr, "Error: --outputs needs camera_pipe_f32_export, which only process_f32 links.\n");
+        return 1;
+#endif
+    }
+
+    if (!cfg.looks_path.empty()) {
+        if (!cfg.batch_path.empty() || cfg.input_path.empty() || cfg.output_path.empty()) {
+            fprintf(stderr, "Error: --looks renders one --input to --output <dir|template>; it can't be used with --batch.\n\n");
+            print_usage();
+            return 1;
+        }
+#ifdef PIPELINE_LOOKS
+        set_raw_decode_threads(cfg.decode_threads);
+        return run_looks(cfg);
+#else
+        fprintf(stderr, "Error: --looks needs the look pipelines, which only process_f32 links.\n");
+        return 1;
+#endif
+    }
+
+    if (!cfg.batch_path.empty()) {
+        if (!cfg.burst_paths.empty()) {
+            fprintf(stderr, "Error: --burst-frames merges into a single --input; it can't be used with --batch.\n");
+            return 1;
+        }
+        if (cfg.output_path.empty()) {
+            fprintf(stderr, "Error: --batch requires --output <dir or template containing {name}>.\n\n");
+            print_usage();
+            return 1;
+        }
+        return run_batch(cfg);
+    }
+
+    if (cfg.input_path.empty() || (cfg.output_path.empty() && cfg.deep_zoom_path.empty())) {
+        fprintf(stderr, "Error: --input and --output arguments are required for command-line processing.\n\n");
+        print_usage();
+        return 1;
+    }
+
+#ifdef PIPELINE_LOOKS
+    if (!cfg.front_cache_dir.empty() || !cfg.front_out_path.empty()) {
+        if (cfg.output_path.empty() || !cfg.deep_zoom_path.empty()) {
+            fprintf(stderr, "Error: --front-cache and --front-out render to --output; they can't be used with "
+                            "--deep-zoom.\n");
+            return 1;
+        }
+        set_raw_decode_threads(cfg.decode_threads);
+        return run_front_cached(cfg);
+    }
+#endif
+
+    // --- Load Input using the new raw_load module ---
+    set_raw_decode_threads(cfg.decode_threads);
+    std::unique_ptr<RawRowStream> row_stream;
+    RawImageData raw_data;
+    try {
+        row_stream = open_row_stream(cfg);
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    raw_data = row_stream ? row_stream->raw() : load_input(cfg, cfg.input_path);
+    fprintf(stderr, "       %d %d\n", raw_data.width(), raw_data.height());
+    // The auto settings' statistics cover the whole mosaic.
+    if (row_stream && (cfg.auto_exposure || !cfg.auto_wb.empty())) row_stream->wait_rows(raw_data.height());
+    apply_auto_settings(cfg, raw_data, true);
+
+    SharedInputs shared = prepare_shared_inputs(cfg);
+    FrameInputs frame = prepare_frame_inputs(cfg, raw_data, true);
+
+    try {
+        output_region(cfg, raw_data);
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    if (!cfg.tap.empty()) {
+#ifdef PIPELINE_TAP
+        return run_tap(cfg, raw_data, shared, frame);
+#else
+        fprintf(stderr, "Error: --tap needs camera_pipe_f32_tap, which process_f32 links with BUILD_TAP_PIPELINE.\n");
+        return 1;
+#endif
+    }
+
+    if (cfg.stream_rows > 0 && !cfg.output_path.empty() && !can_stream(cfg, cfg.output_path)) {
+        fprintf(stderr, "Warning: --stream-rows needs PNG, JPEG or TIFF output; rendering the whole frame.\n");
+    }
+
+    // The tile pyramid is built from the bands of a streamed render, or from
+    // the whole frame if the output can't be streamed.
+    std::unique_ptr<DeepZoomWriter> deep_zoom;
+    if (!cfg.deep_zoom_path.empty()) {
+        try {
+            const Buffer<uint8_t, 3> size = make_output(cfg, raw_data);
+            deep_zoom = std::make_unique<DeepZoomWriter>(
+                cfg.deep_zoom_path, size.width(), size.height(),
+                cfg.deep_zoom_format == "png" ? ImageEncoders::Format::PNG : ImageEncoders::Format::JPEG,
+                encode_options(cfg));
+        } catch (const std::exception& e) {
+            fprintf(stderr, "Error: %s\n", e.what());
+            return 1;
+        }
+    }
+    const bool output_streams = ImageEncoders::is_supported(ImageEncoders::format_for_path(cfg.output_path));
+    const bool streamed = cfg.output_path.empty() || (output_streams && (cfg.stream_rows > 0 || deep_zoom));
+
+#ifdef PIPELINE_PROFILE
+    // Only the timed runs below go into the report.
+    if (cfg.profile) halide_profiler_reset();
+#endif
+
+    if (streamed) {
+        // The file is written as the bands complete, so this runs once and
+        // the time includes encoding.
+        int bands = 0;
+        int result;
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            result = render_streamed(cfg, raw_data, shared, frame, cfg.output_path, encode_options(cfg), bands,
+                                     deep_zoom.get(), row_stream.get());
+        } catch (const std::runtime_error& e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+        if (result != 0) {
+            fprintf(stderr, "Halide pipeline failed with error %d\n", result);
+            return 1;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        fprintf(stdout, "Streamed render and save: %f ms in %d bands\n", elapsed.count() * 1000.0, bands);
+        if (!cfg.output_path.empty()) fprintf(stderr, "output: %s\n", cfg.output_path.c_str());
+    } else {
+        Buffer<uint8_t, 3> output = make_output(cfg, raw_data);
+
+        // --- Halide Pipeline Execution and Benchmarking ---
+        double best_time = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < cfg.timing_iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            run_pipeline(cfg, raw_data, shared, frame, output);
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> elapsed = end - start;
+            if (elapsed.count() < best_time) {
+                best_time = elapsed.count();
+            }
+        }
+
+        if (getenv("HL_PROFILE") == nullptr) {
+            #if defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_GPU)
+                fprintf(stdout, "Using float32 GPU pipeline.\n");
+            #elif defined(PIPELINE_PRECISION_F32) && defined(PIPELINE_HALF)
+                fprintf(stdout, "Using float32 pipeline with float16 storage.\n");
+            #elif defined(PIPELINE_PRECISION_F32)
+                fprintf(stdout, "Using float32 pipeline.\n");
+            #elif defined(PIPELINE_PRECISION_U16)
+                fprintf(stdout, "Using uint16_t pipeline.\n");
+            #endif
+            fprintf(stdout, "Halide pipeline execution time: %f ms\n", best_time * 1000.0);
+        }
+
+        if (cfg.schedule == "compare") {
+            // The loop above ran the manual schedule (and wrote the output
+            // that is saved); time the autoscheduled builds the same way,
+            // without the profiler or tracing so the numbers compare.
+            fprintf(stdout, "%-20s %12s %10s\n", "schedule", "best ms", "vs manual");
+            fprintf(stdout, "%-20s %12.3f %9.2fx\n", "manual", best_time * 1000.0, 1.0);
+            for (const std::string& schedule : available_schedules()) {
+                if (schedule == "manual") continue;
+                ProcessConfig auto_cfg = cfg;
+                auto_cfg.schedule = schedule;
+                auto_cfg.profile = false;
+                auto_cfg.trace_path.clear();
+                Buffer<uint8_t, 3> auto_output = make_output(cfg, raw_data);
+                double auto_best = std::numeric_limits<double>::infinity();
+                for (int i = 0; i < cfg.timing_iterations; i++) {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    run_pipeline(auto_cfg, raw_data, shared, frame, auto_output);
+                    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+                    auto_best = std::min(auto_best, elapsed.count());
+                }
+                fprintf(stdout, "%-20s %12.3f %9.2fx\n", schedule.c_str(), auto_best * 1000.0, auto_best / best_time);
+            }
+        }
+
+        // GPU builds leave the result on the device.
+        output.copy_to_host();
+
+        {
+            fprintf(stderr, "output: %s\n", cfg.output_path.c_str());
+            try {
+                save_output(output, cfg.output_path, encode_options(cfg));
+            } catch (const std::runtime_error& e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 1;
+            }
+            fprintf(stderr, "        %d %d\n", output.width(), output.height());
+        }
+        if (deep_zoom) {
+            try {
+                Instrumentation::ScopedTimer tiles_timer("Deep Zoom Tiles");
+                deep_zoom->write_rows(output);
+                deep_zoom->finish();
+            } catch (const std::exception& e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 1;
+            }
+        }
+    }
+    if (deep_zoom) {
+        fprintf(stderr, "deep zoom: %s (%d tiles)\n", cfg.deep_zoom_path.c_str(), deep_zoom->tiles_written());
+    }
+
+    report_memory(cfg);
+    // Side files are named after the output, or the .dzi without one.
+    const std::string& base_path = cfg.output_path.empty() ? cfg.deep_zoom_path : cfg.output_path;
+#ifdef PIPELINE_PROFILE
+    if (cfg.profile) {
+        std::string json_path = cfg.profile_json_path.empty()
+            ? base_path.substr(0, base_path.find_last_of('.')) + "_profile.json"
+            : cfg.profile_json_path;
+        report_profile(json_path);
+    }
+#endif
+
+    std::string curve_png_path = base_path.substr(0, base_path.find_last_of('.')) + "_curve.png";
     if (ToneCurveUtils::render_curves_to_png(cfg, curve_png_path.c_str())) {
         fprintf(stderr, "curve:  %s\n", curve_png_path.c_str());
     }
@@ -1,5 +1,8 @@
 #include "process_options.h"
+#include "color_profile.h"
+#include "debug_taps.h"
 #include "tone_curve_utils.h"
+#include <cctype>
 #include <iostream>
 #include <algorithm>
 #include <sstream>
@@ -14,27 +17,202 @@ static bool parse_point(const std::string& s, Point& p) {
 }
 
 void print_usage() {
-    printf("Usage: ./process --input <raw_file> --output <out.png> [options]\n\n"
+    printf("Usage: ./process --input <raw_file> --output <out.png> [options]\n"
+           "       ./process --batch <dir|list> --output <dir|template> [options]\n"
+           "       ./process --sequence <dir|list> --output <file|fifo|-> [options]\n\n"
            "This executable is compiled for a specific precision. Run 'process_f32' or 'process_u16'.\n"
            "The 'rawr' executable provides a graphical user interface.\n\n"
            "Required arguments for command-line processing:\n"
            "  --input <path>         Path to the input RAW file (e.g. .dng, .arw, .cr2).\n"
            "  --output <path>        Path for the output 8-bit image file.\n\n"
            "Input Options:\n"
-           "  --raw-png              Treat input as a 16-bit grayscale PNG (legacy format).\n\n"
+           "  --raw-png              Treat input as a 16-bit grayscale PNG (legacy format).\n"
+           "                         (.oraw raw containers from capture are recognized by extension.)\n"
+           "  --half-size            Bin each 2x2 CFA quad on load: a half-size raw, for fast previews and\n"
+           "                         culling at a quarter of the memory.\n"
+           "  --decode-threads <n>   Threads RawSpeed may use to decode the raw. 0=all cores (default: 0).\n"
+           "  --defect-map <file>    Correct the hot and stuck pixels listed in this file (one per camera body,\n"
+           "                         from --calibrate-defects) as each raw loads: each takes the median of its\n"
+           "                         same-colour neighbours, and no other pixel is touched.\n"
+           "  --calibrate-defects <dir|list> Find the pixels that stand out in every one of these dark frames\n"
+           "                         (lens capped, at the exposure and ISO to be corrected) and write them to\n"
+           "                         --output as a defect map, instead of rendering.\n\n"
+           "Threading Options (process and rawr):\n"
+           "  --threads <n>          Threads for the Halide pipeline. 0=HL_NUMTHREADS or all cores (default: 0).\n"
+           "  --thread-pool          Run Halide's parallel loops and PNG strip compression on one shared pool\n"
+           "                         of --threads threads instead of a pool each.\n"
+           "  --affinity <all|big|numa> With 'big', keep the pipeline on the fastest cores of a big.LITTLE\n"
+           "                         CPU. With 'numa', pin the shared pool's threads per NUMA node and give\n"
+           "                         each node its own band of every strip loop, with the raw's rows placed\n"
+           "                         in the memory of the node that reads them (default: all).\n\n"
+           "Output Options (format follows the --output extension: .png, .jpg, .tif):\n"
+           "  --jpeg-quality <1-100> JPEG quality (default: 92).\n"
+           "  --jpeg-subsampling <n> Chroma subsampling: 444, 422 or 420 (default: 420).\n"
+           "  --png-level <0-9>      PNG zlib compression level (default: 6).\n"
+           "  --png-filter <name>    PNG row filter: none, sub, up, paeth, adaptive (default: up).\n"
+           "  --png-strips <n>       Deflate PNG rows in n strips in parallel. 0=one per core (default: 0).\n"
+           "  --tiff-compression <c> TIFF compression: none or lzw (default: none).\n"
+           "  --stream-rows <n>      Render and encode the output in bands of about n rows, bounding memory\n"
+           "                         by the band instead of the frame. Bands are recomputed with the halo\n"
+           "                         each stage needs, so smaller bands cost more time. 0=off (default: 0).\n"
+           "  --stream-input         With --stream-rows and a raw container input, read the file in the\n"
+           "                         background and start each band once the rows it reads are in.\n\n"
+           "Export Options (with --input; process_f32):\n"
+           "  --outputs <list>       Write several sizes from one decode and one pipeline run, in place of\n"
+           "                         --output: size:path pairs, e.g. full:out.jpg,2048:web.jpg,256:thumb.jpg.\n"
+           "                         A number is the long edge in pixels; full is the --downscale size. Up\n"
+           "                         to 2 reduced sizes, averaged down from the full image in the same run.\n\n"
+           "Thumbnail Options (with --input, or in --serve jobs):\n"
+           "  --thumbnail <n>        Write a thumbnail at most n pixels on its long edge instead of a render:\n"
+           "                         the raw's embedded JPEG (the camera's rendering) when it has one at least\n"
+           "                         n pixels long, else the raw binned straight down to n through the live\n"
+           "                         view's chain (look and tone curve; no denoise, local contrast or lens\n"
+           "                         geometry).\n\n"
+           "Deep Zoom Options (with --input):\n"
+           "  --deep-zoom <file.dzi> Also write a Deep Zoom tile pyramid (256px tiles in <file>_files/), built\n"
+           "                         while the image renders in bands; --output is then optional.\n"
+           "  --deep-zoom-format <f> Tile format: jpg or png (default: jpg).\n\n"
+           "Batch Options (instead of --input):\n"
+           "  --batch <dir|list>     Process every raw file in a directory, or each path listed in a text file.\n"
+           "                         --output is then a directory, or a template such as \"out/{name}.png\".\n"
+           "  --batch-decoders <n>   Files decoded concurrently ahead of the pipeline (default: 1).\n"
+           "  --batch-encoders <n>   Output images encoded concurrently behind the pipeline (default: 2).\n"
+           "  --batch-manifest <f>   Record each output's input (size, mtime), settings and build here, and skip\n"
+           "                         inputs whose output is still current, so re-runs render only what changed.\n\n"
+           "Sequence Options (instead of --input):\n"
+           "  --sequence <dir|list>  Render an ordered time lapse (a directory, sorted by name, or a list file)\n"
+           "                         as one stream of rgb24 frames on --output, a file or fifo or - for\n"
+           "                         stdout, e.g. for 'ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i - out.mp4'.\n"
+           "  --deflicker <frames>   Smooth each frame's level over this many frames and correct its exposure\n"
+           "                         to match, removing flicker but keeping slow changes. 0=off (default: 15).\n"
+           "  --sequence-jobs <n>    Frames decoded and rendered at once; output stays in order (default: 2).\n"
+           "  --read-ahead <n>       With --batch or --sequence, files read into memory ahead of their decode,\n"
+           "                         so reads overlap decoding and rendering. 0=off (default: 4).\n"
+           "  --read-ahead-mb <n>    Most memory the files read ahead take at once (default: 1024).\n\n"
+           "Look Options (with --input; process_f32):\n"
+           "  --looks <file>         Render several looks of one input, decoding it once. Each line of the file\n"
+           "                         is a name then options, e.g. \"warm --color-temp 3400 --contrast 40\".\n"
+           "                         --output is a directory, or a template such as \"out/{name}_{look}.jpg\".\n"
+           "                         Looks render through the editor's front/back split.\n"
+           "  --look-jobs <n>        Looks rendered at once after the shared front end (default: 4).\n\n"
+           "Front-End Cache Options (process_f32):\n"
+           "  --front-cache <dir>    Keep each input's front-end output (linear RGB after demosaic, CA correction\n"
+           "                         and colour matrix) here, keyed by the raw's contents and the front-end\n"
+           "                         options, so re-exports with other back-end settings skip the decode and\n"
+           "                         front end. Applies to --input, --batch, --looks and --serve jobs; renders\n"
+           "                         through the editor's front/back split, except with --adjust masks.\n"
+           "  --front-cache-mb <n>   Size limit of the cache; least recently used entries go first (default: 4096).\n"
+           "  --front-out <file>     Also write --input's front-end output to this file as a cache entry, for\n"
+           "                         the in-browser preview (web/) to run the back end on. Use with --downscale 4.\n\n"
+           "Burst Options (with --input):\n"
+           "  --burst-frames <list>  Comma-separated raws of the same scene, aligned to --input tile by tile\n"
+           "                         and merged into it before processing, for less noise in low light.\n"
+           "  --burst-noise <val>    Per-frame noise in raw units. 0=estimate from --input (default: 0).\n"
+           "  --burst-strength <val> How far a tile may differ and still merge; higher merges more, but\n"
+           "                         ghosts on motion (default: 8).\n\n"
+           "Server Options:\n"
+           "  --serve [address]      Stay resident and read jobs, one per line, from a Unix socket path, a TCP\n"
+           "                         host:port (:port listens on loopback only; name a host, e.g. 0.0.0.0,\n"
+           "                         to take jobs from other machines), or stdin if omitted.\n"
+           "                         A job line holds the usual options, e.g.\n"
+           "                         \"--input a.dng --output a.png --exposure 1\", applied on top of the options\n"
+           "                         the server was started with, plus optional --id <str> and --priority <n>\n"
+           "                         (higher runs first, default 0). Each job is answered with\n"
+           "                         \"ok <id> <queued_ms> <run_ms> <output>\" or \"error <id> <message>\".\n"
+           "                         The line \"quit\" stops the server once pending jobs are done; it isn't\n"
+           "                         taken over TCP.\n"
+           "  --serve-token <secret> Run only TCP jobs that carry --token <secret>. With --farm, sent with\n"
+           "                         every job. Use it whenever --serve listens beyond loopback.\n"
+           "  --output-shm <name>    In a job, in place of --output: write the pixels, unencoded, into this\n"
+           "                         shared memory region the client has sized: a POSIX shm name (/name), a\n"
+           "                         file in /dev/shm or a memfd's /proc/<pid>/fd/<n>. Not allowed in jobs\n"
+           "                         over TCP. The job is answered with\n"
+           "                         \"ok <id> <queued_ms> <run_ms> <name> <width> <height> <stride>\".\n"
+           "  --shm-layout <l>       planar (R, G, B planes, each stride x height bytes, rendered in place),\n"
+           "                         rgb8 or rgba8 (interleaved) (default: rgb8).\n"
+           "  --shm-stride <bytes>   Bytes from one row to the next. 0=packed rows (default: 0).\n"
+           "  --farm <addresses>     Render on these --serve servers (comma-separated) instead of here. With\n"
+           "                         --input, the output is rendered in bands spread over the servers and\n"
+           "                         encoded here in order; with --batch, each server takes the next file as\n"
+           "                         it finishes one. Paths must be the same on every machine (shared storage).\n"
+           "  --farm-band-rows <n>   Output rows per band of a farmed --input (default: 1024).\n"
+           "  --farm-jobs <n>        Jobs in flight on each server (default: 2).\n"
+           "  --farm-scratch <dir>   Shared directory the bands are written to (default: beside --output).\n\n"
+           "Editor Options (rawr only):\n"
+           "  --tile-cache-mb <n>    Texture memory kept for panning back over zoomed-in areas (default: 256).\n"
+           "  --history-cache-mb <n> Memory kept for showing undone/redone edits without rendering, for the\n"
+           "                         preview textures and again for the front-end outputs (default: 256).\n"
+           "  --latency-log <csv>    Log each edit's latency by stage (debounce, queue, host prep, pipeline,\n"
+           "                         handoff, upload, present) from launch. F9 shows p50/p95 of the last\n"
+           "                         edits, F10 starts or stops the log (default path: rawr_latency.csv).\n"
+           "  --filmstrip-radius <n> PageUp/PageDown step through the raws in the input's folder; this many\n"
+           "                         images either side are decoded and previewed ahead (default: 2).\n\n"
            "Pipeline Options:\n"
-           "  --demosaic <name>      Demosaic algorithm. 'fast', 'ahd', 'lmmse', or 'ri' (default: fast).\n"
+           "  --demosaic <name>      Demosaic algorithm. 'fast', 'ahd', 'lmmse', 'ri', or 'adaptive' (fast on flat\n"
+           "                         areas, ahd near detail) (default: fast).\n"
            "  --downscale <factor>   Downscale image by this factor (e.g., 2.0 for half size). 1.0=off (default: 1.0).\n"
+           "  --crop <x,y,w,h>       Render only this rectangle of the output, in pixels at the --downscale size.\n"
+           "                         Only the raw the crop needs is processed. Not with --outputs or --looks.\n"
+           "  --orientation <n|auto> EXIF orientation (1-8) to render in, rotating or mirroring as the output is\n"
+           "                         written. auto uses the raw's; 1 keeps it as stored (default: auto).\n"
+           "                         The crop is in the oriented output's pixels.\n"
            "  --exposure <stops>     Exposure compensation in stops, e.g. -1.0, 0.5, 2.0 (default: 0.0).\n"
            "  --green-balance <val>  Green channel equalization factor. 1.0=off (default: 1.0).\n"
            "  --color-temp <K>       Color temperature in Kelvin (default: 3700).\n"
            "  --tint <val>           Green/Magenta tint. >0 -> magenta, <0 -> green (default: 0.0).\n"
+           "  --input-profile <file> Camera profile (.dcp, or an .icc/.icm matrix profile) to use in place of\n"
+           "                         the raw's colour matrices; a DCP's hue/saturation maps and look table\n"
+           "                         are applied too.\n"
+           "  --lut <file.cube>      3D LUT applied after the profile, ahead of the colour grading.\n"
+           "                         Both are baked into the existing LUTs at load; no per-pixel cost.\n"
+           "  --auto-exposure        Choose the exposure from the raw: the median to mid grey, held back so\n"
+           "                         highlights don't clip. --exposure is added to it.\n"
+           "  --auto-wb [grey|white] Choose --color-temp and --tint from the raw's grey world (default) or\n"
+           "                         its brightest unclipped areas. Both read one quarter-resolution pass of\n"
+           "                         the raw; single renders, --batch, --sequence and --outputs.\n"
            "  --ca-strength <val>    Automatic CA correction strength. 0=off (default: 0.0).\n"
            "  --dehaze <val>         Dehaze strength, 0-100 (default: 0.0).\n"
-           "  --iterations <n>       Number of timing iterations for benchmark (default: 5).\n\n"
-           "Denoise Options (Radius is fixed at 2.0):\n"
+           "  --sharpen <val>        Output sharpening (unsharp mask on luma) strength, e.g. 0.5-2.\n"
+           "                         0=off (default: 0.0).\n"
+           "  --sharpen-radius <px>  Sharpening blur sigma in output pixels, 0.3 to 2 (default: 1.0).\n"
+           "  --sharpen-threshold <val> Luma detail, 0 to 1, below which nothing is sharpened, so\n"
+           "                         noise is left alone (default: 0.02).\n"
+           "  --iterations <n>       Number of timing iterations for benchmark (default: 5).\n"
+           "  --schedule <name>      Pipeline schedule: manual, or an autoscheduled build with\n"
+           "                         BUILD_AUTOSCHEDULED_PIPELINES: auto-adams2019, auto-mullapudi2016\n"
+           "                         (CPU), auto-anderson2021 (GPU). 'compare' times every one built, side by\n"
+           "                         side; the image is saved from the manual one (default: manual).\n"
+           "  --jit                  Compile the pipeline for the input's camera (size, CFA layout, levels)\n"
+           "                         and the options' algorithms and disabled stages, cached on disk for\n"
+           "                         later runs (process_f32 built with BUILD_JIT_PIPELINE).\n"
+           "  --tap <stage>          Write this intermediate to --output instead of the image, through a\n"
+           "                         slower autoscheduled build (process_f32 built with BUILD_TAP_PIPELINE):\n"
+           "                         normalized_bayer, ca_corrected, demosaiced (at the raw's size),\n"
+           "                         corrected_f, dehazed, lch_local_adjusted or vignette_corrected, upright.\n"
+           "  --memory-budget <MB>   Use the low-memory schedule (no full-frame intermediates; slower) when a\n"
+           "                         run would take more than this by estimate. Built by default as\n"
+           "                         BUILD_LOW_MEMORY_PIPELINES. 0=no limit (default: 0).\n"
+           "  --profile [json]       Time the profiler-instrumented pipeline and print per-Func time, memory\n"
+           "                         peak and thread use. Also writes a JSON summary to [json], or\n"
+           "                         <output>_profile.json if omitted.\n"
+           "  --trace <json>         Record a Chrome trace (chrome://tracing, ui.perfetto.dev) of the host\n"
+           "                         phases and pipeline runs, with per-Func spans in builds with\n"
+           "                         BUILD_TRACE_PIPELINES. In rawr, F8 also starts and stops a recording.\n"
+           "  --metrics <json>       Write the run's timers (count, p50/p95/p99), counters and byte counts as\n"
+           "                         JSON. A summary is always printed at exit. In rawr, F7 shows\n"
+           "                         recent render latencies.\n"
+           "  --mem-report           Count the pipeline's heap allocations and print each run's peak and\n"
+           "                         allocation count at exit; with --profile, also the Funcs with the\n"
+           "                         largest peaks. In rawr, the F7 overlay shows the peak per render.\n"
+           "  --no-alloc-pool        Return the pipeline's intermediates to the system after every run\n"
+           "                         instead of reusing them in the next one.\n"
+           "  --huge-pages           Back the pipeline's intermediates over 16 MB with 2 MB transparent huge\n"
+           "                         pages (Linux).\n\n"
+           "Denoise Options:\n"
            "  --denoise-strength <val> Denoise strength, 0-100 (default: 50.0).\n"
-           "  --denoise-eps <val>      Denoise filter epsilon (default: 0.01).\n\n"
+           "  --denoise-eps <val>      Denoise filter epsilon; NL-means' h (default: 0.01).\n"
+           "  --denoise-algorithm <name> 'guided', or 'nlmeans' for slower, stronger high-ISO\n"
+           "                         denoising (default: guided).\n\n"
            "Local Adjustment Options (Laplacian Pyramid):\n"
            "  --ll-detail <val>      Local detail enhancement, -100 to 100 (default: 0).\n"
            "  --ll-clarity <val>     Local clarity (mid-tone contrast), -100 to 100 (default: 0).\n"
@@ -43,6 +221,12 @@ void print_usage() {
            "  --ll-blacks <val>      Adjust black point, -100 to 100 (default: 0).\n"
            "  --ll-whites <val>      Adjust white point, -100 to 100 (default: 0).\n"
            "  --ll-debug-levels <N>  DEBUG: Reconstruct from N coarsest levels only. -1=off (default: -1).\n\n"
+           "Masked Adjustment Options:\n"
+           "  --adjust <layers>      Dodge and burn: ';'-separated layers of 'shape:params:stops', e.g.\n"
+           "                         \"radial:0.5,0.4,0.3,0.5:+0.7;linear:0.5,0,0.5,0.4:-1\". Positions are\n"
+           "                         fractions of the output. radial:cx,cy,radius,feather (radius as a fraction\n"
+           "                         of the longer edge, feather of the radius); linear:x0,y0,x1,y1 (full\n"
+           "                         effect at x0,y0, none past x1,y1). Costs only the tiles the layers touch.\n\n"
            "Color Grading Options:\n"
            "  --shadows-wheel <x,y>  Color wheel offset for shadows (e.g., \"0.1,-0.05\").\n"
            "  --shadows-luma <val>   Luminance adjustment for shadows.\n"
@@ -60,6 +244,11 @@ void print_usage() {
            "  --camera-model <name>  Camera model for Lensfun lookup (e.g. \"High Quality Camera\").\n"
            "  --lensfun <profile>    Name of lensfun profile to apply (e.g. \"Raspberry Pi High Quality Camera Lens\").\n"
            "  --focal-length <mm>    Focal length in mm for Lensfun lookup (default: 16.0).\n"
+           "  --aperture <f-number>  Aperture the photo was taken at. With a Lensfun profile, corrects the lens's\n"
+           "                         vignetting from its calibration; 0 = off (default: 0).\n"
+           "  --focus-distance <m>   Focus distance for the vignetting calibration (default: 1000).\n"
+           "  --lens-tca             Correct lateral CA from the Lensfun profile's TCA calibration. Where there\n"
+           "                         is one, the --ca-strength estimate is skipped.\n"
            "  --dist-k1 <val>        Manual distortion coefficient k1 (overrides lensfun).\n"
            "  --dist-k2 <val>        Manual distortion coefficient k2 (overrides lensfun).\n"
            "  --dist-k3 <val>        Manual distortion coefficient k3 (overrides lensfun).\n"
@@ -84,13 +273,15 @@ void print_usage() {
            "  --curve-r <str>        Red channel curve points. Overrides --curve-points for red.\n"
            "  --curve-g <str>        Green channel curve points. Overrides --curve-points for green.\n"
            "  --curve-b <str>        Blue channel curve points. Overrides --curve-points for blue.\n"
-           "  --curve-mode <name>    Curve mode. 'luma' or 'rgb' (default: rgb).\n\n"
+           "  --curve-mode <name>    Curve mode. 'luma' or 'rgb' (default: rgb).\n"
+           "  --tone-curve-size <n>  Entries of a compact, interpolated tone curve LUT, 2-65535, e.g. 1024;\n"
+           "                         0 uses the full 64K table (default: 0).\n\n"
            "  --help                 Display this help message.\n");
 }
 
 
-ProcessConfig parse_args(int argc, char **argv) {
-    ProcessConfig cfg;
+ProcessConfig parse_args(int argc, char **argv, const ProcessConfig& base) {
+    ProcessConfig cfg = base;
 
     if (argc == 1) {
         return cfg; // Return default config for UI if no args
@@ -111,7 +302,8 @@ ProcessConfig parse_args(int argc, char **argv) {
         }
         if (arg.rfind("--", 0) == 0) {
             std::string key = arg.substr(2);
-            if (i + 1 < argc && argv[i + 1][0] != '-') {
+            // A lone "-" is a value (stdout for --output).
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || std::string(argv[i + 1]) == "-")) {
                 args[key] = argv[++i];
             } else {
                 flags.insert(key);
@@ -128,19 +320,185 @@ ProcessConfig parse_args(int argc, char **argv) {
         if (args.count("input")) cfg.input_path = args["input"];
         if (args.count("output")) cfg.output_path = args["output"];
         if (flags.count("raw-png")) cfg.raw_png = true;
+        if (flags.count("half-size")) cfg.half_size = true;
+        if (args.count("defect-map")) cfg.defect_map_path = args["defect-map"];
+        if (args.count("calibrate-defects")) cfg.calibrate_defects_path = args["calibrate-defects"];
+        if (args.count("decode-threads")) cfg.decode_threads = std::stoi(args["decode-threads"]);
+        if (args.count("threads")) cfg.threads = std::stoi(args["threads"]);
+        if (flags.count("thread-pool")) cfg.thread_pool = true;
+        if (args.count("affinity")) {
+            cfg.affinity = args["affinity"];
+            if (cfg.affinity != "all" && cfg.affinity != "big" && cfg.affinity != "numa") {
+                throw std::runtime_error("--affinity must be 'all', 'big' or 'numa'");
+            }
+        }
+        if (args.count("jpeg-quality")) cfg.jpeg_quality = std::stoi(args["jpeg-quality"]);
+        if (args.count("jpeg-subsampling")) cfg.jpeg_subsampling = std::stoi(args["jpeg-subsampling"]);
+        if (args.count("png-level")) cfg.png_level = std::stoi(args["png-level"]);
+        if (args.count("png-filter")) cfg.png_filter = args["png-filter"];
+        if (args.count("png-strips")) cfg.png_strips = std::stoi(args["png-strips"]);
+        if (args.count("tiff-compression")) cfg.tiff_compression = args["tiff-compression"];
+        if (args.count("outputs")) {
+            cfg.export_sizes.clear();
+            std::stringstream list(args["outputs"]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                if (item.empty()) continue;
+                const size_t colon = item.find(':');
+                if (colon == std::string::npos || colon + 1 == item.size()) {
+                    throw std::runtime_error("--outputs entries are size:path, got '" + item + "'");
+                }
+                ExportSize size;
+                const std::string edge = item.substr(0, colon);
+                size.long_edge = edge == "full" ? 0 : std::stoi(edge);
+                if (size.long_edge < 0) throw std::runtime_error("--outputs sizes must be positive");
+                size.path = item.substr(colon + 1);
+                cfg.export_sizes.push_back(size);
+            }
+        }
+        if (args.count("thumbnail")) {
+            cfg.thumbnail = std::stoi(args["thumbnail"]);
+            if (cfg.thumbnail <= 0) throw std::runtime_error("--thumbnail must be a positive size in pixels");
+        }
+        if (args.count("deep-zoom")) cfg.deep_zoom_path = args["deep-zoom"];
+        if (args.count("deep-zoom-format")) {
+            cfg.deep_zoom_format = args["deep-zoom-format"];
+            if (cfg.deep_zoom_format != "jpg" && cfg.deep_zoom_format != "png") {
+                throw std::runtime_error("--deep-zoom-format must be 'jpg' or 'png'");
+            }
+        }
+        if (args.count("stream-rows")) cfg.stream_rows = std::stoi(args["stream-rows"]);
+        if (flags.count("stream-input")) cfg.stream_input = true;
+        if (args.count("batch")) cfg.batch_path = args["batch"];
+        if (args.count("batch-decoders")) cfg.batch_decode_workers = std::stoi(args["batch-decoders"]);
+        if (args.count("batch-encoders")) cfg.batch_encode_workers = std::stoi(args["batch-encoders"]);
+        if (args.count("batch-manifest")) cfg.batch_manifest_path = args["batch-manifest"];
+        if (args.count("sequence")) cfg.sequence_path = args["sequence"];
+        if (args.count("deflicker")) cfg.deflicker_window = std::stoi(args["deflicker"]);
+        if (args.count("sequence-jobs")) cfg.sequence_jobs = std::stoi(args["sequence-jobs"]);
+        if (args.count("read-ahead")) cfg.read_ahead_files = std::stoi(args["read-ahead"]);
+        if (args.count("read-ahead-mb")) cfg.read_ahead_mb = std::stoi(args["read-ahead-mb"]);
+        if (args.count("looks")) cfg.looks_path = args["looks"];
+        if (args.count("look-jobs")) cfg.look_jobs = std::stoi(args["look-jobs"]);
+        if (args.count("front-cache")) cfg.front_cache_dir = args["front-cache"];
+        if (args.count("front-cache-mb")) cfg.front_cache_mb = std::stoi(args["front-cache-mb"]);
+        if (args.count("front-out")) cfg.front_out_path = args["front-out"];
+        if (args.count("burst-frames")) {
+            cfg.burst_paths.clear();
+            std::stringstream list(args["burst-frames"]);
+            std::string path;
+            while (std::getline(list, path, ',')) {
+                if (!path.empty()) cfg.burst_paths.push_back(path);
+            }
+        }
+        if (args.count("burst-noise")) cfg.burst_noise = std::stof(args["burst-noise"]);
+        if (args.count("burst-strength")) cfg.burst_strength = std::stof(args["burst-strength"]);
+        if (args.count("output-shm")) cfg.output_shm = args["output-shm"];
+        if (args.count("shm-layout")) {
+            cfg.shm_layout = args["shm-layout"];
+            if (cfg.shm_layout != "planar" && cfg.shm_layout != "rgb8" && cfg.shm_layout != "rgba8") {
+                throw std::runtime_error("--shm-layout must be 'planar', 'rgb8' or 'rgba8'");
+            }
+        }
+        if (args.count("shm-stride")) {
+            cfg.shm_stride = std::stoi(args["shm-stride"]);
+            if (cfg.shm_stride < 0) throw std::runtime_error("--shm-stride must be 0 or more");
+        }
+        if (args.count("serve")) cfg.serve_path = args["serve"];
+        if (flags.count("serve")) cfg.serve_path = "-";
+        if (args.count("serve-token")) cfg.serve_token = args["serve-token"];
+        if (args.count("farm")) cfg.farm_workers = args["farm"];
+        if (args.count("farm-band-rows")) cfg.farm_band_rows = std::max(16, std::stoi(args["farm-band-rows"]));
+        if (args.count("farm-jobs")) cfg.farm_jobs = std::max(1, std::stoi(args["farm-jobs"]));
+        if (args.count("farm-scratch")) cfg.farm_scratch = args["farm-scratch"];
+        if (args.count("tile-cache-mb")) cfg.tile_cache_mb = std::stoi(args["tile-cache-mb"]);
+        if (args.count("latency-log")) cfg.latency_log_path = args["latency-log"];
+        if (args.count("history-cache-mb")) cfg.history_cache_mb = std::stoi(args["history-cache-mb"]);
+        if (args.count("filmstrip-radius")) cfg.filmstrip_radius = std::stoi(args["filmstrip-radius"]);
         if (args.count("demosaic")) cfg.demosaic_algorithm = args["demosaic"];
         if (args.count("downscale")) cfg.downscale_factor = std::stof(args["downscale"]);
+        if (args.count("orientation")) {
+            const std::string value = args["orientation"];
+            cfg.orientation = value == "auto" ? 0 : std::stoi(value);
+            if (cfg.orientation < 0 || cfg.orientation > 8) {
+                throw std::runtime_error("--orientation must be 'auto' or 1-8");
+            }
+        }
+        if (args.count("crop")) {
+            std::stringstream ss(args["crop"]);
+            char c1 = 0, c2 = 0, c3 = 0;
+            ss >> cfg.crop_x >> c1 >> cfg.crop_y >> c2 >> cfg.crop_width >> c3 >> cfg.crop_height;
+            if (ss.fail() || c1 != ',' || c2 != ',' || c3 != ',' || cfg.crop_x < 0 || cfg.crop_y < 0 ||
+                cfg.crop_width <= 0 || cfg.crop_height <= 0) {
+                throw std::runtime_error("--crop is x,y,width,height with a positive size, got '" +
+                                         args["crop"] + "'");
+            }
+            if (!cfg.export_sizes.empty() || !cfg.looks_path.empty()) {
+                throw std::runtime_error("--crop can't be combined with --outputs or --looks");
+            }
+        }
         if (args.count("exposure")) cfg.exposure = std::stof(args["exposure"]);
         if (args.count("green-balance")) cfg.green_balance = std::stof(args["green-balance"]);
         if (args.count("color-temp")) cfg.color_temp = std::stof(args["color-temp"]);
         if (args.count("tint")) cfg.tint = std::stof(args["tint"]);
+        // Loaded here so a bad file is reported as an option error; the
+        // parse is cached for the render.
+        if (args.count("input-profile")) {
+            cfg.input_profile = args["input-profile"];
+            ColorProfile::load_input_profile(cfg.input_profile);
+        }
+        if (args.count("lut")) {
+            cfg.look_lut = args["lut"];
+            ColorProfile::load_cube_lut(cfg.look_lut);
+        }
+        if (flags.count("auto-exposure")) cfg.auto_exposure = true;
+        if (flags.count("auto-wb")) cfg.auto_wb = "grey";
+        if (args.count("auto-wb")) {
+            cfg.auto_wb = args["auto-wb"];
+            if (cfg.auto_wb != "grey" && cfg.auto_wb != "white") {
+                throw std::runtime_error("--auto-wb must be 'grey' or 'white'");
+            }
+        }
         if (args.count("gamma")) cfg.gamma = std::stof(args["gamma"]);
         if (args.count("contrast")) cfg.contrast = std::stof(args["contrast"]);
+        if (args.count("tone-curve-size")) {
+            cfg.tone_curve_size = std::stoi(args["tone-curve-size"]);
+            if (cfg.tone_curve_size != 0 && (cfg.tone_curve_size < 2 || cfg.tone_curve_size >= 65536)) {
+                throw std::runtime_error("--tone-curve-size must be 0 or 2-65535");
+            }
+        }
         if (args.count("ca-strength")) cfg.ca_strength = std::stof(args["ca-strength"]);
         if (args.count("dehaze")) cfg.dehaze_strength = std::stof(args["dehaze"]);
+        if (args.count("sharpen")) cfg.sharpen_strength = std::stof(args["sharpen"]);
+        if (args.count("sharpen-radius")) cfg.sharpen_radius = std::stof(args["sharpen-radius"]);
+        if (args.count("sharpen-threshold")) cfg.sharpen_threshold = std::stof(args["sharpen-threshold"]);
         if (args.count("iterations")) cfg.timing_iterations = std::stoi(args["iterations"]);
+        if (args.count("schedule")) {
+            cfg.schedule = args["schedule"];
+            if (cfg.schedule != "manual" && cfg.schedule != "compare" && cfg.schedule != "auto-adams2019" &&
+                cfg.schedule != "auto-mullapudi2016" && cfg.schedule != "auto-anderson2021") {
+                throw std::runtime_error("--schedule must be 'manual', 'compare', 'auto-adams2019', "
+                                         "'auto-mullapudi2016' or 'auto-anderson2021'");
+            }
+        }
+        if (args.count("profile")) { cfg.profile = true; cfg.profile_json_path = args["profile"]; }
+        if (flags.count("profile")) cfg.profile = true;
+        if (args.count("trace")) cfg.trace_path = args["trace"];
+        if (args.count("metrics")) cfg.metrics_path = args["metrics"];
+        if (flags.count("mem-report")) cfg.mem_report = true;
+        if (flags.count("jit")) cfg.jit = true;
+        if (args.count("tap")) {
+            cfg.tap = args["tap"];
+            if (debug_tap_named(cfg.tap) == DebugTap::Count) {
+                throw std::runtime_error("unknown --tap stage '" + cfg.tap + "'");
+            }
+        }
+        if (args.count("memory-budget")) cfg.memory_budget_mb = std::stoi(args["memory-budget"]);
+        if (flags.count("no-alloc-pool")) cfg.alloc_pool = false;
+        if (flags.count("huge-pages")) cfg.huge_pages = true;
         if (args.count("denoise-strength")) cfg.denoise_strength = std::stof(args["denoise-strength"]);
         if (args.count("denoise-eps")) cfg.denoise_eps = std::stof(args["denoise-eps"]);
+        if (args.count("denoise-algorithm")) cfg.denoise_algorithm = args["denoise-algorithm"];
 
         // --- Curve Parsing ---
         // Parse strings immediately into the vector<Point> representation.
@@ -201,6 +559,15 @@ ProcessConfig parse_args(int argc, char **argv) {
         if (args.count("camera-model")) cfg.camera_model = args["camera-model"];
         if (args.count("lensfun")) cfg.lens_profile_name = args["lensfun"];
         if (args.count("focal-length")) cfg.focal_length = std::stof(args["focal-length"]);
+        if (args.count("aperture")) {
+            cfg.aperture = std::stof(args["aperture"]);
+            if (cfg.aperture < 0.0f) throw std::runtime_error("--aperture must be 0 (off) or an f-number");
+        }
+        if (args.count("focus-distance")) {
+            cfg.focus_distance = std::stof(args["focus-distance"]);
+            if (cfg.focus_distance <= 0.0f) throw std::runtime_error("--focus-distance must be positive");
+        }
+        if (flags.count("lens-tca")) cfg.lens_tca = true;
         if (args.count("dist-k1")) cfg.dist_k1 = std::stof(args["dist-k1"]);
         if (args.count("dist-k2")) cfg.dist_k2 = std::stof(args["dist-k2"]);
         if (args.count("dist-k3")) cfg.dist_k3 = std::stof(args["dist-k3"]);
@@ -210,6 +577,29 @@ ProcessConfig parse_args(int argc, char **argv) {
         if (args.count("vignette-midpoint")) cfg.vignette_midpoint = std::stof(args["vignette-midpoint"]);
         if (args.count("vignette-roundness")) cfg.vignette_roundness = std::stof(args["vignette-roundness"]);
         if (args.count("vignette-highlights")) cfg.vignette_highlights = std::stof(args["vignette-highlights"]);
+        if (args.count("adjust")) {
+            std::stringstream layers(args["adjust"]);
+            std::string spec;
+            while (std::getline(layers, spec, ';')) {
+                if (spec.empty()) continue;
+                AdjustLayer layer;
+                std::stringstream ss(spec);
+                std::string params, stops;
+                char c1 = 0, c2 = 0, c3 = 0;
+                std::getline(ss, layer.shape, ':');
+                std::getline(ss, params, ':');
+                std::getline(ss, stops);
+                std::stringstream ps(params);
+                ps >> layer.a >> c1 >> layer.b >> c2 >> layer.c >> c3 >> layer.d;
+                if ((layer.shape != "radial" && layer.shape != "linear") || ps.fail() ||
+                    c1 != ',' || c2 != ',' || c3 != ',' || stops.empty()) {
+                    throw std::runtime_error("--adjust layers are 'radial:cx,cy,r,f:stops' or "
+                                             "'linear:x0,y0,x1,y1:stops', got '" + spec + "'");
+                }
+                layer.exposure = std::stof(stops);
+                cfg.adjust_layers.push_back(layer);
+            }
+        }
         if (args.count("rotate")) cfg.geo_rotate = std::stof(args["rotate"]);
         if (args.count("scale")) cfg.geo_scale = std::stof(args["scale"]);
         if (args.count("aspect")) cfg.geo_aspect = std::stof(args["aspect"]);
@@ -225,3 +615,80 @@ ProcessConfig parse_args(int argc, char **argv) {
 
     return cfg;
 }
+
+std::vector<std::string> split_option_line(const std::string& line) {
+    std::vector<std::string> args;
+    std::string current;
+    bool in_quotes = false, have_arg = false;
+    for (char ch : line) {
+        if (ch == '"') {
+            in_quotes = !in_quotes;
+            have_arg = true;
+        } else if (!in_quotes && std::isspace(static_cast<unsigned char>(ch))) {
+            if (have_arg) args.push_back(current);
+            current.clear();
+            have_arg = false;
+        } else {
+            current += ch;
+            have_arg = true;
+        }
+    }
+    if (have_arg) args.push_back(current);
+    return args;
+}
+
+std::string render_settings(const ProcessConfig& cfg) {
+    std::ostringstream s;
+    s.precision(9);
+    auto points = [&](const char* name, const std::vector<Point>& curve) {
+        s << name << '=';
+        for (const Point& p : curve) s << p.x << ',' << p.y << ';';
+        s << '\n';
+    };
+    s << "raw_png=" << cfg.raw_png << "\nhalf_size=" << cfg.half_size << "\ndefect_map=" << cfg.defect_map_path
+      << "\ndemosaic=" << cfg.demosaic_algorithm
+      << "\ndownscale=" << cfg.downscale_factor
+      << "\ncrop=" << cfg.crop_x << ',' << cfg.crop_y << ',' << cfg.crop_width << ',' << cfg.crop_height
+      << "\norientation=" << cfg.orientation
+      << "\ncolor_temp=" << cfg.color_temp << "\ntint=" << cfg.tint
+      << "\ninput_profile=" << cfg.input_profile << "\nlut=" << cfg.look_lut
+      << "\nauto=" << cfg.auto_exposure << ',' << cfg.auto_wb
+      << "\nexposure=" << cfg.exposure << "\ngreen_balance=" << cfg.green_balance << "\nca_strength=" << cfg.ca_strength
+      << "\nschedule=" << cfg.schedule << "\nfront_cache=" << !cfg.front_cache_dir.empty()
+      << "\njpeg=" << cfg.jpeg_quality << ',' << cfg.jpeg_subsampling
+      << "\npng=" << cfg.png_level << ',' << cfg.png_filter << ',' << cfg.png_strips
+      << "\ntiff=" << cfg.tiff_compression
+      << "\ndehaze=" << cfg.dehaze_strength
+      << "\nsharpen=" << cfg.sharpen_strength << ',' << cfg.sharpen_radius << ',' << cfg.sharpen_threshold
+      << "\ndenoise=" << cfg.denoise_algorithm << ',' << cfg.denoise_strength << ',' << cfg.denoise_eps
+      << "\nll=" << cfg.ll_detail << ',' << cfg.ll_clarity << ',' << cfg.ll_shadows << ',' << cfg.ll_highlights << ','
+      << cfg.ll_blacks << ',' << cfg.ll_whites << ',' << cfg.ll_debug_level
+      << "\ntonemap=" << cfg.tonemap_algorithm << ',' << cfg.gamma << ',' << cfg.contrast << ',' << cfg.tone_curve_size
+      << "\ncurve_mode=" << cfg.curve_mode << '\n';
+    points("curve_luma", cfg.curve_points_luma);
+    points("curve_r", cfg.curve_points_r);
+    points("curve_g", cfg.curve_points_g);
+    points("curve_b", cfg.curve_points_b);
+    s << "wheels=" << cfg.shadows_wheel.x << ',' << cfg.shadows_wheel.y << ',' << cfg.shadows_luma << ','
+      << cfg.midtones_wheel.x << ',' << cfg.midtones_wheel.y << ',' << cfg.midtones_luma << ','
+      << cfg.highlights_wheel.x << ',' << cfg.highlights_wheel.y << ',' << cfg.highlights_luma << '\n';
+    points("hue_vs_hue", cfg.curve_hue_vs_hue);
+    points("hue_vs_sat", cfg.curve_hue_vs_sat);
+    points("hue_vs_lum", cfg.curve_hue_vs_lum);
+    points("lum_vs_sat", cfg.curve_lum_vs_sat);
+    points("sat_vs_sat", cfg.curve_sat_vs_sat);
+    s << "lens=" << cfg.camera_make << ',' << cfg.camera_model << ',' << cfg.lens_profile_name << ','
+      << cfg.focal_length << ',' << cfg.aperture << ',' << cfg.focus_distance << ',' << cfg.lens_tca
+      << "\nca=" << cfg.ca_red_cyan << ',' << cfg.ca_blue_yellow
+      << "\nvignette=" << cfg.vignette_amount << ',' << cfg.vignette_midpoint << ',' << cfg.vignette_roundness << ','
+      << cfg.vignette_highlights
+      << "\nadjust=";
+    for (const AdjustLayer& l : cfg.adjust_layers) {
+        s << l.shape << ':' << l.a << ',' << l.b << ',' << l.c << ',' << l.d << ':' << l.exposure << ';';
+    }
+    s
+      << "\ndistortion=" << cfg.dist_k1 << ',' << cfg.dist_k2 << ',' << cfg.dist_k3
+      << "\ngeometry=" << cfg.geo_rotate << ',' << cfg.geo_scale << ',' << cfg.geo_aspect << ','
+      << cfg.geo_keystone_v << ',' << cfg.geo_keystone_h << ',' << cfg.geo_offset_x << ',' << cfg.geo_offset_y << '\n';
+    return s.str();
+}
@@ -17,27 +17,249 @@ struct Point { float x, y; };
 // value or respect the user's override.
 constexpr float UNSET_F = std::numeric_limits<float>::lowest();
 
+// One file of process --outputs: the image at the output size (long_edge
+// 0, "full"), or reduced to long_edge pixels on its longer side.
+struct ExportSize {
+    int long_edge = 0;
+    std::string path;
+};
+
+// One masked exposure layer of --adjust (dodge and burn): a shape's
+// coverage times `exposure` stops. Positions are fractions of the output
+// as shown (after --orientation).
+//   radial: a, b = centre; c = radius, a fraction of the longer edge;
+//           d = feather, the fraction of the radius that fades out.
+//   linear: a, b = where the full effect ends; c, d = where it has faded out.
+struct AdjustLayer {
+    std::string shape = "radial";
+    float a = 0.0f, b = 0.0f, c = 0.0f, d = 0.0f;
+    float exposure = 0.0f;
+};
+
 // All pipeline parameters are now encapsulated in this single struct.
 // It is shared between the command-line runner and the new UI editor.
 struct ProcessConfig {
     std::string input_path;
     std::string output_path;
     bool raw_png = false; // If true, load input as a 16-bit grayscale PNG
+    bool half_size = false; // If true, bin the raw to half size on load (bin_raw_half)
     std::string demosaic_algorithm = "fast";
     float downscale_factor = 1.0f;
+    // Render only this rectangle of the output, in pixels at the
+    // --downscale size (process only). crop_width 0 renders the whole frame.
+    int crop_x = 0, crop_y = 0, crop_width = 0, crop_height = 0;
+    // EXIF orientation of the output, 1-8, applied as the pipeline writes it
+    // (process only). 0 takes the raw's own (RawImageData::orientation).
+    int orientation = 0;
     float color_temp = 3700.0f;
     float tint = 0.0f;
+    // A camera profile (.dcp, or a matrix .icc) whose matrices replace the
+    // raw's and whose hue/saturation maps are applied, and a creative .cube
+    // LUT after it; both are baked into inputs the pipeline already has
+    // (color_profile.h). "" for none.
+    std::string input_profile;
+    std::string look_lut;
     float exposure = 0.0f; // in stops. Default to 0.0 (no change)
+    // Choose exposure and white balance from the raw's statistics
+    // (raw_stats; PipelineUtils::auto_settings) before rendering it (process
+    // only). Auto exposure adds its stops to `exposure`; auto_wb ("grey"
+    // world or "white" patch, "" off) replaces color_temp and tint.
+    bool auto_exposure = false;
+    std::string auto_wb;
     float green_balance = 1.0f; // For green channel equalization.
     float ca_strength = 0.0f;
     int timing_iterations = 5;
+    // Which schedule of the pipeline process runs: "manual", one of the
+    // autoscheduled builds ("auto-adams2019", "auto-mullapudi2016",
+    // "auto-anderson2021"; BUILD_AUTOSCHEDULED_PIPELINES), or "compare" to
+    // time every one that is built.
+    std::string schedule = "manual";
+    // Compile camera_pipe_f32 for the raw's size, layout and levels and the
+    // recipe's algorithms and stages off, and cache it on disk (process_f32
+    // with BUILD_JIT_PIPELINE; jit_pipeline.h). Same output, faster runs
+    // once compiled.
+    bool jit = false;
+    // Write this intermediate (a DebugTap name, debug_taps.h) to
+    // --output instead of the image (process_f32 with BUILD_TAP_PIPELINE).
+    std::string tap;
+    // Peak heap a run may take, in MB (process only). Over it by process's
+    // estimate, runs use the low-memory schedule (process_f32 and
+    // process_u16 with BUILD_LOW_MEMORY_PIPELINES). 0 = no limit.
+    int memory_budget_mb = 0;
+    // Profiling (process only): run the profiler-instrumented pipeline and
+    // report per-Func time, memory and thread use. The JSON summary goes to
+    // profile_json_path, or next to the output if that is empty.
+    bool profile = false;
+    std::string profile_json_path;
+    // Chrome trace (process and rawr): write a trace-event JSON of host
+    // phases and pipeline runs to this path. Empty = off.
+    std::string trace_path;
+    // Timers and counters (process only): also write them as JSON here.
+    std::string metrics_path;
+    // Pipeline heap accounting (process only): peak bytes and allocations
+    // per run, reported at exit.
+    bool mem_report = false;
+    // Keep the pipeline's freed intermediates for the next run
+    // (HalideMemory::Pool). --no-alloc-pool turns it off.
+    bool alloc_pool = true;
+    // Back the pipeline's large intermediates with 2 MB huge pages
+    // (HalideMemory::Pool::set_huge_pages; process only).
+    bool huge_pages = false;
+    int decode_threads = 0; // RawSpeed decode threads. 0 = all hardware threads.
+    // Sensor defects (DefectMap, defect_map.h): correct the hot and stuck
+    // pixels listed in this file as each raw is loaded (process only).
+    // Empty is off. calibrate_defects_path is a directory or list of dark
+    // frames to find them in instead of rendering; the map goes to
+    // output_path.
+    std::string defect_map_path;
+    std::string calibrate_defects_path;
+    // Halide parallelism (process and rawr). threads = 0 leaves the runtime
+    // default (HL_NUMTHREADS, else one per core). thread_pool routes
+    // Halide's parallel loops and PNG strips through the shared ThreadPool
+    // (thread_pool.h); affinity "big" keeps them on the big cores of a
+    // big.LITTLE CPU, and "numa" splits them over the sockets of a
+    // multi-socket machine (always on the shared pool), with each node
+    // computing, and holding in its memory, its own band of rows.
+    int threads = 0;
+    bool thread_pool = false;
+    std::string affinity = "all";
+
+    // Output encoding (process only). The format follows the output file's
+    // extension: .png, .jpg/.jpeg or .tif/.tiff.
+    int jpeg_quality = 92;
+    int jpeg_subsampling = 420; // 444, 422 or 420
+    int png_level = 6;
+    std::string png_filter = "up"; // none, sub, up, paeth, adaptive
+    int png_strips = 0; // 0 = one per core
+    std::string tiff_compression = "none"; // none, lzw
+
+    // Several sizes from one run (process_f32 only), in place of
+    // output_path: --outputs full:out.jpg,2048:web.jpg,256:thumb.jpg.
+    std::vector<ExportSize> export_sizes;
+
+    // Streaming output (process only): render the output in bands of this
+    // many rows, each encoded as soon as it is done, so memory is bounded by
+    // the band rather than the frame. 0 renders the whole frame at once.
+    int stream_rows = 0;
+    // With stream_rows, read a raw container --input in on a thread of its
+    // own and start each band as soon as the rows it reads are in
+    // (RawRowStream), rather than after the whole file.
+    bool stream_input = false;
+
+    // Thumbnail mode (process only): write a thumbnail fitting this many
+    // pixels on its long edge instead of a render, from the raw's embedded
+    // JPEG when it has one at least that large, else binned from the raw
+    // through the live view's chain. 0 renders normally.
+    int thumbnail = 0;
+
+    // Server jobs (process only): write the output's pixels into this
+    // shared memory region instead of encoding a file, for a client on the
+    // same machine. A POSIX shared memory name ("/name"), or a path to open
+    // and map, such as /proc/<pid>/fd/<n> for a client's memfd. shm_layout
+    // is "planar" (R, G and B planes, written by the pipeline itself), "rgb8"
+    // or "rgba8" (interleaved); shm_stride is the bytes from one row to the
+    // next, 0 for rows packed end to end.
+    std::string output_shm;
+    std::string shm_layout = "rgb8";
+    int shm_stride = 0;
+
+    // Deep Zoom export (process only): also write a DZI tile pyramid here
+    // (<name>.dzi and <name>_files/), built from the bands as they render.
+    // deep_zoom_format is the tiles' format, jpg or png.
+    std::string deep_zoom_path;
+    std::string deep_zoom_format = "jpg";
+
+    // Batch mode (process only): a directory or a file listing inputs. The
+    // output path is then a directory or a template containing "{name}".
+    // With a manifest, inputs whose outputs are current are skipped.
+    std::string batch_path;
+    int batch_decode_workers = 1;
+    int batch_encode_workers = 2;
+    std::string batch_manifest_path;
+
+    // Burst merge (process only): further frames of the --input scene,
+    // aligned to it and merged in before processing (BurstMergeBuilder).
+    // burst_noise is the frames' noise in raw units, 0 to estimate it from
+    // the reference; burst_strength scales how much difference still counts
+    // as noise.
+    std::vector<std::string> burst_paths;
+    float burst_noise = 0.0f;
+    float burst_strength = 8.0f;
+
+    // Sequence mode (process only): a directory or a file listing the frames
+    // of a time lapse, in order, rendered to one rgb24 stream on the output
+    // path ("-" for stdout). deflicker_window is the number of frames each
+    // frame's level is smoothed over (0 or 1 is off); sequence_jobs is how
+    // many frames render at once.
+    std::string sequence_path;
+    int deflicker_window = 15;
+    int sequence_jobs = 2;
+
+    // Read-ahead for --batch and --sequence (ReadAhead): how many files are
+    // read into memory ahead of their decode, and the most megabytes of them
+    // waiting at once. 0 files is off.
+    int read_ahead_files = 4;
+    int read_ahead_mb = 1024;
+
+    // Multi-look mode (process_f32 only): a file of looks, one per line as a
+    // name and option overrides, each rendered from one decode of the input
+    // to the output template ("{look}"). look_jobs back ends run at once.
+    std::string looks_path;
+    int look_jobs = 4;
+
+    // Front-end cache (process_f32 only): a directory of the split
+    // pipeline's front-end outputs (FrontCache), kept under front_cache_mb
+    // by evicting the least recently used. Empty is off.
+    std::string front_cache_dir;
+    int front_cache_mb = 4096;
+    // Where to also write --input's front-end output as one entry
+    // (FrontCache::encode), for the in-browser preview. Empty is off.
+    std::string front_out_path;
+
+    // Server mode (process only): read jobs from this Unix socket path, a
+    // TCP "host:port" (":port" for loopback only), or from stdin if it is
+    // "-".
+    std::string serve_path;
+    // A secret that jobs over TCP must carry (--token <secret>) to run,
+    // and that a --farm coordinator sends with its jobs. Empty is none.
+    std::string serve_token;
+
+    // Farm mode (process only): hand the work to these servers instead of
+    // rendering here, a comma-separated list of --serve addresses. An
+    // --input is split into bands of farm_band_rows output rows, rendered
+    // into farm_scratch (a directory every server can reach; empty is
+    // beside the output) and encoded here in order; a --batch is handed
+    // out a file at a time. farm_jobs is the jobs in flight per server.
+    std::string farm_workers;
+    int farm_band_rows = 1024;
+    int farm_jobs = 2;
+    std::string farm_scratch;
+
+    // Editor only: memory budget of the zoomed-in tile cache, in MB.
+    int tile_cache_mb = 256;
+    // Editor only: memory budget of the renders kept for undo/redo, in MB,
+    // for the preview textures and again for the front-end outputs.
+    int history_cache_mb = 256;
+    // Editor only: log each edit's latency by stage as CSV here from
+    // launch. F10 starts and stops the log, at this path or
+    // rawr_latency.csv.
+    std::string latency_log_path;
+    // Editor only: how many images either side of the current one in its
+    // folder are decoded ahead (Filmstrip).
+    int filmstrip_radius = 2;
 
     // Dehaze
     float dehaze_strength = 0.0f;
 
+    // Output sharpening (stage_sharpen.h)
+    float sharpen_strength = 0.0f;   // 0 = off
+    float sharpen_radius = 1.0f;     // Blur sigma in output pixels, 0.3 to 2
+    float sharpen_threshold = 0.02f; // Luma detail below this is left alone
+
     // Denoise
     float denoise_strength = 50.0f;
     float denoise_eps = 0.01f;
+    std::string denoise_algorithm = "guided"; // "guided" or "nlmeans"
 
     // Local Laplacian
     float ll_detail = 0.0f;
@@ -52,6 +274,9 @@ struct ProcessConfig {
     int tonemap_algorithm = 3; // 0=linear, 1=reinhard, 2=filmic, 3=gamma
     float gamma = 2.2f;
     float contrast = 50.0f;
+    // Entries of the tone curve LUT: 0 for the full 64K table, or a compact
+    // sqrt-shaped table of this many (ToneCurveUtils::generate_pipeline_lut).
+    int tone_curve_size = 0;
 
     // Curve points are now stored as vectors of points after parsing.
     // "luma" is the fallback/master, the others are overrides.
@@ -82,6 +307,15 @@ struct ProcessConfig {
     std::string camera_model = "";
     std::string lens_profile_name = "None";
     float focal_length = 16.0f;
+    // The f-number and focus distance (metres) the profile's vignetting
+    // calibration is read at (vignetting_lut_for). Aperture 0 leaves the
+    // lens's vignetting uncorrected.
+    float aperture = 0.0f;
+    float focus_distance = 1000.0f;
+    // Correct lateral CA from the profile's TCA calibration (tca_lut_for)
+    // in the lens & geometry stage. Where one is found it replaces the
+    // ca_strength estimate, which is then skipped.
+    bool lens_tca = false;
 
     // Chromatic Aberration (Manual Override)
     float ca_red_cyan = 0.0f;
@@ -93,6 +327,9 @@ struct ProcessConfig {
     float vignette_roundness = 100.0f; // Range [0, 100] in UI
     float vignette_highlights = 0.0f; // Range [0, 100] in UI
 
+    // Masked local adjustments (stage_masked_adjust.h)
+    std::vector<AdjustLayer> adjust_layers;
+
     // Distortion (Manual overrides)
     float dist_k1 = 0.0f;
     float dist_k2 = 0.0f;
@@ -109,12 +346,23 @@ struct ProcessConfig {
 };
 
 
-// Parses command line arguments and populates a ProcessConfig struct.
+// Parses command line arguments and populates a ProcessConfig struct,
+// starting from `base` so the arguments act as overrides.
 // Throws std::runtime_error on parsing failure.
-ProcessConfig parse_args(int argc, char **argv);
+ProcessConfig parse_args(int argc, char **argv, const ProcessConfig& base = ProcessConfig());
+
+// Splits a line of options (a --looks line, a --serve job) into arguments
+// on whitespace; double quotes group words.
+std::vector<std::string> split_option_line(const std::string& line);
 
 // Prints the command-line usage instructions to stdout.
 void print_usage();
 
+// Every option that can change the rendered file, one "name=value" line
+// each, in a fixed order: equal strings mean equal renders of the same
+// input with the same build. Paths, threading and reporting options are
+// left out.
+std::string render_settings(const ProcessConfig& cfg);
+
 
 #endif // PROCESS_OPTIONS_H
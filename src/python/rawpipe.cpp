@@ -0,0 +1,244 @@
+// Python bindings over RawPipeline (src/raw_pipeline.h), built as the
+// `rawpipe` module with -DBUILD_PYTHON_BINDINGS=ON. For training-data
+// generation and other callers that render many crops in one process:
+//
+//   import rawpipe
+//   p = rawpipe.Pipeline("--denoise-strength 20")
+//   p.load("IMG_0001.ARW")
+//   mosaic = p.raw                                  # (height, width) uint16, no copy
+//   crops = p.render_batch([(0, 0, 512, 512), (512, 0, 512, 512)],
+//                          ["--exposure 0.5", "--exposure 1"])
+//
+// Nothing is copied across the boundary. The raw is a read-only view of the
+// decoded mosaic that keeps it alive. Renders are written by the pipeline
+// straight into the NumPy arrays returned, (3, height, width) uint8,
+// channels first as the pipeline lays them out. Loads and renders release
+// the GIL, so contexts on other threads (one per thread, as RawPipeline
+// requires) render concurrently; use_raw_of() lets them share one decode.
+#include "raw_pipeline.h"
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace py = pybind11;
+using Halide::Runtime::Buffer;
+
+namespace {
+
+using Crop = std::array<int, 4>; // x, y, width, height in output pixels
+
+// Process options over `base`, as raw_pipeline_set_options takes them.
+ProcessConfig parse_options(const std::string& options, const ProcessConfig& base) {
+    std::vector<std::string> tokens = split_option_line(options);
+    std::vector<char*> argv;
+    std::string program = "rawpipe";
+    argv.push_back(&program[0]);
+    for (std::string& token : tokens) {
+        if (token == "--help") throw std::runtime_error("--help is not a render option");
+        argv.push_back(&token[0]);
+    }
+    return parse_args(static_cast<int>(argv.size()), argv.data(), base);
+}
+
+class Pipeline {
+public:
+    Pipeline(const std::string& options, const std::string& variant)
+        : context_(parse_options(options, ProcessConfig()), parse_variant(variant)) {}
+
+    void set_options(const std::string& options) { context_.set_config(parse_options(options, ProcessConfig())); }
+
+    void load(const std::string& path) {
+        py::gil_scoped_release release;
+        context_.load(path);
+    }
+
+    void use_raw_of(const Pipeline& other) {
+        if (!other.context_.has_raw()) throw std::runtime_error("the other pipeline has no raw loaded");
+        context_.set_raw(other.context_.raw());
+    }
+
+    // The CFA mosaic as it was decoded, black level not subtracted. The
+    // array holds a (shallow) RawImageData, so the mosaic outlives a later
+    // load().
+    py::array raw() const {
+        require_raw();
+        auto* keep = new RawImageData(context_.raw());
+        py::capsule owner(keep, [](void* p) { delete static_cast<RawImageData*>(p); });
+        const Buffer<uint16_t, 2>& mosaic = keep->bayer_data;
+        const py::ssize_t item = sizeof(uint16_t);
+        py::array_t<uint16_t> array({py::ssize_t(mosaic.height()), py::ssize_t(mosaic.width())},
+                                    {mosaic.dim(1).stride() * item, mosaic.dim(0).stride() * item}, mosaic.data(),
+                                    owner);
+        array.attr("setflags")(py::arg("write") = false);
+        return array;
+    }
+
+    py::dict raw_info() const {
+        require_raw();
+        const RawImageData& raw = context_.raw();
+        py::dict info;
+        info["width"] = raw.width();
+        info["height"] = raw.height();
+        info["cfa_pattern"] = raw.cfa_pattern;
+        info["black_level"] = raw.black_level;
+        info["white_level"] = raw.white_level;
+        return info;
+    }
+
+    std::pair<int, int> output_size(float scale) const {
+        return {context_.output_width(scale), context_.output_height(scale)};
+    }
+
+    py::array_t<uint8_t> render(std::optional<Crop> crop, float scale) {
+        require_raw();
+        Buffer<uint8_t, 3> view;
+        py::array_t<uint8_t> array = make_output(resolve(crop, scale), view);
+        int result;
+        {
+            py::gil_scoped_release release;
+            result = context_.render_into(view, scale);
+        }
+        check(result);
+        return array;
+    }
+
+    // Renders every crop, each with its options (over this context's
+    // config) if given, from the one raw. Crops are rendered grouped by
+    // options, so each distinct set's host inputs are built once, and all
+    // of them without the GIL. The context's config is left as it was.
+    std::vector<py::array_t<uint8_t>> render_batch(const std::vector<std::optional<Crop>>& crops,
+                                                   std::optional<std::vector<std::string>> options, float scale) {
+        require_raw();
+        if (options && options->size() != crops.size()) {
+            throw std::runtime_error("render_batch needs one options string per crop");
+        }
+        // Parsed up front, so a bad option fails before anything renders.
+        const ProcessConfig base = context_.config();
+        std::vector<ProcessConfig> configs{base};
+        std::vector<size_t> config_of(crops.size(), 0);
+        if (options) {
+            std::map<std::string, size_t> seen;
+            for (size_t i = 0; i < crops.size(); ++i) {
+                const std::string& line = (*options)[i];
+                if (line.empty()) continue;
+                auto it = seen.find(line);
+                if (it == seen.end()) {
+                    it = seen.emplace(line, configs.size()).first;
+                    configs.push_back(parse_options(line, base));
+                }
+                config_of[i] = it->second;
+            }
+        }
+
+        std::vector<py::array_t<uint8_t>> arrays;
+        std::vector<Buffer<uint8_t, 3>> views(crops.size());
+        arrays.reserve(crops.size());
+        for (size_t i = 0; i < crops.size(); ++i) {
+            arrays.push_back(make_output(resolve(crops[i], scale), views[i]));
+        }
+
+        std::vector<size_t> order(crops.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return config_of[a] < config_of[b]; });
+        int result = 0;
+        {
+            py::gil_scoped_release release;
+            size_t current = 0;
+            try {
+                for (size_t i : order) {
+                    if (config_of[i] != current) {
+                        current = config_of[i];
+                        context_.set_config(configs[current]);
+                    }
+                    result = context_.render_into(views[i], scale);
+                    if (result != 0) break;
+                }
+            } catch (...) {
+                context_.set_config(base);
+                throw;
+            }
+            context_.set_config(base);
+        }
+        check(result);
+        return arrays;
+    }
+
+private:
+    static RawPipeline::Variant parse_variant(const std::string& variant) {
+        if (variant == "f32") return RawPipeline::Variant::F32;
+        if (variant == "u16") return RawPipeline::Variant::U16;
+        throw std::runtime_error("variant must be 'f32' or 'u16'");
+    }
+
+    void require_raw() const {
+        if (!context_.has_raw()) throw std::runtime_error("no raw loaded");
+    }
+
+    static void check(int result) {
+        if (result != 0) throw std::runtime_error("render failed with error " + std::to_string(result));
+    }
+
+    // The crop, or the whole output at `scale` for none, checked against it.
+    RawPipeline::Region resolve(const std::optional<Crop>& crop, float scale) const {
+        if (!(scale > 0.0f)) throw std::runtime_error("scale must be positive");
+        const int width = context_.output_width(scale), height = context_.output_height(scale);
+        if (!crop) return RawPipeline::Region{0, 0, width, height};
+        const RawPipeline::Region r{(*crop)[0], (*crop)[1], (*crop)[2], (*crop)[3]};
+        if (r.width <= 0 || r.height <= 0 || r.x < 0 || r.y < 0 || r.x + r.width > width || r.y + r.height > height) {
+            throw std::runtime_error("crop (" + std::to_string(r.x) + ", " + std::to_string(r.y) + ", " +
+                                     std::to_string(r.width) + ", " + std::to_string(r.height) +
+                                     ") is outside the " + std::to_string(width) + "x" + std::to_string(height) +
+                                     " output");
+        }
+        return r;
+    }
+
+    // A C-contiguous (3, height, width) array and a Buffer onto its memory
+    // with the crop's offset as its mins, planar as camera_pipe writes.
+    static py::array_t<uint8_t> make_output(const RawPipeline::Region& r, Buffer<uint8_t, 3>& view) {
+        py::array_t<uint8_t> array({py::ssize_t(3), py::ssize_t(r.height), py::ssize_t(r.width)});
+        halide_dimension_t dims[3] = {{r.x, r.width, 1}, {r.y, r.height, r.width}, {0, 3, r.width * r.height}};
+        view = Buffer<uint8_t, 3>(array.mutable_data(), 3, dims);
+        return array;
+    }
+
+    RawPipeline context_;
+};
+
+} // namespace
+
+PYBIND11_MODULE(rawpipe, m) {
+    m.doc() = "Zero-copy bindings over the RawPipeline render context.";
+
+    py::class_<Pipeline>(m, "Pipeline")
+        .def(py::init<const std::string&, const std::string&>(), py::arg("options") = "", py::arg("variant") = "f32",
+             "A render context with `options` (process options, e.g. \"--exposure 0.5\") over the defaults, "
+             "running camera_pipe_f32 or camera_pipe_u16.")
+        .def("set_options", &Pipeline::set_options, py::arg("options"),
+             "Replaces the config with `options` over the defaults.")
+        .def("load", &Pipeline::load, py::arg("path"), "Loads the raw at `path`, as process does.")
+        .def("use_raw_of", &Pipeline::use_raw_of, py::arg("other"),
+             "Shares `other`'s loaded raw without copying or decoding it again.")
+        .def_property_readonly("raw", &Pipeline::raw, "The CFA mosaic, a read-only (height, width) uint16 view.")
+        .def_property_readonly("raw_info", &Pipeline::raw_info,
+                               "The raw's width, height, cfa_pattern, black_level and white_level.")
+        .def("output_size", &Pipeline::output_size, py::arg("scale") = 1.0f,
+             "(width, height) of the whole output at `scale` output pixels per raw pixel.")
+        .def("render", &Pipeline::render, py::arg("crop") = py::none(), py::arg("scale") = 1.0f,
+             "Renders `crop` (x, y, width, height in output pixels; None for all) at `scale` into a new "
+             "(3, height, width) uint8 array.")
+        .def("render_batch", &Pipeline::render_batch, py::arg("crops"), py::arg("options") = py::none(),
+             py::arg("scale") = 1.0f,
+             "Renders each crop, with the matching entry of `options` over this context's config if given "
+             "(\"\" for none), into a list of new (3, height, width) uint8 arrays.");
+}
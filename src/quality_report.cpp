@@ -0,0 +1,376 @@
+// quality_report: image quality against a reference render, and the
+// quality-vs-speed Pareto front of a set of pipeline configurations.
+//
+//   quality_report compare <reference.png> <test.png>
+//       Prints "psnr_db,ssim,delta_e" for the test image: PSNR over the 8-bit
+//       RGB values, SSIM on luma (11x11 Gaussian window, sigma 1.5), and the
+//       mean CIEDE2000 difference, both images read as sRGB. Images of
+//       different sizes are compared over their centered common area.
+//
+//   quality_report pareto <results.csv> <plot.svg>
+//       Reads the per-image rows benchmark_quality.sh writes (config, image,
+//       time_ms, peak_mb, psnr_db, ssim, delta_e), averages each config over
+//       the images, and prints one row per config with a pareto column: 1 if
+//       no other config is both at least as fast and at least as close to the
+//       reference (by mean delta E), and strictly better in one. Writes the
+//       same as a scatter plot of time against delta E with the front joined.
+//
+// benchmark_quality.sh renders the image set through every configuration and
+// runs both.
+
+#include "HalideBuffer.h"
+#include "halide_image_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using Halide::Runtime::Buffer;
+
+namespace {
+
+// --- Metrics ---
+
+struct Quality {
+    double psnr_db = 0, ssim = 0, delta_e = 0;
+};
+
+// An image as float planes, in [0, 1].
+struct Planes {
+    int width = 0, height = 0;
+    std::vector<float> rgb[3];
+};
+
+// The centered width x height area of `image`.
+Planes crop_planes(const Buffer<uint8_t, 3>& image, int width, int height) {
+    if (image.channels() < 3) throw std::runtime_error("Expected an RGB image");
+    Planes p;
+    p.width = width;
+    p.height = height;
+    const int x0 = (image.width() - width) / 2, y0 = (image.height() - height) / 2;
+    for (int c = 0; c < 3; ++c) {
+        p.rgb[c].resize(static_cast<size_t>(width) * height);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) p.rgb[c][y * width + x] = image(x0 + x, y0 + y, c) / 255.0f;
+        }
+    }
+    return p;
+}
+
+double psnr(const Planes& a, const Planes& b) {
+    double sum = 0;
+    for (int c = 0; c < 3; ++c) {
+        for (size_t i = 0; i < a.rgb[c].size(); ++i) {
+            const double d = a.rgb[c][i] - b.rgb[c][i];
+            sum += d * d;
+        }
+    }
+    const double mse = sum / (3.0 * a.width * a.height);
+    return mse > 0 ? 10.0 * std::log10(1.0 / mse) : 99.0;
+}
+
+// Separable Gaussian blur, edges clamped.
+std::vector<float> blur(const std::vector<float>& in, int width, int height) {
+    const int r = 5;
+    float k[2 * r + 1], total = 0;
+    for (int i = -r; i <= r; ++i) total += k[i + r] = std::exp(-i * i / (2.0f * 1.5f * 1.5f));
+    for (float& w : k) w /= total;
+    std::vector<float> tmp(in.size()), out(in.size());
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float s = 0;
+            for (int i = -r; i <= r; ++i) s += k[i + r] * in[y * width + std::min(width - 1, std::max(0, x + i))];
+            tmp[y * width + x] = s;
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float s = 0;
+            for (int i = -r; i <= r; ++i) s += k[i + r] * tmp[std::min(height - 1, std::max(0, y + i)) * width + x];
+            out[y * width + x] = s;
+        }
+    }
+    return out;
+}
+
+double ssim(const Planes& a, const Planes& b) {
+    const size_t n = static_cast<size_t>(a.width) * a.height;
+    std::vector<float> x(n), y(n), xx(n), yy(n), xy(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = 0.2126f * a.rgb[0][i] + 0.7152f * a.rgb[1][i] + 0.0722f * a.rgb[2][i];
+        y[i] = 0.2126f * b.rgb[0][i] + 0.7152f * b.rgb[1][i] + 0.0722f * b.rgb[2][i];
+        xx[i] = x[i] * x[i];
+        yy[i] = y[i] * y[i];
+        xy[i] = x[i] * y[i];
+    }
+    const std::vector<float> mx = blur(x, a.width, a.height), my = blur(y, a.width, a.height);
+    const std::vector<float> sxx = blur(xx, a.width, a.height), syy = blur(yy, a.width, a.height);
+    const std::vector<float> sxy = blur(xy, a.width, a.height);
+    const double c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const double vx = sxx[i] - mx[i] * mx[i], vy = syy[i] - my[i] * my[i], cov = sxy[i] - mx[i] * my[i];
+        sum += ((2 * mx[i] * my[i] + c1) * (2 * cov + c2)) /
+               ((mx[i] * mx[i] + my[i] * my[i] + c1) * (vx + vy + c2));
+    }
+    return sum / n;
+}
+
+struct Lab {
+    double L, a, b;
+};
+
+// sRGB-encoded values in [0, 1] to CIELAB, D65.
+Lab srgb_to_lab(double r, double g, double b) {
+    auto linear = [](double v) { return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4); };
+    r = linear(r);
+    g = linear(g);
+    b = linear(b);
+    const double X = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+    const double Y = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+    const double Z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+    auto f = [](double t) { return t > 216.0 / 24389.0 ? std::cbrt(t) : (24389.0 / 27.0 * t + 16.0) / 116.0; };
+    const double fx = f(X), fy = f(Y), fz = f(Z);
+    return {116.0 * fy - 16.0, 500.0 * (fx - fy), 200.0 * (fy - fz)};
+}
+
+// CIEDE2000 with kL = kC = kH = 1.
+double ciede2000(const Lab& p, const Lab& q) {
+    const double pi = 3.14159265358979323846;
+    auto deg = [&](double r) { return r * 180.0 / pi; };
+    auto rad = [&](double d) { return d * pi / 180.0; };
+    const double c_bar = 0.5 * (std::hypot(p.a, p.b) + std::hypot(q.a, q.b));
+    const double c7 = std::pow(c_bar, 7);
+    const double g = 0.5 * (1.0 - std::sqrt(c7 / (c7 + std::pow(25.0, 7))));
+    const double a1 = (1.0 + g) * p.a, a2 = (1.0 + g) * q.a;
+    const double c1 = std::hypot(a1, p.b), c2 = std::hypot(a2, q.b);
+    auto hue = [&](double b, double a) {
+        if (a == 0 && b == 0) return 0.0;
+        const double h = deg(std::atan2(b, a));
+        return h < 0 ? h + 360.0 : h;
+    };
+    const double h1 = hue(p.b, a1), h2 = hue(q.b, a2);
+
+    const double dL = q.L - p.L, dC = c2 - c1;
+    double dh = 0;
+    if (c1 * c2 != 0) {
+        dh = h2 - h1;
+        if (dh > 180) dh -= 360;
+        else if (dh < -180) dh += 360;
+    }
+    const double dH = 2.0 * std::sqrt(c1 * c2) * std::sin(rad(dh / 2.0));
+
+    const double L_bar = 0.5 * (p.L + q.L), C_bar = 0.5 * (c1 + c2);
+    double h_bar = h1 + h2;
+    if (c1 * c2 != 0) {
+        if (std::fabs(h1 - h2) <= 180) h_bar = 0.5 * (h1 + h2);
+        else h_bar = h1 + h2 < 360 ? 0.5 * (h1 + h2 + 360) : 0.5 * (h1 + h2 - 360);
+    }
+    const double t = 1.0 - 0.17 * std::cos(rad(h_bar - 30)) + 0.24 * std::cos(rad(2 * h_bar)) +
+                     0.32 * std::cos(rad(3 * h_bar + 6)) - 0.20 * std::cos(rad(4 * h_bar - 63));
+    const double d_theta = 30.0 * std::exp(-std::pow((h_bar - 275.0) / 25.0, 2));
+    const double C_bar7 = std::pow(C_bar, 7);
+    const double r_c = 2.0 * std::sqrt(C_bar7 / (C_bar7 + std::pow(25.0, 7)));
+    const double l50 = (L_bar - 50) * (L_bar - 50);
+    const double s_l = 1.0 + 0.015 * l50 / std::sqrt(20.0 + l50);
+    const double s_c = 1.0 + 0.045 * C_bar;
+    const double s_h = 1.0 + 0.015 * C_bar * t;
+    const double r_t = -std::sin(rad(2 * d_theta)) * r_c;
+    const double l = dL / s_l, c = dC / s_c, h = dH / s_h;
+    return std::sqrt(l * l + c * c + h * h + r_t * c * h);
+}
+
+double mean_delta_e(const Planes& a, const Planes& b) {
+    double sum = 0;
+    const size_t n = a.rgb[0].size();
+    for (size_t i = 0; i < n; ++i) {
+        sum += ciede2000(srgb_to_lab(a.rgb[0][i], a.rgb[1][i], a.rgb[2][i]),
+                         srgb_to_lab(b.rgb[0][i], b.rgb[1][i], b.rgb[2][i]));
+    }
+    return sum / n;
+}
+
+Quality compare(const std::string& reference_path, const std::string& test_path) {
+    Buffer<uint8_t, 3> reference = Halide::Tools::load_and_convert_image(reference_path);
+    Buffer<uint8_t, 3> test = Halide::Tools::load_and_convert_image(test_path);
+    const int width = std::min(reference.width(), test.width());
+    const int height = std::min(reference.height(), test.height());
+    if (reference.width() != test.width() || reference.height() != test.height()) {
+        std::cerr << "Note: " << test_path << " is " << test.width() << "x" << test.height() << ", the reference "
+                  << reference.width() << "x" << reference.height() << "; comparing the centered "
+                  << width << "x" << height << "\n";
+    }
+    const Planes a = crop_planes(reference, width, height), b = crop_planes(test, width, height);
+    Quality q;
+    q.psnr_db = psnr(a, b);
+    q.ssim = ssim(a, b);
+    q.delta_e = mean_delta_e(a, b);
+    return q;
+}
+
+// --- Pareto front ---
+
+struct ConfigSummary {
+    std::string config;
+    int images = 0;
+    double time_ms = 0, peak_mb = 0, psnr_db = 0, ssim = 0, delta_e = 0;
+    bool has_peak = true; // False if any image had no heap figure.
+    bool pareto = false;
+};
+
+std::vector<std::string> split_csv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) fields.push_back(field);
+    return fields;
+}
+
+std::vector<ConfigSummary> summarize(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Could not open " + path);
+    std::string line;
+    std::map<std::string, int> column;
+    std::map<std::string, ConfigSummary> by_config;
+    std::vector<std::string> order;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        const std::vector<std::string> fields = split_csv(line);
+        if (column.empty()) {
+            for (size_t i = 0; i < fields.size(); ++i) column[fields[i]] = static_cast<int>(i);
+            for (const char* name : {"config", "time_ms", "peak_mb", "psnr_db", "ssim", "delta_e"}) {
+                if (!column.count(name)) throw std::runtime_error(path + " has no " + name + " column");
+            }
+            continue;
+        }
+        auto field = [&](const char* name) -> std::string {
+            const size_t i = column[name];
+            return i < fields.size() ? fields[i] : std::string();
+        };
+        const std::string config = field("config");
+        if (!by_config.count(config)) order.push_back(config);
+        ConfigSummary& s = by_config[config];
+        s.config = config;
+        s.images++;
+        s.time_ms += std::stod(field("time_ms"));
+        s.psnr_db += std::stod(field("psnr_db"));
+        s.ssim += std::stod(field("ssim"));
+        s.delta_e += std::stod(field("delta_e"));
+        if (field("peak_mb").empty()) s.has_peak = false;
+        else s.peak_mb += std::stod(field("peak_mb"));
+    }
+    std::vector<ConfigSummary> summaries;
+    for (const auto& name : order) {
+        ConfigSummary s = by_config[name];
+        s.time_ms /= s.images;
+        s.peak_mb /= s.images;
+        s.psnr_db /= s.images;
+        s.ssim /= s.images;
+        s.delta_e /= s.images;
+        summaries.push_back(s);
+    }
+    for (ConfigSummary& s : summaries) {
+        s.pareto = std::none_of(summaries.begin(), summaries.end(), [&](const ConfigSummary& o) {
+            return o.time_ms <= s.time_ms && o.delta_e <= s.delta_e &&
+                   (o.time_ms < s.time_ms || o.delta_e < s.delta_e);
+        });
+    }
+    return summaries;
+}
+
+// Time on x, delta E on y, both from 0; the front's points joined in order
+// of time and labelled.
+void write_svg(const std::vector<ConfigSummary>& summaries, const std::string& path) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) throw std::runtime_error("Could not open " + path + " for writing");
+    const double w = 960, h = 640, left = 70, right = 220, top = 30, bottom = 60;
+    double max_t = 0, max_e = 0;
+    for (const auto& s : summaries) {
+        max_t = std::max(max_t, s.time_ms);
+        max_e = std::max(max_e, s.delta_e);
+    }
+    max_t = max_t > 0 ? max_t * 1.05 : 1.0;
+    max_e = max_e > 0 ? max_e * 1.05 : 1.0;
+    auto px = [&](double t) { return left + t / max_t * (w - left - right); };
+    auto py = [&](double e) { return h - bottom - e / max_e * (h - top - bottom); };
+
+    fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.0f\" height=\"%.0f\" "
+               "font-family=\"sans-serif\" font-size=\"11\">\n", w, h);
+    fprintf(f, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+    fprintf(f, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"black\"/>\n",
+            left, h - bottom, w - right, h - bottom);
+    fprintf(f, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"black\"/>\n",
+            left, top, left, h - bottom);
+    for (int i = 0; i <= 5; ++i) {
+        const double t = max_t * i / 5, e = max_e * i / 5;
+        fprintf(f, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\">%.0f</text>\n", px(t), h - bottom + 16, t);
+        fprintf(f, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"end\">%.2f</text>\n", left - 6, py(e) + 4, e);
+    }
+    fprintf(f, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\">time (ms, mean over images)</text>\n",
+            (left + w - right) / 2, h - 18);
+    fprintf(f, "<text transform=\"translate(18 %.1f) rotate(-90)\" text-anchor=\"middle\">"
+               "mean CIEDE2000 vs reference</text>\n", (top + h - bottom) / 2);
+
+    std::vector<const ConfigSummary*> front;
+    for (const auto& s : summaries) {
+        if (s.pareto) front.push_back(&s);
+    }
+    std::sort(front.begin(), front.end(), [](const ConfigSummary* a, const ConfigSummary* b) { return a->time_ms < b->time_ms; });
+    fprintf(f, "<polyline fill=\"none\" stroke=\"#d62728\" stroke-width=\"1.5\" points=\"");
+    for (const ConfigSummary* s : front) fprintf(f, "%.1f,%.1f ", px(s->time_ms), py(s->delta_e));
+    fprintf(f, "\"/>\n");
+    for (const auto& s : summaries) {
+        fprintf(f, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"%d\" fill=\"%s\"><title>%s: %.2f ms, dE %.3f, "
+                   "PSNR %.2f dB, SSIM %.4f</title></circle>\n",
+                px(s.time_ms), py(s.delta_e), s.pareto ? 4 : 3, s.pareto ? "#d62728" : "#1f77b4",
+                s.config.c_str(), s.time_ms, s.delta_e, s.psnr_db, s.ssim);
+        if (s.pareto) {
+            fprintf(f, "<text x=\"%.1f\" y=\"%.1f\">%s</text>\n", px(s.time_ms) + 6, py(s.delta_e) - 6, s.config.c_str());
+        }
+    }
+    fprintf(f, "</svg>\n");
+    fclose(f);
+}
+
+void print_usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " compare <reference.png> <test.png>\n"
+              << "       " << argv0 << " pareto <results.csv> <plot.svg>\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const std::string mode = argc > 1 ? argv[1] : "";
+        if (mode == "compare" && argc == 4) {
+            const Quality q = compare(argv[2], argv[3]);
+            printf("%.3f,%.5f,%.4f\n", q.psnr_db, q.ssim, q.delta_e);
+        } else if (mode == "pareto" && argc == 4) {
+            const std::vector<ConfigSummary> summaries = summarize(argv[2]);
+            printf("config,images,time_ms,peak_mb,psnr_db,ssim,delta_e,pareto\n");
+            for (const auto& s : summaries) {
+                printf("%s,%d,%.3f,", s.config.c_str(), s.images, s.time_ms);
+                if (s.has_peak) printf("%.1f", s.peak_mb);
+                printf(",%.3f,%.5f,%.4f,%d\n", s.psnr_db, s.ssim, s.delta_e, s.pareto ? 1 : 0);
+            }
+            write_svg(summaries, argv[3]);
+            std::cerr << "Wrote " << argv[3] << "\n";
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef RAW_CONTAINER_H
+#define RAW_CONTAINER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "csi2_packing.h"
+
+// The capture tool's raw format (.oraw): a fixed header, then the sensor's
+// rows exactly as they came off the camera, starting at a page boundary.
+// No compression: the file is written as the frame streams out of capture
+// and mapped as-is by the reader (load_raw_container), so a frame costs one
+// write and no decode. Fields are in host byte order; both ends are
+// little-endian.
+namespace RawContainer {
+
+constexpr uint32_t kMagic = 0x5741524f;  // "ORAW"
+// Version 2 appended exposure_us, analogue_gain and sequence; the zero
+// padding after a version 1 header reads as 0 for them.
+constexpr uint32_t kVersion = 2;
+// The pixel data's offset: a page, so it can be mapped in place.
+constexpr uint64_t kDataOffset = 4096;
+
+struct Header {
+    uint32_t magic = kMagic;
+    uint32_t version = kVersion;
+    uint32_t width = 0, height = 0;  // Pixels.
+    uint32_t stride = 0;             // Bytes per row in the file, padding included.
+    uint32_t bit_depth = 0;
+    uint32_t packing = 0;            // RawPacking; None is 16-bit samples.
+    uint32_t cfa_pattern = 0;        // RawImageData::cfa_pattern's codes.
+    // Per CFA site, [y & 1][x & 1], in sensor units like white_level.
+    int32_t black_levels[2][2] = {{0, 0}, {0, 0}};
+    uint32_t white_level = 0;
+    uint32_t has_matrix = 0;
+    // Camera RGB to linear sRGB, as RawImageData's matrices.
+    float color_matrix[3][4] = {};
+    uint64_t timestamp_ns = 0;       // Sensor timestamp, 0 if unknown.
+    uint64_t data_offset = kDataOffset;
+    uint64_t data_size = 0;          // stride * height.
+    // The frame's exposure, as the camera reports it; 0 if unknown.
+    uint32_t exposure_us = 0;
+    float analogue_gain = 0.0f;
+    uint32_t sequence = 0;           // Frame number from the sensor.
+};
+static_assert(sizeof(Header) <= kDataOffset, "the header must fit before the pixel data");
+
+// Why `header` can't describe a file of `file_size` bytes, or empty if it can.
+inline std::string validate(const Header& header, uint64_t file_size) {
+    if (header.magic != kMagic) return "not a raw container";
+    if (header.version == 0 || header.version > kVersion) return "unsupported raw container version " + std::to_string(header.version);
+    if (header.packing > uint32_t(RawPacking::Csi2Raw12)) return "unknown packing";
+    if (header.width == 0 || header.height == 0) return "empty frame";
+    const RawPacking packing = RawPacking(header.packing);
+    if (header.width % raw_packing_group_pixels(packing) != 0) return "width not a whole number of packed groups";
+    if (header.stride < uint32_t(raw_packing_row_bytes(packing, int(header.width)))) return "stride shorter than a row";
+    if (packing == RawPacking::None && header.stride % 2 != 0) return "odd stride for 16-bit samples";
+    if (header.data_offset % kDataOffset != 0) return "pixel data not page aligned";
+    if (header.data_size != uint64_t(header.stride) * header.height) return "data size does not match the frame";
+    if (header.data_offset + header.data_size > file_size) return "truncated";
+    return "";
+}
+
+// Writes a container row by row, as a frame arrives: open() writes the
+// header, write_rows() appends rows and close() checks they all came.
+class Writer {
+public:
+    Writer() = default;
+    ~Writer() { if (fp_) fclose(fp_); }
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // `header.data_size` and `data_offset` are filled in here.
+    bool open(const std::string& path, Header header) {
+        header.data_offset = kDataOffset;
+        header.data_size = uint64_t(header.stride) * header.height;
+        fp_ = fopen(path.c_str(), "wb");
+        if (!fp_) return false;
+        std::vector<uint8_t> head(kDataOffset, 0);
+        memcpy(head.data(), &header, sizeof(header));
+        header_ = header;
+        rows_written_ = 0;
+        return fwrite(head.data(), 1, head.size(), fp_) == head.size();
+    }
+
+    // Appends `rows` rows of header.stride bytes, `src_stride` apart in `data`.
+    bool write_rows(const uint8_t* data, uint32_t rows, uint32_t src_stride) {
+        if (!fp_ || rows_written_ + rows > header_.height) return false;
+        if (src_stride == header_.stride) {
+            const size_t bytes = size_t(rows) * header_.stride;
+            if (fwrite(data, 1, bytes, fp_) != bytes) return false;
+        } else {
+            for (uint32_t y = 0; y < rows; ++y) {
+                if (fwrite(data + size_t(y) * src_stride, 1, header_.stride, fp_) != header_.stride) return false;
+            }
+        }
+        rows_written_ += rows;
+        return true;
+    }
+
+    bool close() {
+        if (!fp_) return false;
+        const bool ok = fclose(fp_) == 0 && rows_written_ == header_.height;
+        fp_ = nullptr;
+        return ok;
+    }
+
+private:
+    FILE* fp_ = nullptr;
+    Header header_;
+    uint32_t rows_written_ = 0;
+};
+
+} // namespace RawContainer
+
+#endif // RAW_CONTAINER_H
@@ -5,14 +5,48 @@
 #include <cstring> // For memcpy
 #include <numeric> // For std::accumulate
 #include <cmath>   // For fabsf
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <algorithm>
 #include "halide_image_io.h"
-#include "simple_timer.h" // Include the new timer header
+#include "instrumentation.h"
+#include "camera_metadata_cache.h"
+#include "raw_container.h"
+#include <fstream>
+#include <atomic>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAW_LOAD_HAVE_MMAP 1
+#endif
+
+namespace {
+// 0 means "use every hardware thread". Decode and the Halide pipeline never
+// run at the same time, so there is no reason to keep RawSpeed serial.
+std::atomic<int> gDecodeThreads{0};
+} // namespace
+
+void set_raw_decode_threads(int threads) {
+    gDecodeThreads = threads < 0 ? 0 : threads;
+}
+
+int get_raw_decode_threads() {
+    int threads = gDecodeThreads;
+    if (threads == 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    return threads > 0 ? threads : 1;
+}
 
 // RawSpeed requires this function to be defined by the user.
-// It tells the library how many threads it's allowed to use.
-// We'll return 1 to keep it single-threaded, as Halide handles our parallelism.
+// It tells the library how many threads its OpenMP tile decoders may use.
 int rawspeed_get_number_of_processor_cores() {
-    return 1;
+    return get_raw_decode_threads();
 }
 
 using namespace Halide::Runtime;
@@ -54,6 +88,24 @@ void invert3x3(const float in[3][3], float out[3][3]) {
     out[2][2] = (in[0][0] * in[1][1] - in[1][0] * in[0][1]) * invdet;
 }
 
+// Camera -> XYZ to camera -> linear sRGB (D65), with a zero offset column.
+void cam_xyz_to_srgb(const float cam_to_xyz[3][3], float cam_to_srgb[3][4]) {
+    const float xyz_to_srgb_d65[3][3] = {
+        { 3.2404542f, -1.5371385f, -0.4985314f},
+        {-0.9692660f,  1.8760108f,  0.0415560f},
+        { 0.0556434f, -0.2040259f,  1.0572252f}
+    };
+    for (int i = 0; i < 3; ++i) { // output row
+        for (int j = 0; j < 3; ++j) { // output col
+            cam_to_srgb[i][j] = 0.0f;
+            for (int k = 0; k < 3; ++k) { // inner dim
+                cam_to_srgb[i][j] += xyz_to_srgb_d65[i][k] * cam_to_xyz[k][j];
+            }
+        }
+        cam_to_srgb[i][3] = 0.0f;
+    }
+}
+
 
 // Helper to map RawSpeed's CFA enum to our integer pattern codes
 int map_cfa_pattern(const rawspeed::ColorFilterArray& cfa) {
@@ -73,33 +125,104 @@ int map_cfa_pattern(const rawspeed::ColorFilterArray& cfa) {
     return 0;
 }
 
-// A singleton-like holder for the CameraMetaData
+// A read-only mapping of the whole input file. RawSpeed copies the pixels
+// into its own RawImage while decoding, so the mapping only has to outlive
+// the decoder. data() is null if the file could not be mapped.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef RAW_LOAD_HAVE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const uint8_t*>(p);
+                size_ = static_cast<size_t>(st.st_size);
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+#else
+        (void)path;
+#endif
+    }
+    ~MappedFile() {
+#ifdef RAW_LOAD_HAVE_MMAP
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+const char* const kCameraXmlPaths[] = {"../share/rawspeed/cameras.xml", "./data/cameras.xml"};
+
+std::string find_camera_xml() {
+    for (const char* p : kCameraXmlPaths) {
+        if (std::ifstream(p).good()) return p;
+    }
+    return kCameraXmlPaths[1];
+}
+
+// A singleton-like holder for the full CameraMetaData, parsed on first use.
 std::unique_ptr<rawspeed::CameraMetaData> gCameraMetaData;
 
-} // namespace
+const rawspeed::CameraMetaData* full_camera_metadata() {
+    if (!gCameraMetaData) {
+        Instrumentation::ScopedTimer meta_timer("RawSpeed Metadata Load");
+        gCameraMetaData = std::make_unique<rawspeed::CameraMetaData>(find_camera_xml().c_str());
+    }
+    return gCameraMetaData.get();
+}
 
-RawImageData load_raw(const std::string &path) {
-    RawImageData result;
+// Looks up just this file's camera through the binary index, so a one-shot
+// `process` run doesn't parse all of cameras.xml. Only TIFF-based decoders
+// expose make/model before decoding; everything else gets nullptr and uses
+// the full metadata.
+std::unique_ptr<rawspeed::CameraMetaData> indexed_camera_metadata(rawspeed::RawDecoder* decoder) {
+    auto* tiff = dynamic_cast<rawspeed::AbstractTiffDecoder*>(decoder);
+    if (!tiff || gCameraMetaData) return nullptr;
+    try {
+        rawspeed::TiffID id = tiff->getRootIFD()->getID();
+        Instrumentation::ScopedTimer meta_timer("RawSpeed Metadata Load (indexed)");
+        return load_camera_metadata_subset(find_camera_xml(), id.make, id.model);
+    } catch (const rawspeed::RawspeedException&) {
+        return nullptr;
+    }
+}
 
+// The EXIF orientation recorded in a TIFF-based raw, else 1.
+int tiff_orientation(rawspeed::RawDecoder* decoder) {
+    auto* tiff = dynamic_cast<rawspeed::AbstractTiffDecoder*>(decoder);
+    if (!tiff) return 1;
     try {
-        if (!gCameraMetaData) {
-            SimpleTimer meta_timer("RawSpeed Metadata Load");
-            try {
-                gCameraMetaData = std::make_unique<rawspeed::CameraMetaData>("../share/rawspeed/cameras.xml");
-            } catch (const rawspeed::RawspeedException&) {
-                gCameraMetaData = std::make_unique<rawspeed::CameraMetaData>("./data/cameras.xml");
-            }
-        }
+        const rawspeed::TiffEntry* entry = tiff->getRootIFD()->getEntryRecursive(rawspeed::TiffTag::ORIENTATION);
+        const int orientation = entry ? entry->getU16() : 1;
+        return orientation >= 1 && orientation <= 8 ? orientation : 1;
+    } catch (const rawspeed::RawspeedException&) {
+        return 1;
+    }
+}
 
-        auto [file_owner, buffer] = [] (const std::string& p) {
-            SimpleTimer read_timer("File Read to Buffer");
-            rawspeed::FileReader reader(p.c_str());
-            return reader.readFile();
-        }(path);
+// Decodes `buffer`, the contents of the raw file `path`.
+RawImageData decode_raw(const std::string &path, const rawspeed::Buffer &buffer) {
+    RawImageData result;
+
+    try {
+        Instrumentation::Registry::get().add_bytes("raw file bytes", buffer.getSize());
 
         std::unique_ptr<rawspeed::RawDecoder> decoder;
         {
-            SimpleTimer parse_timer("RawSpeed Parse");
+            Instrumentation::ScopedTimer parse_timer("RawSpeed Parse");
             rawspeed::RawParser parser(buffer);
             decoder = parser.getDecoder();
         }
@@ -108,17 +231,33 @@ RawImageData load_raw(const std::string &path) {
             throw std::runtime_error("RawSpeed Error: Failed to get decoder for " + path);
         }
 
+        std::unique_ptr<rawspeed::CameraMetaData> camera_subset = indexed_camera_metadata(decoder.get());
+        const rawspeed::CameraMetaData* meta = camera_subset ? camera_subset.get() : full_camera_metadata();
+
         rawspeed::RawImage img = [&] {
-            SimpleTimer decode_timer("RawSpeed Decode");
+            Instrumentation::ScopedTimer decode_timer("RawSpeed Decode");
             decoder->failOnUnknown = false;
-            decoder->checkSupport(gCameraMetaData.get());
+            decoder->checkSupport(meta);
             decoder->decodeRaw();
-            decoder->decodeMetaData(gCameraMetaData.get());
-            rawspeed::RawImage decoded_img = decoder->mRaw;
-            decoded_img->scaleBlackWhite();
-            return decoded_img;
+            decoder->decodeMetaData(meta);
+            return decoder->mRaw;
         }();
 
+        // Black and white levels are applied by the pipeline rather than by
+        // RawSpeed's scaleBlackWhite(), which would make a full extra pass
+        // over the raw. Prefer the per-site levels from the file, else measure
+        // them from the masked areas.
+        if (!img->blackLevelSeparate && !img->blackAreas.empty()) {
+            img->calculateBlackAreas();
+        }
+        bool levels_known = img->whitePoint.has_value() &&
+                            (img->blackLevelSeparate || img->blackLevel >= 0);
+        if (!levels_known) {
+            // Nothing to go on; let RawSpeed estimate and rescale as before.
+            Instrumentation::ScopedTimer scale_timer("RawSpeed scaleBlackWhite");
+            img->scaleBlackWhite();
+        }
+
         // Get the cropped 2D array view. This object is the ground truth for dimensions and access.
         rawspeed::CroppedArray2DRef<uint16_t> pixels = img->getU16DataAsCroppedArray2DRef();
 
@@ -127,20 +266,39 @@ RawImageData load_raw(const std::string &path) {
         int height = pixels.croppedHeight;
 
         result.cfa_pattern = map_cfa_pattern(img->cfa);
-        result.black_level = 0;
-        result.white_level = 65535;
-        result.bayer_data = Buffer<uint16_t, 2>(width, height);
-
-        {
-            SimpleTimer copy_timer("Pixel Buffer Copy");
-            for (int y = 0; y < height; ++y) {
-                for (int x = 0; x < width; ++x) {
-                    result.bayer_data(x, y) = pixels(y, x);
+        result.orientation = tiff_orientation(decoder.get());
+        if (levels_known) {
+            // blackLevelSeparate is laid out over the uncropped raw, so shift
+            // by the crop offset to index it from bayer_data's origin.
+            rawspeed::iPoint2D crop = img->getCropOffset();
+            int sum = 0;
+            for (int y = 0; y < 2; ++y) {
+                for (int x = 0; x < 2; ++x) {
+                    int level = img->blackLevel;
+                    if (img->blackLevelSeparate) {
+                        level = (*img->blackLevelSeparate)((y + crop.y) & 1, (x + crop.x) & 1);
+                    }
+                    result.black_levels[y][x] = level;
+                    sum += level;
                 }
             }
+            result.black_level = (sum + 2) / 4;
+            result.white_level = *img->whitePoint;
+        } else {
+            result.black_level = 0;
+            result.white_level = 65535;
         }
 
-        const rawspeed::Camera* cam = gCameraMetaData->getCamera(img->metadata.make, img->metadata.model, img->metadata.mode);
+        // Wrap the decoder's storage instead of copying it. The crop offset is
+        // applied by pointing at the first visible pixel, and the row pitch
+        // (padded by RawSpeed) becomes the y stride.
+        uint16_t* origin = &pixels(0, 0);
+        int row_stride = height > 1 ? static_cast<int>(&pixels(1, 0) - origin) : width;
+        halide_dimension_t shape[2] = {{0, width, 1}, {0, height, row_stride}};
+        result.bayer_data = Buffer<uint16_t, 2>(origin, 2, shape);
+        result.decoded_image = std::make_shared<rawspeed::RawImage>(img);
+
+        const rawspeed::Camera* cam = meta->getCamera(img->metadata.make, img->metadata.model, img->metadata.mode);
         float cam_to_xyz[3][3];
         bool matrix_found = false;
 
@@ -170,30 +328,8 @@ RawImageData load_raw(const std::string &path) {
         }
 
         if (matrix_found) {
-            // We have a Camera -> XYZ matrix. Now convert it to Camera -> sRGB.
-            const float xyz_to_srgb_d65[3][3] = {
-                { 3.2404542f, -1.5371385f, -0.4985314f},
-                {-0.9692660f,  1.8760108f,  0.0415560f},
-                { 0.0556434f, -0.2040259f,  1.0572252f}
-            };
-
-            float cam_to_srgb[3][3] = {{0}};
-            for (int i = 0; i < 3; ++i) { // output row
-                for (int j = 0; j < 3; ++j) { // output col
-                    for (int k = 0; k < 3; ++k) { // inner dim
-                        cam_to_srgb[i][j] += xyz_to_srgb_d65[i][k] * cam_to_xyz[k][j];
-                    }
-                }
-            }
-
-            for (int i = 0; i < 3; ++i) {
-                for (int j = 0; j < 3; ++j) {
-                    result.matrix_3200[i][j] = cam_to_srgb[i][j];
-                    result.matrix_7000[i][j] = cam_to_srgb[i][j];
-                }
-                result.matrix_3200[i][3] = 0.0f;
-                result.matrix_7000[i][3] = 0.0f;
-            }
+            cam_xyz_to_srgb(cam_to_xyz, result.matrix_3200);
+            memcpy(result.matrix_7000, result.matrix_3200, sizeof(float) * 12);
         } else {
             // Priority 3: Fall back to hardcoded DNG defaults.
             result.has_matrix = false;
@@ -208,8 +344,62 @@ RawImageData load_raw(const std::string &path) {
     return result;
 }
 
+} // namespace
+
+void camera_to_srgb_matrix(const float xyz_to_cam[3][3], float cam_to_srgb[3][4]) {
+    float cam_to_xyz[3][3];
+    invert3x3(xyz_to_cam, cam_to_xyz);
+    cam_xyz_to_srgb(cam_to_xyz, cam_to_srgb);
+}
+
+RawImageData load_raw(const std::string &path) {
+    Instrumentation::ScopedTimer load_timer("Load Raw");
+    // Map the file where we can so RawSpeed parses straight out of the
+    // page cache; otherwise read it into a heap buffer as before.
+    MappedFile mapped(path);
+    if (mapped.data() && mapped.size() <= std::numeric_limits<rawspeed::Buffer::size_type>::max()) {
+        return decode_raw(path, rawspeed::Buffer(mapped.data(), static_cast<rawspeed::Buffer::size_type>(mapped.size())));
+    }
+    using FileStorage = decltype(std::declval<rawspeed::FileReader&>().readFile().first);
+    FileStorage file_owner;
+    rawspeed::Buffer buffer;
+    try {
+        Instrumentation::ScopedTimer read_timer("File Read to Buffer");
+        rawspeed::FileReader reader(path.c_str());
+        std::tie(file_owner, buffer) = reader.readFile();
+    } catch (const rawspeed::RawspeedException& e) {
+        throw std::runtime_error("RawSpeed Error: " + std::string(e.what()));
+    }
+    return decode_raw(path, buffer);
+}
+
+RawImageData load_raw(const std::string &path, const RawFileBytes &file) {
+    if (!file.data || file.size > std::numeric_limits<rawspeed::Buffer::size_type>::max()) return load_raw(path);
+    Instrumentation::ScopedTimer load_timer("Load Raw");
+    return decode_raw(path, rawspeed::Buffer(file.data, static_cast<rawspeed::Buffer::size_type>(file.size)));
+}
+
+int load_raw_orientation(const std::string &path) {
+    auto parse = [](const rawspeed::Buffer& buffer) {
+        rawspeed::RawParser parser(buffer);
+        std::unique_ptr<rawspeed::RawDecoder> decoder = parser.getDecoder();
+        return decoder ? tiff_orientation(decoder.get()) : 1;
+    };
+    try {
+        MappedFile mapped(path);
+        if (mapped.data() && mapped.size() <= std::numeric_limits<rawspeed::Buffer::size_type>::max()) {
+            return parse(rawspeed::Buffer(mapped.data(), static_cast<rawspeed::Buffer::size_type>(mapped.size())));
+        }
+        rawspeed::FileReader reader(path.c_str());
+        auto file = reader.readFile();
+        return parse(file.second);
+    } catch (const rawspeed::RawspeedException&) {
+        return 1;
+    }
+}
+
 RawImageData load_raw_png(const std::string &path) {
-    SimpleTimer png_timer("PNG Load and Convert");
+    Instrumentation::ScopedTimer png_timer("PNG Load and Convert");
     RawImageData result;
 
     result.bayer_data = load_and_convert_image(path);
@@ -217,9 +407,134 @@ RawImageData load_raw_png(const std::string &path) {
     result.cfa_pattern = 0;
     result.black_level = 25;
     result.white_level = 1023;
+    for (auto& row : result.black_levels) {
+        for (int& level : row) level = result.black_level;
+    }
     result.has_matrix = false;
     memcpy(result.matrix_3200, default_matrix_3200, sizeof(float) * 12);
     memcpy(result.matrix_7000, default_matrix_7000, sizeof(float) * 12);
 
     return result;
 }
+
+int RawImageData::width() const {
+    return packing == RawPacking::None ? bayer_data.width()
+                                       : packed_data.width() / raw_packing_group_bytes(packing) * raw_packing_group_pixels(packing);
+}
+
+int RawImageData::height() const {
+    return packing == RawPacking::None ? bayer_data.height() : packed_data.height();
+}
+
+RawImageData bin_raw_half(const RawImageData& raw) {
+    if (raw.packing != RawPacking::None || !raw.bayer_data.data()) return raw;
+    Instrumentation::ScopedTimer bin_timer("Raw Half-size Bin");
+    const Buffer<uint16_t, 2>& in = raw.bayer_data;
+    const int x0 = in.dim(0).min(), y0 = in.dim(1).min();
+    const int width = in.width() / 2, height = in.height() / 2;
+
+    RawImageData result = raw;
+    result.decoded_image.reset();
+    result.mapped_storage.reset();
+    result.bayer_data = Buffer<uint16_t, 2>(width, height);
+    // GRBG and GBRG have green on the diagonal of the quad, RGGB and BGGR
+    // off it.
+    const bool green_on_diagonal = raw.cfa_pattern == 0 || raw.cfa_pattern == 2;
+    for (int y = 0; y < height; ++y) {
+        const int sy = y & 1;
+        const uint16_t* rows[2] = {&in(x0, y0 + 2 * y), &in(x0, y0 + 2 * y + 1)};
+        uint16_t* out = &result.bayer_data(0, y);
+        for (int x = 0; x < width; ++x) {
+            const int sx = x & 1;
+            const int v = rows[sy][2 * x + sx];
+            if ((sx == sy) != green_on_diagonal) {
+                out[x] = static_cast<uint16_t>(v);
+                continue;
+            }
+            // The other green of the quad, brought to this site's black
+            // level before averaging.
+            const int other = rows[1 - sy][2 * x + 1 - sx];
+            const int black = raw.black_levels[sy][sx], other_black = raw.black_levels[1 - sy][1 - sx];
+            const int binned = black + ((v - black) + (other - other_black)) / 2;
+            out[x] = static_cast<uint16_t>(std::min(65535, std::max(0, binned)));
+        }
+    }
+    return result;
+}
+
+bool is_raw_container_path(const std::string &path) {
+    const std::string ext = ".oraw";
+    return path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+RawImageData raw_container_metadata(const RawContainer::Header &header) {
+    RawImageData result;
+    result.cfa_pattern = static_cast<int>(header.cfa_pattern);
+    result.white_level = static_cast<int>(header.white_level);
+    int black_sum = 0;
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            result.black_levels[y][x] = header.black_levels[y][x];
+            black_sum += header.black_levels[y][x];
+        }
+    }
+    result.black_level = (black_sum + 2) / 4;
+    result.has_matrix = header.has_matrix != 0;
+    if (result.has_matrix) {
+        memcpy(result.matrix_3200, header.color_matrix, sizeof(float) * 12);
+        memcpy(result.matrix_7000, header.color_matrix, sizeof(float) * 12);
+    } else {
+        memcpy(result.matrix_3200, default_matrix_3200, sizeof(float) * 12);
+        memcpy(result.matrix_7000, default_matrix_7000, sizeof(float) * 12);
+    }
+    return result;
+}
+
+RawImageData load_raw_container(const std::string &path, bool keep_packed) {
+    Instrumentation::ScopedTimer map_timer("Raw Container Map");
+    auto mapped = std::make_shared<MappedFile>(path);
+    if (!mapped->data()) {
+        throw std::runtime_error("Could not map raw container " + path);
+    }
+    RawFileBytes file;
+    file.data = mapped->data();
+    file.size = mapped->size();
+    file.storage = std::move(mapped);
+    return load_raw_container(path, keep_packed, file);
+}
+
+RawImageData load_raw_container(const std::string &path, bool keep_packed, const RawFileBytes &file) {
+    if (file.size < sizeof(RawContainer::Header)) {
+        throw std::runtime_error("Raw container " + path + " is too short");
+    }
+    RawContainer::Header header;
+    memcpy(&header, file.data, sizeof(header));
+    const std::string error = RawContainer::validate(header, file.size);
+    if (!error.empty()) {
+        throw std::runtime_error("Raw container " + path + ": " + error);
+    }
+
+    RawImageData result = raw_container_metadata(header);
+
+    // The bytes are read-only; the pipelines only read their input.
+    uint8_t* pixels = const_cast<uint8_t*>(file.data) + header.data_offset;
+    const int width = static_cast<int>(header.width), height = static_cast<int>(header.height);
+    const RawPacking packing = static_cast<RawPacking>(header.packing);
+    if (packing == RawPacking::None) {
+        halide_dimension_t shape[2] = {{0, width, 1}, {0, height, static_cast<int32_t>(header.stride / 2)}};
+        result.bayer_data = Buffer<uint16_t, 2>(reinterpret_cast<uint16_t*>(pixels), 2, shape);
+        result.mapped_storage = file.storage;
+    } else if (keep_packed) {
+        halide_dimension_t shape[2] = {{0, raw_packing_row_bytes(packing, width), 1},
+                                       {0, height, static_cast<int32_t>(header.stride)}};
+        result.packing = packing;
+        result.packed_data = Buffer<uint8_t, 2>(pixels, 2, shape);
+        result.mapped_storage = file.storage;
+    } else {
+        result.bayer_data = Buffer<uint16_t, 2>(width, height);
+        for (int y = 0; y < height; ++y) {
+            csi2_unpack_row(packing, pixels + static_cast<size_t>(y) * header.stride, &result.bayer_data(0, y), width);
+        }
+    }
+    return result;
+}
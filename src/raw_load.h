@@ -7,6 +7,8 @@
 #include <vector>
 #include <cstdint>
 #include "librawspeed/RawSpeed-API.h" // For allocator types
+#include "csi2_packing.h"
+#include "raw_container.h"
 
 // A structure to hold all the essential data extracted from a RAW file.
 struct RawImageData {
@@ -14,22 +16,86 @@ struct RawImageData {
     int cfa_pattern = 0;
     int black_level = 0;
     int white_level = 4095;
+    // Black level for each 2x2 CFA site, indexed [y & 1][x & 1] in the
+    // coordinates of bayer_data. black_level is their mean.
+    int black_levels[2][2] = {{0, 0}, {0, 0}};
     bool has_matrix = false;
     float matrix_3200[3][4];
     float matrix_7000[3][4];
+    // EXIF orientation, 1 (as stored) to 8, from the file's TIFF metadata
+    // where it has one.
+    int orientation = 1;
 
-    // This smart pointer owns the raw file data buffer read by RawSpeed.
-    // By keeping it here, we ensure the memory pointed to by bayer_data
-    // remains valid for the lifetime of this struct.
-    std::unique_ptr<std::vector<uint8_t, rawspeed::DefaultInitAllocatorAdaptor<uint8_t, rawspeed::AlignedAllocator<uint8_t, 16> > > > memory_owner;
+    // The decoded RawSpeed image. For RawSpeed loads, bayer_data is a view
+    // onto its (cropped) pixel storage rather than a copy, so keeping this
+    // handle here keeps that memory valid for the lifetime of this struct.
+    std::shared_ptr<rawspeed::RawImage> decoded_image;
+
+    // A CSI-2 packed frame kept packed for the packed pipelines
+    // (load_raw_container): its rows, cropped to the pixels' bytes, in
+    // packed_data, and bayer_data left empty.
+    RawPacking packing = RawPacking::None;
+    Halide::Runtime::Buffer<uint8_t, 2> packed_data;
+    // Keeps the mapped or read-ahead file that bayer_data or packed_data points into alive.
+    std::shared_ptr<const void> mapped_storage;
+    // The frame's size in pixels.
+    int width() const;
+    int height() const;
+};
+
+// A whole raw file already in memory, e.g. read ahead of its decode
+// (read_ahead.h). `storage` owns the bytes; loaders keep a reference where
+// the result points into them.
+struct RawFileBytes {
+    std::shared_ptr<const void> storage;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
 };
 
+// Sets how many threads RawSpeed may use to decode (for compressed DNG,
+// ARW, NEF, ...). 0 uses all hardware threads.
+void set_raw_decode_threads(int threads);
+int get_raw_decode_threads();
+
+// The camera -> linear sRGB matrix in RawImageData's matrix_3200 form (a
+// zero offset column) for an XYZ -> camera matrix, such as a DNG or DCP
+// ColorMatrix, as load_raw derives it from the file's.
+void camera_to_srgb_matrix(const float xyz_to_cam[3][3], float cam_to_srgb[3][4]);
+
 // Loads a RAW file (e.g., DNG, ARW) using RawSpeed, extracts metadata,
 // and returns the sanitized data in a RawImageData struct.
 RawImageData load_raw(const std::string &path);
+// The same, decoding `file`, the contents of `path`, instead of reading it.
+RawImageData load_raw(const std::string &path, const RawFileBytes &file);
+// The orientation load_raw records for `path`, from its TIFF metadata
+// alone: the file is parsed but not decoded. 1 where it has none.
+int load_raw_orientation(const std::string &path);
 
 // Loads a 16-bit grayscale PNG (legacy format) and populates a
 // RawImageData struct with default metadata.
 RawImageData load_raw_png(const std::string &path);
 
+// Maps a raw container written by the capture tool (raw_container.h) and
+// returns views of its pixels, with the CFA, levels and matrix it records.
+// Packed frames stay packed if `keep_packed`, and are otherwise expanded
+// to 16 bits. Throws std::runtime_error on a malformed file.
+RawImageData load_raw_container(const std::string &path, bool keep_packed);
+// The same, taking the container from `file` instead of mapping it.
+RawImageData load_raw_container(const std::string &path, bool keep_packed, const RawFileBytes &file);
+
+// A half-resolution mosaic of `raw`, for previews and culling: each 2x2
+// CFA quad becomes the one pixel of the half-size mosaic at the same CFA
+// site as the quad's pixel of that colour (the two greens averaged), so it
+// has the same CFA pattern and per-site black levels and the pipelines take
+// it like any other raw. The result owns its pixels; the full-size storage
+// is released with `raw`. Packed frames are returned unchanged.
+RawImageData bin_raw_half(const RawImageData& raw);
+
+// The metadata a raw container's header records (CFA, levels, matrix),
+// with no pixels; for readers that bring the pixels in themselves.
+RawImageData raw_container_metadata(const RawContainer::Header &header);
+
+// True if `path` names a raw container (by its .oraw extension).
+bool is_raw_container_path(const std::string &path);
+
 #endif // RAW_LOAD_H
@@ -0,0 +1,235 @@
+#include "raw_pipeline.h"
+#include "color_tools.h"
+#include "thread_pool.h"
+#include "tone_curve_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#ifdef USE_LENSFUN
+#include "lensfun/lensfun.h"
+#endif
+
+#include "camera_pipe_display_argb8888_lib.h"
+#include "camera_pipe_display_rgb565_lib.h"
+#include "camera_pipe_f32_lib.h"
+#include "camera_pipe_u16_lib.h"
+
+using Halide::Runtime::Buffer;
+
+namespace { // Anonymous namespace for local helpers
+
+#ifdef USE_LENSFUN
+// Loaded on the first lookup that misses the on-disk lens index.
+const lfDatabase* lensfun_database() {
+    static std::unique_ptr<lfDatabase> ldb;
+    if (!ldb) {
+        ldb.reset(new lfDatabase());
+        ldb->Load();
+    }
+    return ldb.get();
+}
+#endif
+
+void configure_threads(const ProcessConfig& cfg) {
+    ThreadPool::get().configure_halide(cfg.threads, cfg.thread_pool, ThreadPool::cores_named(cfg.affinity));
+}
+
+bool same_threads(const ProcessConfig& a, const ProcessConfig& b) {
+    return a.threads == b.threads && a.thread_pool == b.thread_pool && a.affinity == b.affinity;
+}
+
+} // namespace
+
+RawPipeline::RawPipeline(const ProcessConfig& cfg, Variant variant) : cfg_(cfg), variant_(variant) {
+    configure_threads(cfg_);
+    PipelineUtils::set_memoization_cache_size();
+}
+
+void RawPipeline::set_config(const ProcessConfig& cfg) {
+    const bool threads_changed = !same_threads(cfg_, cfg);
+    cfg_ = cfg;
+    if (threads_changed) configure_threads(cfg_);
+}
+
+void RawPipeline::load(const std::string& path) {
+    RawImageData raw;
+    if (is_raw_container_path(path)) raw = load_raw_container(path, false);
+    else if (cfg_.raw_png) raw = load_raw_png(path);
+    else raw = load_raw(path);
+    set_raw(cfg_.half_size ? bin_raw_half(raw) : raw);
+}
+
+void RawPipeline::set_raw(const RawImageData& raw) {
+    raw_ = raw;
+    raw_inputs_valid_ = false;
+}
+
+int RawPipeline::output_width(float scale) const {
+    return static_cast<int>(raw_.width() * scale);
+}
+
+int RawPipeline::output_height(float scale) const {
+    return static_cast<int>(raw_.height() * scale);
+}
+
+int RawPipeline::render(const Region& roi, float scale) {
+    Region r = roi;
+    if (r.width <= 0 || r.height <= 0) {
+        r = Region{0, 0, output_width(scale), output_height(scale)};
+    }
+    if (!output_.data() || output_.width() != r.width || output_.height() != r.height) {
+        output_ = Buffer<uint8_t, 3>(r.width, r.height, 3);
+    }
+    output_.set_min(r.x, r.y, 0);
+    return run(output_, 1.0f / scale);
+}
+
+int RawPipeline::render_into(Buffer<uint8_t, 3>& output) {
+    return run(output, cfg_.downscale_factor);
+}
+
+int RawPipeline::render_into(Buffer<uint8_t, 3>& output, float scale) {
+    return run(output, 1.0f / scale);
+}
+
+int RawPipeline::render_display(void* pixels, int width, int height, int stride_bytes, DisplayFormat format) {
+    const int pixel_bytes = format == DisplayFormat::RGB565 ? 2 : 4;
+    if (!has_raw() || width <= 0 || height <= 0 || stride_bytes % pixel_bytes != 0) return -1;
+    update_inputs();
+
+    // An even bin, so each output pixel covers whole CFA quads.
+    const int fit = static_cast<int>(std::ceil(std::max(float(raw_.width()) / width, float(raw_.height()) / height)));
+    const int bin = std::max(2, (fit + 1) & ~1);
+    const int out_width = raw_.width() / bin, out_height = raw_.height() / bin;
+    uint8_t* origin = static_cast<uint8_t*>(pixels) + static_cast<size_t>((height - out_height) / 2) * stride_bytes +
+                      static_cast<size_t>((width - out_width) / 2) * pixel_bytes;
+    halide_dimension_t dims[2] = {{0, out_width, 1}, {0, out_height, stride_bytes / pixel_bytes}};
+
+    const ProcessConfig& cfg = cfg_;
+    const PipelineUtils::RGBGains wb = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    const float exposure_multiplier = powf(2.0f, cfg.exposure);
+    Buffer<uint16_t, 2> input = raw_.bayer_data;
+    if (format == DisplayFormat::RGB565) {
+        Buffer<uint16_t, 2> display(reinterpret_cast<uint16_t*>(origin), 2, dims);
+        return camera_pipe_display_rgb565(input, raw_.cfa_pattern, cfg.green_balance, float(bin),
+                                          wb.r, wb.g, wb.b, color_matrix_, exposure_multiplier,
+                                          raw_.black_level, raw_.white_level, black_level_cfa_,
+                                          tone_curve_lut_, rgb_color_lut_, display);
+    }
+    Buffer<uint32_t, 2> display(reinterpret_cast<uint32_t*>(origin), 2, dims);
+    return camera_pipe_display_argb8888(input, raw_.cfa_pattern, cfg.green_balance, float(bin),
+                                        wb.r, wb.g, wb.b, color_matrix_, exposure_multiplier,
+                                        raw_.black_level, raw_.white_level, black_level_cfa_,
+                                        tone_curve_lut_, rgb_color_lut_, display);
+}
+
+void RawPipeline::update_inputs() {
+    const ProcessConfig& prev = inputs_params_;
+    if (!inputs_valid_ || prev.demosaic_algorithm != cfg_.demosaic_algorithm ||
+        prev.denoise_algorithm != cfg_.denoise_algorithm) {
+        demosaic_id_ = PipelineUtils::demosaic_algorithm_id(cfg_.demosaic_algorithm);
+        if (demosaic_id_ < 0) demosaic_id_ = 3; // fast
+        denoise_id_ = PipelineUtils::denoise_algorithm_id(cfg_.denoise_algorithm);
+        if (denoise_id_ < 0) denoise_id_ = 0; // guided
+    }
+    if (!inputs_valid_ || !PipelineUtils::tone_lut_inputs_match(prev, cfg_)) {
+        tone_curve_lut_ = ToneCurveUtils::generate_pipeline_lut(cfg_);
+    }
+    if (!inputs_valid_ || !PipelineUtils::color_lut_inputs_match(prev, cfg_)) {
+        color_grading_lut_ = PipelineUtils::color_grading_lut_for(cfg_);
+        rgb_color_lut_ = HostColor::generate_rgb_color_lut(color_grading_lut_);
+    }
+    if (!inputs_valid_ || !PipelineUtils::distortion_lut_inputs_match(prev, cfg_)) {
+#ifdef USE_LENSFUN
+        distortion_lut_ = PipelineUtils::LensCorrection::distortion_lut_for(cfg_, lensfun_database);
+#else
+        distortion_lut_ = PipelineUtils::LensCorrection::distortion_lut_for(cfg_, nullptr);
+#endif
+    }
+    if (!inputs_valid_ || !PipelineUtils::vignetting_lut_inputs_match(prev, cfg_)) {
+#ifdef USE_LENSFUN
+        vignetting_lut_ = PipelineUtils::LensCorrection::vignetting_lut_for(cfg_, lensfun_database);
+#else
+        vignetting_lut_ = PipelineUtils::LensCorrection::vignetting_lut_for(cfg_, nullptr);
+#endif
+    }
+    if (!inputs_valid_ || !PipelineUtils::tca_lut_inputs_match(prev, cfg_)) {
+#ifdef USE_LENSFUN
+        tca_lut_ = PipelineUtils::LensCorrection::tca_lut_for(cfg_, lensfun_database);
+#else
+        tca_lut_ = PipelineUtils::LensCorrection::tca_lut_for(cfg_, nullptr);
+#endif
+    }
+    if (!raw_inputs_valid_ || !inputs_valid_ || !PipelineUtils::color_matrix_inputs_match(prev, cfg_)) {
+        color_matrix_ = Buffer<float, 2>(4, 3);
+        PipelineUtils::color_matrix_for(raw_, cfg_, color_matrix_);
+    }
+    if (!raw_inputs_valid_) {
+        black_level_cfa_ = PipelineUtils::make_black_level_buffer(raw_);
+    }
+    inputs_params_ = cfg_;
+    inputs_valid_ = true;
+    raw_inputs_valid_ = true;
+}
+
+int RawPipeline::run(Buffer<uint8_t, 3>& output, float downscale_factor) {
+    if (!has_raw()) return -1;
+    update_inputs();
+
+    const ProcessConfig& cfg = cfg_;
+    const PipelineUtils::RGBGains wb_gains = PipelineUtils::kelvin_to_rgb_gains(cfg.color_temp, cfg.tint);
+    const float denoise_strength_norm = std::max(0.0f, std::min(1.0f, cfg.denoise_strength / 100.0f));
+    const float exposure_multiplier = powf(2.0f, cfg.exposure);
+
+    // As in process: bound the geometry warp's source rows on the host,
+    // for the whole output and for the rect this buffer covers.
+    const int out_width = static_cast<int>(raw_.width() / downscale_factor);
+    const int out_height = static_cast<int>(raw_.height() / downscale_factor);
+    const PipelineUtils::LensCorrection::WarpParams warp = PipelineUtils::LensCorrection::warp_params(cfg);
+    const int warp_row_reach =
+        PipelineUtils::LensCorrection::warp_row_reach(distortion_lut_, tca_lut_, warp, out_width, out_height);
+    int warp_row_min = 0, warp_row_max = out_height - 1;
+    int warp_col_min = 0, warp_col_max = out_width - 1;
+    if (output.dim(0).min() > 0 || output.width() < out_width ||
+        output.dim(1).min() > 0 || output.height() < out_height) {
+        PipelineUtils::LensCorrection::warp_source_rect(distortion_lut_, tca_lut_, warp, out_width, out_height,
+                                                        output.dim(0).min(), output.dim(0).max() + 1,
+                                                        output.dim(1).min(), output.dim(1).max() + 1,
+                                                        warp_row_min, warp_row_max, warp_col_min, warp_col_max);
+    }
+
+    PipelineUtils::LocalAdjustInputs adjust =
+        PipelineUtils::make_local_adjust_inputs(cfg, out_width, out_height, /* orientation: as stored */ 1);
+
+    // Same signature for both variants.
+    auto camera_pipe = variant_ == Variant::U16 ? camera_pipe_u16 : camera_pipe_f32;
+    Buffer<uint16_t, 2> input = raw_.bayer_data;
+    int result = camera_pipe(input, raw_.cfa_pattern, cfg.green_balance, downscale_factor, demosaic_id_,
+                             wb_gains.r, wb_gains.g, wb_gains.b, color_matrix_,
+                             exposure_multiplier,
+                             PipelineUtils::LensCorrection::ca_estimate_strength(cfg, tca_lut_),
+                             denoise_strength_norm, cfg.denoise_eps, denoise_id_,
+                             raw_.black_level, raw_.white_level, black_level_cfa_, tone_curve_lut_,
+                             cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                             cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights, cfg.ll_blacks, cfg.ll_whites,
+                             cfg.ll_debug_level,
+                             color_grading_lut_, rgb_color_lut_,
+                             cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness, cfg.vignette_highlights,
+                             vignetting_lut_,
+                             cfg.dehaze_strength,
+                             distortion_lut_, tca_lut_,
+                             cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                             cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                             cfg.geo_keystone_v, cfg.geo_keystone_h,
+                             cfg.geo_offset_x, cfg.geo_offset_y,
+                             warp_row_min, warp_row_max, warp_row_reach,
+                             warp_col_min, warp_col_max, /* orientation: as stored */ 1,
+                             adjust.masks, adjust.exposure, adjust.tiles,
+                             output);
+    if (result == 0) {
+        output.device_sync();
+    }
+    return result;
+}
@@ -0,0 +1,111 @@
+#ifndef RAW_PIPELINE_H
+#define RAW_PIPELINE_H
+
+#include "HalideBuffer.h"
+#include "pipeline_utils.h"
+#include "process_options.h"
+#include "raw_load.h"
+#include <cstdint>
+#include <string>
+
+// A render context for callers that render many times in one process (a
+// service, a daemon, a batch): it holds one raw, the config, and every
+// pipeline input built on the host from them, and runs camera_pipe_f32 or
+// camera_pipe_u16 on request. Built as the shared library raw_pipeline.
+//
+// The host-built inputs (tone and color LUTs, lens LUTs, color matrix,
+// black levels) are rebuilt only when the parameters they depend on change
+// (PipelineUtils::*_inputs_match), so a render after e.g. an exposure change
+// does no host work. render() reuses its output buffer while the region's
+// size stays the same.
+//
+// Halide's thread settings are per process: constructing a context, or
+// changing the config's threads, thread_pool or affinity, applies them to
+// every pipeline in the process. Not thread safe; use one context per
+// thread.
+class RawPipeline {
+public:
+    enum class Variant { F32, U16 };
+    // A display frame buffer's pixels, as LVGL lays them out: RGB565 in a
+    // uint16_t, ARGB8888 as B, G, R, A bytes.
+    enum class DisplayFormat { RGB565, ARGB8888 };
+
+    // A rectangle of the output, in output pixels. An empty one is the
+    // whole output.
+    struct Region {
+        int x = 0, y = 0, width = 0, height = 0;
+    };
+
+    explicit RawPipeline(const ProcessConfig& cfg = ProcessConfig(), Variant variant = Variant::F32);
+
+    // Replaces the config; the inputs that depend on what changed are
+    // rebuilt by the next render.
+    void set_config(const ProcessConfig& cfg);
+    const ProcessConfig& config() const { return cfg_; }
+    Variant variant() const { return variant_; }
+
+    // Loads the raw at `path` as process does (raw containers, the config's
+    // raw_png and half_size). Throws std::runtime_error if it can't be read.
+    void load(const std::string& path);
+    // Uses an already loaded raw. Its buffers are shared, not copied.
+    void set_raw(const RawImageData& raw);
+    const RawImageData& raw() const { return raw_; }
+    bool has_raw() const { return raw_.bayer_data.data() != nullptr; }
+
+    // The size of the whole output at `scale` output pixels per raw pixel.
+    int output_width(float scale) const;
+    int output_height(float scale) const;
+
+    // Renders `roi` of the output at `scale` (1 is full size, 0.5 half)
+    // into the context's own buffer, which output() then holds. Returns
+    // the Halide error code, 0 on success.
+    int render(const Region& roi, float scale);
+    const Halide::Runtime::Buffer<uint8_t, 3>& output() const { return output_; }
+
+    // Renders the part of the output `output` covers (its mins are the
+    // offset into the output) at the config's downscale_factor. Returns the
+    // Halide error code, 0 on success.
+    int render_into(Halide::Runtime::Buffer<uint8_t, 3>& output);
+    // The same at `scale` rather than the config's downscale_factor, e.g.
+    // into memory a caller owns (the Python bindings' arrays).
+    int render_into(Halide::Runtime::Buffer<uint8_t, 3>& output, float scale);
+
+    // Renders the whole raw, fitted and centred, straight into a display's
+    // frame buffer of `width` x `height` pixels with rows `stride_bytes`
+    // apart, through camera_pipe_display_rgb565/_argb8888: the live view's
+    // binned processing (no denoise, local contrast or geometry), packed and
+    // for RGB565 dithered in the same pass. Pixels outside the fitted image
+    // are left alone. Returns the Halide error code, 0 on success, or -1 with
+    // no raw or a stride that isn't whole pixels.
+    int render_display(void* pixels, int width, int height, int stride_bytes, DisplayFormat format);
+
+private:
+    // Rebuilds the host-built inputs that are stale for cfg_ and raw_.
+    void update_inputs();
+    int run(Halide::Runtime::Buffer<uint8_t, 3>& output, float downscale_factor);
+
+    ProcessConfig cfg_;
+    Variant variant_;
+    RawImageData raw_;
+
+    // What the host-built inputs were last built from. The config-only ones
+    // are valid while inputs_valid_, the per-raw ones while raw_inputs_valid_.
+    bool inputs_valid_ = false;
+    bool raw_inputs_valid_ = false;
+    ProcessConfig inputs_params_;
+
+    int demosaic_id_ = 3;
+    int denoise_id_ = 0;
+    Halide::Runtime::Buffer<float, 1> distortion_lut_;
+    Halide::Runtime::Buffer<float, 1> vignetting_lut_;
+    Halide::Runtime::Buffer<float, 2> tca_lut_;
+    Halide::Runtime::Buffer<uint16_t, 2> tone_curve_lut_;
+    Halide::Runtime::Buffer<float, 4> color_grading_lut_;
+    Halide::Runtime::Buffer<float, 4> rgb_color_lut_;
+    Halide::Runtime::Buffer<float, 2> color_matrix_;
+    Halide::Runtime::Buffer<int, 2> black_level_cfa_;
+
+    Halide::Runtime::Buffer<uint8_t, 3> output_;
+};
+
+#endif // RAW_PIPELINE_H
@@ -0,0 +1,72 @@
+#include "raw_pipeline_c.h"
+#include "raw_pipeline.h"
+
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+struct raw_pipeline {
+    RawPipeline context;
+    std::string error;
+};
+
+extern "C" {
+
+raw_pipeline_t* raw_pipeline_create(void) {
+    return new (std::nothrow) raw_pipeline();
+}
+
+void raw_pipeline_destroy(raw_pipeline_t* pipeline) {
+    delete pipeline;
+}
+
+int raw_pipeline_set_options(raw_pipeline_t* pipeline, const char* options) {
+    std::vector<std::string> tokens = split_option_line(options ? options : "");
+    std::vector<char*> argv;
+    std::string program = "raw_pipeline";
+    argv.push_back(&program[0]);
+    for (std::string& token : tokens) {
+        if (token == "--help") {
+            pipeline->error = "--help is not a render option";
+            return -1;
+        }
+        argv.push_back(&token[0]);
+    }
+    try {
+        pipeline->context.set_config(parse_args(static_cast<int>(argv.size()), argv.data()));
+    } catch (const std::exception& e) {
+        pipeline->error = e.what();
+        return -1;
+    }
+    return 0;
+}
+
+int raw_pipeline_load(raw_pipeline_t* pipeline, const char* path) {
+    try {
+        pipeline->context.load(path);
+    } catch (const std::exception& e) {
+        pipeline->error = e.what();
+        return -1;
+    }
+    return 0;
+}
+
+int raw_pipeline_render_display(raw_pipeline_t* pipeline, void* pixels, int width, int height, int stride_bytes,
+                                raw_pipeline_display_format_t format) {
+    const RawPipeline::DisplayFormat display_format =
+        format == RAW_PIPELINE_RGB565 ? RawPipeline::DisplayFormat::RGB565 : RawPipeline::DisplayFormat::ARGB8888;
+    const int result = pipeline->context.render_display(pixels, width, height, stride_bytes, display_format);
+    if (result != 0) {
+        pipeline->error = pipeline->context.has_raw()
+                              ? "render failed with error " + std::to_string(result)
+                              : std::string("no raw loaded");
+    }
+    return result;
+}
+
+const char* raw_pipeline_error(const raw_pipeline_t* pipeline) {
+    return pipeline->error.c_str();
+}
+
+} // extern "C"
@@ -0,0 +1,47 @@
+#ifndef RAW_PIPELINE_C_H
+#define RAW_PIPELINE_C_H
+
+#include <stdint.h>
+
+// A C API over RawPipeline (src/raw_pipeline.h), in the raw_pipeline
+// shared library, for C callers such as the LVGL editor: load a raw, set
+// the look as process options, and render it straight into a display's
+// frame buffer. Functions returning int return 0 on success; on failure
+// raw_pipeline_error() says why.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct raw_pipeline raw_pipeline_t;
+
+typedef enum {
+    RAW_PIPELINE_RGB565,   // uint16_t, red in the top bits (LV_COLOR_FORMAT_RGB565)
+    RAW_PIPELINE_ARGB8888, // B, G, R, A bytes (LV_COLOR_FORMAT_ARGB8888 / XRGB8888)
+} raw_pipeline_display_format_t;
+
+// A context with the process defaults, or NULL if it can't be created.
+raw_pipeline_t* raw_pipeline_create(void);
+void raw_pipeline_destroy(raw_pipeline_t* pipeline);
+
+// Sets the config from process options, e.g. "--exposure 0.5 --contrast 20",
+// over the defaults.
+int raw_pipeline_set_options(raw_pipeline_t* pipeline, const char* options);
+
+// Loads the raw at `path`.
+int raw_pipeline_load(raw_pipeline_t* pipeline, const char* path);
+
+// Renders the raw, fitted and centred, into `pixels`: `width` x `height`
+// pixels of `format`, rows `stride_bytes` apart. Pixels outside the image
+// are left as they are.
+int raw_pipeline_render_display(raw_pipeline_t* pipeline, void* pixels, int width, int height, int stride_bytes,
+                                raw_pipeline_display_format_t format);
+
+// Why the last call failed.
+const char* raw_pipeline_error(const raw_pipeline_t* pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RAW_PIPELINE_C_H
@@ -0,0 +1,107 @@
+#include "raw_row_stream.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace { // Anonymous namespace for local helpers
+
+// Reads exactly `size` bytes at `offset`, or returns false.
+bool read_fully(int fd, uint8_t* dst, size_t size, uint64_t offset) {
+    while (size > 0) {
+        const ssize_t n = pread(fd, dst, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        dst += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+RawRowStream::RawRowStream(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Could not open raw container " + path);
+    struct stat st;
+    RawContainer::Header header;
+    std::string error;
+    if (fstat(fd, &st) != 0 || !read_fully(fd, reinterpret_cast<uint8_t*>(&header), sizeof(header), 0)) {
+        error = "is too short";
+    } else {
+        error = RawContainer::validate(header, static_cast<uint64_t>(st.st_size));
+    }
+    if (!error.empty()) {
+        close(fd);
+        throw std::runtime_error("Raw container " + path + ": " + error);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    raw_ = raw_container_metadata(header);
+    raw_.bayer_data = Halide::Runtime::Buffer<uint16_t, 2>(static_cast<int>(header.width), static_cast<int>(header.height));
+    packing_ = static_cast<RawPacking>(header.packing);
+    stride_ = header.stride;
+    data_offset_ = header.data_offset;
+    reader_ = std::thread([this, fd] {
+        read_rows(fd);
+        close(fd);
+    });
+}
+
+RawRowStream::~RawRowStream() {
+    if (reader_.joinable()) reader_.join();
+}
+
+void RawRowStream::read_rows(int fd) {
+    Instrumentation::ScopedTimer read_timer("Raw Container Stream");
+    Halide::Runtime::Buffer<uint16_t, 2>& bayer = raw_.bayer_data;
+    const int width = bayer.width(), height = bayer.height();
+    const int chunk_rows = std::max(1, static_cast<int>(kChunkBytes / stride_));
+    // 16-bit rows with no padding go straight into the mosaic; anything else
+    // through a chunk of the file's rows.
+    const bool direct = packing_ == RawPacking::None && stride_ == static_cast<size_t>(width) * 2;
+    std::vector<uint8_t> chunk(direct ? 0 : static_cast<size_t>(chunk_rows) * stride_);
+    for (int y = 0; y < height; y += chunk_rows) {
+        const int rows = std::min(chunk_rows, height - y);
+        const uint64_t offset = data_offset_ + static_cast<uint64_t>(y) * stride_;
+        const size_t bytes = static_cast<size_t>(rows) * stride_;
+        uint8_t* dst = direct ? reinterpret_cast<uint8_t*>(&bayer(0, y)) : chunk.data();
+        if (!read_fully(fd, dst, bytes, offset)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = "the raw container's pixels could not be read";
+            cv_.notify_all();
+            return;
+        }
+        for (int r = 0; r < rows && !direct; ++r) {
+            const uint8_t* src = chunk.data() + static_cast<size_t>(r) * stride_;
+            if (packing_ == RawPacking::None) {
+                memcpy(&bayer(0, y + r), src, static_cast<size_t>(width) * 2);
+            } else {
+                csi2_unpack_row(packing_, src, &bayer(0, y + r), width);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        rows_ready_ = y + rows;
+        cv_.notify_all();
+    }
+}
+
+void RawRowStream::wait_rows(int end) {
+    end = std::min(end, raw_.bayer_data.height());
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return rows_ready_ >= end || !error_.empty(); });
+    if (rows_ready_ < end) throw std::runtime_error(error_);
+}
+
+bool RawRowStream::done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rows_ready_ >= raw_.bayer_data.height();
+}
@@ -0,0 +1,58 @@
+#ifndef RAW_ROW_STREAM_H
+#define RAW_ROW_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "raw_load.h"
+
+// A raw container (raw_container.h) read into memory from the top down on a
+// thread of its own, so the pipeline can start on the first bands of a
+// streamed render (--stream-input) while the rest of the file is still
+// coming off the disk. Containers are the one input whose rows land in
+// order: RawSpeed decodes a file whole and publishes nothing until it is
+// done.
+//
+// raw() has the header's metadata straight away and a mosaic that fills
+// from row 0 down, in chunks of about kChunkBytes of the file. Packed
+// (CSI-2) rows are unpacked to 16 bits as they arrive, so the result is
+// never packed. Nothing may read a row of the mosaic before wait_rows()
+// has returned for it.
+class RawRowStream {
+public:
+    static constexpr size_t kChunkBytes = size_t(4) << 20;
+
+    // Opens `path`, checks its header and starts reading. Throws
+    // std::runtime_error if it can't be opened or isn't a valid container.
+    explicit RawRowStream(const std::string& path);
+    // Waits for the read to end.
+    ~RawRowStream();
+    RawRowStream(const RawRowStream&) = delete;
+    RawRowStream& operator=(const RawRowStream&) = delete;
+
+    const RawImageData& raw() const { return raw_; }
+
+    // Blocks until rows [0, end) of raw().bayer_data are in (end is clamped
+    // to the height). Throws std::runtime_error if the read failed first.
+    void wait_rows(int end);
+    bool done() const;
+
+private:
+    void read_rows(int fd);
+
+    RawImageData raw_;
+    RawPacking packing_ = RawPacking::None;
+    size_t stride_ = 0;      // Bytes per row in the file.
+    uint64_t data_offset_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    int rows_ready_ = 0;
+    std::string error_;
+    std::thread reader_;
+};
+
+#endif // RAW_ROW_STREAM_H
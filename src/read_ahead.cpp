@@ -0,0 +1,402 @@
+#include "read_ahead.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace { // Anonymous namespace for local helpers
+
+constexpr size_t kAlignment = 4096;
+// Threads of the fallback backend.
+constexpr int kReadThreads = 2;
+#ifdef USE_IO_URING
+// The ring's depth, and the size of each read on it: enough in flight to
+// keep a network mount or an NVMe queue busy.
+constexpr unsigned kRingEntries = 64;
+constexpr size_t kChunkBytes = size_t(1) << 22;
+#endif
+
+size_t round_up(size_t bytes) {
+    return std::max(kAlignment, (bytes + kAlignment - 1) / kAlignment * kAlignment);
+}
+
+} // namespace
+
+struct ReadAhead::State {
+    enum class Slot { Waiting, Reading, Ready, Failed, Taken };
+    struct File {
+        Slot slot = Slot::Waiting;
+        uint8_t* buffer = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;
+    };
+    // A file being read: claimed in list order, opened, then given a buffer
+    // once its turn comes and the pool has room.
+    struct Claim {
+        size_t index = 0;
+        int fd = -1;
+        size_t size = 0;
+        uint8_t* buffer = nullptr;
+        size_t capacity = 0;
+    };
+
+    std::vector<std::string> paths;
+    size_t depth = 1;
+    size_t budget = 0;
+    bool uring = false;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<File> files;
+    size_t next_claim = 0;  // The next file to start.
+    size_t next_buffer = 0; // The next claim to get a buffer, so they're read in order.
+    size_t ahead = 0;       // Files started and not yet taken.
+    size_t ahead_bytes = 0; // Buffers being read or waiting to be taken.
+    std::vector<std::pair<uint8_t*, size_t>> free_buffers;
+    size_t free_bytes = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    ~State() {
+        for (const auto& b : free_buffers) free(b.first);
+    }
+
+    // With the lock held.
+    bool can_claim() const { return !stopping && next_claim < files.size() && ahead < depth; }
+
+    Claim claim() {
+        Claim c;
+        c.index = next_claim++;
+        ahead++;
+        files[c.index].slot = Slot::Reading;
+        return c;
+    }
+
+    // Without the lock. Leaves fd at -1 if the file can't be read.
+    void open_claim(Claim& c) {
+        const int fd = open(paths[c.index].c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+            close(fd);
+            return;
+        }
+        c.fd = fd;
+        c.size = static_cast<size_t>(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    // With the lock held: whether `c` may have its buffer now.
+    bool buffer_ready(const Claim& c) const {
+        return c.index == next_buffer && (c.fd < 0 || ahead_bytes == 0 || ahead_bytes + round_up(c.size) <= budget);
+    }
+
+    // With the lock held, once buffer_ready(). Reuses the smallest free
+    // buffer that's big enough, else frees others until a new one fits.
+    bool give_buffer(Claim& c) {
+        next_buffer++;
+        if (c.fd < 0) return false;
+        const size_t capacity = round_up(c.size);
+        auto best = free_buffers.end();
+        for (auto it = free_buffers.begin(); it != free_buffers.end(); ++it) {
+            if (it->second >= capacity && (best == free_buffers.end() || it->second < best->second)) best = it;
+        }
+        if (best != free_buffers.end()) {
+            c.buffer = best->first;
+            c.capacity = best->second;
+            free_bytes -= best->second;
+            free_buffers.erase(best);
+        } else {
+            std::sort(free_buffers.begin(), free_buffers.end(),
+                      [](const auto& a, const auto& b) { return a.second < b.second; });
+            while (!free_buffers.empty() && ahead_bytes + free_bytes + capacity > budget) {
+                free(free_buffers.back().first);
+                free_bytes -= free_buffers.back().second;
+                free_buffers.pop_back();
+            }
+            void* p = nullptr;
+            if (posix_memalign(&p, kAlignment, capacity) != 0) {
+                close(c.fd);
+                c.fd = -1;
+                return false;
+            }
+            c.buffer = static_cast<uint8_t*>(p);
+            c.capacity = capacity;
+        }
+        ahead_bytes += c.capacity;
+        return true;
+    }
+
+    // With the lock held: a buffer no longer in use goes back to the pool,
+    // or is freed if the pool is full.
+    void recycle(uint8_t* buffer, size_t capacity) {
+        if (stopping || ahead_bytes + free_bytes + capacity > budget) {
+            free(buffer);
+            return;
+        }
+        free_buffers.emplace_back(buffer, capacity);
+        free_bytes += capacity;
+    }
+
+    // With the lock held: `c` has been read, or failed.
+    void finish(Claim& c, bool ok) {
+        if (c.fd >= 0) close(c.fd);
+        File& file = files[c.index];
+        if (ok) {
+            file.slot = Slot::Ready;
+            file.buffer = c.buffer;
+            file.capacity = c.capacity;
+            file.size = c.size;
+        } else {
+            file.slot = Slot::Failed;
+            if (c.buffer) {
+                ahead_bytes -= c.capacity;
+                recycle(c.buffer, c.capacity);
+            }
+        }
+        changed.notify_all();
+    }
+
+    void run_threads();
+#ifdef USE_IO_URING
+    void run_uring(io_uring& ring);
+#endif
+};
+
+void ReadAhead::State::run_threads() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [&] { return stopping || can_claim(); });
+        if (stopping) return;
+        Claim c = claim();
+        lock.unlock();
+        open_claim(c);
+        lock.lock();
+        changed.wait(lock, [&] { return stopping || buffer_ready(c); });
+        if (stopping) {
+            finish(c, false);
+            return;
+        }
+        bool ok = give_buffer(c);
+        if (ok) {
+            lock.unlock();
+            for (size_t done = 0; ok && done < c.size;) {
+                const ssize_t n = pread(c.fd, c.buffer + done, c.size - done, static_cast<off_t>(done));
+                if (n < 0 && errno == EINTR) continue;
+                ok = n > 0;
+                if (ok) done += static_cast<size_t>(n);
+            }
+            lock.lock();
+        }
+        finish(c, ok);
+    }
+}
+
+#ifdef USE_IO_URING
+// One thread: claims files while the depth and the pool allow, queues each
+// one's reads in kChunkBytes pieces as the ring has room, and finishes a
+// file when its last piece completes. It only blocks on the ring while
+// reads are in flight, so a completion is never left waiting behind a full
+// pool.
+void ReadAhead::State::run_uring(io_uring& ring) {
+    struct Reading {
+        Claim claim;
+        size_t queued = 0; // Bytes handed to the ring so far.
+        size_t done = 0;
+        int in_flight = 0;
+        bool failed = false;
+    };
+    struct Piece {
+        Reading* reading;
+        size_t offset, length;
+    };
+    std::list<Reading> reading;
+    std::list<Piece> retries; // Short reads still to finish.
+    Claim pending;
+    bool have_pending = false;
+    unsigned in_flight = 0;
+
+    auto queue = [&](Reading& r, size_t offset, size_t length) {
+        if (in_flight >= kRingEntries) return false; // Keep the completion queue from overflowing.
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (!sqe) return false;
+        io_uring_prep_read(sqe, r.claim.fd, r.claim.buffer + offset, static_cast<unsigned>(length), offset);
+        io_uring_sqe_set_data(sqe, new Piece{&r, offset, length});
+        r.in_flight++;
+        in_flight++;
+        return true;
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Start what the depth and the pool allow.
+        while (!stopping) {
+            if (!have_pending) {
+                if (!can_claim()) break;
+                pending = claim();
+                have_pending = true;
+                lock.unlock();
+                open_claim(pending);
+                lock.lock();
+            }
+            if (!buffer_ready(pending)) break;
+            have_pending = false;
+            if (!give_buffer(pending)) {
+                finish(pending, false);
+                continue;
+            }
+            reading.push_back(Reading{pending});
+        }
+        if (stopping && have_pending) {
+            next_buffer = std::max(next_buffer, pending.index + 1);
+            finish(pending, false);
+            have_pending = false;
+        }
+        if (in_flight == 0 && reading.empty() && retries.empty()) {
+            if (stopping) return;
+            changed.wait(lock);
+            continue;
+        }
+        lock.unlock();
+
+        // Fill the ring: short reads first, then the next pieces in file order.
+        while (!retries.empty() && queue(*retries.front().reading, retries.front().offset, retries.front().length)) {
+            retries.pop_front();
+        }
+        for (Reading& r : reading) {
+            while (!r.failed && r.queued < r.claim.size &&
+                   queue(r, r.queued, std::min(kChunkBytes, r.claim.size - r.queued))) {
+                r.queued = std::min(r.claim.size, r.queued + kChunkBytes);
+            }
+        }
+        io_uring_submit(&ring);
+
+        io_uring_cqe* cqe = nullptr;
+        int wait = in_flight > 0 ? io_uring_wait_cqe(&ring, &cqe) : -EAGAIN;
+        while (wait == 0 && cqe) {
+            Piece* piece = static_cast<Piece*>(io_uring_cqe_get_data(cqe));
+            const int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            Reading& r = *piece->reading;
+            r.in_flight--;
+            in_flight--;
+            if (res == -EINTR || res == -EAGAIN) {
+                retries.push_back(*piece);
+            } else if (res <= 0) {
+                r.failed = true;
+            } else if (static_cast<size_t>(res) < piece->length) {
+                r.done += static_cast<size_t>(res);
+                retries.push_back(Piece{&r, piece->offset + res, piece->length - res});
+            } else {
+                r.done += piece->length;
+            }
+            delete piece;
+            cqe = nullptr;
+            wait = io_uring_peek_cqe(&ring, &cqe);
+        }
+
+        lock.lock();
+        for (auto it = reading.begin(); it != reading.end();) {
+            const bool complete = it->done == it->claim.size;
+            if (it->in_flight > 0 || !(complete || it->failed)) {
+                ++it;
+                continue;
+            }
+            if (it->failed) {
+                retries.remove_if([&](const Piece& p) { return p.reading == &*it; });
+            }
+            finish(it->claim, !it->failed && complete);
+            it = reading.erase(it);
+        }
+        if (stopping) {
+            // Let the reads in flight land, then drop the rest.
+            for (Reading& r : reading) r.failed = true;
+        }
+    }
+}
+#endif
+
+ReadAhead::ReadAhead(std::vector<std::string> paths, int depth, size_t budget_bytes)
+    : state_(std::make_shared<State>()) {
+    state_->files.resize(paths.size());
+    state_->paths = std::move(paths);
+    state_->depth = static_cast<size_t>(std::max(1, depth));
+    state_->budget = budget_bytes;
+    State* state = state_.get();
+#ifdef USE_IO_URING
+    auto ring = std::make_shared<io_uring>();
+    if (io_uring_queue_init(kRingEntries, ring.get(), 0) == 0) {
+        state->uring = true;
+        state->threads.emplace_back([state, ring] {
+            state->run_uring(*ring);
+            io_uring_queue_exit(ring.get());
+        });
+        return;
+    }
+#endif
+    for (int i = 0; i < kReadThreads; ++i) state->threads.emplace_back([state] { state->run_threads(); });
+}
+
+ReadAhead::~ReadAhead() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->stopping = true;
+        state_->changed.notify_all();
+    }
+    for (auto& t : state_->threads) t.join();
+    // Files read but never taken. Buffers still held by callers are freed
+    // when they're dropped.
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (State::File& file : state_->files) {
+        if (file.slot == State::Slot::Ready) free(file.buffer);
+        file.slot = State::Slot::Taken;
+    }
+}
+
+RawFileBytes ReadAhead::take(size_t index) {
+    Instrumentation::ScopedTimer wait_timer("Read Ahead Wait");
+    State& s = *state_;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    State::File& file = s.files.at(index);
+    s.changed.wait(lock, [&] {
+        return s.stopping || file.slot == State::Slot::Ready || file.slot == State::Slot::Failed;
+    });
+    RawFileBytes bytes;
+    if (file.slot == State::Slot::Ready) {
+        std::shared_ptr<State> state = state_;
+        const size_t capacity = file.capacity;
+        bytes.data = file.buffer;
+        bytes.size = file.size;
+        bytes.storage = std::shared_ptr<const void>(file.buffer, [state, capacity](const void* p) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->recycle(static_cast<uint8_t*>(const_cast<void*>(p)), capacity);
+        });
+        s.ahead_bytes -= capacity;
+        Instrumentation::Registry::get().add_bytes("read ahead bytes", file.size);
+    }
+    if (file.slot == State::Slot::Ready || file.slot == State::Slot::Failed) s.ahead--;
+    file.slot = State::Slot::Taken;
+    s.changed.notify_all();
+    return bytes;
+}
+
+const char* ReadAhead::backend() const {
+    return state_->uring ? "io_uring" : "threads";
+}
@@ -0,0 +1,49 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "raw_load.h"
+
+// Reads the files of a batch or sequence into memory ahead of their decode,
+// so the disk works on the next files while the decoders and the pipeline
+// work on this one. Without it each file is read (or faulted in through its
+// mapping) by the decoder, and a cold file on network storage stalls the
+// decode for as long as the read takes.
+//
+// The files are read in list order, at most `depth` of them ahead of the
+// ones taken, into page-aligned buffers. At most `budget_bytes` of them are
+// read or waiting at once: a file is started only when its buffer fits next
+// to those (one larger than the whole budget is read on its own). take()
+// hands a file's buffer to the caller without a copy. It belongs to the
+// caller from then on, and goes back to the pool for reuse when the last
+// reference is dropped (the RawImageData of a raw container points into it).
+//
+// On Linux with liburing (USE_IO_URING) one thread queues every file's
+// reads on an io_uring; elsewhere, or if the ring can't be set up, a few
+// threads read with pread. A file that can't be opened or read comes back
+// empty from take() and the caller loads it from its path as usual, which
+// also reports the error.
+class ReadAhead {
+public:
+    ReadAhead(std::vector<std::string> paths, int depth, size_t budget_bytes);
+    ~ReadAhead();
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    // Waits for paths[index] and hands its bytes over; each index once.
+    RawFileBytes take(size_t index);
+
+    // "io_uring" or "threads".
+    const char* backend() const;
+
+    struct State;
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+#endif // READ_AHEAD_H
@@ -0,0 +1,226 @@
+// scaling_benchmark: strong-scaling sweep of the whole camera_pipe.
+//
+// Runs camera_pipe_f32 and camera_pipe_u16 on synthetic Bayer frames of
+// several sizes, for every combination of Halide thread count, demosaic and
+// set of expensive stages switched on, and writes one CSV row per
+// combination: median/p10/p90 time, MP/s, and speedup and parallel
+// efficiency against the fewest threads measured. The CSV starts with
+// '#' comment lines describing the host, so numbers copied out of it say
+// what they were measured on.
+//
+// Each sample is Halide::Tools::benchmark(1, iterations, ...), as in
+// stage_benchmark.
+
+#include "HalideBuffer.h"
+#include "HalideRuntime.h"
+#include "halide_benchmark.h"
+#include "camera_pipe_benchmark.h"
+
+#include "camera_pipe_f32_lib.h"
+#include "camera_pipe_u16_lib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Halide::Runtime::Buffer;
+using CameraPipeBenchmark::config_for;
+using CameraPipeBenchmark::Inputs;
+using CameraPipeBenchmark::kStageSets;
+
+namespace {
+
+struct BenchmarkOptions {
+    std::vector<double> megapixels = {2, 8, 24};
+    std::vector<int> threads;        // Empty: 1, 2, 4, ... up to the core count.
+    std::vector<std::string> variants = {"f32", "u16"};
+    std::vector<int> demosaic_ids = {3};
+    std::vector<std::string> stage_sets = {"none", "all"};
+    int samples = 5;
+    int iterations = 1;
+    std::string csv_path = "scaling.csv";
+};
+
+void print_usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --sizes <list>      Frame sizes in megapixels, 3:2 (default 2,8,24; e.g. 2,8,24,50,100)\n"
+              << "  --threads <list>    Halide thread counts (default 1,2,4,... up to the core count)\n"
+              << "  --variants <list>   f32, u16 (default f32,u16)\n"
+              << "  --demosaic <list>   Demosaic ids: 0=ahd 1=lmmse 2=ri 3=fast 4=adaptive (default 3)\n"
+              << "  --stages <list>     Stage sets: none, ca, ll, denoise, geometry, all (default none,all)\n"
+              << "  --samples <n>       Timed samples per combination (default 5)\n"
+              << "  --iterations <n>    Runs per sample (default 1)\n"
+              << "  --csv <path>        Output CSV (default scaling.csv)\n";
+}
+
+std::vector<std::string> split_list(const std::string& s) {
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    if (items.empty()) throw std::runtime_error("Empty list: " + s);
+    return items;
+}
+
+BenchmarkOptions parse_benchmark_args(int argc, char** argv) {
+    BenchmarkOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--sizes") {
+            opts.megapixels.clear();
+            for (const auto& s : split_list(value())) opts.megapixels.push_back(std::stod(s));
+        } else if (arg == "--threads") {
+            opts.threads.clear();
+            for (const auto& s : split_list(value())) opts.threads.push_back(std::stoi(s));
+        } else if (arg == "--variants") {
+            opts.variants = split_list(value());
+        } else if (arg == "--demosaic") {
+            opts.demosaic_ids.clear();
+            for (const auto& s : split_list(value())) opts.demosaic_ids.push_back(std::stoi(s));
+        } else if (arg == "--stages") {
+            opts.stage_sets = split_list(value());
+        } else if (arg == "--samples") {
+            opts.samples = std::stoi(value());
+        } else if (arg == "--iterations") {
+            opts.iterations = std::stoi(value());
+        } else if (arg == "--csv") {
+            opts.csv_path = value();
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            exit(0);
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    if (opts.samples < 1 || opts.iterations < 1) throw std::runtime_error("--samples and --iterations must be positive");
+    for (const auto& v : opts.variants) {
+        if (v != "f32" && v != "u16") throw std::runtime_error("Unknown variant: " + v);
+    }
+    for (int id : opts.demosaic_ids) {
+        if (id < 0 || id > 3) throw std::runtime_error("Demosaic ids are 0-3");
+    }
+    for (const auto& s : opts.stage_sets) {
+        if (std::find(std::begin(kStageSets), std::end(kStageSets), s) == std::end(kStageSets)) {
+            throw std::runtime_error("Unknown stage set: " + s);
+        }
+    }
+    if (opts.threads.empty()) {
+        const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        for (int t = 1; t < cores; t *= 2) opts.threads.push_back(t);
+        opts.threads.push_back(cores);
+    }
+    std::sort(opts.threads.begin(), opts.threads.end());
+    return opts;
+}
+
+// Times one configuration. Returns the per-run times of the samples in ms.
+std::vector<double> time_run(const std::string& variant, int demosaic_id, const ProcessConfig& cfg,
+                             Inputs& in, Buffer<uint8_t, 3>& output, const BenchmarkOptions& opts) {
+    CameraPipeBenchmark::Run pipeline_run(cfg, demosaic_id);
+    auto pipe = variant == "f32" ? camera_pipe_f32 : camera_pipe_u16;
+    auto run = [&]() { pipeline_run(pipe, "camera_pipe_" + variant, in, output); };
+    run(); // Warm up: thread pool, allocation caches, page faults.
+    std::vector<double> ms(opts.samples);
+    for (int i = 0; i < opts.samples; ++i) {
+        ms[i] = Halide::Tools::benchmark(1, opts.iterations, run) * 1e3;
+    }
+    return ms;
+}
+
+double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    double pos = p * (v.size() - 1);
+    size_t lo = (size_t)floor(pos), hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (pos - lo);
+}
+
+// The model name from /proc/cpuinfo where there is one.
+std::string cpu_name() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) return line.substr(line.find_first_not_of(" \t", colon + 1));
+        }
+    }
+    return "unknown";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        BenchmarkOptions opts = parse_benchmark_args(argc, argv);
+
+        FILE* csv = fopen(opts.csv_path.c_str(), "w");
+        if (!csv) throw std::runtime_error("Could not open " + opts.csv_path + " for writing");
+        fprintf(csv, "# cpu: %s\n# hardware threads: %u\n# samples: %d x %d runs\n",
+                cpu_name().c_str(), std::thread::hardware_concurrency(), opts.samples, opts.iterations);
+        fprintf(csv, "variant,width,height,megapixels,demosaic,stages,threads,"
+                     "median_ms,p10_ms,p90_ms,mp_per_s,speedup,efficiency\n");
+
+        Inputs in;
+        for (double mp : opts.megapixels) {
+            in.set_size(mp);
+            const int width = in.bayer.width(), height = in.bayer.height();
+            Buffer<uint8_t, 3> output(width, height, 3);
+            const double frame_mp = width * (double)height / 1e6;
+            std::cerr << "Frame " << width << "x" << height << " (" << frame_mp << " MP)\n";
+
+            for (const auto& variant : opts.variants) {
+                for (int demosaic_id : opts.demosaic_ids) {
+                    for (const auto& stages : opts.stage_sets) {
+                        const ProcessConfig cfg = config_for(stages);
+                        double base_ms = 0.0;
+                        int base_threads = 0;
+                        for (int threads : opts.threads) {
+                            // Restart the pool so it really has this many workers.
+                            halide_shutdown_thread_pool();
+                            halide_set_num_threads(threads);
+                            const std::vector<double> ms = time_run(variant, demosaic_id, cfg, in, output, opts);
+                            const double median = percentile(ms, 0.5);
+                            if (base_threads == 0) {
+                                base_ms = median;
+                                base_threads = threads;
+                            }
+                            const double speedup = base_ms / median * base_threads;
+                            fprintf(csv, "%s,%d,%d,%.2f,%d,%s,%d,%.3f,%.3f,%.3f,%.2f,%.3f,%.3f\n",
+                                    variant.c_str(), width, height, frame_mp, demosaic_id, stages.c_str(), threads,
+                                    median, percentile(ms, 0.1), percentile(ms, 0.9), frame_mp / (median / 1e3),
+                                    speedup, speedup / threads);
+                            fflush(csv);
+                            printf("%-4s %5dx%-5d demosaic %d %-9s %3d threads  median %9.2f ms  %7.1f MP/s  eff %5.2f\n",
+                                   variant.c_str(), width, height, demosaic_id, stages.c_str(), threads, median,
+                                   frame_mp / (median / 1e3), speedup / threads);
+                            fflush(stdout);
+                        }
+                    }
+                }
+            }
+        }
+        fclose(csv);
+        std::cerr << "Wrote " << opts.csv_path << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
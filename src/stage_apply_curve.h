@@ -4,8 +4,16 @@
 #include "Halide.h"
 #include "halide_trace_config.h"
 #include "pipeline_helpers.h"
+#include "tone_curve_utils.h"
 #include <type_traits>
 
+// True for a compact tone curve LUT (see ToneCurveUtils::kFullToneCurveSize),
+// which pipeline_apply_curve reads through the sqrt shaper and interpolates.
+// The schedule specializes `curved` on it.
+inline Halide::Expr is_compact_tone_curve(Halide::Expr lut_size) {
+    return lut_size < ToneCurveUtils::kFullToneCurveSize;
+}
+
 template <typename T>
 inline Halide::Func pipeline_apply_curve(Halide::Func input,
                                          Halide::Expr blackLevel,
@@ -43,12 +51,20 @@ inline Halide::Func pipeline_apply_curve(Halide::Func input,
 
     Expr lut_val = lut(lut_idx, c);
 
+    // A compact LUT: the sqrt-shaped position, and a lerp between the two
+    // entries around it, in 16-bit units.
+    Expr shaped_idx = sqrt(clamp(norm_val, 0.0f, 1.0f)) * (lut_size - 1.0f);
+    Expr cell = min(cast<int>(shaped_idx), lut_size - 2);
+    Expr compact_val = lerp(cast<float>(lut(cell, c)), cast<float>(lut(cell + 1, c)),
+                            shaped_idx - cast<float>(cell));
+    Expr is_compact = is_compact_tone_curve(lut_size);
+
     if (std::is_same<T, float>::value) {
         // For the float path, the LUT value (uint16) must be scaled back to [0, 1].
-        curved(x, y, c) = cast<float>(lut_val) / 65535.0f;
+        curved(x, y, c) = select(is_compact, compact_val, cast<float>(lut_val)) / 65535.0f;
     } else {
         // For the uint16 path, the LUT value is already in the correct format.
-        curved(x, y, c) = lut_val;
+        curved(x, y, c) = select(is_compact, u16_sat(compact_val + 0.5f), lut_val);
     }
 
     if (!is_autoscheduled && target.has_gpu_feature()) {
@@ -0,0 +1,67 @@
+#ifndef STAGE_BAYER_BIN_H
+#define STAGE_BAYER_BIN_H
+
+#include "Halide.h"
+#include "pipeline_helpers.h"
+#include <string>
+
+// Fast path for large downscale factors (previews, thumbnails).
+//
+// Instead of demosaicing at full resolution and then resizing, this works on
+// the deinterleaved (half-resolution) CFA planes: each 2x2 quad is turned into
+// one RGB sample with a trivial demosaic (R, avg(Gr, Gb), B), and those samples
+// are box-binned down to the output grid. A 1:4 preview only touches each CFA
+// sample once and never runs the full-resolution demosaic.
+//
+// The bin size in quads is the downscale factor divided by two, rounded to the
+// nearest integer, so it is exact for even integer factors and a close
+// approximation for fractional ones. It is only meant to be selected for
+// downscale_factor >= 2 (see `use_binning`).
+class BayerBinBuilder {
+public:
+    Halide::Func output;
+    Halide::Func rgb_quad;
+    Halide::Func bin_x;
+    Halide::Expr use_binning;
+
+    BayerBinBuilder(Halide::Func deinterleaved,
+                    Halide::Expr full_res_width, Halide::Expr full_res_height,
+                    Halide::Expr downscale_factor,
+                    Halide::Var x, Halide::Var y, Halide::Var c)
+        : output("bayer_binned"),
+          rgb_quad("bayer_bin_rgb_quad"),
+          bin_x("bayer_bin_x")
+    {
+        using namespace Halide;
+
+        use_binning = downscale_factor >= 2.0f;
+
+        Expr quad_w = full_res_width / 2;
+        Expr quad_h = full_res_height / 2;
+
+        // Canonical GRBG planes: 0=Gr, 1=R, 2=B, 3=Gb.
+        Func rgb_quad_raw("bayer_bin_rgb_quad_raw");
+        rgb_quad_raw(x, y, c) = mux(c, {
+            cast<float>(deinterleaved(x, y, 1)),
+            avg(cast<float>(deinterleaved(x, y, 0)), cast<float>(deinterleaved(x, y, 3))),
+            cast<float>(deinterleaved(x, y, 2))
+        });
+        rgb_quad = BoundaryConditions::repeat_edge(rgb_quad_raw, {{0, quad_w}, {0, quad_h}});
+
+        // Scale from quad space to output space, and the integer bin size.
+        Expr scale = downscale_factor * 0.5f;
+        Expr k = max(1, cast<int>(floor(scale + 0.5f)));
+        Expr inv_k = 1.0f / cast<float>(k);
+        RDom r(0, k);
+
+        // Centre the k-wide bin on the output pixel's footprint.
+        Expr x0 = cast<int>(floor(cast<float>(x) * scale + (scale - cast<float>(k)) * 0.5f));
+        Expr y0 = cast<int>(floor(cast<float>(y) * scale + (scale - cast<float>(k)) * 0.5f));
+
+        // Separable box: bin horizontally on quad rows, then vertically.
+        bin_x(x, y, c) = sum(rgb_quad(x0 + r, y, c)) * inv_k;
+        output(x, y, c) = sum(bin_x(x, y0 + r, c)) * inv_k;
+    }
+};
+
+#endif // STAGE_BAYER_BIN_H
@@ -3,9 +3,19 @@
 
 #include "Halide.h"
 
+// Remaps the camera's CFA layout to canonical GRBG and applies the white
+// and green balance gains.
+//
+// For the four Bayer layouts the remap is a swap of neighbouring columns
+// and/or rows, so each output site reads its partner at a constant offset
+// (+1 on even coordinates, -1 on odd) chosen once per run; in a
+// specialization on the pattern (specialize_cfa) the offsets are constants
+// and the stage is a shuffle of the raw. The remaining layout (4, "RGBG")
+// swaps columns on even rows only.
 class BayerNormalizeBuilder {
 public:
     Halide::Func output;
+    Halide::Expr cfa_pattern;
 
     BayerNormalizeBuilder(Halide::Func input,
                           Halide::Expr cfa_pattern,
@@ -13,86 +23,24 @@ public:
                           Halide::Expr wb_r_gain,
                           Halide::Expr wb_g_gain,
                           Halide::Expr wb_b_gain,
-                          Halide::Var x, Halide::Var y) {
+                          Halide::Var x, Halide::Var y)
+        : cfa_pattern(cfa_pattern) {
         using namespace Halide;
         output = Func("bayer_normalized");
 
-        // --- Pure Halide Expr-based LUT ---
-        // This is the correct, robust way to implement the offset LUT logic.
-        // It avoids using host-side Buffer<> objects inside the pipeline definition,
-        // which caused the dimensionality mismatch error.
-
-        // Determine the top-left corner of the 2x2 quad containing the current pixel.
-        Expr qx = (x / 2) * 2;
-        Expr qy = (y / 2) * 2;
-
-        // For each of the four output pixels in a GRBG quad, we determine the
-        // source coordinates based on the input CFA pattern.
-        Expr src_x, src_y;
-
-        // Define the logic for each output pixel position within the 2x2 GRBG quad.
-        Expr is_y_even = (y % 2 == 0);
         Expr is_x_even = (x % 2 == 0);
+        Expr is_y_even = (y % 2 == 0);
 
-        // Location (0,0) in the output quad must be G_r.
-        // We find where G_r is in each input pattern.
-        Expr dx_gr = select(cfa_pattern == 0, 0,  // GRBG
-                     select(cfa_pattern == 1, 1,  // RGGB
-                     select(cfa_pattern == 2, 1,  // GBRG
-                     select(cfa_pattern == 3, 0,  // BGGR
-                                              1))));// RGBG
-        Expr dy_gr = select(cfa_pattern == 0, 0,
-                     select(cfa_pattern == 1, 0,
-                     select(cfa_pattern == 2, 1,
-                     select(cfa_pattern == 3, 1,
-                                              0))));
-
-        // Location (0,1) in the output quad must be R.
-        Expr dx_r = select(cfa_pattern == 0, 1,
-                    select(cfa_pattern == 1, 0,
-                    select(cfa_pattern == 2, 0,
-                    select(cfa_pattern == 3, 1,
-                                             0))));
-        Expr dy_r = select(cfa_pattern == 0, 0,
-                    select(cfa_pattern == 1, 0,
-                    select(cfa_pattern == 2, 1,
-                    select(cfa_pattern == 3, 1,
-                                             0))));
-
-        // Location (1,0) in the output quad must be B.
-        Expr dx_b = select(cfa_pattern == 0, 0,
-                    select(cfa_pattern == 1, 1,
-                    select(cfa_pattern == 2, 1,
-                    select(cfa_pattern == 3, 0,
-                                             0))));
-        Expr dy_b = select(cfa_pattern == 0, 1,
-                    select(cfa_pattern == 1, 1,
-                    select(cfa_pattern == 2, 0,
-                    select(cfa_pattern == 3, 0,
-                                             1))));
-
-        // Location (1,1) in the output quad must be G_b.
-        Expr dx_gb = select(cfa_pattern == 0, 1,
-                     select(cfa_pattern == 1, 0,
-                     select(cfa_pattern == 2, 0,
-                     select(cfa_pattern == 3, 1,
-                                              1))));
-        Expr dy_gb = select(cfa_pattern == 0, 1,
-                     select(cfa_pattern == 1, 1,
-                     select(cfa_pattern == 2, 0,
-                     select(cfa_pattern == 3, 0,
-                                              1))));
-
-        // Select the final source coordinates based on the output pixel's position.
-        src_x = select(is_y_even && is_x_even,   qx + dx_gr,
-                select(is_y_even && !is_x_even,  qx + dx_r,
-                select(!is_y_even && is_x_even,  qx + dx_b,
-                                                 qx + dx_gb)));
-
-        src_y = select(is_y_even && is_x_even,   qy + dy_gr,
-                select(is_y_even && !is_x_even,  qy + dy_r,
-                select(!is_y_even && is_x_even,  qy + dy_b,
-                                                 qy + dy_gb)));
+        // Whether the input's columns (swap_x) and rows (swap_y) are swapped
+        // relative to GRBG:
+        //   GRBG (0): neither  RGGB (1): columns  GBRG (2): both
+        //   BGGR (3): rows     RGBG (4): columns on even rows
+        Expr swap_x = select(cfa_pattern == 0 || cfa_pattern == 3, false,
+                             cfa_pattern == 1 || cfa_pattern == 2, true,
+                             is_y_even);
+        Expr swap_y = cfa_pattern == 2 || cfa_pattern == 3;
+        Expr src_x = x + select(swap_x, select(is_x_even, 1, -1), 0);
+        Expr src_y = y + select(swap_y, select(is_y_even, 1, -1), 0);
 
         // --- Read the pixel and apply gains ---
         Expr val = input(src_x, src_y);
@@ -101,7 +49,6 @@ public:
         // Apply white balance and green balance gains based on the output pixel's position.
         // G R
         // B G
-        Expr is_g_r_loc = is_y_even && is_x_even;
         Expr is_r_loc = is_y_even && !is_x_even;
         Expr is_b_loc = !is_y_even && is_x_even;
         Expr is_g_b_loc = !is_y_even && !is_x_even;
@@ -113,6 +60,15 @@ public:
 
         output(x, y) = val * gain;
     }
+
+    // One loop nest of `output` per Bayer layout, plus the generic one for
+    // anything else. Call after output's compute_at/vectorize, which the
+    // specializations inherit.
+    void specialize_cfa() {
+        for (int pattern = 0; pattern < 4; pattern++) {
+            output.specialize(cfa_pattern == pattern);
+        }
+    }
 };
 
 #endif // STAGE_BAYER_NORMALIZE_H
@@ -0,0 +1,298 @@
+// stage_benchmark: times each stage builder on its own.
+//
+// The stage_* pipelines (stage_benchmark_generator.cpp) are AOT-compiled
+// wrappers around one builder each. This runs them on a synthetic Bayer
+// frame, or on a recorded one (--input, a 16-bit GRBG PNG, the format
+// process reads with --raw-png), and reports the median and p10/p90 per-run time of each.
+//
+// Each sample is Halide::Tools::benchmark(1, iterations, ...), i.e. the mean
+// of `iterations` back-to-back runs; the percentiles are taken over samples.
+
+#include "HalideBuffer.h"
+#include "HalideRuntime.h"
+#include "halide_benchmark.h"
+#include "halide_image_io.h"
+#include "color_tools.h"
+#include "process_options.h"
+
+#include "stage_ca_correct_lib.h"
+#include "stage_demosaic_lib.h"
+#include "stage_local_laplacian_lib.h"
+#include "stage_local_laplacian_fast_lib.h"
+#include "stage_color_grade_lib.h"
+#include "stage_color_grade_tetrahedral_lib.h"
+#include "stage_lens_geometry_lib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using Halide::Runtime::Buffer;
+
+namespace {
+
+struct BenchmarkOptions {
+    int width = 4000;
+    int height = 3000;
+    int samples = 10;
+    int iterations = 3;
+    std::string input_path;
+    std::string json_path;
+    std::string filter; // Only run stages whose name contains this.
+};
+
+struct StageResult {
+    std::string name;
+    int width, height;
+    double median_ms, p10_ms, p90_ms;
+};
+
+void print_usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --width <px>        Synthetic Bayer frame width (default 4000)\n"
+              << "  --height <px>       Synthetic Bayer frame height (default 3000)\n"
+              << "  --input <path>      Use a recorded 16-bit Bayer PNG (GRBG) instead\n"
+              << "  --samples <n>       Timed samples per stage (default 10)\n"
+              << "  --iterations <n>    Runs per sample (default 3)\n"
+              << "  --stage <name>      Only run stages whose name contains <name>\n"
+              << "  --json <path>       Also write the results as JSON\n";
+}
+
+BenchmarkOptions parse_benchmark_args(int argc, char** argv) {
+    BenchmarkOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--width") opts.width = std::stoi(value());
+        else if (arg == "--height") opts.height = std::stoi(value());
+        else if (arg == "--input") opts.input_path = value();
+        else if (arg == "--samples") opts.samples = std::stoi(value());
+        else if (arg == "--iterations") opts.iterations = std::stoi(value());
+        else if (arg == "--stage") opts.filter = value();
+        else if (arg == "--json") opts.json_path = value();
+        else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            exit(0);
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    if (opts.width < 64 || opts.height < 64) throw std::runtime_error("Frame must be at least 64x64");
+    if (opts.samples < 1 || opts.iterations < 1) throw std::runtime_error("--samples and --iterations must be positive");
+    opts.width &= ~1;
+    opts.height &= ~1;
+    return opts;
+}
+
+// A deterministic GRBG mosaic of smooth gradients plus fine texture and a few
+// hard edges, so every stage has real work to do (CA shifts to estimate,
+// edges for the demosaic, detail for the pyramid).
+Buffer<float, 2> synthetic_bayer(int width, int height) {
+    Buffer<float, 2> bayer(width, height);
+    uint32_t seed = 0x9e3779b9u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            float noise = ((seed >> 8) & 0xffff) / 65535.0f - 0.5f;
+            float u = (float)x / width, v = (float)y / height;
+            float r = 0.2f + 0.6f * u, g = 0.25f + 0.5f * v, b = 0.6f - 0.4f * u * v;
+            float texture = 0.08f * sinf(x * 0.37f) * cosf(y * 0.23f);
+            float edge = ((x / 96 + y / 96) % 2) ? 0.15f : 0.0f;
+            bool row_g = (y % 2) == 0;
+            bool col_g = (x % 2) == 0;
+            float base = (row_g == col_g) ? g : (row_g ? r : b);
+            bayer(x, y) = std::min(1.0f, std::max(0.0f, base + texture + edge + 0.01f * noise));
+        }
+    }
+    return bayer;
+}
+
+Buffer<float, 2> recorded_bayer(const std::string& path) {
+    Buffer<uint16_t, 2> raw = Halide::Tools::load_and_convert_image(path);
+    Buffer<float, 2> bayer(raw.width() & ~1, raw.height() & ~1);
+    bayer.for_each_element([&](int x, int y) { bayer(x, y) = raw(x, y) / 65535.0f; });
+    return bayer;
+}
+
+// Host-side linear sRGB -> L*C*h*, matching HalideColor's D65 conversion
+// closely enough to feed the LCh stages realistic values.
+Buffer<float, 3> linear_to_lch(const Buffer<float, 3>& rgb) {
+    Buffer<float, 3> lch(rgb.width(), rgb.height(), 3);
+    auto f = [](float t) { return t > 0.008856f ? cbrtf(t) : 7.787f * t + 16.0f / 116.0f; };
+    for (int y = 0; y < rgb.height(); ++y) {
+        for (int x = 0; x < rgb.width(); ++x) {
+            float r = rgb(x, y, 0), g = rgb(x, y, 1), b = rgb(x, y, 2);
+            float X = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+            float Y = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+            float Z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+            float fx = f(X), fy = f(Y), fz = f(Z);
+            float L = 116.0f * fy - 16.0f, A = 500.0f * (fx - fy), B = 200.0f * (fy - fz);
+            lch(x, y, 0) = L;
+            lch(x, y, 1) = sqrtf(A * A + B * B);
+            lch(x, y, 2) = atan2f(B, A);
+        }
+    }
+    return lch;
+}
+
+// Mild barrel distortion in the layout of LensCorrection's LUTs: the radius
+// scale factor indexed by normalized r_d^2 over [0, 3].
+Buffer<float, 1> barrel_distortion_lut() {
+    const int size = 2048;
+    const float max_rd_sq = 3.0f;
+    Buffer<float, 1> lut(size);
+    for (int i = 0; i < size; ++i) {
+        float rd_sq = i * max_rd_sq / (size - 1);
+        lut(i) = 1.0f + 0.03f * rd_sq;
+    }
+    return lut;
+}
+
+void check(int result, const char* stage) {
+    if (result != 0) throw std::runtime_error(std::string("Halide pipeline ") + stage + " failed with code " + std::to_string(result));
+}
+
+double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    double pos = p * (v.size() - 1);
+    size_t lo = (size_t)floor(pos), hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (pos - lo);
+}
+
+StageResult time_stage(const std::string& name, int width, int height,
+                       const BenchmarkOptions& opts, const std::function<void()>& op) {
+    op(); // Warm up: thread pool, allocation caches, page faults.
+    std::vector<double> ms(opts.samples);
+    for (int i = 0; i < opts.samples; ++i) {
+        ms[i] = Halide::Tools::benchmark(1, opts.iterations, op) * 1e3;
+    }
+    StageResult r{name, width, height, percentile(ms, 0.5), percentile(ms, 0.1), percentile(ms, 0.9)};
+    printf("%-28s %5dx%-5d  median %9.3f ms   p10 %9.3f ms   p90 %9.3f ms\n",
+           name.c_str(), width, height, r.median_ms, r.p10_ms, r.p90_ms);
+    fflush(stdout);
+    return r;
+}
+
+void write_json(const std::string& path, const BenchmarkOptions& opts, const std::vector<StageResult>& results) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) throw std::runtime_error("Could not open " + path + " for writing");
+    fprintf(f, "{\n");
+    fprintf(f, "  \"input\": \"%s\",\n", opts.input_path.empty() ? "synthetic" : opts.input_path.c_str());
+    fprintf(f, "  \"samples\": %d,\n", opts.samples);
+    fprintf(f, "  \"iterations\": %d,\n", opts.iterations);
+    fprintf(f, "  \"stages\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult& r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, "
+                   "\"median_ms\": %.4f, \"p10_ms\": %.4f, \"p90_ms\": %.4f}%s\n",
+                r.name.c_str(), r.width, r.height, r.median_ms, r.p10_ms, r.p90_ms,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        BenchmarkOptions opts = parse_benchmark_args(argc, argv);
+        auto wanted = [&](const std::string& name) {
+            return opts.filter.empty() || name.find(opts.filter) != std::string::npos;
+        };
+
+        Buffer<float, 2> bayer = opts.input_path.empty() ? synthetic_bayer(opts.width, opts.height)
+                                                         : recorded_bayer(opts.input_path);
+        const int raw_w = bayer.width(), raw_h = bayer.height();
+        std::cerr << "Input: " << (opts.input_path.empty() ? "synthetic" : opts.input_path)
+                  << " (" << raw_w << "x" << raw_h << ")\n";
+
+        std::vector<StageResult> results;
+
+        // --- Raw front end, at full resolution ---
+        Buffer<float, 2> ca_out(raw_w, raw_h);
+        if (wanted("ca_correct")) {
+            results.push_back(time_stage("ca_correct", raw_w, raw_h, opts, [&]() {
+                check(stage_ca_correct(bayer, 1.0f, ca_out), "stage_ca_correct");
+            }));
+        }
+
+        const char* demosaic_names[] = {"demosaic_ahd", "demosaic_lmmse", "demosaic_ri", "demosaic_fast",
+                                        "demosaic_adaptive"};
+        Buffer<float, 3> rgb(raw_w, raw_h, 3);
+        for (int algo = 0; algo < 5; ++algo) {
+            if (!wanted(demosaic_names[algo])) continue;
+            results.push_back(time_stage(demosaic_names[algo], raw_w, raw_h, opts, [&]() {
+                check(stage_demosaic(bayer, algo, rgb), "stage_demosaic");
+            }));
+        }
+
+        // --- Back end, at half resolution like a downscaled render. A 2x2
+        // box of the demosaic keeps its inputs realistic. ---
+        check(stage_demosaic(bayer, 3, rgb), "stage_demosaic");
+        const int w = raw_w / 2, h = raw_h / 2;
+        Buffer<float, 3> linear(w, h, 3);
+        linear.for_each_element([&](int x, int y, int c) {
+            linear(x, y, c) = 0.25f * (rgb(2 * x, 2 * y, c) + rgb(2 * x + 1, 2 * y, c) +
+                                       rgb(2 * x, 2 * y + 1, c) + rgb(2 * x + 1, 2 * y + 1, c));
+        });
+        Buffer<float, 3> lch = linear_to_lch(linear);
+        Buffer<float, 3> lch_out(w, h, 3);
+
+        if (wanted("local_laplacian")) {
+            results.push_back(time_stage("local_laplacian", w, h, opts, [&]() {
+                check(stage_local_laplacian(lch, 0.5f, 0.3f, 0.2f, -0.2f, 0.0f, 0.0f, lch_out), "stage_local_laplacian");
+            }));
+        }
+        if (wanted("local_laplacian_fast")) {
+            results.push_back(time_stage("local_laplacian_fast", w, h, opts, [&]() {
+                check(stage_local_laplacian_fast(lch, 0.5f, 0.3f, 0.2f, -0.2f, 0.0f, 0.0f, lch_out), "stage_local_laplacian_fast");
+            }));
+        }
+
+        if (wanted("color_grade")) {
+            ProcessConfig cfg;
+            Buffer<float, 4> color_lut = HostColor::generate_color_lut(cfg);
+            results.push_back(time_stage("color_grade", w, h, opts, [&]() {
+                check(stage_color_grade(lch, color_lut, lch_out), "stage_color_grade");
+            }));
+        }
+        if (wanted("color_grade_tetrahedral")) {
+            ProcessConfig cfg;
+            Buffer<float, 4> color_lut = HostColor::generate_color_lut(cfg);
+            results.push_back(time_stage("color_grade_tetrahedral", w, h, opts, [&]() {
+                check(stage_color_grade_tetrahedral(lch, color_lut, lch_out), "stage_color_grade_tetrahedral");
+            }));
+        }
+
+        if (wanted("lens_geometry")) {
+            Buffer<float, 1> dist_lut = barrel_distortion_lut();
+            Buffer<float, 3> resampled(w, h, 3);
+            results.push_back(time_stage("lens_geometry", w, h, opts, [&]() {
+                check(stage_lens_geometry(linear, dist_lut, 0.5f, -0.5f,
+                                          1.5f, 100.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, resampled),
+                      "stage_lens_geometry");
+            }));
+        }
+
+        if (!opts.json_path.empty()) {
+            write_json(opts.json_path, opts, results);
+            std::cerr << "Wrote " << opts.json_path << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
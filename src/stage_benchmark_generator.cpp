@@ -0,0 +1,237 @@
+#include "Halide.h"
+
+#include "stage_ca_correct.h"
+#include "stage_deinterleave.h"
+#include "stage_demosaic.h"
+#include "stage_local_adjust_laplacian.h"
+#include "stage_color_grading.h"
+#include "stage_lens_geometry.h"
+
+#include "pipeline_schedule.h"
+
+// ============================================================================
+// Standalone pipelines, one per stage builder, for stage_benchmark.
+//
+// Each generator wraps a single builder between buffer inputs and an output,
+// so its cost can be timed without the rest of the pipeline. The builders
+// are the ones pipeline_generator.cpp wires in, and they are scheduled with
+// the same fragments (pipeline_schedule.h) at the same granularity: strips
+// of 32 rows, tiles 256 pixels wide.
+// ============================================================================
+
+using namespace Halide;
+
+namespace {
+
+Var x("x"), y("y"), c("c"), xo("xo"), xi("xi"), yo("yo"), yi("yi");
+
+const int kStripSize = 32;
+const int kTileSizeX = 256;
+
+// Tiled, strip-parallel schedule of a 3-channel stage output.
+void schedule_tiles(Func out, const Target& target) {
+    const int vec_f = target.natural_vector_size<float>();
+    out.compute_root()
+        .tile(x, y, xo, yo, xi, yi, kTileSizeX, kStripSize)
+        .reorder(xi, yi, c, xo, yo)
+        .parallel(yo)
+        .vectorize(xi, vec_f);
+    out.bound(c, 0, 3).unroll(c);
+}
+
+} // namespace
+
+// Bayer (normalized, GRBG) -> CA-corrected Bayer.
+class StageCACorrectGenerator : public Halide::Generator<StageCACorrectGenerator> {
+public:
+    Input<Buffer<float, 2>> input{"input"};
+    Input<float> strength{"strength"};
+    Output<Buffer<float, 2>> output{"output"};
+
+    void generate() {
+        Func bounded = BoundaryConditions::repeat_edge(input);
+        CACorrectBuilder ca_builder(bounded, x, y, strength, input.width(), input.height(),
+                                    get_target(), using_autoscheduler());
+        Func out("ca_out");
+        out(x, y) = ca_builder.output(x, y);
+
+        input.set_estimates({{0, 4000}, {0, 3000}});
+        strength.set_estimate(1.0f);
+        out.set_estimates({{0, 4000}, {0, 3000}});
+
+        if (!using_autoscheduler()) {
+            const int vec_f = get_target().natural_vector_size<float>();
+            out.compute_root().split(y, yo, yi, kStripSize).parallel(yo).vectorize(x, vec_f);
+            ca_builder.output.compute_at(out, yo).store_at(out, yo).vectorize(x, vec_f);
+            ca_builder.g_interp.compute_at(out, yo).store_at(out, yo).vectorize(x, vec_f);
+            schedule_ca_shift_estimate(ca_builder, vec_f);
+        }
+        output = out;
+    }
+};
+
+// Bayer (normalized, GRBG) -> deinterleave -> demosaic, for any algorithm id.
+class StageDemosaicGenerator : public Halide::Generator<StageDemosaicGenerator> {
+public:
+    Input<Buffer<float, 2>> input{"input"};
+    Input<int> demosaic_algorithm_id{"demosaic_algorithm_id"};
+    Output<Buffer<float, 3>> output{"output"};
+
+    void generate() {
+        Func bounded = BoundaryConditions::repeat_edge(input);
+        Func deinterleaved = pipeline_deinterleave(bounded, x, y, c);
+        DemosaicDispatcherT<float> demosaic_dispatcher{deinterleaved, demosaic_algorithm_id, x, y, c,
+                                                       Func(), !using_autoscheduler()};
+        Func demosaiced = demosaic_dispatcher.output;
+        Func out("demosaic_out");
+        out(x, y, c) = demosaiced(x, y, c);
+
+        input.set_estimates({{0, 4000}, {0, 3000}});
+        demosaic_algorithm_id.set_estimate(3);
+        out.set_estimates({{0, 4000}, {0, 3000}, {0, 3}});
+
+        if (!using_autoscheduler()) {
+            const int vec_f = get_target().natural_vector_size<float>();
+            schedule_tiles(out, get_target());
+            deinterleaved.compute_at(out, yo).store_at(out, yo).vectorize(x, vec_f);
+            demosaiced.compute_at(out, yo).store_at(out, yo).vectorize(x, vec_f);
+            demosaiced.bound(c, 0, 3).unroll(c);
+            demosaiced.align_bounds(x, vec_f);
+
+            // As in schedule_front_end_producers: one loop nest per algorithm.
+            typedef DemosaicDispatcherT<float> D;
+            Expr algo = demosaic_dispatcher.algo_id;
+            demosaiced.specialize(algo == D::AHD);
+            demosaiced.specialize(algo == D::LMMSE);
+            demosaiced.specialize(algo == D::RI);
+            demosaiced.specialize(algo == D::FAST);
+            demosaiced.specialize(algo == D::ADAPTIVE);
+            schedule_demosaic_adaptive(demosaic_dispatcher.adaptive, out, yo, vec_f);
+            for (auto& f : demosaic_dispatcher.ri_intermediates) {
+                std::string n = f.name();
+                if (n == "g_final_ri" || n == "cd_r_interp" || n == "cd_b_interp") {
+                    f.compute_at(demosaiced, y).vectorize(f.args()[0], vec_f);
+                }
+            }
+        }
+        output = out;
+    }
+};
+
+// LCh -> local Laplacian adjustments, built the way the editor's back end
+// builds it (the whole pyramid from the input, no raw splice).
+// stage_local_laplacian_fast is the same with ll_fast_levels=8.
+class StageLocalLaplacianGenerator : public Halide::Generator<StageLocalLaplacianGenerator> {
+public:
+    GeneratorParam<int> ll_fast_levels{"ll_fast_levels", 0};
+    Input<Buffer<float, 3>> input{"input"};
+    Input<float> ll_detail{"ll_detail"};
+    Input<float> ll_clarity{"ll_clarity"};
+    Input<float> ll_shadows{"ll_shadows"};
+    Input<float> ll_highlights{"ll_highlights"};
+    Input<float> ll_blacks{"ll_blacks"};
+    Input<float> ll_whites{"ll_whites"};
+    Output<Buffer<float, 3>> output{"output"};
+
+    void generate() {
+        const int J = 8;
+        const int cutover_level = 0;
+        Func bounded = BoundaryConditions::repeat_edge(input);
+        Func no_lowfi("no_lowfi"), no_matrix("no_matrix");
+        no_lowfi(x, y, c) = 0.0f;
+        no_matrix(x, y) = 0.0f;
+        Expr width = input.width(), height = input.height();
+        LocalLaplacianBuilder ll_builder(
+            bounded,
+            no_lowfi, no_matrix,
+            x, y, c,
+            ll_detail, ll_clarity, ll_shadows, ll_highlights, ll_blacks, ll_whites, Expr(-1),
+            width, height, width, height, Expr(1.0f),
+            J, cutover_level, ll_fast_levels);
+        Func out("local_laplacian_out");
+        out(x, y, c) = ll_builder.output(x, y, c);
+
+        input.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+        out.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+
+        if (!using_autoscheduler()) {
+            const int vec_f = get_target().natural_vector_size<float>();
+            schedule_tiles(out, get_target());
+            schedule_local_laplacian(out, ll_builder, xo, yo, J, cutover_level, vec_f);
+            ll_builder.output.compute_at(out, xo).store_at(out, yo).vectorize(x, vec_f).bound(c, 0, 3).unroll(c);
+        }
+        output = out;
+    }
+};
+
+// LCh -> 3D LUT color grading. stage_color_grade_tetrahedral is the same
+// with tetrahedral_color_lut=true.
+class StageColorGradeGenerator : public Halide::Generator<StageColorGradeGenerator> {
+public:
+    GeneratorParam<bool> tetrahedral_color_lut{"tetrahedral_color_lut", false};
+    Input<Buffer<float, 3>> input{"input"};
+    Input<Buffer<float, 4>> color_grading_lut{"color_grading_lut"};
+    Output<Buffer<float, 3>> output{"output"};
+
+    void generate() {
+        ColorGradeBuilder color_grade_builder(input, color_grading_lut, color_grading_lut.dim(0).extent(), x, y, c,
+                                              tetrahedral_color_lut);
+        Func out("color_grade_out");
+        out(x, y, c) = color_grade_builder.output(x, y, c);
+
+        input.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+        color_grading_lut.set_estimates({{0, 33}, {0, 33}, {0, 33}, {0, 3}});
+        require_interleaved_lut(color_grading_lut);
+        out.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+
+        if (!using_autoscheduler()) schedule_tiles(out, get_target());
+        output = out;
+    }
+};
+
+// Linear sRGB -> distortion, CA fringe and geometry resampling.
+class StageLensGeometryGenerator : public Halide::Generator<StageLensGeometryGenerator> {
+public:
+    Input<Buffer<float, 3>> input{"input"};
+    Input<Buffer<float, 1>> distortion_lut{"distortion_lut"};
+    Input<float> ca_red_cyan{"ca_red_cyan"};
+    Input<float> ca_blue_yellow{"ca_blue_yellow"};
+    Input<float> geo_rotate{"geo_rotate"};
+    Input<float> geo_scale{"geo_scale"};
+    Input<float> geo_aspect{"geo_aspect"};
+    Input<float> geo_keystone_v{"geo_keystone_v"};
+    Input<float> geo_keystone_h{"geo_keystone_h"};
+    Input<float> geo_offset_x{"geo_offset_x"};
+    Input<float> geo_offset_y{"geo_offset_y"};
+    Output<Buffer<float, 3>> output{"output"};
+
+    void generate() {
+        Func bounded = BoundaryConditions::repeat_edge(input);
+        // No lens TCA profile: a one-entry table, as the host passes for none.
+        Var i("i"), k("k");
+        Func no_tca("no_tca");
+        no_tca(i, k) = 1.0f;
+        LensGeometryBuilder lens_geometry_builder(bounded, x, y, c, input.width(), input.height(),
+                                                  distortion_lut, distortion_lut.dim(0).extent(),
+                                                  no_tca, 1,
+                                                  ca_red_cyan, ca_blue_yellow,
+                                                  geo_rotate, geo_scale, geo_aspect,
+                                                  geo_keystone_v, geo_keystone_h,
+                                                  geo_offset_x, geo_offset_y);
+        Func out("lens_geometry_out");
+        out(x, y, c) = lens_geometry_builder.output(x, y, c);
+
+        input.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+        distortion_lut.set_estimates({{0, 2048}});
+        out.set_estimates({{0, 1000}, {0, 750}, {0, 3}});
+
+        if (!using_autoscheduler()) schedule_tiles(out, get_target());
+        output = out;
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(StageCACorrectGenerator, stage_ca_correct)
+HALIDE_REGISTER_GENERATOR(StageDemosaicGenerator, stage_demosaic)
+HALIDE_REGISTER_GENERATOR(StageLocalLaplacianGenerator, stage_local_laplacian)
+HALIDE_REGISTER_GENERATOR(StageColorGradeGenerator, stage_color_grade)
+HALIDE_REGISTER_GENERATOR(StageLensGeometryGenerator, stage_lens_geometry)
@@ -0,0 +1,155 @@
+#ifndef STAGE_BURST_MERGE_H
+#define STAGE_BURST_MERGE_H
+
+#include "Halide.h"
+#include <string>
+#include <vector>
+
+// Merges a burst of raw frames of the same scene into one Bayer frame with
+// the noise of a longer exposure, in the manner of HDR+: frame 0 is the
+// reference, every other frame is aligned to it tile by tile and averaged
+// in where it matches.
+//
+// Alignment runs on a grey image binned from each 2x2 CFA block (so it does
+// not depend on the pattern and offsets stay whole blocks, which keeps the
+// CFA phase), as a coarse-to-fine pyramid of kLevels levels kLevelFactor
+// apart. At each level a tile searches +-kSearchRadius binned pixels (+-1
+// at the finest) around its parent tile's offset for the least mean
+// absolute difference. Tiles are kTile binned pixels, kTile / 2 apart.
+//
+// The merge is a temporal Wiener shrinkage per tile: a frame's difference
+// from the reference is kept with weight 1 - A, A = D^2 / (D^2 + c sigma^2),
+// where D is the tile's mean absolute difference after alignment, sigma the
+// noise of the binned image and c `merge_strength`. Matching tiles (D at
+// the noise) average in fully, moving content (D well above it) falls back
+// to the reference. Overlapping tiles are blended with raised-cosine
+// windows, which sum to 1, so tile edges don't show.
+//
+// `frames` is (x, y, n) in raw units; `output` is the merged mosaic in the
+// same units, black and white levels unchanged, for camera_pipe.
+class BurstMergeBuilder {
+public:
+    static constexpr int kTile = 16;
+    static constexpr int kTileStride = kTile / 2;
+    static constexpr int kLevels = 3;
+    static constexpr int kLevelFactor = 4;
+    static constexpr int kSearchRadius = 4;
+    static constexpr int kFineSearchRadius = 1;
+
+    // Per level, finest first: the binned grey image (x, y, n), the cost of
+    // each search offset (sx, sy, tx, ty, n) and the best one,
+    // search(tx, ty, n) = (sx, sy, cost).
+    std::vector<Halide::Func> grey, cost, search;
+    // Each tile's offset at the finest level, in binned pixels, and the
+    // weight 1 - A its difference from the reference merges with.
+    Halide::Func alignment, merge_weight;
+    Halide::Func window;
+    Halide::Func output;
+    Halide::Var tx{"tile_x"}, ty{"tile_y"}, n{"frame"}, sx{"search_x"}, sy{"search_y"}, u{"window_u"};
+
+    BurstMergeBuilder(Halide::Func frames, Halide::Expr width, Halide::Expr height, Halide::Expr frame_count,
+                      Halide::Expr noise_sigma, Halide::Expr merge_strength, Halide::Var x, Halide::Var y)
+        : alignment("burst_alignment"), merge_weight("burst_merge_weight"), window("burst_window"),
+          output("burst_merged")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        Var gx("grey_x"), gy("grey_y");
+        Func raw("burst_raw");
+        raw(x, y, n) = cast<float>(frames(clamp(x, 0, width - 1), clamp(y, 0, height - 1),
+                                          clamp(n, 0, frame_count - 1)));
+
+        // --- The grey pyramid ---
+        std::vector<Expr> w(kLevels), h(kLevels);
+        w[0] = width / 2;
+        h[0] = height / 2;
+        Func g0("burst_grey_0");
+        g0(gx, gy, n) = 0.25f * (raw(2 * gx, 2 * gy, n) + raw(2 * gx + 1, 2 * gy, n) +
+                                 raw(2 * gx, 2 * gy + 1, n) + raw(2 * gx + 1, 2 * gy + 1, n));
+        grey.push_back(g0);
+        RDom r_down(0, kLevelFactor, 0, kLevelFactor, "burst_down");
+        for (int l = 1; l < kLevels; l++) {
+            w[l] = (w[l - 1] + kLevelFactor - 1) / kLevelFactor;
+            h[l] = (h[l - 1] + kLevelFactor - 1) / kLevelFactor;
+            Func prev = bounded(grey[l - 1], w[l - 1], h[l - 1]);
+            Func g("burst_grey_" + std::to_string(l));
+            g(gx, gy, n) = sum(prev(kLevelFactor * gx + r_down.x, kLevelFactor * gy + r_down.y, n)) /
+                           float(kLevelFactor * kLevelFactor);
+            grey.push_back(g);
+        }
+
+        // --- Coarse-to-fine tile alignment ---
+        cost.resize(kLevels);
+        search.resize(kLevels);
+        std::vector<Func> offset(kLevels);
+        RDom r_tile(0, kTile, 0, kTile, "burst_tile");
+        for (int l = kLevels - 1; l >= 0; l--) {
+            const std::string suffix = "_" + std::to_string(l);
+            const int radius = l == 0 ? kFineSearchRadius : kSearchRadius;
+            Func g = bounded(grey[l], w[l], h[l]);
+
+            // The parent tile nearest this one's centre, and its offset at
+            // this level's scale.
+            Expr prior_x = 0, prior_y = 0;
+            if (l + 1 < kLevels) {
+                Expr px = clamp((tx - 1) / kLevelFactor, 0, tile_count(w[l + 1]) - 1);
+                Expr py = clamp((ty - 1) / kLevelFactor, 0, tile_count(h[l + 1]) - 1);
+                prior_x = kLevelFactor * offset[l + 1](px, py, n)[0];
+                prior_y = kLevelFactor * offset[l + 1](px, py, n)[1];
+            }
+
+            Expr rx = kTileStride * tx + r_tile.x, ry = kTileStride * ty + r_tile.y;
+            cost[l] = Func("burst_cost" + suffix);
+            cost[l](sx, sy, tx, ty, n) = sum(abs(g(rx, ry, 0) - g(rx + prior_x + sx - radius,
+                                                                  ry + prior_y + sy - radius, n)));
+
+            RDom r_search(0, 2 * radius + 1, 0, 2 * radius + 1, "burst_search" + suffix);
+            search[l] = Func("burst_search" + suffix);
+            search[l](tx, ty, n) = argmin(r_search, cost[l](r_search.x, r_search.y, tx, ty, n));
+
+            offset[l] = Func("burst_offset" + suffix);
+            offset[l](tx, ty, n) = Tuple(prior_x + search[l](tx, ty, n)[0] - radius,
+                                         prior_y + search[l](tx, ty, n)[1] - radius);
+        }
+        alignment = offset[0];
+
+        // --- Wiener merge ---
+        Expr d = search[0](tx, ty, n)[2] / float(kTile * kTile);
+        Expr sigma = 0.5f * noise_sigma;  // Binned over 4 samples.
+        Expr shrink = d * d / (d * d + merge_strength * sigma * sigma + 1e-6f);
+        merge_weight(tx, ty, n) = 1.0f - shrink;
+
+        window(u) = pow(sin(3.14159265f * (cast<float>(u) + 0.5f) / float(kTile)), 2);
+
+        // Each pixel lies in 2x2 overlapping tiles; r.z runs over the
+        // frames other than the reference.
+        Expr bx = x / 2, by = y / 2;
+        RDom r(0, 2, 0, 2, 1, max(frame_count - 1, 1), "burst_merge");
+        Expr tile_x = bx / kTileStride - 1 + r.x, tile_y = by / kTileStride - 1 + r.y;
+        Expr cx = clamp(tile_x, 0, tile_count(w[0]) - 1), cy = clamp(tile_y, 0, tile_count(h[0]) - 1);
+        Expr weight = window(bx - kTileStride * tile_x) * window(by - kTileStride * tile_y);
+        Expr ref = raw(x, y, 0);
+        Expr alt = raw(x + 2 * alignment(cx, cy, r.z)[0], y + 2 * alignment(cx, cy, r.z)[1], r.z);
+        Expr merged = ref + sum(select(frame_count > 1, weight * merge_weight(cx, cy, r.z) * (alt - ref), 0.0f)) /
+                            cast<float>(max(frame_count, 1));
+        output(x, y) = u16_sat(merged + 0.5f);
+    }
+
+    // Tiles along a side of `extent` binned pixels, the last one reaching
+    // past it if need be.
+    static Halide::Expr tile_count(Halide::Expr extent) {
+        return Halide::max(1, (extent - kTile + kTileStride - 1) / kTileStride + 1);
+    }
+
+private:
+    static Halide::Func bounded(Halide::Func f, Halide::Expr w, Halide::Expr h) {
+        using namespace Halide;
+        Func b(f.name() + "_bounded");
+        std::vector<Var> args = f.args();
+        b(args) = f(clamp(args[0], 0, w - 1), clamp(args[1], 0, h - 1), args[2]);
+        return b;
+    }
+};
+
+#endif // STAGE_BURST_MERGE_H
@@ -3,6 +3,7 @@
 
 #include "Halide.h"
 #include "pipeline_helpers.h"
+#include <string>
 #include <vector>
 #include <type_traits>
 
@@ -12,20 +13,51 @@
     which itself is based on RawTherapee code.
 */
 
+// The shift field CA correction resamples R and B by: (bx, by, c, v) on a
+// grid of kTileSize-pixel tiles, c 0 for R and 1 for B, v 0 for the
+// vertical shift and 1 for the horizontal, in full-resolution pixels.
+// Lateral CA is a property of the lens, so the editor and process --looks
+// estimate it once per raw with camera_pipe_ca_shifts and pass it to the
+// front end as a buffer; the monolithic pipelines estimate it once per run.
+struct CAShiftGrid {
+    static constexpr int kTileSize = 16;
+    static Halide::Expr width(Halide::Expr image_width) { return (image_width + kTileSize - 1) / kTileSize; }
+    static Halide::Expr height(Halide::Expr image_height) { return (image_height + kTileSize - 1) / kTileSize; }
+};
+
 #ifdef NO_CA_CORRECT
-class CACorrectBuilder {
+class CAShiftEstimateBuilder {
 public:
     Halide::Func output;
     // Empty members for API compatibility with the scheduled pipeline.
     Halide::Func g_interp, block_shifts, blur_x, blur_y;
     Halide::Var bx, by;
 
+    CAShiftEstimateBuilder(Halide::Func input_float,
+                           Halide::Var x, Halide::Var y,
+                           Halide::Expr width, Halide::Expr height,
+                           bool binned = false) {
+        Halide::Var c_ca, v_ca;
+        output = Halide::Func("ca_shifts_dummy");
+        output(bx, by, c_ca, v_ca) = 0.0f;
+    }
+};
+
+class CACorrectBuilder {
+public:
+    Halide::Func output;
+    // Empty members for API compatibility with the scheduled pipeline.
+    Halide::Func g_interp, block_shifts, blur_x, blur_y, estimate_g_interp;
+    Halide::Var bx, by;
+    Halide::Expr is_bypassed; // Undefined: nothing to specialize.
+
     CACorrectBuilder(Halide::Func input_float,
                      Halide::Var x, Halide::Var y,
                      Halide::Expr strength,
                      Halide::Expr width, Halide::Expr height,
                      const Halide::Target &target,
-                     bool is_autoscheduled) {
+                     bool is_autoscheduled,
+                     Halide::Func shifts = Halide::Func()) {
         output = Halide::Func("ca_corrected_dummy");
         output(x, y) = input_float(x, y);
     }
@@ -72,10 +104,41 @@ inline Halide::Expr bilinear(Halide::Func f, Halide::Expr x, Halide::Expr y, Hal
     return lerp(v0, v1, yf);
 }
 
-} // namespace
+// Green at every site of a GRBG mosaic: the mosaic's own at G sites, a
+// directionally adaptive average of the four neighbours at R and B.
+inline Halide::Func ca_green_interp(Halide::Func mosaic, Halide::Var x, Halide::Var y,
+                                    Halide::Expr width, Halide::Expr height, const std::string& name) {
+    using namespace Halide;
+    Func g_interp(name);
+    Func clamped = BoundaryConditions::repeat_edge(mosaic, {{Expr(0), width}, {Expr(0), height}});
+    Expr g_n = clamped(x, y - 1);
+    Expr g_s = clamped(x, y + 1);
+    Expr g_w = clamped(x - 1, y);
+    Expr g_e = clamped(x + 1, y);
+
+    Expr grad_v = absd(g_n, g_s);
+    Expr grad_h = absd(g_w, g_e);
+
+    // Directionally-adaptive interpolation based on absolute difference.
+    Expr interp_val = select(grad_h < grad_v, avg(g_w, g_e), avg(g_n, g_s));
+
+    Expr is_g = (y % 2 + x % 2) % 2 == 0;
+    g_interp(x, y) = select(is_g, mosaic(x, y), interp_val);
+    return g_interp;
+}
 
+} // namespace
 
-class CACorrectBuilder {
+// Estimates the CA shift field (see CAShiftGrid) of a GRBG mosaic: a
+// least-squares shift of R and of B against the interpolated green per
+// tile, blurred over 9x9 tiles into a smooth field.
+//
+// With `binned`, the estimate runs on a half-size mosaic of the same CFA
+// layout, a quarter of the sums. Each of its sites is a weighted mean of
+// same-coloured sites around (2x + 1, 2y + 1) ([1 1] taps on even
+// coordinates, [1 2 1] on odd ones, so every colour stays centred on the
+// same point), and the shifts are scaled back to full-resolution pixels.
+class CAShiftEstimateBuilder {
 public:
     Halide::Func output;
     // Expose key internal funcs for scheduling
@@ -86,62 +149,50 @@ public:
     // Expose the vars used for the coarse grid for scheduling
     Halide::Var bx, by;
 
-
-    CACorrectBuilder(Halide::Func input_float,
-                     Halide::Var x, Halide::Var y,
-                     Halide::Expr strength,
-                     Halide::Expr width, Halide::Expr height,
-                     const Halide::Target &target,
-                     bool is_autoscheduled) :
-        output("ca_corrected"),
-        g_interp("ca_g_interp"),
+    CAShiftEstimateBuilder(Halide::Func input_float,
+                           Halide::Var x, Halide::Var y,
+                           Halide::Expr width, Halide::Expr height,
+                           bool binned = false) :
+        output("ca_shifts"),
         block_shifts("ca_block_shifts"),
         blur_x("ca_blur_x"),
         blur_y("ca_blur_y"),
         bx("ca_bx"), by("ca_by")
     {
         using namespace Halide;
-        using namespace Halide::ConciseCasts;
 
-        // The input 'norm_raw' is already a normalized [0,1] float.
+        const Expr grid_w = CAShiftGrid::width(width), grid_h = CAShiftGrid::height(height);
         Func norm_raw = input_float;
-
-        // The tile size for the coarse-grid shift estimation.
-        const int ts = 16;
-
-        // 2. Determine color of each pixel from GRBG Bayer pattern
-        Expr cfa_y = y % 2;
-        Expr cfa_x = x % 2;
-        Expr is_g = (cfa_y + cfa_x) % 2 == 0;
-        Expr is_r = (cfa_y == 0 && cfa_x == 1);
-        Expr is_b = (cfa_y == 1 && cfa_x == 0);
-
-        // 3. Interpolate Green channel to R and B sites.
-        {
-            Func clamped_norm = BoundaryConditions::repeat_edge(norm_raw, {{Expr(0), width}, {Expr(0), height}});
-            Expr g_n = clamped_norm(x, y - 1);
-            Expr g_s = clamped_norm(x, y + 1);
-            Expr g_w = clamped_norm(x - 1, y);
-            Expr g_e = clamped_norm(x + 1, y);
-
-            Expr grad_v = absd(g_n, g_s);
-            Expr grad_h = absd(g_w, g_e);
-
-            // Directionally-adaptive interpolation based on absolute difference.
-            Expr interp_val = select(grad_h < grad_v, avg(g_w, g_e), avg(g_n, g_s));
-
-            g_interp(x, y) = select(is_g, norm_raw(x, y), interp_val);
+        Expr est_width = width, est_height = height;
+        int ts = CAShiftGrid::kTileSize;
+        float scale = 1.0f;
+        if (binned) {
+            Func clamped = BoundaryConditions::repeat_edge(input_float, {{Expr(0), width}, {Expr(0), height}});
+            Func bin_x("ca_bin_x"), binned_raw("ca_binned");
+            bin_x(x, y) = select(x % 2 == 0,
+                                 0.5f * (clamped(2 * x, y) + clamped(2 * x + 2, y)),
+                                 0.25f * (clamped(2 * x - 1, y) + clamped(2 * x + 3, y)) + 0.5f * clamped(2 * x + 1, y));
+            binned_raw(x, y) = select(y % 2 == 0,
+                                      0.5f * (bin_x(x, 2 * y) + bin_x(x, 2 * y + 2)),
+                                      0.25f * (bin_x(x, 2 * y - 1) + bin_x(x, 2 * y + 3)) + 0.5f * bin_x(x, 2 * y + 1));
+            norm_raw = binned_raw;
+            est_width = width / 2;
+            est_height = height / 2;
+            ts /= 2;
+            scale = 2.0f;
         }
 
-        // 4. Estimate shifts on a coarse grid.
+        g_interp = ca_green_interp(norm_raw, x, y, est_width, est_height, "ca_estimate_g_interp");
+
+        // Estimate shifts on a coarse grid.
         Var c_ca("c_ca"), v_ca("v_ca");
         {
             RDom r(0, ts, 0, ts, "ca_rdom");
             Expr tile_x = bx * ts + r.x;
             Expr tile_y = by * ts + r.y;
 
-            Func clamped_g_interp = BoundaryConditions::repeat_edge(g_interp, {{0, width}, {0, height}});
-            Func clamped_norm_raw = BoundaryConditions::repeat_edge(norm_raw, {{0, width}, {0, height}});
+            Func clamped_g_interp = BoundaryConditions::repeat_edge(g_interp, {{0, est_width}, {0, est_height}});
+            Func clamped_norm_raw = BoundaryConditions::repeat_edge(norm_raw, {{0, est_width}, {0, est_height}});
 
             Expr is_tile_r = ((tile_y % 2) == 0 && (tile_x % 2) == 1);
             Expr is_tile_b = ((tile_y % 2) == 1 && (tile_x % 2) == 0);
@@ -150,10 +201,6 @@ public:
             Expr G = clamped_g_interp(tile_x, tile_y);
             Expr deltgrb = G - C;
 
-            // This threshold prevents division by zero in flat areas (shadows, highlights)
-            // which is the likely cause of the visual artifacts.
-            const float den_thresh = 0.001f;
-
             // --- Horizontal shifts (v=1) ---
             Expr gdiff_h = clamped_g_interp(tile_x + 1, tile_y) - clamped_g_interp(tile_x - 1, tile_y);
             Expr num_h_r = sum(select(is_tile_r, deltgrb * gdiff_h, 0.f), "ca_num_h_r_sum");
@@ -181,48 +228,114 @@ public:
             Expr shift_h = select(c_ca == 0, shift_h_r, shift_h_b);
             Expr shift = select(v_ca == 0, shift_v, shift_h);
 
-            block_shifts(bx, by, c_ca, v_ca) = clamp(shift, -bslim, bslim);
-            block_shifts.set_estimates({ {0, (width + ts - 1) / ts}, {0, (height + ts - 1) / ts}, {0, 2}, {0, 2} });
+            // The limit is in full-resolution pixels.
+            block_shifts(bx, by, c_ca, v_ca) = clamp(shift * scale, -bslim, bslim);
+            block_shifts.set_estimates({ {0, grid_w}, {0, grid_h}, {0, 2}, {0, 2} });
         }
 
-        // 5. Blur the block_shifts to get a smooth global shift field.
-        Func blurred_shifts("blurred_shifts");
+        // Blur the block_shifts to get a smooth global shift field.
         {
-            Region block_bounds = {{0, (width+ts-1)/ts}, {0, (height+ts-1)/ts}, {0,2}, {0,2}};
+            Region block_bounds = {{0, grid_w}, {0, grid_h}, {0, 2}, {0, 2}};
             Func clamped_shifts = BoundaryConditions::repeat_edge(block_shifts, block_bounds);
 
             RDom r_blur(-4, 9, "ca_blur_rdom");
             blur_x(bx, by, c_ca, v_ca) = sum(clamped_shifts(bx + r_blur, by, c_ca, v_ca), "ca_shifts_blur_x_sum");
             blur_y(bx, by, c_ca, v_ca) = sum(blur_x(bx, by + r_blur, c_ca, v_ca), "ca_shifts_blur_y_sum");
-            blurred_shifts(bx, by, c_ca, v_ca) = blur_y(bx, by, c_ca, v_ca) / 81.0f;
+            output(bx, by, c_ca, v_ca) = blur_y(bx, by, c_ca, v_ca) / 81.0f;
         }
+    }
+};
+
+class CACorrectBuilder {
+public:
+    Halide::Func output;
+    // Expose key internal funcs for scheduling. g_interp is the green plane
+    // at full resolution, interpolated at the R and B sites; the demosaic
+    // shares it.
+    Halide::Func g_interp;
+    // The shift estimate's (CAShiftEstimateBuilder), when the builder makes
+    // its own; undefined when it is given the shifts.
+    Halide::Func block_shifts;
+    Halide::Func blur_x;
+    Halide::Func blur_y;
+    Halide::Func estimate_g_interp;
+    // Expose the vars used for the coarse grid for scheduling
+    Halide::Var bx, by;
+    // True when the strength turns the stage off; the schedule specializes
+    // `output` on it so the shift estimation drops out.
+    Halide::Expr is_bypassed;
+
+    // `shifts`, if defined, is the shift field (see CAShiftGrid), defined
+    // over the whole grid and beyond (e.g. a repeat_edge'd input buffer);
+    // otherwise it is estimated from `input_float`.
+    CACorrectBuilder(Halide::Func input_float,
+                     Halide::Var x, Halide::Var y,
+                     Halide::Expr strength,
+                     Halide::Expr width, Halide::Expr height,
+                     const Halide::Target &target,
+                     bool is_autoscheduled,
+                     Halide::Func shifts = Halide::Func()) :
+        output("ca_corrected")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        // The input 'norm_raw' is already a normalized [0,1] float.
+        Func norm_raw = input_float;
+
+        if (!shifts.defined()) {
+            CAShiftEstimateBuilder estimate(input_float, x, y, width, height);
+            shifts = estimate.output;
+            block_shifts = estimate.block_shifts;
+            blur_x = estimate.blur_x;
+            blur_y = estimate.blur_y;
+            estimate_g_interp = estimate.g_interp;
+            bx = estimate.bx;
+            by = estimate.by;
+        }
+
+        // Determine color of each pixel from GRBG Bayer pattern
+        Expr cfa_y = y % 2;
+        Expr cfa_x = x % 2;
+        Expr is_r = (cfa_y == 0 && cfa_x == 1);
+        Expr is_b = (cfa_y == 1 && cfa_x == 0);
+
+        // Interpolate Green channel to R and B sites.
+        g_interp = ca_green_interp(norm_raw, x, y, width, height, "ca_g_interp");
 
-        // 6. Apply the correction to R and B channels
+        // Apply the correction to R and B channels
         Func corrected_f("corrected_f");
         {
-            Expr f_bx = cast<float>(x) / (float)ts;
-            Expr f_by = cast<float>(y) / (float)ts;
+            const float ts = static_cast<float>(CAShiftGrid::kTileSize);
+            Expr f_bx = cast<float>(x) / ts;
+            Expr f_by = cast<float>(y) / ts;
 
             const float shift_bound = 4.0f;
-            Expr shift_vr = clamp(bilinear(blurred_shifts, f_bx, f_by, 0, 0), -shift_bound, shift_bound) * strength;
-            Expr shift_hr = clamp(bilinear(blurred_shifts, f_bx, f_by, 0, 1), -shift_bound, shift_bound) * strength;
-            Expr shift_vb = clamp(bilinear(blurred_shifts, f_bx, f_by, 1, 0), -shift_bound, shift_bound) * strength;
-            Expr shift_hb = clamp(bilinear(blurred_shifts, f_bx, f_by, 1, 1), -shift_bound, shift_bound) * strength;
+            Expr shift_vr = clamp(bilinear(shifts, f_bx, f_by, 0, 0), -shift_bound, shift_bound) * strength;
+            Expr shift_hr = clamp(bilinear(shifts, f_bx, f_by, 0, 1), -shift_bound, shift_bound) * strength;
+            Expr shift_vb = clamp(bilinear(shifts, f_bx, f_by, 1, 0), -shift_bound, shift_bound) * strength;
+            Expr shift_hb = clamp(bilinear(shifts, f_bx, f_by, 1, 1), -shift_bound, shift_bound) * strength;
 
             Func g_interp_clamped = BoundaryConditions::repeat_edge(g_interp, {{0, width}, {0, height}});
             Expr r_new = norm_raw(x, y) + g_interp(x, y) - bilinear(g_interp_clamped, x + shift_hr, y + shift_vr);
             Expr b_new = norm_raw(x, y) + g_interp(x, y) - bilinear(g_interp_clamped, x + shift_hb, y + shift_vb);
 
-            corrected_f(x, y) = select(is_r, r_new, is_b, b_new, norm_raw(x, y));
+            // Only R and B move; the greens pass through untouched, so
+            // g_interp is also the green of the corrected mosaic and the
+            // demosaic can take it as is (see DemosaicFastT).
+            corrected_f(x, y) = select(is_r, clamp(r_new, 0.0f, 1.0f),
+                                       is_b, clamp(b_new, 0.0f, 1.0f),
+                                       norm_raw(x, y));
         }
 
         // This stage is a no-op if strength is zero.
-        output(x, y) = select(strength < 0.001f,
+        is_bypassed = strength < 0.001f;
+        output(x, y) = select(is_bypassed,
                               input_float(x, y),
-                              clamp(corrected_f(x,y), 0.0f, 1.0f));
+                              corrected_f(x, y));
 
-        // The pointwise helpers 'blurred_shifts' and 'corrected_f' will be inlined
-        // by default because they are not scheduled.
+        // The pointwise helper 'corrected_f' will be inlined by default
+        // because it is not scheduled.
     }
 };
 
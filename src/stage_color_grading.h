@@ -2,15 +2,91 @@
 #define STAGE_COLOR_GRADING_H
 
 #include "Halide.h"
+#include <vector>
+
+// The 3D LUTs here are [x, y, z, channel] with the channel innermost in
+// memory (HostColor builds them that way), so the three values of a lattice
+// point share a cache line and a lookup's taps are a few lines, not 3x as
+// many spread a whole LUT plane apart. The generators constrain their LUT
+// inputs to the layout with this.
+template <typename LutInput>
+void require_interleaved_lut(LutInput& lut) {
+    Halide::Expr n = lut.dim(0).extent();
+    lut.dim(3).set_bounds(0, 3).set_stride(1);
+    lut.dim(0).set_stride(3);
+    lut.dim(1).set_stride(3 * n);
+    lut.dim(2).set_stride(3 * n * n);
+}
+
+namespace ColorLutLookup {
+    // Interpolates channel `c` of `lut` at lattice cell `idx` (each in
+    // [0, n - 2], so every tap is in bounds without a boundary condition)
+    // and offset `frac` (each in [0, 1]).
+
+    // Eight taps.
+    inline Halide::Expr trilinear(Halide::Func lut, const std::vector<Halide::Expr>& idx,
+                                  const std::vector<Halide::Expr>& frac, Halide::Var c) {
+        using namespace Halide;
+        auto tap = [&](int d0, int d1, int d2) {
+            return lut(idx[0] + d0, idx[1] + d1, idx[2] + d2, c);
+        };
+        Expr c00 = lerp(tap(0, 0, 0), tap(1, 0, 0), frac[0]);
+        Expr c01 = lerp(tap(0, 0, 1), tap(1, 0, 1), frac[0]);
+        Expr c10 = lerp(tap(0, 1, 0), tap(1, 1, 0), frac[0]);
+        Expr c11 = lerp(tap(0, 1, 1), tap(1, 1, 1), frac[0]);
+        Expr c0 = lerp(c00, c10, frac[1]);
+        Expr c1 = lerp(c01, c11, frac[1]);
+        return lerp(c0, c1, frac[2]);
+    }
+
+    // Four taps. The tetrahedron containing the point runs from corner 000
+    // to 111 through the corner that steps the largest fraction's axis, then
+    // the corner that also steps the middle one.
+    inline Halide::Expr tetrahedral(Halide::Func lut, const std::vector<Halide::Expr>& idx,
+                                    const std::vector<Halide::Expr>& frac, Halide::Var c) {
+        using namespace Halide;
+        Expr f0 = frac[0], f1 = frac[1], f2 = frac[2];
+        Expr ge01 = f0 >= f1, ge12 = f1 >= f2, ge02 = f0 >= f2;
+        Expr first0 = ge01 && ge02;
+        Expr first1 = !ge01 && ge12;
+        Expr first2 = !first0 && !first1;
+        Expr last0 = !ge01 && !ge02;
+        Expr last2 = ge02 && ge12;
+        Expr last1 = !last0 && !last2;
+
+        Expr hi = max(f0, f1, f2), lo = min(f0, f1, f2);
+        Expr mid = f0 + f1 + f2 - hi - lo;
+
+        auto tap = [&](Expr d0, Expr d1, Expr d2) {
+            return lut(idx[0] + d0, idx[1] + d1, idx[2] + d2, c);
+        };
+        Expr v0 = tap(0, 0, 0);
+        Expr v1 = tap(select(first0, 1, 0), select(first1, 1, 0), select(first2, 1, 0));
+        Expr v2 = tap(select(last0, 0, 1), select(last1, 0, 1), select(last2, 0, 1));
+        Expr v3 = tap(1, 1, 1);
+        return (1.0f - hi) * v0 + (hi - mid) * v1 + (mid - lo) * v2 + lo * v3;
+    }
 
+    // Splits normalized coordinate `t` (in [0, 1]) into a clamped lattice
+    // cell and the offset within it.
+    inline void locate(Halide::Expr t, Halide::Expr lut_dim, Halide::Expr& idx, Halide::Expr& frac) {
+        using namespace Halide;
+        Expr f = t * cast<float>(lut_dim - 1);
+        idx = clamp(cast<int>(f), 0, lut_dim - 2);
+        frac = f - cast<float>(idx);
+    }
+}
+
+// `tetrahedral` swaps the trilinear lookup for the four-tap one (CMake
+// TETRAHEDRAL_COLOR_LUT). The two agree at the lattice nodes.
 class ColorGradeBuilder {
 public:
     Halide::Func output;
     std::vector<Halide::Func> intermediates;
 
-    ColorGradeBuilder(Halide::Func lch_input, Halide::Func lut, Halide::Expr lut_dim_extent, Halide::Var x, Halide::Var y, Halide::Var c) {
+    ColorGradeBuilder(Halide::Func lch_input, Halide::Func lut, Halide::Expr lut_dim_extent, Halide::Var x, Halide::Var y, Halide::Var c,
+                      bool tetrahedral = false) {
         using namespace Halide;
-        using namespace Halide::ConciseCasts;
         output = Func("color_graded");
 
 #ifndef NO_3D_LUTS
@@ -23,46 +99,13 @@ public:
         Expr C_norm = clamp(C / 150.f, 0.f, 1.f);
         Expr h_norm = clamp((h + (float)M_PI) / (2.f * (float)M_PI), 0.f, 1.f); // [0, 1]
 
-        Expr lut_dim = lut_dim_extent;
-        Expr lf = l_norm * (lut_dim - 1);
-        Expr Cf = C_norm * (lut_dim - 1);
-        Expr hf = h_norm * (lut_dim - 1);
-
-        Expr li = cast<int>(floor(lf));
-        Expr Ci = cast<int>(floor(Cf));
-        Expr hi = cast<int>(floor(hf));
-
-        Expr ld = lf - li;
-        Expr Cd = Cf - Ci;
-        Expr hd = hf - hi;
-
-        Region lut_bounds = {{Expr(0), lut_dim}, {Expr(0), lut_dim}, {Expr(0), lut_dim}, {Expr(0), 3}};
-        Func lut_clamped = BoundaryConditions::repeat_edge(lut, lut_bounds);
-
-        // A clear, textbook implementation of trilinear interpolation.
-
-        // Interpolate along the L axis for the 8 corners of the cube.
-        Expr c000 = lut_clamped(li, Ci, hi, c);
-        Expr c100 = lut_clamped(li + 1, Ci, hi, c);
-        Expr c010 = lut_clamped(li, Ci + 1, hi, c);
-        Expr c110 = lut_clamped(li + 1, Ci + 1, hi, c);
-        Expr c001 = lut_clamped(li, Ci, hi + 1, c);
-        Expr c101 = lut_clamped(li + 1, Ci, hi + 1, c);
-        Expr c011 = lut_clamped(li, Ci + 1, hi + 1, c);
-        Expr c111 = lut_clamped(li + 1, Ci + 1, hi + 1, c);
-
-        // Interpolate along L.
-        Expr c00 = lerp(c000, c100, ld);
-        Expr c01 = lerp(c001, c101, ld);
-        Expr c10 = lerp(c010, c110, ld);
-        Expr c11 = lerp(c011, c111, ld);
-
-        // Interpolate along C.
-        Expr c0 = lerp(c00, c10, Cd);
-        Expr c1 = lerp(c01, c11, Cd);
-
-        // Interpolate along H.
-        output(x, y, c) = lerp(c0, c1, hd);
+        std::vector<Expr> idx(3), frac(3);
+        ColorLutLookup::locate(l_norm, lut_dim_extent, idx[0], frac[0]);
+        ColorLutLookup::locate(C_norm, lut_dim_extent, idx[1], frac[1]);
+        ColorLutLookup::locate(h_norm, lut_dim_extent, idx[2], frac[2]);
+
+        output(x, y, c) = tetrahedral ? ColorLutLookup::tetrahedral(lut, idx, frac, c)
+                                      : ColorLutLookup::trilinear(lut, idx, frac, c);
 #else
         // If NO_3D_LUTS is defined, this stage is a simple pass-through.
         output(x, y, c) = lch_input(x, y, c);
@@ -70,5 +113,36 @@ public:
     }
 };
 
+// The point-wise look (linear sRGB -> LCh -> grading LUT -> linear sRGB)
+// baked by the host into one linear-RGB LUT (HostColor::generate_rgb_color_lut),
+// for use while the local adjustments are at their defaults and the chain is
+// a pure function of each pixel's colour. Lookups are tetrahedral: four taps
+// instead of trilinear's eight, and no colour conversions.
+//
+// The LUT axes are sqrt-shaped (node i is at (i / (size - 1))^2), which puts
+// more nodes near black where L* is steepest. The input is clamped to [0, 1],
+// which holds for `dehazed`: the colour matrix output is clamped and dehazing
+// never raises a value above 1.
+class RgbLutBuilder {
+public:
+    Halide::Func output;
+
+    RgbLutBuilder(Halide::Func rgb_input, Halide::Func lut, Halide::Expr lut_dim_extent, Halide::Var x, Halide::Var y, Halide::Var c) {
+        using namespace Halide;
+        output = Func("look_lut_applied");
+
+#ifndef NO_3D_LUTS
+        std::vector<Expr> idx(3), frac(3);
+        for (int i = 0; i < 3; i++) {
+            ColorLutLookup::locate(sqrt(clamp(rgb_input(x, y, i), 0.0f, 1.0f)), lut_dim_extent, idx[i], frac[i]);
+        }
+        output(x, y, c) = ColorLutLookup::tetrahedral(lut, idx, frac, c);
+#else
+        // Matches ColorGradeBuilder's pass-through: the conversions round-trip.
+        output(x, y, c) = rgb_input(x, y, c);
+#endif
+    }
+};
+
 #endif // STAGE_COLOR_GRADING_H
 
@@ -0,0 +1,41 @@
+#ifndef STAGE_CSI2_UNPACK_H
+#define STAGE_CSI2_UNPACK_H
+
+#include "Halide.h"
+#include "csi2_packing.h"
+
+// Expands CSI-2 packed Bayer rows (see csi2_packing.h) to 16-bit samples at
+// the sensor's bit depth, for the pipeline to read in place of an unpacked
+// raw. `output` is meant to be inlined into its consumer (linear_exposed),
+// so the packed bytes are read once and never stored unpacked.
+//
+// The packed input's extent is the row's packed bytes without padding (the
+// host crops the stride away); `pixel_width` gives the row in pixels.
+class Csi2UnpackBuilder {
+public:
+    Halide::Func output;
+
+    Csi2UnpackBuilder(Halide::Func packed, RawPacking packing, Halide::Var x, Halide::Var y)
+        : output("csi2_unpacked")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        const int group_pixels = raw_packing_group_pixels(packing);
+        const int group_bytes = raw_packing_group_bytes(packing);
+        const int low_bits = packing == RawPacking::Csi2Raw10 ? 2 : 4;
+
+        Expr group = (x / group_pixels) * group_bytes;
+        Expr i = x % group_pixels;
+        Expr high = u16(packed(group + i, y));
+        Expr low = u16(packed(group + group_pixels, y)) >> u16(i * low_bits);
+        output(x, y) = (high << low_bits) | (low & u16((1 << low_bits) - 1));
+    }
+
+    // Pixels in a row of `packed_width` packed bytes.
+    static Halide::Expr pixel_width(Halide::Expr packed_width, RawPacking packing) {
+        return packed_width / raw_packing_group_bytes(packing) * raw_packing_group_pixels(packing);
+    }
+};
+
+#endif // STAGE_CSI2_UNPACK_H
@@ -3,44 +3,113 @@
 
 #include "Halide.h"
 #include "pipeline_helpers.h"
+#include "halide_guided_filter.h"
+#include <vector>
 
+// Dark-channel dehaze (He, Sun & Tang), estimated on a coarse grid and
+// refined per pixel:
+//  - The grid has kGridCells cells along the frame's long edge, 1/8 of a
+//    1536-pixel render, so a preview and the export see the same cells.
+//    Each cell is the mean of kSamples x kSamples samples of `stats`.
+//  - The atmospheric light is the mean colour of the cell with the
+//    brightest dark channel, an argmax over the grid.
+//  - The coarse transmission is 1 - 0.95 * strength * the dark channel of
+//    the cells over their 3 x 3 neighbourhood, each channel relative to
+//    the atmospheric light.
+//  - GuidedUpsampleBuilder refines it against the input's luma and brings
+//    it to full resolution.
+//
+// `stats` is the input at output coordinates, readable anywhere in the
+// frame, for the estimates made once per run. It can be `input` itself
+// where that is a materialized buffer (the back end); the monolithic
+// pipeline gives it a copy inlined from the raw, like the pyramid's low-fi
+// splice, since its `input` only exists per strip. The grid Funcs are in
+// `coarse`, to be computed once per run (schedule_dehaze_estimate);
+// `transmission` is per pixel and shared by its three channels.
 class DehazeBuilder {
 public:
+    static constexpr int kGridCells = 192;
+    static constexpr int kSamples = 4;
+    // The guided refinement's window, in cells either side, and its
+    // regularization on [0, 1] luma.
+    static constexpr int kGuideRadius = 2;
+    static constexpr float kGuideEps = 1e-3f;
+
     Halide::Func output;
+    // The atmospheric light, (c).
+    Halide::Func atmosphere;
+    // Full resolution, in [0.1, 1].
+    Halide::Func transmission;
+    std::vector<Halide::Func> coarse;
+    // True when the strength turns the stage off (see schedule_look_stages).
+    Halide::Expr is_bypassed;
 
-    DehazeBuilder(Halide::Func input_srgb, Halide::Expr strength, Halide::Var x, Halide::Var y, Halide::Var c)
-        : output("dehazed")
+    DehazeBuilder(Halide::Func input_srgb, Halide::Func stats, Halide::Expr strength,
+                  Halide::Expr width, Halide::Expr height,
+                  Halide::Var x, Halide::Var y, Halide::Var c)
+        : output("dehazed"), atmosphere("dehaze_atmosphere"), transmission("dehaze_transmission")
     {
         using namespace Halide;
-        using namespace Halide::ConciseCasts;
 
-        // --- Dehaze using Color Attenuation Prior ---
-        Expr r = input_srgb(x, y, 0);
-        Expr g = input_srgb(x, y, 1);
-        Expr b = input_srgb(x, y, 2);
+        // --- The grid ---
+        Expr cell = max(1.0f, cast<float>(max(width, height)) / kGridCells);
+        Expr grid_width = cast<int>(ceil(cast<float>(width) / cell));
+        Expr grid_height = cast<int>(ceil(cast<float>(height) / cell));
+
+        Var gx("dehaze_gx"), gy("dehaze_gy");
+        RDom s(0, kSamples, 0, kSamples, "dehaze_samples");
+        Expr sx = clamp(cast<int>((cast<float>(gx) + (s.x + 0.5f) / kSamples) * cell), 0, width - 1);
+        Expr sy = clamp(cast<int>((cast<float>(gy) + (s.y + 0.5f) / kSamples) * cell), 0, height - 1);
+        Func cell_mean("dehaze_cell_mean");
+        cell_mean(gx, gy, c) = sum(stats(sx, sy, c), "dehaze_cell_sum") * (1.0f / (kSamples * kSamples));
 
-        // Brightness and Saturation are used to estimate haze depth.
-        Expr v = max(r, g, b);
-        Expr s = (v - min(r, g, b)) / (v + 1e-6f);
-        Expr d = v - s; // Depth estimate
+        // --- Atmospheric light ---
+        RDom g(0, grid_width, 0, grid_height, "dehaze_grid");
+        Expr cell_dark = min(cell_mean(g.x, g.y, 0), cell_mean(g.x, g.y, 1), cell_mean(g.x, g.y, 2));
+        Tuple brightest = argmax(cell_dark, "dehaze_brightest");
+        atmosphere(c) = max(cell_mean(clamp(brightest[0], 0, grid_width - 1),
+                                      clamp(brightest[1], 0, grid_height - 1), c), 0.05f);
 
-        // Transmission = 1 - strength * depth. Clamp to avoid over-dehazing.
-        Expr t = clamp(1.0f - (strength / 100.0f) * d, 0.1f, 1.0f);
+        // --- Coarse transmission ---
+        Func dark("dehaze_dark");
+        dark(gx, gy) = min(cell_mean(gx, gy, 0) / atmosphere(0),
+                           cell_mean(gx, gy, 1) / atmosphere(1),
+                           cell_mean(gx, gy, 2) / atmosphere(2));
+        Func dark_clamped = BoundaryConditions::repeat_edge(dark, {{0, grid_width}, {0, grid_height}});
+        Expr patch_dark = dark_clamped(gx, gy);
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dx != 0 || dy != 0) patch_dark = min(patch_dark, dark_clamped(gx + dx, gy + dy));
+            }
+        }
+        Func coarse_transmission("dehaze_coarse_transmission");
+        coarse_transmission(gx, gy) = 1.0f - 0.95f * (strength / 100.0f) * patch_dark;
 
-        // Assume atmospheric light A is pure white (1,1,1) for speed.
-        const float A = 1.0f;
+        // --- Guided refinement, to full resolution ---
+        Func coarse_luma("dehaze_coarse_luma");
+        coarse_luma(gx, gy) = 0.2126f * cell_mean(gx, gy, 0) + 0.7152f * cell_mean(gx, gy, 1) + 0.0722f * cell_mean(gx, gy, 2);
+        Func luma("dehaze_luma");
+        luma(x, y) = 0.2126f * input_srgb(x, y, 0) + 0.7152f * input_srgb(x, y, 1) + 0.0722f * input_srgb(x, y, 2);
+        GuidedUpsampleBuilder refined(coarse_transmission, coarse_luma, luma, grid_width, grid_height, cell,
+                                      x, y, kGuideRadius, kGuideEps, "dehaze_guided");
 
-        // Invert the haze model: J = (I - A)/t + A
-        Expr val_dehazed = (input_srgb(x, y, c) - A) / t + A;
+        coarse.push_back(cell_mean);
+        coarse.push_back(atmosphere);
+        coarse.push_back(coarse_transmission);
+        coarse.insert(coarse.end(), refined.coarse.begin(), refined.coarse.end());
 
-        // If dehaze is disabled, pass through. Otherwise, apply the dehazing and
-        // clamp the result to be non-negative to prevent numerical errors in subsequent
-        // color space conversions.
-        output(x, y, c) = select(strength < 0.001f,
+        transmission(x, y) = clamp(refined.output(x, y), 0.1f, 1.0f);
+
+        // Invert the haze model: J = (I - A) / t + A. If dehaze is disabled,
+        // pass through. Otherwise clamp the result to be non-negative to
+        // prevent numerical errors in subsequent color space conversions.
+        Expr a = atmosphere(c);
+        Expr val_dehazed = (input_srgb(x, y, c) - a) / transmission(x, y) + a;
+        is_bypassed = strength < 0.001f;
+        output(x, y, c) = select(is_bypassed,
                                  input_srgb(x, y, c),
                                  max(0.0f, val_dehazed));
     }
 };
 
 #endif // STAGE_DEHAZE_H
-
@@ -9,24 +9,60 @@
 #include "demosaic_LMMSE.h"
 #include "demosaic_RI.h"
 #include "demosaic_fast.h"
+#include "demosaic_adaptive.h"
 
 // This class acts as a dispatcher for multiple demosaicing algorithms.
 // It is now templated to support different processing precisions.
 // It instantiates all available algorithms and uses Halide's 'select'
-// primitive to choose one at runtime based on a parameter. Halide's JIT
-// compiler will then perform dead-code elimination on the inactive
-// algorithm paths, resulting in zero runtime overhead for the selection.
+// primitive to choose one at runtime based on a parameter.
+//
+// On its own the select is evaluated per pixel, so every algorithm's
+// inlined expression tree ends up in the inner loop. The schedule is
+// expected to call `output.specialize(algo_id == N)` for each algorithm
+// (see schedule_pipeline), which lets Halide fold the select away and emit
+// one loop nest per algorithm. `algo_id` must be the exact Expr used in the
+// definition for the specialization to simplify it.
+//
+// ADAPTIVE runs Fast on flat areas and AHD only near detail (see
+// DemosaicAdaptive); its blocks need scheduling of their own
+// (schedule_demosaic_adaptive).
 template<typename T>
 class DemosaicDispatcherT {
 public:
     // The final, selected output Func
     Halide::Func output;
 
+    // The runtime algorithm selector, kept so the schedule can specialize on it.
+    Halide::Expr algo_id;
+
+    // Algorithm ids, matching the mapping in process.cpp / the editor.
+    static constexpr int AHD = 0;
+    static constexpr int LMMSE = 1;
+    static constexpr int RI = 2;
+    static constexpr int FAST = 3;
+    static constexpr int ADAPTIVE = 4;
+
+    // Per-algorithm intermediates, so each specialized path can be scheduled
+    // on its own.
+    std::vector<Halide::Func> ahd_intermediates;
+    std::vector<Halide::Func> lmmse_intermediates;
+    std::vector<Halide::Func> ri_intermediates;
+    std::vector<Halide::Func> fast_intermediates;
+
+    // The Fast/AHD blend behind ADAPTIVE. Not among all_intermediates.
+    DemosaicAdaptive adaptive;
+
     // A collection of ALL intermediate Funcs from ALL possible algorithms.
     // This is needed so the generator can schedule them.
     std::vector<Halide::Func> all_intermediates;
 
-    DemosaicDispatcherT(Halide::Func deinterleaved, Halide::Expr algo_id, Halide::Var x, Halide::Var y, Halide::Var c) {
+    // `shared_green`, if defined, is a full-resolution green plane the
+    // algorithms that interpolate green the same way take instead of their
+    // own (see DemosaicFastT): CACorrectBuilder::g_interp. `adaptive_per_block`
+    // builds ADAPTIVE's per-block branch, which needs the CPU schedule.
+    DemosaicDispatcherT(Halide::Func deinterleaved, Halide::Expr algo_id_in, Halide::Var x, Halide::Var y, Halide::Var c,
+                        Halide::Func shared_green = Halide::Func(), bool adaptive_per_block = true)
+        : algo_id(algo_id_in) {
 
         // --- Instantiate all demosaic algorithms ---
 
@@ -40,18 +76,28 @@ public:
         DemosaicRI_T<T> ri_builder(deinterleaved, x, y, c);
 
         // Algorithm 3: Fast (the original algorithm)
-        DemosaicFastT<T> fast_builder(deinterleaved, x, y, c);
+        DemosaicFastT<T> fast_builder(deinterleaved, x, y, c, shared_green);
+
+        // Algorithm 4: Fast on flat areas, AHD near detail
+        adaptive = DemosaicAdaptive(deinterleaved, fast_builder.output, ahd_builder.output, x, y, c,
+                                    adaptive_per_block);
 
         // --- Use 'select' to create the final dispatcher Func ---
         output = Halide::Func("demosaiced");
         output(x, y, c) = Halide::select(
-            algo_id == 0, ahd_builder.output(x, y, c),        // if 0, use AHD
-            algo_id == 1, lmmse_builder.output(x, y, c),     // if 1, use LMMSE
-            algo_id == 2, ri_builder.output(x, y, c),        // if 2, use RI
+            algo_id == AHD, ahd_builder.output(x, y, c),        // if 0, use AHD
+            algo_id == LMMSE, lmmse_builder.output(x, y, c),   // if 1, use LMMSE
+            algo_id == RI, ri_builder.output(x, y, c),         // if 2, use RI
+            algo_id == ADAPTIVE, adaptive.output(x, y, c),     // if 4, Fast/AHD by detail
                           fast_builder.output(x, y, c)       // else, use Fast
         );
 
         // --- Collect all intermediates for the scheduler ---
+        ahd_intermediates = ahd_builder.intermediates;
+        lmmse_intermediates = lmmse_builder.intermediates;
+        ri_intermediates = ri_builder.intermediates;
+        fast_intermediates = fast_builder.intermediates;
+
         all_intermediates.insert(all_intermediates.end(), ahd_builder.intermediates.begin(), ahd_builder.intermediates.end());
         all_intermediates.insert(all_intermediates.end(), lmmse_builder.intermediates.begin(), lmmse_builder.intermediates.end());
         all_intermediates.insert(all_intermediates.end(), ri_builder.intermediates.begin(), ri_builder.intermediates.end());
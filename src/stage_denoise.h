@@ -4,6 +4,7 @@
 #include "Halide.h"
 #include "pipeline_helpers.h"
 #include "halide_guided_filter.h"
+#include "denoise_nlmeans.h"
 #include <vector>
 #include <type_traits>
 #include <memory>
@@ -14,15 +15,25 @@ namespace { // Anonymous namespace for helpers
  * A 2D-only version of the GuidedFilterBuilder.
  * This is a copy of the original 3D version, modified to work on
  * single-channel (2D) Funcs, as required for raw denoising.
+ *
+ * The four moments are box-averaged with running sums (BoxSumBuilder), whose
+ * scans are exposed in `boxes` to be scheduled as strip-level producers, so
+ * the cost doesn't grow with the radius. Everything else is inlined.
  */
 class GuidedFilter2DBuilder {
 public:
     Halide::Func output;
+    std::vector<BoxSumBuilder> boxes;
 
-    GuidedFilter2DBuilder(Halide::Func image, Halide::Func guide, Halide::Var x, Halide::Var y, int radius, Halide::Expr eps) {
+    // Rows (and columns) per running-sum block. Matches the CPU schedules'
+    // default strip height, so a strip's scans mostly stay within one block.
+    static constexpr int kBoxBlock = 32;
+
+    GuidedFilter2DBuilder(Halide::Func image, Halide::Func guide, Halide::Var x, Halide::Var y, int radius, Halide::Expr eps,
+                          const std::string& name = "gf2d") {
         using namespace Halide;
 
-        std::string prefix = "gf2d_r" + std::to_string(radius);
+        std::string prefix = name + "_r" + std::to_string(radius);
 
         int s = 1; // No subsampling for denoising for max quality
         int R = radius;
@@ -39,10 +50,18 @@ public:
         box_p(x, y) = small_image(x, y);
         box_Ip(x, y) = small_guide(x, y) * small_image(x, y);
 
-        Func mean_I = box_filter_2d(box_I, R, R, prefix + "_mean_I", x, y);
-        Func mean_II = box_filter_2d(box_II, R, R, prefix + "_mean_II", x, y);
-        Func mean_p = box_filter_2d(box_p, R, R, prefix + "_mean_p", x, y);
-        Func mean_Ip = box_filter_2d(box_Ip, R, R, prefix + "_mean_Ip", x, y);
+        boxes.emplace_back(box_I, R, kBoxBlock, prefix + "_sum_I", x, y);
+        boxes.emplace_back(box_II, R, kBoxBlock, prefix + "_sum_II", x, y);
+        boxes.emplace_back(box_p, R, kBoxBlock, prefix + "_sum_p", x, y);
+        boxes.emplace_back(box_Ip, R, kBoxBlock, prefix + "_sum_Ip", x, y);
+
+        const float inv_area = 1.0f / ((2 * R + 1) * (2 * R + 1));
+        Func mean_I(prefix + "_mean_I"), mean_II(prefix + "_mean_II");
+        Func mean_p(prefix + "_mean_p"), mean_Ip(prefix + "_mean_Ip");
+        mean_I(x, y) = boxes[0].output(x, y) * inv_area;
+        mean_II(x, y) = boxes[1].output(x, y) * inv_area;
+        mean_p(x, y) = boxes[2].output(x, y) * inv_area;
+        mean_Ip(x, y) = boxes[3].output(x, y) * inv_area;
 
         Func var_I(prefix + "_var_I"), cov_Ip(prefix + "_cov_Ip");
         var_I(x, y) = mean_II(x, y) - mean_I(x, y) * mean_I(x, y);
@@ -56,13 +75,17 @@ public:
         upsampled_a(x, y) = a(x / s, y / s);
         upsampled_b(x, y) = b(x / s, y / s);
 
-        // Schedule all intermediates to be inlined to form a single expression tree.
+        // Inline everything but the box scans into a single expression tree.
         small_guide.compute_inline();
         small_image.compute_inline();
         box_I.compute_inline();
         box_II.compute_inline();
         box_p.compute_inline();
         box_Ip.compute_inline();
+        for (auto& box : boxes) {
+            box.sum_x.compute_inline();
+            box.output.compute_inline();
+        }
         mean_I.compute_inline();
         mean_II.compute_inline();
         mean_p.compute_inline();
@@ -82,52 +105,92 @@ public:
 
 } // namespace
 
-// This untemplated version of the denoiser works on normalized float data.
+// Raw denoise on the canonical GRBG mosaic (after BayerNormalizeBuilder),
+// ahead of CA correction and demosaic. Each CFA plane is filtered on its own
+// at quarter resolution, so neighbouring colours never mix, with the white
+// balance gain taken out first so the Anscombe VST sees each plane's sensor
+// values. `plane_gains` are the gains BayerNormalizeBuilder applied to the
+// G_r, R, B and G_b planes.
+//
+// Two filters, chosen at runtime by `algo_id` like the demosaic dispatcher:
+// the guided filter (GUIDED, `eps` its regularization), or non-local means
+// (NLMEANS, `eps` its h), which is slower and meant for high ISO exports.
+// The schedule specializes `planes` on the id so each gets its own loop nest.
+//
+// `planes` is the denoised quarter-resolution (x, y, c) planes and takes the
+// schedule, together with the guided filters' running box sums in
+// `box_sums` and the NL-means stages in `nlmeans`; `output` re-interleaves
+// them and is inlined. At strength 0 the output is the input
+// (`is_bypassed`, for specializing on).
 class DenoiseBuilder {
 public:
+    Halide::Func planes;
     Halide::Func output;
-
-    DenoiseBuilder(Halide::Func input_float,
-                   Halide::Var x, Halide::Var y,
+    Halide::Expr is_bypassed;
+    // The runtime algorithm selector, kept so the schedule can specialize on it.
+    Halide::Expr algo_id;
+    // The guided filters' running box sums, for the schedule.
+    std::vector<BoxSumBuilder> box_sums;
+    // One NL-means stage per plane, for the schedule.
+    std::vector<NLMeansBuilder> nlmeans;
+
+    // Algorithm ids, matching the mapping in process.cpp.
+    static constexpr int GUIDED = 0;
+    static constexpr int NLMEANS = 1;
+
+    DenoiseBuilder(Halide::Func bayer_grbg,
+                   Halide::Var x, Halide::Var y, Halide::Var c,
                    Halide::Expr strength,
                    Halide::Expr eps,
-                   const Halide::Target &target,
-                   bool is_autoscheduled) {
+                   const std::vector<Halide::Expr>& plane_gains,
+                   Halide::Expr algo_id_in,
+                   int radius = 2,
+                   int nlmeans_search_radius = 4,
+                   int nlmeans_patch_radius = 1)
+        : planes("denoised_planes"), output("denoised"), algo_id(algo_id_in)
+    {
         using namespace Halide;
-        using namespace Halide::ConciseCasts;
-
-        // The input is already a normalized [0,1] float.
-
-        // --- 1. Apply Variance-Stabilizing Transform (Anscombe) ---
-        Func vst("vst");
-        vst(x, y) = 2.0f * sqrt(max(0.0f, input_float(x, y)) + 3.0f/8.0f);
-
-        // --- 2. Denoise in VST space using a Guided Filter with a FIXED radius ---
-        const int fixed_radius = 2;
-        GuidedFilter2DBuilder gf(vst, vst, x, y, fixed_radius, eps);
 
-        Func denoised_vst("denoised_vst");
-        denoised_vst(x, y) = gf.output(x, y);
+        // --- 1. Split the mosaic into its four planes: 0=G_r, 1=R, 2=B, 3=G_b ---
+        // (The same split as pipeline_deinterleave, under its own name: that
+        // Func is already in the graph between CA correction and demosaic.)
+        Func plane_in("denoise_plane_in");
+        plane_in(x, y, c) = mux(c, {bayer_grbg(2 * x, 2 * y), bayer_grbg(2 * x + 1, 2 * y),
+                                    bayer_grbg(2 * x, 2 * y + 1), bayer_grbg(2 * x + 1, 2 * y + 1)});
+        Expr gain = mux(c, plane_gains);
+
+        // --- 2. Variance-stabilizing transform (Anscombe), per plane ---
+        Func vst("denoise_vst");
+        vst(x, y, c) = 2.0f * sqrt(max(0.0f, plane_in(x, y, c) / gain) + 3.0f/8.0f);
+
+        // --- 3. Guided filter or NL-means on each plane in VST space ---
+        Expr filtered[4];
+        for (int p = 0; p < 4; p++) {
+            const std::string suffix = std::to_string(p);
+            Func vst_plane("denoise_vst_" + suffix);
+            vst_plane(x, y) = vst(x, y, p);
+            vst_plane.compute_inline();
+            GuidedFilter2DBuilder gf(vst_plane, vst_plane, x, y, radius, eps, "denoise_gf" + suffix);
+            box_sums.insert(box_sums.end(), gf.boxes.begin(), gf.boxes.end());
+            nlmeans.emplace_back(vst_plane, x, y, nlmeans_search_radius, nlmeans_patch_radius, eps,
+                                 "denoise_nlmeans" + suffix);
+            filtered[p] = select(algo_id == NLMEANS, nlmeans.back().output(x, y), gf.output(x, y));
+        }
+        Expr vst_val = mux(c, {filtered[0], filtered[1], filtered[2], filtered[3]});
 
-        // --- 3. Apply Inverse VST ---
-        Func inv_vst("inv_vst");
-        Expr vst_val = denoised_vst(x, y);
-        inv_vst(x, y) = (vst_val / 2.0f) * (vst_val / 2.0f) - 3.0f/8.0f;
+        // --- 4. Inverse VST, gain restored, blended with the input by strength ---
+        Expr inv_vst = ((vst_val / 2.0f) * (vst_val / 2.0f) - 3.0f/8.0f) * gain;
+        planes(x, y, c) = lerp(plane_in(x, y, c), max(inv_vst, 0.0f), strength);
 
-        // --- 4. Blend with original based on strength ---
-        Func blended("denoise_blended");
-        blended(x, y) = lerp(input_float(x, y), inv_vst(x, y), strength);
+        // --- 5. Back to the GRBG mosaic ---
+        Expr p = (x & 1) + 2 * (y & 1);
+        Expr xh = x >> 1, yh = y >> 1;
+        is_bypassed = strength < 0.001f;
+        output(x, y) = select(is_bypassed, bayer_grbg(x, y),
+                              mux(p, {planes(xh, yh, 0), planes(xh, yh, 1), planes(xh, yh, 2), planes(xh, yh, 3)}));
 
-        // Inline the entire chain of operations to create one large expression
-        // for the final output. This is what allows specialize() to work.
         vst.compute_inline();
-        denoised_vst.compute_inline();
-        inv_vst.compute_inline();
-        blended.compute_inline();
-
-        // --- 5. Output is the final normalized float result ---
-        output = Halide::Func("denoised_output");
-        output(x, y) = clamp(blended(x,y), 0.0f, 1.0f);
+        plane_in.compute_inline();
     }
 };
 
@@ -136,6 +199,8 @@ template <typename T>
 class DenoiseBuilder_T {
 public:
     Halide::Func output;
+    // The guided filter's running box sums, for the schedule.
+    std::vector<BoxSumBuilder> box_sums;
 
     DenoiseBuilder_T(Halide::Func input_raw,
                    Halide::Var x, Halide::Var y,
@@ -160,6 +225,7 @@ public:
         // --- 3. Denoise in VST space using a Guided Filter with a FIXED radius ---
         const int fixed_radius = 2;
         GuidedFilter2DBuilder gf(vst, vst, x, y, fixed_radius, eps);
+        box_sums = gf.boxes;
 
         Func denoised_vst("denoised_vst");
         denoised_vst(x, y) = gf.output(x, y);
@@ -0,0 +1,93 @@
+#ifndef STAGE_EXPORT_PYRAMID_H
+#define STAGE_EXPORT_PYRAMID_H
+
+#include "Halide.h"
+#include <string>
+#include <vector>
+
+// Smaller copies of the 8-bit output (a web size, a thumbnail) made in the
+// same pipeline run, for process --outputs.
+//
+// A 2x2 box pyramid of the full output: level k averages 2^(k+1) square
+// pixels, each level from the one above, so every pixel of the output is
+// read once and the levels together cost a third of that. reduce() picks
+// the deepest level still at least as fine as the requested size and
+// resamples it bilinearly; the remaining reduction is under 2x, which the
+// bilinear footprint covers, so the result is an area average throughout.
+//
+// `full` is the output's (x, y, c) over [0, width) x [0, height); levels
+// and reductions are float in the same 0-255 units until reduce() rounds.
+class ExportPyramidBuilder {
+public:
+    static constexpr int kLevels = 8; // Down to 1/256.
+
+    std::vector<Halide::Func> levels;
+
+    ExportPyramidBuilder(Halide::Func full, Halide::Expr width, Halide::Expr height,
+                         Halide::Var x, Halide::Var y, Halide::Var c)
+        : full_(full), width_(width), height_(height), x_(x), y_(y), c_(c)
+    {
+        using namespace Halide;
+
+        Func src("export_level_full");
+        src(x, y, c) = cast<float>(full(x, y, c));
+        Expr w = width, h = height;
+        for (int k = 0; k < kLevels; k++) {
+            Func level("export_level_" + std::to_string(k + 1));
+            Expr x0 = clamp(2 * x, 0, w - 1), x1 = clamp(2 * x + 1, 0, w - 1);
+            Expr y0 = clamp(2 * y, 0, h - 1), y1 = clamp(2 * y + 1, 0, h - 1);
+            level(x, y, c) = (src(x0, y0, c) + src(x1, y0, c) + src(x0, y1, c) + src(x1, y1, c)) * 0.25f;
+            levels.push_back(level);
+            src = level;
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+    }
+
+    // The output at out_width x out_height, which must not be larger than
+    // the full output.
+    Halide::Func reduce(Halide::Expr out_width, Halide::Expr out_height, const std::string& name) {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+        Var x = x_, y = y_, c = c_;
+
+        Expr scale_x = cast<float>(width_) / out_width;
+        Expr scale_y = cast<float>(height_) / out_height;
+        Expr level = clamp(cast<int>(floor(log(min(scale_x, scale_y)) / float(M_LN2))), 0, kLevels);
+
+        Expr value = sample(full_, 0, scale_x, scale_y);
+        for (int k = 1; k <= kLevels; k++) {
+            value = select(level == k, sample(levels[k - 1], k, scale_x, scale_y), value);
+        }
+        Func reduced(name);
+        reduced(x, y, c) = u8_sat(value + 0.5f);
+        return reduced;
+    }
+
+private:
+    // Bilinear sample of pyramid level k at output pixel (x, y, c).
+    Halide::Expr sample(Halide::Func src, int k, Halide::Expr scale_x, Halide::Expr scale_y) {
+        using namespace Halide;
+        Expr w = width_, h = height_;
+        for (int i = 0; i < k; i++) {
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        const float step = float(1 << k);
+        Expr sx = (cast<float>(x_) + 0.5f) * scale_x / step - 0.5f;
+        Expr sy = (cast<float>(y_) + 0.5f) * scale_y / step - 0.5f;
+        Expr ix = cast<int>(floor(sx)), iy = cast<int>(floor(sy));
+        Expr fx = sx - ix, fy = sy - iy;
+        Expr x0 = clamp(ix, 0, w - 1), x1 = clamp(ix + 1, 0, w - 1);
+        Expr y0 = clamp(iy, 0, h - 1), y1 = clamp(iy + 1, 0, h - 1);
+        Expr f = cast<float>(src(x0, y0, c_)) * (1.0f - fx) + cast<float>(src(x1, y0, c_)) * fx;
+        Expr g = cast<float>(src(x0, y1, c_)) * (1.0f - fx) + cast<float>(src(x1, y1, c_)) * fx;
+        return f * (1.0f - fy) + g * fy;
+    }
+
+    Halide::Func full_;
+    Halide::Expr width_, height_;
+    Halide::Var x_, y_, c_;
+};
+
+#endif // STAGE_EXPORT_PYRAMID_H
@@ -0,0 +1,66 @@
+#ifndef STAGE_FIREBREAK_H
+#define STAGE_FIREBREAK_H
+
+#include "Halide.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Storage type of the full-frame compute_root buffers between phases of the
+// schedule (vignette_corrected, resampled). At 45 MP a
+// float32 RGB firebreak is ~540 MB written once and read back once, so
+// phase 2 is bandwidth bound; float16 or uint16 halve that traffic and the
+// peak memory, at 11 bits of mantissa or 14 bits over [0, 1] respectively.
+enum class FirebreakType { Float32, Float16, UInt16 };
+
+// The values GeneratorParam<FirebreakType> accepts.
+inline const std::map<std::string, FirebreakType>& firebreak_type_names() {
+    static const std::map<std::string, FirebreakType> names = {
+        {"float32", FirebreakType::Float32},
+        {"float16", FirebreakType::Float16},
+        {"uint16", FirebreakType::UInt16},
+    };
+    return names;
+}
+
+// Stores `input` as `type` for a firebreak, with the conversions fused into
+// the loops on either side: `stored` takes the schedule (compute_root; the
+// input is inlined into it, so its producers compute_at `stored`), and
+// `output` is the float view the consumers read, inlined into them. With
+// Float32 both are `input` itself.
+//
+// uint16 covers [0, 4) in steps of 1/16384: the linear values here go a
+// little past 1 in highlights before the tone curve, and negatives (out of
+// gamut after the colour matrix) clamp to 0.
+class FirebreakBuilder {
+public:
+    Halide::Func stored;
+    Halide::Func output;
+
+    static constexpr float kUInt16Scale = 16384.0f;
+
+    FirebreakBuilder(Halide::Func input, FirebreakType type, const std::string& name) {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        if (type == FirebreakType::Float32) {
+            stored = input;
+            output = input;
+            return;
+        }
+
+        std::vector<Var> args = input.args();
+        std::vector<Expr> coords(args.begin(), args.end());
+        stored = Func(name + "_stored");
+        output = Func(name + "_loaded");
+        if (type == FirebreakType::Float16) {
+            stored(args) = cast(Float(16), input(coords));
+            output(args) = cast<float>(stored(coords));
+        } else {
+            stored(args) = u16_sat(input(coords) * kUInt16Scale + 0.5f);
+            output(args) = cast<float>(stored(coords)) * (1.0f / kUInt16Scale);
+        }
+    }
+};
+
+#endif // STAGE_FIREBREAK_H
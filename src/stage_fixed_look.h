@@ -0,0 +1,98 @@
+#ifndef STAGE_FIXED_LOOK_H
+#define STAGE_FIXED_LOOK_H
+
+#include "Halide.h"
+#include "stage_dehaze.h"
+#include "stage_firebreak.h"
+#include <vector>
+
+// The u16 pipeline's look stages with the local adjustments at their
+// defaults, in fixed point: dehaze (DehazeBuilder's haze model) and the
+// baked look LUT (RgbLutBuilder) on 16-bit values, the LUT in 16 bits with
+// integer interpolation weights. Float is left where 16 bits fall short:
+// the scale by the haze transmission, which needs ~17 bits to keep the
+// near-black a*b* within a few hundredths, and the LUT's sqrt-shaped
+// lattice position. The transmission and the atmospheric light are
+// `dehaze`'s own; without one (nullptr) the look is applied undehazed.
+//
+// The input is the u16 colour-matrix output ([0, 1] as [0, 65535]); the
+// output is in FirebreakBuilder's uint16 units (1/16384, [0, 4)), so graded
+// colours a little out of gamut survive and negatives clamp to 0, as they
+// do at the conversion back to u16 ahead of sharpening.
+// test_fixed_look in src/tests bounds the difference from the float stages.
+class FixedPointLookBuilder {
+public:
+    static constexpr int kWeightBits = 12;  // Interpolation weights, Q12.
+    static constexpr float kOutScale = FirebreakBuilder::kUInt16Scale;
+
+    // Per pixel: dehaze's 1 / transmission, in [1, 10].
+    Halide::Func inv_transmission;
+    Halide::Func dehazed;
+    // The look LUT in output units, converted once per run, channel
+    // innermost like the input.
+    Halide::Func lut_q;
+    Halide::Var lut_r{"fixed_lut_r"}, lut_g{"fixed_lut_g"}, lut_b{"fixed_lut_b"}, lut_c{"fixed_lut_c"};
+    Halide::Func output;
+    Halide::Expr dehaze_bypassed;
+
+    FixedPointLookBuilder(Halide::Func input_u16, const DehazeBuilder* dehaze,
+                          Halide::Func lut, Halide::Expr lut_dim_extent,
+                          Halide::Var x, Halide::Var y, Halide::Var c)
+        : inv_transmission("fixed_inv_transmission"), dehazed("fixed_dehazed"),
+          lut_q("fixed_look_lut"), output("fixed_look")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        // --- Dehaze: J = A - (A - I) / t ---
+        if (dehaze) {
+            inv_transmission(x, y) = 1.0f / dehaze->transmission(x, y);
+            Expr a = dehaze->atmosphere(c) * 65535.0f;
+            Expr haze = a - cast<float>(input_u16(x, y, c));
+            dehaze_bypassed = dehaze->is_bypassed;
+            dehazed(x, y, c) = select(dehaze_bypassed, input_u16(x, y, c),
+                                      u16_sat(a + 0.5f - haze * inv_transmission(x, y)));
+        } else {
+            inv_transmission(x, y) = 1.0f;
+            dehaze_bypassed = const_true();
+            dehazed(x, y, c) = input_u16(x, y, c);
+        }
+
+        // --- Baked look LUT, tetrahedral, Q12 weights ---
+        lut_q(lut_r, lut_g, lut_b, lut_c) = u16_sat(lut(lut_r, lut_g, lut_b, lut_c) * kOutScale + 0.5f);
+        lut_q.reorder_storage(lut_c, lut_r, lut_g, lut_b);
+
+        const int one = 1 << kWeightBits;
+        std::vector<Expr> idx(3), frac(3);
+        for (int i = 0; i < 3; i++) {
+            Expr pos = sqrt(cast<float>(dehazed(x, y, i)) * (1.0f / 65535.0f)) * cast<float>(lut_dim_extent - 1);
+            idx[i] = clamp(cast<int>(pos), 0, lut_dim_extent - 2);
+            frac[i] = cast<int32_t>((pos - cast<float>(idx[i])) * one + 0.5f);
+        }
+        Expr f0 = frac[0], f1 = frac[1], f2 = frac[2];
+
+        // The same tetrahedron choice as ColorLutLookup::tetrahedral.
+        Expr ge01 = f0 >= f1, ge12 = f1 >= f2, ge02 = f0 >= f2;
+        Expr first0 = ge01 && ge02;
+        Expr first1 = !ge01 && ge12;
+        Expr first2 = !first0 && !first1;
+        Expr last0 = !ge01 && !ge02;
+        Expr last2 = ge02 && ge12;
+        Expr last1 = !last0 && !last2;
+
+        Expr hi = max(f0, f1, f2), lo = min(f0, f1, f2);
+        Expr mid = f0 + f1 + f2 - hi - lo;
+
+        auto tap = [&](Expr d0, Expr d1, Expr d2) {
+            return cast<int32_t>(lut_q(idx[0] + d0, idx[1] + d1, idx[2] + d2, c));
+        };
+        Expr v0 = tap(0, 0, 0);
+        Expr v1 = tap(select(first0, 1, 0), select(first1, 1, 0), select(first2, 1, 0));
+        Expr v2 = tap(select(last0, 0, 1), select(last1, 0, 1), select(last2, 0, 1));
+        Expr v3 = tap(1, 1, 1);
+        Expr sum = (one - hi) * v0 + (hi - mid) * v1 + (mid - lo) * v2 + lo * v3;
+        output(x, y, c) = u16((sum + (one >> 1)) >> kWeightBits);
+    }
+};
+
+#endif // STAGE_FIXED_LOOK_H
@@ -0,0 +1,59 @@
+#ifndef STAGE_HISTOGRAM_H
+#define STAGE_HISTOGRAM_H
+
+#include "Halide.h"
+#include "pipeline_helpers.h"
+
+// 256-bin R, G, B and luma histograms of an 8-bit RGB image over the region
+// [x_min, x_min + width) x [y_min, y_min + height). Each strip of
+// `strip_rows` rows gets its own partial histogram, so the strips can be
+// counted in parallel; an RDom over the strips then merges them.
+class HistogramBuilder {
+public:
+    Halide::Func partial; // (bin, channel, strip)
+    Halide::Func output;  // (bin, channel); channels 0-2 are R, G, B and 3 is luma.
+    Halide::Var bin, ch, strip;
+    Halide::RDom r_pixels, r_strips;
+
+    static constexpr int kBins = 256;
+    static constexpr int kChannels = 4;
+
+    HistogramBuilder(Halide::Func image,
+                     Halide::Expr x_min, Halide::Expr width,
+                     Halide::Expr y_min, Halide::Expr height,
+                     int strip_rows = 32)
+        : partial("histogram_partial"), output("histogram"),
+          bin("hist_bin"), ch("hist_ch"), strip("hist_strip")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        Expr strips = (height + strip_rows - 1) / strip_rows;
+
+        // r_pixels.z picks the channel, so one pass over a strip's pixels
+        // updates all four histograms.
+        r_pixels = RDom(0, width, 0, strip_rows, 0, kChannels, "hist_pixels");
+        Expr px = x_min + r_pixels.x;
+        Expr py = y_min + strip * strip_rows + r_pixels.y;
+        r_pixels.where(py < y_min + height);
+
+        Expr R = u32(image(px, py, 0));
+        Expr G = u32(image(px, py, 1));
+        Expr B = u32(image(px, py, 2));
+        // Rec.601 luma in 16-bit fixed point, truncated.
+        Expr luma = (19595 * R + 38470 * G + 7471 * B) >> 16;
+        Expr value = select(r_pixels.z == 0, R,
+                            r_pixels.z == 1, G,
+                            r_pixels.z == 2, B,
+                            luma);
+
+        partial(bin, ch, strip) = u32(0);
+        partial(clamp(i32(value), 0, kBins - 1), r_pixels.z, strip) += u32(1);
+
+        r_strips = RDom(0, strips, "hist_strips");
+        output(bin, ch) = u32(0);
+        output(bin, ch) += partial(bin, ch, r_strips);
+    }
+};
+
+#endif // STAGE_HISTOGRAM_H
@@ -9,6 +9,180 @@
 // #define LENS_NO_GEO
 // #define LENS_NO_CA
 
+// Where an output pixel of the lens & geometry stage samples its input: the
+// (green) source position, and the factors the red and blue sources are
+// scaled by about the centre for lateral CA: the lens profile's TCA
+// (tca_lut, red and blue scale over the distorted radius squared, indexed as
+// the distortion LUT is; one entry for none) times the manual terms.
+struct LensWarpSource {
+    Halide::Expr x, y;
+    Halide::Expr r_scale, b_scale;
+};
+
+// The inverse mapping from output pixel (x, y) to its source. Shared by
+// LensGeometryBuilder and WarpMapBuilder; the host mirror used to bound its
+// footprint is PipelineUtils::LensCorrection::warp_source_rows.
+inline LensWarpSource lens_warp_source(Halide::Expr x, Halide::Expr y,
+                                       Halide::Expr out_width, Halide::Expr out_height,
+                                       Halide::Func distortion_lut, Halide::Expr lut_width,
+                                       Halide::Func tca_lut, Halide::Expr tca_lut_width,
+                                       Halide::Expr ca_red_cyan, Halide::Expr ca_blue_yellow,
+                                       Halide::Expr geo_rotate, Halide::Expr geo_scale, Halide::Expr geo_aspect,
+                                       Halide::Expr geo_keystone_v, Halide::Expr geo_keystone_h,
+                                       Halide::Expr geo_offset_x, Halide::Expr geo_offset_y)
+{
+    using namespace Halide;
+
+    // --- 1. Define the chain of inverse transformations ---
+    // We start with the output coordinates of the final resampled image
+    // and work backwards to find the corresponding source pixel in the input.
+
+    Expr current_x = x;
+    Expr current_y = y;
+
+    // Center coordinates for transformations that are origin-dependent.
+    Expr center_x = (cast<float>(out_width) - 1.0f) / 2.0f;
+    Expr center_y = (cast<float>(out_height) - 1.0f) / 2.0f;
+
+    #ifndef LENS_NO_GEO
+    {
+        // Translate to center for rotation/scale/keystone
+        current_x -= center_x;
+        current_y -= center_y;
+
+        // 1. Inverse Rotation
+        Expr angle_rad = geo_rotate * (float)(M_PI / 180.0f);
+        Expr cos_a = cos(-angle_rad);
+        Expr sin_a = sin(-angle_rad);
+        Expr rot_x = current_x * cos_a - current_y * sin_a;
+        Expr rot_y = current_x * sin_a + current_y * cos_a;
+        current_x = rot_x;
+        current_y = rot_y;
+
+        // 2. Inverse Keystone (Perspective)
+        Expr kv = geo_keystone_v / 100.f;
+        Expr kh = geo_keystone_h / 100.f;
+        Expr denom = 1.f - kv * current_y / center_y - kh * current_x / center_x;
+        denom = select(denom > 1e-4f, denom, 1e-4f);
+        current_x = current_x / denom;
+        current_y = current_y / denom;
+
+        // 3. Inverse Scale & Aspect
+        Expr inv_scale = 100.f / geo_scale;
+        current_x *= inv_scale * geo_aspect;
+        current_y *= inv_scale;
+
+        // Translate back from center and apply inverse offset
+        current_x += center_x - geo_offset_x;
+        current_y += center_y - geo_offset_y;
+    }
+    #endif
+
+    #ifndef LENS_NO_DISTORT
+    {
+        // --- Inverse mapping using the pre-computed LUT ---
+        // The LUT maps distorted radius squared (rd^2) to the correction
+        // factor (ru / rd).
+
+        // Coordinates relative to the center. This is our distorted vector.
+        Expr norm_distort_x = (current_x - center_x);
+        Expr norm_distort_y = (current_y - center_y);
+
+        // Per lensfun documentation, radius is normalized to the half-diagonal.
+        Expr half_diag_sq = (cast<float>(out_width) * out_width + cast<float>(out_height) * out_height) / 4.0f;
+
+        // Calculate distorted radius squared (rd^2) and its normalized version.
+        Expr rd_sq = norm_distort_x*norm_distort_x + norm_distort_y*norm_distort_y;
+        Expr rd_sq_norm = rd_sq / half_diag_sq;
+
+        // Use normalized rd^2 to look up the correction factor in the LUT.
+        // This requires knowing the MAX_RD_SQUARED_NORM used to generate the LUT.
+        const float MAX_RD_SQUARED_NORM = 3.0f;
+        Expr lut_width_f = cast<float>(lut_width);
+        Expr lut_f_index = rd_sq_norm * (lut_width_f - 1.0f) / MAX_RD_SQUARED_NORM;
+
+        // Perform linear interpolation.
+        Expr lut_i_index = cast<int>(floor(lut_f_index));
+        Expr frac = lut_f_index - lut_i_index;
+
+        // Clamp indices to be safely within the LUT bounds.
+        Expr idx0 = clamp(lut_i_index, 0, lut_width - 2);
+        Expr idx1 = idx0 + 1;
+
+        Expr factor1 = distortion_lut(idx0);
+        Expr factor2 = distortion_lut(idx1);
+        Expr correction_factor = lerp(factor1, factor2, frac);
+
+        // Apply correction by scaling the distorted vector.
+        // This gives us the undistorted vector.
+        current_x = center_x + norm_distort_x * correction_factor;
+        current_y = center_y + norm_distort_y * correction_factor;
+    }
+    #endif
+
+    Expr r_scale = 1.0f, b_scale = 1.0f;
+    #ifndef LENS_NO_CA
+    {
+        const float ca_scale = 2e-5f;
+        Expr max_radius_sq = max(center_x, center_y) * max(center_x, center_y);
+        Expr rd_sq = ((current_x - center_x)*(current_x - center_x) + (current_y - center_y)*(current_y - center_y));
+        Expr r2_ca = rd_sq / max_radius_sq; // Normalize for consistent feel
+        r_scale = 1.f + ca_red_cyan * ca_scale * r2_ca;
+        b_scale = 1.f + ca_blue_yellow * ca_scale * r2_ca;
+
+        // The profile's scales, read linearly like the distortion LUT.
+        const float MAX_RD_SQUARED_NORM = 3.0f;
+        Expr half_diag_sq = (cast<float>(out_width) * out_width + cast<float>(out_height) * out_height) / 4.0f;
+        Expr tca_f = rd_sq / half_diag_sq * (cast<float>(tca_lut_width) - 1.0f) / MAX_RD_SQUARED_NORM;
+        Expr tca_i = clamp(cast<int>(floor(tca_f)), 0, max(tca_lut_width - 2, 0));
+        Expr tca_frac = tca_f - tca_i;
+        Expr tca_next = min(tca_i + 1, tca_lut_width - 1);
+        Expr tca_r = lerp(tca_lut(tca_i, 0), tca_lut(tca_next, 0), tca_frac);
+        Expr tca_b = lerp(tca_lut(tca_i, 1), tca_lut(tca_next, 1), tca_frac);
+        r_scale *= select(tca_lut_width <= 1, 1.0f, tca_r);
+        b_scale *= select(tca_lut_width <= 1, 1.0f, tca_b);
+    }
+    #endif
+
+    return {current_x, current_y, r_scale, b_scale};
+}
+
+// The mapping above as a map: output(x, y, k) holds the source x and y
+// (k = 0, 1) and the red and blue CA scales (k = 2, 3) of output pixel
+// (x, y). It only depends on the geometry, the lens and the frame size, so
+// the editor builds it once (camera_pipe_warp_map) and its back end then only
+// gathers, instead of redoing the trig, keystone division and LUT lookup per
+// pixel and channel on every render. Kept as float32: absolute source
+// positions of a large frame need more mantissa than float16 has.
+class WarpMapBuilder {
+public:
+    static constexpr int kPlanes = 4;
+
+    Halide::Func source;
+    Halide::Func output;
+
+    WarpMapBuilder(Halide::Var x, Halide::Var y, Halide::Var k,
+                   Halide::Expr out_width, Halide::Expr out_height,
+                   Halide::Func distortion_lut, Halide::Expr lut_width,
+                   Halide::Func tca_lut, Halide::Expr tca_lut_width,
+                   Halide::Expr ca_red_cyan, Halide::Expr ca_blue_yellow,
+                   Halide::Expr geo_rotate, Halide::Expr geo_scale, Halide::Expr geo_aspect,
+                   Halide::Expr geo_keystone_v, Halide::Expr geo_keystone_h,
+                   Halide::Expr geo_offset_x, Halide::Expr geo_offset_y)
+        : source("warp_source"), output("warp_map")
+    {
+        using namespace Halide;
+        LensWarpSource s = lens_warp_source(cast<float>(x), cast<float>(y), out_width, out_height,
+                                            distortion_lut, lut_width, tca_lut, tca_lut_width,
+                                            ca_red_cyan, ca_blue_yellow,
+                                            geo_rotate, geo_scale, geo_aspect,
+                                            geo_keystone_v, geo_keystone_h, geo_offset_x, geo_offset_y);
+        // One tuple per pixel, so the planes share the mapping's arithmetic.
+        source(x, y) = Tuple(s.x, s.y, s.r_scale, s.b_scale);
+        output(x, y, k) = mux(k, {source(x, y)[0], source(x, y)[1], source(x, y)[2], source(x, y)[3]});
+    }
+};
+
 class LensGeometryBuilder {
 public:
     Halide::Func output;
@@ -17,126 +191,60 @@ public:
                         Halide::Var x, Halide::Var y, Halide::Var c,
                         Halide::Expr out_width, Halide::Expr out_height,
                         Halide::Func distortion_lut, Halide::Expr lut_width,
+                        Halide::Func tca_lut, Halide::Expr tca_lut_width,
                         Halide::Expr ca_red_cyan, Halide::Expr ca_blue_yellow,
                         Halide::Expr geo_rotate, Halide::Expr geo_scale, Halide::Expr geo_aspect,
                         Halide::Expr geo_keystone_v, Halide::Expr geo_keystone_h,
-                        Halide::Expr geo_offset_x, Halide::Expr geo_offset_y
+                        Halide::Expr geo_offset_x, Halide::Expr geo_offset_y,
+                        Halide::Expr src_row_min = Halide::Expr(), Halide::Expr src_row_max = Halide::Expr(),
+                        Halide::Expr src_row_reach = Halide::Expr(),
+                        Halide::Expr src_col_min = Halide::Expr(), Halide::Expr src_col_max = Halide::Expr()
                         )
         : output("resampled_srgb")
     {
         using namespace Halide;
-        using namespace Halide::ConciseCasts;
+        LensWarpSource src = lens_warp_source(cast<float>(x), cast<float>(y), out_width, out_height,
+                                              distortion_lut, lut_width, tca_lut, tca_lut_width,
+                                              ca_red_cyan, ca_blue_yellow,
+                                              geo_rotate, geo_scale, geo_aspect,
+                                              geo_keystone_v, geo_keystone_h, geo_offset_x, geo_offset_y);
+        sample(input_srgb, x, y, c, out_width, out_height, src, src_row_min, src_row_max, src_row_reach,
+               src_col_min, src_col_max);
+    }
 
-        // --- 1. Define the chain of inverse transformations ---
-        // We start with the output coordinates of the final resampled image
-        // and work backwards to find the corresponding source pixel in the input.
+    // Gathers through a precomputed WarpMapBuilder map covering the output.
+    LensGeometryBuilder(Halide::Func input_srgb,
+                        Halide::Var x, Halide::Var y, Halide::Var c,
+                        Halide::Expr out_width, Halide::Expr out_height,
+                        Halide::Func warp_map)
+        : output("resampled_srgb")
+    {
+        LensWarpSource src = {warp_map(x, y, 0), warp_map(x, y, 1), warp_map(x, y, 2), warp_map(x, y, 3)};
+        sample(input_srgb, x, y, c, out_width, out_height, src, Halide::Expr(), Halide::Expr(), Halide::Expr());
+    }
 
-        Expr current_x = cast<float>(x);
-        Expr current_y = cast<float>(y);
+private:
+    void sample(Halide::Func input_srgb, Halide::Var x, Halide::Var y, Halide::Var c,
+                Halide::Expr out_width, Halide::Expr out_height, const LensWarpSource& src,
+                Halide::Expr src_row_min, Halide::Expr src_row_max, Halide::Expr src_row_reach,
+                Halide::Expr src_col_min = Halide::Expr(), Halide::Expr src_col_max = Halide::Expr())
+    {
+        using namespace Halide;
 
-        // Center coordinates for transformations that are origin-dependent.
+        // --- 2. Sample the input image with manual boundary checking and bilinear interpolation ---
         Expr center_x = (cast<float>(out_width) - 1.0f) / 2.0f;
         Expr center_y = (cast<float>(out_height) - 1.0f) / 2.0f;
-
-        #ifndef LENS_NO_GEO
-        {
-            // Translate to center for rotation/scale/keystone
-            current_x -= center_x;
-            current_y -= center_y;
-
-            // 1. Inverse Rotation
-            Expr angle_rad = geo_rotate * (float)(M_PI / 180.0f);
-            Expr cos_a = cos(-angle_rad);
-            Expr sin_a = sin(-angle_rad);
-            Expr rot_x = current_x * cos_a - current_y * sin_a;
-            Expr rot_y = current_x * sin_a + current_y * cos_a;
-            current_x = rot_x;
-            current_y = rot_y;
-
-            // 2. Inverse Keystone (Perspective)
-            Expr kv = geo_keystone_v / 100.f;
-            Expr kh = geo_keystone_h / 100.f;
-            Expr denom = 1.f - kv * current_y / center_y - kh * current_x / center_x;
-            denom = select(denom > 1e-4f, denom, 1e-4f);
-            current_x = current_x / denom;
-            current_y = current_y / denom;
-
-            // 3. Inverse Scale & Aspect
-            Expr inv_scale = 100.f / geo_scale;
-            current_x *= inv_scale * geo_aspect;
-            current_y *= inv_scale;
-
-            // Translate back from center and apply inverse offset
-            current_x += center_x - geo_offset_x;
-            current_y += center_y - geo_offset_y;
-        }
-        #endif
-
-        #ifndef LENS_NO_DISTORT
-        {
-            // --- Inverse mapping using the pre-computed LUT ---
-            // The LUT maps distorted radius squared (rd^2) to the correction
-            // factor (ru / rd).
-
-            // Coordinates relative to the center. This is our distorted vector.
-            Expr norm_distort_x = (current_x - center_x);
-            Expr norm_distort_y = (current_y - center_y);
-
-            // Per lensfun documentation, radius is normalized to the half-diagonal.
-            Expr half_diag_sq = (cast<float>(out_width) * out_width + cast<float>(out_height) * out_height) / 4.0f;
-
-            // Calculate distorted radius squared (rd^2) and its normalized version.
-            Expr rd_sq = norm_distort_x*norm_distort_x + norm_distort_y*norm_distort_y;
-            Expr rd_sq_norm = rd_sq / half_diag_sq;
-
-            // Use normalized rd^2 to look up the correction factor in the LUT.
-            // This requires knowing the MAX_RD_SQUARED_NORM used to generate the LUT.
-            const float MAX_RD_SQUARED_NORM = 3.0f;
-            Expr lut_width_f = cast<float>(lut_width);
-            Expr lut_f_index = rd_sq_norm * (lut_width_f - 1.0f) / MAX_RD_SQUARED_NORM;
-
-            // Perform linear interpolation.
-            Expr lut_i_index = cast<int>(floor(lut_f_index));
-            Expr frac = lut_f_index - lut_i_index;
-
-            // Clamp indices to be safely within the LUT bounds.
-            Expr idx0 = clamp(lut_i_index, 0, lut_width - 2);
-            Expr idx1 = idx0 + 1;
-
-            Expr factor1 = distortion_lut(idx0);
-            Expr factor2 = distortion_lut(idx1);
-            Expr correction_factor = lerp(factor1, factor2, frac);
-
-            // Apply correction by scaling the distorted vector.
-            // This gives us the undistorted vector.
-            current_x = center_x + norm_distort_x * correction_factor;
-            current_y = center_y + norm_distort_y * correction_factor;
-        }
-        #endif
-
+        Expr final_src_x = src.x;
+        Expr final_src_y = src.y;
         #ifndef LENS_NO_CA
         {
-            const float ca_scale = 2e-5f;
-            Expr max_radius_sq = max(center_x, center_y) * max(center_x, center_y);
-            Expr r2_ca = ((current_x - center_x)*(current_x - center_x) + (current_y - center_y)*(current_y - center_y));
-            r2_ca = r2_ca / max_radius_sq; // Normalize for consistent feel
-            Expr r_scale = 1.f + ca_red_cyan * ca_scale * r2_ca;
-            Expr b_scale = 1.f + ca_blue_yellow * ca_scale * r2_ca;
-
-            Expr src_x_r = center_x + (current_x - center_x) * r_scale;
-            Expr src_y_r = center_y + (current_y - center_y) * r_scale;
-            Expr src_x_b = center_x + (current_x - center_x) * b_scale;
-            Expr src_y_b = center_y + (current_y - center_y) * b_scale;
-
-            current_x = select(c == 0, src_x_r, c == 2, src_x_b, current_x);
-            current_y = select(c == 0, src_y_r, c == 2, src_y_b, current_y);
+            // Red and blue sample along the same radius, scaled about the centre.
+            Expr dx = src.x - center_x, dy = src.y - center_y;
+            final_src_x = select(c == 0, center_x + dx * src.r_scale, c == 2, center_x + dx * src.b_scale, src.x);
+            final_src_y = select(c == 0, center_y + dy * src.r_scale, c == 2, center_y + dy * src.b_scale, src.y);
         }
         #endif
 
-        // --- 2. Sample the input image with manual boundary checking and bilinear interpolation ---
-        Expr final_src_x = current_x;
-        Expr final_src_y = current_y;
-
         Expr src_min_x = 0.0f, src_max_x = cast<float>(out_width) - 1.0f;
         Expr src_min_y = 0.0f, src_max_y = cast<float>(out_height) - 1.0f;
 
@@ -150,6 +258,26 @@ public:
         Expr fx = final_src_x - ix;
         Expr fy = final_src_y - iy;
 
+        // The source coordinates are data dependent, so bounds inference
+        // would otherwise ask for every row of the input. Callers rendering
+        // the output in bands pass the (inclusive) range of rows the band can
+        // reach, computed on the host, so only those are produced upstream.
+        if (src_row_min.defined() && src_row_max.defined()) {
+            iy = clamp(iy, src_row_min, max(src_row_min, src_row_max - 1));
+        }
+        // Likewise `src_row_reach`, the furthest any output row reads from
+        // its own row (see PipelineUtils::LensCorrection::warp_row_reach),
+        // bounds the footprint per output row. That makes it affine in y, so
+        // the input can be computed strip by strip inside the output's loop
+        // instead of as a full-frame buffer.
+        if (src_row_reach.defined()) {
+            iy = clamp(iy, y - src_row_reach, y + max(src_row_reach - 1, 0));
+        }
+        // And the columns, for renders of a crop narrower than the frame.
+        if (src_col_min.defined() && src_col_max.defined()) {
+            ix = clamp(ix, src_col_min, max(src_col_min, src_col_max - 1));
+        }
+
         Expr v00 = safe_input(ix,     iy,     c);
         Expr v10 = safe_input(ix + 1, iy,     c);
         Expr v01 = safe_input(ix,     iy + 1, c);
@@ -163,4 +291,3 @@ public:
 };
 
 #endif // STAGE_LENS_GEOMETRY_H
-
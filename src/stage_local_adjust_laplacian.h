@@ -4,13 +4,13 @@
 #include "Halide.h"
 #include "pipeline_helpers.h"
 #include "stage_resize.h"
-#include "stage_deinterleave.h"
-#include "stage_bayer_normalize.h"
 #include "color_tools.h"
 #include <vector>
 #include <string>
 #include <type_traits>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
 
 // To debug this stage, define this macro during compilation.
 // This will bypass the pyramid logic and only perform the color space conversions.
@@ -21,21 +21,28 @@ class LocalLaplacianBuilder {
 private:
     // Self-contained, safe pyramid helpers. They explicitly use boundary
     // conditions to handle small images and allow for pyramid levels that are
-    // smaller than the filter kernels.
+    // smaller than the filter kernels. `rest` are extra, unfiltered
+    // dimensions after x and y (the fast mode's intensity samples).
     static void downsample(Halide::Func f_in, Halide::Expr w_in, Halide::Expr h_in,
                            const std::string& name_prefix,
-                           Halide::Func &f_out, std::vector<Halide::Func> &intermediates) {
+                           Halide::Func &f_out, std::vector<Halide::Func> &intermediates,
+                           const std::vector<Halide::Var>& rest = {}) {
         using namespace Halide;
         Func bounded_in = BoundaryConditions::repeat_edge(f_in, {{Expr(0), w_in}, {Expr(0), h_in}});
 
         Func downx(name_prefix + "_downx"), downy(name_prefix + "_downy");
         Var x, y;
+        auto at = [&](Expr xx, Expr yy) {
+            std::vector<Expr> v = {xx, yy};
+            v.insert(v.end(), rest.begin(), rest.end());
+            return v;
+        };
 
-        downx(x, y) = (bounded_in(2*x - 1, y) + 3.f*bounded_in(2*x, y) + 3.f*bounded_in(2*x + 1, y) + bounded_in(2*x + 2, y)) / 8.f;
+        downx(at(x, y)) = (bounded_in(at(2*x - 1, y)) + 3.f*bounded_in(at(2*x, y)) + 3.f*bounded_in(at(2*x + 1, y)) + bounded_in(at(2*x + 2, y))) / 8.f;
         Expr w_out = (w_in + 1) / 2;
         Func bounded_downx = BoundaryConditions::repeat_edge(downx, {{Expr(0), w_out}, {Expr(0), h_in}});
 
-        downy(x, y) = (bounded_downx(x, 2*y - 1) + 3.f*bounded_downx(x, 2*y) + 3.f*bounded_downx(x, 2*y + 1) + bounded_downx(x, 2*y + 2)) / 8.f;
+        downy(at(x, y)) = (bounded_downx(at(x, 2*y - 1)) + 3.f*bounded_downx(at(x, 2*y)) + 3.f*bounded_downx(at(x, 2*y + 1)) + bounded_downx(at(x, 2*y + 2))) / 8.f;
 
         f_out = downy;
         intermediates.push_back(downx);
@@ -43,21 +50,27 @@ private:
 
     static void upsample(Halide::Func f_in, Halide::Expr w_in, Halide::Expr h_in, Halide::Expr w_out, Halide::Expr h_out,
                          const std::string& name_prefix,
-                         Halide::Func &f_out, std::vector<Halide::Func> &intermediates) {
+                         Halide::Func &f_out, std::vector<Halide::Func> &intermediates,
+                         const std::vector<Halide::Var>& rest = {}) {
         using namespace Halide;
         Func bounded_in = BoundaryConditions::repeat_edge(f_in, {{Expr(0), w_in}, {Expr(0), h_in}});
 
         Func upx(name_prefix + "_upx"), upy(name_prefix + "_upy");
         Var x, y;
+        auto at = [&](Expr xx, Expr yy) {
+            std::vector<Expr> v = {xx, yy};
+            v.insert(v.end(), rest.begin(), rest.end());
+            return v;
+        };
 
         Expr xf = (cast<float>(x) / 2.0f) - 0.25f;
         Expr xi = cast<int>(floor(xf));
-        upx(x, y) = lerp(bounded_in(xi, y), bounded_in(xi + 1, y), xf - xi);
+        upx(at(x, y)) = lerp(bounded_in(at(xi, y)), bounded_in(at(xi + 1, y)), xf - xi);
         Func bounded_upx = BoundaryConditions::repeat_edge(upx, {{Expr(0), w_out}, {Expr(0), h_in}});
 
         Expr yf = (cast<float>(y) / 2.0f) - 0.25f;
         Expr yi = cast<int>(floor(yf));
-        upy(x, y) = lerp(bounded_upx(x, yi), bounded_upx(x, yi + 1), yf - yi);
+        upy(at(x, y)) = lerp(bounded_upx(at(x, yi)), bounded_upx(at(x, yi + 1)), yf - yi);
 
         f_out = upy;
         intermediates.push_back(upx);
@@ -66,33 +79,57 @@ private:
 public:
     Halide::Func output;
     std::vector<Halide::Func> gPyramid, inLPyramid, outLPyramid;
-    std::vector<std::vector<Halide::Func>> reconstructedGPyramid; // For dynamic reconstruction
+    std::vector<Halide::Func> reconstructedGPyramid; // Single reconstruction chain, seeded at j_sh
+    Halide::Expr j_sh; // Reconstruction seed level, derived from the image size
     std::vector<Halide::Func> low_fi_intermediates, high_fi_intermediates, high_freq_pyramid_helpers, low_freq_pyramid_helpers, reconstruction_intermediates;
     Halide::Func remap_lut;
-    std::unique_ptr<ResizeBicubicBuilder> lowfi_resize_builder;
+    // The splice level of the low-fi path, and the downsamples from the
+    // low-fi image to it. The schedule materializes it once per run (it is
+    // 1/2^cutover_level of the output), rather than per strip.
+    Halide::Func lowfi_spliced;
+    std::vector<Halide::Func> lowfi_downsample_helpers;
+    std::unique_ptr<ResizeBuilder> lowfi_resize_builder;
+    // True when every slider is at 0, so `output` passes L through and the
+    // pyramid isn't needed (see schedule_look_stages).
+    Halide::Expr is_default;
     const int pyramid_levels;
-
+    // Fast mode (fast_levels > 0): the detail signal remapped around each of
+    // `fast_levels` intensity samples (fast_k), as Gaussian and Laplacian
+    // pyramids over (x, y, fast_k), for the levels the detail and clarity
+    // gains touch. Empty otherwise.
+    const int fast_levels;
+    Halide::Var fast_k{"ll_fast_k"};
+    std::vector<Halide::Func> fastGPyramid, fastLPyramid;
+
+    // `lowfi_sensor_rgb` is the low-fi path's input: white-balanced camera
+    // RGB at half the raw resolution (`lowfi_width` x `lowfi_height`), one
+    // pixel per 2x2 CFA block, which the caller derives from data the main
+    // path has already materialized. It goes through `cc_matrix`, the
+    // output downscale and LCh here. Unused when cutover_level is 0.
     LocalLaplacianBuilder(Halide::Func input_lch,
-                           Halide::Func raw_input,
+                           Halide::Func lowfi_sensor_rgb,
                            Halide::Func cc_matrix,
-                           Halide::Expr cfa_pattern,
-                           Halide::Expr wb_r_gain, Halide::Expr wb_g_gain, Halide::Expr wb_b_gain, Halide::Expr green_balance, Halide::Expr exposure_multiplier,
                            Halide::Var x, Halide::Var y, Halide::Var c,
                            Halide::Expr detail_sharpen, Halide::Expr clarity,
                            Halide::Expr shadows, Halide::Expr highlights,
                            Halide::Expr blacks, Halide::Expr whites,
                            Halide::Expr debug_level,
-                           Halide::Expr blackLevel, Halide::Expr whiteLevel,
                            Halide::Expr width, Halide::Expr height,
-                           Halide::Expr raw_width, Halide::Expr raw_height,
+                           Halide::Expr lowfi_width, Halide::Expr lowfi_height,
                            Halide::Expr downscale_factor,
-                           int J = 8, int cutover_level = 4)
+                           int J = 8, int cutover_level = 4,
+                           int fast_levels_in = 0)
         : output("lch_local_adjusted"),
           gPyramid(J), inLPyramid(J), outLPyramid(J),
-          reconstructedGPyramid(J, std::vector<Halide::Func>(J)),
+          reconstructedGPyramid(J),
+          lowfi_spliced("lowfi_spliced_L"),
           lowfi_resize_builder(nullptr),
-          pyramid_levels(J)
+          pyramid_levels(J),
+          fast_levels(fast_levels_in)
     {
+        if (fast_levels == 1 || fast_levels < 0) {
+            throw std::runtime_error("LocalLaplacianBuilder: fast_levels must be 0 (off) or at least 2");
+        }
         using namespace Halide;
         using namespace Halide::ConciseCasts;
 
@@ -107,35 +144,11 @@ public:
         high_fi_intermediates = {L_in, C_in, h_in, L_norm_hifi};
 
         // --- PATH 2: Low-Fidelity Path ---
-        Func lowfi_spliced_L("lowfi_spliced_L");
+        Func& lowfi_spliced_L = lowfi_spliced;
         {
             Var hx("hx"), hy("hy"); // Use distinct Var names
-            // 1. Replicate the main pipeline's initial normalization and exposure step.
-            Func linear_exposed_lowfi("linear_exposed_lowfi");
-            Expr inv_range = 1.0f / (cast<float>(whiteLevel) - cast<float>(blackLevel));
-            linear_exposed_lowfi(hx, hy) = (cast<float>(raw_input(hx, hy)) - cast<float>(blackLevel)) * inv_range * exposure_multiplier;
-            low_fi_intermediates.push_back(linear_exposed_lowfi);
-
-            // 2. Replicate the main pipeline's white balancing step.
-            BayerNormalizeBuilder normalize_builder_lowfi(linear_exposed_lowfi, cfa_pattern, green_balance, wb_r_gain, wb_g_gain, wb_b_gain, hx, hy);
-            Func normalized_bayer_lowfi = normalize_builder_lowfi.output;
-            low_fi_intermediates.push_back(normalized_bayer_lowfi);
-
-            // 3. Deinterleave the now-canonical GRBG bayer data.
-            Func deinterleaved_lowfi = pipeline_deinterleave(normalized_bayer_lowfi, hx, hy, c);
-            low_fi_intermediates.push_back(deinterleaved_lowfi);
-            
-            // 4. Perform a cheap demosaic.
-            Func rgb_lowfi_sensor("rgb_lowfi_sensor");
-            rgb_lowfi_sensor(hx,hy,c) = mux(c,{
-                deinterleaved_lowfi(hx,hy,1),
-                avg(deinterleaved_lowfi(hx,hy,0), deinterleaved_lowfi(hx,hy,3)),
-                deinterleaved_lowfi(hx,hy,2)
-            });
-            low_fi_intermediates.push_back(rgb_lowfi_sensor);
-
-            // 5. Apply the color matrix.
-            Expr ir_sensor = rgb_lowfi_sensor(hx,hy,0), ig_sensor = rgb_lowfi_sensor(hx,hy,1), ib_sensor = rgb_lowfi_sensor(hx,hy,2);
+            // 1. Apply the color matrix to the caller's half-res camera RGB.
+            Expr ir_sensor = lowfi_sensor_rgb(hx,hy,0), ig_sensor = lowfi_sensor_rgb(hx,hy,1), ib_sensor = lowfi_sensor_rgb(hx,hy,2);
             Expr r_f_sensor = cc_matrix(3, 0) + cc_matrix(0, 0) * ir_sensor + cc_matrix(1, 0) * ig_sensor + cc_matrix(2, 0) * ib_sensor;
             Expr g_f_sensor = cc_matrix(3, 1) + cc_matrix(0, 1) * ir_sensor + cc_matrix(1, 1) * ig_sensor + cc_matrix(2, 1) * ib_sensor;
             Expr b_f_sensor = cc_matrix(3, 2) + cc_matrix(0, 2) * ir_sensor + cc_matrix(1, 2) * ig_sensor + cc_matrix(2, 2) * ib_sensor;
@@ -144,18 +157,21 @@ public:
             corrected_lowfi_norm(hx,hy,c) = clamp(mux(c, {r_f_sensor, g_f_sensor, b_f_sensor}), 0.0f, 1.0f);
             low_fi_intermediates.push_back(corrected_lowfi_norm);
 
-            // 6. Optional downscaling to match the main pipeline's output resolution.
+            // 2. Optional downscaling to match the main pipeline's output resolution.
             Func lowfi_rgb_maybe_downscaled("lowfi_rgb_maybe_downscaled");
             Expr is_no_op = abs(downscale_factor - 1.0f) < 1e-6f;
-            Expr lowfi_w = raw_width / 2, lowfi_h = raw_height / 2;
+            Expr lowfi_w = lowfi_width, lowfi_h = lowfi_height;
             Expr lowfi_down_w = cast<int>(lowfi_w / downscale_factor), lowfi_down_h = cast<int>(lowfi_h / downscale_factor);
-            lowfi_resize_builder = std::make_unique<ResizeBicubicBuilder>(corrected_lowfi_norm, "lowfi_resize", lowfi_w, lowfi_h, lowfi_down_w, lowfi_down_h, hx, hy, c);
+            // An area average: it only feeds the coarse levels, and it is
+            // exact and cheap at the editor's 2x and 4x preview scales.
+            lowfi_resize_builder = std::make_unique<ResizeBuilder>(corrected_lowfi_norm, "lowfi_resize", lowfi_w, lowfi_h, lowfi_down_w, lowfi_down_h, hx, hy, c,
+                                                                   ResizeBuilder::Kernel::AREA);
             low_fi_intermediates.push_back(lowfi_resize_builder->output);
             lowfi_rgb_maybe_downscaled(hx, hy, c) = select(is_no_op, corrected_lowfi_norm(hx, hy, c), lowfi_resize_builder->output(hx, hy, c));
 
             Expr current_w = select(is_no_op, lowfi_w, lowfi_down_w), current_h = select(is_no_op, lowfi_h, lowfi_down_h);
 
-            // 7. Convert the now-correct sRGB image to LCH to get the luminance signal.
+            // 3. Convert the now-correct sRGB image to LCH to get the luminance signal.
             Var dx("dx_lf"), dy("dy_lf"), dc("dc_lf");
             Func lch_lowfi = HalideColor::linear_srgb_to_lch(lowfi_rgb_maybe_downscaled, dx, dy, dc);
             low_fi_intermediates.push_back(lch_lowfi);
@@ -163,18 +179,17 @@ public:
             Func L_lowfi("L_lowfi");
             L_lowfi(dx, dy) = lch_lowfi(dx, dy, 0);
 
-            // 8. Downsample the L channel to the splice level for the pyramid.
+            // 4. Downsample the L channel to the splice level for the pyramid.
             Func L_lowfi_downsampled = L_lowfi;
             for (int j = 1; j < cutover_level; j++) {
                 Func prev = L_lowfi_downsampled;
-                downsample(prev, current_w, current_h, "lowfi_L_ds_"+std::to_string(j), L_lowfi_downsampled, low_freq_pyramid_helpers);
+                downsample(prev, current_w, current_h, "lowfi_L_ds_"+std::to_string(j), L_lowfi_downsampled, lowfi_downsample_helpers);
                 current_w = (current_w + 1) / 2;
                 current_h = (current_h + 1) / 2;
             }
 
             lowfi_spliced_L(dx, dy) = L_lowfi_downsampled(dx, dy) / 100.f;
             low_fi_intermediates.push_back(L_lowfi);
-            low_fi_intermediates.push_back(lowfi_spliced_L);
         }
 
         // --- Build Input Pyramids (Gaussian and Laplacian) with Splicing ---
@@ -212,9 +227,58 @@ public:
         Expr detail_gain = 1.0f + detail_sharpen / 100.0f; Expr clarity_gain = 1.0f + clarity / 100.0f;
         const int detail_level_cutoff = 2, clarity_level_cutoff = 5;
 
+        // Fast mode, after Paris et al. / Aubry et al.: each level's output
+        // Laplacian is the Laplacian of the input remapped around that
+        // pixel's own Gaussian value g, r_g(i) = i + (gain - 1) * e(i - g),
+        // where e(d) = d * exp(-d^2 / 2 sigma^2) only boosts differences
+        // smaller than an edge. By linearity that is
+        //     L_j[r_g(I)] = L_j[I] + (gain_j - 1) * L_j[e(I - g)],
+        // so only the detail term needs a pyramid per sample g_k, and a
+        // pixel interpolates it between the two samples around its g.
+        // Levels at and below the cutover come from the low-fi splice as in
+        // the default mode: there the detail term is e of the spliced
+        // Gaussian level instead of a downsample of the full-res one.
+        const int fast_pyramid_levels = fast_levels > 0 ? std::min(clarity_level_cutoff, pyramid_levels - 1) : 0;
+        if (fast_pyramid_levels > 0) {
+            const int K = fast_levels;
+            const float sigma = 0.1f;
+            Var k = fast_k;
+            Expr g_k = cast<float>(k) / float(K - 1);
+            auto remap_detail = [&](Expr i) {
+                Expr d = i - g_k;
+                return d * exp(d * d * (-0.5f / (sigma * sigma)));
+            };
+            fastGPyramid.resize(fast_pyramid_levels + 1);
+            fastLPyramid.resize(fast_pyramid_levels);
+            for (int j = 0; j <= fast_pyramid_levels; j++) {
+                if (j > 0 && !(perform_splice && j >= cutover_level)) {
+                    downsample(fastGPyramid[j-1], pyramid_widths[j-1], pyramid_heights[j-1], "ll_fast_gpyr_ds_"+std::to_string(j),
+                               fastGPyramid[j], high_freq_pyramid_helpers, {k});
+                } else {
+                    fastGPyramid[j] = Func("ll_fast_gPyramid_"+std::to_string(j));
+                    fastGPyramid[j](x, y, k) = remap_detail(gPyramid[j](x, y));
+                }
+            }
+            for (int j = 0; j < fast_pyramid_levels; j++) {
+                fastLPyramid[j] = Func("ll_fast_lPyramid_"+std::to_string(j));
+                Func upsampled_e;
+                auto& helpers = (perform_splice && j >= cutover_level-1) ? low_freq_pyramid_helpers : high_freq_pyramid_helpers;
+                upsample(fastGPyramid[j+1], pyramid_widths[j+1], pyramid_heights[j+1], pyramid_widths[j], pyramid_heights[j],
+                         "ll_fast_lpyr_us_"+std::to_string(j), upsampled_e, helpers, {k});
+                fastLPyramid[j](x, y, k) = fastGPyramid[j](x, y, k) - upsampled_e(x, y, k);
+            }
+        }
+
         for(int j=0; j < pyramid_levels; j++) {
             outLPyramid[j] = Func("outLPyramid_"+std::to_string(j));
-            Expr adjusted_laplacian = inLPyramid[j](x,y) * select(j < detail_level_cutoff, detail_gain, select(j < clarity_level_cutoff, clarity_gain, 1.0f));
+            Expr level_gain = select(j < detail_level_cutoff, detail_gain, select(j < clarity_level_cutoff, clarity_gain, 1.0f));
+            Expr adjusted_laplacian = inLPyramid[j](x,y) * level_gain;
+            if (j < fast_pyramid_levels) {
+                Expr v = clamp(gPyramid[j](x, y), 0.0f, 1.0f) * float(fast_levels - 1);
+                Expr li = clamp(cast<int>(v), 0, fast_levels - 2);
+                Expr detail = lerp(fastLPyramid[j](x, y, li), fastLPyramid[j](x, y, li + 1), v - cast<float>(li));
+                adjusted_laplacian = inLPyramid[j](x,y) + (level_gain - 1.0f) * detail;
+            }
 
             // If debug_level is active (>0), zero out the finest levels.
             outLPyramid[j](x,y) = select(debug_level > 0 && j < (pyramid_levels - debug_level),
@@ -222,26 +286,32 @@ public:
                                          adjusted_laplacian);
         }
 
+        // The level at which the reconstruction is seeded from the remapped
+        // Gaussian pyramid. It only depends on the image size, so it is
+        // uniform across the whole invocation.
         const float target_sh_size = 256.0f;
-        Expr j_sh = clamp(cast<int>(round(fast_log(cast<float>(max(width, height))/target_sh_size) / fast_log(2.f))), 0, pyramid_levels - 1);
-        std::vector<Func> final_reconstructions(J);
-        for (int b = 0; b < J; ++b) {
-            reconstructedGPyramid[b][b] = Func("reconstructedG_" + std::to_string(b) + "_base");
-            reconstructedGPyramid[b][b](x,y) = remap_lut(cast<int>(clamp(gPyramid[b](x,y) * 255.0f, 0.f, 255.f)));
-            for (int j = b - 1; j >= 0; j--) {
-                reconstructedGPyramid[b][j] = Func("reconstructedG_" + std::to_string(b) + "_" + std::to_string(j));
+        j_sh = clamp(cast<int>(round(fast_log(cast<float>(max(width, height))/target_sh_size) / fast_log(2.f))), 0, pyramid_levels - 1);
+
+        // A single reconstruction chain. Levels at or above j_sh are seeded
+        // with the remapped Gaussian level; levels below it collapse the
+        // adjusted Laplacian onto the upsampled coarser level. This is the same
+        // result as building all J chains and selecting the j_sh-th one, but it
+        // only costs one chain.
+        if (J > 0) {
+            reconstructedGPyramid[J-1] = Func("reconstructedG_" + std::to_string(J-1));
+            reconstructedGPyramid[J-1](x,y) = remap_lut(cast<int>(clamp(gPyramid[J-1](x,y) * 255.0f, 0.f, 255.f)));
+            for (int j = J - 2; j >= 0; j--) {
+                reconstructedGPyramid[j] = Func("reconstructedG_" + std::to_string(j));
                 Func upsampled_out;
                 auto& helpers = (perform_splice && j >= cutover_level-1) ? low_freq_pyramid_helpers : high_freq_pyramid_helpers;
-                upsample(reconstructedGPyramid[b][j+1], pyramid_widths[j+1], pyramid_heights[j+1], pyramid_widths[j], pyramid_heights[j], "reconG_us_"+std::to_string(b)+"_"+std::to_string(j), upsampled_out, helpers);
-                reconstructedGPyramid[b][j](x,y) = upsampled_out(x,y) + outLPyramid[j](x,y);
+                upsample(reconstructedGPyramid[j+1], pyramid_widths[j+1], pyramid_heights[j+1], pyramid_widths[j], pyramid_heights[j], "reconG_us_"+std::to_string(j), upsampled_out, helpers);
+                Expr seeded = remap_lut(cast<int>(clamp(gPyramid[j](x,y) * 255.0f, 0.f, 255.f)));
+                reconstructedGPyramid[j](x,y) = select(j >= j_sh, seeded, upsampled_out(x,y) + outLPyramid[j](x,y));
             }
-            final_reconstructions[b] = reconstructedGPyramid[b][0];
         }
 
         Func L_out_norm("L_out_norm");
-        Expr final_L_expr_norm = (J > 0) ? final_reconstructions[J-1](x,y) : L_norm_hifi(x,y);
-        for (int b = J-2; b >= 0; b--) final_L_expr_norm = select(j_sh == b, final_reconstructions[b](x,y), final_L_expr_norm);
-        L_out_norm(x, y) = final_L_expr_norm;
+        L_out_norm(x, y) = (J > 0) ? reconstructedGPyramid[0](x,y) : L_norm_hifi(x,y);
 
         Func L_out("L_out");
         Expr blacks_level = blacks/100.f * 0.5f, whites_level = 1.f - whites/100.f * 0.5f;
@@ -250,7 +320,7 @@ public:
         L_out(x,y) = clamp(L_remapped, 0.f, 1.f) * 100.f; // Clamp normalized result before scaling
         reconstruction_intermediates = {L_out_norm, L_out};
 
-        Expr is_default = detail_sharpen == 0 && clarity == 0 && shadows == 0 && highlights == 0 && blacks == 0 && whites == 0 && debug_level <= 0;
+        is_default = detail_sharpen == 0 && clarity == 0 && shadows == 0 && highlights == 0 && blacks == 0 && whites == 0 && debug_level <= 0;
         output(x, y, c) = mux(c, { select(is_default, L_in(x,y), L_out(x,y)), C_in(x,y), h_in(x,y) });
 #else
         output(x, y, c) = input_lch(x, y, c);
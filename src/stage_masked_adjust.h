@@ -0,0 +1,76 @@
+#ifndef STAGE_MASKED_ADJUST_H
+#define STAGE_MASKED_ADJUST_H
+
+#include "Halide.h"
+#include "stage_firebreak.h"
+
+// Masked local adjustments (dodge and burn): layers of exposure, in stops,
+// each over a low-resolution coverage mask, applied to the linear image in
+// the vignette firebreak.
+//
+// Each mask has one cell per kCellSize x kCellSize output pixels, sampled
+// bilinearly. The host lists which kTileSize x kTileSize tiles any mask
+// touches, per row of tiles (PipelineUtils::make_local_adjust_inputs):
+// tiles(k, ty) is the k-th touched tile column of tile row ty, -1 past the
+// last. The adjustment is an update of the firebreak over each row's list,
+// so it costs in proportion to the masks' area, and the untouched tiles
+// keep the values the pure definition stored.
+struct MaskedAdjustGrid {
+    static constexpr int kCellSize = 8;
+    static constexpr int kTileSize = 64;
+};
+
+class MaskedAdjustBuilder {
+public:
+    // The update's domain: x = pixel within the tile, y = entry of the
+    // row's tile list.
+    Halide::RDom r;
+
+    // Adds the update to `firebreak.stored`, which holds the image in
+    // `type`. The update writes only columns [col_min, col_max] (the
+    // columns the geometry warp reads, warp_src_col_min/max), so a crop's
+    // firebreak isn't widened to the frame.
+    MaskedAdjustBuilder(const FirebreakBuilder& firebreak, FirebreakType type,
+                        Halide::Func masks, Halide::Expr mask_width, Halide::Expr mask_height,
+                        Halide::Func exposure, Halide::Expr layers,
+                        Halide::Func tiles, Halide::Expr list_length, Halide::Expr tile_rows,
+                        Halide::Expr col_min, Halide::Expr col_max,
+                        Halide::Var y, Halide::Var c)
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+        const int ts = MaskedAdjustGrid::kTileSize;
+        const float inv_cell = 1.0f / MaskedAdjustGrid::kCellSize;
+
+        r = RDom(0, ts, 0, list_length, "masked_adjust_r");
+        Expr tx = tiles(r.y, clamp(y / ts, 0, tile_rows - 1));
+        Expr px = tx * ts + r.x;
+        r.where(tx >= 0);
+        r.where(px >= col_min && px <= col_max);
+        px = clamp(px, col_min, col_max);
+
+        // Total stops at the pixel: each layer's exposure times its mask.
+        Func mask = BoundaryConditions::repeat_edge(masks, {{0, mask_width}, {0, mask_height}, {0, layers}});
+        Expr fx = (cast<float>(px) + 0.5f) * inv_cell - 0.5f;
+        Expr fy = (cast<float>(y) + 0.5f) * inv_cell - 0.5f;
+        Expr ix = cast<int>(floor(fx)), iy = cast<int>(floor(fy));
+        Expr wx = fx - cast<float>(ix), wy = fy - cast<float>(iy);
+        RDom l(0, layers, "masked_adjust_layer");
+        Expr coverage = lerp(lerp(mask(ix, iy, l), mask(ix + 1, iy, l), wx),
+                             lerp(mask(ix, iy + 1, l), mask(ix + 1, iy + 1, l), wx), wy);
+        Expr gain = exp(sum(coverage * exposure(l)) * 0.6931472f);
+
+        Func stored = firebreak.stored;
+        Expr value = stored(px, y, c);
+        if (type == FirebreakType::Float16) {
+            value = cast(Float(16), cast<float>(value) * gain);
+        } else if (type == FirebreakType::UInt16) {
+            value = u16_sat(cast<float>(value) * gain + 0.5f);
+        } else {
+            value = value * gain;
+        }
+        stored(px, y, c) = value;
+    }
+};
+
+#endif // STAGE_MASKED_ADJUST_H
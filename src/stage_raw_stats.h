@@ -0,0 +1,74 @@
+#ifndef STAGE_RAW_STATS_H
+#define STAGE_RAW_STATS_H
+
+#include "Halide.h"
+
+// Exposure and white balance statistics of a raw, for choosing them
+// automatically (PipelineUtils::auto_settings). Each 2x2 CFA block is binned
+// to one R, G, B sample of the normalized raw, before any gains, so the
+// pass reads the raw once and works on quarter-resolution data.
+//
+// output(bin, k): k = 0 is the number of blocks in the bin, 1-3 the sums of
+// their R, G and B. Bins 0 to kBins - 1 are log2 of the block's green,
+// kBinsPerStop to a stop, covering kStops stops below 1; the lowest also
+// takes anything darker. Green is the channel white balance leaves at gain
+// 1, so the bins don't depend on it. Bin kBins holds the blocks with any
+// site at or above kClipLevel, whose colour isn't reliable.
+//
+// As in HistogramBuilder, each strip of `strip_rows` block rows gets its
+// own partial, and an RDom over the strips merges them.
+class RawStatsBuilder {
+public:
+    Halide::Func partial; // (bin, k, strip)
+    Halide::Func output;  // (bin, k)
+    Halide::Var bin, k, strip;
+    Halide::RDom r_blocks, r_strips;
+
+    static constexpr int kBinsPerStop = 16;
+    static constexpr int kStops = 16;
+    static constexpr int kBins = kBinsPerStop * kStops;
+    static constexpr int kValues = 4;
+    static constexpr float kClipLevel = 0.99f;
+
+    // `bayer` is the raw with the black level subtracted and scaled to
+    // [0, 1], in canonical GRBG (BayerNormalizeBuilder with unit gains).
+    RawStatsBuilder(Halide::Func bayer, Halide::Expr width, Halide::Expr height, int strip_rows = 16)
+        : partial("raw_stats_partial"), output("raw_stats"),
+          bin("raw_stats_bin"), k("raw_stats_k"), strip("raw_stats_strip")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        Expr blocks_x = width / 2, blocks_y = height / 2;
+        Expr strips = (blocks_y + strip_rows - 1) / strip_rows;
+
+        // r_blocks.z picks the value, so one pass over a strip's blocks
+        // updates all four.
+        r_blocks = RDom(0, blocks_x, 0, strip_rows, 0, kValues, "raw_stats_blocks");
+        Expr bx = r_blocks.x;
+        Expr by = strip * strip_rows + r_blocks.y;
+        r_blocks.where(by < blocks_y);
+
+        // G R
+        // B G
+        Expr g_r = bayer(2 * bx, 2 * by), r = bayer(2 * bx + 1, 2 * by);
+        Expr b = bayer(2 * bx, 2 * by + 1), g_b = bayer(2 * bx + 1, 2 * by + 1);
+        Expr g = (g_r + g_b) * 0.5f;
+        Expr clipped = max(max(g_r, g_b), max(r, b)) >= kClipLevel;
+        Expr level = (log2(max(g, 1e-9f)) + kStops) * kBinsPerStop;
+        Expr index = select(clipped, kBins, clamp(i32(floor(level)), 0, kBins - 1));
+        Expr value = select(r_blocks.z == 0, 1.0f,
+                            r_blocks.z == 1, r,
+                            r_blocks.z == 2, g,
+                            b);
+
+        partial(bin, k, strip) = 0.0f;
+        partial(index, r_blocks.z, strip) += value;
+
+        r_strips = RDom(0, strips, "raw_stats_strips");
+        output(bin, k) = 0.0f;
+        output(bin, k) += partial(bin, k, r_strips);
+    }
+};
+
+#endif // STAGE_RAW_STATS_H
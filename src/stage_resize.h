@@ -5,76 +5,141 @@
 #include <string>
 #include <vector>
 
-namespace { // Anonymous namespace for helpers
-
-// Catmull-Rom cubic interpolation kernel
-inline Halide::Expr cubic_interp(Halide::Expr p0, Halide::Expr p1, Halide::Expr p2, Halide::Expr p3, Halide::Expr x) {
-    return p1 + 0.5f * x * (p2 - p0 +
-                              x * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 +
-                                   x * (3.0f * (p1 - p2) + p3 - p0)));
-}
-
-} // namespace
-
-// This class encapsulates the logic for a bicubic resize operation.
-// It exposes its output and intermediate Funcs so the main generator
-// can schedule them appropriately within the larger pipeline.
-class ResizeBicubicBuilder {
+// A separable resize with a choice of kernel.
+//
+// Each output row (column) reads `taps` consecutive input rows (columns)
+// from `begin`, with weights that depend only on the output coordinate.
+// Both are computed once per run into small tables (`tables`, (x, tap) and
+// (x)), instead of per pixel. When downscaling, the kernel is stretched by
+// the scale factor, so every input pixel contributes and the result doesn't
+// alias; the number of taps grows with the factor.
+//
+//   CUBIC    Catmull-Rom, support 2.
+//   LANCZOS3 Windowed sinc, support 3.
+//   AREA     Each output pixel is the average of the input area it covers.
+//
+// For exact 2x and 4x reductions the weights are the same for every output
+// pixel and `begin` is a multiple of the output coordinate. `scale` is then
+// a constant, so in the specializations of specialize_exact() the taps are a
+// fixed count, the weights are read from the tables' first row and no
+// per-pixel lookup of `begin` remains.
+class ResizeBuilder {
 public:
+    enum class Kernel { CUBIC, LANCZOS3, AREA };
+
     Halide::Func output;
+    // The columns of the input resampled to the output rows, (x_coord, y, c).
     Halide::Func interp_y;
     Halide::Var x_coord;
+    // The per-row and per-column weight and start tables.
+    std::vector<Halide::Func> tables;
+    Halide::Expr is_2x, is_4x;
 
-    ResizeBicubicBuilder(Halide::Func input,
-                         const std::string& name_prefix,
-                         Halide::Expr input_width, Halide::Expr input_height,
-                         Halide::Expr output_width, Halide::Expr output_height,
-                         Halide::Var x, Halide::Var y, Halide::Var c)
+    ResizeBuilder(Halide::Func input,
+                  const std::string& name_prefix,
+                  Halide::Expr input_width, Halide::Expr input_height,
+                  Halide::Expr output_width, Halide::Expr output_height,
+                  Halide::Var x, Halide::Var y, Halide::Var c,
+                  Kernel kernel = Kernel::LANCZOS3)
         : output(name_prefix + "_output"),
           interp_y(name_prefix + "_interp_y"),
           x_coord(name_prefix + "_x_coord")
     {
         using namespace Halide;
 
-        // Calculate scale factors.
-        Expr scale_x = cast<float>(input_width) / output_width;
-        Expr scale_y = cast<float>(input_height) / output_height;
+        is_2x = input_width == 2 * output_width && input_height == 2 * output_height;
+        is_4x = input_width == 4 * output_width && input_height == 4 * output_height;
+
+        Func clamped = BoundaryConditions::repeat_edge(input, {{0, input_width}, {0, input_height}});
 
-        // Get source coordinates for a given output pixel (x, y).
-        Expr src_x = (cast<float>(x) + 0.5f) * scale_x - 0.5f;
-        Expr src_y = (cast<float>(y) + 0.5f) * scale_y - 0.5f;
+        Axis ax = make_axis(name_prefix + "_x", kernel, input_width, output_width, x);
+        Axis ay = make_axis(name_prefix + "_y", kernel, input_height, output_height, y);
+        tables = {ax.weights, ax.begin, ay.weights, ay.begin};
 
-        Expr ix = cast<int>(floor(src_x));
-        Expr iy = cast<int>(floor(src_y));
-        Expr fx = src_x - ix;
-        Expr fy = src_y - iy;
+        // --- Pass 1: resample each input column to the output rows ---
+        RDom ry(0, ay.taps, name_prefix + "_ry");
+        interp_y(x_coord, y, c) = sum(ay.weight(ry) * clamped(x_coord, ay.start + ry, c));
 
-        Func clamped = BoundaryConditions::repeat_edge(input, {{0, input_width}, {0, input_height}});
+        // --- Pass 2: resample the rows to the output columns ---
+        RDom rx(0, ax.taps, name_prefix + "_rx");
+        output(x, y, c) = sum(ax.weight(rx) * interp_y(ax.start + rx, y, c));
+    }
 
-        // --- Pass 1: Interpolate vertically ---
-        // This Func computes an interpolated value for any input column `x_coord`
-        // at the vertical position `y` from the final output grid.
-        interp_y(x_coord, y, c) = cubic_interp(
-            clamped(x_coord, iy - 1, c),
-            clamped(x_coord, iy,     c),
-            clamped(x_coord, iy + 1, c),
-            clamped(x_coord, iy + 2, c),
-            fy
-        );
-
-        // --- Pass 2: Interpolate horizontally ---
-        // This is the final output Func. It calls the first-pass Func four times
-        // to get the vertically-interpolated values for the four neighboring columns.
-        output(x, y, c) = cubic_interp(
-            interp_y(ix - 1, y, c),
-            interp_y(ix,     y, c),
-            interp_y(ix + 1, y, c),
-            interp_y(ix + 2, y, c),
-            fx
-        );
+    // One loop nest each for exact 2x and 4x reductions, in which the taps
+    // and the weights are constants. Call after the Funcs' compute_at.
+    void specialize_exact() {
+        output.specialize(is_2x);
+        output.specialize(is_4x);
+        interp_y.specialize(is_2x);
+        interp_y.specialize(is_4x);
     }
-};
 
-#endif // STAGE_RESIZE_H
+private:
+    struct Axis {
+        Halide::Func weights, begin;
+        Halide::Expr taps;
+        // The first input coordinate read for the output coordinate, and
+        // the row of `weights` that holds its taps' weights.
+        Halide::Expr start, row;
 
+        Halide::Expr weight(Halide::Expr tap) const { return weights(row, tap); }
+    };
 
+    Axis make_axis(const std::string& name, Kernel kernel, Halide::Expr in_size, Halide::Expr out_size,
+                   Halide::Var v) {
+        using namespace Halide;
+        Axis axis;
+
+        Expr scale = select(is_2x, 2.0f, is_4x, 4.0f, cast<float>(in_size) / out_size);
+        // Stretched only when downscaling; upscaling interpolates.
+        Expr kernel_scale = max(scale, 1.0f);
+        const float radius = kernel == Kernel::CUBIC ? 2.0f : kernel == Kernel::LANCZOS3 ? 3.0f : 0.5f;
+        Expr support = radius * kernel_scale;
+        // A window of width 2 * support covers at most ceil(2 * support) + 1
+        // pixel centres. The area kernel's window is the pixel footprint, so
+        // its partly covered end pixels are the + 1.
+        axis.taps = cast<int>(ceil(2.0f * support)) + 1;
+
+        Var k(name + "_k");
+        Expr src = (cast<float>(v) + 0.5f) * scale - 0.5f;
+        axis.begin = Func(name + "_begin");
+        axis.begin(v) = cast<int>(floor(src - support)) + 1;
+
+        Expr pos = cast<float>(axis.begin(v) + k);
+        Expr w;
+        if (kernel == Kernel::AREA) {
+            // Overlap of the pixel's footprint with the output pixel's.
+            Expr lo = src - support, hi = src + support;
+            w = max(min(pos + 0.5f, hi) - max(pos - 0.5f, lo), 0.0f);
+        } else {
+            Expr t = abs(pos - src) / kernel_scale;
+            if (kernel == Kernel::CUBIC) {
+                w = select(t < 1.0f, (1.5f * t - 2.5f) * t * t + 1.0f,
+                           t < 2.0f, ((-0.5f * t + 2.5f) * t - 4.0f) * t + 2.0f,
+                           0.0f);
+            } else {
+                const float pi = 3.14159265358979f;
+                Expr sinc = select(t < 1e-6f, 1.0f, sin(pi * t) / (pi * t));
+                Expr sinc3 = select(t < 1e-6f, 1.0f, sin(pi * t / 3.0f) / (pi * t / 3.0f));
+                w = select(t < 3.0f, sinc * sinc3, 0.0f);
+            }
+        }
+        Func raw(name + "_weight_raw");
+        raw(v, k) = w;
+        RDom r(0, axis.taps, name + "_r");
+        Func norm(name + "_weight_sum");
+        norm(v) = sum(raw(v, r));
+        axis.weights = Func(name + "_weights");
+        axis.weights(v, k) = raw(v, k) / norm(v);
+
+        // For an exact factor the weights repeat with every output pixel,
+        // and the start steps by the factor from the first.
+        Expr exact = is_2x || is_4x;
+        Expr step = select(is_2x, 2, 4);
+        axis.row = select(exact, 0, v);
+        axis.start = select(exact, step * v + axis.begin(0), axis.begin(v));
+        return axis;
+    }
+};
+
+#endif // STAGE_RESIZE_H
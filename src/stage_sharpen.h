@@ -6,10 +6,26 @@
 #include <type_traits>
 #include <vector>
 
+// Output sharpening: an unsharp mask on luma, applied to the colour channels
+// as a gain, with a threshold that leaves low-contrast detail (noise) alone.
+//
+// The blur is separable and reaches at most kRadius pixels either side, so
+// schedule_output_phase can compute it per output strip: `luma` is stored
+// per strip and slides along the tiles, `luma_x` (the horizontal pass) and
+// `gain` (the vertical pass and the mask) are computed per tile. A strip
+// then reads kRadius extra rows and columns of its input, and nothing is
+// materialized for the whole frame.
 template <typename T>
 class SharpenBuilder_T {
 public:
+    // Taps either side of the centre. Covers 2.5 sigma of the widest blur.
+    static constexpr int kRadius = 5;
+    static constexpr float kMaxSigma = kRadius / 2.5f;
+
     Halide::Func output;
+    Halide::Func luma, kernel, luma_x, gain;
+    // True at strength 0, when the output is the input (see schedule_output_phase).
+    Halide::Expr is_bypassed;
     std::vector<Halide::Func> intermediates;
 
     SharpenBuilder_T(Halide::Func input,
@@ -17,15 +33,13 @@ public:
                      Halide::Expr sharpen_radius,
                      Halide::Expr sharpen_threshold,
                      Halide::Expr width, Halide::Expr height,
-                     Halide::Var x, Halide::Var y, Halide::Var c) {
+                     Halide::Var x, Halide::Var y, Halide::Var c)
+        : output("sharpened"), luma("sharpen_luma"), kernel("sharpen_kernel"),
+          luma_x("sharpen_luma_x"), gain("sharpen_gain")
+    {
         using namespace Halide;
         using namespace Halide::ConciseCasts;
 
-        output = Func("sharpened");
-
-#ifdef NO_SHARPEN
-        output(x, y, c) = input(x, y, c);
-#else
         // --- 0. Normalize to a common float [0,1] space for calculations ---
         Func input_f("sharpen_input_f");
         if (std::is_same<T, float>::value) {
@@ -35,63 +49,52 @@ public:
         }
 
         // --- 1. Calculate Luminance ---
-        // The input is linear RGB, so a simple weighted sum is correct.
-        Func luma("luma");
-        Expr r_ch = input_f(x, y, 0);
-        Expr g_ch = input_f(x, y, 1);
-        Expr b_ch = input_f(x, y, 2);
-        luma(x, y) = 0.299f * r_ch + 0.587f * g_ch + 0.114f * b_ch;
+        luma(x, y) = 0.299f * input_f(x, y, 0) + 0.587f * input_f(x, y, 1) + 0.114f * input_f(x, y, 2);
 
-        // --- 2. Create 1D Gaussian Kernel ---
-        const int kernel_size = 31; // Supports sigma up to ~5.0
-        const int kernel_center = kernel_size / 2;
-        Func gaussian_kernel("gaussian_kernel");
+        // --- 2. Normalized 1D Gaussian Kernel ---
         Var k("k");
-        Expr sigma = max(0.1f, sharpen_radius);
-        Expr dist_sq = (k - kernel_center) * (k - kernel_center);
-        gaussian_kernel(k) = exp(-dist_sq / (2.0f * sigma * sigma));
+        Expr sigma = clamp(sharpen_radius, 0.3f, kMaxSigma);
+        Func weight("sharpen_weight");
+        weight(k) = exp(-cast<float>((k - kRadius) * (k - kRadius)) / (2.0f * sigma * sigma));
+        RDom r(0, 2 * kRadius + 1, "sharpen_rdom");
+        kernel(k) = weight(k) / sum(weight(r), "sharpen_kernel_sum");
 
         // --- 3. Blur the Luma (Separable Gaussian Blur) ---
+        // The taps are unrolled here rather than reduced over an RDom, so
+        // each pass vectorizes across x.
         Func luma_clamped = BoundaryConditions::repeat_edge(luma, {{0, width}, {0, height}});
-        Func luma_x("luma_x"), blurred_luma("blurred_luma");
-        RDom r_blur(0, kernel_size, "sharpen_rdom");
-
-        // Normalize the kernel
-        Expr kernel_sum = sum(gaussian_kernel(r_blur.x), "sharpen_kernel_sum");
-
-        // Horizontal pass
-        luma_x(x, y) = sum(luma_clamped(x + r_blur.x - kernel_center, y) * gaussian_kernel(r_blur.x), "sharpen_blur_x_sum") / kernel_sum;
+        Expr blur_x = 0.0f;
+        for (int i = -kRadius; i <= kRadius; i++) {
+            blur_x += luma_clamped(x + i, y) * kernel(i + kRadius);
+        }
+        luma_x(x, y) = blur_x;
 
-        // Vertical pass
         Func luma_x_clamped = BoundaryConditions::repeat_edge(luma_x, {{0, width}, {0, height}});
-        blurred_luma(x, y) = sum(luma_x_clamped(x, y + r_blur.x - kernel_center) * gaussian_kernel(r_blur.x), "sharpen_blur_y_sum") / kernel_sum;
+        Expr blurred_luma = 0.0f;
+        for (int i = -kRadius; i <= kRadius; i++) {
+            blurred_luma += luma_x_clamped(x, y + i) * kernel(i + kRadius);
+        }
 
         // --- 4. Unsharp Masking on Luma ---
-        Expr detail_luma = luma(x, y) - blurred_luma(x, y);
-        Expr edge_mask = smoothstep(0.0f, sharpen_threshold, abs(detail_luma));
+        // The threshold is floored so the smoothstep never divides by zero.
+        Expr detail_luma = luma(x, y) - blurred_luma;
+        Expr edge_mask = smoothstep(0.0f, max(sharpen_threshold, 1e-4f), abs(detail_luma));
         Expr sharpened_luma = luma(x, y) + detail_luma * sharpen_strength * edge_mask;
+        gain(x, y) = max(0.0f, sharpened_luma) / (luma(x, y) + 1e-6f); // Add epsilon for stability
 
-        // --- 5. Apply Gain to color channels ---
-        Expr gain = sharpened_luma / (luma(x, y) + 1e-6f); // Add epsilon for stability
-        Expr sharpened_val = input_f(x, y, c) * gain;
-
-        // --- 6. Convert back to the pipeline's processing type ---
-        Expr final_val;
-        if (std::is_same<T, float>::value) {
-            final_val = sharpened_val;
-        } else {
-            final_val = sharpened_val * 65535.0f;
+        // --- 5. Apply Gain to color channels, back in the processing type ---
+        Expr sharpened_val = input_f(x, y, c) * gain(x, y);
+        if (!std::is_same<T, float>::value) {
+            sharpened_val = sharpened_val * 65535.0f;
         }
-        output(x, y, c) = proc_type_sat<T>(final_val);
+        is_bypassed = sharpen_strength == 0.0f;
+        output(x, y, c) = select(is_bypassed, input(x, y, c), proc_type_sat<T>(sharpened_val));
 
         intermediates.push_back(input_f);
-        intermediates.push_back(gaussian_kernel);
+        intermediates.push_back(kernel);
         intermediates.push_back(luma_x);
-        intermediates.push_back(blurred_luma);
-#endif
+        intermediates.push_back(gain);
     }
 };
 
 #endif // STAGE_SHARPEN_H
-
-
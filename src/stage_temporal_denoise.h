@@ -0,0 +1,65 @@
+#ifndef STAGE_TEMPORAL_DENOISE_H
+#define STAGE_TEMPORAL_DENOISE_H
+
+#include "Halide.h"
+
+// Recursive temporal denoise for frame sequences (the live view, time
+// lapses): each raw frame is blended with the previous output, which the
+// caller keeps as the state and passes back in as `history` next frame.
+//
+// The blend is motion-gated rather than motion-compensated. Motion is the
+// difference between the frame and the history on a grey image binned from
+// each 2x2 CFA block, so it doesn't depend on the pattern and its noise is
+// half the raw's. The history's weight is a Wiener shrinkage on it,
+// `strength` * c sigma^2 / (D^2 + c sigma^2) with sigma the binned noise and
+// c = kGateScale: static content converges to an average of about
+// 1 / (1 - strength) frames, moving content falls back to the new frame.
+//
+// Two point-wise passes over the mosaic, no neighbourhoods beyond the 2x2
+// block. It runs ahead of camera_pipe on the raw it would get anyway, so
+// the Bayer normalize and everything after see a cleaner mosaic. A
+// strength of 0 passes the frame through (`is_bypassed`), which is what
+// single stills get.
+//
+// `frame` and `history` are (x, y) in raw units; `output` is in the same
+// units, black and white levels unchanged.
+class TemporalDenoiseBuilder {
+public:
+    static constexpr float kGateScale = 4.0f;
+
+    Halide::Func motion;  // (qx, qy): binned |frame - history|.
+    Halide::Func weight;  // (qx, qy): the history's weight.
+    Halide::Func output;
+    Halide::Expr is_bypassed;
+    Halide::Var qx{"quad_x"}, qy{"quad_y"};
+
+    TemporalDenoiseBuilder(Halide::Func frame, Halide::Func history,
+                           Halide::Expr width, Halide::Expr height,
+                           Halide::Expr noise_sigma, Halide::Expr strength,
+                           Halide::Var x, Halide::Var y)
+        : motion("temporal_motion"), weight("temporal_weight"), output("temporal_denoised")
+    {
+        using namespace Halide;
+        using namespace Halide::ConciseCasts;
+
+        is_bypassed = strength <= 0.0f;
+
+        auto quad_diff = [&](Expr dx, Expr dy) {
+            Expr px = clamp(2 * qx + dx, 0, width - 1);
+            Expr py = clamp(2 * qy + dy, 0, height - 1);
+            return cast<float>(frame(px, py)) - cast<float>(history(px, py));
+        };
+        motion(qx, qy) = abs(quad_diff(0, 0) + quad_diff(1, 0) + quad_diff(0, 1) + quad_diff(1, 1)) * 0.25f;
+
+        Expr sigma_sq = kGateScale * (noise_sigma * 0.5f) * (noise_sigma * 0.5f) + 1e-6f;
+        Expr d = motion(qx, qy);
+        weight(qx, qy) = clamp(strength, 0.0f, 0.95f) * sigma_sq / (d * d + sigma_sq);
+
+        Expr f = cast<float>(frame(x, y));
+        Expr h = cast<float>(history(x, y));
+        Expr blended = f + weight(x / 2, y / 2) * (h - f);
+        output(x, y) = select(is_bypassed, frame(x, y), u16_sat(blended + 0.5f));
+    }
+};
+
+#endif // STAGE_TEMPORAL_DENOISE_H
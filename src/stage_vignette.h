@@ -4,14 +4,27 @@
 #include "Halide.h"
 #include "pipeline_helpers.h"
 
+// The creative vignette and the lens profile's vignetting correction, as
+// one gain per pixel on linear sRGB.
+//
+// `lens_gain` is the correction (PipelineUtils::LensCorrection::
+// vignetting_lut_for): the gain at a distance from the centre of 0 to the
+// half-diagonal, sampled at `lens_gain_size` evenly spaced points. A
+// one-point LUT means no correction. That is a size rather than a value so
+// that specializing on is_bypassed can fold the lookup away too.
 class VignetteBuilder {
 public:
     Halide::Func output;
+    // True when the amount is 0 and there is no lens correction, so the
+    // factor is 1 everywhere. Specializing on it substitutes the amount and
+    // the LUT size, which folds the falloff and the lookup away.
+    Halide::Expr is_bypassed;
 
     VignetteBuilder(Halide::Func input_srgb,
                     Halide::Expr out_width, Halide::Expr out_height,
                     Halide::Expr amount_slider, Halide::Expr midpoint_slider,
                     Halide::Expr roundness_slider, Halide::Expr highlights_slider,
+                    Halide::Func lens_gain, Halide::Expr lens_gain_size,
                     Halide::Var x, Halide::Var y, Halide::Var c)
         : output("vignette_corrected")
     {
@@ -60,7 +73,18 @@ public:
         // Only apply highlight protection when brightening (amount < 0), not when darkening (amount > 0).
         Expr final_factor = select(amount < 0, protection_factor, vignette_factor);
 
-        output(x, y, c) = input_srgb(x, y, c) * final_factor;
+        // --- Lens Vignetting ---
+        // Linear between the LUT's points, by distance from the centre over
+        // the half-diagonal whatever the roundness.
+        Expr half_diagonal = sqrt(center_x * center_x + center_y * center_y);
+        Expr lens_pos = sqrt(dx * dx + dy * dy) / max(half_diagonal, 1.0f) * cast<float>(lens_gain_size - 1);
+        Expr lens_i = clamp(cast<int>(lens_pos), 0, max(lens_gain_size - 2, 0));
+        Expr lens_frac = clamp(lens_pos - cast<float>(lens_i), 0.0f, 1.0f);
+        Expr lens_factor = select(lens_gain_size <= 1, 1.0f,
+                                  lerp(lens_gain(lens_i), lens_gain(min(lens_i + 1, lens_gain_size - 1)), lens_frac));
+
+        is_bypassed = amount_slider == 0.0f && lens_gain_size == 1;
+        output(x, y, c) = input_srgb(x, y, c) * (final_factor * lens_factor);
     }
 };
 
@@ -12,6 +12,15 @@ void test_e2e_linear_curve();
 void test_e2e_inverting_curve();
 void test_e2e_crushing_curve();
 void test_stage_outputs();
+void test_color_tools_fast_math();
+void test_color_tools_baked_look();
+void test_apply_curve_compact_lut();
+void test_fixed_look_vs_float();
+void test_csi2_unpack_matches_host();
+void test_burst_merge_reduces_noise();
+void test_temporal_denoise_static_and_motion();
+void test_sharpen_step_edge();
+void test_dehaze_estimate();
 
 
 int main(int argc, char **argv) {
@@ -25,6 +34,15 @@ int main(int argc, char **argv) {
     test_e2e_inverting_curve();
     test_e2e_crushing_curve();
     test_stage_outputs();
+    test_color_tools_fast_math();
+    test_color_tools_baked_look();
+    test_apply_curve_compact_lut();
+    test_fixed_look_vs_float();
+    test_csi2_unpack_matches_host();
+    test_burst_merge_reduces_noise();
+    test_temporal_denoise_static_and_motion();
+    test_sharpen_step_edge();
+    test_dehaze_estimate();
 
     std::cout << "\n-------------------------------------\n";
     if (test_failures == 0) {
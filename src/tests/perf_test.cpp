@@ -0,0 +1,291 @@
+// perf_test: performance regression test for the AOT camera_pipe builds.
+//
+// The tests in this directory check what the stages compute; this one checks
+// how fast the shipped pipelines are, so that a schedule change which slows
+// them down fails a test instead of landing silently. Two kinds of check:
+//
+// Timing. camera_pipe_f32 and camera_pipe_u16 run on a fixed synthetic frame
+// with a pinned Halide thread count, with every optional stage at its
+// default and with all of them on. The median of the samples is compared
+// against the baseline for the machine class (--class), a CSV checked in
+// under src/tests/perf_baselines/<class>.csv; a median more than --tolerance
+// above its baseline fails. --update writes the medians as the new baseline.
+// Without --class, or without a baseline for it, the times are only printed.
+//
+// Specializations. The optional stages are specialized on their bypass
+// conditions (StageBypasses in pipeline_schedule.h), so at the defaults their
+// producers are not computed at all. A select on the slider that Halide can't
+// fold defeats that without changing the output, only the runtime. This runs
+// the profiled builds (BUILD_PROFILE_PIPELINES) and reads the profiler's
+// per-Func counters: at the defaults the stage's producers must not have run,
+// and with the stage on they must have (so a renamed Func can't pass by
+// being absent). These checks don't depend on the machine.
+//
+// Exits non-zero on any failure, for ctest.
+
+#include "HalideBuffer.h"
+#include "HalideRuntime.h"
+#include "halide_benchmark.h"
+#include "camera_pipe_benchmark.h"
+
+#include "camera_pipe_f32_lib.h"
+#include "camera_pipe_u16_lib.h"
+#include "camera_pipe_f32_profile_lib.h"
+#include "camera_pipe_u16_profile_lib.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PERF_BASELINE_DIR
+#define PERF_BASELINE_DIR "src/tests/perf_baselines"
+#endif
+
+using Halide::Runtime::Buffer;
+using CameraPipeBenchmark::config_for;
+using CameraPipeBenchmark::Inputs;
+
+namespace {
+
+int failures = 0;
+
+struct PerfOptions {
+    std::string machine_class;  // Empty: no timing comparison.
+    std::string baseline_dir = PERF_BASELINE_DIR;
+    double megapixels = 4.0;
+    int threads = 4;            // Capped at the core count.
+    int samples = 9;
+    double tolerance = 0.15;
+    bool update = false;
+};
+
+void print_usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --class <name>      Machine class: compare against <baselines>/<name>.csv\n"
+              << "  --baselines <dir>   Baseline directory (default " PERF_BASELINE_DIR ")\n"
+              << "  --update            Write the measured medians as the class's baseline\n"
+              << "  --tolerance <f>     Allowed slowdown over the baseline (default 0.15)\n"
+              << "  --size <mp>         Frame size in megapixels (default 4)\n"
+              << "  --threads <n>       Halide threads (default 4, at most the core count)\n"
+              << "  --samples <n>       Timed runs per case (default 9)\n";
+}
+
+PerfOptions parse_perf_args(int argc, char** argv) {
+    PerfOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--class") {
+            opts.machine_class = value();
+        } else if (arg == "--baselines") {
+            opts.baseline_dir = value();
+        } else if (arg == "--update") {
+            opts.update = true;
+        } else if (arg == "--tolerance") {
+            opts.tolerance = std::stod(value());
+        } else if (arg == "--size") {
+            opts.megapixels = std::stod(value());
+        } else if (arg == "--threads") {
+            opts.threads = std::stoi(value());
+        } else if (arg == "--samples") {
+            opts.samples = std::stoi(value());
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            exit(0);
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    if (opts.samples < 1 || opts.threads < 1) throw std::runtime_error("--samples and --threads must be positive");
+    if (opts.tolerance < 0) throw std::runtime_error("--tolerance must not be negative");
+    if (opts.update && opts.machine_class.empty()) throw std::runtime_error("--update needs --class");
+    const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    opts.threads = std::min(opts.threads, cores);
+    return opts;
+}
+
+void fail(const std::string& message) {
+    std::cerr << "FAIL: " << message << "\n";
+    failures++;
+}
+
+double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// --- Timing ---
+
+// Case name ("f32_none") -> median ms.
+typedef std::map<std::string, double> Medians;
+
+Medians read_baseline(const std::string& path) {
+    Medians baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line.rfind("case,", 0) == 0) continue;
+        const size_t comma = line.find(',');
+        if (comma == std::string::npos) throw std::runtime_error("Malformed line in " + path + ": " + line);
+        baseline[line.substr(0, comma)] = std::stod(line.substr(comma + 1));
+    }
+    return baseline;
+}
+
+void write_baseline(const std::string& path, const Medians& medians, const PerfOptions& opts, int width, int height) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) throw std::runtime_error("Could not open " + path + " for writing");
+    fprintf(f, "# perf_test baseline: %dx%d, %d threads, median of %d runs\n", width, height, opts.threads, opts.samples);
+    fprintf(f, "case,median_ms\n");
+    for (const auto& m : medians) fprintf(f, "%s,%.3f\n", m.first.c_str(), m.second);
+    fclose(f);
+    std::cerr << "Wrote " << path << "\n";
+}
+
+Medians time_cases(Inputs& in, Buffer<uint8_t, 3>& output, const PerfOptions& opts) {
+    Medians medians;
+    for (const std::string variant : {"f32", "u16"}) {
+        for (const std::string stages : {"none", "all"}) {
+            CameraPipeBenchmark::Run pipeline_run(config_for(stages), /* fast demosaic */ 3);
+            auto pipe = variant == "f32" ? camera_pipe_f32 : camera_pipe_u16;
+            auto run = [&]() { pipeline_run(pipe, "camera_pipe_" + variant, in, output); };
+            run(); // Warm up: thread pool, allocation caches, page faults.
+            std::vector<double> ms(opts.samples);
+            for (int i = 0; i < opts.samples; ++i) ms[i] = Halide::Tools::benchmark(1, 1, run) * 1e3;
+            const std::string name = variant + "_" + stages;
+            medians[name] = median(ms);
+            printf("%-10s median %9.2f ms\n", name.c_str(), medians[name]);
+            fflush(stdout);
+        }
+    }
+    return medians;
+}
+
+void compare_to_baseline(const Medians& medians, const Medians& baseline, const PerfOptions& opts) {
+    for (const auto& m : medians) {
+        auto it = baseline.find(m.first);
+        if (it == baseline.end()) {
+            std::cerr << "Note: no baseline for " << m.first << "\n";
+            continue;
+        }
+        const double ratio = m.second / it->second;
+        if (ratio > 1.0 + opts.tolerance) {
+            char message[160];
+            snprintf(message, sizeof(message), "%s took %.2f ms, %.0f%% over the %s baseline of %.2f ms",
+                     m.first.c_str(), m.second, (ratio - 1.0) * 100.0, opts.machine_class.c_str(), it->second);
+            fail(message);
+        } else if (ratio < 1.0 - opts.tolerance) {
+            std::cerr << "Note: " << m.first << " is " << (int)((1.0 - ratio) * 100.0)
+                      << "% under its baseline; consider --update\n";
+        }
+    }
+}
+
+// --- Specializations ---
+
+// A stage with a bypass specialization, and the producers that only its
+// non-default branch computes.
+struct BypassedStage {
+    const char* stage_set; // config_for() name that turns the stage on.
+    std::vector<std::string> producers; // Func name prefixes.
+};
+
+const BypassedStage kBypassedStages[] = {
+    {"ca", {"ca_g_interp"}},
+    {"denoise", {"denoised_planes"}},
+    {"ll", {"inLPyramid_", "outLPyramid_"}},
+};
+
+// Whether any Func matching `producers` ran in the profiled runs so far.
+bool producers_ran(const char* pipeline, const std::vector<std::string>& producers, std::string& which) {
+    halide_profiler_pipeline_stats* stats = halide_profiler_get_pipeline_state(pipeline);
+    if (stats == nullptr || stats->runs == 0) throw std::runtime_error(std::string("No profile recorded for ") + pipeline);
+    for (int i = 0; i < stats->num_funcs; i++) {
+        const halide_profiler_func_stats& f = stats->funcs[i];
+        if (f.time == 0 && f.num_allocs == 0) continue;
+        for (const auto& prefix : producers) {
+            if (std::string(f.name).rfind(prefix, 0) == 0) {
+                which = f.name;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void check_specializations(Inputs& in, Buffer<uint8_t, 3>& output) {
+    for (const std::string variant : {"f32", "u16"}) {
+        const std::string pipeline = "camera_pipe_" + variant + "_profile";
+        auto pipe = variant == "f32" ? camera_pipe_f32_profile : camera_pipe_u16_profile;
+        for (const BypassedStage& stage : kBypassedStages) {
+            std::string which;
+            halide_profiler_reset();
+            CameraPipeBenchmark::Run defaults(config_for("none"), 3);
+            defaults(pipe, pipeline, in, output);
+            if (producers_ran(pipeline.c_str(), stage.producers, which)) {
+                fail(pipeline + ": " + which + " ran with " + stage.stage_set + " at its default; "
+                     "the bypass specialization didn't take");
+            }
+            halide_profiler_reset();
+            CameraPipeBenchmark::Run on(config_for(stage.stage_set), 3);
+            on(pipe, pipeline, in, output);
+            if (!producers_ran(pipeline.c_str(), stage.producers, which)) {
+                fail(pipeline + ": no " + stage.producers[0] + " ran with " + stage.stage_set +
+                     " on; update kBypassedStages if the Funcs were renamed");
+            }
+        }
+    }
+    // So the runtime doesn't print its own report at exit.
+    halide_profiler_reset();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        PerfOptions opts = parse_perf_args(argc, argv);
+
+        Inputs in;
+        in.set_size(opts.megapixels);
+        const int width = in.bayer.width(), height = in.bayer.height();
+        Buffer<uint8_t, 3> output(width, height, 3);
+        halide_shutdown_thread_pool();
+        halide_set_num_threads(opts.threads);
+        std::cerr << "Frame " << width << "x" << height << ", " << opts.threads << " threads\n";
+
+        check_specializations(in, output);
+
+        const Medians medians = time_cases(in, output, opts);
+        if (!opts.machine_class.empty()) {
+            const std::string path = opts.baseline_dir + "/" + opts.machine_class + ".csv";
+            if (opts.update) {
+                write_baseline(path, medians, opts, width, height);
+            } else if (!std::ifstream(path)) {
+                std::cerr << "Note: no baseline at " << path << "; run with --update to record one\n";
+            } else {
+                compare_to_baseline(medians, read_baseline(path), opts);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failures > 0) {
+        std::cerr << failures << " perf check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All perf checks passed\n";
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "test_harness.h"
+#include "stage_apply_curve.h"
+#include "tone_curve_utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// The largest difference, in 16-bit units, between the compact LUT applied
+// by pipeline_apply_curve and the full table's entries, over every 16-bit
+// input level.
+float max_compact_curve_error(const ProcessConfig& cfg, int size) {
+    const int n = ToneCurveUtils::kFullToneCurveSize;
+    Halide::Buffer<uint16_t> full(ToneCurveUtils::generate_pipeline_lut(cfg, n));
+    Halide::Buffer<uint16_t> compact(ToneCurveUtils::generate_pipeline_lut(cfg, size));
+    Halide::Func compact_func = buffer_to_func(compact, "compact_tone_curve");
+
+    Halide::Var x, y, c;
+    Halide::Func ramp("tone_ramp");
+    ramp(x, y, c) = Halide::cast<float>(x) / float(n - 1);
+    Halide::Func curved = pipeline_apply_curve<float>(ramp, Halide::Expr(0), Halide::Expr(1),
+                                                      compact_func, compact.width(), x, y, c,
+                                                      Halide::get_jit_target_from_environment(), false);
+    Halide::Buffer<float> out = curved.realize({n, 1, 3});
+
+    float worst = 0.0f;
+    for (int ch = 0; ch < 3; ch++) {
+        for (int i = 0; i < n; i++) {
+            worst = std::max(worst, std::abs(out(i, 0, ch) * 65535.0f - float(full(i, ch))));
+        }
+    }
+    return worst;
+}
+
+} // namespace
+
+// A compact (sqrt-shaped, interpolated) tone curve must track the full 64K
+// table to within 2 LSB of 16 bits, for the default curve and a user one.
+void test_apply_curve_compact_lut() {
+    std::cout << "--- Running test: test_apply_curve_compact_lut ---\n";
+    const float max_lsb = 2.0f;
+    const int size = 1024;
+
+    ProcessConfig cfg;
+    float default_error = max_compact_curve_error(cfg, size);
+    std::cout << "  default curve, " << size << " entries: max error " << default_error << " LSB\n";
+    ASSERT_TRUE(default_error < max_lsb);
+
+    ToneCurveUtils::parse_curve_points("0:0,0.25:0.15,0.75:0.85,1:1", cfg.curve_points_luma);
+    ToneCurveUtils::parse_curve_points("0:0.05,0.5:0.6,1:0.95", cfg.curve_points_r);
+    float user_error = max_compact_curve_error(cfg, size);
+    std::cout << "  user curves, " << size << " entries: max error " << user_error << " LSB\n";
+    ASSERT_TRUE(user_error < max_lsb);
+}
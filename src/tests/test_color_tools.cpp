@@ -0,0 +1,117 @@
+#include "test_harness.h"
+#include "color_tools.h"
+#include "stage_color_grading.h"
+
+#include <algorithm>
+
+namespace {
+
+// dE76 between two LCh colors, compared as L*a*b*.
+float delta_e_lch(float L1, float C1, float h1, float L2, float C2, float h2) {
+    float da = C1 * std::cos(h1) - C2 * std::cos(h2);
+    float db = C1 * std::sin(h1) - C2 * std::sin(h2);
+    float dL = L1 - L2;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+
+// A grid over the linear sRGB cube, extended to `max_value` (4x for
+// highlights by default), as an (n, n*n, 3) buffer.
+Halide::Buffer<float> make_srgb_grid(int n, float max_value = 4.0f) {
+    Halide::Buffer<float> grid(n, n * n, 3);
+    for (int b = 0; b < n; b++) {
+        for (int g = 0; g < n; g++) {
+            for (int r = 0; r < n; r++) {
+                // Denser near black, where the cube root's linear segment
+                // meets the curve.
+                auto level = [&](int i) { float t = float(i) / (n - 1); return max_value * t * t; };
+                grid(r, g * n + b, 0) = level(r);
+                grid(r, g * n + b, 1) = level(g);
+                grid(r, g * n + b, 2) = level(b);
+            }
+        }
+    }
+    return grid;
+}
+
+float max_delta_e(const Halide::Buffer<float>& lch_a, const Halide::Buffer<float>& lch_b) {
+    float worst = 0.0f;
+    for (int y = 0; y < lch_a.height(); y++) {
+        for (int x = 0; x < lch_a.width(); x++) {
+            worst = std::max(worst, delta_e_lch(lch_a(x, y, 0), lch_a(x, y, 1), lch_a(x, y, 2),
+                                                lch_b(x, y, 0), lch_b(x, y, 1), lch_b(x, y, 2)));
+        }
+    }
+    return worst;
+}
+
+} // namespace
+
+// The fast-math LCh conversions (HalideColor, `fast = true`) must stay
+// within the dE bound documented in color_tools.h of the precise ones.
+void test_color_tools_fast_math() {
+    std::cout << "--- Running test: test_color_tools_fast_math ---\n";
+    const float max_dE = 0.01f;
+    const int n = 33;
+    Halide::Var x, y, c;
+    Halide::Buffer<float> srgb = make_srgb_grid(n);
+    Halide::Func srgb_func = buffer_to_func(srgb, "fast_math_srgb");
+
+    // Forward: linear sRGB -> LCh.
+    Halide::Func precise = HalideColor::linear_srgb_to_lch(srgb_func, x, y, c, false);
+    Halide::Func fast = HalideColor::linear_srgb_to_lch(srgb_func, x, y, c, true);
+    Halide::Buffer<float> lch_precise = precise.realize({n, n * n, 3});
+    Halide::Buffer<float> lch_fast = fast.realize({n, n * n, 3});
+    float forward_dE = max_delta_e(lch_precise, lch_fast);
+    std::cout << "  forward max dE76: " << forward_dE << "\n";
+    ASSERT_TRUE(forward_dE < max_dE);
+
+    // Inverse: LCh -> linear sRGB, from the precise LCh of the same grid,
+    // with both results measured back in LCh through the precise path.
+    Halide::Func lch_func = buffer_to_func(lch_precise, "fast_math_lch");
+    Halide::Func back_precise = HalideColor::lch_to_linear_srgb(lch_func, x, y, c, false);
+    Halide::Func back_fast = HalideColor::lch_to_linear_srgb(lch_func, x, y, c, true);
+    Halide::Func remeasured_precise = HalideColor::linear_srgb_to_lch(back_precise, x, y, c, false);
+    Halide::Func remeasured_fast = HalideColor::linear_srgb_to_lch(back_fast, x, y, c, false);
+    Halide::Buffer<float> round_precise = remeasured_precise.realize({n, n * n, 3});
+    Halide::Buffer<float> round_fast = remeasured_fast.realize({n, n * n, 3});
+    float inverse_dE = max_delta_e(round_precise, round_fast);
+    std::cout << "  inverse max dE76: " << inverse_dE << "\n";
+    ASSERT_TRUE(inverse_dE < max_dE);
+}
+
+// The host-baked RGB LUT (HostColor::generate_rgb_color_lut, applied by
+// RgbLutBuilder) must match the chain it stands in for, LCh -> grading LUT
+// -> linear sRGB, at colours off its nodes, with a non-trivial grade.
+void test_color_tools_baked_look() {
+    std::cout << "--- Running test: test_color_tools_baked_look ---\n";
+    const float max_dE = 1.0f;
+    // 29 levels fall between the 65-node LUT's, so the interpolation is tested.
+    const int n = 29;
+    Halide::Var x, y, c;
+    Halide::Buffer<float> srgb = make_srgb_grid(n, 1.0f);
+    Halide::Func srgb_func = buffer_to_func(srgb, "baked_look_srgb");
+
+    ProcessConfig cfg;
+    cfg.shadows_wheel = {0.05f, -0.1f};
+    cfg.highlights_wheel = {-0.1f, 0.05f};
+    cfg.midtones_luma = 10.0f;
+    // The host's LUTs are channel-innermost; buffer_to_func wants planar.
+    Halide::Runtime::Buffer<float, 4> host_lch_lut = HostColor::generate_color_lut(cfg);
+    Halide::Buffer<float> lch_lut(host_lch_lut.copy_to_planar());
+    Halide::Buffer<float> rgb_lut(HostColor::generate_rgb_color_lut(host_lch_lut).copy_to_planar());
+    Halide::Func lch_lut_func = buffer_to_func(lch_lut, "baked_look_lch_lut");
+    Halide::Func rgb_lut_func = buffer_to_func(rgb_lut, "baked_look_rgb_lut");
+
+    Halide::Func lch = HalideColor::linear_srgb_to_lch(srgb_func, x, y, c);
+    ColorGradeBuilder grade(lch, lch_lut_func, lch_lut.dim(0).extent(), x, y, c);
+    Halide::Func chain = HalideColor::lch_to_linear_srgb(grade.output, x, y, c);
+    RgbLutBuilder baked(srgb_func, rgb_lut_func, rgb_lut.dim(0).extent(), x, y, c);
+
+    Halide::Func chain_lch = HalideColor::linear_srgb_to_lch(chain, x, y, c);
+    Halide::Func baked_lch = HalideColor::linear_srgb_to_lch(baked.output, x, y, c);
+    Halide::Buffer<float> lch_chain = chain_lch.realize({n, n * n, 3});
+    Halide::Buffer<float> lch_baked = baked_lch.realize({n, n * n, 3});
+    float dE = max_delta_e(lch_chain, lch_baked);
+    std::cout << "  baked vs chain max dE76: " << dE << "\n";
+    ASSERT_TRUE(dE < max_dE);
+}
@@ -0,0 +1,32 @@
+#include "test_harness.h"
+#include "stage_csi2_unpack.h"
+
+#include <random>
+
+// Csi2UnpackBuilder must expand packed RAW10 and RAW12 rows to the same
+// samples as the host-side csi2_unpack_row, over random bytes, so every bit
+// of each group's low-bits byte is exercised.
+void test_csi2_unpack_matches_host() {
+    std::cout << "--- Running test: test_csi2_unpack_matches_host ---\n";
+    const int width = 64, height = 4;
+    std::mt19937 rng(1234);
+    for (RawPacking packing : {RawPacking::Csi2Raw10, RawPacking::Csi2Raw12}) {
+        const int row_bytes = raw_packing_row_bytes(packing, width);
+        Halide::Buffer<uint8_t> packed(row_bytes, height);
+        packed.for_each_value([&](uint8_t& v) { v = uint8_t(rng() & 0xff); });
+
+        Halide::Var x, y;
+        Csi2UnpackBuilder unpack(buffer_to_func(packed, "csi2_packed"), packing, x, y);
+        Halide::Buffer<uint16_t> out = unpack.output.realize({width, height});
+
+        std::vector<uint16_t> expected(width);
+        int mismatches = 0;
+        for (int j = 0; j < height; j++) {
+            csi2_unpack_row(packing, &packed(0, j), expected.data(), width);
+            for (int i = 0; i < width; i++) {
+                if (out(i, j) != expected[i]) mismatches++;
+            }
+        }
+        ASSERT_EQUAL(mismatches, 0);
+    }
+}
@@ -0,0 +1,62 @@
+#include "test_harness.h"
+#include "pipeline_schedule.h"
+#include "stage_dehaze.h"
+
+#include <algorithm>
+#include <cmath>
+
+// A scene behind haze: a dark left half and a grey gradient on the right,
+// seen through transmission 0.5 against atmospheric light 0.9.
+static Halide::Buffer<float> hazy_image(int width, int height) {
+    Halide::Buffer<float> b(width, height, 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float scene = x < width / 2 ? 0.05f : 0.2f + 0.6f * float(y) / height;
+            for (int c = 0; c < 3; c++) b(x, y, c) = scene * 0.5f + 0.9f * 0.5f;
+        }
+    }
+    return b;
+}
+
+// Runs DehazeBuilder over `input`, returning the output and, in
+// `transmission`, the refined transmission.
+static Halide::Buffer<float> dehaze(const Halide::Buffer<float>& input, float strength,
+                                    Halide::Buffer<float>* transmission = nullptr) {
+    Halide::Var x, y, c;
+    Halide::Func in = buffer_to_func(input, "dehaze_in");
+    DehazeBuilder dehaze(in, in, strength, input.width(), input.height(), x, y, c);
+    schedule_dehaze_estimate(dehaze, 8);
+    if (transmission) *transmission = dehaze.transmission.realize({input.width(), input.height()});
+    return dehaze.output.realize({input.width(), input.height(), 3});
+}
+
+// Dehaze must deepen the haze-lifted blacks, leave the image alone at
+// strength 0, and estimate the same transmission from a half-size render
+// as from the full one, the grid being fixed to the frame.
+void test_dehaze_estimate() {
+    std::cout << "--- Running test: test_dehaze_estimate ---\n";
+    Halide::Buffer<float> input = hazy_image(384, 256);
+    Halide::Buffer<float> transmission;
+    Halide::Buffer<float> out = dehaze(input, 100.0f, &transmission);
+    std::cout << "  dark half: " << input(40, 128, 0) << " -> " << out(40, 128, 0) << "\n";
+    ASSERT_TRUE(out(40, 128, 0) < input(40, 128, 0) - 0.1f);
+    ASSERT_TRUE(out(40, 128, 0) >= 0.0f);
+
+    Halide::Buffer<float> off = dehaze(input, 0.0f);
+    float worst = 0.0f;
+    off.for_each_element([&](int x, int y, int c) { worst = std::max(worst, std::abs(off(x, y, c) - input(x, y, c))); });
+    ASSERT_TRUE(worst == 0.0f);
+
+    Halide::Buffer<float> half_transmission;
+    dehaze(hazy_image(192, 128), 100.0f, &half_transmission);
+    float worst_t = 0.0f;
+    for (int y = 8; y < 120; y += 8) {
+        for (int x = 8; x < 184; x += 8) {
+            // Away from the step, where the guide sharpens it at either size.
+            if (std::abs(x - 96) < 16) continue;
+            worst_t = std::max(worst_t, std::abs(half_transmission(x, y) - transmission(2 * x, 2 * y)));
+        }
+    }
+    std::cout << "  half vs full size transmission, max difference: " << worst_t << "\n";
+    ASSERT_TRUE(worst_t < 0.05f);
+}
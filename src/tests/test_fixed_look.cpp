@@ -0,0 +1,87 @@
+#include "test_harness.h"
+#include "color_tools.h"
+#include "pipeline_schedule.h"
+#include "stage_color_grading.h"
+#include "stage_dehaze.h"
+#include "stage_fixed_look.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// dE76 between two linear sRGB buffers, measured in L*a*b*.
+float max_delta_e_srgb(const Halide::Buffer<float>& a, const Halide::Buffer<float>& b) {
+    Halide::Var x, y, c;
+    Halide::Buffer<float> lch_a = HalideColor::linear_srgb_to_lch(buffer_to_func(a, "fixed_ref_srgb"), x, y, c)
+                                      .realize({a.width(), a.height(), 3});
+    Halide::Buffer<float> lch_b = HalideColor::linear_srgb_to_lch(buffer_to_func(b, "fixed_out_srgb"), x, y, c)
+                                      .realize({b.width(), b.height(), 3});
+    float worst = 0.0f;
+    for (int yy = 0; yy < a.height(); yy++) {
+        for (int xx = 0; xx < a.width(); xx++) {
+            float da = lch_a(xx, yy, 1) * std::cos(lch_a(xx, yy, 2)) - lch_b(xx, yy, 1) * std::cos(lch_b(xx, yy, 2));
+            float db = lch_a(xx, yy, 1) * std::sin(lch_a(xx, yy, 2)) - lch_b(xx, yy, 1) * std::sin(lch_b(xx, yy, 2));
+            float dL = lch_a(xx, yy, 0) - lch_b(xx, yy, 0);
+            worst = std::max(worst, std::sqrt(dL * dL + da * da + db * db));
+        }
+    }
+    return worst;
+}
+
+} // namespace
+
+// The u16 variant's fixed-point dehaze and baked look (FixedPointLookBuilder)
+// against the float stages they replace (DehazeBuilder, RgbLutBuilder), from
+// the same 16-bit input, under a non-trivial grade.
+void test_fixed_look_vs_float() {
+    std::cout << "--- Running test: test_fixed_look_vs_float ---\n";
+    const float max_dE = 0.5f;
+    const int n = 29;
+    Halide::Var x, y, c;
+
+    // (n, n*n, 3) levels over [0, 1], denser near black, as u16.
+    Halide::Buffer<uint16_t> input(n, n * n, 3);
+    for (int b = 0; b < n; b++) {
+        for (int g = 0; g < n; g++) {
+            for (int r = 0; r < n; r++) {
+                auto level = [&](int i) { float t = float(i) / (n - 1); return uint16_t(t * t * 65535.0f + 0.5f); };
+                input(r, g * n + b, 0) = level(r);
+                input(r, g * n + b, 1) = level(g);
+                input(r, g * n + b, 2) = level(b);
+            }
+        }
+    }
+    Halide::Func input_u16 = buffer_to_func(input, "fixed_look_in");
+    Halide::Func input_f("fixed_look_in_f");
+    input_f(x, y, c) = Halide::cast<float>(input_u16(x, y, c)) / 65535.0f;
+
+    ProcessConfig cfg;
+    cfg.shadows_wheel = {0.05f, -0.1f};
+    cfg.highlights_wheel = {-0.1f, 0.05f};
+    cfg.midtones_luma = 10.0f;
+    Halide::Buffer<float> rgb_lut(HostColor::generate_rgb_color_lut(HostColor::generate_color_lut(cfg)).copy_to_planar());
+    Halide::Func lut_func = buffer_to_func(rgb_lut, "fixed_look_lut");
+
+    for (float strength : {0.0f, 30.0f}) {
+        Halide::Param<float> dehaze_strength;
+        dehaze_strength.set(strength);
+
+        DehazeBuilder dehaze(input_f, input_f, dehaze_strength, n, n * n, x, y, c);
+        schedule_dehaze_estimate(dehaze, 8);
+        RgbLutBuilder baked(dehaze.output, lut_func, rgb_lut.dim(0).extent(), x, y, c);
+        // The fixed path's range, [0, 4).
+        Halide::Func reference("fixed_look_reference");
+        reference(x, y, c) = Halide::clamp(baked.output(x, y, c), 0.0f, 65535.0f / FixedPointLookBuilder::kOutScale);
+
+        FixedPointLookBuilder fixed(input_u16, &dehaze, lut_func, rgb_lut.dim(0).extent(), x, y, c);
+        Halide::Func fixed_f("fixed_look_f");
+        fixed_f(x, y, c) = Halide::cast<float>(fixed.output(x, y, c)) / FixedPointLookBuilder::kOutScale;
+
+        Halide::Buffer<float> ref = reference.realize({n, n * n, 3});
+        Halide::Buffer<float> out = fixed_f.realize({n, n * n, 3});
+        float dE = max_delta_e_srgb(ref, out);
+        std::cout << "  dehaze " << strength << ": fixed vs float max dE76: " << dE << "\n";
+        ASSERT_TRUE(dE < max_dE);
+    }
+}
@@ -0,0 +1,53 @@
+#include "test_harness.h"
+#include "stage_sharpen.h"
+
+#include <algorithm>
+
+// Runs SharpenBuilder_T<float> over `input`.
+static Halide::Buffer<float> sharpen(const Halide::Buffer<float>& input,
+                                     float strength, float radius, float threshold) {
+    Halide::Var x, y, c;
+    SharpenBuilder_T<float> sharpen(buffer_to_func(input, "sharpen_in"), strength, radius, threshold,
+                                    input.width(), input.height(), x, y, c);
+    sharpen.kernel.compute_root();
+    sharpen.luma_x.compute_root();
+    return sharpen.output.realize({input.width(), input.height(), 3});
+}
+
+// A grey vertical step from `low` to `high` at x = 32.
+static Halide::Buffer<float> step_image(float low, float high) {
+    Halide::Buffer<float> b(64, 16, 3);
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < b.height(); y++) {
+            for (int x = 0; x < b.width(); x++) b(x, y, c) = x < 32 ? low : high;
+        }
+    }
+    return b;
+}
+
+// Sharpening must overshoot on both sides of a step and leave the flat areas
+// away from it alone. A step below the threshold is left (nearly) as is, and
+// strength 0 leaves the image untouched.
+void test_sharpen_step_edge() {
+    std::cout << "--- Running test: test_sharpen_step_edge ---\n";
+    Halide::Buffer<float> input = step_image(0.2f, 0.6f);
+    Halide::Buffer<float> out = sharpen(input, 1.0f, 1.0f, 0.02f);
+    std::cout << "  across the edge: " << out(31, 8, 1) << " | " << out(32, 8, 1) << "\n";
+    ASSERT_TRUE(out(31, 8, 1) < 0.18f);
+    ASSERT_TRUE(out(32, 8, 1) > 0.62f);
+    ASSERT_NEAR(out(4, 8, 1), 0.2f, 1e-4f);
+    ASSERT_NEAR(out(60, 8, 1), 0.6f, 1e-4f);
+    // The image's top and bottom rows are clamped, not darkened.
+    ASSERT_NEAR(out(32, 0, 1), out(32, 8, 1), 1e-4f);
+
+    auto max_change = [](const Halide::Buffer<float>& a, const Halide::Buffer<float>& b) {
+        float worst = 0.0f;
+        a.for_each_element([&](int x, int y, int c) { worst = std::max(worst, std::abs(a(x, y, c) - b(x, y, c))); });
+        return worst;
+    };
+    Halide::Buffer<float> faint = step_image(0.2f, 0.21f);
+    ASSERT_TRUE(max_change(faint, sharpen(faint, 1.0f, 1.0f, 0.001f)) > 1e-3f);
+    ASSERT_TRUE(max_change(faint, sharpen(faint, 1.0f, 1.0f, 0.1f)) < 1e-4f);
+
+    ASSERT_TRUE(max_change(input, sharpen(input, 0.0f, 1.0f, 0.02f)) == 0.0f);
+}
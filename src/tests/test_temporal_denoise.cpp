@@ -0,0 +1,70 @@
+#include "test_harness.h"
+#include "pipeline_schedule.h"
+
+#include <random>
+
+// Runs TemporalDenoiseBuilder once: `frame` blended with `history`.
+static Halide::Buffer<uint16_t> temporal_step(const Halide::Buffer<uint16_t>& frame,
+                                              const Halide::Buffer<uint16_t>& history,
+                                              float sigma, float strength) {
+    Halide::Var x, y;
+    TemporalDenoiseBuilder td(buffer_to_func(frame, "td_frame"), buffer_to_func(history, "td_history"),
+                              frame.width(), frame.height(), sigma, strength, x, y);
+    schedule_temporal_denoise(false, Halide::get_host_target(), td, x, y, 32);
+    return td.output.realize({frame.width(), frame.height()});
+}
+
+// A static scene under fresh noise each frame: after a run of frames the
+// recursive average must be well closer to the clean scene than one frame.
+// Then the scene changes: the first frame after the change must follow it
+// rather than ghost the old content.
+void test_temporal_denoise_static_and_motion() {
+    std::cout << "--- Running test: test_temporal_denoise_static_and_motion ---\n";
+    const int width = 64, height = 64, frames = 12;
+    const float sigma = 24.0f, strength = 0.8f;
+
+    auto scene = [](int x, int y) {
+        return 1000.0f + 400.0f * std::sin(x * 0.11f) * std::cos(y * 0.07f);
+    };
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, sigma);
+    auto noisy_frame = [&](float offset) {
+        Halide::Buffer<uint16_t> b(width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                b(x, y) = uint16_t(std::min(std::max(scene(x, y) + offset + noise(rng), 0.0f), 65535.0f));
+            }
+        }
+        return b;
+    };
+    auto rms_error = [&](const Halide::Buffer<uint16_t>& b, float offset) {
+        double err = 0.0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) err += std::pow(b(x, y) - (scene(x, y) + offset), 2);
+        }
+        return std::sqrt(err / (width * height));
+    };
+
+    Halide::Buffer<uint16_t> first = noisy_frame(0.0f);
+    Halide::Buffer<uint16_t> history = first;
+    for (int n = 1; n < frames; n++) history = temporal_step(noisy_frame(0.0f), history, sigma, strength);
+    const double single_err = rms_error(first, 0.0f), averaged_err = rms_error(history, 0.0f);
+    std::cout << "  single frame rms error " << single_err << ", after " << frames << " frames " << averaged_err << "\n";
+    ASSERT_TRUE(averaged_err < 0.6 * single_err);
+
+    // A 20-sigma change: the gate must drop the history.
+    const float step = 20.0f * sigma;
+    Halide::Buffer<uint16_t> moved = noisy_frame(step);
+    Halide::Buffer<uint16_t> out = temporal_step(moved, history, sigma, strength);
+    const double ghost_err = rms_error(out, step);
+    std::cout << "  after a scene change, rms error " << ghost_err << "\n";
+    ASSERT_TRUE(ghost_err < 2.0 * sigma);
+
+    // Strength 0 is the still path: the frame, untouched.
+    Halide::Buffer<uint16_t> bypass = temporal_step(moved, history, sigma, 0.0f);
+    bool identical = true;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) identical &= bypass(x, y) == moved(x, y);
+    }
+    ASSERT_TRUE(identical);
+}
@@ -0,0 +1,332 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "HalideRuntime.h"
+
+// One set of worker threads for everything that runs in parallel: Halide's
+// parallel loops (through halide_set_custom_do_par_for), PNG strip deflate,
+// and whatever else calls parallel_for. Without it each of those brings its
+// own threads, and a batch run with decoders, encoders and the pipeline busy
+// at once oversubscribes the cores.
+//
+// parallel_for posts the loop and the calling thread works on it too until
+// every index is taken, so a loop started from inside another (Halide's
+// nested parallelism) always makes progress. Idle workers take indices from
+// the oldest loop first.
+//
+// With Cores::Numa on a multi-socket machine, the workers are spread over
+// the NUMA nodes and pinned to their node's cores, and every loop is split
+// into one contiguous block of indices per node. A node's threads take from
+// its own block before helping with the others'. For the schedules' strip
+// loops that means a node computes the same band of rows every run, so the
+// rows it first-touches, in root-level intermediates and in buffers placed
+// with for_each_node_block, are in its own memory.
+class ThreadPool {
+public:
+    enum class Cores { All, Big, Numa };
+
+    // --affinity: "big", "numa", else all.
+    static Cores cores_named(const std::string& name) {
+        if (name == "big") return Cores::Big;
+        if (name == "numa") return Cores::Numa;
+        return Cores::All;
+    }
+
+    static ThreadPool& get() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ~ThreadPool() { stop(); }
+
+    // Starts `threads` workers (-1 = one per core in the chosen set, less
+    // the caller). With Cores::Big the workers, and the calling thread, are
+    // pinned to the fastest cores of a big.LITTLE CPU. With Cores::Numa
+    // each worker is pinned to one node's cores, the nodes taking equal
+    // shares; the calling thread is left where it is.
+    void start(int threads, Cores cores = Cores::All) {
+        stop();
+        std::vector<int> cpus = cores == Cores::Big ? big_cores() : std::vector<int>();
+        nodes_ = cores == Cores::Numa ? numa_nodes() : std::vector<std::vector<int>>();
+        if (threads < 0) {
+            const int available = cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency())
+                                               : static_cast<int>(cpus.size());
+            threads = std::max(0, available - 1);
+        }
+        if (!cpus.empty()) pin_current_thread(cpus);
+        quit_ = false;
+        for (int i = 0; i < threads; ++i) {
+            // Workers 0..threads-1 over the nodes in order, so with the
+            // caller on any node each gets about threads / nodes + 1.
+            const int node = nodes_.empty() ? 0 : static_cast<int>(int64_t(i) * nodes_.size() / threads);
+            const std::vector<int> node_cpus = nodes_.empty() ? cpus : nodes_[node];
+            workers_.emplace_back([this, node_cpus, node] {
+                if (!node_cpus.empty()) pin_current_thread(node_cpus);
+                home_node() = node;
+                work();
+            });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+        workers_.clear();
+    }
+
+    // Sets up Halide's parallelism: `threads` in all (0 = the runtime's
+    // default), on the shared pool if `shared`, else on Halide's own. With
+    // Cores::Big and Halide's own pool the calling thread is pinned, which
+    // Halide's workers inherit when they are first started. Cores::Numa
+    // always uses the shared pool: Halide's own can't split loops by node.
+    // Call before any pipeline runs, or at least while none does.
+    void configure_halide(int threads, bool shared, Cores cores) {
+        if (shared || cores == Cores::Numa) {
+            start(threads > 0 ? threads - 1 : -1, cores);
+            halide_set_custom_do_par_for(&ThreadPool::halide_do_par_for);
+            return;
+        }
+        stop();
+        halide_set_custom_do_par_for(&halide_default_do_par_for);
+        if (threads > 0) halide_set_num_threads(threads);
+        if (cores == Cores::Big) {
+            const std::vector<int> cpus = big_cores();
+            if (!cpus.empty()) pin_current_thread(cpus);
+        }
+    }
+
+    bool running() const { return !workers_.empty(); }
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+    // NUMA nodes the loops are split over; 1 unless started with Cores::Numa
+    // on a multi-node machine.
+    int node_count() const { return nodes_.empty() ? 1 : static_cast<int>(nodes_.size()); }
+
+    // Runs body(i) for i in [begin, end) and returns once all have finished.
+    // With no workers it runs them in order on the calling thread.
+    void parallel_for(int begin, int end, const std::function<void(int)>& body) {
+        if (end <= begin) return;
+        if (workers_.empty() || end - begin == 1) {
+            for (int i = begin; i < end; ++i) body(i);
+            return;
+        }
+        const int blocks = node_count();
+        auto loop = std::make_shared<Loop>(blocks);
+        for (int b = 0; b < blocks; ++b) {
+            loop->blocks[b].next = begin + static_cast<int>(int64_t(end - begin) * b / blocks);
+            loop->blocks[b].end = begin + static_cast<int>(int64_t(end - begin) * (b + 1) / blocks);
+        }
+        loop->count = end - begin;
+        loop->body = &body;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            loops_.push_back(loop);
+        }
+        cv_.notify_all();
+        const int home = blocks > 1 ? current_node() : 0;
+        while (run_one(*loop, home)) {}
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return loop->finished == loop->count; });
+    }
+
+    // Runs body(begin, end) over `rows` split into one contiguous band per
+    // node, each on that node's threads, in parallel. Writing a freshly
+    // allocated buffer this way places each band in the memory of the node
+    // whose strips read it (first touch), as long as the strip loop covers
+    // the same rows. A single band on the calling thread without nodes.
+    void for_each_node_block(int rows, const std::function<void(int, int)>& body) {
+        // A few pieces per thread, so a node's threads share its band.
+        const int pieces = std::min(rows, size() * 4);
+        parallel_for(0, pieces, [&](int i) {
+            body(static_cast<int>(int64_t(rows) * i / pieces), static_cast<int>(int64_t(rows) * (i + 1) / pieces));
+        });
+    }
+
+    // For halide_set_custom_do_par_for. Each index still goes through
+    // halide_do_task, so a custom do_task (the editor's cancellation) keeps
+    // working. Loops with async producers use halide_do_parallel_tasks and
+    // stay on Halide's own threads.
+    static int halide_do_par_for(void* user_context, halide_task_t f, int min, int size, uint8_t* closure) {
+        std::atomic<int> result{0};
+        get().parallel_for(min, min + size, [&](int i) {
+            if (result.load(std::memory_order_relaxed) != 0) return;
+            int r = halide_do_task(user_context, f, i, closure);
+            if (r != 0) result.store(r);
+        });
+        return result.load();
+    }
+
+    // The cores with the highest maximum frequency, if they differ between
+    // cores (big.LITTLE); empty if they don't or it can't be told.
+    static std::vector<int> big_cores() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        std::vector<long> freqs;
+        const int n = static_cast<int>(std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < n; ++cpu) {
+            const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq";
+            long freq = 0;
+            if (FILE* f = fopen(path.c_str(), "r")) {
+                if (fscanf(f, "%ld", &freq) != 1) freq = 0;
+                fclose(f);
+            }
+            freqs.push_back(freq);
+        }
+        if (freqs.empty()) return cpus;
+        const auto range = std::minmax_element(freqs.begin(), freqs.end());
+        if (*range.first == 0 || *range.first == *range.second) return cpus;
+        for (int cpu = 0; cpu < n; ++cpu) {
+            if (freqs[cpu] == *range.second) cpus.push_back(cpu);
+        }
+#endif
+        return cpus;
+    }
+
+    // The CPUs of each NUMA node, from /sys/devices/system/node; empty
+    // unless there are at least two nodes with CPUs.
+    static std::vector<std::vector<int>> numa_nodes() {
+        std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+        for (int node = 0;; ++node) {
+            const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+            FILE* f = fopen(path.c_str(), "r");
+            if (!f) break;
+            // "0-15,32-47"
+            std::vector<int> cpus;
+            int first = 0, last = 0;
+            char sep = 0;
+            while (fscanf(f, "%d", &first) == 1) {
+                last = first;
+                if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+                    if (fscanf(f, "%d", &last) != 1) break;
+                    if (fscanf(f, "%c", &sep) != 1) sep = 0;
+                }
+                for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+                if (sep != ',') break;
+            }
+            fclose(f);
+            if (!cpus.empty()) nodes.push_back(cpus);
+        }
+        if (nodes.size() < 2) nodes.clear();
+#endif
+        return nodes;
+    }
+
+    static void pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)cpus;
+#endif
+    }
+
+private:
+    // A loop's indices, one contiguous block per node.
+    struct Block {
+        std::atomic<int> next{0};
+        int end = 0;
+    };
+    struct Loop {
+        explicit Loop(int blocks) : blocks(blocks) {}
+        std::vector<Block> blocks;
+        int count = 0;
+        int finished = 0; // Guarded by mutex_.
+        const std::function<void(int)>* body = nullptr;
+
+        bool taken() const {
+            for (const Block& b : blocks) {
+                if (b.next.load() < b.end) return false;
+            }
+            return true;
+        }
+    };
+
+    // The node of the calling thread: set for workers, looked up from the
+    // CPU it is running on for others.
+    static int& home_node() {
+        thread_local int node = -1;
+        return node;
+    }
+
+    int current_node() const {
+        if (home_node() >= 0) return home_node();
+#ifdef __linux__
+        const int cpu = sched_getcpu();
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+            if (std::find(nodes_[n].begin(), nodes_[n].end(), cpu) != nodes_[n].end()) return static_cast<int>(n);
+        }
+#endif
+        return 0;
+    }
+
+    // Takes and runs one index of `loop`, from block `home` while it lasts,
+    // then from the others; false once none are left.
+    bool run_one(Loop& loop, int home) {
+        const int blocks = static_cast<int>(loop.blocks.size());
+        for (int k = 0; k < blocks; ++k) {
+            Block& block = loop.blocks[(home + k) % blocks];
+            if (block.next.load(std::memory_order_relaxed) >= block.end) continue;
+            const int i = block.next.fetch_add(1);
+            if (i >= block.end) continue;
+            (*loop.body)(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                loop.finished++;
+            }
+            done_.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    void work() {
+        const int home = std::max(0, home_node());
+        for (;;) {
+            std::shared_ptr<Loop> loop;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] {
+                    while (!loops_.empty() && loops_.front()->taken()) loops_.pop_front();
+                    return quit_ || !loops_.empty();
+                });
+                if (quit_) return;
+                loop = loops_.front();
+            }
+            while (run_one(*loop, home % static_cast<int>(loop->blocks.size()))) {}
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;   // Workers wait for loops.
+    std::condition_variable done_; // Callers wait for their loop's last index.
+    std::deque<std::shared_ptr<Loop>> loops_;
+    std::vector<std::thread> workers_;
+    std::vector<std::vector<int>> nodes_; // CPUs per node with Cores::Numa.
+    bool quit_ = false;
+};
+
+#endif // THREAD_POOL_H
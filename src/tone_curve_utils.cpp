@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iomanip>
 #include <set>
+#include <thread>
 
 // The STB implementation define should only exist in ONE .cpp file.
 #if defined(__GNUC__) || defined(__clang__)
@@ -47,11 +48,17 @@ template <typename T> int sign(T val) {
 }
 
 // The core LUT generation function, now implementing a Monotone Cubic Hermite Spline.
-void generate_lut_channel(const ProcessConfig& cfg, const std::vector<Point>& user_points, uint16_t* lut_col, int lut_size, bool apply_base_tonemap) {
+// `sqrt_shaped` places entry i at (i / (lut_size - 1))^2 instead of i / (lut_size - 1).
+void generate_lut_channel(const ProcessConfig& cfg, const std::vector<Point>& user_points, uint16_t* lut_col, int lut_size, bool apply_base_tonemap,
+                          bool sqrt_shaped = false) {
+    auto input_at = [&](int i) {
+        float t = static_cast<float>(i) / (lut_size - 1.0f);
+        return sqrt_shaped ? t * t : t;
+    };
     if (user_points.empty()) {
         // If no user points, generate a default S-curve based on contrast and fall back.
         for (int i = 0; i < lut_size; ++i) {
-            float linear_val = static_cast<float>(i) / (lut_size - 1.0f);
+            float linear_val = input_at(i);
             float tonemapped_val = apply_base_tonemap ? powf(linear_val, 1.0f/2.2f) : linear_val;
             float b = 2.0f - powf(2.0f, cfg.contrast / 100.0f);
             float a = 2.0f - 2.0f * b;
@@ -66,7 +73,7 @@ void generate_lut_channel(const ProcessConfig& cfg, const std::vector<Point>& us
     Spline s(user_points, 1.0f, false, true);
 
     for (int i = 0; i < lut_size; ++i) {
-        float linear_val = static_cast<float>(i) / (lut_size - 1.0f);
+        float linear_val = input_at(i);
         float tonemapped_val = apply_base_tonemap ? powf(linear_val, 1.0f/2.2f) : linear_val;
         float final_val = s.evaluate(tonemapped_val);
         lut_col[i] = static_cast<uint16_t>(std::max(0.0f, std::min(65535.0f, final_val * 65535.0f + 0.5f)));
@@ -167,7 +174,12 @@ float Spline::evaluate(float x) const {
 
 
 Halide::Runtime::Buffer<uint16_t, 2> generate_pipeline_lut(const ProcessConfig& cfg) {
-    Halide::Runtime::Buffer<uint16_t, 2> lut_buffer(65536, 3);
+    return generate_pipeline_lut(cfg, cfg.tone_curve_size > 0 ? cfg.tone_curve_size : kFullToneCurveSize);
+}
+
+Halide::Runtime::Buffer<uint16_t, 2> generate_pipeline_lut(const ProcessConfig& cfg, int size) {
+    Halide::Runtime::Buffer<uint16_t, 2> lut_buffer(size, 3);
+    const bool shaped = size < kFullToneCurveSize;
     const auto& luma_pts = cfg.curve_points_luma;
     const auto& r_pts = cfg.curve_points_r;
     const auto& g_pts = cfg.curve_points_g;
@@ -178,9 +190,16 @@ Halide::Runtime::Buffer<uint16_t, 2> generate_pipeline_lut(const ProcessConfig&
     bool has_g_curve = !g_pts.empty();
     bool has_b_curve = !b_pts.empty();
 
-    generate_lut_channel(cfg, has_r_curve ? r_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 0), lut_buffer.width(), true);
-    generate_lut_channel(cfg, has_g_curve ? g_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 1), lut_buffer.width(), true);
-    generate_lut_channel(cfg, has_b_curve ? b_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 2), lut_buffer.width(), true);
+    // The three channels are independent tables; build them concurrently.
+    std::thread r_worker([&] {
+        generate_lut_channel(cfg, has_r_curve ? r_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 0), lut_buffer.width(), true, shaped);
+    });
+    std::thread g_worker([&] {
+        generate_lut_channel(cfg, has_g_curve ? g_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 1), lut_buffer.width(), true, shaped);
+    });
+    generate_lut_channel(cfg, has_b_curve ? b_pts : (has_luma_curve ? luma_pts : std::vector<Point>()), &lut_buffer(0, 2), lut_buffer.width(), true, shaped);
+    r_worker.join();
+    g_worker.join();
 
     return lut_buffer;
 }
@@ -225,7 +244,7 @@ void average_rgb_to_luma(ProcessConfig& cfg) {
 }
 
 bool render_curves_to_png(const ProcessConfig& cfg, const char* filename, int width, int height) {
-    auto lut_buffer = generate_pipeline_lut(cfg);
+    auto lut_buffer = generate_pipeline_lut(cfg, kFullToneCurveSize);
     std::vector<uint8_t> pixels(width * height * 3);
     std::fill(pixels.begin(), pixels.end(), 20); // Dark background
 
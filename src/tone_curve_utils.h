@@ -45,8 +45,17 @@ namespace ToneCurveUtils {
         bool is_identity_val;
     };
 
-    // Generates the final, combined LUT for the Halide pipeline.
+    // Entries of the full tone curve LUT, indexed linearly by the 16-bit
+    // value. A LUT with fewer entries is sqrt-shaped, entry i holding the
+    // curve at (i / (size - 1))^2, and pipeline_apply_curve interpolates
+    // linearly between entries. The shaper follows the gamma's steep toe, so
+    // 1024 entries track the full table to about 1 (16-bit) LSB.
+    constexpr int kFullToneCurveSize = 65536;
+
+    // Generates the final, combined LUT for the Halide pipeline, with
+    // cfg.tone_curve_size entries (kFullToneCurveSize if 0).
     Halide::Runtime::Buffer<uint16_t, 2> generate_pipeline_lut(const ProcessConfig& cfg);
+    Halide::Runtime::Buffer<uint16_t, 2> generate_pipeline_lut(const ProcessConfig& cfg, int size);
 
     // Generates a LUT that only reflects the user's curve against a linear baseline.
     void generate_linear_lut(const ProcessConfig& cfg, Halide::Runtime::Buffer<uint16_t, 2>& out_lut);
@@ -0,0 +1,179 @@
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "HalideRuntime.h"
+
+// A recorder for Chrome trace events (chrome://tracing, ui.perfetto.dev).
+//
+// While recording, Instrumentation::ScopedTimer scopes (instrumentation.h),
+// TraceEvents::Scope spans and - for pipelines built with the
+// trace_pipeline/trace_realizations target features and `halide_trace_hook`
+// installed - Halide's pipeline and per-Func produce spans are kept as
+// complete ("X") events stamped with a small per-thread id, and `write`
+// dumps them as one JSON file. When not recording, a scope costs one
+// relaxed atomic load.
+namespace TraceEvents {
+
+using Clock = std::chrono::steady_clock;
+
+class Recorder {
+public:
+    static Recorder& get() {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    // Discards anything recorded so far and starts recording.
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+        pending_.clear();
+        origin_ = Clock::now();
+        active_.store(true, std::memory_order_release);
+    }
+
+    void stop() { active_.store(false, std::memory_order_release); }
+    bool active() const { return active_.load(std::memory_order_relaxed); }
+
+    void complete(const std::string& name, const char* category, Clock::time_point begin, Clock::time_point end) {
+        if (!active()) return;
+        const uint32_t tid = thread_id();
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(Event{name, category, micros(begin), micros(end) - micros(begin), tid});
+    }
+
+    // Stops recording and writes the events to `path`. Returns false if the
+    // file can't be written.
+    bool write(const std::string& path) {
+        stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) return false;
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (size_t i = 0; i < events_.size(); ++i) {
+            const Event& e = events_[i];
+            fprintf(f, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": 1, \"tid\": %u}%s\n",
+                    escape(e.name).c_str(), e.category, (long long)e.ts_us, (long long)e.dur_us, e.tid,
+                    i + 1 < events_.size() ? "," : "");
+        }
+        fprintf(f, "]}\n");
+        fclose(f);
+        events_.clear();
+        return true;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return events_.size();
+    }
+
+    // Sequential ids in the order threads first record something, so the
+    // main thread is usually 1 and Halide's workers follow.
+    static uint32_t thread_id() {
+        static std::atomic<uint32_t> next{1};
+        thread_local uint32_t id = next.fetch_add(1);
+        return id;
+    }
+
+    // For halide_set_custom_trace. Turns begin/end pipeline and produce/
+    // end produce pairs into spans; other events are ignored (loads and
+    // stores are never traced by the features above).
+    static int32_t halide_trace_hook(void* /*user_context*/, const halide_trace_event_t* e) {
+        Recorder& r = get();
+        static std::atomic<int32_t> next_id{1};
+        const int32_t id = next_id.fetch_add(1);
+        if (!r.active()) return id;
+        switch (e->event) {
+            case halide_trace_begin_pipeline:
+            case halide_trace_produce: {
+                Pending p{e->func, e->event == halide_trace_begin_pipeline ? "pipeline" : "func", Clock::now(), thread_id()};
+                std::lock_guard<std::mutex> lock(r.mutex_);
+                r.pending_[id] = std::move(p);
+                break;
+            }
+            case halide_trace_end_pipeline:
+            case halide_trace_end_produce: {
+                const Clock::time_point end = Clock::now();
+                std::lock_guard<std::mutex> lock(r.mutex_);
+                auto it = r.pending_.find(e->parent_id);
+                if (it == r.pending_.end()) break;
+                const Pending& p = it->second;
+                r.events_.push_back(Event{p.name, p.category, r.micros(p.begin), r.micros(end) - r.micros(p.begin), p.tid});
+                r.pending_.erase(it);
+                break;
+            }
+            default:
+                break;
+        }
+        return id;
+    }
+
+private:
+    struct Event {
+        std::string name;
+        const char* category;
+        int64_t ts_us, dur_us;
+        uint32_t tid;
+    };
+    struct Pending {
+        std::string name;
+        const char* category;
+        Clock::time_point begin;
+        uint32_t tid;
+    };
+
+    // Scopes already open when recording started are clipped to its start.
+    int64_t micros(Clock::time_point t) const {
+        return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(t - origin_).count());
+    }
+
+    static std::string escape(const std::string& s) {
+        std::string out;
+        for (char ch : s) {
+            if (ch == '"' || ch == '\\') out += '\\';
+            if (static_cast<unsigned char>(ch) >= 0x20) out += ch;
+        }
+        return out;
+    }
+
+    std::atomic<bool> active_{false};
+    std::mutex mutex_;
+    Clock::time_point origin_ = Clock::now();
+    std::vector<Event> events_;
+    std::unordered_map<int32_t, Pending> pending_;
+};
+
+// Records a span from construction to destruction while recording.
+class Scope {
+public:
+    explicit Scope(const char* name, const char* category = "host")
+        : name_(name), category_(category), active_(Recorder::get().active()) {
+        if (active_) begin_ = Clock::now();
+    }
+    ~Scope() {
+        if (active_) Recorder::get().complete(name_, category_, begin_, Clock::now());
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name_;
+    const char* category_;
+    bool active_;
+    Clock::time_point begin_;
+};
+
+} // namespace TraceEvents
+
+#endif // TRACE_EVENTS_H
@@ -0,0 +1,68 @@
+#ifndef WHITE_BALANCE_H
+#define WHITE_BALANCE_H
+
+#include <algorithm>
+#include <cmath>
+
+// Temperature/tint white balance, shared by the pipeline hosts and the
+// camera frontend, which has no raw loader to link against.
+namespace PipelineUtils {
+
+struct RGBGains { float r, g, b; };
+
+// Calculates white balance gains for a given temperature and tint.
+inline RGBGains kelvin_to_rgb_gains(float temp, float tint) {
+    // This is a standard algorithm for converting temperature to RGB multipliers,
+    // based on the method used in dcraw.
+    double r, g, b;
+    double temp_d = temp;
+
+    if (temp_d <= 6600.0) {
+        r = 255.0;
+        double g_temp = temp_d / 100.0;
+        g = 99.4708025861 * std::log(g_temp) - 161.1195681661;
+
+        if (temp_d <= 1900.0) {
+            b = 0;
+        } else {
+            double b_temp = (temp_d - 600.0) / 100.0;
+            b = 138.5177312231 * std::log(b_temp) - 305.0447927307;
+        }
+    } else {
+        double r_temp = (temp_d - 6000.0) / 100.0;
+        r = 329.698727446 * std::pow(r_temp, -0.1332047592);
+        
+        double g_temp = (temp_d - 6000.0) / 100.0;
+        g = 288.1221695283 * std::pow(g_temp, -0.0755148492);
+
+        b = 255.0;
+    }
+
+    r = std::max(0.0, std::min(255.0, r));
+    g = std::max(0.0, std::min(255.0, g));
+    b = std::max(0.0, std::min(255.0, b));
+    
+    // Apply tint, which primarily adjusts the green channel.
+    // A positive tint value should shift towards magenta (less green).
+    g *= (1.0 - tint * 0.5);
+
+    // To white balance, we need gains that are inversely proportional to the light color.
+    // We normalize these gains so the green channel multiplier is 1.0.
+    RGBGains final_gains;
+    if (r > 1e-6 && g > 1e-6 && b > 1e-6) {
+        final_gains.r = static_cast<float>(g / r);
+        final_gains.g = 1.0f;
+        final_gains.b = static_cast<float>(g / b);
+    } else {
+        // Avoid division by zero in extreme cases, return neutral gains.
+        final_gains.r = 1.0f;
+        final_gains.g = 1.0f;
+        final_gains.b = 1.0f;
+    }
+
+    return final_gains;
+}
+
+} // namespace PipelineUtils
+
+#endif // WHITE_BALANCE_H
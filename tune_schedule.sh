@@ -0,0 +1,86 @@
+#!/bin/bash
+# Schedule tuning sweep: rebuilds process_f32 for every combination of the
+# CPU schedule's tiling params (CpuTiling in src/pipeline_schedule.h), times
+# it on a raw file and records the fastest under this machine's target
+# triple in schedule_tuning.txt, which later builds use automatically.
+#
+#   ./tune_schedule.sh bayer_raw.png
+#   ITERATIONS=20 ./tune_schedule.sh bayer_raw.png --demosaic ahd
+#
+# Extra arguments after the raw file are passed to process_f32, so tune
+# with the settings the pipeline is normally run with. Each point is a full
+# generator run and rebuild, so the sweep takes a while.
+#
+# Note: This script is compatible with Bash 3.x (default on macOS) and newer versions.
+set -e # Exit immediately if a command exits with a non-zero status.
+
+BUILD_DIR="build"
+TUNING_FILE="schedule_tuning.txt"
+ITERATIONS=${ITERATIONS:-10}
+
+STRIP_SIZES="16 32 64"
+TILE_WIDTHS="128 256 512"
+CUTOVER_LEVELS="2 3"
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <raw file> [process_f32 options...]" >&2
+    exit 1
+fi
+INPUT="$1"
+shift
+
+if [ ! -d "$BUILD_DIR" ] || [ ! -f "$BUILD_DIR/CMakeCache.txt" ]; then
+    echo "Error: Build directory '$BUILD_DIR' not found or not configured." >&2
+    echo "Please run 'cmake -S . -B $BUILD_DIR -DHalide_DIR=...' at least once before running this script." >&2
+    exit 1
+fi
+
+# Same as HALIDE_TARGET_TRIPLE in CMakeLists.txt for a host target.
+case "$(uname -m)" in
+    x86_64|amd64) ARCH="x86-64" ;;
+    aarch64|arm64) ARCH="arm-64" ;;
+    arm*) ARCH="arm-32" ;;
+    *) ARCH="$(uname -m)" ;;
+esac
+case "$(uname -s)" in
+    Darwin) OS="osx" ;;
+    MINGW*|MSYS*|CYGWIN*) OS="windows" ;;
+    *) OS="linux" ;;
+esac
+TRIPLE="$ARCH-$OS"
+
+BUILD_JOBS=$( (which nproc > /dev/null && nproc) || sysctl -n hw.ncpu )
+OUTPUT="${TMPDIR:-/tmp}/tune_schedule_$$.png"
+trap 'rm -f "$OUTPUT"; cmake -B "$BUILD_DIR" -DCAMERA_PIPE_SCHEDULE= > /dev/null' EXIT
+
+BEST_MS=""
+BEST_PARAMS=""
+for STRIP in $STRIP_SIZES; do
+    for TILE in $TILE_WIDTHS; do
+        for CUTOVER in $CUTOVER_LEVELS; do
+            PARAMS="strip_size=$STRIP tile_width=$TILE cutover_level=$CUTOVER"
+            cmake -B "$BUILD_DIR" -DCAMERA_PIPE_SCHEDULE="$PARAMS" > /dev/null
+            cmake --build "$BUILD_DIR" --target process_f32 -- -j$BUILD_JOBS > /dev/null
+            MS=$("$BUILD_DIR/process_f32" --input "$INPUT" --output "$OUTPUT" --iterations "$ITERATIONS" "$@" |
+                 sed -n 's/^Halide pipeline execution time: \([0-9.]*\) ms$/\1/p')
+            if [ -z "$MS" ]; then
+                echo "Error: no timing from process_f32 for $PARAMS" >&2
+                exit 1
+            fi
+            printf "%-70s %10.2f ms\n" "$PARAMS" "$MS"
+            if [ -z "$BEST_MS" ] || awk -v a="$MS" -v b="$BEST_MS" 'BEGIN { exit !(a < b) }'; then
+                BEST_MS="$MS"
+                BEST_PARAMS="$PARAMS"
+            fi
+        done
+    done
+done
+
+echo "Fastest on $TRIPLE: $BEST_PARAMS ($BEST_MS ms)"
+
+# Replace this triple's line, keeping the others.
+touch "$TUNING_FILE"
+grep -v "^$TRIPLE[[:space:]]" "$TUNING_FILE" > "$TUNING_FILE.tmp" || true
+echo "$TRIPLE $BEST_PARAMS" >> "$TUNING_FILE.tmp"
+mv "$TUNING_FILE.tmp" "$TUNING_FILE"
+echo "Wrote $TUNING_FILE; re-run cmake to build with it."
@@ -0,0 +1,80 @@
+// A thin wrapper over the C API of src/openraw_preview.h, for the review
+// tool's preview worker:
+//
+//   import { OpenrawPreview } from './openraw_preview.js';
+//   const preview = await OpenrawPreview.create();
+//   preview.loadFront(new Uint8Array(await (await fetch('photo.front')).arrayBuffer()));
+//   preview.setOptions('--contrast 95 --tonemap reinhard');
+//   const image = preview.render();   // ImageData, RGBA
+//
+// The entry comes from process_f32 --input photo.dng --downscale 4
+// --front-out photo.front on the server. render() copies the pixels out of
+// the module's memory, so the ImageData can be transferred to the page.
+import createOpenrawPreviewModule from './openraw_preview_wasm.js';
+
+export class OpenrawPreview {
+    static async create(moduleOptions = {}) {
+        const module = await createOpenrawPreviewModule(moduleOptions);
+        return new OpenrawPreview(module);
+    }
+
+    constructor(module) {
+        this.module = module;
+        const fn = (name, ret, args) => module.cwrap(name, ret, args);
+        this.api = {
+            create: fn('openraw_preview_create', 'number', []),
+            destroy: fn('openraw_preview_destroy', null, ['number']),
+            loadFront: fn('openraw_preview_load_front', 'number', ['number', 'number', 'number']),
+            setOptions: fn('openraw_preview_set_options', 'number', ['number', 'string']),
+            render: fn('openraw_preview_render', 'number', ['number']),
+            pixels: fn('openraw_preview_pixels', 'number', ['number']),
+            width: fn('openraw_preview_width', 'number', ['number']),
+            height: fn('openraw_preview_height', 'number', ['number']),
+            histogram: fn('openraw_preview_histogram', 'number', ['number']),
+            error: fn('openraw_preview_error', 'number', ['number']),
+        };
+        this.handle = this.api.create();
+    }
+
+    // Loads a front-end cache entry (a Uint8Array).
+    loadFront(bytes) {
+        const data = this.module._malloc(bytes.length);
+        try {
+            this.module.HEAPU8.set(bytes, data);
+            if (this.api.loadFront(this.handle, data, bytes.length) !== 0) this.fail('loadFront');
+        } finally {
+            this.module._free(data);
+        }
+    }
+
+    // Sets the look as process options over the defaults.
+    setOptions(options) {
+        if (this.api.setOptions(this.handle, options) !== 0) this.fail('setOptions');
+    }
+
+    // Renders the loaded front end with the look, as an ImageData.
+    render() {
+        const result = this.api.render(this.handle);
+        if (result !== 0) this.fail(`render (error ${result})`);
+        const width = this.api.width(this.handle), height = this.api.height(this.handle);
+        const pixels = this.api.pixels(this.handle);
+        // slice() copies: the module's memory is shared and may grow.
+        const rgba = new Uint8ClampedArray(this.module.HEAPU8.slice(pixels, pixels + width * height * 4).buffer);
+        return new ImageData(rgba, width, height);
+    }
+
+    // The last render's 256 bins x (R, G, B, luma) counts, as a Uint32Array.
+    histogram() {
+        const bins = this.api.histogram(this.handle) / 4;
+        return this.module.HEAPU32.slice(bins, bins + 256 * 4);
+    }
+
+    destroy() {
+        this.api.destroy(this.handle);
+        this.handle = 0;
+    }
+
+    fail(what) {
+        throw new Error(`openraw preview ${what}: ${this.module.UTF8ToString(this.api.error(this.handle))}`);
+    }
+}
@@ -0,0 +1,166 @@
+#include "openraw_preview.h"
+
+#include <exception>
+#include <string>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#define PREVIEW_EXPORT EMSCRIPTEN_KEEPALIVE
+#else
+#define PREVIEW_EXPORT
+#endif
+
+#include "camera_pipe_web_back_lib.h"
+#include "camera_pipe_web_warp_map_lib.h"
+#include "color_tools.h"
+#include "front_cache.h"
+#include "process_options.h"
+#include "tone_curve_utils.h"
+
+using Halide::Runtime::Buffer;
+
+struct OpenrawPreview {
+    ProcessConfig cfg;
+    Buffer<float, 3> linear;
+    Buffer<uint16_t, 2> tone_curve_lut;
+    Buffer<float, 4> color_grading_lut;
+    Buffer<float, 4> rgb_color_lut;
+    Buffer<float, 1> distortion_lut;
+    Buffer<float, 1> vignetting_lut;
+    Buffer<float, 2> tca_lut;
+    Buffer<float, 3> warp_map;
+    bool warp_valid = false;
+    Buffer<uint8_t, 3> output;
+    Buffer<uint32_t, 2> histogram;
+    std::string error;
+};
+
+namespace { // Anonymous namespace for local helpers
+
+bool same_geometry(const ProcessConfig& a, const ProcessConfig& b) {
+    return a.ca_red_cyan == b.ca_red_cyan && a.ca_blue_yellow == b.ca_blue_yellow &&
+           a.geo_rotate == b.geo_rotate && a.geo_scale == b.geo_scale && a.geo_aspect == b.geo_aspect &&
+           a.geo_keystone_v == b.geo_keystone_v && a.geo_keystone_h == b.geo_keystone_h &&
+           a.geo_offset_x == b.geo_offset_x && a.geo_offset_y == b.geo_offset_y;
+}
+
+void build_luts(OpenrawPreview* preview) {
+    preview->tone_curve_lut = ToneCurveUtils::generate_pipeline_lut(preview->cfg);
+    preview->color_grading_lut = HostColor::generate_color_lut(preview->cfg);
+    preview->rgb_color_lut = HostColor::generate_rgb_color_lut(preview->color_grading_lut);
+}
+
+} // namespace
+
+extern "C" {
+
+PREVIEW_EXPORT OpenrawPreview* openraw_preview_create(void) {
+    OpenrawPreview* preview = new OpenrawPreview();
+    build_luts(preview);
+    // The identity (PipelineUtils::LensCorrection::generate_identity_lut):
+    // lens profiles live in the server's Lensfun database.
+    preview->distortion_lut = Buffer<float, 1>(2048);
+    preview->distortion_lut.fill(1.0f);
+    // Likewise no lens vignetting or TCA correction (one-point LUTs).
+    preview->vignetting_lut = Buffer<float, 1>(1);
+    preview->vignetting_lut.fill(1.0f);
+    preview->tca_lut = Buffer<float, 2>(1, 2);
+    preview->tca_lut.fill(1.0f);
+    preview->histogram = Buffer<uint32_t, 2>(256, 4);
+    return preview;
+}
+
+PREVIEW_EXPORT void openraw_preview_destroy(OpenrawPreview* preview) {
+    delete preview;
+}
+
+PREVIEW_EXPORT int openraw_preview_load_front(OpenrawPreview* preview, const uint8_t* data, size_t size) {
+    Buffer<float, 3> linear;
+    if (!FrontCache::decode(data, size, linear)) {
+        preview->error = "not a front-end cache entry, or a damaged one";
+        return -1;
+    }
+    preview->linear = std::move(linear);
+    preview->output = Buffer<uint8_t, 3>::make_interleaved(preview->linear.width(), preview->linear.height(), 4);
+    preview->warp_map = Buffer<float, 3>(preview->linear.width(), preview->linear.height(), 4);
+    preview->warp_valid = false;
+    return 0;
+}
+
+PREVIEW_EXPORT int openraw_preview_set_options(OpenrawPreview* preview, const char* options) {
+    std::vector<std::string> tokens = split_option_line(options ? options : "");
+    std::vector<char*> argv;
+    std::string program = "openraw_preview";
+    argv.push_back(&program[0]);
+    for (std::string& token : tokens) {
+        if (token == "--help") {
+            preview->error = "--help is not a look option";
+            return -1;
+        }
+        argv.push_back(&token[0]);
+    }
+    try {
+        ProcessConfig cfg = parse_args(static_cast<int>(argv.size()), argv.data());
+        if (!same_geometry(cfg, preview->cfg)) preview->warp_valid = false;
+        preview->cfg = cfg;
+        build_luts(preview);
+    } catch (const std::exception& e) {
+        preview->error = e.what();
+        return -1;
+    }
+    return 0;
+}
+
+PREVIEW_EXPORT int openraw_preview_render(OpenrawPreview* preview) {
+    if (!preview->linear.data()) {
+        preview->error = "no front end loaded";
+        return -1;
+    }
+    const ProcessConfig& cfg = preview->cfg;
+    const int width = preview->linear.width(), height = preview->linear.height();
+    if (!preview->warp_valid) {
+        int result = camera_pipe_web_warp_map(width, height, preview->distortion_lut, preview->tca_lut,
+                                              cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                              cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                              cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                              cfg.geo_offset_x, cfg.geo_offset_y, preview->warp_map);
+        if (result != 0) return result;
+        preview->warp_valid = true;
+    }
+    return camera_pipe_web_back(preview->linear, width, height, preview->tone_curve_lut,
+                                cfg.sharpen_strength, cfg.sharpen_radius, cfg.sharpen_threshold,
+                                cfg.ll_detail, cfg.ll_clarity, cfg.ll_shadows, cfg.ll_highlights,
+                                cfg.ll_blacks, cfg.ll_whites, cfg.ll_debug_level,
+                                preview->color_grading_lut, preview->rgb_color_lut,
+                                cfg.vignette_amount, cfg.vignette_midpoint, cfg.vignette_roundness,
+                                cfg.vignette_highlights, preview->vignetting_lut, cfg.dehaze_strength,
+                                preview->linear, preview->distortion_lut, preview->tca_lut,
+                                cfg.ca_red_cyan, cfg.ca_blue_yellow,
+                                cfg.geo_rotate, cfg.geo_scale, cfg.geo_aspect,
+                                cfg.geo_keystone_v, cfg.geo_keystone_h,
+                                cfg.geo_offset_x, cfg.geo_offset_y,
+                                preview->warp_map, preview->output, preview->histogram);
+}
+
+PREVIEW_EXPORT const uint8_t* openraw_preview_pixels(const OpenrawPreview* preview) {
+    return preview->output.data();
+}
+
+PREVIEW_EXPORT int openraw_preview_width(const OpenrawPreview* preview) {
+    return preview->output.data() ? preview->output.width() : 0;
+}
+
+PREVIEW_EXPORT int openraw_preview_height(const OpenrawPreview* preview) {
+    return preview->output.data() ? preview->output.height() : 0;
+}
+
+PREVIEW_EXPORT const uint32_t* openraw_preview_histogram(const OpenrawPreview* preview) {
+    return preview->histogram.data();
+}
+
+PREVIEW_EXPORT const char* openraw_preview_error(const OpenrawPreview* preview) {
+    return preview->error.c_str();
+}
+
+} // extern "C"
@@ -0,0 +1,55 @@
+#ifndef OPENRAW_PREVIEW_H
+#define OPENRAW_PREVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The C API of the in-browser preview (web/openraw_preview.js wraps it).
+//
+// The server renders the front end of a raw once, at 1:4, and ships it as
+// a front-end cache entry (process_f32 --input photo.dng --downscale 4
+// --front-out photo.front). The browser loads that entry here and runs
+// only the back end on it, built for WebAssembly SIMD with threads
+// (camera_pipe_web_back, CMake -DBUILD_WEB_PREVIEW=ON): tone curve,
+// local contrast, colour grading, vignette, dehaze and geometry follow
+// every slider without a round trip. Exposure, white balance and the
+// other front-end options are baked into the entry, and lens profiles
+// aren't looked up, so only the manual geometry is previewed.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct OpenrawPreview OpenrawPreview;
+
+OpenrawPreview* openraw_preview_create(void);
+void openraw_preview_destroy(OpenrawPreview* preview);
+
+// Loads a front-end cache entry (FrontCache::encode). Returns 0, or -1 if
+// it is damaged.
+int openraw_preview_load_front(OpenrawPreview* preview, const uint8_t* data, size_t size);
+
+// Sets the look as process options, e.g. "--contrast 95 --tonemap reinhard"
+// (a --looks line without its name), over the defaults. Returns 0, or -1
+// with the reason in openraw_preview_error().
+int openraw_preview_set_options(OpenrawPreview* preview, const char* options);
+
+// Renders the loaded front end with the look. Returns the Halide error
+// code, or -1 if nothing is loaded.
+int openraw_preview_render(OpenrawPreview* preview);
+
+// The last render: interleaved RGBA, width * height * 4 bytes, valid until
+// the next load or render.
+const uint8_t* openraw_preview_pixels(const OpenrawPreview* preview);
+int openraw_preview_width(const OpenrawPreview* preview);
+int openraw_preview_height(const OpenrawPreview* preview);
+// 256 bins x (R, G, B, luma) counts of the last render.
+const uint32_t* openraw_preview_histogram(const OpenrawPreview* preview);
+
+const char* openraw_preview_error(const OpenrawPreview* preview);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OPENRAW_PREVIEW_H